@@ -7,6 +7,7 @@
  */
 #define LIBFEEDBACK_USE_UNSTABLE_API
 #include "libfeedback.h"
+#include "lfb-names.h"
 
 #include <glib.h>
 #include <gio/gio.h>
@@ -15,6 +16,8 @@
 #include <locale.h>
 
 #define DEFAULT_EVENT "phone-incoming-call"
+/* A short event so feedbacks don't pile up */
+#define DEFAULT_LOAD_EVENT "button-pressed"
 
 static GMainLoop *loop;
 
@@ -140,6 +143,432 @@ set_profile (const gchar *profile)
   return TRUE;
 }
 
+/* Upper bound of the bucket holding the given percentile */
+static guint64
+get_percentile (GVariant *buckets, guint64 count, guint percent)
+{
+  guint64 needed = (count * percent + 99) / 100;
+  guint64 seen = 0;
+  gsize n_buckets;
+  const guint64 *values = g_variant_get_fixed_array (buckets, &n_buckets, sizeof (guint64));
+
+  for (gsize i = 0; i < n_buckets; i++) {
+    seen += values[i];
+    if (seen >= needed)
+      return (guint64)1 << i;
+  }
+
+  return (guint64)1 << n_buckets;
+}
+
+static gboolean
+show_stats (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedbackStats) proxy = NULL;
+  g_autoptr (GVariant) counters = NULL;
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GVariant) buckets = NULL;
+  GVariantIter iter;
+  const char *name;
+  guint64 value, count, sum, max;
+
+  proxy = lfb_gdbus_feedback_stats_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                           G_DBUS_PROXY_FLAGS_NONE,
+                                                           FB_DBUS_NAME,
+                                                           FB_DBUS_PATH,
+                                                           NULL,
+                                                           &err);
+  if (proxy == NULL) {
+    g_print ("Failed to connect to feedbackd: %s\n", err->message);
+    return FALSE;
+  }
+
+  if (!lfb_gdbus_feedback_stats_call_get_stats_sync (proxy, &counters, &histograms, NULL, &err)) {
+    g_print ("Failed to get stats: %s\n", err->message);
+    return FALSE;
+  }
+
+  g_print ("Counters:\n");
+  g_variant_iter_init (&iter, counters);
+  while (g_variant_iter_next (&iter, "{&st}", &name, &value))
+    g_print ("  %-20s %" G_GUINT64_FORMAT "\n", name, value);
+
+  g_print ("Histograms (µs):\n");
+  g_print ("  %-20s %8s %8s %8s %8s %8s\n", "", "count", "avg", "max", "p50<", "p99<");
+  g_variant_iter_init (&iter, histograms);
+  while (g_variant_iter_next (&iter, "{&s(ttt@at)}", &name, &count, &sum, &max, &buckets)) {
+    if (count) {
+      g_print ("  %-20s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+               " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT "\n",
+               name, count, sum / count, max,
+               get_percentile (buckets, count, 50),
+               get_percentile (buckets, count, 99));
+    } else {
+      g_print ("  %-20s %8d\n", name, 0);
+    }
+    g_clear_pointer (&buckets, g_variant_unref);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+show_history (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedbackStats) proxy = NULL;
+  g_autoptr (GVariant) events = NULL;
+  g_autoptr (GVariantIter) feedbacks = NULL;
+  GVariantIter iter;
+  const char *app_id, *event, *level, *reason, *kind;
+  gint64 time, duration;
+  guint id;
+
+  proxy = lfb_gdbus_feedback_stats_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                           G_DBUS_PROXY_FLAGS_NONE,
+                                                           FB_DBUS_NAME,
+                                                           FB_DBUS_PATH,
+                                                           NULL,
+                                                           &err);
+  if (proxy == NULL) {
+    g_print ("Failed to connect to feedbackd: %s\n", err->message);
+    return FALSE;
+  }
+
+  if (!lfb_gdbus_feedback_stats_call_get_history_sync (proxy, &events, NULL, &err)) {
+    g_print ("Failed to get history: %s\n", err->message);
+    return FALSE;
+  }
+
+  g_print ("%-12s %6s %-30s %-24s %-6s %-18s %-9s %9s\n", "time", "id", "app-id", "event",
+           "level", "feedbacks", "ended", "ms");
+  g_variant_iter_init (&iter, events);
+  while (g_variant_iter_next (&iter, "(u&s&s&sas&sxx)", &id, &app_id, &event, &level,
+                              &feedbacks, &reason, &time, &duration)) {
+    g_autoptr (GDateTime) dt = g_date_time_new_from_unix_local (time / G_USEC_PER_SEC);
+    g_autofree char *timestamp = g_date_time_format (dt, "%T");
+    g_autoptr (GString) kinds = g_string_new (NULL);
+
+    while (g_variant_iter_next (feedbacks, "&s", &kind))
+      g_string_append_printf (kinds, "%s%s", kinds->len ? "," : "", kind);
+    g_clear_pointer (&feedbacks, g_variant_iter_free);
+
+    g_print ("%s.%03d %6u %-30s %-24s %-6s %-18s %-9s %9.1f\n", timestamp,
+             (int)(time % G_USEC_PER_SEC / 1000), id, app_id, event, level,
+             kinds->len ? kinds->str : "-", *reason ? reason : "running",
+             duration / 1000.0);
+  }
+
+  return TRUE;
+}
+
+/* How often the load generator checks whether to send more events */
+#define LOAD_TICK_MS 10
+
+typedef struct {
+  LfbGdbusFeedback       *proxy;
+  LfbGdbusFeedbackHaptic *haptic;
+  const char             *event;
+  GPtrArray              *app_ids;
+  guint                   rate;
+  gint64                  start;
+  gint64                  stop;
+  guint64                 n_sent;
+  guint64                 n_failed;
+  guint64                 n_rate_limited;
+  guint                   n_outstanding;
+  /* Key: event id, value: time the reply arrived */
+  GHashTable             *pending;
+  GArray                 *trigger_latencies;
+  GArray                 *ended_latencies;
+  GArray                 *haptic_latencies;
+} FbcliLoad;
+
+typedef struct {
+  FbcliLoad *load;
+  gint64     sent;
+} FbcliLoadCall;
+
+
+static void
+load_check_done (FbcliLoad *load)
+{
+  if (g_get_monotonic_time () < load->stop)
+    return;
+
+  if (load->n_outstanding == 0 && g_hash_table_size (load->pending) == 0)
+    g_main_loop_quit (loop);
+}
+
+
+static void
+on_load_feedback_ended (LfbGdbusFeedback *proxy, guint id, guint reason, FbcliLoad *load)
+{
+  gpointer replied;
+  gint64 latency;
+
+  if (!g_hash_table_lookup_extended (load->pending, GUINT_TO_POINTER (id), NULL, &replied))
+    return;
+
+  latency = g_get_monotonic_time () - *(gint64 *)replied;
+  g_array_append_val (load->ended_latencies, latency);
+  g_hash_table_remove (load->pending, GUINT_TO_POINTER (id));
+
+  load_check_done (load);
+}
+
+
+static void
+on_load_trigger_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autofree FbcliLoadCall *call = user_data;
+  FbcliLoad *load = call->load;
+  g_autoptr (GError) err = NULL;
+  gint64 now = g_get_monotonic_time (), latency;
+  gint64 *replied;
+  guint id;
+
+  load->n_outstanding--;
+
+  if (!lfb_gdbus_feedback_call_trigger_feedback_finish (LFB_GDBUS_FEEDBACK (source_object),
+                                                        &id, res, &err)) {
+    g_autofree char *remote = g_dbus_error_get_remote_error (err);
+
+    if (g_strcmp0 (remote, FB_DBUS_ERROR_RATE_LIMITED) == 0)
+      load->n_rate_limited++;
+    else
+      load->n_failed++;
+    g_debug ("Failed to trigger feedback: %s", err->message);
+    load_check_done (load);
+    return;
+  }
+
+  latency = now - call->sent;
+  g_array_append_val (load->trigger_latencies, latency);
+
+  /* Nothing to wait for */
+  if (id == FB_EVENT_ID_NO_FEEDBACK) {
+    load_check_done (load);
+    return;
+  }
+
+  replied = g_new (gint64, 1);
+  *replied = now;
+  g_hash_table_insert (load->pending, GUINT_TO_POINTER (id), replied);
+}
+
+
+static void
+on_load_vibrate_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autofree FbcliLoadCall *call = user_data;
+  FbcliLoad *load = call->load;
+  g_autoptr (GError) err = NULL;
+  gint64 latency;
+
+  load->n_outstanding--;
+
+  if (!lfb_gdbus_feedback_haptic_call_vibrate_finish (LFB_GDBUS_FEEDBACK_HAPTIC (source_object),
+                                                      NULL, res, &err)) {
+    load->n_failed++;
+    g_debug ("Failed to vibrate: %s", err->message);
+  } else {
+    latency = g_get_monotonic_time () - call->sent;
+    g_array_append_val (load->haptic_latencies, latency);
+  }
+
+  load_check_done (load);
+}
+
+
+static void
+load_send_one (FbcliLoad *load)
+{
+  const char *app_id = g_ptr_array_index (load->app_ids, load->n_sent % load->app_ids->len);
+  FbcliLoadCall *call;
+
+  call = g_new0 (FbcliLoadCall, 1);
+  call->load = load;
+  call->sent = g_get_monotonic_time ();
+  load->n_outstanding++;
+  lfb_gdbus_feedback_call_trigger_feedback (load->proxy,
+                                            app_id,
+                                            load->event,
+                                            g_variant_new ("a{sv}", NULL),
+                                            -1,
+                                            NULL,
+                                            on_load_trigger_finished,
+                                            call);
+
+  if (load->haptic) {
+    GVariantBuilder pattern;
+
+    g_variant_builder_init (&pattern, G_VARIANT_TYPE ("a(du)"));
+    g_variant_builder_add (&pattern, "(du)", 0.5, 20);
+    g_variant_builder_add (&pattern, "(du)", 0.0, 20);
+    g_variant_builder_add (&pattern, "(du)", 0.8, 20);
+
+    call = g_new0 (FbcliLoadCall, 1);
+    call->load = load;
+    call->sent = g_get_monotonic_time ();
+    load->n_outstanding++;
+    lfb_gdbus_feedback_haptic_call_vibrate (load->haptic,
+                                            app_id,
+                                            g_variant_builder_end (&pattern),
+                                            NULL,
+                                            on_load_vibrate_finished,
+                                            call);
+  }
+
+  load->n_sent++;
+}
+
+
+static gboolean
+on_load_tick (gpointer user_data)
+{
+  FbcliLoad *load = user_data;
+  gint64 now = g_get_monotonic_time ();
+  guint64 due;
+
+  if (now >= load->stop) {
+    load_check_done (load);
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Catch up if the main loop got delayed */
+  due = (now - load->start) * load->rate / G_USEC_PER_SEC;
+  while (load->n_sent < due)
+    load_send_one (load);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static int
+cmp_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *)a, lb = *(const gint64 *)b;
+
+  return (la > lb) - (la < lb);
+}
+
+
+static void
+print_latencies (const char *name, GArray *latencies)
+{
+  guint n = latencies->len;
+
+  if (n == 0) {
+    g_print ("  %-20s %8d\n", name, 0);
+    return;
+  }
+
+  g_array_sort (latencies, cmp_latency);
+  g_print ("  %-20s %8u %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT
+           " %8" G_GINT64_FORMAT "\n",
+           name, n,
+           g_array_index (latencies, gint64, (n - 1) * 50 / 100),
+           g_array_index (latencies, gint64, (n - 1) * 90 / 100),
+           g_array_index (latencies, gint64, (n - 1) * 99 / 100),
+           g_array_index (latencies, gint64, n - 1));
+}
+
+/*
+ * Fires `rate` events per second spread over `n_apps` app ids for
+ * `duration` seconds and prints latency percentiles. The events go
+ * over D-Bus directly as libfeedback only uses a single app id.
+ */
+static gboolean
+run_load (const char *event,
+          guint       rate,
+          guint       n_apps,
+          guint       duration,
+          gboolean    haptic,
+          guint       watch)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  g_autoptr (LfbGdbusFeedbackHaptic) haptic_proxy = NULL;
+  g_autoptr (GPtrArray) app_ids = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GHashTable) pending = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                          NULL, g_free);
+  g_autoptr (GArray) trigger_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  g_autoptr (GArray) ended_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  g_autoptr (GArray) haptic_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  FbcliLoad load = { 0 };
+  guint n_unended;
+
+  proxy = lfb_gdbus_feedback_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                     G_DBUS_PROXY_FLAGS_NONE,
+                                                     FB_DBUS_NAME,
+                                                     FB_DBUS_PATH,
+                                                     NULL,
+                                                     &err);
+  if (proxy == NULL) {
+    g_print ("Failed to connect to feedbackd: %s\n", err->message);
+    return FALSE;
+  }
+
+  if (haptic) {
+    haptic_proxy = lfb_gdbus_feedback_haptic_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                                     G_DBUS_PROXY_FLAGS_NONE,
+                                                                     FB_DBUS_NAME,
+                                                                     FB_DBUS_PATH,
+                                                                     NULL,
+                                                                     &err);
+    if (haptic_proxy == NULL) {
+      g_print ("Failed to connect to feedbackd's haptic interface: %s\n", err->message);
+      return FALSE;
+    }
+  }
+
+  for (guint i = 0; i < n_apps; i++)
+    g_ptr_array_add (app_ids, g_strdup_printf ("org.sigxcpu.fbcli.Load%u", i));
+
+  load.proxy = proxy;
+  load.haptic = haptic_proxy;
+  load.event = event;
+  load.app_ids = app_ids;
+  load.rate = rate;
+  load.pending = pending;
+  load.trigger_latencies = trigger_latencies;
+  load.ended_latencies = ended_latencies;
+  load.haptic_latencies = haptic_latencies;
+
+  g_signal_connect (proxy, "feedback-ended", G_CALLBACK (on_load_feedback_ended), &load);
+  g_unix_signal_add (SIGTERM, on_shutdown_signal, NULL);
+  g_unix_signal_add (SIGINT, on_shutdown_signal, NULL);
+
+  g_print ("Triggering %u '%s' events per second from %u app ids for %u seconds\n",
+           rate, event, n_apps, duration);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  load.start = g_get_monotonic_time ();
+  load.stop = load.start + (gint64)duration * G_USEC_PER_SEC;
+  g_timeout_add (LOAD_TICK_MS, on_load_tick, &load);
+  g_timeout_add_seconds (duration + watch, (GSourceFunc)on_watch_expired, NULL);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  g_signal_handlers_disconnect_by_data (proxy, &load);
+  n_unended = g_hash_table_size (pending);
+
+  g_print ("Sent: %" G_GUINT64_FORMAT ", failed: %" G_GUINT64_FORMAT
+           ", rate limited: %" G_GUINT64_FORMAT ", not ended: %u\n",
+           load.n_sent, load.n_failed, load.n_rate_limited, n_unended);
+  g_print ("Latencies (µs):\n");
+  g_print ("  %-20s %8s %8s %8s %8s %8s\n", "", "count", "p50", "p90", "p99", "max");
+  print_latencies ("trigger-feedback", trigger_latencies);
+  /* From the reply until the signal, includes the feedback's duration */
+  print_latencies ("feedback-ended", ended_latencies);
+  if (haptic)
+    print_latencies ("haptic-vibrate", haptic_latencies);
+
+  return load.n_failed == 0;
+}
+
 int
 main (int argc, char *argv[0])
 {
@@ -149,9 +578,10 @@ main (int argc, char *argv[0])
   g_autofree char *app_id = NULL;
   g_autofree char *sound_file = NULL;
   const char *name = NULL;
-  gboolean success, important = FALSE;
+  gboolean success, important = FALSE, stats = FALSE, history = FALSE, load_haptic = FALSE;
   int watch = 30;
   int timeout = -1;
+  int load_rate = 0, load_apps = 1, load_duration = 10;
   const GOptionEntry options [] = {
     {"event", 'E', 0, G_OPTION_ARG_STRING, &name,
      "Event name. (default: " DEFAULT_EVENT ").", NULL},
@@ -167,6 +597,18 @@ main (int argc, char *argv[0])
      "Override used application id"},
     {"sound-file", 'S', 0, G_OPTION_ARG_STRING, &sound_file,
      "Override the sound effect used by a file"},
+    {"stats", 0, 0, G_OPTION_ARG_NONE, &stats,
+     "Show feedbackd's performance metrics", NULL},
+    {"history", 0, 0, G_OPTION_ARG_NONE, &history,
+     "Show the events feedbackd handled recently", NULL},
+    {"load", 0, 0, G_OPTION_ARG_INT, &load_rate,
+     "Trigger RATE events per second and measure latencies", "RATE"},
+    {"load-apps", 0, 0, G_OPTION_ARG_INT, &load_apps,
+     "Number of app ids to spread the load over", "N"},
+    {"load-duration", 0, 0, G_OPTION_ARG_INT, &load_duration,
+     "How long to generate load in seconds", "SECONDS"},
+    {"load-haptic", 0, 0, G_OPTION_ARG_NONE, &load_haptic,
+     "Also send a haptic pattern for each event", NULL},
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
   };
 
@@ -178,6 +620,21 @@ main (int argc, char *argv[0])
     return 1;
   }
 
+  if (stats)
+    return !show_stats ();
+
+  if (history)
+    return !show_history ();
+
+  if (load_rate > 0) {
+    if (load_apps < 1 || load_duration < 1) {
+      g_print ("Need at least one app id and a duration of one second\n");
+      return 1;
+    }
+    return !run_load (name ?: DEFAULT_LOAD_EVENT, load_rate, load_apps, load_duration,
+                      load_haptic, MAX (watch, 0));
+  }
+
   if (!app_id)
     app_id = g_strdup ("org.sigxcpu.fbcli");
 
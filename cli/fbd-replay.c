@@ -0,0 +1,600 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define LIBFEEDBACK_USE_UNSTABLE_API
+#include "libfeedback.h"
+#include "lfb-names.h"
+#include "fbd-record-format.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include <locale.h>
+#include <string.h>
+
+/*
+ * Replays a trace recorded by feedbackd (see FEEDBACKD_RECORD) against
+ * a running daemon and reports where the outcome differs from the
+ * recording along with latencies.
+ */
+
+typedef struct {
+  LfbGdbusFeedback       *proxy;
+  LfbGdbusFeedbackHaptic *haptic;
+  GMainLoop              *loop;
+
+  GPtrArray              *records;
+  guint                   next;
+  double                  speed;
+  gint64                  start;
+  guint                   timer_id;
+  gboolean                verbose;
+
+  /* Key: recorded event id, value: replayed event id */
+  GHashTable             *ids;
+  /* Key: replayed event id, value: recorded event id */
+  GHashTable             *running;
+  /* Key: recorded event id, value: recorded end reason + 1 */
+  GHashTable             *expected_reasons;
+  /* Recorded event ids ended before the trigger's reply arrived */
+  GHashTable             *pending_ends;
+  guint                   n_outstanding;
+
+  guint64                 n_replayed;
+  guint64                 n_divergences;
+  GArray                 *trigger_latencies;
+  GArray                 *vibrate_latencies;
+  GArray                 *lags;
+} FbdReplay;
+
+typedef struct {
+  FbdReplay *replay;
+  GVariant  *record;
+  gint64     sent;
+} FbdReplayCall;
+
+
+static const char *
+result_to_string (guint result)
+{
+  switch (result) {
+  case FBD_RECORD_RESULT_OK:
+    return "ok";
+  case FBD_RECORD_RESULT_RATE_LIMITED:
+    return "rate-limited";
+  case FBD_RECORD_RESULT_INVALID:
+    return "invalid";
+  case FBD_RECORD_RESULT_DROPPED:
+    return "dropped";
+  default:
+    return "unknown";
+  }
+}
+
+
+static void
+report_divergence (FbdReplay *replay, GVariant *record, const char *format, ...) G_GNUC_PRINTF (3, 4);
+
+static void
+report_divergence (FbdReplay *replay, GVariant *record, const char *format, ...)
+{
+  g_autofree char *msg = NULL;
+  const char *app_id, *name;
+  gint64 timestamp;
+  va_list args;
+
+  va_start (args, format);
+  msg = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_variant_get (record, "(yx&s&s&s@a{sv}iuu)", NULL, &timestamp, NULL, &app_id, &name,
+                 NULL, NULL, NULL, NULL);
+  g_print ("%10.3fs %s %s: %s\n", timestamp / (double)G_USEC_PER_SEC, app_id, name, msg);
+  replay->n_divergences++;
+}
+
+
+static void
+replay_check_done (FbdReplay *replay)
+{
+  if (replay->next < replay->records->len || replay->n_outstanding)
+    return;
+
+  if (g_hash_table_size (replay->running))
+    return;
+
+  g_main_loop_quit (replay->loop);
+}
+
+
+static GVariant *
+find_trigger (FbdReplay *replay, guint recorded_id)
+{
+  for (guint i = 0; i < replay->records->len; i++) {
+    GVariant *record = g_ptr_array_index (replay->records, i);
+    guchar kind;
+    guint id;
+
+    g_variant_get (record, "(yxsss@a{sv}iuu)", &kind, NULL, NULL, NULL, NULL, NULL, NULL,
+                   &id, NULL);
+    if (kind == FBD_RECORD_KIND_TRIGGER && id == recorded_id)
+      return record;
+  }
+
+  return NULL;
+}
+
+
+static void
+on_feedback_ended (LfbGdbusFeedback *proxy, guint id, guint reason, FbdReplay *replay)
+{
+  gpointer recorded, expected;
+
+  if (!g_hash_table_lookup_extended (replay->running, GUINT_TO_POINTER (id), NULL, &recorded))
+    return;
+
+  if (g_hash_table_lookup_extended (replay->expected_reasons, recorded, NULL, &expected) &&
+      GPOINTER_TO_UINT (expected) - 1 != reason) {
+    report_divergence (replay, find_trigger (replay, GPOINTER_TO_UINT (recorded)),
+                       "ended with reason %u, recorded %u",
+                       reason, GPOINTER_TO_UINT (expected) - 1);
+  }
+
+  g_hash_table_remove (replay->running, GUINT_TO_POINTER (id));
+  replay_check_done (replay);
+}
+
+
+static void
+end_event (FbdReplay *replay, guint replayed_id)
+{
+  lfb_gdbus_feedback_call_end_feedback (replay->proxy, replayed_id, NULL, NULL, NULL);
+}
+
+
+static void
+on_trigger_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdReplayCall *call = user_data;
+  FbdReplay *replay = call->replay;
+  g_autoptr (GError) err = NULL;
+  guint recorded_id, recorded_result, id, result;
+  gint64 latency = g_get_monotonic_time () - call->sent;
+
+  replay->n_outstanding--;
+  g_variant_get (call->record, "(yxsss@a{sv}iuu)", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                 &recorded_id, &recorded_result);
+
+  if (lfb_gdbus_feedback_call_trigger_feedback_finish (LFB_GDBUS_FEEDBACK (source_object),
+                                                       &id, res, &err)) {
+    result = FBD_RECORD_RESULT_OK;
+    g_array_append_val (replay->trigger_latencies, latency);
+  } else {
+    g_autofree char *remote = g_dbus_error_get_remote_error (err);
+
+    id = 0;
+    result = g_strcmp0 (remote, FB_DBUS_ERROR_RATE_LIMITED) ? FBD_RECORD_RESULT_INVALID :
+      FBD_RECORD_RESULT_RATE_LIMITED;
+  }
+
+  if (result != recorded_result) {
+    report_divergence (replay, call->record, "%s, recorded %s",
+                       result_to_string (result), result_to_string (recorded_result));
+  }
+
+  if (id && recorded_id) {
+    g_hash_table_insert (replay->ids, GUINT_TO_POINTER (recorded_id), GUINT_TO_POINTER (id));
+    g_hash_table_insert (replay->running, GUINT_TO_POINTER (id), GUINT_TO_POINTER (recorded_id));
+    if (g_hash_table_remove (replay->pending_ends, GUINT_TO_POINTER (recorded_id)))
+      end_event (replay, id);
+  }
+
+  g_variant_unref (call->record);
+  g_free (call);
+  replay_check_done (replay);
+}
+
+
+static void
+on_vibrate_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdReplayCall *call = user_data;
+  FbdReplay *replay = call->replay;
+  g_autoptr (GError) err = NULL;
+  guint recorded_result, result;
+  gboolean success;
+  gint64 latency = g_get_monotonic_time () - call->sent;
+
+  replay->n_outstanding--;
+  g_variant_get (call->record, "(yxsss@a{sv}iuu)", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                 NULL, &recorded_result);
+
+  if (lfb_gdbus_feedback_haptic_call_vibrate_finish (LFB_GDBUS_FEEDBACK_HAPTIC (source_object),
+                                                     &success, res, &err)) {
+    result = success ? FBD_RECORD_RESULT_OK : FBD_RECORD_RESULT_DROPPED;
+    g_array_append_val (replay->vibrate_latencies, latency);
+  } else {
+    g_autofree char *remote = g_dbus_error_get_remote_error (err);
+
+    result = g_strcmp0 (remote, FB_DBUS_ERROR_RATE_LIMITED) ? FBD_RECORD_RESULT_INVALID :
+      FBD_RECORD_RESULT_RATE_LIMITED;
+  }
+
+  if (result != recorded_result) {
+    report_divergence (replay, call->record, "vibrate %s, recorded %s",
+                       result_to_string (result), result_to_string (recorded_result));
+  }
+
+  g_variant_unref (call->record);
+  g_free (call);
+  replay_check_done (replay);
+}
+
+
+static FbdReplayCall *
+replay_call_new (FbdReplay *replay, GVariant *record)
+{
+  FbdReplayCall *call = g_new0 (FbdReplayCall, 1);
+
+  call->replay = replay;
+  call->record = g_variant_ref (record);
+  call->sent = g_get_monotonic_time ();
+  replay->n_outstanding++;
+
+  return call;
+}
+
+
+static void
+replay_record (FbdReplay *replay, GVariant *record)
+{
+  g_autoptr (GVariant) hints = NULL;
+  const char *app_id, *name;
+  guchar kind;
+  int timeout;
+  guint id;
+  gpointer replayed;
+
+  g_variant_get (record, "(yx&s&s&s@a{sv}iuu)", &kind, NULL, NULL, &app_id, &name, &hints,
+                 &timeout, &id, NULL);
+
+  if (replay->verbose)
+    g_print ("Replaying '%c' %s %s %u\n", kind, app_id, name, id);
+
+  switch (kind) {
+  case FBD_RECORD_KIND_TRIGGER:
+    lfb_gdbus_feedback_call_trigger_feedback (replay->proxy, app_id, name, hints, timeout, NULL,
+                                              on_trigger_finished,
+                                              replay_call_new (replay, record));
+    break;
+  case FBD_RECORD_KIND_END:
+    if (g_hash_table_lookup_extended (replay->ids, GUINT_TO_POINTER (id), NULL, &replayed))
+      end_event (replay, GPOINTER_TO_UINT (replayed));
+    else
+      g_hash_table_add (replay->pending_ends, GUINT_TO_POINTER (id));
+    break;
+  case FBD_RECORD_KIND_VIBRATE: {
+    g_autoptr (GVariant) pattern = g_variant_lookup_value (hints, "pattern",
+                                                           G_VARIANT_TYPE ("a(du)"));
+    guint repeat_count, repeat_from = 0;
+
+    if (pattern == NULL || replay->haptic == NULL)
+      break;
+
+    /* Vibrate and VibrateEx have the same reply so share the callback */
+    if (g_variant_lookup (hints, "repeat-count", "u", &repeat_count)) {
+      g_variant_lookup (hints, "repeat-from", "u", &repeat_from);
+      lfb_gdbus_feedback_haptic_call_vibrate_ex (replay->haptic, app_id, pattern,
+                                                 repeat_count, repeat_from, NULL,
+                                                 on_vibrate_finished,
+                                                 replay_call_new (replay, record));
+      break;
+    }
+
+    lfb_gdbus_feedback_haptic_call_vibrate (replay->haptic, app_id, pattern, NULL,
+                                            on_vibrate_finished,
+                                            replay_call_new (replay, record));
+    break;
+  }
+  case FBD_RECORD_KIND_PROFILE:
+    lfb_gdbus_feedback_set_profile (replay->proxy, name);
+    break;
+  case FBD_RECORD_KIND_ENDED:
+    /* Only used as expectation */
+    return;
+  default:
+    g_warning ("Unknown record kind '%c'", kind);
+    return;
+  }
+
+  replay->n_replayed++;
+}
+
+
+static gint64
+record_due (FbdReplay *replay, GVariant *record)
+{
+  gint64 timestamp;
+
+  g_variant_get (record, "(yxsss@a{sv}iuu)", NULL, &timestamp, NULL, NULL, NULL, NULL, NULL,
+                 NULL, NULL);
+
+  return replay->start + (gint64)(timestamp / replay->speed);
+}
+
+
+static gboolean on_replay_timeout (gpointer user_data);
+
+static void
+schedule_next (FbdReplay *replay)
+{
+  gint64 delay;
+
+  if (replay->next == replay->records->len) {
+    replay_check_done (replay);
+    return;
+  }
+
+  delay = record_due (replay, g_ptr_array_index (replay->records, replay->next)) -
+    g_get_monotonic_time ();
+  replay->timer_id = g_timeout_add (MAX (delay, 0) / 1000, on_replay_timeout, replay);
+}
+
+
+static gboolean
+on_replay_timeout (gpointer user_data)
+{
+  FbdReplay *replay = user_data;
+  gint64 now = g_get_monotonic_time ();
+
+  replay->timer_id = 0;
+
+  while (replay->next < replay->records->len) {
+    GVariant *record = g_ptr_array_index (replay->records, replay->next);
+    gint64 due = record_due (replay, record), lag;
+
+    /* Timeouts have millisecond granularity */
+    if (due > now + 1000)
+      break;
+
+    lag = MAX (now - due, 0);
+    g_array_append_val (replay->lags, lag);
+    replay_record (replay, record);
+    replay->next++;
+  }
+
+  schedule_next (replay);
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+load_trace (const char *path, GPtrArray *records, GHashTable *expected_reasons, GError **error)
+{
+  g_autofree char *contents = NULL;
+  gsize len, pos;
+  guint32 version;
+
+  if (!g_file_get_contents (path, &contents, &len, error))
+    return FALSE;
+
+  if (len < FBD_RECORD_MAGIC_LEN + sizeof (guint32) ||
+      memcmp (contents, FBD_RECORD_MAGIC, FBD_RECORD_MAGIC_LEN) != 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a feedbackd trace");
+    return FALSE;
+  }
+
+  memcpy (&version, contents + FBD_RECORD_MAGIC_LEN, sizeof (version));
+  version = GUINT32_FROM_LE (version);
+  if (version != FBD_RECORD_VERSION) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Unsupported trace version %u", version);
+    return FALSE;
+  }
+
+  pos = FBD_RECORD_MAGIC_LEN + sizeof (version);
+  while (pos + sizeof (guint32) <= len) {
+    g_autoptr (GBytes) bytes = NULL;
+    GVariant *record;
+    guint32 size;
+    guchar kind;
+    guint id, result;
+
+    memcpy (&size, contents + pos, sizeof (size));
+    size = GUINT32_FROM_LE (size);
+    pos += sizeof (size);
+
+    /* A trace cut off by a crash still has its earlier records */
+    if (size > FBD_RECORD_MAX_SIZE || pos + size > len) {
+      g_warning ("Truncated record at offset %" G_GSIZE_FORMAT ", ignoring the rest", pos);
+      break;
+    }
+
+    bytes = g_bytes_new (contents + pos, size);
+    record = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FBD_RECORD_TYPE),
+                                                           bytes, FALSE));
+    if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+      GVariant *swapped = g_variant_byteswap (record);
+
+      g_variant_unref (record);
+      record = swapped;
+    }
+    pos += size;
+
+    g_variant_get (record, "(yxsss@a{sv}iuu)", &kind, NULL, NULL, NULL, NULL, NULL, NULL,
+                   &id, &result);
+    if (kind == FBD_RECORD_KIND_ENDED)
+      g_hash_table_insert (expected_reasons, GUINT_TO_POINTER (id), GUINT_TO_POINTER (result + 1));
+
+    g_ptr_array_add (records, record);
+  }
+
+  return TRUE;
+}
+
+
+static int
+cmp_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(const gint64 *)a, lb = *(const gint64 *)b;
+
+  return (la > lb) - (la < lb);
+}
+
+
+static void
+print_latencies (const char *name, GArray *latencies)
+{
+  guint n = latencies->len;
+
+  if (n == 0) {
+    g_print ("  %-20s %8d\n", name, 0);
+    return;
+  }
+
+  g_array_sort (latencies, cmp_latency);
+  g_print ("  %-20s %8u %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT
+           " %8" G_GINT64_FORMAT "\n",
+           name, n,
+           g_array_index (latencies, gint64, (n - 1) * 50 / 100),
+           g_array_index (latencies, gint64, (n - 1) * 90 / 100),
+           g_array_index (latencies, gint64, (n - 1) * 99 / 100),
+           g_array_index (latencies, gint64, n - 1));
+}
+
+
+static gboolean
+on_shutdown_signal (gpointer user_data)
+{
+  FbdReplay *replay = user_data;
+
+  g_main_loop_quit (replay->loop);
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_watch_expired (gpointer user_data)
+{
+  FbdReplay *replay = user_data;
+
+  g_print ("Watch expired waiting for all feedbacks to end\n");
+  g_main_loop_quit (replay->loop);
+  return G_SOURCE_REMOVE;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GPtrArray) records = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  FbdReplay replay = { 0 };
+  double speed = 1.0;
+  gboolean verbose = FALSE;
+  int watch = 30;
+  gint64 duration = 0;
+  const GOptionEntry options [] = {
+    {"speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+     "Replay faster (> 1.0) or slower (< 1.0) than recorded", "FACTOR"},
+    {"watch", 'w', 0, G_OPTION_ARG_INT, &watch,
+     "How long to wait for feedbacks to end after the last record", "SECONDS"},
+    {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+     "Print each replayed record", NULL},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  setlocale (LC_ALL, "");
+  opt_context = g_option_context_new ("TRACE - Replay a recorded feedbackd workload");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_warning ("%s", err->message);
+    return 1;
+  }
+
+  if (argc != 2 || speed <= 0.0) {
+    g_print ("Usage: %s [--speed=FACTOR] TRACE\n", argv[0]);
+    return 1;
+  }
+
+  replay.expected_reasons = g_hash_table_new (g_direct_hash, g_direct_equal);
+  if (!load_trace (argv[1], records, replay.expected_reasons, &err)) {
+    g_print ("Failed to load trace: %s\n", err->message);
+    return 1;
+  }
+
+  replay.proxy = lfb_gdbus_feedback_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                            G_DBUS_PROXY_FLAGS_NONE,
+                                                            FB_DBUS_NAME,
+                                                            FB_DBUS_PATH,
+                                                            NULL,
+                                                            &err);
+  if (replay.proxy == NULL) {
+    g_print ("Failed to connect to feedbackd: %s\n", err->message);
+    return 1;
+  }
+  /* The haptic interface is optional */
+  replay.haptic = lfb_gdbus_feedback_haptic_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                                    FB_DBUS_NAME,
+                                                                    FB_DBUS_PATH,
+                                                                    NULL,
+                                                                    NULL);
+
+  replay.loop = g_main_loop_new (NULL, FALSE);
+  replay.records = records;
+  replay.speed = speed;
+  replay.verbose = verbose;
+  replay.ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  replay.running = g_hash_table_new (g_direct_hash, g_direct_equal);
+  replay.pending_ends = g_hash_table_new (g_direct_hash, g_direct_equal);
+  replay.trigger_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  replay.vibrate_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  replay.lags = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  g_signal_connect (replay.proxy, "feedback-ended", G_CALLBACK (on_feedback_ended), &replay);
+  g_unix_signal_add (SIGTERM, on_shutdown_signal, &replay);
+  g_unix_signal_add (SIGINT, on_shutdown_signal, &replay);
+
+  if (records->len) {
+    g_variant_get (g_ptr_array_index (records, records->len - 1), "(yxsss@a{sv}iuu)",
+                   NULL, &duration, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  }
+  g_print ("Replaying %u records spanning %.1fs at %.2fx speed\n",
+           records->len, duration / (double)G_USEC_PER_SEC, speed);
+
+  replay.start = g_get_monotonic_time ();
+  g_timeout_add_seconds (duration / speed / G_USEC_PER_SEC + watch, on_watch_expired, &replay);
+  schedule_next (&replay);
+  g_main_loop_run (replay.loop);
+
+  g_signal_handlers_disconnect_by_data (replay.proxy, &replay);
+  g_clear_handle_id (&replay.timer_id, g_source_remove);
+
+  g_print ("Replayed: %" G_GUINT64_FORMAT ", divergences: %" G_GUINT64_FORMAT
+           ", not ended: %u\n",
+           replay.n_replayed, replay.n_divergences, g_hash_table_size (replay.running));
+  g_print ("Latencies (µs):\n");
+  g_print ("  %-20s %8s %8s %8s %8s %8s\n", "", "count", "p50", "p90", "p99", "max");
+  print_latencies ("trigger-feedback", replay.trigger_latencies);
+  print_latencies ("haptic-vibrate", replay.vibrate_latencies);
+  print_latencies ("schedule-lag", replay.lags);
+
+  g_clear_object (&replay.haptic);
+  g_clear_object (&replay.proxy);
+  g_main_loop_unref (replay.loop);
+  g_hash_table_destroy (replay.ids);
+  g_hash_table_destroy (replay.running);
+  g_hash_table_destroy (replay.pending_ends);
+  g_hash_table_destroy (replay.expected_reasons);
+  g_array_unref (replay.trigger_latencies);
+  g_array_unref (replay.vibrate_latencies);
+  g_array_unref (replay.lags);
+
+  return replay.n_divergences != 0;
+}
@@ -7,6 +7,7 @@
  */
 
 #include "libfeedback.h"
+#include "lfb-names.h"
 #include "lfb-priv.h"
 
 #include <gio/gio.h>
@@ -103,20 +104,20 @@ typedef struct _LfbEvent {
   gboolean       important;
   char          *app_id;
   char          *sound_file;
+  /* Built on first use, cleared when a property that's a hint changes */
+  GVariant      *hints;
+  GVariant      *fixed_hints;
 
   guint          id;
+  guint          no_feedback_id;
   LfbEventState  state;
   gint           end_reason;
-  gulong         handler_id;
+  /* The thread default context of the last trigger, the end is signalled there */
+  GMainContext  *context;
 } LfbEvent;
 
 G_DEFINE_TYPE (LfbEvent, lfb_event, G_TYPE_OBJECT);
 
-typedef struct _LfbAsyncData {
-  LfbEvent *event;
-  GTask    *task;
-} LfbAsyncData;
-
 static void
 lfb_event_set_state (LfbEvent *self, LfbEventState state)
 {
@@ -137,11 +138,97 @@ lfb_event_set_end_reason (LfbEvent *self, LfbEventEndReason reason)
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_END_REASON]);
 }
 
+/* Sets the id the daemon handed out so the end of the feedback reaches us */
+static void
+lfb_event_set_id (LfbEvent *self, guint id)
+{
+  if (self->id)
+    _lfb_active_remove_event (self->id, self);
+
+  self->id = id;
+
+  if (self->id)
+    _lfb_active_add_event (self->id, self);
+}
+
+/* Called when triggering so the event's signals reach the triggering thread */
+static void
+lfb_event_update_context (LfbEvent *self)
+{
+  g_autoptr (GMainContext) context = g_main_context_ref_thread_default ();
+
+  if (self->context == context)
+    return;
+
+  g_clear_pointer (&self->context, g_main_context_unref);
+  self->context = g_steal_pointer (&context);
+}
+
+static void
+lfb_event_feedback_ended (LfbEvent *self, guint event_id, guint reason)
+{
+  /* Triggered again meanwhile */
+  if (event_id != self->id)
+    return;
+
+  /* Clear first so handlers can trigger the event again */
+  self->id = 0;
+  lfb_event_set_end_reason (self, reason);
+  lfb_event_set_state (self, LFB_EVENT_STATE_ENDED);
+  g_signal_emit (self, signals[SIGNAL_FEEDBACK_ENDED], 0);
+}
+
+static gboolean
+on_no_feedback_idle (gpointer data)
+{
+  LfbEvent *self = LFB_EVENT (data);
+
+  self->no_feedback_id = 0;
+
+  /* Triggered again meanwhile */
+  if (self->id != FB_EVENT_ID_NO_FEEDBACK || self->state != LFB_EVENT_STATE_RUNNING)
+    return G_SOURCE_REMOVE;
+
+  lfb_event_feedback_ended (self, FB_EVENT_ID_NO_FEEDBACK, LFB_EVENT_END_REASON_NOT_FOUND);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * The daemon accepted the event. The daemon doesn't send
+ * FeedbackEnded for events without feedback so end them here, like
+ * the signal after the method call returned.
+ */
+static void
+lfb_event_set_triggered (LfbEvent *self, guint id)
+{
+  g_autoptr (GSource) source = NULL;
+
+  lfb_event_set_id (self, id);
+  lfb_event_set_state (self, LFB_EVENT_STATE_RUNNING);
+
+  if (id != FB_EVENT_ID_NO_FEEDBACK || self->no_feedback_id)
+    return;
+
+  source = g_idle_source_new ();
+  g_source_set_callback (source, on_no_feedback_idle, g_object_ref (self), g_object_unref);
+  self->no_feedback_id = g_source_attach (source, self->context);
+}
+
+static void
+lfb_event_clear_hints (LfbEvent *self)
+{
+  g_clear_pointer (&self->hints, g_variant_unref);
+  g_clear_pointer (&self->fixed_hints, g_variant_unref);
+}
+
 static GVariant *
-build_hints (LfbEvent *self)
+get_hints (LfbEvent *self)
 {
   GVariantBuilder hints_builder;
 
+  if (self->hints)
+    return self->hints;
+
   g_variant_builder_init (&hints_builder, G_VARIANT_TYPE ("a{sv}"));
   if (self->profile) {
     g_variant_builder_add (&hints_builder, "{sv}", "profile",
@@ -155,50 +242,170 @@ build_hints (LfbEvent *self)
     g_variant_builder_add (&hints_builder, "{sv}", "sound-file",
                            g_variant_new_string (self->sound_file));
   }
-  return g_variant_builder_end (&hints_builder);
+  self->hints = g_variant_ref_sink (g_variant_builder_end (&hints_builder));
+
+  return self->hints;
+}
+
+/* The hints for TriggerFeedbackEx, NULL if they can't be expressed that way */
+static GVariant *
+get_fixed_hints (LfbEvent *self)
+{
+  guint level = FB_TRIGGER_LEVEL_DEFAULT, flags = 0;
+
+  if (self->fixed_hints)
+    return self->fixed_hints;
+
+  if (self->profile) {
+    if (g_str_equal (self->profile, "silent"))
+      level = FB_TRIGGER_LEVEL_SILENT;
+    else if (g_str_equal (self->profile, "quiet"))
+      level = FB_TRIGGER_LEVEL_QUIET;
+    else if (g_str_equal (self->profile, "full"))
+      level = FB_TRIGGER_LEVEL_FULL;
+    else
+      return NULL;
+  }
+
+  if (self->important)
+    flags |= FB_TRIGGER_FLAG_IMPORTANT;
+
+  self->fixed_hints = g_variant_ref_sink (g_variant_new ("(uuus)", level, flags, 0,
+                                                         self->sound_file ?: ""));
+  return self->fixed_hints;
+}
+
+/*
+ * Trigger via TriggerFeedbackEx when the daemon supports it as it's
+ * cheaper to marshal. Both methods reply with the event id.
+ */
+static void
+call_trigger_feedback (LfbEvent            *self,
+                       LfbGdbusFeedback    *proxy,
+                       GCancellable        *cancellable,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data)
+{
+  const char *app_id = self->app_id ?: lfb_get_app_id ();
+  GVariant *fixed_hints = _lfb_has_trigger_feedback_ex () ? get_fixed_hints (self) : NULL;
+
+  if (fixed_hints) {
+    lfb_gdbus_feedback_call_trigger_feedback_ex (proxy,
+                                                 app_id,
+                                                 self->event,
+                                                 fixed_hints,
+                                                 g_variant_new ("a{sv}", NULL),
+                                                 self->timeout,
+                                                 cancellable,
+                                                 callback,
+                                                 user_data);
+    return;
+  }
+
+  lfb_gdbus_feedback_call_trigger_feedback (proxy,
+                                            app_id,
+                                            self->event,
+                                            get_hints (self),
+                                            self->timeout,
+                                            cancellable,
+                                            callback,
+                                            user_data);
+}
+
+static gboolean
+call_trigger_feedback_finish (LfbGdbusFeedback  *proxy,
+                              guint             *id,
+                              GAsyncResult      *res,
+                              GError           **error)
+{
+  g_autoptr (GVariant) ret = NULL;
+
+  ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (proxy), res, error);
+  if (ret == NULL)
+    return FALSE;
+
+  g_variant_get (ret, "(u)", id);
+  return TRUE;
 }
 
 static void
 on_trigger_feedback_finished (LfbGdbusFeedback *proxy,
                               GAsyncResult     *res,
-                              LfbAsyncData     *data)
+                              GTask            *task)
 
 {
-  GTask *task = data->task;
-  LfbEvent *self = data->event;
+  LfbEvent *self = g_task_get_source_object (task);
   g_autoptr (GError) err = NULL;
   gboolean success;
+  guint id;
 
   g_return_if_fail (G_IS_TASK (task));
   g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
   g_return_if_fail (LFB_IS_EVENT (self));
 
-  success = lfb_gdbus_feedback_call_trigger_feedback_finish (proxy,
-                                                             &self->id,
-                                                             res,
-                                                             &err);
+  success = call_trigger_feedback_finish (proxy, &id, res, &err);
+  if (success)
+    lfb_event_set_triggered (self, id);
+  else
+    lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
 
-  lfb_event_set_state (self, success ? LFB_EVENT_STATE_RUNNING : LFB_EVENT_STATE_ERRORED);
   if (!success) {
     g_task_return_error (task, g_steal_pointer (&err));
   } else {
     g_task_return_boolean (task, TRUE);
-    _lfb_active_add_id (self->id);
   }
 
-  g_free (data);
   g_object_unref (task);
-  g_object_unref (self);
+}
+
+static void
+on_retrigger_finished (LfbGdbusFeedback *proxy,
+                       GAsyncResult     *res,
+                       GTask            *task)
+{
+  LfbEvent *self = g_task_get_source_object (task);
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+  guint id;
+
+  success = call_trigger_feedback_finish (proxy, &id, res, &err);
+  if (success) {
+    lfb_event_set_triggered (self, id);
+  } else {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to trigger feedback for '%s': %s", self->event, err->message);
+    lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
+  }
+
+  g_task_return_boolean (task, success);
+  g_object_unref (task);
+}
+
+static void
+on_prepare_finished (LfbGdbusFeedback *proxy,
+                     GAsyncResult     *res,
+                     GTask            *task)
+{
+  LfbEvent *self = g_task_get_source_object (task);
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+
+  /* Preparing is only an optimization, triggering works regardless */
+  success = lfb_gdbus_feedback_call_prepare_feedback_finish (proxy, res, &err);
+  if (!success)
+    g_debug ("Failed to prepare feedback for '%s': %s", self->event, err->message);
+
+  g_task_return_boolean (task, success);
+  g_object_unref (task);
 }
 
 static void
 on_end_feedback_finished (LfbGdbusFeedback *proxy,
                           GAsyncResult     *res,
-                          LfbAsyncData     *data)
+                          GTask            *task)
 
 {
-  GTask *task = data->task;
-  LfbEvent *self = data->event;
+  LfbEvent *self = g_task_get_source_object (task);
   g_autoptr (GError) err = NULL;
   gboolean success;
 
@@ -214,9 +421,93 @@ on_end_feedback_finished (LfbGdbusFeedback *proxy,
   } else
     g_task_return_boolean (task, TRUE);
 
-  g_free (data);
   g_object_unref (task);
-  g_object_unref (self);
+}
+
+/*
+ * The callbacks below run once the proxy is there, which might be
+ * right away or after libfeedback connected to the daemon.
+ */
+static void
+on_trigger_proxy_ready (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data)
+{
+  GTask *task = user_data;
+  LfbEvent *self = g_task_get_source_object (task);
+
+  if (proxy == NULL) {
+    lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
+    g_task_return_error (task, g_error_copy (error));
+    g_object_unref (task);
+    return;
+  }
+
+  call_trigger_feedback (self,
+                         proxy,
+                         g_task_get_cancellable (task),
+                         (GAsyncReadyCallback)on_trigger_feedback_finished,
+                         task);
+}
+
+static void
+on_retrigger_proxy_ready (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data)
+{
+  GTask *task = user_data;
+  LfbEvent *self = g_task_get_source_object (task);
+
+  if (proxy == NULL) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to trigger feedback for '%s': %s", self->event, error->message);
+    lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
+    g_task_return_error (task, g_error_copy (error));
+    g_object_unref (task);
+    return;
+  }
+
+  call_trigger_feedback (self,
+                         proxy,
+                         g_task_get_cancellable (task),
+                         (GAsyncReadyCallback)on_retrigger_finished,
+                         task);
+}
+
+static void
+on_prepare_proxy_ready (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data)
+{
+  GTask *task = user_data;
+  LfbEvent *self = g_task_get_source_object (task);
+
+  if (proxy == NULL) {
+    g_task_return_error (task, g_error_copy (error));
+    g_object_unref (task);
+    return;
+  }
+
+  lfb_gdbus_feedback_call_prepare_feedback (proxy,
+                                            self->app_id ?: lfb_get_app_id (),
+                                            self->event,
+                                            get_hints (self),
+                                            g_task_get_cancellable (task),
+                                            (GAsyncReadyCallback)on_prepare_finished,
+                                            task);
+}
+
+static void
+on_end_feedback_proxy_ready (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data)
+{
+  GTask *task = user_data;
+  LfbEvent *self = g_task_get_source_object (task);
+
+  if (proxy == NULL) {
+    g_task_return_error (task, g_error_copy (error));
+    g_object_unref (task);
+    return;
+  }
+
+  lfb_gdbus_feedback_call_end_feedback (proxy,
+                                        self->id,
+                                        g_task_get_cancellable (task),
+                                        (GAsyncReadyCallback)on_end_feedback_finished,
+                                        task);
 }
 
 static void
@@ -288,14 +579,29 @@ lfb_event_get_property (GObject    *object,
   }
 }
 
+/*
+ * Drop out of the FeedbackEnded dispatcher's table here rather than
+ * in finalize: the dispatcher might take a reference from another
+ * thread until then which is fine during dispose.
+ */
+static void
+lfb_event_dispose (GObject *object)
+{
+  LfbEvent *self = LFB_EVENT (object);
+
+  if (self->id)
+    _lfb_active_remove_event (self->id, self);
+
+  G_OBJECT_CLASS (lfb_event_parent_class)->dispose (object);
+}
+
 static void
 lfb_event_finalize (GObject *object)
 {
   LfbEvent *self = LFB_EVENT (object);
 
-  /* Signal handler is disconnected automatically due to g_signal_connect_object */
-  self->handler_id = 0;
-
+  g_clear_pointer (&self->context, g_main_context_unref);
+  lfb_event_clear_hints (self);
   g_clear_pointer (&self->sound_file, g_free);
   g_clear_pointer (&self->event, g_free);
   g_clear_pointer (&self->profile, g_free);
@@ -312,6 +618,7 @@ lfb_event_class_init (LfbEventClass *klass)
   object_class->set_property = lfb_event_set_property;
   object_class->get_property = lfb_event_get_property;
 
+  object_class->dispose = lfb_event_dispose;
   object_class->finalize = lfb_event_finalize;
 
   /**
@@ -450,25 +757,51 @@ lfb_event_new (const char *event)
   return g_object_new (LFB_TYPE_EVENT, "event", event, NULL);
 }
 
+typedef struct _LfbEventEnded {
+  LfbEvent *event;
+  guint     event_id;
+  guint     reason;
+} LfbEventEnded;
+
 static void
-on_feedback_ended (LfbEvent         *self,
-                   guint             event_id,
-                   guint             reason,
-                   LfbGdbusFeedback *proxy)
+lfb_event_ended_free (LfbEventEnded *ended)
+{
+  g_object_unref (ended->event);
+  g_free (ended);
+}
+
+static gboolean
+on_feedback_ended_dispatch (gpointer data)
+{
+  LfbEventEnded *ended = data;
+
+  lfb_event_feedback_ended (ended->event, ended->event_id, ended->reason);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Invoked by the FeedbackEnded dispatcher once the daemon ended the
+ * feedbacks for @event_id. The dispatcher already dropped the event
+ * from its table. The dispatcher might run in another thread than
+ * the one that triggered the event so hop over to its context.
+ */
+void
+_lfb_event_feedback_ended (LfbEvent *self, guint event_id, guint reason)
 {
+  LfbEventEnded *ended;
+
   g_return_if_fail (LFB_IS_EVENT (self));
-  g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
 
-  if (event_id != self->id)
-    return;
+  ended = g_new0 (LfbEventEnded, 1);
+  ended->event = g_object_ref (self);
+  ended->event_id = event_id;
+  ended->reason = reason;
 
-  lfb_event_set_end_reason (self, reason);
-  lfb_event_set_state (self, LFB_EVENT_STATE_ENDED);
-  g_signal_emit (self, signals[SIGNAL_FEEDBACK_ENDED], 0);
-  _lfb_active_remove_id (self->id);
-  self->id = 0;
-  g_signal_handler_disconnect (proxy, self->handler_id);
-  self->handler_id = 0;
+  g_main_context_invoke_full (self->context,
+                              G_PRIORITY_DEFAULT,
+                              on_feedback_ended_dispatch,
+                              ended,
+                              (GDestroyNotify)lfb_event_ended_free);
 }
 
 /**
@@ -485,9 +818,11 @@ on_feedback_ended (LfbEvent         *self,
 gboolean
 lfb_event_trigger_feedback (LfbEvent *self, GError **error)
 {
-  LfbGdbusFeedback *proxy;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  GVariant *fixed_hints;
   gboolean success;
   const char *app_id;
+  guint id;
 
   g_return_val_if_fail (LFB_IS_EVENT (self), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -495,29 +830,39 @@ lfb_event_trigger_feedback (LfbEvent *self, GError **error)
    if (!lfb_is_initted ())
      g_error ("You must call lfb_init() before triggering events.");
 
-   proxy = _lfb_get_proxy ();
-   g_return_val_if_fail (G_IS_DBUS_PROXY (proxy), FALSE);
-
-   if (self->handler_id == 0) {
-     self->handler_id = g_signal_connect_object (proxy,
-                                                 "feedback-ended",
-                                                 G_CALLBACK (on_feedback_ended),
-                                                 self,
-                                                 G_CONNECT_SWAPPED);
+   lfb_event_update_context (self);
+   proxy = _lfb_ensure_event_proxy (error);
+   if (proxy == NULL) {
+     lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
+     return FALSE;
    }
 
    app_id = self->app_id ?: lfb_get_app_id ();
-   success =  lfb_gdbus_feedback_call_trigger_feedback_sync (proxy,
-                                                             app_id,
-                                                             self->event,
-                                                             build_hints (self),
-                                                             self->timeout,
-                                                             &self->id,
-                                                             NULL,
-                                                             error);
+   fixed_hints = _lfb_has_trigger_feedback_ex () ? get_fixed_hints (self) : NULL;
+   if (fixed_hints) {
+     success = lfb_gdbus_feedback_call_trigger_feedback_ex_sync (proxy,
+                                                                 app_id,
+                                                                 self->event,
+                                                                 fixed_hints,
+                                                                 g_variant_new ("a{sv}", NULL),
+                                                                 self->timeout,
+                                                                 &id,
+                                                                 NULL,
+                                                                 error);
+   } else {
+     success = lfb_gdbus_feedback_call_trigger_feedback_sync (proxy,
+                                                              app_id,
+                                                              self->event,
+                                                              get_hints (self),
+                                                              self->timeout,
+                                                              &id,
+                                                              NULL,
+                                                              error);
+   }
    if (success)
-     _lfb_active_add_id (self->id);
-   lfb_event_set_state (self, success ? LFB_EVENT_STATE_RUNNING : LFB_EVENT_STATE_ERRORED);
+     lfb_event_set_triggered (self, id);
+   else
+     lfb_event_set_state (self, LFB_EVENT_STATE_ERRORED);
    return success;
 }
 
@@ -538,38 +883,15 @@ lfb_event_trigger_feedback_async (LfbEvent            *self,
                                   GAsyncReadyCallback  callback,
                                   gpointer             user_data)
 {
-  LfbAsyncData *data;
-  LfbGdbusFeedback *proxy;
-  const char *app_id;
+  GTask *task;
 
   g_return_if_fail (LFB_IS_EVENT (self));
   if (!lfb_is_initted ())
      g_error ("You must call lfb_init() before triggering events.");
 
-  proxy = _lfb_get_proxy ();
-  g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
-
-  if (self->handler_id == 0) {
-    self->handler_id = g_signal_connect_object (proxy,
-                                                "feedback-ended",
-                                                G_CALLBACK (on_feedback_ended),
-                                                self,
-                                                G_CONNECT_SWAPPED);
-  }
-
-  data = g_new0 (LfbAsyncData, 1);
-  data->task = g_task_new (self, cancellable, callback, user_data);
-  data->event = g_object_ref (self);
-
-  app_id = self->app_id ?: lfb_get_app_id ();
-  lfb_gdbus_feedback_call_trigger_feedback (proxy,
-                                            app_id,
-                                            self->event,
-                                            build_hints (self),
-                                            self->timeout,
-                                            cancellable,
-                                            (GAsyncReadyCallback)on_trigger_feedback_finished,
-                                            data);
+  lfb_event_update_context (self);
+  task = g_task_new (self, cancellable, callback, user_data);
+  _lfb_with_event_proxy (on_trigger_proxy_ready, task);
 }
 
 /**
@@ -594,6 +916,203 @@ lfb_event_trigger_feedback_finish (LfbEvent      *self,
   return g_task_propagate_boolean (G_TASK (res), error);
 }
 
+/**
+ * lfb_event_retrigger_async:
+ * @self: The event to trigger feedback for.
+ * @cancellable: (nullable): A #GCancellable to cancel the operation or %NULL.
+ *
+ * Tells the feedback server to provide feedback for the event
+ * again. Unlike [method@LfbEvent.trigger_feedback_async] there's no
+ * completion callback: the outcome is reflected in the event's
+ * [property@LfbEvent:state]. This keeps the overhead low for events
+ * that are triggered over and over again like key presses, so create
+ * the event once and retrigger it whenever needed.
+ *
+ * If the event is still running the previous feedbacks aren't tracked
+ * by the event anymore. They end on their own or when libfeedback is
+ * uninitialized.
+ */
+void
+lfb_event_retrigger_async (LfbEvent *self, GCancellable *cancellable)
+{
+  GTask *task;
+
+  g_return_if_fail (LFB_IS_EVENT (self));
+  if (!lfb_is_initted ())
+     g_error ("You must call lfb_init() before triggering events.");
+
+  lfb_event_update_context (self);
+  task = g_task_new (self, cancellable, NULL, NULL);
+  _lfb_with_event_proxy (on_retrigger_proxy_ready, task);
+}
+
+/**
+ * lfb_event_prepare_feedback_async:
+ * @self: The event to prepare feedback for.
+ * @cancellable: (nullable): A #GCancellable to cancel the operation or %NULL.
+ *
+ * Tells the feedback server that the event is likely triggered soon
+ * so it can get the feedback ready. A typical use is to prepare on
+ * touch down and trigger on touch up which lowers the latency of the
+ * haptic feedback. Nothing is played and unused preparations expire
+ * after a short while.
+ */
+void
+lfb_event_prepare_feedback_async (LfbEvent *self, GCancellable *cancellable)
+{
+  GTask *task;
+
+  g_return_if_fail (LFB_IS_EVENT (self));
+  if (!lfb_is_initted ())
+     g_error ("You must call lfb_init() before preparing events.");
+
+  task = g_task_new (self, cancellable, NULL, NULL);
+  _lfb_with_event_proxy (on_prepare_proxy_ready, task);
+}
+
+static void
+on_trigger_feedbacks_finished (LfbGdbusFeedback *proxy,
+                               GAsyncResult     *res,
+                               GTask            *task)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) ids = NULL;
+  GPtrArray *events = g_task_get_task_data (task);
+  const guint32 *id_data = NULL;
+  gsize n_ids = 0;
+  gboolean success;
+
+  g_return_if_fail (G_IS_TASK (task));
+  g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
+
+  success = lfb_gdbus_feedback_call_trigger_feedbacks_finish (proxy, &ids, res, &err);
+  if (success) {
+    id_data = g_variant_get_fixed_array (ids, &n_ids, sizeof (guint32));
+    if (n_ids != events->len) {
+      g_set_error (&err, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Got %" G_GSIZE_FORMAT " ids for %u events", n_ids, events->len);
+      success = FALSE;
+    }
+  }
+
+  for (guint i = 0; i < events->len; i++) {
+    LfbEvent *event = g_ptr_array_index (events, i);
+
+    if (success)
+      lfb_event_set_triggered (event, id_data[i]);
+    else
+      lfb_event_set_state (event, LFB_EVENT_STATE_ERRORED);
+  }
+
+  if (success)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, g_steal_pointer (&err));
+
+  g_object_unref (task);
+}
+
+static void
+on_trigger_feedbacks_proxy_ready (LfbGdbusFeedback *proxy,
+                                  const GError     *error,
+                                  gpointer          user_data)
+{
+  GTask *task = user_data;
+  GPtrArray *events = g_task_get_task_data (task);
+  GVariantBuilder builder;
+
+  if (proxy == NULL) {
+    for (guint i = 0; i < events->len; i++)
+      lfb_event_set_state (g_ptr_array_index (events, i), LFB_EVENT_STATE_ERRORED);
+    g_task_return_error (task, g_error_copy (error));
+    g_object_unref (task);
+    return;
+  }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa{sv}i)"));
+  for (guint i = 0; i < events->len; i++) {
+    LfbEvent *event = g_ptr_array_index (events, i);
+    const char *app_id = event->app_id ?: lfb_get_app_id ();
+
+    g_variant_builder_add (&builder, "(ss@a{sv}i)",
+                           app_id,
+                           event->event,
+                           get_hints (event),
+                           event->timeout);
+  }
+
+  lfb_gdbus_feedback_call_trigger_feedbacks (proxy,
+                                             g_variant_builder_end (&builder),
+                                             g_task_get_cancellable (task),
+                                             (GAsyncReadyCallback)on_trigger_feedbacks_finished,
+                                             task);
+}
+
+/**
+ * lfb_events_trigger_feedback_batch_async:
+ * @events: (element-type LfbEvent): The events to trigger feedback for.
+ * @cancellable: (nullable): A #GCancellable to cancel the operation or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied or %NULL.
+ * @user_data: User data to pass to @callback.
+ *
+ * Tells the feedback server to provide proper feedback for all the
+ * given events using a single request. This is more efficient than
+ * invoking [method@LfbEvent.trigger_feedback_async] for each event
+ * when several events need to be triggered at once.
+ *
+ * If any of the events is invalid no feedback is triggered at all.
+ */
+void
+lfb_events_trigger_feedback_batch_async (GPtrArray           *events,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  GTask *task;
+  GPtrArray *task_events;
+
+  g_return_if_fail (events);
+  if (!lfb_is_initted ())
+     g_error ("You must call lfb_init() before triggering events.");
+
+  for (guint i = 0; i < events->len; i++)
+    g_return_if_fail (LFB_IS_EVENT (g_ptr_array_index (events, i)));
+
+  task_events = g_ptr_array_new_full (events->len, g_object_unref);
+  for (guint i = 0; i < events->len; i++) {
+    LfbEvent *event = g_ptr_array_index (events, i);
+
+    lfb_event_update_context (event);
+    g_ptr_array_add (task_events, g_object_ref (event));
+  }
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, lfb_events_trigger_feedback_batch_async);
+  g_task_set_task_data (task, task_events, (GDestroyNotify)g_ptr_array_unref);
+
+  _lfb_with_event_proxy (on_trigger_feedbacks_proxy_ready, task);
+}
+
+/**
+ * lfb_events_trigger_feedback_batch_finish:
+ * @res: Result object passed to the callback of [func@Lfb.events_trigger_feedback_batch_async]
+ * @error: Return location for error
+ *
+ * Finish an async operation started by [func@Lfb.events_trigger_feedback_batch_async].
+ * You must call this function in the callback to free memory and receive any
+ * errors which occurred.
+ *
+ * Returns: %TRUE if triggering the feedbacks was successful
+ */
+gboolean
+lfb_events_trigger_feedback_batch_finish (GAsyncResult  *res,
+                                          GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
 /**
  * lfb_event_end_feedback:
  * @self: The event to end feedback for.
@@ -608,7 +1127,7 @@ lfb_event_trigger_feedback_finish (LfbEvent      *self,
 gboolean
 lfb_event_end_feedback (LfbEvent *self, GError **error)
 {
-  LfbGdbusFeedback *proxy;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
 
   g_return_val_if_fail (LFB_IS_EVENT (self), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -616,8 +1135,10 @@ lfb_event_end_feedback (LfbEvent *self, GError **error)
   if (!lfb_is_initted ())
      g_error ("You must call lfb_init() before ending events.");
 
-  proxy = _lfb_get_proxy ();
-  g_return_val_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy), FALSE);
+  proxy = _lfb_ensure_event_proxy (error);
+  if (proxy == NULL)
+    return FALSE;
+
   return lfb_gdbus_feedback_call_end_feedback_sync (proxy, self->id, NULL, error);
 }
 
@@ -662,24 +1183,14 @@ lfb_event_end_feedback_async (LfbEvent            *self,
                               GAsyncReadyCallback  callback,
                               gpointer             user_data)
 {
-  LfbAsyncData *data;
-  LfbGdbusFeedback *proxy;
+  GTask *task;
 
   g_return_if_fail (LFB_IS_EVENT (self));
   if (!lfb_is_initted ())
      g_error ("You must call lfb_init() before ending events.");
 
-  proxy = _lfb_get_proxy ();
-  g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
-
-  data = g_new0 (LfbAsyncData, 1);
-  data->task = g_task_new (self, cancellable, callback, user_data);
-  data->event = g_object_ref (self);
-  lfb_gdbus_feedback_call_end_feedback (proxy,
-                                        self->id,
-                                        cancellable,
-                                        (GAsyncReadyCallback)on_end_feedback_finished,
-                                        data);
+  task = g_task_new (self, cancellable, callback, user_data);
+  _lfb_with_event_proxy (on_end_feedback_proxy_ready, task);
 }
 
 /**
@@ -790,6 +1301,7 @@ lfb_event_set_feedback_profile (LfbEvent *self, const gchar *profile)
 
   g_free (self->profile);
   self->profile = g_strdup (profile);
+  lfb_event_clear_hints (self);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_FEEDBACK_PROFILE]);
 }
 
@@ -828,6 +1340,7 @@ lfb_event_set_important (LfbEvent *self, gboolean important)
     return;
 
   self->important = important;
+  lfb_event_clear_hints (self);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_IMPORTANT]);
 }
 
@@ -915,6 +1428,7 @@ lfb_event_set_sound_file (LfbEvent *self, const gchar *sound_file)
 
   g_free (self->sound_file);
   self->sound_file = g_strdup (sound_file);
+  lfb_event_clear_hints (self);
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SOUND_FILE]);
 }
 
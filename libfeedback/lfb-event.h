@@ -50,6 +50,22 @@ typedef enum _LfbEventEndReason {
   LFB_EVENT_END_REASON_EXPLICIT  = 2,
 } LfbEventEndReason;
 
+/**
+ * LfbEventCapabilities:
+ * @LFB_EVENT_CAPABILITY_NONE: Triggering the event gives no feedback
+ * @LFB_EVENT_CAPABILITY_SOUND: The event plays a sound
+ * @LFB_EVENT_CAPABILITY_HAPTIC: The event uses a haptic motor
+ * @LFB_EVENT_CAPABILITY_LED: The event uses a LED
+ *
+ * Flags to indicate the kinds of feedback an event would give.
+ */
+typedef enum _LfbEventCapabilities {
+  LFB_EVENT_CAPABILITY_NONE   = 0,
+  LFB_EVENT_CAPABILITY_SOUND  = 1 << 0,
+  LFB_EVENT_CAPABILITY_HAPTIC = 1 << 1,
+  LFB_EVENT_CAPABILITY_LED    = 1 << 2,
+} LfbEventCapabilities;
+
 #define LFB_TYPE_EVENT (lfb_event_get_type())
 
 G_DECLARE_FINAL_TYPE (LfbEvent, lfb_event, LFB, EVENT, GObject)
@@ -63,6 +79,8 @@ void        lfb_event_trigger_feedback_async (LfbEvent            *self,
 gboolean    lfb_event_trigger_feedback_finish (LfbEvent            *self,
                                                GAsyncResult        *res,
                                                GError             **error);
+void        lfb_event_retrigger_async (LfbEvent *self, GCancellable *cancellable);
+void        lfb_event_prepare_feedback_async (LfbEvent *self, GCancellable *cancellable);
 gboolean    lfb_event_end_feedback (LfbEvent *self, GError **error);
 void        lfb_event_end_feedback_async (LfbEvent            *self,
                                           GCancellable        *cancellable,
@@ -83,6 +101,13 @@ const char *lfb_event_get_event (LfbEvent *self);
 void        lfb_event_set_sound_file (LfbEvent *self, const char *sound_file);
 const char *lfb_event_get_sound_file (LfbEvent *self);
 
+void        lfb_events_trigger_feedback_batch_async (GPtrArray           *events,
+                                                     GCancellable        *cancellable,
+                                                     GAsyncReadyCallback  callback,
+                                                     gpointer             user_data);
+gboolean    lfb_events_trigger_feedback_batch_finish (GAsyncResult        *res,
+                                                      GError             **error);
+
 LfbEventState     lfb_event_get_state (LfbEvent *self);
 LfbEventEndReason lfb_event_get_end_reason (LfbEvent *self);
 
@@ -12,61 +12,897 @@
 
 #include "lfb-names.h"
 
+#include <gio/gunixfdlist.h>
+
+#include <unistd.h>
+
+/* The events running under an id, not referenced */
+typedef struct _LfbActiveId {
+  GSList *events;
+} LfbActiveId;
+
+/* A call waiting for the proxy, see _lfb_with_event_proxy() */
+typedef struct _LfbPendingCall {
+  LfbProxyFunc      func;
+  gpointer          user_data;
+  /* Where to run @func */
+  GMainContext     *context;
+  LfbGdbusFeedback *proxy;
+  GError           *error;
+} LfbPendingCall;
+
+/*
+ * Protects the state below so libfeedback can be used from any
+ * thread. Never held while running callbacks or blocking on the bus.
+ */
+static GMutex            _lock;
+/* Signalled when the async proxy creation finished */
+static GCond             _proxy_cond;
+
+/* Proxy on the bus, doesn't load properties */
 static LfbGdbusFeedback *_proxy;
+/* Proxy with properties, only created once they're needed */
+static LfbGdbusFeedback *_props_proxy;
+/* Private connection to the daemon for triggering events */
+static GDBusConnection  *_peer_conn;
+static LfbGdbusFeedback *_peer_proxy;
 static char             *_app_id;
 static gboolean          _initted;
+/* Key: event id, value: LfbActiveId */
 static GHashTable       *_active_ids;
+/* Key: event name, value: LfbEventCapabilities */
+static GHashTable       *_capabilities;
+/* The daemon's interface version, see FB_DBUS_VERSION */
+static guint             _version;
+/* Cancelled on uninit so late replies don't touch the next init */
+static GCancellable     *_cancel;
+/* The context libfeedback got initialized in, the bus objects' signals are emitted there */
+static GMainContext     *_context;
+/* The proxy is being created asynchronously */
+static gboolean          _creating_proxy;
+/* LfbPendingCall */
+static GQueue            _pending = G_QUEUE_INIT;
+
+/*
+ * Events don't need the properties and creating the proxy shouldn't
+ * start the daemon, the first call does
+ */
+#define LFB_EVENT_PROXY_FLAGS (G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | \
+                               G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION)
+
+/* Assumed if the daemon can't tell so events still get triggered */
+#define LFB_EVENT_CAPABILITY_ALL (LFB_EVENT_CAPABILITY_SOUND |  \
+                                  LFB_EVENT_CAPABILITY_HAPTIC | \
+                                  LFB_EVENT_CAPABILITY_LED)
+
+static void
+lfb_active_id_free (LfbActiveId *active)
+{
+  g_slist_free (active->events);
+  g_free (active);
+}
+
+static void
+lfb_pending_call_free (LfbPendingCall *call)
+{
+  g_clear_pointer (&call->context, g_main_context_unref);
+  g_clear_object (&call->proxy);
+  g_clear_error (&call->error);
+  g_free (call);
+}
+
+/*
+ * Objects emit their signals in the thread default main context
+ * they got created in. Use libfeedback's context for the bus
+ * objects if the calling thread can get hold of it.
+ */
+static gboolean
+lfb_push_context (GMainContext *context)
+{
+  if (!g_main_context_acquire (context))
+    return FALSE;
+
+  g_main_context_push_thread_default (context);
+  return TRUE;
+}
+
+static void
+lfb_pop_context (GMainContext *context)
+{
+  g_main_context_pop_thread_default (context);
+  g_main_context_release (context);
+}
+
+/*
+ * All FeedbackEnded signals go through here so each signal only
+ * wakes the events that use the id rather than every live event.
+ */
+static void
+on_feedback_ended (LfbGdbusFeedback *proxy,
+                   guint             event_id,
+                   guint             reason,
+                   gpointer          unused)
+{
+  LfbActiveId *active = NULL;
+  GSList *events;
+
+  g_mutex_lock (&_lock);
+  if (_active_ids)
+    active = g_hash_table_lookup (_active_ids, GUINT_TO_POINTER (event_id));
+  if (active == NULL) {
+    g_mutex_unlock (&_lock);
+    return;
+  }
+
+  /* Handlers might trigger or drop events so take them out first */
+  g_hash_table_steal (_active_ids, GUINT_TO_POINTER (event_id));
+  events = g_steal_pointer (&active->events);
+  lfb_active_id_free (active);
+  /* Events drop out of the table on dispose so they're still alive here */
+  g_slist_foreach (events, (GFunc) g_object_ref, NULL);
+  g_mutex_unlock (&_lock);
+
+  /* Each event gets the signal in the thread that triggered it */
+  for (GSList *l = events; l; l = l->next)
+    _lfb_event_feedback_ended (l->data, event_id, reason);
+  g_slist_free_full (events, g_object_unref);
+}
+
+static void
+on_capabilities_changed (LfbGdbusFeedback *proxy, gpointer unused)
+{
+  g_debug ("Event capabilities changed");
+
+  g_mutex_lock (&_lock);
+  if (_capabilities)
+    g_hash_table_remove_all (_capabilities);
+  g_mutex_unlock (&_lock);
+}
 
 static void
-lfb_cancel_feedbacks (void)
+lfb_set_version (guint version)
+{
+  g_atomic_int_set (&_version, version);
+  g_debug ("Daemon interface version %u", version);
+}
+
+static void
+on_version_changed (LfbGdbusFeedback *proxy, GParamSpec *pspec, gpointer unused)
+{
+  /* Properties are loaded again when the daemon (re)starts */
+  lfb_set_version (lfb_gdbus_feedback_get_version (proxy));
+}
+
+static void
+on_version_fetched (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GCancellable) cancel = user_data;
+  g_autoptr (GVariant) ret = NULL;
+  g_autoptr (GVariant) version = NULL;
+  g_autoptr (GError) err = NULL;
+
+  ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &err);
+  if (g_cancellable_is_cancelled (cancel))
+    return;
+
+  if (ret == NULL) {
+    g_debug ("Failed to get the daemon's version: %s", err->message);
+    return;
+  }
+
+  g_variant_get (ret, "(v)", &version);
+  if (g_variant_is_of_type (version, G_VARIANT_TYPE_UINT32))
+    lfb_set_version (g_variant_get_uint32 (version));
+}
+
+/*
+ * The bus proxy doesn't load properties so fetch the one that is
+ * needed to trigger events on its own.
+ */
+static void
+lfb_fetch_version (LfbGdbusFeedback *proxy, GCancellable *cancel)
+{
+  g_dbus_proxy_call (G_DBUS_PROXY (proxy),
+                     "org.freedesktop.DBus.Properties.Get",
+                     g_variant_new ("(ss)", FB_DBUS_NAME, "Version"),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     cancel,
+                     on_version_fetched,
+                     g_object_ref (cancel));
+}
+
+static void
+on_name_owner_changed (LfbGdbusFeedback *proxy, GParamSpec *pspec, gpointer unused)
+{
+  g_autofree char *owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (proxy));
+  g_autoptr (GCancellable) cancel = NULL;
+
+  /* A restarted daemon might be a different version */
+  g_atomic_int_set (&_version, 0);
+  if (owner == NULL)
+    return;
+
+  g_mutex_lock (&_lock);
+  if (_cancel)
+    cancel = g_object_ref (_cancel);
+  g_mutex_unlock (&_lock);
+
+  if (cancel)
+    lfb_fetch_version (proxy, cancel);
+}
+
+/*
+ * The proxy to trigger and end events with. This is the peer
+ * connection to the daemon if there is one as it avoids the detour
+ * via the message bus. Must be called with the lock held.
+ */
+static LfbGdbusFeedback *
+lfb_get_event_proxy_locked (void)
+{
+  return _peer_proxy ?: _proxy;
+}
+
+static LfbGdbusFeedback *
+lfb_dup_event_proxy (void)
+{
+  LfbGdbusFeedback *proxy;
+
+  g_mutex_lock (&_lock);
+  proxy = lfb_get_event_proxy_locked ();
+  if (proxy)
+    g_object_ref (proxy);
+  g_mutex_unlock (&_lock);
+
+  return proxy;
+}
+
+static void
+lfb_cancel_feedbacks (GHashTable *active_ids, LfbGdbusFeedback *proxy)
 {
   gpointer key, value;
   GHashTableIter iter;
 
-  g_hash_table_iter_init (&iter, _active_ids);
+  if (g_hash_table_size (active_ids) == 0)
+    return;
+
+  /*
+   * Send all ids in one message without waiting for a reply. Flushing
+   * makes sure it's out before the connection goes away.
+   */
+  if (g_atomic_int_get (&_version) >= 2) {
+    g_autoptr (GArray) ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+                                                g_hash_table_size (active_ids));
+    GVariant *arg_ids;
+
+    g_hash_table_iter_init (&iter, active_ids);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+      guint32 id = GPOINTER_TO_UINT (key);
+
+      g_array_append_val (ids, id);
+    }
+    g_debug ("Cancelling %u feedbacks on shutdown", ids->len);
+
+    arg_ids = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, ids->data, ids->len,
+                                         sizeof (guint32));
+    lfb_gdbus_feedback_call_end_feedbacks (proxy, arg_ids, NULL, NULL, NULL);
+    g_dbus_connection_flush_sync (g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy)),
+                                  NULL, NULL);
+    g_hash_table_remove_all (active_ids);
+    return;
+  }
+
+  g_hash_table_iter_init (&iter, active_ids);
 
   while (g_hash_table_iter_next (&iter, &key, &value)) {
     guint id = GPOINTER_TO_UINT(key);
     g_hash_table_iter_remove (&iter);
     g_debug ("Cancelling feedback on shutdown %d", id);
     /* Need to use a sync call here since there might not be a main loop anymore */
-    lfb_gdbus_feedback_call_end_feedback_sync (_proxy, id, NULL, NULL);
+    lfb_gdbus_feedback_call_end_feedback_sync (proxy, id, NULL, NULL);
   }
 }
 
+/*
+ * Track @event as running under @id until the daemon signals that the
+ * id ended. The daemon hands out the same id for coalesced events so
+ * an id can have several events.
+ */
 void
-_lfb_active_add_id (guint id)
+_lfb_active_add_event (guint id, LfbEvent *event)
 {
+  LfbActiveId *active;
+
   g_return_if_fail (id > 0);
 
-  if (!_initted)
+  g_mutex_lock (&_lock);
+  if (_active_ids == NULL) {
+    g_mutex_unlock (&_lock);
     return;
+  }
 
-  g_hash_table_add (_active_ids, GUINT_TO_POINTER (id));
+  active = g_hash_table_lookup (_active_ids, GUINT_TO_POINTER (id));
+  if (active == NULL) {
+    active = g_new0 (LfbActiveId, 1);
+    g_hash_table_insert (_active_ids, GUINT_TO_POINTER (id), active);
+  }
+  active->events = g_slist_prepend (active->events, event);
+  g_mutex_unlock (&_lock);
 }
 
+/*
+ * Stop dispatching the end of @id to @event. The id stays active so
+ * it's still ended on shutdown.
+ */
 void
-_lfb_active_remove_id (guint id)
+_lfb_active_remove_event (guint id, LfbEvent *event)
 {
-  gboolean success;
+  LfbActiveId *active = NULL;
 
   g_return_if_fail (id > 0);
 
-  if (!_initted)
+  g_mutex_lock (&_lock);
+  if (_active_ids)
+    active = g_hash_table_lookup (_active_ids, GUINT_TO_POINTER (id));
+  if (active)
+    active->events = g_slist_remove (active->events, event);
+  g_mutex_unlock (&_lock);
+}
+
+
+gboolean
+_lfb_has_trigger_feedback_ex (void)
+{
+  return g_atomic_int_get (&_version) >= 1;
+}
+
+static void
+on_peer_connection_closed (GDBusConnection *conn,
+                           gboolean         remote_peer_vanished,
+                           GError          *error,
+                           gpointer         unused)
+{
+  g_autoptr (LfbGdbusFeedback) peer_proxy = NULL;
+  g_autoptr (GDBusConnection) peer_conn = NULL;
+
+  g_debug ("Peer connection closed, using the bus");
+
+  g_mutex_lock (&_lock);
+  if (_peer_conn == conn) {
+    peer_proxy = g_steal_pointer (&_peer_proxy);
+    peer_conn = g_steal_pointer (&_peer_conn);
+  }
+  g_mutex_unlock (&_lock);
+}
+
+static void
+lfb_close_peer_connection (GDBusConnection *conn, LfbGdbusFeedback *proxy)
+{
+  if (proxy) {
+    g_signal_handlers_disconnect_by_func (proxy, on_feedback_ended, NULL);
+    g_object_unref (proxy);
+  }
+
+  if (conn) {
+    g_signal_handlers_disconnect_by_func (conn, on_peer_connection_closed, NULL);
+    g_dbus_connection_close_sync (conn, NULL, NULL);
+    g_object_unref (conn);
+  }
+}
+
+static GIOStream *
+lfb_peer_stream_new (GVariant *handle, GUnixFDList *fd_list, GError **error)
+{
+  g_autoptr (GSocket) socket = NULL;
+  int fd;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (handle), error);
+  if (fd < 0)
+    return NULL;
+
+  socket = g_socket_new_from_fd (fd, error);
+  if (socket == NULL) {
+    close (fd);
+    return NULL;
+  }
+
+  return G_IO_STREAM (g_socket_connection_factory_create_connection (socket));
+}
+
+/*
+ * Use @conn with @proxy to trigger events unless another thread
+ * opened a peer connection meanwhile. Takes ownership of both.
+ */
+static void
+lfb_set_peer_connection (GDBusConnection  *conn,
+                         LfbGdbusFeedback *proxy,
+                         GCancellable     *cancel)
+{
+  gboolean used = FALSE;
+
+  /* We fall back to the bus, no need to exit */
+  g_dbus_connection_set_exit_on_close (conn, FALSE);
+  /*
+   * Replies and FeedbackEnded arrive in order on the peer
+   * connection, the copies broadcast on the bus are ignored by the
+   * dispatcher as the ids are gone already.
+   */
+  g_signal_connect (proxy, "feedback-ended", G_CALLBACK (on_feedback_ended), NULL);
+  g_signal_connect (conn, "closed", G_CALLBACK (on_peer_connection_closed), NULL);
+
+  g_mutex_lock (&_lock);
+  if (_initted && _peer_conn == NULL && !g_cancellable_is_cancelled (cancel)) {
+    _peer_conn = conn;
+    _peer_proxy = proxy;
+    used = TRUE;
+  }
+  g_mutex_unlock (&_lock);
+
+  if (!used) {
+    lfb_close_peer_connection (conn, proxy);
+    return;
+  }
+
+  g_debug ("Using peer connection");
+}
+
+/* Try to get a private connection to the daemon, older daemons don't support that */
+static void
+lfb_open_peer_connection (LfbGdbusFeedback *bus_proxy, GCancellable *cancel)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) handle = NULL;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GDBusConnection) conn = NULL;
+  LfbGdbusFeedback *proxy;
+
+  if (!lfb_gdbus_feedback_call_open_peer_connection_sync (bus_proxy, NULL, &handle, &fd_list,
+                                                          NULL, &err)) {
+    g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  stream = lfb_peer_stream_new (handle, fd_list, &err);
+  if (stream == NULL) {
+    g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  conn = g_dbus_connection_new_sync (stream,
+                                     NULL,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL,
+                                     NULL,
+                                     &err);
+  if (conn == NULL) {
+    g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  proxy = lfb_gdbus_feedback_proxy_new_sync (conn,
+                                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                             NULL,
+                                             FB_DBUS_PATH,
+                                             NULL,
+                                             &err);
+  if (proxy == NULL) {
+    g_debug ("No peer connection: %s", err->message);
+    g_dbus_connection_close_sync (conn, NULL, NULL);
+    return;
+  }
+  lfb_set_peer_connection (g_steal_pointer (&conn), proxy, cancel);
+}
+
+static void
+on_peer_proxy_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GDBusConnection) conn = user_data;
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy;
+
+  /* Fails as cancelled after uninit */
+  proxy = lfb_gdbus_feedback_proxy_new_finish (res, &err);
+  if (proxy == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug ("No peer connection: %s", err->message);
+    g_dbus_connection_close (conn, NULL, NULL, NULL);
+    return;
+  }
+  lfb_set_peer_connection (g_steal_pointer (&conn), proxy, NULL);
+}
+
+static void
+on_peer_connection_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GCancellable) cancel = user_data;
+  g_autoptr (GError) err = NULL;
+  GDBusConnection *conn;
+
+  conn = g_dbus_connection_new_finish (res, &err);
+  if (conn == NULL) {
+    if (!g_cancellable_is_cancelled (cancel))
+      g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  lfb_gdbus_feedback_proxy_new (conn,
+                                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                NULL,
+                                FB_DBUS_PATH,
+                                cancel,
+                                on_peer_proxy_ready,
+                                conn);
+}
+
+static void
+on_open_peer_connection_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GCancellable) cancel = user_data;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) handle = NULL;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+
+  if (!lfb_gdbus_feedback_call_open_peer_connection_finish (LFB_GDBUS_FEEDBACK (source_object),
+                                                            &handle,
+                                                            &fd_list,
+                                                            res,
+                                                            &err)) {
+    if (!g_cancellable_is_cancelled (cancel))
+      g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  if (g_cancellable_is_cancelled (cancel))
+    return;
+
+  stream = lfb_peer_stream_new (handle, fd_list, &err);
+  if (stream == NULL) {
+    g_debug ("No peer connection: %s", err->message);
+    return;
+  }
+
+  g_dbus_connection_new (stream,
+                         NULL,
+                         G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                         NULL,
+                         cancel,
+                         on_peer_connection_ready,
+                         g_object_ref (cancel));
+}
+
+/* Like lfb_open_peer_connection() but events use the bus until it's there */
+static void
+lfb_open_peer_connection_async (LfbGdbusFeedback *bus_proxy, GCancellable *cancel)
+{
+  lfb_gdbus_feedback_call_open_peer_connection (bus_proxy,
+                                                NULL,
+                                                cancel,
+                                                on_open_peer_connection_finished,
+                                                g_object_ref (cancel));
+}
+
+/*
+ * Makes @proxy the bus proxy unless another thread was faster.
+ * Returns %TRUE if @proxy is used.
+ */
+static gboolean
+lfb_set_proxy (LfbGdbusFeedback *proxy, GCancellable *cancel)
+{
+  g_autofree char *owner = NULL;
+  gboolean used = FALSE;
+
+  g_signal_connect (proxy, "feedback-ended", G_CALLBACK (on_feedback_ended), NULL);
+  g_signal_connect (proxy, "capabilities-changed", G_CALLBACK (on_capabilities_changed), NULL);
+  g_signal_connect (proxy, "notify::g-name-owner", G_CALLBACK (on_name_owner_changed), NULL);
+
+  g_mutex_lock (&_lock);
+  if (_initted && _proxy == NULL && !g_cancellable_is_cancelled (cancel)) {
+    _proxy = g_object_ref (proxy);
+    used = TRUE;
+  }
+  g_mutex_unlock (&_lock);
+
+  if (!used) {
+    g_signal_handlers_disconnect_by_data (proxy, NULL);
+    return FALSE;
+  }
+
+  owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (proxy));
+  if (owner)
+    lfb_fetch_version (proxy, cancel);
+
+  return TRUE;
+}
+
+static gboolean
+run_pending_call (gpointer data)
+{
+  LfbPendingCall *call = data;
+
+  call->func (call->proxy, call->error, call->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the calls waiting for the proxy in the threads that made them */
+static void
+lfb_run_pending (const GError *error)
+{
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  GQueue pending;
+  LfbPendingCall *call;
+
+  g_mutex_lock (&_lock);
+  pending = _pending;
+  /* Calls queued by the callbacks wait for the next attempt */
+  g_queue_init (&_pending);
+  if (error == NULL && lfb_get_event_proxy_locked ())
+    proxy = g_object_ref (lfb_get_event_proxy_locked ());
+  g_mutex_unlock (&_lock);
+
+  while ((call = g_queue_pop_head (&pending))) {
+    if (proxy)
+      call->proxy = g_object_ref (proxy);
+    else if (error)
+      call->error = g_error_copy (error);
+    else
+      call->error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CLOSED,
+                                         "Not connected to the feedback daemon");
+
+    g_main_context_invoke_full (call->context,
+                                G_PRIORITY_DEFAULT,
+                                run_pending_call,
+                                call,
+                                (GDestroyNotify)lfb_pending_call_free);
+  }
+}
+
+static void
+on_proxy_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GCancellable) cancel = user_data;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  gboolean used = FALSE;
+
+  proxy = lfb_gdbus_feedback_proxy_new_for_bus_finish (res, &err);
+  if (g_cancellable_is_cancelled (cancel))
+    return;
+
+  if (proxy)
+    used = lfb_set_proxy (proxy, cancel);
+  else
+    g_debug ("Failed to create proxy: %s", err->message);
+
+  g_mutex_lock (&_lock);
+  _creating_proxy = FALSE;
+  g_cond_broadcast (&_proxy_cond);
+  g_mutex_unlock (&_lock);
+
+  if (used)
+    lfb_open_peer_connection_async (proxy, cancel);
+
+  lfb_run_pending (err);
+}
+
+/* Runs in libfeedback's context so the proxy's signals get emitted there */
+static gboolean
+lfb_create_proxy (gpointer data)
+{
+  GCancellable *cancel = data;
+
+  lfb_gdbus_feedback_proxy_new_for_bus (FB_DBUS_TYPE,
+                                        LFB_EVENT_PROXY_FLAGS,
+                                        FB_DBUS_NAME,
+                                        FB_DBUS_PATH,
+                                        cancel,
+                                        on_proxy_ready,
+                                        cancel);
+  return G_SOURCE_REMOVE;
+}
+
+/* Must be called with the lock held */
+static void
+lfb_create_proxy_async_locked (void)
+{
+  if (_creating_proxy)
     return;
 
-  success = g_hash_table_remove (_active_ids, GUINT_TO_POINTER(id));
-  if (!success)
-    g_warning ("Event id %d not known", id);
+  _creating_proxy = TRUE;
+  g_main_context_invoke (_context, lfb_create_proxy, g_object_ref (_cancel));
 }
 
+/*
+ * Runs @func with the proxy to trigger events with, creating the
+ * proxy first if needed. Calls made until the proxy is there are run
+ * in order once it is. @func runs in the calling thread's default
+ * main context.
+ */
+void
+_lfb_with_event_proxy (LfbProxyFunc func, gpointer user_data)
+{
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  LfbPendingCall *call;
+
+  g_mutex_lock (&_lock);
+  proxy = lfb_get_event_proxy_locked ();
+  if (proxy) {
+    g_object_ref (proxy);
+    g_mutex_unlock (&_lock);
+    func (proxy, NULL, user_data);
+    return;
+  }
+
+  call = g_new0 (LfbPendingCall, 1);
+  call->func = func;
+  call->user_data = user_data;
+  call->context = g_main_context_ref_thread_default ();
+  g_queue_push_tail (&_pending, call);
 
+  lfb_create_proxy_async_locked ();
+  g_mutex_unlock (&_lock);
+}
+
+/*
+ * Gets the proxy to trigger events with, creating it right away if
+ * needed. Returns a new reference.
+ */
 LfbGdbusFeedback *
-_lfb_get_proxy (void)
+_lfb_ensure_event_proxy (GError **error)
 {
-  /* Caller needs to check since the proxy might be gone when
-     the last event gets finalized */
-  return _proxy;
+  g_autoptr (GMainContext) context = NULL;
+  g_autoptr (GCancellable) cancel = NULL;
+  LfbGdbusFeedback *proxy;
+
+  g_mutex_lock (&_lock);
+  proxy = lfb_get_event_proxy_locked ();
+  if (proxy || !_initted) {
+    g_mutex_unlock (&_lock);
+    if (proxy == NULL) {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           "Libfeedback got uninitialized");
+    }
+    return proxy ? g_object_ref (proxy) : NULL;
+  }
+  context = g_main_context_ref (_context);
+  cancel = g_object_ref (_cancel);
+  g_mutex_unlock (&_lock);
+
+  if (!lfb_push_context (context)) {
+    /* The thread running libfeedback's context creates it */
+    g_mutex_lock (&_lock);
+    lfb_create_proxy_async_locked ();
+    while (_creating_proxy)
+      g_cond_wait (&_proxy_cond, &_lock);
+    proxy = lfb_get_event_proxy_locked ();
+    if (proxy) {
+      g_object_ref (proxy);
+    } else {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "Failed to connect to the feedback daemon");
+    }
+    g_mutex_unlock (&_lock);
+    return proxy;
+  }
+
+  proxy = lfb_gdbus_feedback_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                     LFB_EVENT_PROXY_FLAGS,
+                                                     FB_DBUS_NAME,
+                                                     FB_DBUS_PATH,
+                                                     NULL,
+                                                     error);
+  if (proxy && lfb_set_proxy (proxy, cancel))
+    lfb_open_peer_connection (proxy, cancel);
+  lfb_pop_context (context);
+
+  if (proxy == NULL)
+    return NULL;
+  g_object_unref (proxy);
+
+  /* No need to wait for the async creation anymore */
+  lfb_run_pending (NULL);
+
+  return lfb_dup_event_proxy ();
+}
+
+/*
+ * The proxy is created on first use so applications that never
+ * look at properties don't need to fetch them at all.
+ */
+static LfbGdbusFeedback *
+lfb_get_props_proxy (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GMainContext) context = NULL;
+  LfbGdbusFeedback *proxy;
+  gboolean pushed;
+
+  g_mutex_lock (&_lock);
+  proxy = _props_proxy;
+  if (proxy || !_initted) {
+    g_mutex_unlock (&_lock);
+    return proxy;
+  }
+  context = g_main_context_ref (_context);
+  g_mutex_unlock (&_lock);
+
+  /* Property changes are notified in the context the proxy got created in */
+  pushed = lfb_push_context (context);
+  proxy = lfb_gdbus_feedback_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                     G_DBUS_PROXY_FLAGS_NONE,
+                                                     FB_DBUS_NAME,
+                                                     FB_DBUS_PATH,
+                                                     NULL,
+                                                     &err);
+  if (pushed)
+    lfb_pop_context (context);
+
+  if (proxy == NULL) {
+    g_warning ("Failed to get feedbackd's properties: %s", err->message);
+    return NULL;
+  }
+
+  g_mutex_lock (&_lock);
+  if (_initted && _props_proxy == NULL) {
+    _props_proxy = proxy;
+    g_signal_connect (proxy, "notify::version", G_CALLBACK (on_version_changed), NULL);
+    on_version_changed (proxy, NULL, NULL);
+  } else {
+    g_object_unref (proxy);
+  }
+  proxy = _props_proxy;
+  g_mutex_unlock (&_lock);
+
+  return proxy;
+}
+
+static void
+lfb_set_app_id_locked (const char *app_id)
+{
+  g_free (_app_id);
+  _app_id = g_strdup (app_id);
+
+  /* The answers depend on the app's profile */
+  if (_capabilities)
+    g_hash_table_remove_all (_capabilities);
+}
+
+/**
+ * lfb_init_lazy:
+ * @app_id: The application id
+ *
+ * Initialize libfeedback without talking to the feedback daemon. The
+ * connection to the daemon is set up when the first event gets
+ * triggered. Asynchronous calls made meanwhile are queued and sent
+ * in order once it's there, synchronous calls set it up right away.
+ *
+ * Use this instead of [func@Lfb.init] to not delay the application's
+ * startup. This must be called before any other of libfeedback's
+ * functions.
+ */
+void
+lfb_init_lazy (const char *app_id)
+{
+  g_return_if_fail (app_id != NULL);
+  g_return_if_fail (*app_id != '\0');
+
+  g_mutex_lock (&_lock);
+  if (_initted) {
+    g_mutex_unlock (&_lock);
+    return;
+  }
+
+  lfb_set_app_id_locked (app_id);
+  _active_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                       (GDestroyNotify) lfb_active_id_free);
+  _capabilities = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  _cancel = g_cancellable_new ();
+  _context = g_main_context_ref_thread_default ();
+
+  g_atomic_int_set (&_initted, TRUE);
+  g_mutex_unlock (&_lock);
 }
 
 /**
@@ -76,30 +912,100 @@ _lfb_get_proxy (void)
  *
  * Initialize libfeedback. This must be called before any other of libfeedback's functions.
  *
+ * This blocks until the connection to the feedback daemon is set up,
+ * see [func@Lfb.init_async] and [func@Lfb.init_lazy] for alternatives.
+ *
+ * Libfeedback can be used from any thread once initialized. The
+ * daemon's signals are received in the thread default main context
+ * of the thread that initialized libfeedback so that context needs
+ * to run. Completions and [signal@Lfb.Event::feedback-ended] are
+ * delivered in the thread default main context of the thread that
+ * triggered the event.
+ *
  * Returns: %TRUE if successful, or %FALSE on error.
  */
 gboolean
 lfb_init (const gchar *app_id, GError **error)
 {
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+
   g_return_val_if_fail (app_id != NULL, FALSE);
   g_return_val_if_fail (*app_id != '\0', FALSE);
 
-  if (_initted)
+  if (lfb_is_initted ())
     return TRUE;
 
-  lfb_set_app_id (app_id);
-  _proxy = lfb_gdbus_feedback_proxy_new_for_bus_sync(
-      FB_DBUS_TYPE, 0, FB_DBUS_NAME, FB_DBUS_PATH, NULL, error);
-  if (!_proxy)
+  lfb_init_lazy (app_id);
+  proxy = _lfb_ensure_event_proxy (error);
+  if (proxy == NULL) {
+    lfb_uninit ();
     return FALSE;
+  }
 
-  _active_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
-  g_object_add_weak_pointer (G_OBJECT (_proxy), (gpointer *) &_proxy);
-
-  _initted = TRUE;
   return TRUE;
 }
 
+static void
+on_init_proxy_ready (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data)
+{
+  g_autoptr (GTask) task = user_data;
+
+  if (proxy == NULL) {
+    g_task_return_error (task, g_error_copy (error));
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * lfb_init_async:
+ * @app_id: The application id
+ * @cancellable: (nullable): A #GCancellable to cancel the operation or %NULL.
+ * @callback: A #GAsyncReadyCallback to call when the request is satisfied or %NULL.
+ * @user_data: User data to pass to @callback.
+ *
+ * Initialize libfeedback without blocking. This is the async version
+ * of [func@Lfb.init]. Libfeedback is initialized right away like with
+ * [func@Lfb.init_lazy] so events can be triggered before @callback
+ * runs. If setting up the connection to the daemon fails it's
+ * retried when the next event gets triggered.
+ */
+void
+lfb_init_async (const char          *app_id,
+                GCancellable        *cancellable,
+                GAsyncReadyCallback  callback,
+                gpointer             user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (app_id != NULL);
+  g_return_if_fail (*app_id != '\0');
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, lfb_init_async);
+
+  lfb_init_lazy (app_id);
+  _lfb_with_event_proxy (on_init_proxy_ready, task);
+}
+
+/**
+ * lfb_init_finish:
+ * @res: Result object passed to the callback of [func@Lfb.init_async]
+ * @error: Return location for error
+ *
+ * Finish an async operation started by [func@Lfb.init_async].
+ *
+ * Returns: %TRUE if the connection to the daemon is set up
+ */
+gboolean
+lfb_init_finish (GAsyncResult *res, GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
 /**
  * lfb_uninit:
  *
@@ -109,14 +1015,48 @@ lfb_init (const gchar *app_id, GError **error)
 void
 lfb_uninit (void)
 {
-  _initted = FALSE;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GHashTable) active_ids = NULL;
+  g_autoptr (GHashTable) capabilities = NULL;
+  g_autoptr (GCancellable) cancel = NULL;
+  g_autoptr (GMainContext) context = NULL;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  g_autoptr (LfbGdbusFeedback) props_proxy = NULL;
+  GDBusConnection *peer_conn;
+  LfbGdbusFeedback *peer_proxy;
 
-  /* Cancel all feedbacks that the client forgot to clean up */
-  if (_active_ids)
-    lfb_cancel_feedbacks ();
-  g_clear_pointer (&_active_ids, g_hash_table_destroy);
+  g_mutex_lock (&_lock);
+  g_atomic_int_set (&_initted, FALSE);
+  active_ids = g_steal_pointer (&_active_ids);
+  capabilities = g_steal_pointer (&_capabilities);
+  cancel = g_steal_pointer (&_cancel);
+  context = g_steal_pointer (&_context);
+  proxy = g_steal_pointer (&_proxy);
+  props_proxy = g_steal_pointer (&_props_proxy);
+  peer_conn = g_steal_pointer (&_peer_conn);
+  peer_proxy = g_steal_pointer (&_peer_proxy);
   g_clear_pointer (&_app_id, g_free);
-  g_clear_object (&_proxy);
+  _creating_proxy = FALSE;
+  g_cond_broadcast (&_proxy_cond);
+  g_mutex_unlock (&_lock);
+
+  g_cancellable_cancel (cancel);
+  err = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "Libfeedback got uninitialized");
+  lfb_run_pending (err);
+
+  /* Cancel all feedbacks that the client forgot to clean up */
+  if (active_ids && (peer_proxy || proxy))
+    lfb_cancel_feedbacks (active_ids, peer_proxy ?: proxy);
+  lfb_close_peer_connection (peer_conn, peer_proxy);
+  /* Someone else might still hold a ref on the proxies */
+  if (proxy) {
+    g_signal_handlers_disconnect_by_func (proxy, on_feedback_ended, NULL);
+    g_signal_handlers_disconnect_by_func (proxy, on_capabilities_changed, NULL);
+    g_signal_handlers_disconnect_by_func (proxy, on_name_owner_changed, NULL);
+  }
+  if (props_proxy)
+    g_signal_handlers_disconnect_by_func (props_proxy, on_version_changed, NULL);
+  g_atomic_int_set (&_version, 0);
 }
 
 /**
@@ -128,8 +1068,9 @@ lfb_uninit (void)
 void
 lfb_set_app_id (const char *app_id)
 {
-  g_free (_app_id);
-  _app_id = g_strdup (app_id);
+  g_mutex_lock (&_lock);
+  lfb_set_app_id_locked (app_id);
+  g_mutex_unlock (&_lock);
 }
 
 /**
@@ -137,6 +1078,9 @@ lfb_set_app_id (const char *app_id)
  *
  * Get the application id set via [func@Lfb.set_app_id].
  *
+ * The returned string is only valid until the application id gets
+ * changed, so don't change it while other threads trigger events.
+ *
  * Returns:  the application id.
  */
 const gchar *
@@ -155,7 +1099,7 @@ lfb_get_app_id (void)
 gboolean
 lfb_is_initted (void)
 {
-  return _initted;
+  return g_atomic_int_get (&_initted);
 }
 
 /**
@@ -173,8 +1117,9 @@ lfb_get_feedback_profile (void)
   if (!lfb_is_initted ())
     g_error ("You must call lfb_init() before ending events.");
 
-  proxy = _lfb_get_proxy ();
-  g_return_val_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy), NULL);
+  proxy = lfb_get_props_proxy ();
+  if (proxy == NULL)
+    return NULL;
 
   return lfb_gdbus_feedback_get_profile (LFB_GDBUS_FEEDBACK (proxy));
 }
@@ -197,8 +1142,9 @@ lfb_set_feedback_profile (const gchar *profile)
   if (!lfb_is_initted ())
     g_error ("You must call lfb_init() before ending events.");
 
-  proxy = _lfb_get_proxy ();
-  g_return_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy));
+  proxy = lfb_get_props_proxy ();
+  if (proxy == NULL)
+    return;
 
   lfb_gdbus_feedback_set_profile (LFB_GDBUS_FEEDBACK (proxy), profile);
 }
@@ -210,13 +1156,133 @@ lfb_set_feedback_profile (const gchar *profile)
  * property changes. The object is not owned by the caller. Don't
  * unref it after use.
  *
+ * The daemon's properties are fetched when this is first called.
+ *
  * Returns: (transfer none): The DBus proxy.
  */
 LfbGdbusFeedback *
 lfb_get_proxy (void)
 {
-  LfbGdbusFeedback *proxy = _lfb_get_proxy ();
+  g_return_val_if_fail (lfb_is_initted (), NULL);
 
-  g_return_val_if_fail (LFB_GDBUS_IS_FEEDBACK (proxy), NULL);
-  return proxy;
+  return lfb_get_props_proxy ();
+}
+
+/**
+ * lfb_query_event_capabilities:
+ * @events: (array zero-terminated=1): The event names
+ * @error: Error information
+ *
+ * Asks the daemon which kinds of feedback the given events would
+ * give for the application and caches the answers so that
+ * [func@Lfb.get_event_capabilities] doesn't need to ask again. This
+ * allows to fetch the capabilities of all the events an application
+ * uses in a single round trip. The cache is dropped when the daemon
+ * signals that the capabilities changed, listen to
+ * #LfbGdbusFeedback::capabilities-changed on [func@Lfb.get_proxy] to
+ * get notified.
+ *
+ * Returns: %TRUE if successful, or %FALSE on error.
+ */
+gboolean
+lfb_query_event_capabilities (const char * const *events, GError **error)
+{
+  g_autoptr (GVariant) caps = NULL;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  GVariantIter iter;
+  guint cap, i = 0;
+
+  if (!lfb_is_initted ())
+    g_error ("You must call lfb_init() before querying event capabilities.");
+
+  g_return_val_if_fail (events, FALSE);
+
+  proxy = _lfb_ensure_event_proxy (error);
+  if (proxy == NULL)
+    return FALSE;
+
+  if (!lfb_gdbus_feedback_call_get_event_capabilities_sync (proxy,
+                                                            events,
+                                                            lfb_get_app_id (),
+                                                            &caps,
+                                                            NULL,
+                                                            error)) {
+    return FALSE;
+  }
+
+  g_mutex_lock (&_lock);
+  g_variant_iter_init (&iter, caps);
+  while (_capabilities && events[i] && g_variant_iter_next (&iter, "u", &cap)) {
+    g_hash_table_insert (_capabilities, g_strdup (events[i]), GUINT_TO_POINTER (cap));
+    i++;
+  }
+  g_mutex_unlock (&_lock);
+
+  return TRUE;
+}
+
+static gboolean
+lfb_lookup_event_capabilities (const char *event, LfbEventCapabilities *caps)
+{
+  gpointer cap;
+  gboolean found = FALSE;
+
+  g_mutex_lock (&_lock);
+  if (_capabilities && g_hash_table_lookup_extended (_capabilities, event, NULL, &cap)) {
+    *caps = GPOINTER_TO_UINT (cap);
+    found = TRUE;
+  }
+  g_mutex_unlock (&_lock);
+
+  return found;
+}
+
+/**
+ * lfb_get_event_capabilities:
+ * @event: The event name
+ *
+ * Gets the kinds of feedback triggering @event would currently give
+ * for the application. This allows to skip triggering events that
+ * don't give any feedback on the device at all. Answers are cached,
+ * if the event's capabilities aren't known yet the daemon is asked.
+ *
+ * The capabilities only take the application's profile into account,
+ * hints set on the event (e.g. a custom sound file) are not considered.
+ * If the daemon can't be asked all capabilities are assumed.
+ *
+ * Returns: The event's capabilities
+ */
+LfbEventCapabilities
+lfb_get_event_capabilities (const char *event)
+{
+  g_autoptr (GError) err = NULL;
+  const char *events[] = { event, NULL };
+  LfbEventCapabilities caps;
+
+  if (!lfb_is_initted ())
+    g_error ("You must call lfb_init() before querying event capabilities.");
+
+  g_return_val_if_fail (event, LFB_EVENT_CAPABILITY_NONE);
+
+  if (lfb_lookup_event_capabilities (event, &caps))
+    return caps;
+
+  if (lfb_query_event_capabilities (events, &err)) {
+    if (lfb_lookup_event_capabilities (event, &caps))
+      return caps;
+    return LFB_EVENT_CAPABILITY_ALL;
+  }
+
+  g_debug ("Failed to get capabilities of '%s': %s", event, err->message);
+  /* Older daemons can't tell, don't ask them again */
+  if (g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+    g_mutex_lock (&_lock);
+    if (_capabilities) {
+      g_hash_table_insert (_capabilities, g_strdup (event),
+                           GUINT_TO_POINTER (LFB_EVENT_CAPABILITY_ALL));
+    }
+    g_mutex_unlock (&_lock);
+  }
+
+  return LFB_EVENT_CAPABILITY_ALL;
 }
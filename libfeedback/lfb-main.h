@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include "lfb-event.h"
 #include "lfb-gdbus.h"
 
 #include <glib.h>
@@ -16,6 +17,12 @@
 G_BEGIN_DECLS
 
 gboolean    lfb_init (const gchar *app_id, GError **error);
+void        lfb_init_lazy (const char *app_id);
+void        lfb_init_async (const char          *app_id,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data);
+gboolean    lfb_init_finish (GAsyncResult *res, GError **error);
 void        lfb_uninit (void);
 void        lfb_set_app_id (const char *app_id);
 const char *lfb_get_app_id (void);
@@ -23,5 +30,7 @@ gboolean    lfb_is_initted (void);
 void        lfb_set_feedback_profile (const char *profile);
 const char *lfb_get_feedback_profile (void);
 LfbGdbusFeedback *lfb_get_proxy (void);
+gboolean    lfb_query_event_capabilities (const char * const *events, GError **error);
+LfbEventCapabilities lfb_get_event_capabilities (const char *event);
 
 G_END_DECLS
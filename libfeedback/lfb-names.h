@@ -10,3 +10,21 @@
 #define FB_DBUS_PATH "/org/sigxcpu/Feedback"
 
 #define FB_DBUS_TYPE G_BUS_TYPE_SESSION
+
+/* The interface version the daemon implements, see the Version property */
+#define FB_DBUS_VERSION 2
+
+/* Levels and flags of TriggerFeedbackEx's hints */
+#define FB_TRIGGER_LEVEL_DEFAULT 0
+#define FB_TRIGGER_LEVEL_SILENT  1
+#define FB_TRIGGER_LEVEL_QUIET   2
+#define FB_TRIGGER_LEVEL_FULL    3
+
+#define FB_TRIGGER_FLAG_IMPORTANT       (1 << 0)
+#define FB_TRIGGER_FLAG_FIRE_AND_FORGET (1 << 1)
+
+/* Event id returned when there's no feedback for an event, it ends right away */
+#define FB_EVENT_ID_NO_FEEDBACK 0
+
+/* Returned when a client triggers feedback too often */
+#define FB_DBUS_ERROR_RATE_LIMITED FB_DBUS_NAME ".Error.RateLimited"
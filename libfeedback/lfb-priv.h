@@ -7,12 +7,19 @@
 #pragma once
 
 #include <gio/gio.h>
+#include "lfb-event.h"
 #include "lfb-gdbus.h"
 
 G_BEGIN_DECLS
 
-LfbGdbusFeedback *_lfb_get_proxy (void);
-void              _lfb_active_add_id (guint id);
-void              _lfb_active_remove_id (guint id);
+/* @proxy is %NULL and @error set if there's no connection to the daemon */
+typedef void (*LfbProxyFunc) (LfbGdbusFeedback *proxy, const GError *error, gpointer user_data);
+
+void              _lfb_with_event_proxy (LfbProxyFunc func, gpointer user_data);
+LfbGdbusFeedback *_lfb_ensure_event_proxy (GError **error);
+gboolean          _lfb_has_trigger_feedback_ex (void);
+void              _lfb_active_add_event (guint id, LfbEvent *event);
+void              _lfb_active_remove_event (guint id, LfbEvent *event);
+void              _lfb_event_feedback_ended (LfbEvent *self, guint event_id, guint reason);
 
 G_END_DECLS
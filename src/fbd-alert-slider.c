@@ -15,10 +15,12 @@
 #include "libfeedback.h"
 
 #include "fbd.h"
+#include "fbd-slider-filter.h"
 
 #include <gudev/gudev.h>
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <gio/gio.h>
 
 #include <errno.h>
@@ -39,12 +41,24 @@
 #define LONG(x) ((x) / BITS_PER_LONG)
 #define test_bit(bit, array)    ((array[LONG (bit)] >> OFF (bit)) & 1)
 
+/* The axis the slider position is reported on */
+#define ALERT_SLIDER_ABS_CODE 34
+/* Only commit a position once the slider settled for this long (ms) */
+#define ALERT_SLIDER_SETTLE_TIME 250
+
 typedef enum {
   FBD_ALERT_SLIDER_STATE_SILENT = 0,
   FBD_ALERT_SLIDER_STATE_QUIET = 1,
   FBD_ALERT_SLIDER_STATE_FULL = 2,
 } FbdAlertSliderState;
 
+typedef struct _FbdAlertSlider {
+  int              fd;
+  GMainLoop       *loop;
+  /* Commits the final position of a bouncing slider */
+  FbdSliderFilter *filter;
+} FbdAlertSlider;
+
 GSettings *settings = NULL;
 
 static void
@@ -120,7 +134,7 @@ probe (FbdAlertSliderState *initial)
     return -ENOENT;
   }
 
-  if ((fd = open (device_file, O_RDONLY)) < 0) {
+  if ((fd = open (device_file, O_RDONLY | O_NONBLOCK)) < 0) {
     g_warning ("Failed to open alert slider device: %s", strerror (errno));
     return -1;
   }
@@ -162,48 +176,64 @@ probe (FbdAlertSliderState *initial)
 }
 
 
+static void
+on_settled (int position, gpointer unused)
+{
+  set_level (position, FALSE);
+}
+
+
 static gboolean
-on_input_ready (GIOChannel *source, GIOCondition cond, gpointer unused)
+on_input_ready (int fd, GIOCondition cond, gpointer data)
 {
-  GIOError status;
+  FbdAlertSlider *slider = data;
   struct input_event ev[64];
-  gsize rd;
-
-  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-    status = g_io_channel_read (source, (char *)ev, sizeof(ev), &rd /*, &err */);
-  G_GNUC_END_IGNORE_DEPRECATIONS
-  if (status != G_IO_ERROR_NONE ) {
-    g_warning ("Failed to read event: %d", status);
-    return TRUE;
-  }
+  ssize_t rd;
 
-  if (rd < sizeof(struct input_event)) {
-    g_warning ("Expected %d bytes, got %zd", (int) sizeof(struct input_event), rd);
-    return TRUE;
+  if (cond & (G_IO_ERR | G_IO_HUP)) {
+    g_warning ("Alert slider device went away");
+    g_main_loop_quit (slider->loop);
+    return G_SOURCE_REMOVE;
   }
 
-  for (int i = 0; i < rd / sizeof(struct input_event); i++) {
-    unsigned int type, code;
-
-    type = ev[i].type;
-    code = ev[i].code;
+  /* Drain the device, frames are committed on SYN_REPORT */
+  while ((rd = read (fd, ev, sizeof (ev))) > 0) {
+    for (int i = 0; i < rd / sizeof (struct input_event); i++) {
+      unsigned int type = ev[i].type, code = ev[i].code;
+
+      if (type == EV_SYN) {
+        if (code == SYN_REPORT) {
+          fbd_slider_filter_commit (slider->filter);
+        } else if (code == SYN_DROPPED) {
+          /* Events got lost, resync with the device's current state */
+          int value = get_initial_value (fd, ALERT_SLIDER_ABS_CODE);
+
+          g_debug ("Events dropped, resyncing to %d", value);
+          fbd_slider_filter_set_value (slider->filter, value);
+        }
+        continue;
+      }
 
-    if (type == EV_SYN)
-      continue;
+      if (type != EV_ABS || code != ALERT_SLIDER_ABS_CODE) {
+        g_warning ("Unexpected event %d / %d", type, code);
+        continue;
+      }
 
-    if (type != EV_ABS || code != 34) {
-      g_warning ("Unexpected event %d / %d", type, code);
-      continue;
+      g_debug ("Event: time %ld.%06ld, value: %d",
+               ev[i].input_event_sec,
+               ev[i].input_event_usec,
+               ev[i].value);
+      fbd_slider_filter_set_value (slider->filter, ev[i].value);
     }
+  }
 
-    g_debug ("Event: time %ld.%06ld, value: %d",
-             ev[i].input_event_sec,
-             ev[i].input_event_usec,
-             ev[i].value);
-    set_level (ev[i].value, FALSE);
+  if (rd < 0 && errno != EAGAIN && errno != EINTR) {
+    g_warning ("Failed to read event: %s", g_strerror (errno));
+    g_main_loop_quit (slider->loop);
+    return G_SOURCE_REMOVE;
   }
 
-  return TRUE;
+  return G_SOURCE_CONTINUE;
 }
 
 
@@ -212,8 +242,8 @@ main (int argc, char *argv[])
 {
   g_autoptr (GError) err = NULL;
   g_autoptr (GOptionContext) opt_context = NULL;
-  g_autoptr (GIOChannel) input = NULL;
   g_autoptr (GMainLoop) loop = NULL;
+  FbdAlertSlider slider = { 0 };
   FbdAlertSliderState state = 0;
   int fd;
   const GOptionEntry options [] = {
@@ -242,14 +272,17 @@ main (int argc, char *argv[])
 
   set_level (state, TRUE);
 
-  input = g_io_channel_unix_new (fd);
-  g_io_channel_set_encoding (input, NULL, NULL);
-  g_io_add_watch (input, G_IO_IN | G_IO_ERR | G_IO_HUP, on_input_ready, NULL);
-
   loop = g_main_loop_new (NULL, FALSE);
+  slider.fd = fd;
+  slider.loop = loop;
+  slider.filter = fbd_slider_filter_new (state, ALERT_SLIDER_SETTLE_TIME, on_settled, NULL);
+  g_unix_fd_add (fd, G_IO_IN | G_IO_ERR | G_IO_HUP, on_input_ready, &slider);
+
   g_main_loop_run (loop);
 
+  g_clear_pointer (&slider.filter, fbd_slider_filter_free);
   g_clear_object (&settings);
+  close (fd);
 
   return 0;
 }
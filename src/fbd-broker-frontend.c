@@ -0,0 +1,712 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-broker-frontend"
+
+#include "fbd-broker-frontend.h"
+#include "lfb-gdbus.h"
+#include "lfb-names.h"
+
+#define PROPERTIES_IFACE "org.freedesktop.DBus.Properties"
+/* Property accesses block until the broker replies */
+#define PROPERTY_TIMEOUT 1000
+
+/**
+ * FbdBrokerFrontend:
+ *
+ * Provides the feedback interface in a user session while the
+ * devices and the theme are owned by a broker serving all sessions.
+ *
+ * Method calls are forwarded to the broker which treats the session
+ * as a single peer, so events of all sessions are arbitrated by the
+ * broker's scheduler. The front-end remembers which client triggered
+ * which event so `FeedbackEnded` goes to that client only and the
+ * client's events are ended when it vanishes from the bus. Clients
+ * can only end the events they triggered. Signals and properties of
+ * the broker are passed through.
+ *
+ * As the broker only sees the session all clients of a session share
+ * the broker's rate limit. The haptic interface isn't forwarded, its
+ * methods fail with `org.freedesktop.DBus.Error.NotSupported`.
+ */
+
+enum {
+  PROP_0,
+  PROP_BROKER,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef struct _FbdBrokerClient {
+  guint watch_id;
+  guint n_events;
+} FbdBrokerClient;
+
+struct _FbdBrokerFrontend {
+  GObject          parent;
+
+  GDBusConnection *broker;
+  guint            ended_id;
+  guint            caps_id;
+  guint            props_id;
+
+  GDBusConnection *connection;
+  guint            registration_id;
+  guint            haptic_registration_id;
+
+  /* Key: event id, value: the sender that triggered it */
+  GHashTable      *events;
+  /* Key: sender, value: FbdBrokerClient */
+  GHashTable      *clients;
+};
+
+G_DEFINE_TYPE (FbdBrokerFrontend, fbd_broker_frontend, G_TYPE_OBJECT)
+
+typedef struct _FbdForwardCall {
+  FbdBrokerFrontend     *self;
+  GDBusMethodInvocation *invocation;
+} FbdForwardCall;
+
+
+static void
+fbd_broker_client_free (FbdBrokerClient *client)
+{
+  g_clear_handle_id (&client->watch_id, g_bus_unwatch_name);
+  g_free (client);
+}
+
+
+static void
+end_events_on_broker (FbdBrokerFrontend *self, GVariantBuilder *ids)
+{
+  g_dbus_connection_call (self->broker,
+                          NULL,
+                          FB_DBUS_PATH,
+                          FB_DBUS_NAME,
+                          "EndFeedbacks",
+                          g_variant_new ("(au)", ids),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          NULL,
+                          NULL);
+}
+
+/* Ends the events of @sender on the broker, returns the number of events */
+static guint
+end_client_events (FbdBrokerFrontend *self, const char *sender)
+{
+  g_auto (GVariantBuilder) ids = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("au"));
+  GHashTableIter iter;
+  gpointer id, event_sender;
+  guint n_events = 0;
+
+  g_hash_table_iter_init (&iter, self->events);
+  while (g_hash_table_iter_next (&iter, &id, &event_sender)) {
+    if (!g_str_equal (event_sender, sender))
+      continue;
+
+    g_variant_builder_add (&ids, "u", GPOINTER_TO_UINT (id));
+    g_hash_table_iter_remove (&iter);
+    n_events++;
+  }
+
+  if (n_events)
+    end_events_on_broker (self, &ids);
+  g_hash_table_remove (self->clients, sender);
+
+  return n_events;
+}
+
+
+static void
+on_client_vanished (GDBusConnection *connection, const char *name, gpointer user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  guint n_events;
+
+  n_events = end_client_events (self, name);
+  g_debug ("Client %s vanished, ended %u events", name, n_events);
+}
+
+
+static void
+track_event (FbdBrokerFrontend *self, const char *sender, guint event_id)
+{
+  FbdBrokerClient *client;
+
+  /* Peer to peer connections have no sender, these get broadcasts */
+  if (sender == NULL || event_id == 0)
+    return;
+
+  client = g_hash_table_lookup (self->clients, sender);
+  if (client == NULL) {
+    client = g_new0 (FbdBrokerClient, 1);
+    client->watch_id = g_bus_watch_name_on_connection (self->connection,
+                                                       sender,
+                                                       G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                       NULL,
+                                                       on_client_vanished,
+                                                       self,
+                                                       NULL);
+    g_hash_table_insert (self->clients, g_strdup (sender), client);
+  }
+
+  g_hash_table_insert (self->events, GUINT_TO_POINTER (event_id), g_strdup (sender));
+  client->n_events++;
+}
+
+
+static void
+track_events (FbdBrokerFrontend *self, const char *sender, GVariant *reply)
+{
+  g_autoptr (GVariantIter) iter = NULL;
+  guint event_id;
+
+  if (g_variant_is_of_type (reply, G_VARIANT_TYPE ("(u)"))) {
+    g_variant_get (reply, "(u)", &event_id);
+    track_event (self, sender, event_id);
+  } else if (g_variant_is_of_type (reply, G_VARIANT_TYPE ("(au)"))) {
+    g_variant_get (reply, "(au)", &iter);
+    while (g_variant_iter_next (iter, "u", &event_id))
+      track_event (self, sender, event_id);
+  }
+}
+
+/* Whether @event_id got triggered by @sender via the front-end */
+static gboolean
+is_client_event (FbdBrokerFrontend *self, const char *sender, guint event_id)
+{
+  const char *event_sender = g_hash_table_lookup (self->events, GUINT_TO_POINTER (event_id));
+
+  /* Events of peer to peer connections aren't tracked */
+  return g_strcmp0 (event_sender, sender) == 0;
+}
+
+/* Forgets about @event_id, returns the sender that triggered it */
+static char *
+untrack_event (FbdBrokerFrontend *self, guint event_id)
+{
+  FbdBrokerClient *client;
+  char *sender = NULL;
+
+  if (!g_hash_table_steal_extended (self->events, GUINT_TO_POINTER (event_id),
+                                    NULL, (gpointer *)&sender)) {
+    return NULL;
+  }
+
+  client = g_hash_table_lookup (self->clients, sender);
+  if (client && --client->n_events == 0)
+    g_hash_table_remove (self->clients, sender);
+
+  return sender;
+}
+
+
+static void
+on_forward_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdForwardCall *call = user_data;
+  FbdBrokerFrontend *self = call->self;
+  GDBusMethodInvocation *invocation = call->invocation;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_free (call);
+
+  reply = g_dbus_connection_call_with_unix_fd_list_finish (G_DBUS_CONNECTION (source_object),
+                                                           &fd_list,
+                                                           res,
+                                                           &err);
+  if (reply == NULL) {
+    g_autofree char *name = g_dbus_error_get_remote_error (err);
+
+    /* Keep the broker's error names, clients act on them */
+    if (name) {
+      g_dbus_error_strip_remote_error (err);
+      g_dbus_method_invocation_return_dbus_error (invocation, name, err->message);
+    } else {
+      g_dbus_method_invocation_return_gerror (invocation, err);
+    }
+    g_object_unref (self);
+    return;
+  }
+
+  if (self->connection &&
+      g_str_has_prefix (g_dbus_method_invocation_get_method_name (invocation), "TriggerFeedback")) {
+    track_events (self, g_dbus_method_invocation_get_sender (invocation), reply);
+  }
+
+  g_dbus_method_invocation_return_value_with_unix_fd_list (invocation, reply, fd_list);
+  g_object_unref (self);
+}
+
+
+static void
+forward_method_call (GDBusConnection       *connection,
+                     const char            *sender,
+                     const char            *object_path,
+                     const char            *interface_name,
+                     const char            *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  GDBusMessage *message = g_dbus_method_invocation_get_message (invocation);
+  GVariant *forward_parameters = parameters;
+  FbdForwardCall *call;
+
+  /* The broker only knows the session as a whole */
+  if (g_str_equal (method_name, "EndAllFeedbacksForSender")) {
+    if (sender)
+      end_client_events (self, sender);
+    g_dbus_method_invocation_return_value (invocation, NULL);
+    return;
+  }
+
+  /*
+   * The broker lets the session end all of the session's events so only
+   * pass on the caller's own. They're forgotten once the broker tells
+   * us they ended so FeedbackEnded still reaches the caller.
+   */
+  if (g_str_equal (method_name, "EndFeedback")) {
+    guint event_id;
+
+    g_variant_get (parameters, "(u)", &event_id);
+    if (!is_client_event (self, sender, event_id)) {
+      g_warning ("Tried to end non-existing or foreign event %u", event_id);
+      g_dbus_method_invocation_return_value (invocation, NULL);
+      return;
+    }
+  } else if (g_str_equal (method_name, "EndFeedbacks")) {
+    g_auto (GVariantBuilder) ids = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("au"));
+    g_autoptr (GVariantIter) iter = NULL;
+    guint event_id, n_ids = 0;
+
+    g_variant_get (parameters, "(au)", &iter);
+    while (g_variant_iter_next (iter, "u", &event_id)) {
+      if (!is_client_event (self, sender, event_id)) {
+        g_warning ("Tried to end non-existing or foreign event %u", event_id);
+        continue;
+      }
+      g_variant_builder_add (&ids, "u", event_id);
+      n_ids++;
+    }
+
+    if (n_ids == 0) {
+      g_dbus_method_invocation_return_value (invocation, NULL);
+      return;
+    }
+    forward_parameters = g_variant_new ("(au)", &ids);
+  }
+
+  call = g_new0 (FbdForwardCall, 1);
+  call->self = g_object_ref (self);
+  call->invocation = invocation;
+
+  g_dbus_connection_call_with_unix_fd_list (self->broker,
+                                            NULL,
+                                            object_path,
+                                            interface_name,
+                                            method_name,
+                                            forward_parameters,
+                                            NULL,
+                                            G_DBUS_CALL_FLAGS_NONE,
+                                            -1,
+                                            g_dbus_message_get_unix_fd_list (message),
+                                            NULL,
+                                            on_forward_done,
+                                            call);
+}
+
+
+static void
+reject_haptic_method_call (GDBusConnection       *connection,
+                           const char            *sender,
+                           const char            *object_path,
+                           const char            *interface_name,
+                           const char            *method_name,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation,
+                           gpointer               user_data)
+{
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                                         "Haptic interface not available via a broker");
+}
+
+
+static GVariant *
+forward_get_property (GDBusConnection  *connection,
+                      const char       *sender,
+                      const char       *object_path,
+                      const char       *interface_name,
+                      const char       *property_name,
+                      GError          **error,
+                      gpointer          user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  g_autoptr (GVariant) reply = NULL;
+  GVariant *value;
+
+  reply = g_dbus_connection_call_sync (self->broker,
+                                       NULL,
+                                       object_path,
+                                       PROPERTIES_IFACE,
+                                       "Get",
+                                       g_variant_new ("(ss)", interface_name, property_name),
+                                       G_VARIANT_TYPE ("(v)"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       PROPERTY_TIMEOUT,
+                                       NULL,
+                                       error);
+  if (reply == NULL)
+    return NULL;
+
+  g_variant_get (reply, "(v)", &value);
+  return value;
+}
+
+
+static gboolean
+forward_set_property (GDBusConnection  *connection,
+                      const char       *sender,
+                      const char       *object_path,
+                      const char       *interface_name,
+                      const char       *property_name,
+                      GVariant         *value,
+                      GError          **error,
+                      gpointer          user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  g_autoptr (GVariant) reply = NULL;
+
+  reply = g_dbus_connection_call_sync (self->broker,
+                                       NULL,
+                                       object_path,
+                                       PROPERTIES_IFACE,
+                                       "Set",
+                                       g_variant_new ("(ssv)",
+                                                      interface_name,
+                                                      property_name,
+                                                      value),
+                                       NULL,
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       PROPERTY_TIMEOUT,
+                                       NULL,
+                                       error);
+  return reply != NULL;
+}
+
+
+static void
+on_broker_feedback_ended (GDBusConnection *connection,
+                          const char      *sender_name,
+                          const char      *object_path,
+                          const char      *interface_name,
+                          const char      *signal_name,
+                          GVariant        *parameters,
+                          gpointer         user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  g_autofree char *destination = NULL;
+  g_autoptr (GError) err = NULL;
+  guint event_id, reason;
+
+  if (self->connection == NULL || !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(uu)")))
+    return;
+
+  g_variant_get (parameters, "(uu)", &event_id, &reason);
+  /* Unknown events are broadcast, e.g. if the broker broadcasts */
+  destination = untrack_event (self, event_id);
+
+  if (!g_dbus_connection_emit_signal (self->connection,
+                                      destination,
+                                      object_path,
+                                      interface_name,
+                                      signal_name,
+                                      parameters,
+                                      &err)) {
+    g_warning ("Failed to notify about end of event %u: %s", event_id, err->message);
+  }
+}
+
+
+static void
+on_broker_signal (GDBusConnection *connection,
+                  const char      *sender_name,
+                  const char      *object_path,
+                  const char      *interface_name,
+                  const char      *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (user_data);
+  g_autoptr (GError) err = NULL;
+
+  if (self->connection == NULL)
+    return;
+
+  if (!g_dbus_connection_emit_signal (self->connection,
+                                      NULL,
+                                      object_path,
+                                      interface_name,
+                                      signal_name,
+                                      parameters,
+                                      &err)) {
+    g_warning ("Failed to pass on %s: %s", signal_name, err->message);
+  }
+}
+
+
+static void
+fbd_broker_frontend_set_property (GObject      *object,
+                                  guint         property_id,
+                                  const GValue *value,
+                                  GParamSpec   *pspec)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (object);
+
+  switch (property_id) {
+  case PROP_BROKER:
+    g_set_object (&self->broker, g_value_get_object (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_broker_frontend_get_property (GObject    *object,
+                                  guint       property_id,
+                                  GValue     *value,
+                                  GParamSpec *pspec)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (object);
+
+  switch (property_id) {
+  case PROP_BROKER:
+    g_value_set_object (value, self->broker);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_broker_frontend_constructed (GObject *object)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (object);
+
+  G_OBJECT_CLASS (fbd_broker_frontend_parent_class)->constructed (object);
+
+  self->ended_id = g_dbus_connection_signal_subscribe (self->broker,
+                                                       NULL,
+                                                       FB_DBUS_NAME,
+                                                       "FeedbackEnded",
+                                                       FB_DBUS_PATH,
+                                                       NULL,
+                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                       on_broker_feedback_ended,
+                                                       self,
+                                                       NULL);
+  self->caps_id = g_dbus_connection_signal_subscribe (self->broker,
+                                                      NULL,
+                                                      FB_DBUS_NAME,
+                                                      "CapabilitiesChanged",
+                                                      FB_DBUS_PATH,
+                                                      NULL,
+                                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                                      on_broker_signal,
+                                                      self,
+                                                      NULL);
+  self->props_id = g_dbus_connection_signal_subscribe (self->broker,
+                                                       NULL,
+                                                       PROPERTIES_IFACE,
+                                                       "PropertiesChanged",
+                                                       FB_DBUS_PATH,
+                                                       FB_DBUS_NAME,
+                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                       on_broker_signal,
+                                                       self,
+                                                       NULL);
+}
+
+
+static void
+fbd_broker_frontend_dispose (GObject *object)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (object);
+
+  fbd_broker_frontend_unexport (self);
+
+  if (self->broker) {
+    g_dbus_connection_signal_unsubscribe (self->broker, self->ended_id);
+    g_dbus_connection_signal_unsubscribe (self->broker, self->caps_id);
+    g_dbus_connection_signal_unsubscribe (self->broker, self->props_id);
+    self->ended_id = self->caps_id = self->props_id = 0;
+  }
+  g_clear_object (&self->broker);
+
+  G_OBJECT_CLASS (fbd_broker_frontend_parent_class)->dispose (object);
+}
+
+
+static void
+fbd_broker_frontend_finalize (GObject *object)
+{
+  FbdBrokerFrontend *self = FBD_BROKER_FRONTEND (object);
+
+  g_clear_pointer (&self->events, g_hash_table_destroy);
+  g_clear_pointer (&self->clients, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (fbd_broker_frontend_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_broker_frontend_class_init (FbdBrokerFrontendClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = fbd_broker_frontend_constructed;
+  object_class->dispose = fbd_broker_frontend_dispose;
+  object_class->finalize = fbd_broker_frontend_finalize;
+  object_class->set_property = fbd_broker_frontend_set_property;
+  object_class->get_property = fbd_broker_frontend_get_property;
+
+  /**
+   * FbdBrokerFrontend:broker:
+   *
+   * The peer to peer connection to the broker
+   */
+  props[PROP_BROKER] =
+    g_param_spec_object ("broker", "", "",
+                         G_TYPE_DBUS_CONNECTION,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+fbd_broker_frontend_init (FbdBrokerFrontend *self)
+{
+  self->events = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  self->clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) fbd_broker_client_free);
+}
+
+
+FbdBrokerFrontend *
+fbd_broker_frontend_new (GDBusConnection *broker)
+{
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (broker), NULL);
+
+  return g_object_new (FBD_TYPE_BROKER_FRONTEND, "broker", broker, NULL);
+}
+
+/**
+ * fbd_broker_frontend_export:
+ * @self: The front-end
+ * @connection: The session's bus connection
+ * @error: return location for error or %NULL
+ *
+ * Provides the feedback interface on @connection, forwarding all
+ * requests to the broker. The haptic interface is provided too but
+ * rejects all method calls.
+ *
+ * Returns: `TRUE` if the interface was exported
+ */
+gboolean
+fbd_broker_frontend_export (FbdBrokerFrontend  *self,
+                            GDBusConnection    *connection,
+                            GError            **error)
+{
+  static const GDBusInterfaceVTable vtable = {
+    .method_call = forward_method_call,
+    .get_property = forward_get_property,
+    .set_property = forward_set_property,
+  };
+  static const GDBusInterfaceVTable haptic_vtable = {
+    .method_call = reject_haptic_method_call,
+  };
+
+  g_return_val_if_fail (FBD_IS_BROKER_FRONTEND (self), FALSE);
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), FALSE);
+  g_return_val_if_fail (self->connection == NULL, FALSE);
+
+  self->registration_id =
+    g_dbus_connection_register_object (connection,
+                                       FB_DBUS_PATH,
+                                       lfb_gdbus_feedback_interface_info (),
+                                       &vtable,
+                                       self,
+                                       NULL,
+                                       error);
+  if (self->registration_id == 0)
+    return FALSE;
+
+  /* Clients get an error instead of an unknown interface */
+  self->haptic_registration_id =
+    g_dbus_connection_register_object (connection,
+                                       FB_DBUS_PATH,
+                                       lfb_gdbus_feedback_haptic_interface_info (),
+                                       &haptic_vtable,
+                                       self,
+                                       NULL,
+                                       error);
+  if (self->haptic_registration_id == 0) {
+    g_dbus_connection_unregister_object (connection, self->registration_id);
+    self->registration_id = 0;
+    return FALSE;
+  }
+  g_message ("Haptic interface unavailable via the broker, rejecting its method calls");
+
+  self->connection = g_object_ref (connection);
+  return TRUE;
+}
+
+/**
+ * fbd_broker_frontend_unexport:
+ * @self: The front-end
+ *
+ * Stops providing the feedback interface and ends all events
+ * triggered via the front-end.
+ */
+void
+fbd_broker_frontend_unexport (FbdBrokerFrontend *self)
+{
+  g_auto (GVariantBuilder) ids = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("au"));
+  GHashTableIter iter;
+  gpointer id;
+
+  g_return_if_fail (FBD_IS_BROKER_FRONTEND (self));
+
+  if (self->connection == NULL)
+    return;
+
+  g_dbus_connection_unregister_object (self->connection, self->registration_id);
+  g_dbus_connection_unregister_object (self->connection, self->haptic_registration_id);
+  self->registration_id = self->haptic_registration_id = 0;
+
+  if (g_hash_table_size (self->events)) {
+    g_hash_table_iter_init (&iter, self->events);
+    while (g_hash_table_iter_next (&iter, &id, NULL))
+      g_variant_builder_add (&ids, "u", GPOINTER_TO_UINT (id));
+    end_events_on_broker (self, &ids);
+  }
+  g_hash_table_remove_all (self->events);
+  g_hash_table_remove_all (self->clients);
+
+  g_clear_object (&self->connection);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_BROKER_FRONTEND (fbd_broker_frontend_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdBrokerFrontend, fbd_broker_frontend, FBD, BROKER_FRONTEND, GObject)
+
+FbdBrokerFrontend *fbd_broker_frontend_new (GDBusConnection *broker);
+gboolean           fbd_broker_frontend_export (FbdBrokerFrontend  *self,
+                                               GDBusConnection    *connection,
+                                               GError            **error);
+void               fbd_broker_frontend_unexport (FbdBrokerFrontend *self);
+
+G_END_DECLS
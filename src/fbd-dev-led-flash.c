@@ -5,6 +5,7 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  *
  * See Documentation/ABI/testing/sysfs-class-led-trigger-pattern
+ *     Documentation/ABI/testing/sysfs-class-led-flash
  */
 
 #define G_LOG_DOMAIN "fbd-dev-led-flash"
@@ -12,26 +13,115 @@
 #include "fbd-dev-led-priv.h"
 #include "fbd-dev-led-flash.h"
 #include "fbd-enums.h"
+#include "fbd-timer-wheel.h"
 #include "fbd-udev.h"
 
 #include <gio/gio.h>
 
+#define LED_FLASH_BRIGHTNESS_ATTR     "flash_brightness"
+#define LED_FLASH_TIMEOUT_ATTR        "flash_timeout"
+#define LED_FLASH_STROBE_ATTR         "flash_strobe"
+#define LED_MAX_FLASH_BRIGHTNESS_ATTR "max_flash_brightness"
+#define LED_MAX_FLASH_TIMEOUT_ATTR    "max_flash_timeout"
+
 /**
  * fbd-dev-led-flash:
  *
  * The LED of a camera flash
+ *
+ * Blinking uses the flash class interface when available: brightness
+ * and duration of the pulses are set up once, each pulse is then a
+ * single write to `flash_strobe` and the hardware switches the LED
+ * off again. The pulses are scheduled via the timer wheel so they
+ * can be coalesced with other timers. Constant light and animations
+ * use the LED's torch mode.
  */
 typedef struct _FbdDevLedFlash {
   FbdDevLed parent;
+
+  /* In µA and µs, 0 if the LED can't strobe */
+  guint     max_flash_brightness;
+  guint     max_flash_timeout;
+  guint     strobe_id;
 } FbdDevLedFlash;
 
 
 G_DEFINE_TYPE (FbdDevLedFlash, fbd_dev_led_flash, FBD_TYPE_DEV_LED)
 
 
+static gboolean
+on_strobe_timeout (gpointer user_data)
+{
+  FbdDevLedFlash *self = user_data;
+  GUdevDevice *dev = fbd_dev_led_get_device (FBD_DEV_LED (self));
+  g_autoptr (GError) err = NULL;
+
+  if (!fbd_udev_queue_sysfs_path_attr_as_int (dev, LED_FLASH_STROBE_ATTR, 1, &err)) {
+    g_warning ("Failed to strobe flash: %s", err->message);
+    self->strobe_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+stop_strobe (FbdDevLedFlash *self)
+{
+  GUdevDevice *dev = fbd_dev_led_get_device (FBD_DEV_LED (self));
+  g_autoptr (GError) err = NULL;
+
+  if (self->strobe_id == 0)
+    return;
+
+  g_clear_handle_id (&self->strobe_id, fbd_timeout_remove);
+  /* Cut a running pulse short */
+  if (!fbd_udev_queue_sysfs_path_attr_as_int (dev, LED_FLASH_STROBE_ATTR, 0, &err))
+    g_warning ("Failed to stop flash strobe: %s", err->message);
+}
+
+
+static gboolean
+start_strobe (FbdDevLedFlash *self, guint max_brightness_percentage, guint freq)
+{
+  GUdevDevice *dev = fbd_dev_led_get_device (FBD_DEV_LED (self));
+  g_autoptr (GError) err = NULL;
+  guint period, timeout, brightness;
+
+  /*       ms     mHz */
+  period = 1000 * 1000 / freq;
+  /* Half of the period on, in µs */
+  timeout = MIN ((guint64) period * 1000 / 2, self->max_flash_timeout);
+  brightness = (guint64) self->max_flash_brightness * max_brightness_percentage / 100;
+  if (period == 0 || timeout == 0 || brightness == 0)
+    return FALSE;
+
+  /* Leave torch mode and any pattern trigger */
+  if (!fbd_dev_led_set_brightness (FBD_DEV_LED (self), 0))
+    return FALSE;
+
+  if (!fbd_udev_set_sysfs_path_attr_as_int (dev, LED_FLASH_BRIGHTNESS_ATTR, brightness, &err) ||
+      !fbd_udev_set_sysfs_path_attr_as_int (dev, LED_FLASH_TIMEOUT_ATTR, timeout, &err)) {
+    g_warning ("Failed to setup flash strobe: %s", err->message);
+    return FALSE;
+  }
+
+  g_debug ("Freq %d mHz, Brightness: %d%%, Strobe %u µs every %u ms",
+           freq, max_brightness_percentage, timeout, period);
+
+  self->strobe_id = fbd_timeout_add (period, FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                     on_strobe_timeout, self);
+  on_strobe_timeout (self);
+
+  return self->strobe_id != 0;
+}
+
+
 static gboolean
 fbd_dev_led_flash_probe (FbdDevLed *led, GError **error)
 {
+  FbdDevLedFlash *self = FBD_DEV_LED_FLASH (led);
   GUdevDevice *dev = fbd_dev_led_get_device (led);
   const gchar *name, *path;
   guint max_brightness;
@@ -52,19 +142,78 @@ fbd_dev_led_flash_probe (FbdDevLed *led, GError **error)
   fbd_dev_led_set_max_brightness (led, max_brightness);
   fbd_dev_led_set_supported_color (led, FBD_FEEDBACK_LED_COLOR_FLASH);
 
+  self->max_flash_brightness = g_udev_device_get_sysfs_attr_as_int (dev,
+                                                                    LED_MAX_FLASH_BRIGHTNESS_ATTR);
+  self->max_flash_timeout = g_udev_device_get_sysfs_attr_as_int (dev, LED_MAX_FLASH_TIMEOUT_ATTR);
+
   path = g_udev_device_get_sysfs_path (dev);
-  g_debug ("LED at '%s' usable as flash", path);
+  g_debug ("LED at '%s' usable as flash, strobe: %s", path,
+           self->max_flash_brightness && self->max_flash_timeout ? "yes" : "no");
 
   return TRUE;
 }
 
 
+static gboolean
+fbd_dev_led_flash_start_periodic (FbdDevLed *led,
+                                  guint      max_brightness_percentage,
+                                  guint      freq)
+{
+  FbdDevLedFlash *self = FBD_DEV_LED_FLASH (led);
+
+  stop_strobe (self);
+
+  if (freq && self->max_flash_brightness && self->max_flash_timeout &&
+      start_strobe (self, max_brightness_percentage, freq)) {
+    return TRUE;
+  }
+
+  return FBD_DEV_LED_CLASS (fbd_dev_led_flash_parent_class)->start_periodic (
+    led, max_brightness_percentage, freq);
+}
+
+
+static gboolean
+fbd_dev_led_flash_start_animation (FbdDevLed *led, FbdLedAnimation *animation)
+{
+  stop_strobe (FBD_DEV_LED_FLASH (led));
+
+  return FBD_DEV_LED_CLASS (fbd_dev_led_flash_parent_class)->start_animation (led, animation);
+}
+
+
+static gboolean
+fbd_dev_led_flash_stop (FbdDevLed *led)
+{
+  stop_strobe (FBD_DEV_LED_FLASH (led));
+
+  return FBD_DEV_LED_CLASS (fbd_dev_led_flash_parent_class)->stop (led);
+}
+
+
+static void
+fbd_dev_led_flash_finalize (GObject *object)
+{
+  FbdDevLedFlash *self = FBD_DEV_LED_FLASH (object);
+
+  g_clear_handle_id (&self->strobe_id, fbd_timeout_remove);
+
+  G_OBJECT_CLASS (fbd_dev_led_flash_parent_class)->finalize (object);
+}
+
+
 static void
 fbd_dev_led_flash_class_init (FbdDevLedFlashClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   FbdDevLedClass *fbd_dev_led_class = FBD_DEV_LED_CLASS (klass);
 
+  object_class->finalize = fbd_dev_led_flash_finalize;
+
   fbd_dev_led_class->probe = fbd_dev_led_flash_probe;
+  fbd_dev_led_class->start_periodic = fbd_dev_led_flash_start_periodic;
+  fbd_dev_led_class->start_animation = fbd_dev_led_flash_start_animation;
+  fbd_dev_led_class->stop = fbd_dev_led_flash_stop;
 }
 
 
@@ -151,10 +151,10 @@ fbd_dev_led_multicolor_set_color (FbdDevLed           *led,
   g_debug ("Multicolor intensity: %s", intensity);
 
   fbd_dev_led_set_brightness (led, max_brightness);
-  success = fbd_udev_set_sysfs_path_attr_as_string (dev,
-                                                    LED_MULTI_INTENSITY_ATTR,
-                                                    intensity,
-                                                    &err);
+  success = fbd_udev_queue_sysfs_path_attr_as_string (dev,
+                                                      LED_MULTI_INTENSITY_ATTR,
+                                                      intensity,
+                                                      &err);
   if (!success) {
     g_warning ("Failed to set multi intensity: %s", err->message);
     return FALSE;
@@ -49,6 +49,32 @@ fbd_dev_led_qcom_multicolor_start_periodic (FbdDevLed *led,
   return fbd_dev_led_start_periodic (FBD_DEV_LED (self->qcom_led), max_brightness_percentage, freq);
 }
 
+
+static gboolean
+fbd_dev_led_qcom_multicolor_start_animation (FbdDevLed *led, FbdLedAnimation *animation)
+{
+  FbdDevLedQcomMulticolor *self = FBD_DEV_LED_QCOM_MULTICOLOR (led);
+
+  /* The hardware pattern can't change colors so use the first one */
+  for (guint i = 0; i < fbd_led_animation_get_n_steps (animation); i++) {
+    const FbdLedStep *step = fbd_led_animation_get_step (animation, i);
+
+    if (step->has_color) {
+      FbdLedRgbColor rgb = step->rgb;
+
+      fbd_dev_led_set_color (led, FBD_FEEDBACK_LED_COLOR_RGB, &rgb);
+      break;
+    }
+  }
+
+  if (fbd_dev_led_qcom_start_hw_animation (self->qcom_led, animation))
+    return TRUE;
+
+  g_debug ("Falling back to software animation");
+  return FBD_DEV_LED_CLASS (fbd_dev_led_qcom_multicolor_parent_class)->start_animation (led,
+                                                                                        animation);
+}
+
 static void
 fbd_dev_led_qcom_multicolor_finalize (GObject *object)
 {
@@ -69,6 +95,7 @@ fbd_dev_led_qcom_multicolor_class_init (FbdDevLedQcomMulticolorClass *klass)
 
   fbd_dev_led_class->probe = fbd_dev_led_qcom_multicolor_probe;
   fbd_dev_led_class->start_periodic = fbd_dev_led_qcom_multicolor_start_periodic;
+  fbd_dev_led_class->start_animation = fbd_dev_led_qcom_multicolor_start_animation;
 }
 
 
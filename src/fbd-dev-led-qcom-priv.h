@@ -12,5 +12,7 @@
 G_BEGIN_DECLS
 
 gboolean fbd_dev_led_probe_qcom (FbdDevLed *led, GError **error);
+gboolean fbd_dev_led_qcom_start_hw_animation (FbdDevLedQcom   *self,
+                                              FbdLedAnimation *animation);
 
 G_END_DECLS
@@ -14,10 +14,17 @@
 
 #include <gio/gio.h>
 
+#include <math.h>
+#include <string.h>
+
 #define LED_HW_PATTERN_ATTR   "hw_pattern"
 #define LED_REPEAT_ATTR       "repeat"
 #define LED_REPEAT_INFINITY   "-1"
 #define QCOM_LPG_MAX_PAUSE_MS 511
+/* Smallest lookup table of the supported PMICs */
+#define QCOM_LPG_MAX_STEPS    24
+/* Minimum number of steps a ramp is approximated with */
+#define QCOM_LPG_RAMP_STEPS   4
 #define LED_DRIVER_PROP       "DRIVER"
 #define QCOM_LED_DRIVER       "qcom-spmi-lpg"
 
@@ -128,6 +135,180 @@ failure:
 }
 
 
+static guint
+get_gcd (guint a, guint b)
+{
+  while (b) {
+    guint t = b;
+
+    b = a % b;
+    a = t;
+  }
+
+  return a;
+}
+
+/* Steps at the start and end can use the LPG's lo and hi pause */
+static gboolean
+is_pause (FbdLedAnimation *animation, guint index)
+{
+  const FbdLedStep *step = fbd_led_animation_get_step (animation, index);
+  guint n_steps = fbd_led_animation_get_n_steps (animation);
+
+  if (step->kind != FBD_LED_STEP_HOLD || step->duration > QCOM_LPG_MAX_PAUSE_MS)
+    return FALSE;
+
+  return index == 0 || index == n_steps - 1;
+}
+
+
+static void
+append_entry (GString *pattern, guint brightness, guint duration)
+{
+  g_string_append_printf (pattern, "%u %u %u 0 ", brightness, duration, brightness);
+}
+
+/*
+ * Compile @animation into the LPG's hw_pattern format. The LPG steps
+ * through its lookup table at a fixed pace, only the first and last
+ * entry can last longer. Holds are hence split into multiple entries
+ * and ramps approximated by steps. Returns %NULL if the result doesn't
+ * fit the hardware's limits.
+ */
+static char *
+compile_hw_pattern (FbdLedAnimation *animation, guint max_brightness)
+{
+  g_autoptr (GString) pattern = g_string_new (NULL);
+  guint n_steps = fbd_led_animation_get_n_steps (animation);
+  gboolean repeat = fbd_led_animation_get_repeat (animation);
+  const FbdLedRgbColor *rgb = NULL;
+  guint gcd = 0, min_ramp = G_MAXUINT, tick = 1, n_entries = 0;
+
+  if (n_steps < 2)
+    return NULL;
+
+  for (guint i = 0; i < n_steps; i++) {
+    const FbdLedStep *step = fbd_led_animation_get_step (animation, i);
+
+    /* The pattern only scales the brightness, colors can't change */
+    if (step->has_color) {
+      if (rgb && memcmp (rgb, &step->rgb, sizeof (FbdLedRgbColor)))
+        return NULL;
+      rgb = &step->rgb;
+    }
+
+    if (is_pause (animation, i))
+      continue;
+
+    gcd = get_gcd (gcd, step->duration);
+    if (step->kind == FBD_LED_STEP_RAMP)
+      min_ramp = MIN (min_ramp, step->duration);
+  }
+
+  /* Pick the largest tick that divides all steps and resolves ramps */
+  for (guint k = 1; gcd && k <= gcd; k++) {
+    if (gcd % k)
+      continue;
+
+    tick = gcd / k;
+    if (tick <= QCOM_LPG_MAX_PAUSE_MS &&
+        (min_ramp == G_MAXUINT || min_ramp / tick >= QCOM_LPG_RAMP_STEPS))
+      break;
+  }
+
+  for (guint i = 0; i < n_steps; i++) {
+    const FbdLedStep *step = fbd_led_animation_get_step (animation, i);
+    guint brightness = round (max_brightness * step->brightness / 100.0);
+
+    if (is_pause (animation, i)) {
+      append_entry (pattern, brightness, step->duration);
+      n_entries++;
+    } else if (step->kind == FBD_LED_STEP_HOLD) {
+      for (guint j = 0; j < step->duration / tick; j++)
+        append_entry (pattern, brightness, tick);
+      n_entries += step->duration / tick;
+    } else {
+      guint m = step->duration / tick;
+      const FbdLedStep *prev = NULL;
+      double from;
+
+      if (i > 0)
+        prev = fbd_led_animation_get_step (animation, i - 1);
+      else if (repeat)
+        prev = fbd_led_animation_get_step (animation, n_steps - 1);
+      from = prev ? max_brightness * prev->brightness / 100.0 : 0;
+
+      for (guint j = 1; j <= m; j++)
+        append_entry (pattern, round (from + (brightness - from) * j / m), tick);
+      n_entries += m;
+    }
+
+    if (n_entries > QCOM_LPG_MAX_STEPS)
+      return NULL;
+  }
+
+  if (n_entries < 2)
+    return NULL;
+
+  g_string_truncate (pattern, pattern->len - 1);
+  g_string_append_c (pattern, '\n');
+
+  return g_string_free (g_steal_pointer (&pattern), FALSE);
+}
+
+/**
+ * fbd_dev_led_qcom_start_hw_animation:
+ * @self: The LED
+ * @animation: The animation
+ *
+ * Runs @animation via the LPG's hardware pattern so no CPU
+ * is involved.
+ *
+ * Returns: `TRUE` if the animation fits the hardware's limits and
+ *   was started
+ */
+gboolean
+fbd_dev_led_qcom_start_hw_animation (FbdDevLedQcom *self, FbdLedAnimation *animation)
+{
+  FbdDevLed *led = FBD_DEV_LED (self);
+  GUdevDevice *dev = fbd_dev_led_get_device (led);
+  g_autofree char *str = NULL;
+  g_autoptr (GError) err = NULL;
+  const char *repeat;
+
+  str = compile_hw_pattern (animation, fbd_dev_led_get_max_brightness (led));
+  if (!str) {
+    g_debug ("Animation exceeds LPG limits");
+    return FALSE;
+  }
+
+  repeat = fbd_led_animation_get_repeat (animation) ? LED_REPEAT_INFINITY : "1";
+  if (!fbd_udev_set_sysfs_path_attr_as_string (dev, LED_REPEAT_ATTR, repeat, &err)) {
+    g_warning ("Failed to set LED repeat: %s", err->message);
+    return FALSE;
+  }
+
+  if (!fbd_udev_set_sysfs_path_attr_as_string (dev, LED_HW_PATTERN_ATTR, str, &err)) {
+    g_warning ("Failed to set LED hw_pattern: %s", err->message);
+    return FALSE;
+  }
+
+  g_debug ("Animation with %u steps, hw_pattern: %s", fbd_led_animation_get_n_steps (animation), str);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_dev_led_qcom_start_animation (FbdDevLed *led, FbdLedAnimation *animation)
+{
+  if (fbd_dev_led_qcom_start_hw_animation (FBD_DEV_LED_QCOM (led), animation))
+    return TRUE;
+
+  g_debug ("Falling back to software animation");
+  return FBD_DEV_LED_CLASS (fbd_dev_led_qcom_parent_class)->start_animation (led, animation);
+}
+
+
 static void
 fbd_dev_led_qcom_class_init (FbdDevLedQcomClass *klass)
 {
@@ -135,6 +316,7 @@ fbd_dev_led_qcom_class_init (FbdDevLedQcomClass *klass)
 
   fbd_dev_led_class->probe = fbd_dev_led_qcom_probe;
   fbd_dev_led_class->start_periodic = fbd_dev_led_qcom_start_periodic;
+  fbd_dev_led_class->start_animation = fbd_dev_led_qcom_start_animation;
 }
 
 
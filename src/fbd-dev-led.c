@@ -13,13 +13,19 @@
 #include "fbd-dev-led.h"
 #include "fbd-dev-led-priv.h"
 #include "fbd-enums.h"
+#include "fbd-timer-wheel.h"
 #include "fbd-udev.h"
 
 #include <gio/gio.h>
 
+#include <math.h>
+
 #define LED_BRIGHTNESS_ATTR      "brightness"
 #define LED_PATTERN_ATTR         "pattern"
 
+/* Time between frames of software animations that dim LEDs in ms */
+#define FBD_DEV_LED_FRAME_INTERVAL 20
+
 enum {
   PROP_0,
   PROP_DEV,
@@ -31,15 +37,33 @@ static GParamSpec *props[PROP_LAST_PROP];
  * FbdDevLed:
  *
  * A single color LED driven by Linux sysfs
+ *
+ * Animations the `pattern` trigger can express run in the kernel.
+ * Other ones and LEDs without the trigger are animated in software. All
+ * animated LEDs share a single timer that only runs while there's
+ * something to animate. Frames that don't change the LED aren't
+ * written.
  */
 typedef struct _FbdDevLedPrivate {
   GUdevDevice        *dev;
   guint               max_brightness;
+  gboolean            has_pattern;
 
   int                 priority;
   FbdFeedbackLedColor color;
+
+  /* Software animation */
+  FbdLedAnimation    *animation;
+  gint64              animation_start;
+  gint                frame_brightness;
+  gboolean            frame_has_rgb;
+  FbdLedRgbColor      frame_rgb;
 } FbdDevLedPrivate;
 
+/* LEDs with running software animations */
+static GSList *animated_leds;
+static guint   animate_id;
+
 
 static void initable_iface_init (GInitableIface *iface);
 
@@ -53,17 +77,9 @@ fbd_dev_led_probe_default (FbdDevLed *led, GError **error)
   FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (led);
   const gchar *name, *path, *hint;
   gboolean success = FALSE;
-  const char *pattern;
 
   name = g_udev_device_get_name (priv->dev);
   hint = g_udev_device_get_property (priv->dev, "FEEDBACKD_LED_COLOR");
-  pattern = g_udev_device_get_sysfs_attr (priv->dev, LED_PATTERN_ATTR);
-  if (!pattern) {
-    g_set_error (error,
-                 G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                 "LED %s can't use patterns", name);
-    return FALSE;
-  }
 
   for (int i = 0; i <= FBD_FEEDBACK_LED_COLOR_RGB; i++) {
     g_autofree char *color = NULL;
@@ -99,6 +115,151 @@ fbd_dev_led_probe_default (FbdDevLed *led, GError **error)
 }
 
 
+static void
+write_frame (FbdDevLed *self, guint brightness, const FbdLedRgbColor *rgb)
+{
+  FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (self);
+
+  if (rgb && (!priv->frame_has_rgb || memcmp (rgb, &priv->frame_rgb, sizeof (*rgb)))) {
+    fbd_dev_led_set_color (self, FBD_FEEDBACK_LED_COLOR_RGB, (FbdLedRgbColor *) rgb);
+    priv->frame_rgb = *rgb;
+    priv->frame_has_rgb = TRUE;
+    /* Setting the color might have touched the brightness too */
+    priv->frame_brightness = -1;
+  }
+
+  if (priv->frame_brightness == brightness)
+    return;
+
+  priv->frame_brightness = brightness;
+  fbd_dev_led_set_brightness (self, brightness);
+}
+
+/*
+ * Write the animation frame for time @now. Returns the time until
+ * the next frame in ms or -1 when the animation ended.
+ */
+static gint64
+animate_frame (FbdDevLed *self, gint64 now)
+{
+  FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (self);
+  FbdLedAnimation *animation = priv->animation;
+  guint n_steps = fbd_led_animation_get_n_steps (animation);
+  guint duration = fbd_led_animation_get_duration (animation);
+  gboolean repeat = fbd_led_animation_get_repeat (animation);
+  const FbdLedStep *step = NULL, *prev = NULL;
+  gint64 t = (now - priv->animation_start) / 1000;
+  gboolean done = FALSE;
+  FbdLedRgbColor rgb;
+  double brightness;
+  gint64 next;
+
+  if (n_steps == 0)
+    return -1;
+
+  if (t >= duration) {
+    if (repeat && duration) {
+      t %= duration;
+    } else {
+      t = duration;
+      done = TRUE;
+    }
+  }
+
+  for (guint i = 0; i < n_steps; i++) {
+    step = fbd_led_animation_get_step (animation, i);
+
+    if (t < step->duration || i == n_steps - 1) {
+      if (i > 0)
+        prev = fbd_led_animation_get_step (animation, i - 1);
+      else if (repeat)
+        prev = fbd_led_animation_get_step (animation, n_steps - 1);
+      break;
+    }
+    t -= step->duration;
+  }
+
+  brightness = step->brightness;
+  rgb = step->rgb;
+  if (step->kind == FBD_LED_STEP_RAMP && step->duration) {
+    double frac = MIN ((double) t / step->duration, 1.0);
+    double from = prev ? prev->brightness : 0;
+
+    brightness = from + (step->brightness - from) * frac;
+    if (prev && prev->has_color && step->has_color) {
+      rgb.r = roundf (prev->rgb.r + ((double) step->rgb.r - prev->rgb.r) * frac);
+      rgb.g = roundf (prev->rgb.g + ((double) step->rgb.g - prev->rgb.g) * frac);
+      rgb.b = roundf (prev->rgb.b + ((double) step->rgb.b - prev->rgb.b) * frac);
+    }
+    next = MIN (FBD_DEV_LED_FRAME_INTERVAL, step->duration - t);
+  } else {
+    next = step->duration - t;
+  }
+
+  write_frame (self,
+               round (priv->max_brightness * brightness / 100.0),
+               step->has_color ? &rgb : NULL);
+
+  if (done)
+    return -1;
+
+  return MAX (next, 1);
+}
+
+
+static void
+stop_animation (FbdDevLed *self)
+{
+  FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (self);
+
+  if (priv->animation == NULL)
+    return;
+
+  animated_leds = g_slist_remove (animated_leds, self);
+  g_clear_pointer (&priv->animation, fbd_led_animation_unref);
+
+  if (animated_leds == NULL)
+    g_clear_handle_id (&animate_id, fbd_timeout_remove);
+}
+
+
+static gboolean
+on_animate_timeout (gpointer unused)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 next = G_MAXINT;
+  GSList *l = animated_leds;
+
+  animate_id = 0;
+
+  while (l) {
+    FbdDevLed *led = l->data;
+    gint64 delay;
+
+    l = l->next;
+    delay = animate_frame (led, now);
+    if (delay < 0)
+      stop_animation (led);
+    else
+      next = MIN (next, delay);
+  }
+
+  if (animated_leds) {
+    animate_id = fbd_timeout_add (next, FBD_TIMER_WHEEL_SLACK_DEFAULT, on_animate_timeout, NULL);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+reschedule_animations (void)
+{
+  g_clear_handle_id (&animate_id, fbd_timeout_remove);
+  on_animate_timeout (NULL);
+}
+
+
 static gboolean
 fbd_dev_led_set_color_default (FbdDevLed           *led,
                                FbdFeedbackLedColor  color,
@@ -122,6 +283,43 @@ fbd_dev_led_supports_color_default (FbdDevLed           *led,
 }
 
 
+static gboolean
+fbd_dev_led_start_animation_default (FbdDevLed *led, FbdLedAnimation *animation)
+{
+  FbdDevLedPrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
+  g_return_val_if_fail (animation, FALSE);
+  priv = fbd_dev_led_get_instance_private (led);
+
+  stop_animation (led);
+
+  if (priv->has_pattern) {
+    const char *pattern = fbd_led_animation_get_pattern (animation, priv->max_brightness);
+    g_autoptr (GError) err = NULL;
+
+    if (pattern) {
+      g_debug ("Animation with %u steps, pattern: %s",
+               fbd_led_animation_get_n_steps (animation), pattern);
+      if (fbd_udev_set_sysfs_path_attr_as_string (priv->dev, LED_PATTERN_ATTR, pattern, &err))
+        return TRUE;
+
+      g_warning ("Failed to set led pattern: %s", err->message);
+    }
+  }
+
+  priv->animation = fbd_led_animation_ref (animation);
+  priv->animation_start = g_get_monotonic_time ();
+  priv->frame_brightness = -1;
+  priv->frame_has_rgb = FALSE;
+  animated_leds = g_slist_prepend (animated_leds, led);
+
+  reschedule_animations ();
+
+  return TRUE;
+}
+
+
 static gboolean
 fbd_dev_led_start_periodic_default (FbdDevLed *led,
                                     guint      max_brightness_percentage,
@@ -143,6 +341,14 @@ fbd_dev_led_start_periodic_default (FbdDevLed *led,
 
     /*  ms     mHz           T/2 */
     t = 1000.0 * 1000.0 / freq / 2.0;
+    if (!priv->has_pattern) {
+      g_autoptr (FbdLedAnimation) animation = NULL;
+
+      g_debug ("Freq %d mHz, Brightness: %d%%, Software pattern", freq, max_brightness_percentage);
+      animation = fbd_led_animation_new_breathe (freq, max_brightness_percentage);
+      return fbd_dev_led_start_animation_default (led, animation);
+    }
+
     str = g_strdup_printf ("0 %d %d %d\n", (gint)t, (gint)max, (gint)t);
     g_debug ("Freq %d mHz, Brightness: %d%%, Blink pattern: %s", freq, max_brightness_percentage,
              str);
@@ -158,6 +364,13 @@ fbd_dev_led_start_periodic_default (FbdDevLed *led,
 }
 
 
+static gboolean
+fbd_dev_led_stop_default (FbdDevLed *led)
+{
+  return fbd_dev_led_set_brightness (led, 0);
+}
+
+
 static void
 fbd_dev_led_set_property (GObject      *object,
                           guint         property_id,
@@ -204,6 +417,7 @@ fbd_dev_led_finalize (GObject *object)
   FbdDevLed *self = FBD_DEV_LED (object);
   FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (self);
 
+  stop_animation (self);
   g_clear_object (&priv->dev);
 
   G_OBJECT_CLASS (fbd_dev_led_parent_class)->finalize (object);
@@ -216,8 +430,18 @@ initable_init (GInitable    *initable,
                GError      **error)
 {
   FbdDevLedClass *fbd_dev_led_class = FBD_DEV_LED_GET_CLASS (initable);
+  FbdDevLed *self = FBD_DEV_LED (initable);
+  FbdDevLedPrivate *priv = fbd_dev_led_get_instance_private (self);
+
+  if (!fbd_dev_led_class->probe (self, error))
+    return FALSE;
 
-  return fbd_dev_led_class->probe (FBD_DEV_LED (initable), error);
+  priv->has_pattern = !!g_udev_device_get_sysfs_attr (priv->dev, LED_PATTERN_ATTR);
+  if (!priv->has_pattern)
+    g_debug ("LED %s has no pattern trigger, using software patterns",
+             g_udev_device_get_name (priv->dev));
+
+  return TRUE;
 }
 
 
@@ -240,8 +464,10 @@ fbd_dev_led_class_init (FbdDevLedClass *klass)
 
   fbd_dev_led_class->probe = fbd_dev_led_probe_default;
   fbd_dev_led_class->start_periodic = fbd_dev_led_start_periodic_default;
+  fbd_dev_led_class->start_animation = fbd_dev_led_start_animation_default;
   fbd_dev_led_class->set_color = fbd_dev_led_set_color_default;
   fbd_dev_led_class->supports_color = fbd_dev_led_supports_color_default;
+  fbd_dev_led_class->stop = fbd_dev_led_stop_default;
 
   props[PROP_DEV] =
     g_param_spec_object ("dev", "", "",
@@ -275,7 +501,7 @@ fbd_dev_led_set_brightness (FbdDevLed *led, guint brightness)
   g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
   priv = fbd_dev_led_get_instance_private (led);
 
-  if (!fbd_udev_set_sysfs_path_attr_as_int (priv->dev, LED_BRIGHTNESS_ATTR, brightness, &err)) {
+  if (!fbd_udev_queue_sysfs_path_attr_as_int (priv->dev, LED_BRIGHTNESS_ATTR, brightness, &err)) {
     g_warning ("Failed to setup brightness: %s", err->message);
     return FALSE;
   }
@@ -293,9 +519,72 @@ fbd_dev_led_start_periodic (FbdDevLed *led,
 
   g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
 
+  stop_animation (led);
+
   return fbd_dev_led_class->start_periodic (led, max_brightness_percentage, freq);
 }
 
+/**
+ * fbd_dev_led_start_animation:
+ * @led: The LED
+ * @animation: The animation to run
+ *
+ * Runs @animation on @led replacing any running animation or
+ * pattern. LEDs that can run the animation in hardware do so,
+ * otherwise it is run in software.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_dev_led_start_animation (FbdDevLed *led, FbdLedAnimation *animation)
+{
+  FbdDevLedClass *fbd_dev_led_class = FBD_DEV_LED_GET_CLASS (led);
+
+  g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
+  g_return_val_if_fail (animation, FALSE);
+
+  stop_animation (led);
+
+  return fbd_dev_led_class->start_animation (led, animation);
+}
+
+/**
+ * fbd_dev_led_stop:
+ * @led: The LED
+ *
+ * Stops any pattern or animation and turns the LED off.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_dev_led_stop (FbdDevLed *led)
+{
+  FbdDevLedClass *fbd_dev_led_class = FBD_DEV_LED_GET_CLASS (led);
+
+  g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
+
+  stop_animation (led);
+
+  return fbd_dev_led_class->stop (led);
+}
+
+/**
+ * fbd_dev_led_is_animating:
+ * @led: The LED
+ *
+ * Returns: `TRUE` if a software animation is running on the LED
+ */
+gboolean
+fbd_dev_led_is_animating (FbdDevLed *led)
+{
+  FbdDevLedPrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_DEV_LED (led), FALSE);
+  priv = fbd_dev_led_get_instance_private (led);
+
+  return priv->animation != NULL;
+}
+
 
 gboolean
 fbd_dev_led_set_color (FbdDevLed           *led,
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "fbd-feedback-led.h"
+#include "fbd-led-animation.h"
 
 #include <gudev/gudev.h>
 
@@ -26,6 +27,10 @@ gboolean            fbd_dev_led_set_color (FbdDevLed           *led,
 gboolean            fbd_dev_led_start_periodic (FbdDevLed      *led,
                                                 guint           max_brightness_percentage,
                                                 guint           freq);
+gboolean            fbd_dev_led_start_animation (FbdDevLed       *led,
+                                                 FbdLedAnimation *animation);
+gboolean            fbd_dev_led_stop (FbdDevLed *led);
+gboolean            fbd_dev_led_is_animating (FbdDevLed *led);
 gboolean            fbd_dev_led_supports_color (FbdDevLed *led, FbdFeedbackLedColor color);
 int                 fbd_dev_led_get_priority (FbdDevLed *self);
 
@@ -36,11 +41,14 @@ struct _FbdDevLedClass {
   gboolean (*start_periodic) (FbdDevLed           *led,
                               guint                max_brightness_percentage,
                               guint                freq);
+  gboolean (*start_animation) (FbdDevLed          *led,
+                               FbdLedAnimation    *animation);
   gboolean (*set_color)      (FbdDevLed            *led,
                               FbdFeedbackLedColor   color,
                               FbdLedRgbColor       *rgb);
   gboolean (*supports_color) (FbdDevLed            *led,
                               FbdFeedbackLedColor   color);
+  gboolean (*stop)           (FbdDevLed            *led);
 };
 
 G_END_DECLS
@@ -10,7 +10,7 @@
 
 #include "fbd.h"
 #include "fbd-enums.h"
-#include "fbd-dev-led.h"
+#include "fbd-dev-led-priv.h"
 #include "fbd-dev-led-flash.h"
 #include "fbd-dev-led-multicolor.h"
 #include "fbd-dev-led-qcom.h"
@@ -28,27 +28,165 @@
  *
  * LED device interface
  *
- * #FbdDevLeds is used to interface with all LEDs detected in sysfs
- * It currently only supports one pattern per led at a time.
+ * #FbdDevLeds is used to interface with all LEDs detected in sysfs.
+ * Each LED can only show one pattern at a time so #FbdDevLeds keeps
+ * track of all requested patterns and shows the one with the highest
+ * priority on each LED. The LED is only updated when that changes.
  */
 typedef struct _FbdDevLeds {
   GObject      parent;
 
   GUdevClient *client;
   GSList      *leds;
+
+  GPtrArray   *requests;
+  /* The request currently shown on each LED */
+  GHashTable  *shown;
+  guint64      serial;
 } FbdDevLeds;
 
+/* A pattern requested for a LED */
+typedef struct _FbdLedRequest {
+  gpointer             owner;
+  guint                priority;
+  guint64              serial;
+  FbdDevLed           *led;
+
+  FbdFeedbackLedColor  color;
+  FbdLedRgbColor       rgb;
+  guint                max_brightness;
+  guint                freq;
+  FbdLedAnimation     *animation;
+} FbdLedRequest;
+
 static void initable_iface_init (GInitableIface *iface);
 
+/* The default GAsyncInitable implementation probes in a worker thread */
 G_DEFINE_TYPE_WITH_CODE (FbdDevLeds, fbd_dev_leds, G_TYPE_OBJECT,
-                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, NULL));
+
+
+static void
+fbd_led_request_free (FbdLedRequest *request)
+{
+  g_clear_pointer (&request->animation, fbd_led_animation_unref);
+  g_free (request);
+}
+
+
+static FbdLedRequest *
+fbd_led_request_copy (FbdLedRequest *request)
+{
+  FbdLedRequest *copy = g_memdup2 (request, sizeof (FbdLedRequest));
+
+  if (copy->animation)
+    fbd_led_animation_ref (copy->animation);
+
+  return copy;
+}
+
+/* Whether showing @b on a LED that shows @a needs any updates */
+static gboolean
+fbd_led_request_same_state (FbdLedRequest *a, FbdLedRequest *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+
+  return a->color == b->color &&
+    a->rgb.r == b->rgb.r && a->rgb.g == b->rgb.g && a->rgb.b == b->rgb.b &&
+    a->max_brightness == b->max_brightness &&
+    a->freq == b->freq &&
+    a->animation == b->animation;
+}
+
+
+static FbdLedRequest *
+find_request_by_owner (FbdDevLeds *self, gpointer owner, guint *index)
+{
+  for (guint i = 0; i < self->requests->len; i++) {
+    FbdLedRequest *request = g_ptr_array_index (self->requests, i);
+
+    if (request->owner == owner) {
+      if (index)
+        *index = i;
+      return request;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Show the pattern of the request with the highest priority on @led.
+ * If several requests have the same priority the most recent wins.
+ */
+static gboolean
+compose_led (FbdDevLeds *self, FbdDevLed *led)
+{
+  FbdLedRequest *winner = NULL, *shown;
+  gboolean success;
+
+  for (guint i = 0; i < self->requests->len; i++) {
+    FbdLedRequest *request = g_ptr_array_index (self->requests, i);
+
+    if (request->led != led)
+      continue;
+
+    if (winner == NULL || request->priority > winner->priority ||
+        (request->priority == winner->priority && request->serial > winner->serial)) {
+      winner = request;
+    }
+  }
+
+  shown = g_hash_table_lookup (self->shown, led);
+  if (fbd_led_request_same_state (shown, winner))
+    return TRUE;
+
+  if (winner == NULL) {
+    g_hash_table_remove (self->shown, led);
+    return fbd_dev_led_stop (led);
+  }
+
+  fbd_dev_led_set_color (led, winner->color, &winner->rgb);
+  if (winner->animation)
+    success = fbd_dev_led_start_animation (led, winner->animation);
+  else
+    success = fbd_dev_led_start_periodic (led, winner->max_brightness, winner->freq);
+
+  g_hash_table_insert (self->shown, led, fbd_led_request_copy (winner));
+
+  return success;
+}
+
+
+static gboolean
+add_request (FbdDevLeds *self, FbdLedRequest *request)
+{
+  FbdLedRequest *old;
+  FbdDevLed *old_led = NULL;
+  guint index;
+
+  old = find_request_by_owner (self, request->owner, &index);
+  if (old) {
+    old_led = old->led;
+    g_ptr_array_remove_index_fast (self->requests, index);
+  }
+
+  request->serial = ++self->serial;
+  g_ptr_array_add (self->requests, request);
+
+  if (old_led && old_led != request->led)
+    compose_led (self, old_led);
+
+  return compose_led (self, request->led);
+}
 
 
 static FbdDevLed *
 find_led_by_color (FbdDevLeds *self, FbdFeedbackLedColor color)
 {
-  g_return_val_if_fail (self->leds, NULL);
-
+  /* The list can become empty when LEDs get unplugged */
   for (GSList *l = self->leds; l != NULL; l = l->next) {
     FbdDevLed *led = FBD_DEV_LED (l->data);
     if (fbd_dev_led_supports_color (led, color))
@@ -120,38 +258,44 @@ priority_cmp (gconstpointer a, gconstpointer b)
 }
 
 
+/* Only matches LEDs tagged for feedbackd in 72-feedbackd.rules */
+static GList *
+enumerate_leds (GUdevClient *client)
+{
+  g_autoptr (GUdevEnumerator) enumerator = g_udev_enumerator_new (client);
+
+  g_udev_enumerator_add_match_subsystem (enumerator, LED_SUBSYSTEM);
+  g_udev_enumerator_add_match_property (enumerator, FEEDBACKD_UDEV_ATTR, FEEDBACKD_UDEV_VAL_LED);
+
+  return g_udev_enumerator_execute (enumerator);
+}
+
+
 static gboolean
 initable_init (GInitable    *initable,
                GCancellable *cancellable,
                GError      **error)
 {
-  const gchar * const subsystems[] = { LED_SUBSYSTEM, NULL };
   FbdDevLeds *self = FBD_DEV_LEDS (initable);
   g_autolist (GUdevDevice) leds = NULL;
   GSList *usable_leds = NULL;
 
-  self->client = g_udev_client_new (subsystems);
+  /* Only used for enumeration, LED hotplug comes via the manager's monitor */
+  self->client = g_udev_client_new (NULL);
 
-  leds = g_udev_client_query_by_subsystem (self->client, LED_SUBSYSTEM);
+  leds = enumerate_leds (self->client);
 
   for (GList *l = leds; l != NULL; l = l->next) {
     g_autoptr (GError) err = NULL;
     GUdevDevice *dev = G_UDEV_DEVICE (l->data);
     FbdDevLed *led;
 
-    if (g_strcmp0 (g_udev_device_get_property (dev, FEEDBACKD_UDEV_ATTR),
-                   FEEDBACKD_UDEV_VAL_LED)) {
-      continue;
-    }
-
     led = probe_led (dev, &err);
 
     if (led)
       usable_leds = g_slist_append (usable_leds, led);
   }
 
-  /* TODO: listen for new leds via udev events */
-
   if (usable_leds) {
     self->leds = g_slist_sort (usable_leds, priority_cmp);
   } else {
@@ -163,6 +307,7 @@ initable_init (GInitable    *initable,
   return !!usable_leds;
 }
 
+
 static void
 initable_iface_init (GInitableIface *iface)
 {
@@ -174,6 +319,10 @@ fbd_dev_leds_dispose (GObject *object)
 {
   FbdDevLeds *self = FBD_DEV_LEDS (object);
 
+  /* Make sure queued LED updates hit the hardware */
+  fbd_udev_flush_sysfs_attrs ();
+  g_clear_pointer (&self->requests, g_ptr_array_unref);
+  g_clear_pointer (&self->shown, g_hash_table_destroy);
   g_clear_object (&self->client);
   g_slist_free_full (self->leds, (GDestroyNotify)g_object_unref);
   self->leds = NULL;
@@ -192,6 +341,11 @@ fbd_dev_leds_class_init (FbdDevLedsClass *klass)
 static void
 fbd_dev_leds_init (FbdDevLeds *self)
 {
+  self->requests = g_ptr_array_new_with_free_func ((GDestroyNotify)fbd_led_request_free);
+  self->shown = g_hash_table_new_full (g_direct_hash,
+                                       g_direct_equal,
+                                       NULL,
+                                       (GDestroyNotify)fbd_led_request_free);
 }
 
 FbdDevLeds *
@@ -203,23 +357,71 @@ fbd_dev_leds_new (GError **error)
                                        NULL));
 }
 
+/**
+ * fbd_dev_leds_new_async:
+ * @cancellable: (nullable): A cancellable
+ * @callback: Invoked when probing finished
+ * @user_data: User data for @callback
+ *
+ * Like `fbd_dev_leds_new()` but the LEDs are probed in a worker
+ * thread.
+ */
+void
+fbd_dev_leds_new_async (GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+  g_async_initable_new_async (FBD_TYPE_DEV_LEDS,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              callback,
+                              user_data,
+                              NULL);
+}
+
+/**
+ * fbd_dev_leds_new_finish:
+ * @res: The result
+ * @error: The return location for errors
+ *
+ * Finishes `fbd_dev_leds_new_async()`.
+ *
+ * Returns:(transfer full)(nullable): The leds device
+ */
+FbdDevLeds *
+fbd_dev_leds_new_finish (GAsyncResult *res, GError **error)
+{
+  g_autoptr (GObject) source_object = g_async_result_get_source_object (res);
+  GObject *object;
+
+  object = g_async_initable_new_finish (G_ASYNC_INITABLE (source_object), res, error);
+  return object ? FBD_DEV_LEDS (object) : NULL;
+}
+
 /**
  * fbd_dev_leds_start_periodic:
  * @self: The #FbdDevLeds
+ * @owner: The requester of the pattern
+ * @priority: The pattern's priority
  * @color: The color LED to use for the LED pattern
- * @rgb: The rgb value to set (if `color` indicates an RGB led)
+ * @rgb: (nullable): The rgb value to set (if `color` indicates an RGB led)
  * @max_brightness_percentage: The max brightness (in percent) to use for the pattern
  * @freq: The pattern's frequency in mHz
  *
- * Start periodic feedback.
+ * Start periodic feedback. The pattern is shown as long as there's
+ * no pattern with a higher priority for the same LED. A previous
+ * pattern of @owner is replaced.
  */
 gboolean
 fbd_dev_leds_start_periodic (FbdDevLeds          *self,
+                             gpointer             owner,
+                             guint                priority,
                              FbdFeedbackLedColor  color,
                              FbdLedRgbColor      *rgb,
                              guint                max_brightness_percentage,
                              guint                freq)
 {
+  FbdLedRequest *request;
   FbdDevLed *led;
 
   g_return_val_if_fail (FBD_IS_DEV_LEDS (self), FALSE);
@@ -230,25 +432,94 @@ fbd_dev_leds_start_periodic (FbdDevLeds          *self,
     return FALSE;
   }
 
-  fbd_dev_led_set_color (led, color, rgb);
-
-  return fbd_dev_led_start_periodic (led, max_brightness_percentage, freq);
+  request = g_new0 (FbdLedRequest, 1);
+  request->owner = owner;
+  request->priority = priority;
+  request->led = led;
+  request->color = color;
+  if (rgb)
+    request->rgb = *rgb;
+  request->max_brightness = max_brightness_percentage;
+  request->freq = freq;
+
+  return add_request (self, request);
 }
 
+/**
+ * fbd_dev_leds_start_animation:
+ * @self: The #FbdDevLeds
+ * @owner: The requester of the animation
+ * @priority: The animation's priority
+ * @color: The color LED to use for the animation
+ * @rgb: (nullable): The rgb value to set (if `color` indicates an RGB led)
+ * @animation: The animation to run
+ *
+ * Start an animation with multiple steps. Like
+ * fbd_dev_leds_start_periodic() the animation is only shown
+ * when it has the highest priority for its LED.
+ */
 gboolean
-fbd_dev_leds_stop (FbdDevLeds *self, FbdFeedbackLedColor color)
+fbd_dev_leds_start_animation (FbdDevLeds          *self,
+                              gpointer             owner,
+                              guint                priority,
+                              FbdFeedbackLedColor  color,
+                              FbdLedRgbColor      *rgb,
+                              FbdLedAnimation     *animation)
 {
+  FbdLedRequest *request;
   FbdDevLed *led;
 
   g_return_val_if_fail (FBD_IS_DEV_LEDS (self), FALSE);
-
+  g_return_val_if_fail (animation, FALSE);
   led = find_led_by_color (self, color);
   if (!led) {
     g_warning_once ("No usable led found");
     return FALSE;
   }
 
-  return fbd_dev_led_set_brightness (led, 0);
+  request = g_new0 (FbdLedRequest, 1);
+  request->owner = owner;
+  request->priority = priority;
+  request->led = led;
+  request->color = color;
+  if (rgb)
+    request->rgb = *rgb;
+  request->animation = fbd_led_animation_ref (animation);
+
+  return add_request (self, request);
+}
+
+/**
+ * fbd_dev_leds_stop:
+ * @self: The #FbdDevLeds
+ * @owner: The requester of the pattern
+ *
+ * Drops the pattern requested by @owner. The LED then shows the
+ * next pattern by priority or is turned off.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_dev_leds_stop (FbdDevLeds *self, gpointer owner)
+{
+  FbdLedRequest *request;
+  FbdDevLed *led;
+  guint index;
+
+  g_return_val_if_fail (FBD_IS_DEV_LEDS (self), FALSE);
+
+  request = find_request_by_owner (self, owner, &index);
+  if (!request)
+    return TRUE;
+
+  led = request->led;
+  g_ptr_array_remove_index_fast (self->requests, index);
+
+  /* The LED is gone */
+  if (led == NULL)
+    return TRUE;
+
+  return compose_led (self, led);
 }
 
 /**
@@ -267,3 +538,91 @@ fbd_dev_leds_has_led (FbdDevLeds *self, FbdFeedbackLedColor color)
 
   return !!find_led_by_color (self, color);
 }
+
+/**
+ * fbd_dev_leds_add_device:
+ * @self: The FbdDevLeds
+ * @dev: The hotplugged LED device
+ *
+ * Probes and adds a LED that appeared after startup. A LED
+ * with the same sysfs path is replaced. Patterns whose LED got
+ * removed move to the new LED if it supports their color.
+ *
+ * Returns: `TRUE` if the LED is usable, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_leds_add_device (FbdDevLeds *self, GUdevDevice *dev)
+{
+  g_autoptr (GError) err = NULL;
+  FbdDevLed *led;
+
+  g_return_val_if_fail (FBD_IS_DEV_LEDS (self), FALSE);
+  g_return_val_if_fail (G_UDEV_IS_DEVICE (dev), FALSE);
+
+  fbd_dev_leds_remove_device (self, dev);
+
+  led = probe_led (dev, &err);
+  if (led == NULL)
+    return FALSE;
+
+  g_debug ("Added LED %s", g_udev_device_get_sysfs_path (dev));
+  self->leds = g_slist_insert_sorted (self->leds, led, priority_cmp);
+
+  /* Patterns requested while their LED was gone */
+  for (guint i = 0; i < self->requests->len; i++) {
+    FbdLedRequest *request = g_ptr_array_index (self->requests, i);
+
+    if (request->led != NULL)
+      continue;
+
+    request->led = find_led_by_color (self, request->color);
+    if (request->led && request->led != led)
+      compose_led (self, request->led);
+  }
+  compose_led (self, led);
+
+  return TRUE;
+}
+
+/**
+ * fbd_dev_leds_remove_device:
+ * @self: The FbdDevLeds
+ * @dev: The removed LED device
+ *
+ * Drops the LED matching @dev's sysfs path. The patterns requested
+ * for it are kept and shown again once a matching LED gets added.
+ *
+ * Returns: `TRUE` if a LED was removed, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_leds_remove_device (FbdDevLeds *self, GUdevDevice *dev)
+{
+  const char *path;
+
+  g_return_val_if_fail (FBD_IS_DEV_LEDS (self), FALSE);
+  g_return_val_if_fail (G_UDEV_IS_DEVICE (dev), FALSE);
+
+  path = g_udev_device_get_sysfs_path (dev);
+  for (GSList *l = self->leds; l != NULL; l = l->next) {
+    FbdDevLed *led = FBD_DEV_LED (l->data);
+
+    if (g_strcmp0 (g_udev_device_get_sysfs_path (fbd_dev_led_get_device (led)), path))
+      continue;
+
+    g_debug ("Removed LED %s", path);
+    /* Keep the requests so they move to the LED once it's back */
+    for (guint i = 0; i < self->requests->len; i++) {
+      FbdLedRequest *request = g_ptr_array_index (self->requests, i);
+
+      if (request->led == led)
+        request->led = NULL;
+    }
+    g_hash_table_remove (self->shown, led);
+
+    self->leds = g_slist_delete_link (self->leds, l);
+    g_object_unref (led);
+    return TRUE;
+  }
+
+  return FALSE;
+}
@@ -6,9 +6,10 @@
 #pragma once
 
 #include "fbd-feedback-led.h"
+#include "fbd-led-animation.h"
 #include "fbd-udev.h"
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -17,12 +18,26 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (FbdDevLeds, fbd_dev_leds, FBD, DEV_LEDS, GObject);
 
 FbdDevLeds *fbd_dev_leds_new (GError **error);
+void        fbd_dev_leds_new_async (GCancellable        *cancellable,
+                                    GAsyncReadyCallback  callback,
+                                    gpointer             user_data);
+FbdDevLeds *fbd_dev_leds_new_finish (GAsyncResult *res, GError **error);
 gboolean    fbd_dev_leds_start_periodic (FbdDevLeds          *self,
+                                         gpointer             owner,
+                                         guint                priority,
                                          FbdFeedbackLedColor  color,
                                          FbdLedRgbColor      *rgb,
                                          guint                max_brighness,
                                          guint                freq);
-gboolean    fbd_dev_leds_stop (FbdDevLeds *self, FbdFeedbackLedColor color);
+gboolean    fbd_dev_leds_start_animation (FbdDevLeds          *self,
+                                          gpointer             owner,
+                                          guint                priority,
+                                          FbdFeedbackLedColor  color,
+                                          FbdLedRgbColor      *rgb,
+                                          FbdLedAnimation     *animation);
+gboolean    fbd_dev_leds_stop (FbdDevLeds *self, gpointer owner);
 gboolean    fbd_dev_leds_has_led (FbdDevLeds *self, FbdFeedbackLedColor color);
+gboolean    fbd_dev_leds_add_device (FbdDevLeds *self, GUdevDevice *dev);
+gboolean    fbd_dev_leds_remove_device (FbdDevLeds *self, GUdevDevice *dev);
 
 G_END_DECLS
@@ -12,42 +12,130 @@
 
 #include "fbd-config.h"
 
+#include "fbd.h"
 #include "fbd-dev-sound.h"
 #include "fbd-feedback-sound.h"
-
-#include <gsound.h>
+#include "fbd-sound-backend-gsound.h"
+#include "fbd-stats.h"
+#include "fbd-trace.h"
+#ifdef FBD_HAVE_PIPEWIRE
+# include "fbd-sound-backend-pipewire.h"
+#endif
 
 #define GNOME_SOUND_SCHEMA_ID "org.gnome.desktop.sound"
 #define GNOME_SOUND_KEY_THEME_NAME "theme-name"
 
+#define FEEDBACKD_KEY_SOUND_BACKEND "sound-backend"
+#define FEEDBACKD_KEY_SOUND_MAX_VOICES "sound-max-voices"
+#define FEEDBACKD_KEY_SOUND_MAX_INSTANCES "sound-max-instances"
+#define FEEDBACKD_KEY_SOUND_VOICE_POLICY "sound-voice-policy"
+
 /**
  * SECTION:fbd-dev-sound
  * @short_description: Sound interface
  * @Title: FbdDevSound
  *
  * The #FbdDevSound is used to play sounds via the systems audio
- * system.
+ * system. The actual playback is done by a #FbdSoundBackend. If the
+ * configured backend can't play a sound the GSound backend is used
+ * as fallback.
+ *
+ * The number of sounds playing at once (voices) is limited by the
+ * `sound-max-voices` and, per sound, `sound-max-instances`
+ * settings. When a limit is hit `sound-voice-policy` determines
+ * whether the oldest voice is stopped or the new sound is dropped.
+ *
+ * The backends can be passed in via the #FbdDevSound:backend and
+ * #FbdDevSound:fallback properties, otherwise the `sound-backend`
+ * setting picks one.
  */
 
+enum {
+  PROP_0,
+  PROP_BACKEND,
+  PROP_FALLBACK,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef enum {
+  FBD_DEV_SOUND_VOICE_POLICY_STEAL_OLDEST,
+  FBD_DEV_SOUND_VOICE_POLICY_DROP_NEW,
+} FbdDevSoundVoicePolicy;
+
 typedef struct _FbdAsyncData {
   FbdDevSoundPlayedCallback  callback;
+  FbdFeedbackPlayback       *playback;
   FbdFeedbackSound          *feedback;
   FbdDevSound               *dev;
   GCancellable              *cancel;
+  /* When the sound was handed to the backend */
+  gint64                     start_time;
 } FbdAsyncData;
 
 typedef struct _FbdDevSound {
   GObject parent;
 
-  GSoundContext *ctx;
+  FbdSoundBackend *backend;
+  FbdSoundBackend *fallback;
   GSettings     *sound_settings;
+  GSettings     *settings;
   GHashTable    *playbacks;
+
+  /* Playing sounds, oldest first */
+  GQueue                 voices;
+  guint                  max_voices;
+  guint                  max_instances;
+  FbdDevSoundVoicePolicy voice_policy;
+  /* Finished playbacks' data for reuse */
+  GPtrArray             *pool;
+
+  /* Sound effects kept in the sound server's cache */
+  GStrv          preload;
+  guint          preload_pos;
+  guint          preload_id;
 } FbdDevSound;
 
 static void initable_iface_init (GInitableIface *iface);
 
+/* The default GAsyncInitable implementation probes in a worker thread */
 G_DEFINE_TYPE_WITH_CODE (FbdDevSound, fbd_dev_sound, G_TYPE_OBJECT,
-                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, NULL));
+
+static gboolean
+on_preload_idle (gpointer user_data)
+{
+  FbdDevSound *self = FBD_DEV_SOUND (user_data);
+  g_autoptr (GError) err = NULL;
+  const char *effect = self->preload[self->preload_pos];
+
+  if (effect == NULL) {
+    g_debug ("Preloaded %u sounds", self->preload_pos);
+    self->preload_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+  self->preload_pos++;
+
+  if (!fbd_sound_backend_cache (self->backend, effect, &err))
+    g_debug ("Failed to cache sound '%s': %s", effect, err->message);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Cache one sound per idle run so we don't block event processing */
+static void
+start_preload (FbdDevSound *self)
+{
+  g_clear_handle_id (&self->preload_id, g_source_remove);
+  self->preload_pos = 0;
+
+  if (self->preload == NULL || self->preload[0] == NULL)
+    return;
+
+  self->preload_id = g_idle_add_full (G_PRIORITY_LOW, on_preload_idle, self, NULL);
+  g_source_set_name_by_id (self->preload_id, "fbd-dev-sound-preload");
+}
 
 static void
 on_sound_theme_name_changed (FbdDevSound *self,
@@ -61,41 +149,142 @@ on_sound_theme_name_changed (FbdDevSound *self,
   g_return_if_fail (FBD_IS_DEV_SOUND (self));
   g_return_if_fail (G_IS_SETTINGS (settings));
   g_return_if_fail (!g_strcmp0 (key, GNOME_SOUND_KEY_THEME_NAME));
-  g_return_if_fail (self->ctx);
+  g_return_if_fail (self->backend);
 
   name = g_settings_get_string (settings, key);
   g_debug ("Setting sound theme to %s", name);
 
-  ok = gsound_context_set_attributes (self->ctx,
-				      &error,
-				      GSOUND_ATTR_CANBERRA_XDG_THEME_NAME,
-				      name,
-				      NULL);
+  ok = fbd_sound_backend_set_theme_name (self->backend, name, &error);
+  if (ok && self->fallback)
+    ok = fbd_sound_backend_set_theme_name (self->fallback, name, &error);
   if (!ok)
     g_warning ("Failed to set sound theme name to %s: %s", key, error->message);
+
+  /* The theme's samples differ, cache them again */
+  start_preload (self);
+}
+
+static void
+fbd_async_data_free (FbdAsyncData *data)
+{
+  g_object_unref (data->cancel);
+  g_free (data);
+  fbd_stats_object_free (fbd_stats_get_default (), FBD_STATS_OBJECT_SOUND, sizeof (*data));
 }
 
 static FbdAsyncData*
-fbd_async_data_new (FbdDevSound *dev, FbdFeedbackSound *feedback, FbdDevSoundPlayedCallback callback)
+fbd_async_data_acquire (FbdDevSound               *dev,
+                        FbdFeedbackPlayback       *playback,
+                        FbdDevSoundPlayedCallback  callback)
 {
   FbdAsyncData* data;
 
-  data = g_new0 (FbdAsyncData, 1);
+  if (dev->pool->len) {
+    data = g_ptr_array_steal_index_fast (dev->pool, dev->pool->len - 1);
+  } else {
+    data = g_new0 (FbdAsyncData, 1);
+    data->cancel = g_cancellable_new ();
+    fbd_stats_object_new (fbd_stats_get_default (), FBD_STATS_OBJECT_SOUND, sizeof (*data));
+  }
+
   data->callback = callback;
-  data->feedback = g_object_ref (feedback);
+  data->playback = fbd_feedback_playback_ref (playback);
+  data->feedback = FBD_FEEDBACK_SOUND (playback->feedback);
   data->dev = g_object_ref (dev);
-  data->cancel = g_cancellable_new ();
 
   return data;
 }
 
 static void
-fbd_async_data_dispose (FbdAsyncData *data)
+fbd_async_data_release (FbdAsyncData *data)
 {
-  g_object_unref (data->feedback);
-  g_object_unref (data->dev);
-  g_object_unref (data->cancel);
-  g_free (data);
+  FbdDevSound *dev = data->dev;
+
+  g_clear_pointer (&data->playback, fbd_feedback_playback_unref);
+  data->feedback = NULL;
+  data->callback = NULL;
+  data->dev = NULL;
+
+  if (dev->pool && dev->pool->len < dev->max_voices) {
+    g_cancellable_reset (data->cancel);
+    g_ptr_array_add (dev->pool, data);
+  } else {
+    fbd_async_data_free (data);
+  }
+
+  g_object_unref (dev);
+}
+
+static void
+on_voice_settings_changed (FbdDevSound *self,
+                           const gchar *key,
+                           GSettings   *settings)
+{
+  g_autofree char *policy = NULL;
+
+  g_return_if_fail (FBD_IS_DEV_SOUND (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  self->max_voices = g_settings_get_uint (settings, FEEDBACKD_KEY_SOUND_MAX_VOICES);
+  self->max_instances = g_settings_get_uint (settings, FEEDBACKD_KEY_SOUND_MAX_INSTANCES);
+
+  policy = g_settings_get_string (settings, FEEDBACKD_KEY_SOUND_VOICE_POLICY);
+  if (g_str_equal (policy, "drop-new"))
+    self->voice_policy = FBD_DEV_SOUND_VOICE_POLICY_DROP_NEW;
+  else
+    self->voice_policy = FBD_DEV_SOUND_VOICE_POLICY_STEAL_OLDEST;
+}
+
+static const char *
+get_sound_name (FbdFeedbackSound *feedback)
+{
+  const char *sound = fbd_feedback_sound_get_file_name (feedback);
+
+  return sound ?: fbd_feedback_sound_get_effect (feedback);
+}
+
+static void
+fbd_dev_sound_set_property (GObject      *object,
+                            guint         property_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  FbdDevSound *self = FBD_DEV_SOUND (object);
+
+  switch (property_id) {
+  case PROP_BACKEND:
+    g_clear_object (&self->backend);
+    self->backend = g_value_dup_object (value);
+    break;
+  case PROP_FALLBACK:
+    g_clear_object (&self->fallback);
+    self->fallback = g_value_dup_object (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+fbd_dev_sound_get_property (GObject    *object,
+                            guint       property_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  FbdDevSound *self = FBD_DEV_SOUND (object);
+
+  switch (property_id) {
+  case PROP_BACKEND:
+    g_value_set_object (value, self->backend);
+    break;
+  case PROP_FALLBACK:
+    g_value_set_object (value, self->fallback);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
 }
 
 static void
@@ -103,13 +292,49 @@ fbd_dev_sound_dispose (GObject *object)
 {
   FbdDevSound *self = FBD_DEV_SOUND (object);
 
-  g_clear_object (&self->ctx);
+  g_clear_handle_id (&self->preload_id, g_source_remove);
+  g_clear_pointer (&self->preload, g_strfreev);
+  g_clear_object (&self->backend);
+  g_clear_object (&self->fallback);
   g_clear_object (&self->sound_settings);
+  g_clear_object (&self->settings);
   g_clear_pointer (&self->playbacks, g_hash_table_unref);
+  g_queue_clear (&self->voices);
+  g_clear_pointer (&self->pool, g_ptr_array_unref);
 
   G_OBJECT_CLASS (fbd_dev_sound_parent_class)->dispose (object);
 }
 
+/* Picks the backend via the settings with GSound as fallback */
+static gboolean
+create_backends (FbdDevSound *self, GError **error)
+{
+  g_autofree char *backend = NULL;
+
+  g_clear_object (&self->fallback);
+  backend = g_settings_get_string (self->settings, FEEDBACKD_KEY_SOUND_BACKEND);
+  if (g_str_equal (backend, "pipewire")) {
+#ifdef FBD_HAVE_PIPEWIRE
+    g_autoptr (GError) err = NULL;
+
+    self->backend = fbd_sound_backend_pipewire_new (&err);
+    if (!self->backend)
+      g_warning ("Failed to init PipeWire sound backend, using GSound: %s", err->message);
+#else
+    g_warning ("Built without PipeWire sound backend, using GSound");
+#endif
+  }
+
+  self->fallback = fbd_sound_backend_gsound_new (error);
+  if (!self->fallback)
+    return FALSE;
+
+  if (!self->backend)
+    self->backend = g_steal_pointer (&self->fallback);
+
+  return TRUE;
+}
+
 static gboolean
 initable_init (GInitable    *initable,
                GCancellable *cancellable,
@@ -120,10 +345,22 @@ initable_init (GInitable    *initable,
   gboolean gnome_session = FALSE;
 
   self->playbacks = g_hash_table_new (g_direct_hash, g_direct_equal);
-  self->ctx = gsound_context_new (NULL, error);
-  if (!self->ctx)
+  self->pool = g_ptr_array_new_with_free_func ((GDestroyNotify) fbd_async_data_free);
+
+  self->settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_SOUND_MAX_VOICES,
+                            G_CALLBACK (on_voice_settings_changed), self);
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_SOUND_MAX_INSTANCES,
+                            G_CALLBACK (on_voice_settings_changed), self);
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_SOUND_VOICE_POLICY,
+                            G_CALLBACK (on_voice_settings_changed), self);
+  on_voice_settings_changed (self, FEEDBACKD_KEY_SOUND_MAX_VOICES, self->settings);
+
+  if (!self->backend && !create_backends (self, error))
     return FALSE;
 
+  g_debug ("Using %s", G_OBJECT_TYPE_NAME (self->backend));
+
   desktop = g_getenv ("XDG_CURRENT_DESKTOP");
   if (desktop) {
     g_auto (GStrv) components = g_strsplit (desktop, ":", -1);
@@ -153,12 +390,38 @@ fbd_dev_sound_class_init (FbdDevSoundClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->set_property = fbd_dev_sound_set_property;
+  object_class->get_property = fbd_dev_sound_get_property;
   object_class->dispose = fbd_dev_sound_dispose;
+
+  /**
+   * FbdDevSound:backend:
+   *
+   * The backend sounds are played with. If unset it's picked via the
+   * `sound-backend` setting.
+   */
+  props[PROP_BACKEND] =
+    g_param_spec_object ("backend", "", "",
+                         FBD_TYPE_SOUND_BACKEND,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdDevSound:fallback:
+   *
+   * The backend used for sounds #FbdDevSound:backend doesn't support.
+   * Only used when #FbdDevSound:backend is set as well.
+   */
+  props[PROP_FALLBACK] =
+    g_param_spec_object ("fallback", "", "",
+                         FBD_TYPE_SOUND_BACKEND,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
 
 static void
 fbd_dev_sound_init (FbdDevSound *self)
 {
+  g_queue_init (&self->voices);
 }
 
 FbdDevSound *
@@ -170,20 +433,75 @@ fbd_dev_sound_new (GError **error)
                                         NULL));
 }
 
+/**
+ * fbd_dev_sound_new_async:
+ * @cancellable: (nullable): A cancellable
+ * @callback: Invoked when probing finished
+ * @user_data: User data for @callback
+ *
+ * Like `fbd_dev_sound_new()` but the sound backend is set up in a worker
+ * thread.
+ */
+void
+fbd_dev_sound_new_async (GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+  g_async_initable_new_async (FBD_TYPE_DEV_SOUND,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              callback,
+                              user_data,
+                              NULL);
+}
+
+/**
+ * fbd_dev_sound_new_finish:
+ * @res: The result
+ * @error: The return location for errors
+ *
+ * Finishes `fbd_dev_sound_new_async()`.
+ *
+ * Returns:(transfer full)(nullable): The sound device
+ */
+FbdDevSound *
+fbd_dev_sound_new_finish (GAsyncResult *res, GError **error)
+{
+  g_autoptr (GObject) source_object = g_async_result_get_source_object (res);
+  GObject *object;
+
+  object = g_async_initable_new_finish (G_ASYNC_INITABLE (source_object), res, error);
+  return object ? FBD_DEV_SOUND (object) : NULL;
+}
+
+
+static void play (FbdDevSound *self, FbdSoundBackend *backend, FbdAsyncData *data);
 
 static void
-on_sound_play_finished_callback (GSoundContext *ctx,
-                                 GAsyncResult  *res,
-                                 FbdAsyncData  *data)
+on_sound_play_finished_callback (FbdSoundBackend *backend,
+                                 GAsyncResult    *res,
+                                 FbdAsyncData    *data)
 {
   g_autoptr (GError) err = NULL;
+  FbdDevSound *self = data->dev;
+
+  fbd_trace_mark (data->start_time * 1000, "sound-play", "%s", get_sound_name (data->feedback));
 
-  if (!gsound_context_play_full_finish (ctx, res, &err)) {
-    const char *sound = fbd_feedback_sound_get_file_name (data->feedback);
-    if (!sound)
-      sound = fbd_feedback_sound_get_effect (data->feedback);
+  if (fbd_sound_backend_play_finish (backend, res, &err)) {
+    fbd_stats_add_duration (fbd_stats_get_default (), FBD_STATS_DURATION_SOUND_PLAY,
+                            g_get_monotonic_time () - data->start_time);
+  } else {
+    const char *sound = get_sound_name (data->feedback);
+
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED) &&
+        self->fallback && backend != self->fallback) {
+      g_debug ("Sound '%s' not supported by %s, trying %s", sound,
+               G_OBJECT_TYPE_NAME (backend), G_OBJECT_TYPE_NAME (self->fallback));
+      play (self, self->fallback, data);
+      return;
+    }
 
-    if (err->domain == GSOUND_ERROR && err->code == GSOUND_ERROR_NOTFOUND) {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
       g_debug ("Failed to find sound '%s'", sound);
     } else if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
       g_debug ("Sound '%s' cancelled", sound);
@@ -192,67 +510,151 @@ on_sound_play_finished_callback (GSoundContext *ctx,
     }
   }
 
-  /* Order matters here. We need to remove the feedback from the hash table before
+  /* Order matters here. We need to remove the playback from the hash table before
      invoking the callback. */
-  g_hash_table_remove (data->dev->playbacks, data->feedback);
-  (*data->callback)(data->feedback);
+  g_hash_table_remove (data->dev->playbacks, data->playback);
+  g_queue_remove (&self->voices, data);
+  (*data->callback)(data->playback);
 
-  fbd_async_data_dispose (data);
+  fbd_async_data_release (data);
 }
 
 
+static void
+play (FbdDevSound *self, FbdSoundBackend *backend, FbdAsyncData *data)
+{
+  const char *role = NULL;
+  gint64 start_time;
+
+#ifdef FBD_USE_MEDIA_ROLES
+  role = fbd_feedback_sound_get_media_role (data->feedback);
+#endif
+  if (!role)
+    role = "event";
+
+  start_time = data->start_time = g_get_monotonic_time ();
+  fbd_sound_backend_play (backend, data->feedback, role, data->playback->loop_until,
+                          data->cancel,
+                          (GAsyncReadyCallback) on_sound_play_finished_callback,
+                          data);
+  fbd_stats_add_duration (fbd_stats_get_default (), FBD_STATS_DURATION_SOUND_START,
+                          g_get_monotonic_time () - start_time);
+  fbd_trace_mark (start_time * 1000, "sound-start", "%s via %s",
+                  get_sound_name (data->feedback), G_OBJECT_TYPE_NAME (backend));
+}
+
+
+/*
+ * Check whether another voice can be started for @feedback. Depending
+ * on the policy this stops the oldest voice (of the same sound if the
+ * per sound limit is hit).
+ */
+static gboolean
+claim_voice (FbdDevSound *self, FbdFeedbackSound *feedback)
+{
+  const char *sound = get_sound_name (feedback);
+  FbdAsyncData *oldest = NULL, *victim = NULL;
+  guint instances = 0;
+
+  for (GList *l = self->voices.head; l; l = l->next) {
+    FbdAsyncData *data = l->data;
+
+    if (g_strcmp0 (get_sound_name (data->feedback), sound))
+      continue;
+
+    if (oldest == NULL)
+      oldest = data;
+    instances++;
+  }
+
+  if (self->max_instances && instances >= self->max_instances)
+    victim = oldest;
+  else if (g_queue_get_length (&self->voices) >= self->max_voices)
+    victim = g_queue_peek_head (&self->voices);
+  else
+    return TRUE;
+
+  if (self->voice_policy == FBD_DEV_SOUND_VOICE_POLICY_DROP_NEW) {
+    g_debug ("Voice limit hit, dropping '%s'", sound);
+    return FALSE;
+  }
+
+  g_debug ("Voice limit hit, stopping '%s'", get_sound_name (victim->feedback));
+  /* The voice is gone for accounting purposes, the callback comes later */
+  g_queue_remove (&self->voices, victim);
+  g_cancellable_cancel (victim->cancel);
+
+  return TRUE;
+}
+
+/**
+ * fbd_dev_sound_play:
+ * @self: The sound device
+ * @playback: The playback of a sound feedback
+ * @callback: Invoked when the sound finished playing
+ *
+ * Starts playing the sound of @playback's feedback. The same feedback
+ * can be played by several playbacks at once. If the playback may loop
+ * the backend keeps playing the sound until the loop ends or the sound
+ * is stopped via `fbd_dev_sound_stop()`. If the voice limit is hit
+ * and the policy is to drop new sounds nothing is played and
+ * @callback is not invoked.
+ *
+ * Returns: `TRUE` if the sound is being played, otherwise `FALSE`
+ */
 gboolean
 fbd_dev_sound_play (FbdDevSound              *self,
-                    FbdFeedbackSound         *feedback,
+                    FbdFeedbackPlayback      *playback,
                     FbdDevSoundPlayedCallback callback)
 {
   FbdAsyncData *data;
-  const char *filename;
-  const char *role = NULL;
 
   g_return_val_if_fail (FBD_IS_DEV_SOUND (self), FALSE);
-  g_return_val_if_fail (GSOUND_IS_CONTEXT (self->ctx), FALSE);
+  g_return_val_if_fail (FBD_IS_SOUND_BACKEND (self->backend), FALSE);
+  g_return_val_if_fail (FBD_IS_FEEDBACK_SOUND (playback->feedback), FALSE);
 
-  data = fbd_async_data_new (self, feedback, callback);
+  if (!claim_voice (self, FBD_FEEDBACK_SOUND (playback->feedback)))
+    return FALSE;
 
-  if (!g_hash_table_insert (self->playbacks, feedback, data))
-    g_warning ("Feedback %p already present", feedback);
+  data = fbd_async_data_acquire (self, playback, callback);
 
-#ifdef FBD_USE_MEDIA_ROLES
-  role = fbd_feedback_sound_get_media_role (feedback);
-#endif
-  if (!role)
-    role = "event";
+  if (!g_hash_table_insert (self->playbacks, playback, data))
+    g_warning ("Playback %p already present", playback);
+  g_queue_push_tail (&self->voices, data);
 
-  filename = fbd_feedback_sound_get_file_name (feedback);
-  if (filename) {
-    gsound_context_play_full (self->ctx, data->cancel,
-                              (GAsyncReadyCallback) on_sound_play_finished_callback,
-                              data,
-                              GSOUND_ATTR_MEDIA_FILENAME, filename,
-                              GSOUND_ATTR_EVENT_DESCRIPTION, "Feedbackd custom sound feedback",
-                              GSOUND_ATTR_MEDIA_ROLE, role,
-                              NULL);
-  } else {
-    gsound_context_play_full (self->ctx, data->cancel,
-                              (GAsyncReadyCallback) on_sound_play_finished_callback,
-                              data,
-                              GSOUND_ATTR_EVENT_ID, fbd_feedback_sound_get_effect (feedback),
-                              GSOUND_ATTR_EVENT_DESCRIPTION, "Feedbackd sound feedback",
-                              GSOUND_ATTR_MEDIA_ROLE, role,
-                              NULL);
-  }
+  play (self, self->backend, data);
   return TRUE;
 }
 
+/**
+ * fbd_dev_sound_preload:
+ * @self: The sound device
+ * @effects: The sound effect names
+ *
+ * Asks the sound backend to cache the given sound effects so they
+ * don't need to be looked up and decoded when played. This replaces
+ * any previously preloaded effects and is redone when the sound theme
+ * changes.
+ */
+void
+fbd_dev_sound_preload (FbdDevSound *self, const char * const *effects)
+{
+  g_return_if_fail (FBD_IS_DEV_SOUND (self));
+
+  g_strfreev (self->preload);
+  self->preload = g_strdupv ((GStrv)effects);
+
+  start_preload (self);
+}
+
 gboolean
-fbd_dev_sound_stop (FbdDevSound *self, FbdFeedbackSound *feedback)
+fbd_dev_sound_stop (FbdDevSound *self, FbdFeedbackPlayback *playback)
 {
   FbdAsyncData *data;
 
   g_return_val_if_fail (FBD_IS_DEV_SOUND (self), FALSE);
 
-  data = g_hash_table_lookup (self->playbacks, feedback);
+  data = g_hash_table_lookup (self->playbacks, playback);
 
   if (data == NULL)
     return FALSE;
@@ -5,7 +5,7 @@
  */
 #pragma once
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
 #include "fbd-feedback-sound.h"
 
@@ -15,12 +15,17 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (FbdDevSound, fbd_dev_sound, FBD, DEV_SOUND, GObject);
 
-typedef void (*FbdDevSoundPlayedCallback)(FbdFeedbackSound *feedback);
+typedef void (*FbdDevSoundPlayedCallback)(FbdFeedbackPlayback *playback);
 
 FbdDevSound *fbd_dev_sound_new (GError **error);
+void         fbd_dev_sound_new_async (GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data);
+FbdDevSound *fbd_dev_sound_new_finish (GAsyncResult *res, GError **error);
 gboolean     fbd_dev_sound_play (FbdDevSound *self,
-                                 FbdFeedbackSound *feedback,
+                                 FbdFeedbackPlayback *playback,
                                  FbdDevSoundPlayedCallback callback);
-gboolean     fbd_dev_sound_stop (FbdDevSound *self, FbdFeedbackSound *feedback);
+gboolean     fbd_dev_sound_stop (FbdDevSound *self, FbdFeedbackPlayback *playback);
+void         fbd_dev_sound_preload (FbdDevSound *self, const char * const *effects);
 
 G_END_DECLS
@@ -9,14 +9,21 @@
 
 #define G_LOG_DOMAIN "fbd-dev-vibra"
 
+#include "fbd.h"
 #include "fbd-dev-vibra.h"
+#include "fbd-stats.h"
+#include "fbd-trace.h"
+#include "fbd-vibra-slots.h"
 
 #include <gio/gio.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/input.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -26,9 +33,43 @@
  * @Title: FbdDevVibra
  *
  * The #FbdDevVibra is used to interface with haptic motor via the force
- * feedback interface. It currently only supports one id at a time.
+ * feedback interface. It currently only plays one id at a time.
+ *
+ * Uploaded effects are kept in a small cache of effect slots so
+ * repeatedly played effects don't need to be uploaded again. Uploads
+ * can take several milliseconds on some devices. Changing the
+ * magnitude of a playing effect updates it in place and the overall
+ * strength is scaled via the device's gain so neither needs a new
+ * upload.
+ *
+ * Custom waveforms (`FF_CUSTOM`) stay resident once uploaded so
+ * playing them is a single write.
+ *
+ * If enabled via the `haptic-thread` setting all device I/O and the
+ * timing of pattern steps happens in a separate high priority thread.
+ * The main thread then only posts commands so busy main loops don't
+ * delay or jitter haptic feedback.
+ *
+ * Motors that can only be switched on and off (see
+ * #FbdDevVibraActuatorClass) get graded strengths via dithered
+ * patterns made of many short steps. They always use the haptic
+ * thread so these steps don't need main loop timers.
  */
 
+/* How long (in ms) a prepared effect is kept from being evicted */
+#define FBD_DEV_VIBRA_PREPARE_TIMEOUT 500
+
+/* Gain until fbd_dev_vibra_set_gain() is called, [0, 0xFFFF] */
+#define FBD_DEV_VIBRA_DEFAULT_GAIN 0xC000
+
+/* Upper bound for spin up and down times (in ms) */
+#define FBD_DEV_VIBRA_MAX_SPIN_TIME 200
+
+/* Used when the haptic thread can't use SCHED_FIFO */
+#define FBD_DEV_VIBRA_WORKER_NICE -10
+
+#define FEEDBACKD_KEY_HAPTIC_THREAD "haptic-thread"
+
 enum {
   PROP_0,
   PROP_DEVICE,
@@ -37,9 +78,11 @@ enum {
 static GParamSpec *props[PROP_LAST_PROP];
 
 typedef enum {
-  FBD_DEV_VIBRA_FEATURE_RUMBLE,
-  FBD_DEV_VIBRA_FEATURE_PERIODIC,
-  FBD_DEV_VIBRA_FEATURE_GAIN,
+  FBD_DEV_VIBRA_FEATURE_RUMBLE   = (1 << 0),
+  FBD_DEV_VIBRA_FEATURE_PERIODIC = (1 << 1),
+  FBD_DEV_VIBRA_FEATURE_GAIN     = (1 << 2),
+  FBD_DEV_VIBRA_FEATURE_CONSTANT = (1 << 3),
+  FBD_DEV_VIBRA_FEATURE_CUSTOM   = (1 << 4),
 } FbdDevVibraFeatureFlags;
 
 typedef struct _FbdDevVibra {
@@ -49,13 +92,149 @@ typedef struct _FbdDevVibra {
   gint fd;
   gint id; /* currently used id */
 
+  /* Uploaded effects */
+  FbdVibraSlots *slots;
+
+  /* Effects of a pattern played by the kernel */
+  int          pattern_ids[FBD_VIBRA_SLOTS_MAX];
+  guint        n_pattern_ids;
+
+  /* The haptic thread, owns the above when running */
+  GThread     *worker;
+  GAsyncQueue *queue;
+  gboolean     busy;
+
+  /* Until when the last prepared effect is reserved */
+  gint64       prepared_until;
+
+  /* The gain last written to the device, -1 if unknown */
+  int          gain;
+
   FbdDevVibraFeatureFlags features;
+  /* In ms, from the device's latency profile */
+  guint        spin_up;
+  guint        spin_down;
+  FbdDevVibraActuatorClass actuator_class;
 } FbdDevVibra;
 
 static void initable_iface_init (GInitableIface *iface);
+static gpointer worker_thread (gpointer data);
+static const FbdVibraSlotsOps slot_ops;
 
+/* The default GAsyncInitable implementation probes in a worker thread */
 G_DEFINE_TYPE_WITH_CODE (FbdDevVibra, fbd_dev_vibra, G_TYPE_OBJECT,
-                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init)
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE, NULL));
+
+typedef enum {
+  FBD_VIBRA_CMD_RUMBLE,
+  FBD_VIBRA_CMD_RETUNE,
+  FBD_VIBRA_CMD_PERIODIC,
+  FBD_VIBRA_CMD_ENVELOPE,
+  FBD_VIBRA_CMD_CUSTOM,
+  FBD_VIBRA_CMD_PREPARE,
+  FBD_VIBRA_CMD_GAIN,
+  FBD_VIBRA_CMD_PATTERN,
+  FBD_VIBRA_CMD_STEPS,
+  FBD_VIBRA_CMD_REMOVE,
+  FBD_VIBRA_CMD_STOP,
+  FBD_VIBRA_CMD_QUIT,
+} FbdVibraCmdType;
+
+typedef struct _FbdVibraCmd {
+  FbdVibraCmdType type;
+
+  double          magnitude;
+  guint           duration;
+  gboolean        upload;
+  double          fade_in_level;
+  guint           fade_in_time;
+  double          fade_out_level;
+  guint           fade_out_time;
+
+  struct ff_effect effect;
+  gint16         *custom_data;
+
+  double         *magnitudes;
+  guint          *durations;
+  guint           n_steps;
+  guint           repeat_count;
+  guint           repeat_from;
+} FbdVibraCmd;
+
+
+static FbdVibraCmd *
+vibra_cmd_new (FbdVibraCmdType type)
+{
+  FbdVibraCmd *cmd = g_new0 (FbdVibraCmd, 1);
+
+  cmd->type = type;
+  return cmd;
+}
+
+
+static FbdVibraCmd *
+vibra_cmd_new_pattern (FbdVibraCmdType  type,
+                       const double    *magnitudes,
+                       const guint     *durations,
+                       guint            n_steps)
+{
+  FbdVibraCmd *cmd = vibra_cmd_new (type);
+
+  cmd->magnitudes = g_memdup2 (magnitudes, sizeof (double) * n_steps);
+  cmd->durations = g_memdup2 (durations, sizeof (guint) * n_steps);
+  cmd->n_steps = n_steps;
+  return cmd;
+}
+
+
+/* The worker can run after the caller's samples are gone */
+static FbdVibraCmd *
+vibra_cmd_new_effect (FbdVibraCmdType type, const struct ff_effect *effect)
+{
+  FbdVibraCmd *cmd = vibra_cmd_new (type);
+
+  cmd->effect = *effect;
+  if (fbd_vibra_effect_is_custom (effect)) {
+    cmd->custom_data = fbd_vibra_effect_dup_custom_data (effect);
+    cmd->effect.u.periodic.custom_data = cmd->custom_data;
+  }
+  return cmd;
+}
+
+
+static void
+vibra_cmd_free (FbdVibraCmd *cmd)
+{
+  g_free (cmd->custom_data);
+  g_free (cmd->magnitudes);
+  g_free (cmd->durations);
+  g_free (cmd);
+}
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdVibraCmd, vibra_cmd_free)
+
+
+static void
+post_cmd (FbdDevVibra *self, FbdVibraCmd *cmd)
+{
+  switch (cmd->type) {
+  case FBD_VIBRA_CMD_REMOVE:
+  case FBD_VIBRA_CMD_STOP:
+  case FBD_VIBRA_CMD_QUIT:
+    self->busy = FALSE;
+    break;
+  case FBD_VIBRA_CMD_PREPARE:
+  case FBD_VIBRA_CMD_GAIN:
+    /* Doesn't start the motor */
+    break;
+  default:
+    self->busy = TRUE;
+    break;
+  }
+
+  g_async_queue_push (self->queue, cmd);
+}
+
 
 static void
 fbd_dev_vibra_set_property (GObject      *object,
@@ -95,6 +274,36 @@ fbd_dev_vibra_get_property (GObject    *object,
 #define HAS_FEATURE(fbit, a) \
   (a[(fbit/BITS_PER_LONG)] >> ((fbit % BITS_PER_LONG)) & 1)
 
+/* Scales the magnitude of all effects, including playing ones */
+static gboolean
+set_gain (FbdDevVibra *self, guint16 gain)
+{
+  struct input_event event = { 0 };
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+
+  if (!(self->features & FBD_DEV_VIBRA_FEATURE_GAIN))
+    return FALSE;
+
+  if (self->gain == gain)
+    return TRUE;
+
+  event.type = EV_FF;
+  event.code = FF_GAIN;
+  event.value = gain;
+
+  g_debug ("Setting master gain to %u%%", gain * 100 / 0xFFFF);
+  if (write (self->fd, &event, sizeof (event)) != sizeof (event)) {
+    g_warning ("Unable to set gain: %s", g_strerror (errno));
+    self->gain = -1;
+    return FALSE;
+  }
+  fbd_trace_mark (begin, "EV_FF", "gain %u", gain);
+
+  self->gain = gain;
+  return TRUE;
+}
+
+
 static gboolean
 initable_init (GInitable     *initable,
                GCancellable  *cancellable,
@@ -103,7 +312,8 @@ initable_init (GInitable     *initable,
   FbdDevVibra *self = FBD_DEV_VIBRA (initable);
   const char *filename = g_udev_device_get_device_file (self->device);
   gulong features[1 + FF_MAX/BITS_PER_LONG];
-  struct input_event gain = { 0 };
+  g_autoptr (GSettings) settings = NULL;
+  int n_effects;
 
   self->fd = open (filename, O_RDWR | O_NONBLOCK, O_RDWR);
   if (self->fd < 0) {
@@ -134,33 +344,52 @@ initable_init (GInitable     *initable,
 
   if (HAS_FEATURE(FF_PERIODIC, features))
     self->features |= FBD_DEV_VIBRA_FEATURE_PERIODIC;
-  else {
-    g_set_error (error,
-                 G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                 "No rumble capable vibra device “%s”: %s",
-                 filename, g_strerror (errno));
-    return FALSE;
-  }
+  else
+    g_debug ("Periodic effects unsupported");
+
+  if (HAS_FEATURE(FF_CONSTANT, features))
+    self->features |= FBD_DEV_VIBRA_FEATURE_CONSTANT;
+
+  /* Custom waveforms are periodic effects */
+  if (HAS_FEATURE(FF_CUSTOM, features) && (self->features & FBD_DEV_VIBRA_FEATURE_PERIODIC))
+    self->features |= FBD_DEV_VIBRA_FEATURE_CUSTOM;
 
-  /* Set gain to 75% if supported */
   if (HAS_FEATURE(FF_GAIN, features)) {
     self->features |= FBD_DEV_VIBRA_FEATURE_GAIN;
-    memset(&gain, 0, sizeof(gain));
-    gain.type = EV_FF;
-    gain.code = FF_GAIN;
-    gain.value = 0xC000; /* [0, 0xFFFF]) */
-
-    g_debug("Setting master gain to 75%%");
-    if (write(self->fd, &gain, sizeof(gain)) != sizeof(gain)) {
-      g_set_error (error,
-                 G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                 "Unable to set gain of '%s': %s",
-                 filename, g_strerror (errno));
-    }
+    set_gain (self, FBD_DEV_VIBRA_DEFAULT_GAIN);
   } else {
     g_debug ("Gain unsupported");
   }
 
+  if (ioctl (self->fd, EVIOCGEFFECTS, &n_effects) == -1 || n_effects < 1) {
+    g_debug ("Unable to query number of effects of '%s': %s", filename, g_strerror (errno));
+    n_effects = 1;
+  }
+  self->slots = fbd_vibra_slots_new (MIN (n_effects, FBD_VIBRA_SLOTS_MAX), &slot_ops, self);
+  g_debug ("Caching up to %u effects", fbd_vibra_slots_get_n_slots (self->slots));
+
+  self->spin_up = CLAMP (g_udev_device_get_property_as_int (self->device, FEEDBACKD_UDEV_SPIN_UP),
+                         0, FBD_DEV_VIBRA_MAX_SPIN_TIME);
+  self->spin_down = CLAMP (g_udev_device_get_property_as_int (self->device,
+                                                              FEEDBACKD_UDEV_SPIN_DOWN),
+                           0, FBD_DEV_VIBRA_MAX_SPIN_TIME);
+  if (self->spin_up || self->spin_down)
+    g_debug ("Motor spins up in %ums, down in %ums", self->spin_up, self->spin_down);
+
+  if (g_strcmp0 (g_udev_device_get_property (self->device, FEEDBACKD_UDEV_ACTUATOR_CLASS),
+                 FEEDBACKD_UDEV_VAL_ACTUATOR_ON_OFF) == 0) {
+    self->actuator_class = FBD_DEV_VIBRA_ACTUATOR_CLASS_ON_OFF;
+    g_debug ("Motor can only be switched on and off");
+  }
+
+  settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+  /* Dithered patterns have too many steps to time them on the main loop */
+  if (g_settings_get_boolean (settings, FEEDBACKD_KEY_HAPTIC_THREAD) ||
+      self->actuator_class == FBD_DEV_VIBRA_ACTUATOR_CLASS_ON_OFF) {
+    self->queue = g_async_queue_new ();
+    self->worker = g_thread_new ("fbd-haptic", worker_thread, self);
+  }
+
   g_debug ("Vibra device at '%s' usable", filename);
   return TRUE;
 }
@@ -186,6 +415,15 @@ fbd_dev_vibra_finalize (GObject *object)
 {
   FbdDevVibra *self = FBD_DEV_VIBRA (object);
 
+  if (self->worker) {
+    post_cmd (self, vibra_cmd_new (FBD_VIBRA_CMD_QUIT));
+    g_clear_pointer (&self->worker, g_thread_join);
+  }
+  g_clear_pointer (&self->queue, g_async_queue_unref);
+
+  g_clear_pointer (&self->slots, fbd_vibra_slots_free);
+
+  /* Closing the device erases all uploaded effects */
   if (self->fd >= 0) {
     close (self->fd);
     self->fd = -1;
@@ -220,49 +458,150 @@ static void
 fbd_dev_vibra_init (FbdDevVibra *self)
 {
   self->id = -1;
+  self->gain = -1;
 }
 
-FbdDevVibra *
-fbd_dev_vibra_new (GUdevDevice *device, GError **error)
+
+static gboolean
+is_pattern_id (FbdDevVibra *self, int id)
 {
-  return FBD_DEV_VIBRA (g_initable_new (FBD_TYPE_DEV_VIBRA,
-                                        NULL,
-                                        error,
-                                        "device", device,
-                                        NULL));
+  for (guint i = 0; i < self->n_pattern_ids; i++) {
+    if (self->pattern_ids[i] == id)
+      return TRUE;
+  }
+
+  return FALSE;
 }
 
-gboolean
-fbd_dev_vibra_rumble (FbdDevVibra *self, double magnitude, guint duration, gboolean upload)
+
+/* Sends an effect to the kernel, keeping track of how long that takes */
+static int
+set_effect (FbdDevVibra *self, struct ff_effect *effect)
 {
-  struct input_event event = { 0 };
-  struct ff_effect effect = { 0 };
+  gint64 start = g_get_monotonic_time ();
+  int ret, saved_errno;
 
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  ret = ioctl (self->fd, EVIOCSFF, effect);
+  saved_errno = errno;
+  fbd_stats_add_duration (fbd_stats_get_default (), FBD_STATS_DURATION_EVIOCSFF,
+                          g_get_monotonic_time () - start);
+  fbd_trace_mark (start * 1000, "EVIOCSFF", "type 0x%x, id %d", effect->type, effect->id);
+  errno = saved_errno;
 
-  memset(&effect, 0, sizeof(effect));
-  effect.type = FF_RUMBLE;
-  effect.id = -1;
-  effect.u.rumble.strong_magnitude = 0xFFFF * magnitude;
-  effect.u.rumble.weak_magnitude = 0;
-  effect.replay.length = duration;
-  effect.replay.delay = 0;
+  return ret;
+}
+
+
+static int
+slot_upload (struct ff_effect *effect, gpointer user_data)
+{
+  FbdDevVibra *self = FBD_DEV_VIBRA (user_data);
+
+  g_debug ("Uploading vibra effect (%d)", self->fd);
+  return set_effect (self, effect);
+}
+
+
+static void
+slot_erase (int id, gpointer user_data)
+{
+  FbdDevVibra *self = FBD_DEV_VIBRA (user_data);
+
+  if (ioctl (self->fd, EVIOCRMFF, id) == -1)
+    g_warning ("Failed to erase vibra effect with id %d: %s", id, g_strerror (errno));
+
+  if (self->id == id)
+    self->id = -1;
+}
+
+
+static gboolean
+slot_is_busy (int id, gpointer user_data)
+{
+  FbdDevVibra *self = FBD_DEV_VIBRA (user_data);
+
+  return id == self->id || is_pattern_id (self, id);
+}
+
+
+static const FbdVibraSlotsOps slot_ops = {
+  .upload = slot_upload,
+  .erase = slot_erase,
+  .is_busy = slot_is_busy,
+};
 
-  if (upload) {
-    g_debug("Uploading rumbling vibra effect (%d)", self->fd);
-    if (ioctl(self->fd, EVIOCSFF, &effect) == -1) {
-      g_warning ("Failed to upload rumbling vibra effect: %s", g_strerror (errno));
-      return FALSE;
-    }
-    self->id = effect.id;
-  }
 
-  g_debug("Playing rumbling vibra effect id %d", effect.id);
+/* Uploads the effect unless it's in the slot cache already */
+static gboolean
+upload_effect (FbdDevVibra *self, struct ff_effect *effect)
+{
+  return fbd_vibra_slots_upload (self->slots, effect, g_get_monotonic_time ());
+}
+
+/* Like `upload_effect()` but doesn't look at the slot cache */
+static gboolean
+upload_new_effect (FbdDevVibra *self, struct ff_effect *effect)
+{
+  return fbd_vibra_slots_upload_new (self->slots, effect, g_get_monotonic_time ());
+}
+
+/* Uploads the effect and keeps it from being evicted for a short while */
+static gboolean
+prepare_effect (FbdDevVibra *self, struct ff_effect *effect)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  return fbd_vibra_slots_prepare (self->slots, effect, now,
+                                  now + FBD_DEV_VIBRA_PREPARE_TIMEOUT * 1000);
+}
+
+
+static gboolean
+play_effect (FbdDevVibra *self, int id)
+{
+  struct input_event event = { 0 };
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+
   event.type = EV_FF;
+  event.code = id;
   event.value = 1;
-  event.code = self->id;
 
-  if (write (self->fd, (const void*) &event, sizeof (event)) < 0) {
+  if (write (self->fd, (const void*) &event, sizeof (event)) < 0)
+    return FALSE;
+  fbd_trace_mark (begin, "EV_FF", "play %d", id);
+
+  self->id = id;
+  return TRUE;
+}
+
+static void
+build_rumble (struct ff_effect *effect, double magnitude, guint duration)
+{
+  memset(effect, 0, sizeof(*effect));
+  effect->type = FF_RUMBLE;
+  effect->id = -1;
+  effect->u.rumble.strong_magnitude = 0xFFFF * magnitude;
+  effect->u.rumble.weak_magnitude = 0;
+  effect->replay.length = duration;
+  effect->replay.delay = 0;
+}
+
+static gboolean
+do_rumble (FbdDevVibra *self, double magnitude, guint duration, gboolean upload)
+{
+  struct ff_effect effect;
+  int id = self->id;
+
+  build_rumble (&effect, magnitude, duration);
+
+  if (upload || id == -1) {
+    if (!upload_effect (self, &effect))
+      return FALSE;
+    id = effect.id;
+  }
+
+  g_debug("Playing rumbling vibra effect id %d", id);
+  if (!play_effect (self, id)) {
     g_warning ("Failed to play rumbling vibra effect.");
     return FALSE;
   }
@@ -270,49 +609,49 @@ fbd_dev_vibra_rumble (FbdDevVibra *self, double magnitude, guint duration, gbool
   return TRUE;
 }
 
-/* TODO: fall back to multiple rumbles when sine not supported */
-gboolean
-fbd_dev_vibra_periodic (FbdDevVibra *self,
-                        guint        duration,
-                        double       magnitude,
-                        double       fade_in_level,
-                        guint        fade_in_time)
+static void
+build_periodic (struct ff_effect *effect,
+                guint             duration,
+                double            magnitude,
+                double            fade_in_level,
+                guint             fade_in_time)
 {
-  struct input_event event;
-  struct ff_effect effect = { 0 };
+  memset(effect, 0, sizeof(*effect));
+  effect->type = FF_PERIODIC;
+  effect->id = -1;
+  effect->u.periodic.waveform = FF_SINE;
+  effect->u.periodic.period = 10;
+  effect->u.periodic.magnitude = 0x7FFF * magnitude;
+  effect->u.periodic.offset = 0;
+  effect->u.periodic.phase = 0;
+  effect->direction = 0x4000;
+  effect->u.periodic.envelope.attack_length = fade_in_time;
+  effect->u.periodic.envelope.attack_level = 0x7FFF * fade_in_level;
+  effect->u.periodic.envelope.fade_length = 0;
+  effect->u.periodic.envelope.fade_level = 0;
+  effect->trigger.button = 0;
+  effect->trigger.interval = 0;
+  effect->replay.length = duration;
+  effect->replay.delay = 200;
+}
 
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+static gboolean
+do_periodic (FbdDevVibra *self,
+             guint        duration,
+             double       magnitude,
+             double       fade_in_level,
+             guint        fade_in_time)
+{
+  struct ff_effect effect;
 
-  effect.type = FF_PERIODIC;
-  effect.id = -1;
-  effect.u.periodic.waveform = FF_SINE;
-  effect.u.periodic.period = 10;
-  effect.u.periodic.magnitude = 0x7FFF * magnitude;
-  effect.u.periodic.offset = 0;
-  effect.u.periodic.phase = 0;
-  effect.direction = 0x4000;
-  effect.u.periodic.envelope.attack_length = fade_in_time;
-  effect.u.periodic.envelope.attack_level = 0x7FFF * fade_in_level;
-  effect.u.periodic.envelope.fade_length = 0;
-  effect.u.periodic.envelope.fade_level = 0;
-  effect.trigger.button = 0;
-  effect.trigger.interval = 0;
-  effect.replay.length = duration;
-  effect.replay.delay = 200;
+  build_periodic (&effect, duration, magnitude, fade_in_level, fade_in_time);
 
-  g_debug("Uploading periodic effect (%d)", self->fd);
-  if (ioctl(self->fd, EVIOCSFF, &effect) == -1) {
-    g_warning ("Failed to upload periodic vibra effect: %s", g_strerror (errno));
+  if (!upload_effect (self, &effect))
     return FALSE;
-  }
 
   g_debug("Playing periodic vibra effect id %d", effect.id);
-  event.type = EV_FF;
-  self->id = event.code = effect.id;
-  event.value = 1;
-
-  if (write (self->fd, (const void*) &event, sizeof (event)) < 0) {
-    g_warning ("Failed to play rumbling effect.");
+  if (!play_effect (self, effect.id)) {
+    g_warning ("Failed to play periodic effect.");
     return FALSE;
   }
 
@@ -320,70 +659,1121 @@ fbd_dev_vibra_periodic (FbdDevVibra *self,
 }
 
 
-gboolean
-fbd_dev_vibra_remove_effect (FbdDevVibra *self)
+/*
+ * Change the magnitude of the playing rumble by updating the uploaded
+ * effect in place instead of uploading a new one. Only rumbles
+ * started by an earlier retune are changed, other effects might be
+ * shared via the slot cache.
+ */
+static gboolean
+do_retune (FbdDevVibra *self, double magnitude, guint duration)
 {
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  FbdVibraSlot *slot = NULL;
+  struct ff_effect effect;
 
-  if (self->id == -1)
+  if (self->id != -1 && !is_pattern_id (self, self->id))
+    slot = fbd_vibra_slots_find (self->slots, self->id);
+
+  /* Reuse the rumble of an earlier retune, e.g. after a stop */
+  if (slot == NULL || !slot->tuned)
+    slot = fbd_vibra_slots_find_tuned (self->slots);
+
+  if (slot == NULL) {
+    build_rumble (&effect, magnitude, duration);
+    if (!upload_new_effect (self, &effect))
+      return FALSE;
+
+    slot = fbd_vibra_slots_find (self->slots, effect.id);
+    if (slot)
+      slot->tuned = TRUE;
+
+    g_debug ("Playing tunable vibra effect id %d", effect.id);
+    if (!play_effect (self, effect.id)) {
+      g_warning ("Failed to play rumbling vibra effect.");
+      return FALSE;
+    }
     return TRUE;
+  }
 
-  g_debug("Erasing vibra effect (%d)", self->fd);
-  if (ioctl(self->fd, EVIOCRMFF, self->id) == -1) {
-    g_warning  ("Failed to erase vibra effect with id %d: %s", self->id, strerror(errno));
-    self->id = -1;
+  effect = slot->effect;
+  effect.u.rumble.strong_magnitude = 0xFFFF * magnitude;
+  effect.replay.length = duration;
+
+  if (!fbd_vibra_effect_equal (&slot->effect, &effect)) {
+    if (set_effect (self, &effect) == -1) {
+      g_warning ("Failed to update vibra effect %d: %s", effect.id, g_strerror (errno));
+      return FALSE;
+    }
+    slot->effect = effect;
+  }
+  slot->last_used = g_get_monotonic_time ();
+
+  /* Replaying restarts the effect's duration */
+  if (!play_effect (self, effect.id)) {
+    g_warning ("Failed to play rumbling vibra effect.");
     return FALSE;
   }
-  self->id = -1;
+
   return TRUE;
 }
 
 
-gboolean
-fbd_dev_vibra_stop (FbdDevVibra *self)
+/*
+ * A single effect whose magnitude is shaped by the kernel via the
+ * effect's envelope. Prefer a sine, constant effects work as well for
+ * drivers that map them onto the motor directly.
+ */
+static void
+build_envelope (FbdDevVibra      *self,
+                struct ff_effect *effect,
+                guint             duration,
+                double            magnitude,
+                double            attack_level,
+                guint             attack_time,
+                double            fade_level,
+                guint             fade_time)
 {
-  struct input_event stop = { 0 };
+  struct ff_envelope *envelope;
+
+  memset(effect, 0, sizeof(*effect));
+  effect->id = -1;
+  effect->direction = 0x4000;
+  effect->replay.length = duration;
+  effect->replay.delay = 0;
+
+  if (self->features & FBD_DEV_VIBRA_FEATURE_PERIODIC) {
+    effect->type = FF_PERIODIC;
+    effect->u.periodic.waveform = FF_SINE;
+    effect->u.periodic.period = 10;
+    effect->u.periodic.magnitude = 0x7FFF * magnitude;
+    envelope = &effect->u.periodic.envelope;
+  } else {
+    effect->type = FF_CONSTANT;
+    effect->u.constant.level = 0x7FFF * magnitude;
+    envelope = &effect->u.constant.envelope;
+  }
 
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  envelope->attack_length = attack_time;
+  envelope->attack_level = 0x7FFF * attack_level;
+  envelope->fade_length = fade_time;
+  envelope->fade_level = 0x7FFF * fade_level;
+}
 
-  if (self->id == -1)
-    return TRUE;
+static gboolean
+do_envelope (FbdDevVibra *self,
+             guint        duration,
+             double       magnitude,
+             double       attack_level,
+             guint        attack_time,
+             double       fade_level,
+             guint        fade_time)
+{
+  struct ff_effect effect;
 
-  stop.type = EV_FF;
-  stop.code = self->id;
-  stop.value = 0;
+  build_envelope (self, &effect, duration, magnitude, attack_level, attack_time,
+                  fade_level, fade_time);
+
+  if (!upload_effect (self, &effect))
+    return FALSE;
 
-  if (write(self->fd, (const void*) &stop, sizeof(stop)) < 0) {
-    g_warning  ("Failed to stop vibra effect with id %d: %s", self->id, strerror(errno));
+  g_debug("Playing envelope vibra effect id %d", effect.id);
+  if (!play_effect (self, effect.id)) {
+    g_warning ("Failed to play envelope effect.");
     return FALSE;
   }
 
-  return fbd_dev_vibra_remove_effect (self);
+  return TRUE;
 }
 
-GUdevDevice *
-fbd_dev_vibra_get_device (FbdDevVibra *self)
-{
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
 
-  return self->device;
+/*
+ * A waveform stored in or interpreted by the driver, e.g. an index
+ * into the driver's effect library.
+ */
+static void
+build_custom (struct ff_effect *effect,
+              guint             duration,
+              double            magnitude,
+              const gint16     *samples,
+              guint             n_samples)
+{
+  memset(effect, 0, sizeof(*effect));
+  effect->type = FF_PERIODIC;
+  effect->id = -1;
+  effect->u.periodic.waveform = FF_CUSTOM;
+  effect->u.periodic.magnitude = 0x7FFF * magnitude;
+  effect->u.periodic.custom_len = n_samples;
+  effect->u.periodic.custom_data = (gint16 *)samples;
+  effect->direction = 0x4000;
+  effect->replay.length = duration;
+  effect->replay.delay = 0;
 }
 
-/**
- * fbd_dev_vibra_is_busy:
- * @self: The vibra device
- *
- * Check whether the device is currently in used
- *
- * Returns: `TRUE` when the device is in use, otherwise `FALSE`
- */
-gboolean
-fbd_dev_vibra_is_busy (FbdDevVibra *self)
+static gboolean
+do_custom (FbdDevVibra *self, struct ff_effect *effect)
 {
-  if (self == NULL)
+  if (!upload_effect (self, effect))
     return FALSE;
 
-  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), TRUE);
+  g_debug("Playing custom vibra effect id %d", effect->id);
+  if (!play_effect (self, effect->id)) {
+    g_warning ("Failed to play custom effect.");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+stop_effect (FbdDevVibra *self, int id)
+{
+  struct input_event stop = { 0 };
+
+  stop.type = EV_FF;
+  stop.code = id;
+  stop.value = 0;
+
+  if (write (self->fd, (const void*) &stop, sizeof(stop)) < 0) {
+    g_warning  ("Failed to stop vibra effect with id %d: %s", id, strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+release_effect (FbdDevVibra *self, int id, gboolean stop)
+{
+  /* Cached effects stay uploaded but need to be stopped */
+  if (fbd_vibra_slots_find (self->slots, id))
+    return stop_effect (self, id);
+
+  if (stop && !stop_effect (self, id))
+    return FALSE;
+
+  g_debug("Erasing vibra effect (%d)", self->fd);
+  if (ioctl(self->fd, EVIOCRMFF, id) == -1) {
+    g_warning  ("Failed to erase vibra effect with id %d: %s", id, strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+release_effects (FbdDevVibra *self, gboolean stop)
+{
+  gboolean success = TRUE;
+
+  if (self->id != -1) {
+    success = release_effect (self, self->id, stop);
+    self->id = -1;
+  }
+
+  for (guint i = 0; i < self->n_pattern_ids; i++)
+    success &= release_effect (self, self->pattern_ids[i], stop);
+  self->n_pattern_ids = 0;
+
+  return success;
+}
+
+
+static gboolean
+pattern_fits (FbdDevVibra  *self,
+              const double *magnitudes,
+              const guint  *durations,
+              guint         n_steps)
+{
+  guint n_effects = 0, total = 0;
+
+  for (guint i = 0; i < n_steps; i++) {
+    if (magnitudes[i] != 0.0)
+      n_effects++;
+    total += durations[i];
+  }
+
+  if (n_effects > fbd_vibra_slots_get_n_slots (self->slots) || total > G_MAXUINT16) {
+    g_debug ("Pattern with %u effects and %u ms doesn't fit device slots",
+             n_effects, total);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+do_play_pattern (FbdDevVibra  *self,
+                 const double *magnitudes,
+                 const guint  *durations,
+                 guint         n_steps)
+{
+  struct input_event events[FBD_VIBRA_SLOTS_MAX] = { 0 };
+  guint offset = 0;
+  ssize_t len;
+  gint64 begin;
+
+  release_effects (self, FALSE);
+
+  for (guint i = 0; i < n_steps; i++) {
+    struct ff_effect effect;
+
+    if (magnitudes[i] == 0.0) {
+      offset += durations[i];
+      continue;
+    }
+
+    memset (&effect, 0, sizeof (effect));
+    effect.type = FF_RUMBLE;
+    effect.id = -1;
+    effect.u.rumble.strong_magnitude = 0xFFFF * magnitudes[i];
+    effect.u.rumble.weak_magnitude = 0;
+    effect.replay.length = durations[i];
+    effect.replay.delay = offset;
+
+    if (!upload_effect (self, &effect)) {
+      release_effects (self, FALSE);
+      return FALSE;
+    }
+
+    /* Also keeps the effect from being evicted by the next upload */
+    self->pattern_ids[self->n_pattern_ids] = effect.id;
+
+    events[self->n_pattern_ids].type = EV_FF;
+    events[self->n_pattern_ids].code = effect.id;
+    events[self->n_pattern_ids].value = 1;
+    self->n_pattern_ids++;
+
+    offset += durations[i];
+  }
+
+  g_debug ("Playing pattern of %u effects", self->n_pattern_ids);
+  len = sizeof (struct input_event) * self->n_pattern_ids;
+  begin = FBD_TRACE_CURRENT_TIME;
+  if (write (self->fd, events, len) != len) {
+    g_warning ("Failed to play vibra pattern: %s", g_strerror (errno));
+    release_effects (self, TRUE);
+    return FALSE;
+  }
+  fbd_trace_mark (begin, "EV_FF", "play pattern of %u", self->n_pattern_ids);
+
+  return TRUE;
+}
+
+
+
+static void
+worker_raise_priority (void)
+{
+  struct sched_param param = { .sched_priority = sched_get_priority_min (SCHED_FIFO) };
+  int ret;
+
+  ret = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+  if (ret == 0) {
+    g_debug ("Haptic thread uses SCHED_FIFO");
+    return;
+  }
+  g_debug ("Failed to use SCHED_FIFO for haptic thread: %s", g_strerror (ret));
+
+  /* Linux applies the nice value to the calling thread only */
+  if (setpriority (PRIO_PROCESS, 0, FBD_DEV_VIBRA_WORKER_NICE) == 0)
+    g_debug ("Haptic thread uses nice level %d", FBD_DEV_VIBRA_WORKER_NICE);
+  else
+    g_debug ("Failed to raise haptic thread priority: %s", g_strerror (errno));
+}
+
+
+static void
+worker_pattern_step (FbdDevVibra *self, FbdVibraCmd *steps, guint pos)
+{
+  /* Consecutive steps update the playing effect in place */
+  if (steps->magnitudes[pos] != 0.0)
+    do_retune (self, steps->magnitudes[pos], steps->durations[pos]);
+  else
+    release_effects (self, FALSE);
+}
+
+
+/*
+ * The worker owns the device's fd, effect slots and played ids. The
+ * main thread only posts commands. Pattern steps are timed against
+ * absolute deadlines so they don't drift.
+ */
+static gpointer
+worker_thread (gpointer data)
+{
+  FbdDevVibra *self = FBD_DEV_VIBRA (data);
+  g_autoptr (FbdVibraCmd) steps = NULL;
+  gint64 deadline = 0;
+  guint pos = 0, loop = 0;
+
+  worker_raise_priority ();
+
+  while (TRUE) {
+    g_autoptr (FbdVibraCmd) cmd = NULL;
+
+    if (steps) {
+      gint64 timeout = deadline - g_get_monotonic_time ();
+
+      if (timeout > 0)
+        cmd = g_async_queue_timeout_pop (self->queue, timeout);
+
+      if (cmd == NULL) {
+        pos++;
+        if (pos == steps->n_steps && loop < steps->repeat_count) {
+          loop++;
+          pos = steps->repeat_from;
+        }
+        if (pos == steps->n_steps) {
+          g_clear_pointer (&steps, vibra_cmd_free);
+          continue;
+        }
+        worker_pattern_step (self, steps, pos);
+        deadline += (gint64)steps->durations[pos] * 1000;
+        continue;
+      }
+
+      /* Any new command replaces the running pattern */
+      g_clear_pointer (&steps, vibra_cmd_free);
+    } else {
+      cmd = g_async_queue_pop (self->queue);
+    }
+
+    switch (cmd->type) {
+    case FBD_VIBRA_CMD_RUMBLE:
+      do_rumble (self, cmd->magnitude, cmd->duration, cmd->upload);
+      break;
+    case FBD_VIBRA_CMD_RETUNE:
+      do_retune (self, cmd->magnitude, cmd->duration);
+      break;
+    case FBD_VIBRA_CMD_PERIODIC:
+      do_periodic (self, cmd->duration, cmd->magnitude, cmd->fade_in_level, cmd->fade_in_time);
+      break;
+    case FBD_VIBRA_CMD_ENVELOPE:
+      do_envelope (self, cmd->duration, cmd->magnitude,
+                   cmd->fade_in_level, cmd->fade_in_time,
+                   cmd->fade_out_level, cmd->fade_out_time);
+      break;
+    case FBD_VIBRA_CMD_CUSTOM:
+      do_custom (self, &cmd->effect);
+      break;
+    case FBD_VIBRA_CMD_PREPARE:
+      prepare_effect (self, &cmd->effect);
+      break;
+    case FBD_VIBRA_CMD_GAIN:
+      set_gain (self, cmd->magnitude * 0xFFFF);
+      break;
+    case FBD_VIBRA_CMD_PATTERN:
+      do_play_pattern (self, cmd->magnitudes, cmd->durations, cmd->n_steps);
+      break;
+    case FBD_VIBRA_CMD_STEPS:
+      steps = g_steal_pointer (&cmd);
+      pos = 0;
+      loop = 0;
+      deadline = g_get_monotonic_time () + (gint64)steps->durations[0] * 1000;
+      worker_pattern_step (self, steps, pos);
+      break;
+    case FBD_VIBRA_CMD_REMOVE:
+      release_effects (self, FALSE);
+      break;
+    case FBD_VIBRA_CMD_STOP:
+      release_effects (self, TRUE);
+      break;
+    case FBD_VIBRA_CMD_QUIT:
+      release_effects (self, TRUE);
+      return NULL;
+    default:
+      g_assert_not_reached ();
+    }
+  }
+}
+
+
+FbdDevVibra *
+fbd_dev_vibra_new (GUdevDevice *device, GError **error)
+{
+  return FBD_DEV_VIBRA (g_initable_new (FBD_TYPE_DEV_VIBRA,
+                                        NULL,
+                                        error,
+                                        "device", device,
+                                        NULL));
+}
+
+/**
+ * fbd_dev_vibra_new_async:
+ * @device: The udev device of the motor
+ * @cancellable: (nullable): A cancellable
+ * @callback: Invoked when probing finished
+ * @user_data: User data for @callback
+ *
+ * Like `fbd_dev_vibra_new()` but the device is opened and probed in
+ * a worker thread.
+ */
+void
+fbd_dev_vibra_new_async (GUdevDevice         *device,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+  g_async_initable_new_async (FBD_TYPE_DEV_VIBRA,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              callback,
+                              user_data,
+                              "device", device,
+                              NULL);
+}
+
+/**
+ * fbd_dev_vibra_new_finish:
+ * @res: The result
+ * @error: The return location for errors
+ *
+ * Finishes `fbd_dev_vibra_new_async()`.
+ *
+ * Returns:(transfer full)(nullable): The vibra device
+ */
+FbdDevVibra *
+fbd_dev_vibra_new_finish (GAsyncResult *res, GError **error)
+{
+  g_autoptr (GObject) source_object = g_async_result_get_source_object (res);
+  GObject *object;
+
+  object = g_async_initable_new_finish (G_ASYNC_INITABLE (source_object), res, error);
+  return object ? FBD_DEV_VIBRA (object) : NULL;
+}
+
+
+gboolean
+fbd_dev_vibra_rumble (FbdDevVibra *self, double magnitude, guint duration, gboolean upload)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (self->worker == NULL)
+    return do_rumble (self, magnitude, duration, upload);
+
+  cmd = vibra_cmd_new (FBD_VIBRA_CMD_RUMBLE);
+  cmd->magnitude = magnitude;
+  cmd->duration = duration;
+  cmd->upload = upload;
+  post_cmd (self, cmd);
+
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_retune:
+ * @self: The vibra device
+ * @magnitude: The new relative magnitude
+ * @duration: The duration in ms from now
+ *
+ * Changes the magnitude of the rumble started by an earlier retune.
+ * The uploaded effect is updated in place so this is cheap enough to
+ * be called at a high rate. If the device plays any other effect a
+ * new rumble is started instead.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_retune (FbdDevVibra *self, double magnitude, guint duration)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (self->worker == NULL)
+    return do_retune (self, magnitude, duration);
+
+  cmd = vibra_cmd_new (FBD_VIBRA_CMD_RETUNE);
+  cmd->magnitude = magnitude;
+  cmd->duration = duration;
+  post_cmd (self, cmd);
+
+  return TRUE;
+}
+
+
+gboolean
+fbd_dev_vibra_periodic (FbdDevVibra *self,
+                        guint        duration,
+                        double       magnitude,
+                        double       fade_in_level,
+                        guint        fade_in_time)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (self->worker == NULL)
+    return do_periodic (self, duration, magnitude, fade_in_level, fade_in_time);
+
+  cmd = vibra_cmd_new (FBD_VIBRA_CMD_PERIODIC);
+  cmd->duration = duration;
+  cmd->magnitude = magnitude;
+  cmd->fade_in_level = fade_in_level;
+  cmd->fade_in_time = fade_in_time;
+  post_cmd (self, cmd);
+
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_envelope:
+ * @self: The vibra device
+ * @duration: The total duration in ms
+ * @magnitude: The relative magnitude during sustain
+ * @attack_level: The relative magnitude at the start
+ * @attack_time: The time in ms to ramp from @attack_level to @magnitude
+ * @fade_level: The relative magnitude at the end
+ * @fade_time: The time in ms to ramp from @magnitude to @fade_level
+ *
+ * Plays a single effect with the given envelope. The ramps are done
+ * by the kernel so this needs only one upload.
+ *
+ * Returns: `TRUE` on success, `FALSE` if the device can't shape
+ *   effects (see `fbd_dev_vibra_has_envelope()`) or playing failed
+ */
+gboolean
+fbd_dev_vibra_envelope (FbdDevVibra *self,
+                        guint        duration,
+                        double       magnitude,
+                        double       attack_level,
+                        guint        attack_time,
+                        double       fade_level,
+                        guint        fade_time)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (!fbd_dev_vibra_has_envelope (self))
+    return FALSE;
+
+  if (self->worker == NULL)
+    return do_envelope (self, duration, magnitude, attack_level, attack_time,
+                        fade_level, fade_time);
+
+  cmd = vibra_cmd_new (FBD_VIBRA_CMD_ENVELOPE);
+  cmd->duration = duration;
+  cmd->magnitude = magnitude;
+  cmd->fade_in_level = attack_level;
+  cmd->fade_in_time = attack_time;
+  cmd->fade_out_level = fade_level;
+  cmd->fade_out_time = fade_time;
+  post_cmd (self, cmd);
+
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_custom:
+ * @self: The vibra device
+ * @duration: The duration in ms
+ * @magnitude: The relative magnitude
+ * @samples:(array length=n_samples): The driver specific waveform data
+ * @n_samples: The number of samples
+ *
+ * Plays a custom waveform. The waveform is uploaded on first use
+ * and then stays on the device so playing it again only needs a
+ * single write.
+ *
+ * Returns: `TRUE` on success, `FALSE` if the device doesn't support
+ *   custom waveforms (see `fbd_dev_vibra_has_custom()`) or playing failed
+ */
+gboolean
+fbd_dev_vibra_custom (FbdDevVibra  *self,
+                      guint         duration,
+                      double        magnitude,
+                      const gint16 *samples,
+                      guint         n_samples)
+{
+  struct ff_effect effect;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  g_return_val_if_fail (samples && n_samples, FALSE);
+
+  if (!fbd_dev_vibra_has_custom (self))
+    return FALSE;
+
+  build_custom (&effect, duration, magnitude, samples, n_samples);
+  if (self->worker == NULL)
+    return do_custom (self, &effect);
+
+  post_cmd (self, vibra_cmd_new_effect (FBD_VIBRA_CMD_CUSTOM, &effect));
+  return TRUE;
+}
+
+
+static gboolean
+post_prepare (FbdDevVibra *self, struct ff_effect *effect)
+{
+  self->prepared_until = g_get_monotonic_time () + FBD_DEV_VIBRA_PREPARE_TIMEOUT * 1000;
+
+  if (self->worker == NULL)
+    return prepare_effect (self, effect);
+
+  post_cmd (self, vibra_cmd_new_effect (FBD_VIBRA_CMD_PREPARE, effect));
+  return TRUE;
+}
+
+/**
+ * fbd_dev_vibra_prepare_rumble:
+ * @self: The vibra device
+ * @magnitude: The relative magnitude
+ * @duration: The duration in ms
+ *
+ * Uploads the effect a later `fbd_dev_vibra_rumble()` with the same
+ * arguments would play without playing it. The effect is kept
+ * uploaded for a short while.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_prepare_rumble (FbdDevVibra *self, double magnitude, guint duration)
+{
+  struct ff_effect effect;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  build_rumble (&effect, magnitude, duration);
+  return post_prepare (self, &effect);
+}
+
+/**
+ * fbd_dev_vibra_prepare_periodic:
+ * @self: The vibra device
+ * @duration: The duration in ms
+ * @magnitude: The relative magnitude
+ * @fade_in_level: The relative level to fade in from
+ * @fade_in_time: The fade in time in ms
+ *
+ * Like `fbd_dev_vibra_prepare_rumble()` but for
+ * `fbd_dev_vibra_periodic()`.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_prepare_periodic (FbdDevVibra *self,
+                                guint        duration,
+                                double       magnitude,
+                                double       fade_in_level,
+                                guint        fade_in_time)
+{
+  struct ff_effect effect;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  build_periodic (&effect, duration, magnitude, fade_in_level, fade_in_time);
+  return post_prepare (self, &effect);
+}
+
+/**
+ * fbd_dev_vibra_prepare_envelope:
+ * @self: The vibra device
+ * @duration: The duration in ms
+ * @magnitude: The relative magnitude
+ * @attack_level: The relative level to start from
+ * @attack_time: The attack time in ms
+ * @fade_level: The relative level to fade to
+ * @fade_time: The fade time in ms
+ *
+ * Like `fbd_dev_vibra_prepare_rumble()` but for
+ * `fbd_dev_vibra_envelope()`.
+ *
+ * Returns: `TRUE` on success, `FALSE` if the device doesn't support
+ *   envelopes or the upload failed
+ */
+gboolean
+fbd_dev_vibra_prepare_envelope (FbdDevVibra *self,
+                                guint        duration,
+                                double       magnitude,
+                                double       attack_level,
+                                guint        attack_time,
+                                double       fade_level,
+                                guint        fade_time)
+{
+  struct ff_effect effect;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (!fbd_dev_vibra_has_envelope (self))
+    return FALSE;
+
+  build_envelope (self, &effect, duration, magnitude, attack_level, attack_time,
+                  fade_level, fade_time);
+  return post_prepare (self, &effect);
+}
+
+/**
+ * fbd_dev_vibra_prepare_custom:
+ * @self: The vibra device
+ * @duration: The duration in ms
+ * @magnitude: The relative magnitude
+ * @samples:(array length=n_samples): The driver specific waveform data
+ * @n_samples: The number of samples
+ *
+ * Like `fbd_dev_vibra_prepare_rumble()` but for
+ * `fbd_dev_vibra_custom()`.
+ *
+ * Returns: `TRUE` on success, `FALSE` if the device doesn't support
+ *   custom waveforms or the upload failed
+ */
+gboolean
+fbd_dev_vibra_prepare_custom (FbdDevVibra  *self,
+                              guint         duration,
+                              double        magnitude,
+                              const gint16 *samples,
+                              guint         n_samples)
+{
+  struct ff_effect effect;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  g_return_val_if_fail (samples && n_samples, FALSE);
+
+  if (!fbd_dev_vibra_has_custom (self))
+    return FALSE;
+
+  build_custom (&effect, duration, magnitude, samples, n_samples);
+  return post_prepare (self, &effect);
+}
+
+/**
+ * fbd_dev_vibra_remove_effect:
+ * @self: The vibra device
+ *
+ * Releases the currently played effects. Effects tracked in the slot
+ * cache are stopped but stay uploaded so they can be played again
+ * quickly, other effects are erased.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_remove_effect (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (self->worker == NULL)
+    return release_effects (self, FALSE);
+
+  post_cmd (self, vibra_cmd_new (FBD_VIBRA_CMD_REMOVE));
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_set_gain:
+ * @self: The vibra device
+ * @gain: The relative gain
+ *
+ * Scales the magnitude of all effects, including the playing one,
+ * without uploading them again. Does nothing if the gain didn't
+ * change.
+ *
+ * Returns: `TRUE` on success, `FALSE` if the device can't change
+ *   its gain
+ */
+gboolean
+fbd_dev_vibra_set_gain (FbdDevVibra *self, double gain)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  g_return_val_if_fail (gain >= 0.0 && gain <= 1.0, FALSE);
+
+  if (!(self->features & FBD_DEV_VIBRA_FEATURE_GAIN))
+    return FALSE;
+
+  if (self->worker == NULL)
+    return set_gain (self, gain * 0xFFFF);
+
+  cmd = vibra_cmd_new (FBD_VIBRA_CMD_GAIN);
+  cmd->magnitude = gain;
+  post_cmd (self, cmd);
+
+  return TRUE;
+}
+
+
+gboolean
+fbd_dev_vibra_stop (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (self->worker == NULL)
+    return release_effects (self, TRUE);
+
+  post_cmd (self, vibra_cmd_new (FBD_VIBRA_CMD_STOP));
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_play_pattern:
+ * @self: The vibra device
+ * @magnitudes: The relative magnitude of each step
+ * @durations: The duration of each step in ms
+ * @n_steps: The number of steps
+ *
+ * Plays a whole pattern with the kernel doing the timing: each
+ * non-zero step is uploaded as separate effect that is delayed by the
+ * duration of the steps before it. All effects are then started with
+ * a single write.
+ *
+ * This fails if the pattern has more non-zero steps than there are
+ * effect slots or is longer than the kernel can delay an effect.
+ * Callers should then fall back to playing the steps one by one.
+ *
+ * Returns: `TRUE` if the pattern is playing, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_play_pattern (FbdDevVibra  *self,
+                            const double *magnitudes,
+                            const guint  *durations,
+                            guint         n_steps)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  if (!pattern_fits (self, magnitudes, durations, n_steps))
+    return FALSE;
+
+  if (self->worker == NULL)
+    return do_play_pattern (self, magnitudes, durations, n_steps);
+
+  post_cmd (self, vibra_cmd_new_pattern (FBD_VIBRA_CMD_PATTERN, magnitudes, durations, n_steps));
+  return TRUE;
+}
+
+
+/**
+ * fbd_dev_vibra_step_pattern:
+ * @self: The vibra device
+ * @magnitudes: The relative magnitude of each step
+ * @durations: The duration of each step in ms
+ * @n_steps: The number of steps
+ *
+ * Plays a pattern step by step with the haptic thread doing the
+ * timing. A magnitude of 0 is a pause.
+ *
+ * Returns: `TRUE` if the pattern is playing, `FALSE` if there's no
+ *   haptic thread and the caller needs to time the steps itself
+ */
+gboolean
+fbd_dev_vibra_step_pattern (FbdDevVibra  *self,
+                            const double *magnitudes,
+                            const guint  *durations,
+                            guint         n_steps)
+{
+  return fbd_dev_vibra_loop_pattern (self, magnitudes, durations, n_steps, 0, 0);
+}
+
+
+/**
+ * fbd_dev_vibra_loop_pattern:
+ * @self: The vibra device
+ * @magnitudes: The relative magnitude of each step
+ * @durations: The duration of each step in ms
+ * @n_steps: The number of steps
+ * @repeat_count: How often to play the steps from @repeat_from again
+ * @repeat_from: The first step that is repeated
+ *
+ * Like `fbd_dev_vibra_step_pattern()` but once the last step was
+ * played the haptic thread continues with @repeat_from until it
+ * played the repeated steps @repeat_count more times.
+ *
+ * Returns: `TRUE` if the pattern is playing, `FALSE` if there's no
+ *   haptic thread and the caller needs to time the steps itself
+ */
+gboolean
+fbd_dev_vibra_loop_pattern (FbdDevVibra  *self,
+                            const double *magnitudes,
+                            const guint  *durations,
+                            guint         n_steps,
+                            guint         repeat_count,
+                            guint         repeat_from)
+{
+  FbdVibraCmd *cmd;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+  g_return_val_if_fail (repeat_from < n_steps || n_steps == 0, FALSE);
+
+  if (self->worker == NULL || n_steps == 0)
+    return FALSE;
+
+  cmd = vibra_cmd_new_pattern (FBD_VIBRA_CMD_STEPS, magnitudes, durations, n_steps);
+  cmd->repeat_count = repeat_count;
+  cmd->repeat_from = repeat_from;
+  post_cmd (self, cmd);
+  return TRUE;
+}
+
+
+GUdevDevice *
+fbd_dev_vibra_get_device (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  return self->device;
+}
+
+/**
+ * fbd_dev_vibra_get_actuator:
+ * @self: The vibra device
+ *
+ * Get the actuator tag themes can use to route feedback to this device.
+ * It's taken from the device's `FEEDBACKD_ACTUATOR` udev property.
+ *
+ * Returns:(nullable): The actuator tag
+ */
+const char *
+fbd_dev_vibra_get_actuator (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), NULL);
+
+  return g_udev_device_get_property (self->device, FEEDBACKD_UDEV_ACTUATOR);
+}
+
+/**
+ * fbd_dev_vibra_get_spin_up:
+ * @self: The vibra device
+ *
+ * Get the time the motor needs to reach the requested magnitude. It's
+ * taken from the device's `FEEDBACKD_SPIN_UP` udev property.
+ *
+ * Returns: The spin up time in ms, `0` if unknown
+ */
+guint
+fbd_dev_vibra_get_spin_up (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), 0);
+
+  return self->spin_up;
+}
+
+/**
+ * fbd_dev_vibra_get_spin_down:
+ * @self: The vibra device
+ *
+ * Get the time the motor keeps running after being stopped. It's
+ * taken from the device's `FEEDBACKD_SPIN_DOWN` udev property.
+ *
+ * Returns: The spin down time in ms, `0` if unknown
+ */
+guint
+fbd_dev_vibra_get_spin_down (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), 0);
+
+  return self->spin_down;
+}
+
+/**
+ * fbd_dev_vibra_get_actuator_class:
+ * @self: The vibra device
+ *
+ * Get how the motor honours magnitudes. It's taken from the device's
+ * `FEEDBACKD_ACTUATOR_CLASS` udev property.
+ *
+ * Returns: The actuator class
+ */
+FbdDevVibraActuatorClass
+fbd_dev_vibra_get_actuator_class (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FBD_DEV_VIBRA_ACTUATOR_CLASS_GRADED);
+
+  return self->actuator_class;
+}
+
+/**
+ * fbd_dev_vibra_has_periodic:
+ * @self: The vibra device
+ *
+ * Check whether the device supports periodic effects
+ *
+ * Returns: `TRUE` if periodic effects are supported, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_has_periodic (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  return !!(self->features & FBD_DEV_VIBRA_FEATURE_PERIODIC);
+}
+
+/**
+ * fbd_dev_vibra_has_envelope:
+ * @self: The vibra device
+ *
+ * Check whether the device supports effects with an envelope
+ *
+ * Returns: `TRUE` if effects can be shaped by an envelope, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_has_envelope (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  return !!(self->features & (FBD_DEV_VIBRA_FEATURE_PERIODIC | FBD_DEV_VIBRA_FEATURE_CONSTANT));
+}
+
+/**
+ * fbd_dev_vibra_has_custom:
+ * @self: The vibra device
+ *
+ * Check whether the device supports custom waveforms
+ *
+ * Returns: `TRUE` if custom waveforms are supported, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_has_custom (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  return !!(self->features & FBD_DEV_VIBRA_FEATURE_CUSTOM);
+}
+
+/**
+ * fbd_dev_vibra_has_prepared:
+ * @self: The vibra device
+ *
+ * Check whether an effect was prepared recently and is still kept
+ * uploaded so it can be played right away.
+ *
+ * Returns: `TRUE` when there's a prepared effect, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_has_prepared (FbdDevVibra *self)
+{
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), FALSE);
+
+  return self->prepared_until > g_get_monotonic_time ();
+}
+
+/**
+ * fbd_dev_vibra_is_busy:
+ * @self: The vibra device
+ *
+ * Check whether the device is currently in used
+ *
+ * Returns: `TRUE` when the device is in use, otherwise `FALSE`
+ */
+gboolean
+fbd_dev_vibra_is_busy (FbdDevVibra *self)
+{
+  if (self == NULL)
+    return FALSE;
+
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (self), TRUE);
+
+  if (self->worker)
+    return self->busy;
 
-  return self->id != -1;
+  return self->id != -1 || self->n_pattern_ids > 0;
 }
@@ -5,28 +5,103 @@
  */
 #pragma once
 
-#include <glib-object.h>
+#include <gio/gio.h>
 #include <gudev/gudev.h>
 
 G_BEGIN_DECLS
 
 #define FBD_TYPE_DEV_VIBRA (fbd_dev_vibra_get_type())
 
+/**
+ * FbdDevVibraActuatorClass:
+ * @FBD_DEV_VIBRA_ACTUATOR_CLASS_GRADED: The motor's strength follows the magnitude
+ * @FBD_DEV_VIBRA_ACTUATOR_CLASS_ON_OFF: The motor is either off or at full strength
+ *
+ * How a haptic motor honours the magnitude of effects.
+ */
+typedef enum {
+  FBD_DEV_VIBRA_ACTUATOR_CLASS_GRADED,
+  FBD_DEV_VIBRA_ACTUATOR_CLASS_ON_OFF,
+} FbdDevVibraActuatorClass;
+
 G_DECLARE_FINAL_TYPE (FbdDevVibra, fbd_dev_vibra, FBD, DEV_VIBRA, GObject);
 
 FbdDevVibra *fbd_dev_vibra_new (GUdevDevice *device, GError **error);
+void         fbd_dev_vibra_new_async (GUdevDevice         *device,
+                                      GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data);
+FbdDevVibra *fbd_dev_vibra_new_finish (GAsyncResult *res, GError **error);
 gboolean     fbd_dev_vibra_rumble (FbdDevVibra *device,
                                    double       magnitude,
                                    guint        duration,
                                    gboolean     upload);
+gboolean     fbd_dev_vibra_retune (FbdDevVibra *self,
+                                   double       magnitude,
+                                   guint        duration);
 gboolean     fbd_dev_vibra_periodic (FbdDevVibra *self,
                                      guint        duration,
                                      double       magnitude,
                                      double       fade_in_level,
                                      guint        fade_in_time);
+gboolean     fbd_dev_vibra_envelope (FbdDevVibra *self,
+                                     guint        duration,
+                                     double       magnitude,
+                                     double       attack_level,
+                                     guint        attack_time,
+                                     double       fade_level,
+                                     guint        fade_time);
+gboolean     fbd_dev_vibra_custom (FbdDevVibra  *self,
+                                   guint         duration,
+                                   double        magnitude,
+                                   const gint16 *samples,
+                                   guint         n_samples);
+gboolean     fbd_dev_vibra_prepare_rumble (FbdDevVibra *self,
+                                           double       magnitude,
+                                           guint        duration);
+gboolean     fbd_dev_vibra_prepare_periodic (FbdDevVibra *self,
+                                             guint        duration,
+                                             double       magnitude,
+                                             double       fade_in_level,
+                                             guint        fade_in_time);
+gboolean     fbd_dev_vibra_prepare_envelope (FbdDevVibra *self,
+                                             guint        duration,
+                                             double       magnitude,
+                                             double       attack_level,
+                                             guint        attack_time,
+                                             double       fade_level,
+                                             guint        fade_time);
+gboolean     fbd_dev_vibra_prepare_custom (FbdDevVibra  *self,
+                                           guint         duration,
+                                           double        magnitude,
+                                           const gint16 *samples,
+                                           guint         n_samples);
+gboolean     fbd_dev_vibra_play_pattern (FbdDevVibra  *self,
+                                         const double *magnitudes,
+                                         const guint  *durations,
+                                         guint         n_steps);
+gboolean     fbd_dev_vibra_step_pattern (FbdDevVibra  *self,
+                                         const double *magnitudes,
+                                         const guint  *durations,
+                                         guint         n_steps);
+gboolean     fbd_dev_vibra_loop_pattern (FbdDevVibra  *self,
+                                         const double *magnitudes,
+                                         const guint  *durations,
+                                         guint         n_steps,
+                                         guint         repeat_count,
+                                         guint         repeat_from);
+gboolean     fbd_dev_vibra_set_gain (FbdDevVibra *self, double gain);
 gboolean     fbd_dev_vibra_stop (FbdDevVibra *self);
 gboolean     fbd_dev_vibra_remove_effect (FbdDevVibra *self);
 GUdevDevice *fbd_dev_vibra_get_device(FbdDevVibra *self);
+const char  *fbd_dev_vibra_get_actuator (FbdDevVibra *self);
+guint        fbd_dev_vibra_get_spin_up (FbdDevVibra *self);
+guint        fbd_dev_vibra_get_spin_down (FbdDevVibra *self);
+FbdDevVibraActuatorClass fbd_dev_vibra_get_actuator_class (FbdDevVibra *self);
+gboolean     fbd_dev_vibra_has_periodic (FbdDevVibra *self);
+gboolean     fbd_dev_vibra_has_envelope (FbdDevVibra *self);
+gboolean     fbd_dev_vibra_has_custom (FbdDevVibra *self);
+gboolean     fbd_dev_vibra_has_prepared (FbdDevVibra *self);
 gboolean     fbd_dev_vibra_is_busy (FbdDevVibra *self);
 
 G_END_DECLS
@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-dispatcher"
+
+#include "fbd-dispatcher.h"
+
+/**
+ * FbdDispatcher:
+ *
+ * Receives the method calls of latency critical D-Bus interfaces in
+ * a separate thread.
+ *
+ * GDBus queues incoming method calls on the context the interface
+ * was exported from at default priority. On the main context they'd
+ * wait behind settings changes, udev events, sound callbacks and
+ * theme reloads. Interfaces exported via fbd_dispatcher_export()
+ * get their method calls queued on the dispatcher's own context
+ * instead. The dispatcher's thread passes them on to the main
+ * context at high priority so they're handled before any pending
+ * housekeeping.
+ *
+ * The handlers still run on the main thread so the daemon's state
+ * doesn't need any locking. Property accesses are forwarded to the
+ * main thread too and wait for the result. The main thread in turn
+ * handles these while it waits for an export so the two threads
+ * never end up waiting on each other.
+ *
+ * The skeletons need to route their vtable through
+ * fbd_dispatcher_wrap_vtable().
+ */
+
+struct _FbdDispatcher {
+  GObject       parent;
+
+  GMainContext *context;
+  GMainLoop    *loop;
+  GThread      *thread;
+};
+
+G_DEFINE_TYPE (FbdDispatcher, fbd_dispatcher, G_TYPE_OBJECT)
+
+/* Key: the skeleton's GType, value: the skeleton's own vtable */
+static GHashTable *vtables;
+G_LOCK_DEFINE_STATIC (vtables);
+
+typedef struct _FbdExportCall {
+  GDBusInterfaceSkeleton *skeleton;
+  GDBusConnection        *connection;
+  const char             *object_path;
+  GError                **error;
+  gboolean                ret;
+  gboolean                done;
+} FbdExportCall;
+
+typedef struct _FbdMethodCall {
+  GDBusInterfaceMethodCallFunc method_call;
+  GDBusMethodInvocation       *invocation;
+  GObject                     *skeleton;
+} FbdMethodCall;
+
+typedef struct _FbdPropertyCall {
+  GSourceFunc           func;
+  gboolean              done;
+  GDBusInterfaceVTable *vtable;
+  GDBusConnection      *connection;
+  const char           *sender;
+  const char           *object_path;
+  const char           *interface_name;
+  const char           *property_name;
+  GVariant             *value;
+  GError              **error;
+  gpointer              user_data;
+  gboolean              ret;
+} FbdPropertyCall;
+
+/* Property accesses waiting for the main thread, protected by props_lock */
+static GQueue pending_props = G_QUEUE_INIT;
+static GMutex props_lock;
+static GCond props_cond;
+/* Set while the dispatcher shuts down, protected by props_lock */
+static gboolean props_closed;
+
+
+/* Runs the queued property accesses, called with props_lock held */
+static void
+run_pending_props_locked (void)
+{
+  FbdPropertyCall *prop;
+
+  while ((prop = g_queue_pop_head (&pending_props))) {
+    g_mutex_unlock (&props_lock);
+    prop->func (prop);
+    g_mutex_lock (&props_lock);
+
+    prop->done = TRUE;
+    g_cond_broadcast (&props_cond);
+  }
+}
+
+
+/* Fails @prop without running it, called with props_lock held */
+static void
+property_call_fail_locked (FbdPropertyCall *prop)
+{
+  g_set_error_literal (prop->error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                       "Feedback daemon is shutting down");
+  prop->value = NULL;
+  prop->ret = FALSE;
+  prop->done = TRUE;
+  g_cond_broadcast (&props_cond);
+}
+
+
+static gboolean
+do_pending_props (gpointer unused)
+{
+  g_mutex_lock (&props_lock);
+  run_pending_props_locked ();
+  g_mutex_unlock (&props_lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Hands @prop to the main thread and waits for it to be handled */
+static void
+property_call_run (FbdPropertyCall *prop)
+{
+  GSource *source;
+
+  g_mutex_lock (&props_lock);
+  if (props_closed) {
+    property_call_fail_locked (prop);
+    g_mutex_unlock (&props_lock);
+    return;
+  }
+  g_queue_push_tail (&pending_props, prop);
+  /* Wakes up a main thread waiting for an export */
+  g_cond_broadcast (&props_cond);
+  g_mutex_unlock (&props_lock);
+
+  /* Not g_main_context_invoke () as that would run it right here if the main context is idle */
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, do_pending_props, NULL, NULL);
+  g_source_attach (source, NULL);
+  g_source_unref (source);
+
+  g_mutex_lock (&props_lock);
+  while (!prop->done)
+    g_cond_wait (&props_cond, &props_lock);
+  g_mutex_unlock (&props_lock);
+}
+
+
+static GDBusInterfaceVTable *
+lookup_vtable (gpointer skeleton)
+{
+  GDBusInterfaceVTable *vtable;
+
+  G_LOCK (vtables);
+  vtable = g_hash_table_lookup (vtables, GSIZE_TO_POINTER (G_OBJECT_TYPE (skeleton)));
+  G_UNLOCK (vtables);
+
+  g_assert (vtable);
+  return vtable;
+}
+
+
+static gboolean
+do_method_call (gpointer data)
+{
+  FbdMethodCall *call = data;
+  GDBusMethodInvocation *invocation = call->invocation;
+
+  /* Takes over the invocation */
+  call->method_call (g_dbus_method_invocation_get_connection (invocation),
+                     g_dbus_method_invocation_get_sender (invocation),
+                     g_dbus_method_invocation_get_object_path (invocation),
+                     g_dbus_method_invocation_get_interface_name (invocation),
+                     g_dbus_method_invocation_get_method_name (invocation),
+                     g_dbus_method_invocation_get_parameters (invocation),
+                     invocation,
+                     call->skeleton);
+
+  g_object_unref (call->skeleton);
+  g_free (call);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+forward_method_call (GDBusConnection       *connection,
+                     const char            *sender,
+                     const char            *object_path,
+                     const char            *interface_name,
+                     const char            *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               user_data)
+{
+  FbdMethodCall *call = g_new0 (FbdMethodCall, 1);
+
+  call->method_call = lookup_vtable (user_data)->method_call;
+  call->invocation = invocation;
+  call->skeleton = g_object_ref (user_data);
+
+  /* Ahead of the housekeeping queued on the main context */
+  g_main_context_invoke_full (NULL, G_PRIORITY_HIGH, do_method_call, call, NULL);
+}
+
+
+static gboolean
+do_get_property (gpointer data)
+{
+  FbdPropertyCall *prop = data;
+
+  prop->value = prop->vtable->get_property (prop->connection,
+                                            prop->sender,
+                                            prop->object_path,
+                                            prop->interface_name,
+                                            prop->property_name,
+                                            prop->error,
+                                            prop->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static GVariant *
+forward_get_property (GDBusConnection  *connection,
+                      const char       *sender,
+                      const char       *object_path,
+                      const char       *interface_name,
+                      const char       *property_name,
+                      GError          **error,
+                      gpointer          user_data)
+{
+  FbdPropertyCall prop = {
+    .func = do_get_property,
+    .vtable = lookup_vtable (user_data),
+    .connection = connection,
+    .sender = sender,
+    .object_path = object_path,
+    .interface_name = interface_name,
+    .property_name = property_name,
+    .error = error,
+    .user_data = user_data,
+  };
+
+  property_call_run (&prop);
+
+  return prop.value;
+}
+
+
+static gboolean
+do_set_property (gpointer data)
+{
+  FbdPropertyCall *prop = data;
+
+  prop->ret = prop->vtable->set_property (prop->connection,
+                                          prop->sender,
+                                          prop->object_path,
+                                          prop->interface_name,
+                                          prop->property_name,
+                                          prop->value,
+                                          prop->error,
+                                          prop->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+forward_set_property (GDBusConnection  *connection,
+                      const char       *sender,
+                      const char       *object_path,
+                      const char       *interface_name,
+                      const char       *property_name,
+                      GVariant         *value,
+                      GError          **error,
+                      gpointer          user_data)
+{
+  FbdPropertyCall prop = {
+    .func = do_set_property,
+    .vtable = lookup_vtable (user_data),
+    .connection = connection,
+    .sender = sender,
+    .object_path = object_path,
+    .interface_name = interface_name,
+    .property_name = property_name,
+    .value = value,
+    .error = error,
+    .user_data = user_data,
+  };
+
+  property_call_run (&prop);
+
+  return prop.ret;
+}
+
+
+static gboolean
+do_export (gpointer data)
+{
+  FbdExportCall *export = data;
+
+  /* GDBus queues the method calls on the thread default context */
+  export->ret = g_dbus_interface_skeleton_export (export->skeleton,
+                                                  export->connection,
+                                                  export->object_path,
+                                                  export->error);
+
+  g_mutex_lock (&props_lock);
+  export->done = TRUE;
+  g_cond_broadcast (&props_cond);
+  g_mutex_unlock (&props_lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+quit_loop (gpointer data)
+{
+  g_main_loop_quit (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gpointer
+dispatch_thread (gpointer data)
+{
+  FbdDispatcher *self = FBD_DISPATCHER (data);
+
+  g_main_context_push_thread_default (self->context);
+  g_main_loop_run (self->loop);
+  g_main_context_pop_thread_default (self->context);
+
+  return NULL;
+}
+
+
+static void
+fbd_dispatcher_finalize (GObject *object)
+{
+  FbdDispatcher *self = FBD_DISPATCHER (object);
+  FbdPropertyCall *prop;
+
+  /* Also works if the loop isn't running yet */
+  g_main_context_invoke (self->context, quit_loop, self->loop);
+
+  /*
+   * The thread might be waiting for us to handle a property access.
+   * Fail these (and any later ones) so it gets to quit the loop.
+   */
+  g_mutex_lock (&props_lock);
+  props_closed = TRUE;
+  while ((prop = g_queue_pop_head (&pending_props)))
+    property_call_fail_locked (prop);
+  g_mutex_unlock (&props_lock);
+
+  g_thread_join (self->thread);
+
+  g_mutex_lock (&props_lock);
+  props_closed = FALSE;
+  g_mutex_unlock (&props_lock);
+
+  g_main_loop_unref (self->loop);
+  g_main_context_unref (self->context);
+
+  G_OBJECT_CLASS (fbd_dispatcher_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_dispatcher_class_init (FbdDispatcherClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = fbd_dispatcher_finalize;
+}
+
+
+static void
+fbd_dispatcher_init (FbdDispatcher *self)
+{
+  self->context = g_main_context_new ();
+  self->loop = g_main_loop_new (self->context, FALSE);
+  self->thread = g_thread_new ("fbd-dispatch", dispatch_thread, self);
+}
+
+/**
+ * fbd_dispatcher_get_default:
+ *
+ * Gets the daemon's dispatcher. The first call creates it and starts
+ * its thread.
+ *
+ * Returns:(transfer none): The dispatcher
+ */
+FbdDispatcher *
+fbd_dispatcher_get_default (void)
+{
+  static FbdDispatcher *instance;
+
+  if (instance == NULL) {
+    instance = g_object_new (FBD_TYPE_DISPATCHER, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+
+  return instance;
+}
+
+/**
+ * fbd_dispatcher_export:
+ * @self: The dispatcher
+ * @skeleton: The interface to export
+ * @connection: The connection to export it on
+ * @object_path: The object path
+ * @error: return location for error or %NULL
+ *
+ * Exports @skeleton like g_dbus_interface_skeleton_export() but
+ * queues its method calls on the dispatcher's context. Must be
+ * called from the main thread.
+ *
+ * Returns: `TRUE` if the interface was exported
+ */
+gboolean
+fbd_dispatcher_export (FbdDispatcher           *self,
+                       GDBusInterfaceSkeleton  *skeleton,
+                       GDBusConnection         *connection,
+                       const char              *object_path,
+                       GError                 **error)
+{
+  FbdExportCall export = {
+    .skeleton = skeleton,
+    .connection = connection,
+    .object_path = object_path,
+    .error = error,
+  };
+
+  g_return_val_if_fail (FBD_IS_DISPATCHER (self), FALSE);
+  g_return_val_if_fail (G_IS_DBUS_INTERFACE_SKELETON (skeleton), FALSE);
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), FALSE);
+
+  g_main_context_invoke_full (self->context, G_PRIORITY_HIGH, do_export, &export, NULL);
+
+  /*
+   * The dispatcher's thread might wait for us to handle a property
+   * access (every new proxy does a GetAll) before it gets to the
+   * export so handle these while waiting.
+   */
+  g_mutex_lock (&props_lock);
+  while (!export.done) {
+    if (g_queue_is_empty (&pending_props))
+      g_cond_wait (&props_cond, &props_lock);
+    else
+      run_pending_props_locked ();
+  }
+  g_mutex_unlock (&props_lock);
+
+  return export.ret;
+}
+
+/**
+ * fbd_dispatcher_wrap_vtable:
+ * @skeleton: The skeleton
+ * @vtable: The skeleton's own vtable
+ *
+ * Gets a vtable that hands method calls and property accesses on to
+ * @vtable on the main thread. Meant to be returned from a skeleton's
+ * `get_vtable()`. Method calls that already arrive on the main thread
+ * are handled right away.
+ *
+ * Returns:(transfer none): The vtable
+ */
+GDBusInterfaceVTable *
+fbd_dispatcher_wrap_vtable (GDBusInterfaceSkeleton *skeleton, GDBusInterfaceVTable *vtable)
+{
+  static GDBusInterfaceVTable forward_vtable = {
+    .method_call = forward_method_call,
+    .get_property = forward_get_property,
+    .set_property = forward_set_property,
+  };
+  gpointer type = GSIZE_TO_POINTER (G_OBJECT_TYPE (skeleton));
+
+  g_return_val_if_fail (G_IS_DBUS_INTERFACE_SKELETON (skeleton), NULL);
+  g_return_val_if_fail (vtable, NULL);
+
+  G_LOCK (vtables);
+  if (vtables == NULL)
+    vtables = g_hash_table_new (g_direct_hash, g_direct_equal);
+  if (!g_hash_table_contains (vtables, type))
+    g_hash_table_insert (vtables, type, vtable);
+  G_UNLOCK (vtables);
+
+  return &forward_vtable;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_DISPATCHER (fbd_dispatcher_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdDispatcher, fbd_dispatcher, FBD, DISPATCHER, GObject)
+
+FbdDispatcher        *fbd_dispatcher_get_default (void);
+gboolean              fbd_dispatcher_export (FbdDispatcher           *self,
+                                             GDBusInterfaceSkeleton  *skeleton,
+                                             GDBusConnection         *connection,
+                                             const char              *object_path,
+                                             GError                 **error);
+GDBusInterfaceVTable *fbd_dispatcher_wrap_vtable (GDBusInterfaceSkeleton *skeleton,
+                                                  GDBusInterfaceVTable   *vtable);
+
+G_END_DECLS
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-duty-governor"
+
+#include "fbd-duty-governor.h"
+#include "fbd-stats.h"
+
+/**
+ * FbdDutyGovernor:
+ *
+ * Keeps the duty cycle of actuators like haptic motors within a
+ * budget so that constant feedback doesn't heat up small motors and
+ * their regulators or drain the battery.
+ *
+ * Each actuator has a bucket that fills while the actuator is on and
+ * drains at the budgeted rate. It holds at most the on time allowed
+ * within `FBD_DUTY_GOVERNOR_WINDOW`. Once the bucket is half full
+ * feedback gets scaled down, a full bucket means feedback should be
+ * dropped. Important feedback isn't limited but still fills the
+ * bucket.
+ *
+ * The usage of each actuator is reported via #FbdStats. The governor
+ * must only be used from the main thread.
+ */
+
+/* Usage from which on feedback gets scaled down */
+#define SCALE_FROM 0.5
+/* Scale right before the budget is used up */
+#define MIN_SCALE  0.3
+
+typedef struct _FbdDutyActuator {
+  char   *name;
+  guint   active;
+  gint64  last;
+  /* On time in µs that still needs to drain */
+  double  fill;
+} FbdDutyActuator;
+
+struct _FbdDutyGovernor {
+  GObject     parent;
+
+  double      budget;
+  /* Key: the actuator, value: FbdDutyActuator */
+  GHashTable *actuators;
+};
+
+G_DEFINE_TYPE (FbdDutyGovernor, fbd_duty_governor, G_TYPE_OBJECT)
+
+
+static void
+fbd_duty_actuator_free (FbdDutyActuator *actuator)
+{
+  g_free (actuator->name);
+  g_free (actuator);
+}
+
+
+static void
+update_actuator (FbdDutyGovernor *self, FbdDutyActuator *actuator, gint64 now)
+{
+  gint64 elapsed = MAX (now - actuator->last, 0);
+
+  if (actuator->active)
+    actuator->fill += elapsed;
+  actuator->fill = MAX (actuator->fill - elapsed * self->budget, 0.0);
+  actuator->last = now;
+}
+
+
+static double
+get_usage (FbdDutyGovernor *self, FbdDutyActuator *actuator)
+{
+  double capacity = (double) FBD_DUTY_GOVERNOR_WINDOW * G_USEC_PER_SEC * self->budget;
+
+  /* Full budget means the actuator may always be on */
+  if (self->budget >= 1.0)
+    return 0.0;
+
+  return MIN (actuator->fill / capacity, 1.0);
+}
+
+
+static void
+report_usage (FbdDutyGovernor *self, FbdDutyActuator *actuator)
+{
+  fbd_stats_set_duty_cycle (fbd_stats_get_default (),
+                            actuator->name,
+                            get_usage (self, actuator) * 1000);
+}
+
+
+static void
+start_at (FbdDutyGovernor *self, gpointer key, const char *name, gint64 now)
+{
+  FbdDutyActuator *actuator = g_hash_table_lookup (self->actuators, key);
+
+  if (actuator == NULL) {
+    actuator = g_new0 (FbdDutyActuator, 1);
+    actuator->name = g_strdup (name);
+    actuator->last = now;
+    g_hash_table_insert (self->actuators, key, actuator);
+  }
+
+  update_actuator (self, actuator, now);
+  actuator->active++;
+  report_usage (self, actuator);
+}
+
+
+static void
+stop_at (FbdDutyGovernor *self, gpointer key, gint64 now)
+{
+  FbdDutyActuator *actuator = g_hash_table_lookup (self->actuators, key);
+
+  if (actuator == NULL || actuator->active == 0)
+    return;
+
+  update_actuator (self, actuator, now);
+  actuator->active--;
+  report_usage (self, actuator);
+}
+
+
+static double
+get_usage_at (FbdDutyGovernor *self, gpointer key, gint64 now)
+{
+  FbdDutyActuator *actuator = g_hash_table_lookup (self->actuators, key);
+
+  if (actuator == NULL)
+    return 0.0;
+
+  update_actuator (self, actuator, now);
+  report_usage (self, actuator);
+
+  return get_usage (self, actuator);
+}
+
+
+static double
+get_scale_at (FbdDutyGovernor *self, gpointer key, gint64 now)
+{
+  double usage = get_usage_at (self, key, now);
+
+  if (usage >= 1.0)
+    return 0.0;
+
+  if (usage <= SCALE_FROM)
+    return 1.0;
+
+  return 1.0 - (1.0 - MIN_SCALE) * (usage - SCALE_FROM) / (1.0 - SCALE_FROM);
+}
+
+
+static void
+fbd_duty_governor_finalize (GObject *object)
+{
+  FbdDutyGovernor *self = FBD_DUTY_GOVERNOR (object);
+
+  g_clear_pointer (&self->actuators, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (fbd_duty_governor_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_duty_governor_class_init (FbdDutyGovernorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = fbd_duty_governor_finalize;
+}
+
+
+static void
+fbd_duty_governor_init (FbdDutyGovernor *self)
+{
+  self->budget = 1.0;
+  self->actuators = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, (GDestroyNotify) fbd_duty_actuator_free);
+}
+
+/**
+ * fbd_duty_governor_get_default:
+ *
+ * Gets the daemon's duty cycle governor. The first call creates it.
+ *
+ * Returns:(transfer none): The governor
+ */
+FbdDutyGovernor *
+fbd_duty_governor_get_default (void)
+{
+  static FbdDutyGovernor *instance;
+
+  if (instance == NULL) {
+    instance = g_object_new (FBD_TYPE_DUTY_GOVERNOR, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+
+  return instance;
+}
+
+/**
+ * fbd_duty_governor_set_budget:
+ * @self: The governor
+ * @budget: The fraction of time an actuator may be on
+ *
+ * Sets the budgeted duty cycle of all actuators. `1.0` doesn't
+ * limit the actuators at all.
+ */
+void
+fbd_duty_governor_set_budget (FbdDutyGovernor *self, double budget)
+{
+  GHashTableIter iter;
+  FbdDutyActuator *actuator;
+  gint64 now = g_get_monotonic_time ();
+
+  g_return_if_fail (FBD_IS_DUTY_GOVERNOR (self));
+  g_return_if_fail (budget > 0.0 && budget <= 1.0);
+
+  /* Drain at the old rate up to now */
+  g_hash_table_iter_init (&iter, self->actuators);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&actuator))
+    update_actuator (self, actuator, now);
+
+  self->budget = budget;
+  g_debug ("Duty cycle budget: %.2f", budget);
+}
+
+
+double
+fbd_duty_governor_get_budget (FbdDutyGovernor *self)
+{
+  g_return_val_if_fail (FBD_IS_DUTY_GOVERNOR (self), 1.0);
+
+  return self->budget;
+}
+
+/**
+ * fbd_duty_governor_start:
+ * @self: The governor
+ * @actuator: The actuator that was switched on
+ * @name: The actuator's name in the stats
+ *
+ * Tracks that @actuator is on until fbd_duty_governor_stop() is
+ * called for it.
+ */
+void
+fbd_duty_governor_start (FbdDutyGovernor *self, gpointer actuator, const char *name)
+{
+  g_return_if_fail (FBD_IS_DUTY_GOVERNOR (self));
+  g_return_if_fail (actuator);
+
+  start_at (self, actuator, name, g_get_monotonic_time ());
+}
+
+/**
+ * fbd_duty_governor_stop:
+ * @self: The governor
+ * @actuator: The actuator that was switched off
+ *
+ * Tracks that @actuator is off again.
+ */
+void
+fbd_duty_governor_stop (FbdDutyGovernor *self, gpointer actuator)
+{
+  g_return_if_fail (FBD_IS_DUTY_GOVERNOR (self));
+
+  stop_at (self, actuator, g_get_monotonic_time ());
+}
+
+/**
+ * fbd_duty_governor_remove:
+ * @self: The governor
+ * @actuator: The actuator that went away
+ *
+ * Forgets about an actuator, e.g. because it was unplugged.
+ */
+void
+fbd_duty_governor_remove (FbdDutyGovernor *self, gpointer actuator)
+{
+  FbdDutyActuator *duty;
+
+  g_return_if_fail (FBD_IS_DUTY_GOVERNOR (self));
+
+  duty = g_hash_table_lookup (self->actuators, actuator);
+  if (duty == NULL)
+    return;
+
+  fbd_stats_set_duty_cycle (fbd_stats_get_default (), duty->name, -1);
+  g_hash_table_remove (self->actuators, actuator);
+}
+
+/**
+ * fbd_duty_governor_get_usage:
+ * @self: The governor
+ * @actuator: The actuator
+ *
+ * Gets how much of the actuator's budget is used up.
+ *
+ * Returns: The used budget in the range `[0.0, 1.0]`
+ */
+double
+fbd_duty_governor_get_usage (FbdDutyGovernor *self, gpointer actuator)
+{
+  g_return_val_if_fail (FBD_IS_DUTY_GOVERNOR (self), 0.0);
+
+  return get_usage_at (self, actuator, g_get_monotonic_time ());
+}
+
+/**
+ * fbd_duty_governor_get_scale:
+ * @self: The governor
+ * @actuator: The actuator
+ *
+ * Gets how strong feedback that isn't important should be on
+ * @actuator.
+ *
+ * Returns: The factor to scale the feedback with, `0.0` if the
+ *   feedback should be dropped
+ */
+double
+fbd_duty_governor_get_scale (FbdDutyGovernor *self, gpointer actuator)
+{
+  g_return_val_if_fail (FBD_IS_DUTY_GOVERNOR (self), 1.0);
+
+  return get_scale_at (self, actuator, g_get_monotonic_time ());
+}
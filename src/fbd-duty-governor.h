@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* The window the duty cycle is averaged over in seconds */
+#define FBD_DUTY_GOVERNOR_WINDOW 60
+
+#define FBD_TYPE_DUTY_GOVERNOR (fbd_duty_governor_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdDutyGovernor, fbd_duty_governor, FBD, DUTY_GOVERNOR, GObject)
+
+FbdDutyGovernor *fbd_duty_governor_get_default (void);
+void             fbd_duty_governor_set_budget (FbdDutyGovernor *self, double budget);
+double           fbd_duty_governor_get_budget (FbdDutyGovernor *self);
+void             fbd_duty_governor_start (FbdDutyGovernor *self,
+                                          gpointer         actuator,
+                                          const char      *name);
+void             fbd_duty_governor_stop (FbdDutyGovernor *self, gpointer actuator);
+void             fbd_duty_governor_remove (FbdDutyGovernor *self, gpointer actuator);
+double           fbd_duty_governor_get_usage (FbdDutyGovernor *self, gpointer actuator);
+double           fbd_duty_governor_get_scale (FbdDutyGovernor *self, gpointer actuator);
+
+G_END_DECLS
@@ -10,6 +10,9 @@
 #include "fbd.h"
 #include "fbd-enums.h"
 #include "fbd-event.h"
+#include "fbd-stats.h"
+#include "fbd-timer-wheel.h"
+#include "fbd-trace.h"
 
 enum {
   SIGNAL_FEEDBACKS_ENDED,
@@ -34,6 +37,7 @@ typedef struct _FbdEvent {
   GObject parent;
 
   guint id;
+  /* Interned, see set_interned() */
   char *app_id;
   char *event;
   char *sender;
@@ -45,7 +49,8 @@ typedef struct _FbdEvent {
   gboolean ended;
   FbdEventEndReason end_reason;
 
-  GSList *feedbacks;
+  /* The playbacks of the event's feedbacks */
+  GSList *playbacks;
 } FbdEvent;
 
 G_DEFINE_TYPE (FbdEvent, fbd_event, G_TYPE_OBJECT);
@@ -72,26 +77,88 @@ check_ended (FbdEvent *self)
   return TRUE;
 }
 
+static GSList *
+copy_playbacks (FbdEvent *self)
+{
+  return g_slist_copy_deep (self->playbacks, (GCopyFunc)fbd_feedback_playback_ref, NULL);
+}
+
+static gboolean
+has_successor (FbdEvent *self, FbdFeedbackPlayback *playback)
+{
+  for (GSList *l = self->playbacks; l; l = l->next) {
+    if (fbd_feedback_playback_get_after (l->data) == playback)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Start the playbacks that follow `playback` */
+static gboolean
+run_successors (FbdEvent *self, FbdFeedbackPlayback *playback)
+{
+  g_autoslist (FbdFeedbackPlayback) playbacks = copy_playbacks (self);
+  gboolean found = FALSE;
+
+  for (GSList *l = playbacks; l; l = l->next) {
+    if (fbd_feedback_playback_get_after (l->data) != playback)
+      continue;
+
+    fbd_feedback_playback_run (l->data);
+    found = TRUE;
+  }
+
+  return found;
+}
+
 static void
-on_fb_ended (FbdEvent *self, FbdFeedbackBase *fb)
+on_playback_ended (FbdFeedbackPlayback *playback, gpointer user_data)
 {
+  g_autoptr (FbdEvent) self = g_object_ref (FBD_EVENT (user_data));
+  gboolean natural = self->end_reason == FBD_EVENT_END_REASON_NATURAL;
+  gboolean again;
+
+  /* A sequence continues even when the timeout expired */
+  if (natural && run_successors (self, playback))
+    return;
+
   switch (self->timeout) {
   case FBD_EVENT_TIMEOUT_ONESHOT:
-    check_ended (self);
+    again = FALSE;
     break;
   case FBD_EVENT_TIMEOUT_LOOP:
-    if (self->end_reason != FBD_EVENT_END_REASON_NATURAL)
-      check_ended (self);
-    else
-      fbd_feedback_run (fb);
+    again = natural;
     break;
   default:
-    if (!self->expired && self->end_reason == FBD_EVENT_END_REASON_NATURAL)
-      fbd_feedback_run (fb);
-    else
-      check_ended (self);
+    again = !self->expired && natural;
+    /* The feedback looped on its own until the timeout */
+    if (playback->loop_until && g_get_monotonic_time () >= playback->loop_until)
+      again = FALSE;
     break;
   }
+
+  if (!again) {
+    check_ended (self);
+    return;
+  }
+
+  /* Loop the whole sequence, not only its last feedback */
+  while (fbd_feedback_playback_get_after (playback))
+    playback = fbd_feedback_playback_get_after (playback);
+  fbd_feedback_playback_run (playback);
+}
+
+/*
+ * The same few app ids, event names and senders are used over and
+ * over again so events share a single copy of them.
+ */
+static void
+set_interned (char **field, const char *value)
+{
+  g_clear_pointer (field, g_ref_string_release);
+  if (value)
+    *field = g_ref_string_new_intern (value);
 }
 
 static void
@@ -107,12 +174,10 @@ fbd_event_set_property (GObject      *object,
     self->id = g_value_get_int (value);
     break;
   case PROP_APP_ID:
-    g_free (self->app_id);
-    self->app_id = g_value_dup_string (value);
+    set_interned (&self->app_id, g_value_get_string (value));
     break;
   case PROP_EVENT:
-    g_free (self->event);
-    self->event = g_value_dup_string (value);
+    set_interned (&self->event, g_value_get_string (value));
     break;
   case PROP_TIMEOUT:
     self->timeout = g_value_get_int (value);
@@ -121,8 +186,7 @@ fbd_event_set_property (GObject      *object,
     fbd_event_set_end_reason (self, g_value_get_enum (value));
     break;
   case PROP_SENDER:
-    g_free (self->sender);
-    self->sender = g_value_dup_string (value);
+    set_interned (&self->sender, g_value_get_string (value));
     break;
   case PROP_FEEDBACKS_ENDED:
   default:
@@ -172,12 +236,14 @@ fbd_event_dispose (GObject *object)
 {
   FbdEvent *self = FBD_EVENT (object);
 
-  g_clear_handle_id (&self->timeout_id, g_source_remove);
+  g_clear_handle_id (&self->timeout_id, fbd_timeout_remove);
 
-  if (self->feedbacks) {
-    /* Feedbacks end themselves when unrefed */
-    g_slist_free_full (self->feedbacks, g_object_unref);
-    self->feedbacks = NULL;
+  if (self->playbacks) {
+    /* Running playbacks keep themselves alive until they end */
+    for (GSList *l = self->playbacks; l; l = l->next)
+      fbd_feedback_playback_set_ended_func (l->data, NULL, NULL);
+    g_slist_free_full (self->playbacks, (GDestroyNotify)fbd_feedback_playback_unref);
+    self->playbacks = NULL;
   }
 
   G_OBJECT_CLASS (fbd_event_parent_class)->dispose (object);
@@ -188,9 +254,10 @@ fbd_event_finalize (GObject *object)
 {
   FbdEvent *self = FBD_EVENT (object);
 
-  g_clear_pointer (&self->app_id, g_free);
-  g_clear_pointer (&self->event, g_free);
-  g_clear_pointer (&self->sender, g_free);
+  g_clear_pointer (&self->app_id, g_ref_string_release);
+  g_clear_pointer (&self->event, g_ref_string_release);
+  g_clear_pointer (&self->sender, g_ref_string_release);
+  fbd_stats_object_free (fbd_stats_get_default (), FBD_STATS_OBJECT_EVENT, sizeof (*self));
 
   G_OBJECT_CLASS (fbd_event_parent_class)->finalize (object);
 }
@@ -287,6 +354,7 @@ static void
 fbd_event_init (FbdEvent *self)
 {
   self->timeout = -1;
+  fbd_stats_object_new (fbd_stats_get_default (), FBD_STATS_OBJECT_EVENT, sizeof (*self));
 }
 
 FbdEvent *
@@ -333,56 +401,153 @@ fbd_event_get_timeout (FbdEvent *self)
   return self->timeout;
 }
 
+/**
+ * fbd_event_add_playback:
+ * @self: The event that gets a playback added
+ * @playback: (transfer none): The playback to add
+ *
+ * Add a playback to the list of feedbacks triggered by event.
+ */
+void
+fbd_event_add_playback (FbdEvent *self, FbdFeedbackPlayback *playback)
+{
+  g_return_if_fail (FBD_IS_EVENT (self));
+  g_return_if_fail (playback);
+
+  self->playbacks = g_slist_prepend (self->playbacks, fbd_feedback_playback_ref (playback));
+  playback->event_id = self->id;
+  fbd_feedback_playback_set_ended_func (playback, on_playback_ended, self);
+}
+
 /**
  * fbd_event_add_feedback:
  * @self: The event that gets a feedback added
- * @feedback: (transfer-none): The feedback to add
+ * @feedback: (transfer none): The feedback to add
+ * @level: The profile level the feedback was looked up for
  *
- * Add a feedback to the list of feedbacks triggered by event
+ * Add a new playback of @feedback to the list of feedbacks triggered
+ * by event.
+ *
+ * Returns:(transfer none): The feedback's playback
  */
-void
-fbd_event_add_feedback (FbdEvent *self, FbdFeedbackBase *feedback)
+FbdFeedbackPlayback *
+fbd_event_add_feedback (FbdEvent *self, FbdFeedbackBase *feedback, guint level)
 {
-  self->feedbacks = g_slist_prepend (self->feedbacks, g_object_ref (feedback));
-  g_object_set_data (G_OBJECT (feedback), "event-id", GUINT_TO_POINTER (self->id));
-  g_signal_connect_object (feedback,
-                           "ended",
-                           (GCallback) on_fb_ended,
-                           self,
-                           G_CONNECT_SWAPPED);
+  g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+  g_return_val_if_fail (FBD_IS_EVENT (self), NULL);
+
+  playback = fbd_feedback_playback_new (feedback, level);
+  fbd_event_add_playback (self, playback);
+
+  return playback;
 }
 
+/**
+ * fbd_event_get_playbacks:
+ * @self: The event
+ *
+ * Returns:(transfer none)(element-type FbdFeedbackPlayback): The playbacks
+ *   of the event's feedbacks.
+ */
 GSList *
-fbd_event_get_feedbacks (FbdEvent *self)
+fbd_event_get_playbacks (FbdEvent *self)
+{
+  g_return_val_if_fail (FBD_IS_EVENT (self), NULL);
+
+  return self->playbacks;
+}
+
+static void
+remove_playback (FbdEvent *self, FbdFeedbackPlayback *playback)
 {
-  return self->feedbacks;
+  g_autoslist (FbdFeedbackPlayback) successors = NULL;
+  GSList *link;
+
+  link = g_slist_find (self->playbacks, playback);
+  if (link == NULL)
+    return;
+
+  self->playbacks = g_slist_delete_link (self->playbacks, link);
+  fbd_feedback_playback_set_ended_func (playback, NULL, NULL);
+
+  /* Without its predecessor the rest of a sequence would never start */
+  successors = copy_playbacks (self);
+  for (GSList *l = successors; l; l = l->next) {
+    FbdFeedbackPlayback *successor = l->data;
+
+    if (fbd_feedback_playback_get_after (successor) != playback)
+      continue;
+
+    remove_playback (self, successor);
+    if (!fbd_feedback_playback_get_ended (successor))
+      fbd_feedback_playback_end (successor);
+  }
+
+  fbd_feedback_playback_unref (playback);
 }
 
+/**
+ * fbd_event_remove_playback:
+ * @self: The event
+ * @playback: The playback to remove
+ *
+ * Removes @playback from the event. If it's still running it keeps
+ * running but the event isn't notified when it ends. Playbacks
+ * following @playback are removed and ended too.
+ *
+ * Returns: The number of remaining playbacks.
+ */
 int
-fbd_event_remove_feedback (FbdEvent *self, FbdFeedbackBase *feedback)
+fbd_event_remove_playback (FbdEvent *self, FbdFeedbackPlayback *playback)
 {
   guint len;
 
   g_return_val_if_fail (FBD_IS_EVENT (self), 0);
 
-  if (!self->feedbacks)
+  if (!self->playbacks)
     return 0;
 
-  if (g_slist_index (self->feedbacks, feedback) >= 0) {
-    g_signal_handlers_disconnect_by_data (feedback, self);
-    /* Drop our reference, feedbacks end themselves when unref'ed */
-    g_object_unref (feedback);
-  }
-
-  self->feedbacks = g_slist_remove (self->feedbacks, feedback);
+  remove_playback (self, playback);
 
-  len = g_slist_length (self->feedbacks);
+  len = g_slist_length (self->playbacks);
   if (!len)
     check_ended (self);
 
   return len;
 }
 
+/**
+ * fbd_event_remove_feedback:
+ * @self: The event
+ * @feedback: The feedback to remove
+ *
+ * Removes the playbacks of @feedback from the event.
+ *
+ * Returns: The number of remaining playbacks.
+ */
+int
+fbd_event_remove_feedback (FbdEvent *self, FbdFeedbackBase *feedback)
+{
+  g_autoslist (FbdFeedbackPlayback) playbacks = NULL;
+
+  g_return_val_if_fail (FBD_IS_EVENT (self), 0);
+
+  if (!self->playbacks)
+    return 0;
+
+  /* Copy the list as we will remove playbacks from self->playbacks */
+  playbacks = copy_playbacks (self);
+  for (GSList *l = playbacks; l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
+
+    if (playback->feedback == feedback)
+      fbd_event_remove_playback (self, playback);
+  }
+
+  return g_slist_length (self->playbacks);
+}
+
 /**
  * fbd_event_run_feedbacks:
  * @self: The Event
@@ -392,25 +557,42 @@ fbd_event_remove_feedback (FbdEvent *self, FbdFeedbackBase *feedback)
 void
 fbd_event_run_feedbacks (FbdEvent *self)
 {
+  g_autoptr (GPtrArray) starting = NULL;
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+  gint64 loop_until = 0;
+
   g_return_if_fail (FBD_IS_EVENT (self));
 
-  g_debug ("Running %d feedbacks for event %d", g_slist_length (self->feedbacks), self->id);
+  g_debug ("Running %d feedbacks for event %d", g_slist_length (self->playbacks), self->id);
 
-  if (!self->feedbacks)
+  if (!self->playbacks)
     return;
 
   if (self->timeout > 0) {
-    self->timeout_id = g_timeout_add_seconds (self->timeout,
-                                              (GSourceFunc)on_timeout_expired,
-                                              self);
-    g_source_set_name_by_id (self->timeout_id, "event timeout source");
+    self->timeout_id = fbd_timeout_add (self->timeout * 1000,
+                                        FBD_TIMER_WHEEL_SLACK_COARSE,
+                                        (GSourceFunc)on_timeout_expired,
+                                        self);
+    loop_until = g_get_monotonic_time () + (gint64)self->timeout * G_USEC_PER_SEC;
+  } else if (self->timeout == FBD_EVENT_TIMEOUT_LOOP) {
+    loop_until = G_MAXINT64;
   }
 
   g_object_ref (self);
-  for (GSList *l = self->feedbacks; l; l = l->next) {
-    FbdFeedbackBase *fb = FBD_FEEDBACK_BASE (l->data);
-    fbd_feedback_run (fb);
+  starting = g_ptr_array_new ();
+  for (GSList *l = self->playbacks; l; l = l->next) {
+    /* Started when their predecessor ended */
+    if (fbd_feedback_playback_get_after (l->data))
+      continue;
+
+    /* Feedbacks that aren't part of a sequence can loop without a gap */
+    if (!has_successor (self, l->data))
+      ((FbdFeedbackPlayback *)l->data)->loop_until = loop_until;
+
+    g_ptr_array_add (starting, l->data);
   }
+  fbd_feedback_playbacks_run (starting);
+  fbd_trace_mark (begin, "run-feedbacks", "%u: %s", self->id, self->event);
   g_object_unref (self);
 }
 
@@ -426,8 +608,8 @@ fbd_event_end_feedbacks (FbdEvent *self)
   g_return_if_fail (FBD_IS_EVENT (self));
 
   fbd_event_set_end_reason (self, FBD_EVENT_END_REASON_EXPLICIT);
-  g_debug ("Ending %d feedbacks for event %d", g_slist_length (self->feedbacks), self->id);
-  g_slist_foreach (self->feedbacks, (GFunc)fbd_feedback_end, NULL);
+  g_debug ("Ending %d feedbacks for event %d", g_slist_length (self->playbacks), self->id);
+  g_slist_foreach (self->playbacks, (GFunc)fbd_feedback_playback_end, NULL);
 }
 
 /**
@@ -440,19 +622,17 @@ fbd_event_end_feedbacks (FbdEvent *self)
 void
 fbd_event_end_feedbacks_by_level (FbdEvent *self, guint level)
 {
-  g_autoptr (GSList) feedbacks = NULL;
+  g_autoslist (FbdFeedbackPlayback) playbacks = NULL;
   guint num = 0;
 
   g_return_if_fail (FBD_IS_EVENT (self));
-  /* Copy the list as we will remove feedbacks from self->feedbacks */
-  feedbacks = g_slist_copy (fbd_event_get_feedbacks (self));
+  /* Copy the list as we will remove playbacks from self->playbacks */
+  playbacks = copy_playbacks (self);
 
-  for (GSList *l = feedbacks; l; l = l->next) {
-    FbdFeedbackBase *fb = FBD_FEEDBACK_BASE (l->data);
-    guint event_level;
+  for (GSList *l = playbacks; l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
 
-    event_level = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (fb), "fbd-level"));
-    if (event_level > level)
+    if (playback->level > level)
       num++;
   }
 
@@ -461,17 +641,15 @@ fbd_event_end_feedbacks_by_level (FbdEvent *self, guint level)
 
   g_debug ("Will end %d feedbacks of event %s", num, fbd_event_get_event (self));
   /* Set 'explicit' if we end all remaining feedbacks */
-  if (num == g_slist_length (self->feedbacks))
+  if (num == g_slist_length (self->playbacks))
       fbd_event_set_end_reason (self, FBD_EVENT_END_REASON_EXPLICIT);
 
-  for (GSList *l = feedbacks; l; l = l->next) {
-    FbdFeedbackBase *fb = FBD_FEEDBACK_BASE (l->data);
-    guint event_level;
+  for (GSList *l = playbacks; l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
 
-    event_level = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (fb), "fbd-level"));
-    if (event_level > level) {
-      fbd_event_remove_feedback (self, fb);
-      fbd_feedback_end (fb);
+    if (playback->level > level) {
+      fbd_event_remove_playback (self, playback);
+      fbd_feedback_playback_end (playback);
     }
   }
 }
@@ -491,17 +669,38 @@ fbd_event_get_feedbacks_ended (FbdEvent *self)
 
   g_return_val_if_fail (FBD_IS_EVENT (self), FALSE);
 
-  if (!self->feedbacks)
+  if (!self->playbacks)
     return TRUE;
 
-  for (l = self->feedbacks; l ; l = l->next) {
-    if (!fbd_feedback_get_ended (FBD_FEEDBACK_BASE (l->data)))
+  for (l = self->playbacks; l ; l = l->next) {
+    if (!fbd_feedback_playback_get_ended (l->data))
       return FALSE;
   }
 
   return TRUE;
 }
 
+/**
+ * fbd_event_get_looping:
+ * @self: The Event
+ *
+ * Whether the event's feedbacks are still started again when they
+ * end. This is the case for events with a timeout until the timeout
+ * expired or the event got ended.
+ *
+ * Returns: %TRUE if the event's feedbacks loop
+ */
+gboolean
+fbd_event_get_looping (FbdEvent *self)
+{
+  g_return_val_if_fail (FBD_IS_EVENT (self), FALSE);
+
+  if (self->timeout == FBD_EVENT_TIMEOUT_ONESHOT || self->expired || self->ended)
+    return FALSE;
+
+  return self->end_reason == FBD_EVENT_END_REASON_NATURAL;
+}
+
 /**
  * fbd_event_set_end_reason:
  * @self: The Event
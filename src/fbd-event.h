@@ -29,6 +29,14 @@ typedef enum _FbdEventTimeout {
   FBD_EVENT_TIMEOUT_LOOP     =  0,
 } FbdEventTimeout;
 
+/* The kinds of feedback an event gives, see GetEventCapabilities */
+typedef enum _FbdEventCapabilities {
+  FBD_EVENT_CAPABILITY_NONE   = 0,
+  FBD_EVENT_CAPABILITY_SOUND  = 1 << 0,
+  FBD_EVENT_CAPABILITY_HAPTIC = 1 << 1,
+  FBD_EVENT_CAPABILITY_LED    = 1 << 2,
+} FbdEventCapabilities;
+
 #define FBD_TYPE_EVENT (fbd_event_get_type())
 
 G_DECLARE_FINAL_TYPE (FbdEvent, fbd_event, FBD, EVENT, GObject);
@@ -40,15 +48,21 @@ guint        fbd_event_get_id (FbdEvent *event);
 int          fbd_event_get_timeout (FbdEvent *self);
 void         fbd_event_set_end_reason (FbdEvent *self, FbdEventEndReason reason);
 FbdEventEndReason fbd_event_get_end_reason (FbdEvent *self);
-GSList *     fbd_event_get_feedbacks (FbdEvent *self);
-void         fbd_event_add_feedback (FbdEvent *self,
-                                     FbdFeedbackBase *feedback);
+GSList *     fbd_event_get_playbacks (FbdEvent *self);
+void         fbd_event_add_playback (FbdEvent *self,
+                                     FbdFeedbackPlayback *playback);
+FbdFeedbackPlayback *fbd_event_add_feedback (FbdEvent *self,
+                                             FbdFeedbackBase *feedback,
+                                             guint level);
+int          fbd_event_remove_playback (FbdEvent *self,
+                                        FbdFeedbackPlayback *playback);
 int          fbd_event_remove_feedback (FbdEvent *self,
                                         FbdFeedbackBase *feedback);
 void         fbd_event_run_feedbacks (FbdEvent *self);
 void         fbd_event_end_feedbacks (FbdEvent *self);
 void         fbd_event_end_feedbacks_by_level (FbdEvent *self, guint level);
 gboolean     fbd_event_get_feedbacks_ended (FbdEvent *self);
+gboolean     fbd_event_get_looping (FbdEvent *self);
 const char  *fbd_event_get_sender (FbdEvent *self);
 
 G_END_DECLS
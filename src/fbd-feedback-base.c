@@ -7,6 +7,14 @@
 #define G_LOG_DOMAIN "fbd-feedback-base"
 
 #include "fbd-feedback-base.h"
+#include "fbd-stats.h"
+#include "fbd-timer-wheel.h"
+#include "fbd-trace.h"
+
+#include <string.h>
+
+/* Finished playbacks kept for reuse */
+#define FBD_FEEDBACK_PLAYBACK_POOL_SIZE 32
 
 /**
  * SECTION:fbd-feedback-base
@@ -15,26 +23,34 @@
  *
  * You usually don't want to create objects of this type. It just
  * serves as a base class for other feedback types.
+ *
+ * Feedbacks are immutable descriptions that are shared by all events
+ * using them. Running a feedback creates a #FbdFeedbackPlayback that
+ * holds the state of that run.
  */
 
 enum {
   PROP_0,
   PROP_EVENT_NAME,
+  PROP_COALESCE_WINDOW,
+  PROP_DELAY,
+  PROP_FIRE_AND_FORGET,
   PROP_LAST_PROP,
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
-enum {
-  SIGNAL_ENDED,
-  N_SIGNALS
-};
-static guint signals[N_SIGNALS];
-
 typedef struct _FbdFeedbackBasePrivate {
   gchar *event_name;
-  gboolean ended;
+  guint coalesce_window;
+  guint delay;
+  gboolean fire_and_forget;
+
+  /* The feedback's playbacks, not referenced */
+  GList *playbacks;
 } FbdFeedbackBasePrivate;
 
+static GPtrArray *playback_pool;
+
 G_DEFINE_TYPE_WITH_PRIVATE (FbdFeedbackBase, fbd_feedback_base, G_TYPE_OBJECT);
 
 static void
@@ -51,6 +67,15 @@ fbd_feedback_base_set_property (GObject        *object,
     g_free (priv->event_name);
     priv->event_name = g_value_dup_string (value);
     break;
+  case PROP_COALESCE_WINDOW:
+    priv->coalesce_window = g_value_get_uint (value);
+    break;
+  case PROP_DELAY:
+    priv->delay = g_value_get_uint (value);
+    break;
+  case PROP_FIRE_AND_FORGET:
+    priv->fire_and_forget = g_value_get_boolean (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -71,24 +96,21 @@ fbd_feedback_base_get_property (GObject  *object,
   case PROP_EVENT_NAME:
     g_value_set_string (value, priv->event_name);
     break;
+  case PROP_COALESCE_WINDOW:
+    g_value_set_uint (value, priv->coalesce_window);
+    break;
+  case PROP_DELAY:
+    g_value_set_uint (value, priv->delay);
+    break;
+  case PROP_FIRE_AND_FORGET:
+    g_value_set_boolean (value, priv->fire_and_forget);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
   }
 }
 
-static void
-fbd_feedback_base_dispose (GObject *object)
-{
-  FbdFeedbackBase *self = FBD_FEEDBACK_BASE (object);
-
-  /* end feedback if running */
-  if (!fbd_feedback_get_ended (self))
-    fbd_feedback_end (self);
-
-  G_OBJECT_CLASS (fbd_feedback_base_parent_class)->dispose (object);
-}
-
 static void
 fbd_feedback_base_finalize (GObject *object)
 {
@@ -108,9 +130,10 @@ fbd_feedback_base_class_init (FbdFeedbackBaseClass *klass)
   object_class->set_property = fbd_feedback_base_set_property;
   object_class->get_property = fbd_feedback_base_get_property;
 
-  object_class->dispose = fbd_feedback_base_dispose;
   object_class->finalize = fbd_feedback_base_finalize;
 
+  klass->start_order = FBD_FEEDBACK_START_ORDER_DEFAULT;
+
   props[PROP_EVENT_NAME] =
     g_param_spec_string (
       "event-name",
@@ -119,19 +142,50 @@ fbd_feedback_base_class_init (FbdFeedbackBaseClass *klass)
       NULL,
       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
-  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+  /**
+   * FbdFeedbackBase:coalesce-window:
+   *
+   * Time in milliseconds during which repeated triggers of the same
+   * event by the same client are merged into the already running
+   * event. `0` disables coalescing.
+   */
+  props[PROP_COALESCE_WINDOW] =
+    g_param_spec_uint (
+      "coalesce-window",
+      "",
+      "",
+      0, G_MAXUINT, 0,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * FbdFeedbackBase:delay:
+   *
+   * Time in milliseconds the feedback starts after the event was
+   * triggered or after the feedback it follows ended.
+   */
+  props[PROP_DELAY] =
+    g_param_spec_uint (
+      "delay",
+      "",
+      "",
+      0, G_MAXUINT, 0,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
   /**
-   * FbdFeedbackBase::ended:
+   * FbdFeedbackBase:fire-and-forget:
    *
-   * Emitted when the feedback has ended
+   * Whether one shot events using this feedback are run without
+   * tracking them, like with the `fire-and-forget` hint.
    */
-  signals[SIGNAL_ENDED] = g_signal_new ("ended",
-                                        G_TYPE_FROM_CLASS (klass),
-                                        G_SIGNAL_RUN_LAST, 0, NULL, NULL,
-                                        NULL,
-                                        G_TYPE_NONE,
-                                        0);
+  props[PROP_FIRE_AND_FORGET] =
+    g_param_spec_boolean (
+      "fire-and-forget",
+      "",
+      "",
+      FALSE,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
 
 static void
@@ -157,75 +211,54 @@ fbd_feedback_get_event_name (FbdFeedbackBase *self)
 }
 
 /**
- * fbd_feedback_run:
- * @self: The feedback to run
+ * fbd_feedback_get_coalesce_window:
+ * @self: The feedback
  *
- * Emit the feedback.
+ * Returns: The time in milliseconds during which repeated events are coalesced.
  */
-void
-fbd_feedback_run (FbdFeedbackBase *self)
+guint
+fbd_feedback_get_coalesce_window (FbdFeedbackBase *self)
 {
-  FbdFeedbackBaseClass *klass;
   FbdFeedbackBasePrivate *priv;
 
-  g_return_if_fail (FBD_IS_FEEDBACK_BASE (self));
+  g_return_val_if_fail (FBD_IS_FEEDBACK_BASE (self), 0);
   priv = fbd_feedback_base_get_instance_private (self);
 
-  priv->ended = FALSE;
-  klass = FBD_FEEDBACK_BASE_GET_CLASS (self);
-  g_return_if_fail (klass->run);
-  klass->run (self);
+  return priv->coalesce_window;
 }
 
 /**
- * fbd_feedback_end:
- * @self: The feedback to end
- *
- * End the feedback immediately.
- */
-void
-fbd_feedback_end (FbdFeedbackBase *self)
-{
-  FbdFeedbackBaseClass *klass;
-
-  g_return_if_fail (FBD_IS_FEEDBACK_BASE (self));
-
-  klass = FBD_FEEDBACK_BASE_GET_CLASS (self);
-  g_return_if_fail (klass->end);
-  klass->end (self);
-}
-
-
-/**
- * fbd_feedback_get_ended:
+ * fbd_feedback_get_fire_and_forget:
  * @self: The feedback
  *
- * Whether the feedback is ended.
- *
- * Returns: %TRUE if feedback has ended, otherwise %FALSE.
+ * Returns: Whether the theme marks the feedback's events as fire and forget.
  */
 gboolean
-fbd_feedback_get_ended (FbdFeedbackBase *self)
+fbd_feedback_get_fire_and_forget (FbdFeedbackBase *self)
 {
-  FbdFeedbackBasePrivate *priv = fbd_feedback_base_get_instance_private (self);
+  FbdFeedbackBasePrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_BASE (self), FALSE);
+  priv = fbd_feedback_base_get_instance_private (self);
 
-  return priv->ended;
+  return priv->fire_and_forget;
 }
 
 /**
- * fbd_feedback_base_done:
+ * fbd_feedback_get_delay:
  * @self: The feedback
  *
- * Invoked by a derived classes to notify that it's done emitting feedback,
- * e.g. when the vibra motor stopped or a sound finished playing.
+ * Returns: The time in milliseconds by which the start of the feedback is delayed.
  */
-void
-fbd_feedback_base_done (FbdFeedbackBase *self)
+guint
+fbd_feedback_get_delay (FbdFeedbackBase *self)
 {
-  FbdFeedbackBasePrivate *priv = fbd_feedback_base_get_instance_private (self);
+  FbdFeedbackBasePrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_BASE (self), 0);
+  priv = fbd_feedback_base_get_instance_private (self);
 
-  priv->ended = TRUE;
-  g_signal_emit (self, signals[SIGNAL_ENDED], 0);
+  return priv->delay;
 }
 
 /**
@@ -252,3 +285,453 @@ fbd_feedback_is_available (FbdFeedbackBase *self)
     return TRUE;
 }
 
+
+/**
+ * fbd_feedback_end_playbacks:
+ * @self: The feedback
+ *
+ * End all running playbacks of the feedback, e.g. because a setting
+ * the feedback depends on changed.
+ */
+void
+fbd_feedback_end_playbacks (FbdFeedbackBase *self)
+{
+  FbdFeedbackBasePrivate *priv;
+  g_autoptr (GList) playbacks = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_BASE (self));
+  priv = fbd_feedback_base_get_instance_private (self);
+
+  /* Ending a playback can drop it from the list */
+  playbacks = g_list_copy (priv->playbacks);
+  for (GList *l = playbacks; l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
+
+    if (playback->running)
+      fbd_feedback_playback_end (playback);
+  }
+}
+
+/**
+ * fbd_feedback_playback_new:
+ * @feedback: The feedback to play
+ * @level: The profile level the feedback was looked up for
+ *
+ * Creates a new playback of @feedback. Playbacks are taken from a pool
+ * so running a feedback doesn't need to allocate.
+ *
+ * Returns:(transfer full): The playback
+ */
+FbdFeedbackPlayback *
+fbd_feedback_playback_new (FbdFeedbackBase *feedback, guint level)
+{
+  FbdFeedbackBasePrivate *priv;
+  FbdFeedbackPlayback *self;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_BASE (feedback), NULL);
+  priv = fbd_feedback_base_get_instance_private (feedback);
+
+  if (playback_pool && playback_pool->len)
+    self = g_ptr_array_steal_index_fast (playback_pool, playback_pool->len - 1);
+  else
+    self = g_new0 (FbdFeedbackPlayback, 1);
+
+  g_ref_count_init (&self->ref_count);
+  self->feedback = g_object_ref (feedback);
+  self->level = level;
+  self->trigger_time = g_get_monotonic_time ();
+
+  priv->playbacks = g_list_prepend (priv->playbacks, self);
+  fbd_stats_object_new (fbd_stats_get_default (), FBD_STATS_OBJECT_PLAYBACK, sizeof (*self));
+
+  return self;
+}
+
+/**
+ * fbd_feedback_playback_ref:
+ * @self: The playback
+ *
+ * Returns:(transfer full): The playback
+ */
+FbdFeedbackPlayback *
+fbd_feedback_playback_ref (FbdFeedbackPlayback *self)
+{
+  g_return_val_if_fail (self, NULL);
+
+  g_ref_count_inc (&self->ref_count);
+
+  return self;
+}
+
+/**
+ * fbd_feedback_playback_unref:
+ * @self: The playback
+ *
+ * Drops a reference. A running playback holds a reference on itself
+ * so it keeps running until it ends. When the last reference is
+ * dropped the playback goes back to the pool.
+ */
+void
+fbd_feedback_playback_unref (FbdFeedbackPlayback *self)
+{
+  FbdFeedbackBasePrivate *priv;
+
+  g_return_if_fail (self);
+
+  if (!g_ref_count_dec (&self->ref_count))
+    return;
+
+  priv = fbd_feedback_base_get_instance_private (self->feedback);
+  priv->playbacks = g_list_remove (priv->playbacks, self);
+
+  /* Timers of the feedback type must not fire once the playback is reused */
+  g_clear_handle_id (&self->timer_id, fbd_timeout_remove);
+  g_clear_handle_id (&self->step_id, fbd_timeout_remove);
+  g_clear_handle_id (&self->delay_id, fbd_timeout_remove);
+  g_clear_pointer (&self->after, fbd_feedback_playback_unref);
+  g_clear_object (&self->dev);
+  g_clear_object (&self->feedback);
+  memset (self, 0, sizeof (*self));
+  fbd_stats_object_free (fbd_stats_get_default (), FBD_STATS_OBJECT_PLAYBACK, sizeof (*self));
+
+  if (playback_pool == NULL)
+    playback_pool = g_ptr_array_new_with_free_func (g_free);
+
+  if (playback_pool->len < FBD_FEEDBACK_PLAYBACK_POOL_SIZE)
+    g_ptr_array_add (playback_pool, self);
+  else
+    g_free (self);
+}
+
+/**
+ * fbd_feedback_playback_set_ended_func:
+ * @self: The playback
+ * @func:(nullable): The function to invoke when the playback ended
+ * @user_data: The user data passed to @func
+ *
+ * Sets the function invoked each time the playback ends. Pass `NULL`
+ * to detach the playback from its owner.
+ */
+void
+fbd_feedback_playback_set_ended_func (FbdFeedbackPlayback          *self,
+                                      FbdFeedbackPlaybackEndedFunc  func,
+                                      gpointer                      user_data)
+{
+  g_return_if_fail (self);
+
+  self->ended_func = func;
+  self->user_data = user_data;
+}
+
+/**
+ * fbd_feedback_playback_set_device:
+ * @self: The playback
+ * @dev:(nullable): The device
+ *
+ * Sets the device the feedback is played on, e.g. the haptic motor
+ * picked by the manager.
+ */
+void
+fbd_feedback_playback_set_device (FbdFeedbackPlayback *self, gpointer dev)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (dev == NULL || G_IS_OBJECT (dev));
+
+  g_set_object (&self->dev, dev);
+}
+
+/**
+ * fbd_feedback_playback_get_device:
+ * @self: The playback
+ *
+ * Returns:(transfer none)(nullable): The device the feedback is played on
+ */
+gpointer
+fbd_feedback_playback_get_device (FbdFeedbackPlayback *self)
+{
+  g_return_val_if_fail (self, NULL);
+
+  return self->dev;
+}
+
+/**
+ * fbd_feedback_playback_set_deadline:
+ * @self: The playback
+ * @deadline: The deadline in milliseconds or `0` for no deadline
+ *
+ * Sets the time after triggering by which the client expects the
+ * feedback to start. Playbacks starting later are counted as missed.
+ */
+void
+fbd_feedback_playback_set_deadline (FbdFeedbackPlayback *self, guint deadline)
+{
+  g_return_if_fail (self);
+
+  self->deadline = deadline;
+}
+
+/**
+ * fbd_feedback_playback_set_after:
+ * @self: The playback
+ * @after:(nullable): The playback to follow
+ *
+ * Makes @self a successor of @after. The owner of the playbacks
+ * starts @self once @after ended instead of running both together.
+ */
+void
+fbd_feedback_playback_set_after (FbdFeedbackPlayback *self, FbdFeedbackPlayback *after)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self != after);
+
+  if (after)
+    fbd_feedback_playback_ref (after);
+  g_clear_pointer (&self->after, fbd_feedback_playback_unref);
+  self->after = after;
+}
+
+/**
+ * fbd_feedback_playback_get_after:
+ * @self: The playback
+ *
+ * Returns:(transfer none)(nullable): The playback @self follows
+ */
+FbdFeedbackPlayback *
+fbd_feedback_playback_get_after (FbdFeedbackPlayback *self)
+{
+  g_return_val_if_fail (self, NULL);
+
+  return self->after;
+}
+
+
+static void
+playback_run_now (FbdFeedbackPlayback *self)
+{
+  FbdFeedbackBaseClass *klass = FBD_FEEDBACK_BASE_GET_CLASS (self->feedback);
+  gint64 trigger_time, begin;
+  guint deadline;
+  GType type;
+
+  /* Only the first run is triggered by a client, later ones loop */
+  trigger_time = self->trigger_time;
+  self->trigger_time = 0;
+  deadline = self->deadline;
+  type = G_OBJECT_TYPE (self->feedback);
+
+  /* The feedback might finish right away and drop the last reference */
+  begin = FBD_TRACE_CURRENT_TIME;
+  self->run_time = g_get_monotonic_time ();
+  klass->run (self->feedback, self);
+  fbd_trace_mark (begin, "feedback-run", "%s", g_type_name (type));
+
+  if (trigger_time) {
+    FbdStats *stats = fbd_stats_get_default ();
+    gint64 latency = g_get_monotonic_time () - trigger_time;
+
+    /* The theme asked for the delay, it doesn't count as latency */
+    latency = MAX (0, latency - (gint64)fbd_feedback_get_delay (self->feedback) * 1000);
+
+    fbd_stats_add_latency (stats, type, latency);
+    if (deadline && latency > (gint64)deadline * 1000)
+      fbd_stats_count (stats, FBD_STATS_COUNTER_DEADLINE_MISSED);
+  }
+}
+
+
+static void
+on_delay_expired (gpointer data)
+{
+  FbdFeedbackPlayback *self = data;
+
+  self->delay_id = 0;
+  playback_run_now (self);
+}
+
+/**
+ * fbd_feedback_playback_run:
+ * @self: The playback
+ *
+ * Emit the feedback. If the feedback has a delay the playback is
+ * running from now on but the feedback only starts once the delay
+ * passed.
+ */
+void
+fbd_feedback_playback_run (FbdFeedbackPlayback *self)
+{
+  FbdFeedbackBaseClass *klass;
+  guint delay;
+
+  g_return_if_fail (self);
+
+  klass = FBD_FEEDBACK_BASE_GET_CLASS (self->feedback);
+  g_return_if_fail (klass->run);
+
+  self->ended = FALSE;
+  /* Keep the playback alive until it's done */
+  if (!self->running) {
+    self->running = TRUE;
+    fbd_feedback_playback_ref (self);
+  }
+
+  delay = fbd_feedback_get_delay (self->feedback);
+  if (delay == 0) {
+    playback_run_now (self);
+    return;
+  }
+
+  g_clear_handle_id (&self->delay_id, fbd_timeout_remove);
+  self->delay_id = fbd_timeout_add_once (delay,
+                                         FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                         on_delay_expired,
+                                         self);
+}
+
+/**
+ * fbd_feedback_playbacks_run:
+ * @playbacks:(element-type FbdFeedbackPlayback): The playbacks to run
+ *
+ * Runs the playbacks of an event so their feedbacks reach the user
+ * as close together as possible. All feedbacks first get ready
+ * (e.g. by uploading a haptic effect) and are then started by their
+ * start order rather than the order of the theme: feedbacks with a
+ * long way to the user start first and ones that block the daemon
+ * (e.g. sysfs writes) last. The time between the first and the last
+ * start is tracked as `start-skew`.
+ */
+void
+fbd_feedback_playbacks_run (GPtrArray *playbacks)
+{
+  gint64 first, last;
+  guint n_started = 0;
+
+  g_return_if_fail (playbacks);
+
+  for (guint i = 0; i < playbacks->len; i++) {
+    FbdFeedbackPlayback *playback = g_ptr_array_index (playbacks, i);
+    FbdFeedbackBaseClass *klass = FBD_FEEDBACK_BASE_GET_CLASS (playback->feedback);
+
+    /* Delayed feedbacks get ready when they start */
+    if (klass->prepare && fbd_feedback_get_delay (playback->feedback) == 0)
+      klass->prepare (playback->feedback, playback);
+  }
+
+  first = g_get_monotonic_time ();
+  for (int order = 0; order < FBD_FEEDBACK_N_START_ORDERS; order++) {
+    for (guint i = 0; i < playbacks->len; i++) {
+      FbdFeedbackPlayback *playback = g_ptr_array_index (playbacks, i);
+      FbdFeedbackBaseClass *klass = FBD_FEEDBACK_BASE_GET_CLASS (playback->feedback);
+
+      if (klass->start_order != order)
+        continue;
+
+      fbd_feedback_playback_run (playback);
+      if (fbd_feedback_get_delay (playback->feedback) == 0)
+        n_started++;
+    }
+  }
+  last = g_get_monotonic_time ();
+
+  if (n_started > 1)
+    fbd_stats_add_duration (fbd_stats_get_default (), FBD_STATS_DURATION_START_SKEW, last - first);
+}
+
+/**
+ * fbd_feedback_playback_end:
+ * @self: The playback
+ *
+ * End the feedback immediately.
+ */
+void
+fbd_feedback_playback_end (FbdFeedbackPlayback *self)
+{
+  FbdFeedbackBaseClass *klass;
+
+  g_return_if_fail (self);
+
+  /* Nothing was emitted yet */
+  if (self->delay_id || (self->after && !self->running && !self->ended)) {
+    g_clear_handle_id (&self->delay_id, fbd_timeout_remove);
+    fbd_feedback_playback_done (self);
+    return;
+  }
+
+  klass = FBD_FEEDBACK_BASE_GET_CLASS (self->feedback);
+  g_return_if_fail (klass->end);
+  klass->end (self->feedback, self);
+}
+
+/**
+ * fbd_feedback_playback_get_ended:
+ * @self: The playback
+ *
+ * Whether the playback has ended.
+ *
+ * Returns: %TRUE if the playback has ended, otherwise %FALSE.
+ */
+gboolean
+fbd_feedback_playback_get_ended (FbdFeedbackPlayback *self)
+{
+  g_return_val_if_fail (self, TRUE);
+
+  return self->ended;
+}
+
+/**
+ * fbd_feedback_playback_set_paused:
+ * @self: The playback
+ * @paused: Whether the playback is paused
+ *
+ * Marks the playback as paused, e.g. while its device is gone. A
+ * paused playback keeps running and can still be ended.
+ */
+void
+fbd_feedback_playback_set_paused (FbdFeedbackPlayback *self, gboolean paused)
+{
+  g_return_if_fail (self);
+
+  self->paused = paused;
+}
+
+/**
+ * fbd_feedback_playback_get_paused:
+ * @self: The playback
+ *
+ * Whether the playback is paused.
+ *
+ * Returns: %TRUE if the playback is paused, otherwise %FALSE.
+ */
+gboolean
+fbd_feedback_playback_get_paused (FbdFeedbackPlayback *self)
+{
+  g_return_val_if_fail (self, FALSE);
+
+  return self->paused;
+}
+
+/**
+ * fbd_feedback_playback_done:
+ * @self: The playback
+ *
+ * Invoked by a derived classes to notify that it's done emitting feedback,
+ * e.g. when the vibra motor stopped or a sound finished playing.
+ */
+void
+fbd_feedback_playback_done (FbdFeedbackPlayback *self)
+{
+  gboolean running;
+
+  g_return_if_fail (self);
+
+  running = self->running;
+  self->running = FALSE;
+  self->ended = TRUE;
+  self->paused = FALSE;
+
+  /* Might run the playback again */
+  if (self->ended_func)
+    self->ended_func (self, self->user_data);
+
+  if (running)
+    fbd_feedback_playback_unref (self);
+}
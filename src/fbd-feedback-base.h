@@ -13,21 +13,120 @@ G_BEGIN_DECLS
 
 G_DECLARE_DERIVABLE_TYPE (FbdFeedbackBase, fbd_feedback_base, FBD, FEEDBACK_BASE, GObject);
 
+typedef struct _FbdFeedbackPlayback FbdFeedbackPlayback;
+
+/**
+ * FbdFeedbackPlaybackEndedFunc:
+ * @playback: The playback that ended
+ * @user_data: The user data
+ *
+ * Invoked when a playback ended.
+ */
+typedef void (*FbdFeedbackPlaybackEndedFunc) (FbdFeedbackPlayback *playback, gpointer user_data);
+
+/**
+ * FbdFeedbackPlayback:
+ * @feedback: The feedback that is played
+ * @level: The profile level the feedback was looked up for
+ * @event_id: The id of the event the playback belongs to
+ * @timer_id: Timer of the feedback type
+ * @step_id: Timer for the steps of a feedback type
+ * @pos: The current step
+ * @loop: How often the repeated steps were played again
+ * @loop_until: Until when (in monotonic time) the feedback may loop on its own, `0` if it
+ *   must not loop
+ * @run_time: When the current run started
+ * @offset: Where a paused playback continues, in milliseconds
+ * @after: The playback this one follows
+ *
+ * A single run of a feedback. Feedbacks only describe the feedback and
+ * are shared between events, the playback state lives here so the
+ * same feedback can be played several times at once.
+ */
+struct _FbdFeedbackPlayback {
+  FbdFeedbackBase     *feedback;
+  guint                level;
+  guint                event_id;
+  guint                timer_id;
+  guint                step_id;
+  guint                pos;
+  guint                loop;
+  gint64               loop_until;
+  gint64               run_time;
+  guint                offset;
+  FbdFeedbackPlayback *after;
+
+  /*< private >*/
+  grefcount                    ref_count;
+  gboolean                     running;
+  gboolean                     ended;
+  gboolean                     paused;
+  gint64                       trigger_time;
+  guint                        deadline;
+  guint                        delay_id;
+  GObject                     *dev;
+  FbdFeedbackPlaybackEndedFunc ended_func;
+  gpointer                     user_data;
+};
+
+/**
+ * FbdFeedbackStartOrder:
+ * @FBD_FEEDBACK_START_ORDER_FIRST: Feedbacks with a long way to the user, e.g. sounds
+ * @FBD_FEEDBACK_START_ORDER_EARLY: Feedbacks that only hand work to a worker
+ * @FBD_FEEDBACK_START_ORDER_DEFAULT: The default
+ * @FBD_FEEDBACK_START_ORDER_LATE: Feedbacks that block when started, e.g. sysfs writes
+ *
+ * When a feedback is started relative to the other feedbacks of an
+ * event.
+ */
+typedef enum {
+  FBD_FEEDBACK_START_ORDER_FIRST,
+  FBD_FEEDBACK_START_ORDER_EARLY,
+  FBD_FEEDBACK_START_ORDER_DEFAULT,
+  FBD_FEEDBACK_START_ORDER_LATE,
+  FBD_FEEDBACK_N_START_ORDERS,
+} FbdFeedbackStartOrder;
+
 struct _FbdFeedbackBaseClass
 {
   GObjectClass parent_class;
 
-  void     (*run) (FbdFeedbackBase *self);
-  void     (*end) (FbdFeedbackBase *self);
+  FbdFeedbackStartOrder start_order;
+
+  void     (*prepare) (FbdFeedbackBase *self, FbdFeedbackPlayback *playback);
+  void     (*run) (FbdFeedbackBase *self, FbdFeedbackPlayback *playback);
+  void     (*end) (FbdFeedbackBase *self, FbdFeedbackPlayback *playback);
   gboolean (*is_available) (FbdFeedbackBase *self);
 };
 
 
 const gchar *fbd_feedback_get_event_name (FbdFeedbackBase *self);
-void         fbd_feedback_run (FbdFeedbackBase *self);
-void         fbd_feedback_end (FbdFeedbackBase *self);
-gboolean     fbd_feedback_get_ended (FbdFeedbackBase *self);
-void         fbd_feedback_base_done (FbdFeedbackBase *self);
+guint        fbd_feedback_get_coalesce_window (FbdFeedbackBase *self);
+guint        fbd_feedback_get_delay (FbdFeedbackBase *self);
+gboolean     fbd_feedback_get_fire_and_forget (FbdFeedbackBase *self);
 gboolean     fbd_feedback_is_available (FbdFeedbackBase *self);
+void         fbd_feedback_end_playbacks (FbdFeedbackBase *self);
+
+FbdFeedbackPlayback *fbd_feedback_playback_new (FbdFeedbackBase *feedback, guint level);
+FbdFeedbackPlayback *fbd_feedback_playback_ref (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_unref (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_set_ended_func (FbdFeedbackPlayback          *self,
+                                                           FbdFeedbackPlaybackEndedFunc  func,
+                                                           gpointer                      user_data);
+void                 fbd_feedback_playback_set_device (FbdFeedbackPlayback *self, gpointer dev);
+gpointer             fbd_feedback_playback_get_device (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_set_deadline (FbdFeedbackPlayback *self, guint deadline);
+void                 fbd_feedback_playback_set_after (FbdFeedbackPlayback *self,
+                                                      FbdFeedbackPlayback *after);
+FbdFeedbackPlayback *fbd_feedback_playback_get_after (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_run (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playbacks_run (GPtrArray *playbacks);
+void                 fbd_feedback_playback_end (FbdFeedbackPlayback *self);
+gboolean             fbd_feedback_playback_get_ended (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_set_paused (FbdFeedbackPlayback *self, gboolean paused);
+gboolean             fbd_feedback_playback_get_paused (FbdFeedbackPlayback *self);
+void                 fbd_feedback_playback_done (FbdFeedbackPlayback *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdFeedbackPlayback, fbd_feedback_playback_unref)
 
 G_END_DECLS
@@ -9,6 +9,7 @@
 #include "fbd-enums.h"
 #include "fbd-feedback-dummy.h"
 #include "fbd-feedback-manager.h"
+#include "fbd-timer-wheel.h"
 
 /**
  * SECTION:fbd-feedback-dummy
@@ -27,7 +28,6 @@ typedef struct _FbdFeedbackDummy {
   FbdFeedbackBase parent;
 
   guint duration;
-  guint timer_id;
 } FbdFeedbackDummy;
 
 G_DEFINE_TYPE (FbdFeedbackDummy, fbd_feedback_dummy, FBD_TYPE_FEEDBACK_BASE);
@@ -69,34 +69,33 @@ fbd_feedback_dummy_get_property (GObject    *object,
 }
 
 static gboolean
-on_timeout_expired (FbdFeedbackDummy *self)
+on_timeout_expired (FbdFeedbackPlayback *playback)
 {
-  fbd_feedback_base_done (FBD_FEEDBACK_BASE(self));
+  playback->timer_id = 0;
+  fbd_feedback_playback_done (playback);
   return G_SOURCE_REMOVE;
 }
 
 static void
-fbd_feedback_dummy_run (FbdFeedbackBase *base)
+fbd_feedback_dummy_run (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackDummy *self = FBD_FEEDBACK_DUMMY (base);
 
   if (self->duration) {
-    self->timer_id = g_timeout_add (self->duration,
-				  (GSourceFunc)on_timeout_expired,
-				  self);
-    g_source_set_name_by_id (self->timer_id, "feedback-dummy-timer");
+    playback->timer_id = fbd_timeout_add (self->duration,
+                                          FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                          (GSourceFunc)on_timeout_expired,
+                                          playback);
   } else {
-    fbd_feedback_base_done (base);
+    fbd_feedback_playback_done (playback);
   }
 }
 
 static void
-fbd_feedback_dummy_end (FbdFeedbackBase *base)
+fbd_feedback_dummy_end (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackDummy *self = FBD_FEEDBACK_DUMMY (base);
-
-  g_clear_handle_id(&self->timer_id, g_source_remove);
-  fbd_feedback_base_done (base);
+  g_clear_handle_id (&playback->timer_id, fbd_timeout_remove);
+  fbd_feedback_playback_done (playback);
 }
 
 static void
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-feedback-group"
+
+#include "fbd-enums.h"
+#include "fbd-feedback-group.h"
+#include "fbd-feedback-profile.h"
+
+#include <json-glib/json-glib.h>
+
+/**
+ * FbdFeedbackGroup:
+ *
+ * Several feedbacks for one event.
+ *
+ * A group is never run itself. When the theme's dispatch table is
+ * built the group is replaced by its feedbacks together with how they
+ * are started (see #FbdFeedbackThemeEntry) so an event can e.g. play
+ * two LED patterns one after another while a sound is playing.
+ */
+
+enum {
+  PROP_0,
+  PROP_MODE,
+  PROP_FEEDBACKS,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef struct _FbdFeedbackGroup {
+  FbdFeedbackBase      parent;
+
+  FbdFeedbackGroupMode mode;
+  GPtrArray           *feedbacks;
+} FbdFeedbackGroup;
+
+static void json_serializable_iface_init (JsonSerializableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdFeedbackGroup, fbd_feedback_group, FBD_TYPE_FEEDBACK_BASE,
+                         G_IMPLEMENT_INTERFACE (JSON_TYPE_SERIALIZABLE,
+                                                json_serializable_iface_init));
+
+
+static gboolean
+fbd_feedback_group_serializable_deserialize_property (JsonSerializable *serializable,
+                                                      const gchar      *property_name,
+                                                      GValue           *value,
+                                                      GParamSpec       *pspec,
+                                                      JsonNode         *property_node)
+{
+  if (g_strcmp0 (property_name, "feedbacks") == 0) {
+    if (JSON_NODE_TYPE (property_node) == JSON_NODE_ARRAY) {
+      JsonArray *array = json_node_get_array (property_node);
+      guint array_len = json_array_get_length (array);
+      g_autoptr (GPtrArray) feedbacks = g_ptr_array_new_full (array_len, g_object_unref);
+
+      for (guint i = 0; i < array_len; i++) {
+        JsonNode *element_node = json_array_get_element (array, i);
+        const char *type_name;
+        GType gtype;
+
+        if (!JSON_NODE_HOLDS_OBJECT (element_node))
+          return FALSE;
+
+        type_name = json_object_get_string_member_with_default (json_node_get_object (element_node),
+                                                                "type", NULL);
+        gtype = fbd_feedback_profile_get_feedback_type (type_name);
+        /* Groups don't nest */
+        if (gtype == G_TYPE_INVALID || gtype == FBD_TYPE_FEEDBACK_GROUP) {
+          g_warning ("Invalid feedback type '%s' in group", type_name);
+          return FALSE;
+        }
+
+        g_ptr_array_add (feedbacks, json_gobject_deserialize (gtype, element_node));
+      }
+      g_value_set_boxed (value, feedbacks);
+      return TRUE;
+    }
+    return FALSE;
+  }
+
+  return json_serializable_default_deserialize_property (serializable,
+                                                         property_name,
+                                                         value,
+                                                         pspec,
+                                                         property_node);
+}
+
+
+static void
+fbd_feedback_group_set_property (GObject      *object,
+                                 guint         property_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  FbdFeedbackGroup *self = FBD_FEEDBACK_GROUP (object);
+
+  switch (property_id) {
+  case PROP_MODE:
+    self->mode = g_value_get_enum (value);
+    break;
+  case PROP_FEEDBACKS:
+    g_clear_pointer (&self->feedbacks, g_ptr_array_unref);
+    self->feedbacks = g_value_dup_boxed (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_feedback_group_get_property (GObject    *object,
+                                 guint       property_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  FbdFeedbackGroup *self = FBD_FEEDBACK_GROUP (object);
+
+  switch (property_id) {
+  case PROP_MODE:
+    g_value_set_enum (value, self->mode);
+    break;
+  case PROP_FEEDBACKS:
+    g_value_set_boxed (value, self->feedbacks);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+/* Groups are flattened into the dispatch table, nothing to play */
+static void
+fbd_feedback_group_run (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
+{
+  fbd_feedback_playback_done (playback);
+}
+
+
+static void
+fbd_feedback_group_end (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
+{
+  fbd_feedback_playback_done (playback);
+}
+
+
+static gboolean
+fbd_feedback_group_is_available (FbdFeedbackBase *base)
+{
+  FbdFeedbackGroup *self = FBD_FEEDBACK_GROUP (base);
+
+  for (guint i = 0; self->feedbacks && i < self->feedbacks->len; i++) {
+    if (fbd_feedback_is_available (g_ptr_array_index (self->feedbacks, i)))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static void
+fbd_feedback_group_finalize (GObject *object)
+{
+  FbdFeedbackGroup *self = FBD_FEEDBACK_GROUP (object);
+
+  g_clear_pointer (&self->feedbacks, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (fbd_feedback_group_parent_class)->finalize (object);
+}
+
+
+static void
+json_serializable_iface_init (JsonSerializableIface *iface)
+{
+  iface->deserialize_property = fbd_feedback_group_serializable_deserialize_property;
+}
+
+
+static void
+fbd_feedback_group_class_init (FbdFeedbackGroupClass *klass)
+{
+  FbdFeedbackBaseClass *base_class = FBD_FEEDBACK_BASE_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = fbd_feedback_group_set_property;
+  object_class->get_property = fbd_feedback_group_get_property;
+  object_class->finalize = fbd_feedback_group_finalize;
+
+  base_class->run = fbd_feedback_group_run;
+  base_class->end = fbd_feedback_group_end;
+  base_class->is_available = fbd_feedback_group_is_available;
+
+  /**
+   * FbdFeedbackGroup:mode:
+   *
+   * Whether the feedbacks start together or one after another.
+   */
+  props[PROP_MODE] =
+    g_param_spec_enum ("mode", "", "",
+                       FBD_TYPE_FEEDBACK_GROUP_MODE,
+                       FBD_FEEDBACK_GROUP_MODE_PARALLEL,
+                       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackGroup:feedbacks:
+   *
+   * The feedbacks of the group in the order they're started.
+   */
+  props[PROP_FEEDBACKS] =
+    g_param_spec_boxed ("feedbacks", "", "",
+                        G_TYPE_PTR_ARRAY,
+                        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+fbd_feedback_group_init (FbdFeedbackGroup *self)
+{
+}
+
+/**
+ * fbd_feedback_group_get_mode:
+ * @self: The feedback group
+ *
+ * Returns: How the group's feedbacks are started
+ */
+FbdFeedbackGroupMode
+fbd_feedback_group_get_mode (FbdFeedbackGroup *self)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_GROUP (self), FBD_FEEDBACK_GROUP_MODE_PARALLEL);
+
+  return self->mode;
+}
+
+/**
+ * fbd_feedback_group_get_feedbacks:
+ * @self: The feedback group
+ *
+ * Returns:(transfer none)(element-type FbdFeedbackBase)(nullable): The group's feedbacks
+ */
+GPtrArray *
+fbd_feedback_group_get_feedbacks (FbdFeedbackGroup *self)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_GROUP (self), NULL);
+
+  return self->feedbacks;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-feedback-base.h"
+
+G_BEGIN_DECLS
+
+/**
+ * FbdFeedbackGroupMode:
+ * @FBD_FEEDBACK_GROUP_MODE_PARALLEL: All feedbacks start together
+ * @FBD_FEEDBACK_GROUP_MODE_SEQUENTIAL: Each feedback starts when the previous one ended
+ *
+ * How the feedbacks of a group are played.
+ */
+typedef enum _FbdFeedbackGroupMode {
+  FBD_FEEDBACK_GROUP_MODE_PARALLEL = 0,
+  FBD_FEEDBACK_GROUP_MODE_SEQUENTIAL = 1,
+} FbdFeedbackGroupMode;
+
+#define FBD_TYPE_FEEDBACK_GROUP (fbd_feedback_group_get_type())
+
+G_DECLARE_FINAL_TYPE (FbdFeedbackGroup, fbd_feedback_group, FBD, FEEDBACK_GROUP, FbdFeedbackBase);
+
+FbdFeedbackGroupMode fbd_feedback_group_get_mode (FbdFeedbackGroup *self);
+GPtrArray           *fbd_feedback_group_get_feedbacks (FbdFeedbackGroup *self);
+
+G_END_DECLS
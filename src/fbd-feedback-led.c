@@ -13,14 +13,16 @@
 #include "fbd-dev-leds.h"
 #include "fbd-feedback-led.h"
 #include "fbd-feedback-manager.h"
+#include "fbd-led-animation.h"
 
 #include <gmobile.h>
+#include <json-glib/json-glib.h>
 
 /**
  * FbdFeedbackLed:
  *
- * The `FbdFeedbackLed` describes a feedback via an LED. It currently
- * only supports periodic patterns.
+ * The `FbdFeedbackLed` describes a feedback via an LED. This is either
+ * a periodic pattern or a sequence of steps.
  */
 
 enum {
@@ -29,6 +31,8 @@ enum {
   PROP_COLOR,
   PROP_MAX_BRIGHTNESS,
   PROP_PRIORITY,
+  PROP_STEPS,
+  PROP_SHAPE,
   PROP_LAST_PROP,
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -40,12 +44,20 @@ typedef struct _FbdFeedbackLed {
   guint            priority;
   guint            max_brightness;
   char            *color;
+  FbdLedAnimation *steps;
+  FbdFeedbackLedShape shape;
+  /* Built on first use from shape, frequency and max_brightness */
+  FbdLedAnimation *shape_animation;
   gboolean         prefer_flash;
 
   GSettings       *settings;
 } FbdFeedbackLed;
 
-G_DEFINE_TYPE (FbdFeedbackLed, fbd_feedback_led, FBD_TYPE_FEEDBACK_BASE)
+static void json_serializable_iface_init (JsonSerializableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdFeedbackLed, fbd_feedback_led, FBD_TYPE_FEEDBACK_BASE,
+                         G_IMPLEMENT_INTERFACE (JSON_TYPE_SERIALIZABLE,
+                                                json_serializable_iface_init))
 
 /**
  * ascii_to_int:
@@ -165,13 +177,73 @@ color_string_to_color (const char *color, gboolean prefer_flash, FbdLedRgbColor
 }
 
 
+static FbdLedAnimation *
+parse_steps (JsonArray *array)
+{
+  g_autoptr (FbdLedAnimation) animation = fbd_led_animation_new (TRUE);
+
+  for (guint i = 0; i < json_array_get_length (array); i++) {
+    JsonNode *element_node = json_array_get_element (array, i);
+    FbdLedRgbColor rgb = { 0 };
+    FbdLedStepKind kind;
+    JsonObject *step;
+    const char *color;
+    gint64 brightness, duration;
+
+    if (!JSON_NODE_HOLDS_OBJECT (element_node))
+      return NULL;
+
+    step = json_node_get_object (element_node);
+    kind = json_object_get_boolean_member_with_default (step, "ramp", FALSE) ?
+      FBD_LED_STEP_RAMP : FBD_LED_STEP_HOLD;
+    brightness = json_object_get_int_member_with_default (step, "brightness", 100);
+    duration = json_object_get_int_member_with_default (step, "duration", 0);
+    color = json_object_get_string_member_with_default (step, "color", NULL);
+    if (!gm_str_is_null_or_empty (color))
+      color_string_to_color (color, FALSE, &rgb);
+
+    fbd_led_animation_add_step (animation,
+                                kind,
+                                CLAMP (duration, 0, G_MAXUINT),
+                                CLAMP (brightness, 0, 100),
+                                gm_str_is_null_or_empty (color) ? NULL : &rgb);
+  }
+
+  return g_steal_pointer (&animation);
+}
+
+
+static gboolean
+fbd_feedback_led_serializable_deserialize_property (JsonSerializable *serializable,
+                                                    const gchar      *property_name,
+                                                    GValue           *value,
+                                                    GParamSpec       *pspec,
+                                                    JsonNode         *property_node)
+{
+  if (g_strcmp0 (property_name, "steps") == 0) {
+    if (JSON_NODE_TYPE (property_node) == JSON_NODE_ARRAY) {
+      g_autoptr (FbdLedAnimation) steps = NULL;
+
+      steps = parse_steps (json_node_get_array (property_node));
+      if (steps == NULL)
+        return FALSE;
+
+      g_value_set_boxed (value, steps);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+
 static void
 on_prefer_flash_changed (FbdFeedbackLed *self)
 {
   gboolean prefer_flash = g_settings_get_boolean (self->settings, "prefer-flash");
 
   if (self->prefer_flash && !prefer_flash)
-    fbd_feedback_end (FBD_FEEDBACK_BASE (self));
+    fbd_feedback_end_playbacks (FBD_FEEDBACK_BASE (self));
 
   self->prefer_flash = prefer_flash;
   g_debug ("Prefer flash: %d", self->prefer_flash);
@@ -199,6 +271,13 @@ fbd_feedback_led_set_property (GObject      *object,
   case PROP_COLOR:
     self->color = g_value_dup_string (value);
     break;
+  case PROP_STEPS:
+    g_clear_pointer (&self->steps, fbd_led_animation_unref);
+    self->steps = g_value_dup_boxed (value);
+    break;
+  case PROP_SHAPE:
+    self->shape = g_value_get_enum (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -227,6 +306,12 @@ fbd_feedback_led_get_property (GObject    *object,
   case PROP_COLOR:
     g_value_set_string (value, self->color);
     break;
+  case PROP_STEPS:
+    g_value_set_boxed (value, self->steps);
+    break;
+  case PROP_SHAPE:
+    g_value_set_enum (value, self->shape);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -234,21 +319,60 @@ fbd_feedback_led_get_property (GObject    *object,
 }
 
 
+/*
+ * Breathing is what fbd_dev_led_start_periodic() does so only other
+ * shapes need an animation. It is built once so LEDs that can run it
+ * in the kernel can reuse the compiled pattern.
+ */
+static FbdLedAnimation *
+get_shape_animation (FbdFeedbackLed *self)
+{
+  if (self->shape_animation || self->frequency == 0)
+    return self->shape_animation;
+
+  switch (self->shape) {
+  case FBD_FEEDBACK_LED_SHAPE_BLINK:
+    self->shape_animation = fbd_led_animation_new_blink (self->frequency, self->max_brightness);
+    break;
+  case FBD_FEEDBACK_LED_SHAPE_FADE_IN:
+    self->shape_animation = fbd_led_animation_new_fade_in (self->frequency, self->max_brightness);
+    break;
+  case FBD_FEEDBACK_LED_SHAPE_HEARTBEAT:
+    self->shape_animation = fbd_led_animation_new_heartbeat (self->frequency,
+                                                             self->max_brightness);
+    break;
+  case FBD_FEEDBACK_LED_SHAPE_BREATHE:
+  default:
+    break;
+  }
+
+  return self->shape_animation;
+}
+
+
 static void
-fbd_feedback_led_run (FbdFeedbackBase *base)
+fbd_feedback_led_run (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackLed *self = FBD_FEEDBACK_LED (base);
   FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
   FbdDevLeds *dev = fbd_feedback_manager_get_dev_leds (manager);
   FbdFeedbackLedColor color;
-  FbdLedRgbColor rgb;
+  FbdLedRgbColor rgb = { 0 };
+  FbdLedAnimation *animation;
 
   g_return_if_fail (FBD_IS_DEV_LEDS (dev));
   g_debug ("Periodic led feedback: max brightness: %d, freq: %d", self->max_brightness, self->frequency);
 
   color = color_string_to_color (self->color, self->prefer_flash, &rgb);
-  /* FIXME: handle priority */
+  animation = self->steps ?: get_shape_animation (self);
+  if (animation) {
+    fbd_dev_leds_start_animation (dev, playback, self->priority, color, &rgb, animation);
+    return;
+  }
+
   fbd_dev_leds_start_periodic (dev,
+                               playback,
+                               self->priority,
                                color,
                                &rgb,
                                self->max_brightness,
@@ -257,17 +381,14 @@ fbd_feedback_led_run (FbdFeedbackBase *base)
 
 
 static void
-fbd_feedback_led_end (FbdFeedbackBase *base)
+fbd_feedback_led_end (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackLed *self = FBD_FEEDBACK_LED (base);
   FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
   FbdDevLeds *dev = fbd_feedback_manager_get_dev_leds (manager);
-  FbdFeedbackLedColor color;
 
-  color = color_string_to_color (self->color, self->prefer_flash, NULL);
   if (dev)
-    fbd_dev_leds_stop (dev, color);
-  fbd_feedback_base_done (FBD_FEEDBACK_BASE (self));
+    fbd_dev_leds_stop (dev, playback);
+  fbd_feedback_playback_done (playback);
 }
 
 
@@ -297,11 +418,20 @@ fbd_feedback_led_finalize (GObject *object)
 
   g_clear_object (&self->settings);
   g_clear_pointer (&self->color, g_free);
+  g_clear_pointer (&self->steps, fbd_led_animation_unref);
+  g_clear_pointer (&self->shape_animation, fbd_led_animation_unref);
 
   G_OBJECT_CLASS (fbd_feedback_led_parent_class)->finalize (object);
 }
 
 
+static void
+json_serializable_iface_init (JsonSerializableIface *iface)
+{
+  iface->deserialize_property = fbd_feedback_led_serializable_deserialize_property;
+}
+
+
 static void
 fbd_feedback_led_class_init (FbdFeedbackLedClass *klass)
 {
@@ -312,6 +442,7 @@ fbd_feedback_led_class_init (FbdFeedbackLedClass *klass)
   object_class->get_property = fbd_feedback_led_get_property;
   object_class->finalize = fbd_feedback_led_finalize;
 
+  base_class->start_order = FBD_FEEDBACK_START_ORDER_LATE;
   base_class->run = fbd_feedback_led_run;
   base_class->end = fbd_feedback_led_end;
   base_class->is_available = fbd_feedback_led_is_available;
@@ -357,6 +488,28 @@ fbd_feedback_led_class_init (FbdFeedbackLedClass *klass)
     g_param_spec_uint ("max-brightness", "", "",
                        1, 100, 100,
                        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackLed:steps:
+   *
+   * A sequence of brightness and color steps that repeats until the
+   * feedback ends. If set it's used instead of the periodic pattern
+   * given by `frequency`.
+   */
+  props[PROP_STEPS] =
+    g_param_spec_boxed ("steps", "", "",
+                        FBD_TYPE_LED_ANIMATION,
+                        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackLed:shape:
+   *
+   * The shape of each period of the pattern given by `frequency`.
+   * LEDs with the kernel's `pattern` trigger let the kernel run it.
+   */
+  props[PROP_SHAPE] =
+    g_param_spec_enum ("shape", "", "",
+                       FBD_TYPE_FEEDBACK_LED_SHAPE,
+                       FBD_FEEDBACK_LED_SHAPE_BREATHE,
+                       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
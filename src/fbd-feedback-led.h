@@ -30,6 +30,22 @@ typedef enum _FbdFeedbackLedColor {
   FBD_FEEDBACK_LED_COLOR_FLASH = 5,
 } FbdFeedbackLedColor;
 
+/**
+ * FbdFeedbackLedShape:
+ * @FBD_FEEDBACK_LED_SHAPE_BREATHE: Fade in and out
+ * @FBD_FEEDBACK_LED_SHAPE_BLINK: Switch on and off
+ * @FBD_FEEDBACK_LED_SHAPE_FADE_IN: Fade in, stay on briefly and switch off
+ * @FBD_FEEDBACK_LED_SHAPE_HEARTBEAT: Two short pulses followed by a pause
+ *
+ * The shape of one period of a periodic LED feedback.
+ */
+typedef enum _FbdFeedbackLedShape {
+  FBD_FEEDBACK_LED_SHAPE_BREATHE = 0,
+  FBD_FEEDBACK_LED_SHAPE_BLINK = 1,
+  FBD_FEEDBACK_LED_SHAPE_FADE_IN = 2,
+  FBD_FEEDBACK_LED_SHAPE_HEARTBEAT = 3,
+} FbdFeedbackLedShape;
+
 typedef struct {
   guint r, g, b;
 } FbdLedRgbColor;
@@ -12,29 +12,61 @@
 #include "fbd.h"
 #include "fbd-dev-vibra.h"
 #include "fbd-dev-leds.h"
+#include "fbd-dispatcher.h"
+#include "fbd-duty-governor.h"
 #include "fbd-event.h"
+#include "fbd-feedback-led.h"
 #include "fbd-feedback-vibra.h"
 #include "fbd-feedback-vibra-pattern.h"
 #include "fbd-feedback-manager.h"
 #include "fbd-feedback-theme.h"
 #include "fbd-haptic-manager.h"
+#include "fbd-history.h"
+#include "fbd-power-monitor.h"
+#include "fbd-rate-limiter.h"
+#include "fbd-recorder.h"
+#include "fbd-stats.h"
 #include "fbd-theme-expander.h"
+#include "fbd-timer-wheel.h"
+#include "fbd-trace.h"
 
 #include <gmobile.h>
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-unix.h>
 #include <gudev/gudev.h>
 
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #define FEEDBACKD_KEY_PROFILE "profile"
 #define FEEDBACKD_KEY_THEME "theme"
 #define FEEDBACKD_KEY_ALLOW_IMPORTANT "allow-important"
+#define FEEDBACKD_KEY_BROADCAST_FEEDBACK_ENDED "broadcast-feedback-ended"
+#define FEEDBACKD_KEY_HAPTIC_GAIN "haptic-gain"
+#define FEEDBACKD_KEY_HAPTIC_DUTY_CYCLE "haptic-duty-cycle"
 
 #define APP_SCHEMA FEEDBACKD_SCHEMA_ID ".application"
 #define APP_PREFIX "/org/sigxcpu/feedbackd/application/"
 
 #define FEEDBACKD_THEME_VAR "FEEDBACK_THEME"
 
+#define APP_LEVEL_CACHE_SIZE 32
+
+#define TRIGGER_FEEDBACKS_MAX_EVENTS 64
+
+#define MAX_PEER_CONNECTIONS 64
+#define MAX_PEER_CONNECTIONS_PER_CLIENT 4
+
+/* Above any priority a theme can specify */
+#define FBD_VIBRA_PRIORITY_IMPORTANT 256
+
+/* How long paused haptic feedbacks wait for a motor to come back */
+#define VIBRA_REATTACH_TIMEOUT 3000
+
 /**
  * SECTION:fbd-feedback-manager
  * @short_description: The manager processing incoming events
@@ -46,6 +78,50 @@
 
 FbdDebugFlags fbd_debug_flags;
 
+typedef struct _FbdCoalesceEntry {
+  FbdEvent *event;
+  gint64    last;
+} FbdCoalesceEntry;
+
+typedef struct _FbdPeer {
+  /* Used as sender for the peer's events */
+  char *name;
+  /* DBus name of the client that opened the connection, if any */
+  char *opener;
+} FbdPeer;
+
+typedef struct _FbdPeerOpen {
+  FbdFeedbackManager *manager;
+  char               *opener;
+} FbdPeerOpen;
+
+typedef struct _FbdVibraActuator {
+  FbdDevVibra         *dev;
+  /* The playback of the haptic feedback currently using the motor */
+  FbdFeedbackPlayback *owner;
+  guint                owner_priority;
+  /* How much the duty cycle budget weakens the current feedback */
+  double               duty_scale;
+} FbdVibraActuator;
+
+/* How an event's feedbacks follow the global profile */
+typedef struct _FbdEventProfile {
+  /* The level the event gets if the global profile allows it */
+  FbdFeedbackProfileLevel  wanted;
+  /* The global profile doesn't limit the event */
+  gboolean                 important;
+  /* Feedbacks up to `wanted`, only kept if the event can be raised */
+  GArray                  *feedbacks;
+  char                    *sound_file;
+} FbdEventProfile;
+
+typedef struct _FbdAppLevel {
+  FbdFeedbackManager      *manager;
+  char                    *app_id;
+  GSettings               *settings;
+  FbdFeedbackProfileLevel  level;
+  GList                    link;
+} FbdAppLevel;
 
 typedef struct _FbdFeedbackManager {
   LfbGdbusFeedbackSkeleton parent;
@@ -53,22 +129,63 @@ typedef struct _FbdFeedbackManager {
   GSettings               *settings;
   FbdFeedbackProfileLevel  level;
   FbdFeedbackTheme        *theme;
+  FbdThemeExpander        *expander;
+  /* A theme being loaded in the background */
+  GCancellable            *theme_cancel;
+  guint                    preload_id;
+  guint                    caps_changed_id;
   guint                    next_id;
-  GStrv                    allow_important;
+  /* App ids allowed to use the important hint */
+  GHashTable              *allow_important;
+
+  /* Key: app_id, value: FbdAppLevel, most recently used first in app_levels_lru */
+  GHashTable              *app_levels;
+  GQueue                   app_levels_lru;
 
   /* Key: event id, value: event */
   GHashTable              *events;
-  /* Key: DBus name, value: watch_id */
+  /* Key: DBus name, value: set of the sender's events */
+  GHashTable              *sender_events;
+  /* Events by the highest level of their running feedbacks */
+  GHashTable              *level_events[FBD_FEEDBACK_PROFILE_N_PROFILES];
+  /* Key: DBus name of a sender with events, value: watch_id */
   GHashTable              *clients;
+  /* Key: sender, app_id and event name, value: FbdCoalesceEntry */
+  GHashTable              *coalesce;
+  FbdRateLimiter          *rate_limiter;
+  /* Key: peer to peer GDBusConnection, value: FbdPeer */
+  GHashTable              *peers;
+  /* Key: DBus name of a client, value: its (pending) peer connections */
+  GHashTable              *peer_openers;
+  guint                    next_peer;
+  /* Send FeedbackEnded to everyone instead of the event's sender */
+  gboolean                 broadcast_ended;
+  /* Applied to all haptic motors that support it */
+  double                   haptic_gain;
 
   /* org.sigxcpu.Feedbackd.Haptic */
   FbdHapticManager        *haptic_manager;
 
+  FbdPowerMonitor         *power_monitor;
+
   /* Hardware interaction */
   GUdevClient             *client;
-  FbdDevVibra             *vibra;
+  /* FbdVibraActuator, the first one is the default device */
+  GPtrArray               *vibras;
+  /* FbdVibraActuator without a device, their owners are paused */
+  GPtrArray               *suspended_vibras;
+  guint                    reattach_id;
   FbdDevSound             *sound;
   FbdDevLeds              *leds;
+  /* Devices still being probed and the method calls waiting for them */
+  guint                    n_probes;
+  GCancellable            *probe_cancel;
+  GQueue                   deferred_calls;
+
+  FbdHistory              *history;
+
+  /* When the daemon was last seen doing something */
+  gint64                   last_activity;
 } FbdFeedbackManager;
 
 static void fbd_feedback_manager_feedback_iface_init (LfbGdbusFeedbackIface *iface);
@@ -80,430 +197,2287 @@ G_DEFINE_TYPE_WITH_CODE (FbdFeedbackManager,
                            LFB_GDBUS_TYPE_FEEDBACK,
                            fbd_feedback_manager_feedback_iface_init));
 
+static void preempt_vibra (FbdFeedbackManager *self, FbdVibraActuator *actuator);
+
 static void
-device_changes (FbdFeedbackManager *self, gchar *action, GUdevDevice *device,
-                GUdevClient        *client)
+vibra_actuator_free (FbdVibraActuator *actuator)
 {
-  g_debug ("Device changes: action = %s, device = %s",
-           action, g_udev_device_get_sysfs_path (device));
+  g_clear_pointer (&actuator->owner, fbd_feedback_playback_unref);
+  g_clear_object (&actuator->dev);
+  g_free (actuator);
+}
 
-  if (g_strcmp0 (action, "remove") == 0 && self->vibra) {
-    GUdevDevice *dev = fbd_dev_vibra_get_device (self->vibra);
+static gboolean
+vibra_actuator_busy (FbdFeedbackManager *self, FbdVibraActuator *actuator)
+{
+  /* Haptic sessions keep the motor, even while it's stopped between updates */
+  if (self->haptic_manager &&
+      fbd_haptic_manager_has_session (self->haptic_manager, actuator->dev))
+    return TRUE;
 
-    if (g_strcmp0 (g_udev_device_get_sysfs_path (dev),
-                   g_udev_device_get_sysfs_path (device)) == 0) {
-      g_debug ("Vibra device %s got removed", g_udev_device_get_sysfs_path (dev));
-      g_clear_object (&self->vibra);
-    }
-  } else if (g_strcmp0 (action, "add") == 0) {
-    if (!g_strcmp0 (g_udev_device_get_property (device, FEEDBACKD_UDEV_ATTR), "vibra")) {
-      g_autoptr (GError) err = NULL;
+  /* A pattern might have no effect uploaded between steps */
+  if (actuator->owner && !fbd_feedback_playback_get_ended (actuator->owner))
+    return TRUE;
 
-      g_debug ("Found hotplugged vibra device at %s", g_udev_device_get_sysfs_path (device));
-      g_clear_object (&self->vibra);
-      self->vibra = fbd_dev_vibra_new (device, &err);
-      if (!self->vibra)
-        g_warning ("Failed to init vibra device: %s", err->message);
-    }
-  }
+  return fbd_dev_vibra_is_busy (actuator->dev);
 }
 
-static gchar *
-munge_app_id (const gchar *app_id)
+/* The gain is device wide so don't weaken whoever uses the motor next */
+static void
+restore_duty_scale (FbdFeedbackManager *self, FbdVibraActuator *actuator)
 {
-  gchar *id = g_strdup (app_id);
-  gint i;
-
-  g_strcanon (id,
-              "0123456789"
-              "abcdefghijklmnopqrstuvwxyz"
-              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-              "-",
-              '-');
-  for (i = 0; id[i] != '\0'; i++)
-    id[i] = g_ascii_tolower (id[i]);
+  if (actuator->duty_scale == 1.0)
+    return;
 
-  return id;
+  actuator->duty_scale = 1.0;
+  fbd_dev_vibra_set_gain (actuator->dev, self->haptic_gain);
 }
 
-static FbdFeedbackProfileLevel
-app_get_feedback_level (const gchar *app_id)
+
+static FbdVibraActuator *
+find_vibra_actuator (FbdFeedbackManager *self, FbdDevVibra *dev)
 {
-  g_autofree gchar *profile = NULL;
-  g_autofree gchar *munged_app_id = munge_app_id (app_id);
-  g_autofree gchar *path = g_strconcat (APP_PREFIX, munged_app_id, "/", NULL);
-  g_autoptr (GSettings) setting =  g_settings_new_with_path (APP_SCHEMA, path);
+  for (guint i = 0; self->vibras && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (actuator->dev == dev)
+      return actuator;
+  }
 
-  profile = g_settings_get_string (setting, FEEDBACKD_KEY_PROFILE);
-  g_debug ("%s uses app profile %s", app_id, profile);
-  return fbd_feedback_profile_level (profile);
+  return NULL;
 }
 
+static void probe_done (FbdFeedbackManager *self);
+static void capabilities_changed (FbdFeedbackManager *self);
+
 static void
-init_devices (FbdFeedbackManager *self)
+on_reattach_timeout (gpointer data)
 {
-  GList *l;
-  g_autolist (GUdevClient) devices = NULL;
-  g_autoptr(GError) err = NULL;
-
-  devices = g_udev_client_query_by_subsystem (self->client, "input");
+  FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (data);
 
-  for (l = devices; l != NULL; l = l->next) {
-    GUdevDevice *dev = l->data;
-
-    if (!g_strcmp0 (g_udev_device_get_property (dev, FEEDBACKD_UDEV_ATTR), "vibra")) {
-      g_debug ("Found vibra device");
-      self->vibra = fbd_dev_vibra_new (dev, &err);
-      if (!self->vibra) {
-        g_warning ("Failed to init vibra device: %s", err->message);
-        g_clear_error (&err);
-      }
-    }
-  }
-  if (!self->vibra)
-    g_debug ("No vibra capable device found");
+  self->reattach_id = 0;
 
-  self->leds = fbd_dev_leds_new (&err);
-  if (!self->leds) {
-    g_debug ("Failed to init leds device: %s", err->message);
-    g_clear_error (&err);
-  }
+  for (guint i = 0; i < self->suspended_vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->suspended_vibras, i);
 
-  self->sound = fbd_dev_sound_new (&err);
-  if (!self->sound) {
-    g_warning ("Failed to init sound device: %s", err->message);
-    g_clear_error (&err);
+    if (fbd_feedback_playback_get_paused (actuator->owner))
+      preempt_vibra (self, actuator);
   }
+  g_ptr_array_set_size (self->suspended_vibras, 0);
 }
 
-static void
-on_event_feedbacks_ended (FbdFeedbackManager *self, FbdEvent *event)
+/* Pause the actuator's feedback so it can continue on a reattached motor */
+static gboolean
+suspend_vibra (FbdFeedbackManager *self, FbdVibraActuator *actuator)
 {
-  guint event_id;
-
-  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
-  g_return_if_fail (FBD_IS_EVENT (event));
+  FbdFeedbackPlayback *owner = actuator->owner;
 
-  event_id = fbd_event_get_id (event);
-  event = g_hash_table_lookup (self->events, GUINT_TO_POINTER (event_id));
-  if (!event) {
-    g_warning ("Feedback ended for unknown event %d", event_id);
-    return;
-  }
+  if (fbd_feedback_playback_get_ended (owner))
+    return FALSE;
 
-  g_return_if_fail (fbd_event_get_feedbacks_ended (event));
+  fbd_feedback_vibra_pause (FBD_FEEDBACK_VIBRA (owner->feedback), owner);
+  if (!fbd_feedback_playback_get_paused (owner))
+    return FALSE;
 
-  lfb_gdbus_feedback_emit_feedback_ended (LFB_GDBUS_FEEDBACK (self), event_id,
-                                          fbd_event_get_end_reason (event));
+  g_clear_object (&actuator->dev);
+  g_ptr_array_add (self->suspended_vibras, actuator);
 
-  g_debug ("All feedbacks for event %d finished", event_id);
-  g_hash_table_remove (self->events, GUINT_TO_POINTER (event_id));
+  g_clear_handle_id (&self->reattach_id, fbd_timeout_remove);
+  self->reattach_id = fbd_timeout_add_once (VIBRA_REATTACH_TIMEOUT,
+                                            FBD_TIMER_WHEEL_SLACK_COARSE,
+                                            on_reattach_timeout,
+                                            self);
+  return TRUE;
 }
 
+/* Continue a paused feedback the new actuator can play */
 static void
-on_profile_changed (FbdFeedbackManager *self, GParamSpec *psepc, gpointer unused)
+resume_vibra (FbdFeedbackManager *self, FbdVibraActuator *actuator)
 {
-  const gchar *pname;
+  for (guint i = 0; i < self->suspended_vibras->len; i++) {
+    FbdVibraActuator *suspended = g_ptr_array_index (self->suspended_vibras, i);
+    FbdFeedbackVibra *fb;
 
-  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+    /* Ended while waiting for a motor */
+    if (!fbd_feedback_playback_get_paused (suspended->owner)) {
+      g_ptr_array_remove_index (self->suspended_vibras, i--);
+      continue;
+    }
 
-  pname = lfb_gdbus_feedback_get_profile (LFB_GDBUS_FEEDBACK (self));
+    fb = FBD_FEEDBACK_VIBRA (suspended->owner->feedback);
+    if (!fbd_feedback_vibra_supports_device (fb, actuator->dev))
+      continue;
 
-  if (!fbd_feedback_manager_set_profile (self, pname))
-    g_warning ("Invalid profile '%s'", pname);
+    actuator->owner = g_steal_pointer (&suspended->owner);
+    actuator->owner_priority = suspended->owner_priority;
+    g_ptr_array_remove_index (self->suspended_vibras, i);
+    fbd_feedback_vibra_resume (fb, actuator->owner, actuator->dev);
+    break;
+  }
+
+  if (self->suspended_vibras->len == 0)
+    g_clear_handle_id (&self->reattach_id, fbd_timeout_remove);
 }
 
-static void
-on_feedbackd_setting_changed (FbdFeedbackManager *self,
-                              const gchar        *key,
-                              GSettings          *settings)
+static gboolean
+remove_vibra (FbdFeedbackManager *self, GUdevDevice *device)
 {
-  g_autofree gchar *profile = NULL;
+  const char *sysfs_path = g_udev_device_get_sysfs_path (device);
 
-  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
-  g_return_if_fail (G_IS_SETTINGS (settings));
+  for (guint i = 0; i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+    GUdevDevice *dev = fbd_dev_vibra_get_device (actuator->dev);
 
-  if (g_str_equal (key, FEEDBACKD_KEY_PROFILE)) {
-    profile = g_settings_get_string (settings, key);
-    fbd_feedback_manager_set_profile (self, profile);
-  } else if (g_str_equal (key, FEEDBACKD_KEY_THEME)) {
-    fbd_feedback_manager_load_theme (self);
-  } else {
-    g_critical ("Unknown settings key '%s'", key);
-  }
-}
+    if (g_strcmp0 (g_udev_device_get_sysfs_path (dev), sysfs_path))
+      continue;
 
+    g_debug ("Vibra device %s got removed", sysfs_path);
+    if (self->haptic_manager &&
+        fbd_haptic_manager_get_dev_vibra (self->haptic_manager) == actuator->dev)
+      fbd_haptic_manager_end_feedback (self->haptic_manager);
 
-static gboolean
-app_is_important (FbdFeedbackManager *self, const char *app_id)
-{
-  if (!self->allow_important)
-    return FALSE;
+    actuator = g_ptr_array_steal_index (self->vibras, i);
+    fbd_duty_governor_remove (fbd_duty_governor_get_default (), actuator->dev);
+    if (actuator->owner && suspend_vibra (self, actuator))
+      return TRUE;
 
-  if (g_strv_contains ((const char *const *)self->allow_important, app_id))
+    if (actuator->owner)
+      preempt_vibra (self, actuator);
+    vibra_actuator_free (actuator);
     return TRUE;
+  }
 
   return FALSE;
 }
 
-
 static void
-on_feedbackd_allow_important_changed (FbdFeedbackManager *self,
-                                      const gchar        *key,
-                                      GSettings          *settings)
+add_vibra_actuator (FbdFeedbackManager *self, FbdDevVibra *vibra)
 {
-  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
-  g_return_if_fail (G_IS_SETTINGS (settings));
+  GUdevDevice *device = fbd_dev_vibra_get_device (vibra);
+  FbdVibraActuator *actuator;
 
-  g_strfreev (self->allow_important);
-  self->allow_important = g_settings_get_strv(self->settings, FEEDBACKD_KEY_ALLOW_IMPORTANT);
-}
+  /* Reprobe devices we already know */
+  remove_vibra (self, device);
 
+  actuator = g_new0 (FbdVibraActuator, 1);
+  actuator->dev = vibra;
+  actuator->duty_scale = 1.0;
+  g_ptr_array_add (self->vibras, actuator);
+  fbd_dev_vibra_set_gain (vibra, self->haptic_gain);
 
-static void
-on_client_vanished (GDBusConnection *connection,
-		    const gchar     *name,
-		    gpointer         user_data)
-{
-  FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (user_data);
-  GHashTableIter iter;
-  gpointer key, value;
-  FbdEvent *event;
-  GSList *l;
-  g_autoptr (GSList) events = NULL;
+  g_debug ("Using vibra device %s (actuator: %s)", g_udev_device_get_sysfs_path (device),
+           fbd_dev_vibra_get_actuator (vibra) ?: "none");
 
-  g_return_if_fail (name);
+  resume_vibra (self, actuator);
+}
 
-  g_debug ("Client %s vanished", name);
+static void
+add_vibra (FbdFeedbackManager *self, GUdevDevice *device)
+{
+  g_autoptr (GError) err = NULL;
+  FbdDevVibra *vibra;
 
-  /*
-   * Prepare a list of events to end feedback for so we don't modify
-   * the hash table in place when 'feedbacks-ended' fires.
-   */
-  g_hash_table_iter_init (&iter, self->events);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    event = FBD_EVENT (value);
-    if (!g_strcmp0 (fbd_event_get_sender (event), name))
-      events = g_slist_append (events, event);
+  vibra = fbd_dev_vibra_new (device, &err);
+  if (!vibra) {
+    g_warning ("Failed to init vibra device: %s", err->message);
+    return;
   }
 
-  for (l = events; l; l = l->next) {
-    event = l->data;
-    g_debug ("Ending event %s (%d) since %s vanished",
-             fbd_event_get_event (event),
-             fbd_event_get_id (event),
-             name);
-    fbd_event_end_feedbacks (event);
-  }
+  add_vibra_actuator (self, vibra);
+}
 
-  g_hash_table_remove (self->clients, name);
+static void
+vibra_changes (FbdFeedbackManager *self, const char *action, GUdevDevice *device)
+{
+  if (g_strcmp0 (action, "remove") == 0) {
+    remove_vibra (self, device);
+  } else if (g_strcmp0 (action, "add") == 0) {
+    g_debug ("Found hotplugged vibra device at %s", g_udev_device_get_sysfs_path (device));
+    add_vibra (self, device);
+  }
 }
 
 static void
-watch_client (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+leds_changes (FbdFeedbackManager *self, const char *action, GUdevDevice *device)
 {
-  guint watch_id;
-  GDBusConnection *conn = g_dbus_method_invocation_get_connection (invocation);
-  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+  g_autoptr (GError) err = NULL;
 
-  watch_id = g_bus_watch_name_on_connection (conn,
-					     sender,
-					     G_BUS_NAME_WATCHER_FLAGS_NONE,
-					     NULL,
-					     on_client_vanished,
-					     self,
-					     NULL);
-  g_hash_table_insert (self->clients, g_strdup (sender), GUINT_TO_POINTER (watch_id));
+  if (g_strcmp0 (action, "remove") == 0) {
+    if (self->leds)
+      fbd_dev_leds_remove_device (self->leds, device);
+  } else if (g_strcmp0 (action, "add") == 0) {
+    g_debug ("Found hotplugged LED at %s", g_udev_device_get_sysfs_path (device));
+    if (self->leds) {
+      fbd_dev_leds_add_device (self->leds, device);
+      return;
+    }
+
+    self->leds = fbd_dev_leds_new (&err);
+    if (!self->leds)
+      g_debug ("Failed to init leds device: %s", err->message);
+  }
 }
 
+/*
+ * The single udev monitor for all device classes. Untagged devices
+ * are dropped before anything else is looked at. udev adds the
+ * properties from its database to remove events so these match too.
+ */
 static void
-free_client_watch (gpointer data)
+device_changes (FbdFeedbackManager *self, gchar *action, GUdevDevice *device,
+                GUdevClient        *client)
 {
-  guint watch_id = GPOINTER_TO_UINT (data);
+  const char *type = g_udev_device_get_property (device, FEEDBACKD_UDEV_ATTR);
 
-  if (watch_id == 0)
+  if (type == NULL)
     return;
-  g_bus_unwatch_name (watch_id);
+
+  g_debug ("Device changes: action = %s, device = %s, type = %s",
+           action, g_udev_device_get_sysfs_path (device), type);
+
+  if (g_str_equal (type, FEEDBACKD_UDEV_VAL_VIBRA))
+    vibra_changes (self, action, device);
+  else if (g_str_equal (type, FEEDBACKD_UDEV_VAL_LED))
+    leds_changes (self, action, device);
+  else
+    return;
+
+  capabilities_changed (self);
 }
 
-static FbdFeedbackProfileLevel
-get_max_level (FbdFeedbackProfileLevel global_level,
-               FbdFeedbackProfileLevel app_level,
-               FbdFeedbackProfileLevel event_level)
+static gchar *
+munge_app_id (const gchar *app_id)
 {
-  FbdFeedbackProfileLevel level;
+  gchar *id = g_strdup (app_id);
+  gint i;
 
-  /* Per app configuration can only select a *lower* feedback level */
-  level = MIN (global_level, app_level);
-  /* A hint in an event can only select a *lower* feedback level */
-  level = MIN (level, event_level);
+  g_strcanon (id,
+              "0123456789"
+              "abcdefghijklmnopqrstuvwxyz"
+              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+              "-",
+              '-');
+  for (i = 0; id[i] != '\0'; i++)
+    id[i] = g_ascii_tolower (id[i]);
 
-  return level;
+  return id;
 }
 
-static gboolean
-parse_hints (GVariant                *hints,
-             FbdFeedbackProfileLevel *level,
-             gboolean                *hint_important,
-             char                   **hint_sound_file)
+static void
+on_app_profile_changed (FbdAppLevel *app_level, const char *key, GSettings *settings)
 {
-  const gchar *profile, *sound_file;
-  gboolean found, important;
-  g_auto (GVariantDict) dict = G_VARIANT_DICT_INIT (NULL);
+  g_autofree gchar *profile = g_settings_get_string (settings, FEEDBACKD_KEY_PROFILE);
+  FbdFeedbackProfileLevel level = fbd_feedback_profile_level (profile);
 
-  g_variant_dict_init (&dict, hints);
+  g_debug ("%s uses app profile %s", app_level->app_id, profile);
+  if (app_level->level == level)
+    return;
 
-  found = g_variant_dict_lookup (&dict, "profile", "&s", &profile);
-  if (level && found)
-    *level = fbd_feedback_profile_level (profile);
+  app_level->level = level;
+  /* Not set yet while reading the initial value */
+  if (app_level->manager)
+    capabilities_changed (app_level->manager);
+}
 
-  found = g_variant_dict_lookup (&dict, "important", "b", &important);
-  if (hint_important && found)
-    *hint_important = important;
+static void
+app_level_free (FbdAppLevel *app_level)
+{
+  g_signal_handlers_disconnect_by_data (app_level->settings, app_level);
+  g_clear_object (&app_level->settings);
+  g_ref_string_release (app_level->app_id);
+  g_free (app_level);
+}
 
-  found = g_variant_dict_lookup (&dict, "sound-file", "&s", &sound_file);
-  if (hint_sound_file && found)
-    *hint_sound_file = g_strdup (sound_file);
+static FbdAppLevel *
+app_level_new (FbdFeedbackManager *manager, const char *app_id)
+{
+  FbdAppLevel *app_level = g_new0 (FbdAppLevel, 1);
+  g_autofree gchar *munged_app_id = munge_app_id (app_id);
+  g_autofree gchar *path = g_strconcat (APP_PREFIX, munged_app_id, "/", NULL);
 
-  return TRUE;
+  app_level->app_id = g_ref_string_new_intern (app_id);
+  app_level->link.data = app_level;
+  app_level->settings = g_settings_new_with_path (APP_SCHEMA, path);
+  g_signal_connect_swapped (app_level->settings, "changed::" FEEDBACKD_KEY_PROFILE,
+                            G_CALLBACK (on_app_profile_changed), app_level);
+  /* Reading the key also makes sure we get change notifications */
+  on_app_profile_changed (app_level, FEEDBACKD_KEY_PROFILE, app_level->settings);
+  app_level->manager = manager;
+
+  return app_level;
 }
 
-/**
- * add_event_feedbacks:
- *
- * Add the suitable feedbacks to the event.
- *
- * Returns: `TRUE` if at least on feedback was added.
- */
-static gboolean
-add_event_feedbacks (FbdFeedbackManager      *self,
-                     FbdEvent                *event,
-                     GSList                  *feedbacks,
-                     FbdFeedbackProfileLevel  level,
-                     const char              *sound_file)
+static FbdFeedbackProfileLevel
+app_get_feedback_level (FbdFeedbackManager *self, const gchar *app_id)
 {
-  gboolean has_vibra = FALSE, has_sound = FALSE;
+  FbdAppLevel *app_level;
 
-  /* Synthesize sound event for custom sound */
-  if (sound_file && level >= FBD_FEEDBACK_PROFILE_LEVEL_FULL) {
-    g_autoptr (FbdFeedbackSound) sound = NULL;
+  app_level = g_hash_table_lookup (self->app_levels, app_id);
+  if (app_level) {
+    g_queue_unlink (&self->app_levels_lru, &app_level->link);
+    g_queue_push_head_link (&self->app_levels_lru, &app_level->link);
+    return app_level->level;
+  }
 
-    g_debug ("Using custom sound event '%s'", sound_file);
-    sound = fbd_feedback_sound_new_from_file_name (sound_file);
+  if (self->app_levels_lru.length >= APP_LEVEL_CACHE_SIZE) {
+    GList *oldest = g_queue_pop_tail_link (&self->app_levels_lru);
+    FbdAppLevel *evicted = oldest->data;
 
-    fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (sound));
-    has_sound = TRUE;
+    g_debug ("Evicting app level of %s", evicted->app_id);
+    g_hash_table_remove (self->app_levels, evicted->app_id);
   }
 
-  for (GSList *l = feedbacks; l; l = l->next) {
-    FbdFeedbackBase *fb = FBD_FEEDBACK_BASE (l->data);
+  app_level = app_level_new (self, app_id);
+  g_hash_table_insert (self->app_levels, app_level->app_id, app_level);
+  g_queue_push_head_link (&self->app_levels_lru, &app_level->link);
 
-    if (!fbd_feedback_is_available (FBD_FEEDBACK_BASE (fb)))
-      continue;
+  return app_level->level;
+}
 
-    if (FBD_IS_FEEDBACK_SOUND (fb) && has_sound)
-      continue;
+static void
+on_vibra_probed (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdFeedbackManager *self;
+  g_autoptr (GError) err = NULL;
+  FbdDevVibra *vibra;
+
+  vibra = fbd_dev_vibra_new_finish (res, &err);
+  if (!vibra && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = FBD_FEEDBACK_MANAGER (user_data);
+  if (vibra)
+    add_vibra_actuator (self, vibra);
+  else
+    g_warning ("Failed to init vibra device: %s", err->message);
+
+  probe_done (self);
+}
+
+static void
+on_leds_probed (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdFeedbackManager *self;
+  g_autoptr (GError) err = NULL;
+  FbdDevLeds *leds;
+
+  leds = fbd_dev_leds_new_finish (res, &err);
+  if (!leds && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = FBD_FEEDBACK_MANAGER (user_data);
+  g_clear_object (&self->leds);
+  self->leds = leds;
+  if (!self->leds)
+    g_debug ("Failed to init leds device: %s", err->message);
+
+  probe_done (self);
+}
+
+static void
+on_sound_probed (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdFeedbackManager *self;
+  g_autoptr (GError) err = NULL;
+  FbdDevSound *sound;
+
+  sound = fbd_dev_sound_new_finish (res, &err);
+  if (!sound && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = FBD_FEEDBACK_MANAGER (user_data);
+  self->sound = sound;
+  if (!self->sound)
+    g_warning ("Failed to init sound device: %s", err->message);
+
+  probe_done (self);
+}
+
+/**
+ * init_devices:
+ * @self: The feedback manager
+ *
+ * Probes the haptic motors, LEDs and the sound backend in parallel in
+ * worker threads so the daemon can take its bus name right away.
+ * Triggering feedbacks is deferred until all devices are probed, see
+ * `defer_call()`.
+ */
+static void
+init_devices (FbdFeedbackManager *self)
+{
+  g_autoptr (GUdevEnumerator) enumerator = g_udev_enumerator_new (self->client);
+  g_autolist (GUdevDevice) devices = NULL;
+
+  self->probe_cancel = g_cancellable_new ();
+
+  /* Only look at devices tagged in 72-feedbackd.rules */
+  g_udev_enumerator_add_match_subsystem (enumerator, "input");
+  g_udev_enumerator_add_match_property (enumerator, FEEDBACKD_UDEV_ATTR, FEEDBACKD_UDEV_VAL_VIBRA);
+  devices = g_udev_enumerator_execute (enumerator);
+
+  for (GList *l = devices; l != NULL; l = l->next) {
+    GUdevDevice *dev = l->data;
+
+    g_debug ("Found vibra device");
+    self->n_probes++;
+    fbd_dev_vibra_new_async (dev, self->probe_cancel, on_vibra_probed, self);
+  }
+  if (self->n_probes == 0)
+    g_debug ("No vibra capable device found");
+
+  self->n_probes++;
+  fbd_dev_leds_new_async (self->probe_cancel, on_leds_probed, self);
+
+  self->n_probes++;
+  fbd_dev_sound_new_async (self->probe_cancel, on_sound_probed, self);
+}
+
+static char *
+coalesce_key (const char *sender, const char *app_id, const char *event)
+{
+  return g_strjoin ("\n", sender, app_id, event, NULL);
+}
+
+
+static void
+coalesce_remove_event (FbdFeedbackManager *self, FbdEvent *event)
+{
+  g_autofree char *key = NULL;
+  FbdCoalesceEntry *entry;
+
+  if (g_hash_table_size (self->coalesce) == 0)
+    return;
+
+  key = coalesce_key (fbd_event_get_sender (event), fbd_event_get_app_id (event),
+                      fbd_event_get_event (event));
+  entry = g_hash_table_lookup (self->coalesce, key);
+  if (entry && entry->event == event)
+    g_hash_table_remove (self->coalesce, key);
+}
+
+static void
+event_profile_free (FbdEventProfile *profile)
+{
+  g_clear_pointer (&profile->feedbacks, g_array_unref);
+  g_free (profile->sound_file);
+  g_free (profile);
+}
+
+/**
+ * index_event:
+ * @self: The feedback manager
+ * @event: The event
+ * @level: The highest level of the event's feedbacks
+ *
+ * Adds an event that is already in `self->events` to the per sender
+ * and per level indices.
+ */
+static void
+index_event (FbdFeedbackManager *self, FbdEvent *event, FbdFeedbackProfileLevel level)
+{
+  const char *sender = fbd_event_get_sender (event);
+
+  if (sender) {
+    GHashTable *events = g_hash_table_lookup (self->sender_events, sender);
+
+    if (events == NULL) {
+      events = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (self->sender_events, g_ref_string_new_intern (sender), events);
+    }
+    g_hash_table_add (events, event);
+  }
+
+  g_object_set_data (G_OBJECT (event), "fbd-level", GUINT_TO_POINTER (level));
+  g_hash_table_add (self->level_events[level], event);
+}
+
+
+static void
+remove_event (FbdFeedbackManager *self, FbdEvent *event)
+{
+  const char *sender = fbd_event_get_sender (event);
+  guint level;
+
+  if (sender) {
+    GHashTable *events = g_hash_table_lookup (self->sender_events, sender);
+
+    /* The sender's last event is gone, no need to watch it anymore */
+    if (events && g_hash_table_remove (events, event) && g_hash_table_size (events) == 0) {
+      g_hash_table_remove (self->sender_events, sender);
+      g_hash_table_remove (self->clients, sender);
+    }
+  }
+
+  level = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (event), "fbd-level"));
+  g_hash_table_remove (self->level_events[level], event);
+
+  /* Drops the last reference */
+  g_hash_table_remove (self->events, GUINT_TO_POINTER (fbd_event_get_id (event)));
+  fbd_stats_set_active_events (fbd_stats_get_default (), g_hash_table_size (self->events));
+}
+
+
+static GList *
+get_sender_events (FbdFeedbackManager *self, const char *sender)
+{
+  GHashTable *events = g_hash_table_lookup (self->sender_events, sender);
+
+  if (events == NULL)
+    return NULL;
+
+  return g_hash_table_get_keys (events);
+}
+
+
+static void
+peer_free (FbdPeer *peer)
+{
+  g_free (peer->name);
+  g_free (peer->opener);
+  g_free (peer);
+}
+
+
+static guint
+get_n_opened_peers (FbdFeedbackManager *self, const char *opener)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->peer_openers, opener));
+}
+
+
+static void
+release_opened_peer (FbdFeedbackManager *self, const char *opener)
+{
+  guint n_peers = get_n_opened_peers (self, opener);
+
+  g_return_if_fail (n_peers);
+
+  if (n_peers == 1)
+    g_hash_table_remove (self->peer_openers, opener);
+  else
+    g_hash_table_insert (self->peer_openers, g_strdup (opener), GUINT_TO_POINTER (n_peers - 1));
+}
+
+
+static GDBusConnection *
+find_peer_connection (FbdFeedbackManager *self, const char *name)
+{
+  GHashTableIter iter;
+  gpointer conn;
+  FbdPeer *peer;
+
+  g_hash_table_iter_init (&iter, self->peers);
+  while (g_hash_table_iter_next (&iter, &conn, (gpointer *)&peer)) {
+    if (g_str_equal (peer->name, name))
+      return conn;
+  }
+
+  return NULL;
+}
+
+/**
+ * emit_feedback_ended:
+ * @self: The feedback manager
+ * @sender:(nullable): The sender that triggered the event
+ * @event_id: The event's id
+ * @reason: Why the event ended
+ *
+ * Tells the client that triggered an event that its feedbacks
+ * ended. The signal is sent to that client only so other clients
+ * aren't woken up for every event unless broadcasting is enabled via
+ * GSettings.
+ */
+static void
+emit_feedback_ended (FbdFeedbackManager *self,
+                     const char         *sender,
+                     guint               event_id,
+                     FbdEventEndReason   reason)
+{
+  GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (self);
+  g_autoptr (GError) err = NULL;
+  const char *destination = sender;
+  GDBusConnection *conn;
+
+  if (self->broadcast_ended || sender == NULL) {
+    lfb_gdbus_feedback_emit_feedback_ended (LFB_GDBUS_FEEDBACK (self), event_id, reason);
+    return;
+  }
+
+  /* Peers only get the signal on their own connection */
+  conn = find_peer_connection (self, sender);
+  if (conn) {
+    destination = NULL;
+  } else {
+    /* The message bus connection is exported first */
+    conn = g_dbus_interface_skeleton_get_connection (skeleton);
+    if (conn == NULL)
+      return;
+  }
+
+  if (!g_dbus_connection_emit_signal (conn,
+                                      destination,
+                                      g_dbus_interface_skeleton_get_object_path (skeleton),
+                                      g_dbus_interface_skeleton_get_info (skeleton)->name,
+                                      "FeedbackEnded",
+                                      g_variant_new ("(uu)", event_id, reason),
+                                      &err)) {
+    g_warning ("Failed to notify %s about end of event %u: %s", sender, event_id, err->message);
+  }
+}
+
+static void
+on_event_feedbacks_ended (FbdFeedbackManager *self, FbdEvent *event)
+{
+  guint event_id;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (FBD_IS_EVENT (event));
+
+  event_id = fbd_event_get_id (event);
+  event = g_hash_table_lookup (self->events, GUINT_TO_POINTER (event_id));
+  if (!event) {
+    g_warning ("Feedback ended for unknown event %d", event_id);
+    return;
+  }
+
+  g_return_if_fail (fbd_event_get_feedbacks_ended (event));
+
+  emit_feedback_ended (self, fbd_event_get_sender (event), event_id,
+                       fbd_event_get_end_reason (event));
+  fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_ENDED, NULL, NULL, NULL,
+                    NULL, 0, event_id, fbd_event_get_end_reason (event));
+  fbd_history_end (self->history, event_id, fbd_event_get_end_reason (event));
+
+  g_debug ("All feedbacks for event %d finished", event_id);
+  coalesce_remove_event (self, event);
+  remove_event (self, event);
+
+  for (guint i = 0; i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (actuator->owner && actuator->owner->event_id == event_id)
+      restore_duty_scale (self, actuator);
+  }
+}
+
+static gboolean
+emit_capabilities_changed (gpointer data)
+{
+  FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (data);
+
+  self->caps_changed_id = 0;
+  g_debug ("Event capabilities changed");
+  lfb_gdbus_feedback_emit_capabilities_changed (LFB_GDBUS_FEEDBACK (self));
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Tell clients to query event capabilities again. Bursts of changes
+ * (e.g. a theme update and hotplugged devices) result in a single
+ * signal. Nothing is sent while probing, that's done once probing
+ * finished.
+ */
+static void
+capabilities_changed (FbdFeedbackManager *self)
+{
+  if (self->n_probes || self->caps_changed_id)
+    return;
+
+  self->caps_changed_id = g_idle_add (emit_capabilities_changed, self);
+}
+
+static void
+on_profile_changed (FbdFeedbackManager *self, GParamSpec *psepc, gpointer unused)
+{
+  const gchar *pname;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+
+  pname = lfb_gdbus_feedback_get_profile (LFB_GDBUS_FEEDBACK (self));
+
+  if (!fbd_feedback_manager_set_profile (self, pname))
+    g_warning ("Invalid profile '%s'", pname);
+}
+
+static void
+on_feedbackd_setting_changed (FbdFeedbackManager *self,
+                              const gchar        *key,
+                              GSettings          *settings)
+{
+  g_autofree gchar *profile = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  if (g_str_equal (key, FEEDBACKD_KEY_PROFILE)) {
+    profile = g_settings_get_string (settings, key);
+    fbd_feedback_manager_set_profile (self, profile);
+  } else if (g_str_equal (key, FEEDBACKD_KEY_THEME)) {
+    fbd_feedback_manager_load_theme (self);
+  } else {
+    g_critical ("Unknown settings key '%s'", key);
+  }
+}
+
+
+static gboolean
+app_is_important (FbdFeedbackManager *self, const char *app_id)
+{
+  return g_hash_table_contains (self->allow_important, app_id);
+}
+
+
+static void
+on_feedbackd_allow_important_changed (FbdFeedbackManager *self,
+                                      const gchar        *key,
+                                      GSettings          *settings)
+{
+  g_auto (GStrv) app_ids = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  app_ids = g_settings_get_strv (self->settings, FEEDBACKD_KEY_ALLOW_IMPORTANT);
+  g_hash_table_remove_all (self->allow_important);
+  for (int i = 0; app_ids[i]; i++)
+    g_hash_table_add (self->allow_important, g_ref_string_new_intern (app_ids[i]));
+}
+
+
+static void
+on_feedbackd_broadcast_feedback_ended_changed (FbdFeedbackManager *self,
+                                               const gchar        *key,
+                                               GSettings          *settings)
+{
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  self->broadcast_ended = g_settings_get_boolean (self->settings,
+                                                  FEEDBACKD_KEY_BROADCAST_FEEDBACK_ENDED);
+}
+
+
+static void
+on_feedbackd_haptic_duty_cycle_changed (FbdFeedbackManager *self,
+                                        const gchar        *key,
+                                        GSettings          *settings)
+{
+  double budget;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  budget = g_settings_get_double (self->settings, FEEDBACKD_KEY_HAPTIC_DUTY_CYCLE);
+  fbd_duty_governor_set_budget (fbd_duty_governor_get_default (), MAX (budget, 0.01));
+}
+
+
+static void
+on_feedbackd_haptic_gain_changed (FbdFeedbackManager *self,
+                                  const gchar        *key,
+                                  GSettings          *settings)
+{
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+  g_return_if_fail (G_IS_SETTINGS (settings));
+
+  self->haptic_gain = g_settings_get_double (self->settings, FEEDBACKD_KEY_HAPTIC_GAIN);
+  g_debug ("Haptic gain: %f", self->haptic_gain);
+
+  /* Playing effects follow right away */
+  for (guint i = 0; self->vibras && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    fbd_dev_vibra_set_gain (actuator->dev, self->haptic_gain * actuator->duty_scale);
+  }
+}
+
+
+static void
+end_client_events (FbdFeedbackManager *self, const char *name)
+{
+  g_autoptr (GList) events = NULL;
+
+  /*
+   * Copy the sender's events so we don't modify the index in place
+   * when 'feedbacks-ended' fires.
+   */
+  events = get_sender_events (self, name);
+  g_list_foreach (events, (GFunc)g_object_ref, NULL);
+
+  for (GList *l = events; l; l = l->next) {
+    g_autoptr (FbdEvent) event = l->data;
+
+    g_debug ("Ending event %s (%d) of %s",
+             fbd_event_get_event (event),
+             fbd_event_get_id (event),
+             name);
+    fbd_event_end_feedbacks (event);
+  }
+}
+
+static void
+on_client_vanished (GDBusConnection *connection,
+		    const gchar     *name,
+		    gpointer         user_data)
+{
+  FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (user_data);
+
+  g_return_if_fail (name);
+
+  g_debug ("Client %s vanished", name);
+
+  end_client_events (self, name);
+  g_hash_table_remove (self->clients, name);
+}
+
+/*
+ * Peer to peer connections have no sender so use the name we picked
+ * for the peer instead.
+ */
+static const char *
+get_sender (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+{
+  GDBusConnection *conn = g_dbus_method_invocation_get_connection (invocation);
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+
+  FbdPeer *peer;
+
+  if (sender)
+    return sender;
+
+  peer = g_hash_table_lookup (self->peers, conn);
+  return peer ? peer->name : NULL;
+}
+
+/*
+ * Requests on peer connections are charged to the client that opened
+ * them so opening more connections doesn't raise the client's limit.
+ */
+static const char *
+get_rate_limit_sender (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+{
+  GDBusConnection *conn = g_dbus_method_invocation_get_connection (invocation);
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+  FbdPeer *peer;
+
+  if (sender)
+    return sender;
+
+  peer = g_hash_table_lookup (self->peers, conn);
+  if (peer == NULL)
+    return NULL;
+
+  return peer->opener ?: peer->name;
+}
+
+/* Clients may only end their own events */
+static FbdEvent *
+lookup_caller_event (FbdFeedbackManager *self, GDBusMethodInvocation *invocation, guint event_id)
+{
+  FbdEvent *event = g_hash_table_lookup (self->events, GUINT_TO_POINTER (event_id));
+
+  if (event == NULL)
+    return NULL;
+
+  if (g_strcmp0 (fbd_event_get_sender (event), get_sender (self, invocation)))
+    return NULL;
+
+  return event;
+}
+
+/**
+ * watch_client:
+ * @self: The feedback manager
+ * @invocation: The method call that started events
+ *
+ * Watches the caller so its events can be ended when it vanishes.
+ * There's a single watch per sender that lives as long as the sender
+ * has running events (see `remove_event()`) so triggering events in a
+ * row doesn't cause any bus traffic.
+ */
+static void
+watch_client (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+{
+  guint watch_id;
+  GDBusConnection *conn = g_dbus_method_invocation_get_connection (invocation);
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+
+  /* Peers are handled when their connection closes */
+  if (sender == NULL)
+    return;
+
+  if (g_hash_table_contains (self->clients, sender))
+    return;
+
+  /* All events might have ended already */
+  if (!g_hash_table_contains (self->sender_events, sender))
+    return;
+
+  watch_id = g_bus_watch_name_on_connection (conn,
+					     sender,
+					     G_BUS_NAME_WATCHER_FLAGS_NONE,
+					     NULL,
+					     on_client_vanished,
+					     self,
+					     NULL);
+  g_hash_table_insert (self->clients, g_ref_string_new_intern (sender),
+                       GUINT_TO_POINTER (watch_id));
+  fbd_stats_object_new (fbd_stats_get_default (), FBD_STATS_OBJECT_CLIENT_WATCH, 0);
+}
+
+static void
+free_client_watch (gpointer data)
+{
+  guint watch_id = GPOINTER_TO_UINT (data);
+
+  if (watch_id == 0)
+    return;
+  g_bus_unwatch_name (watch_id);
+  fbd_stats_object_free (fbd_stats_get_default (), FBD_STATS_OBJECT_CLIENT_WATCH, 0);
+}
+
+static FbdFeedbackProfileLevel
+get_max_level (FbdFeedbackProfileLevel global_level,
+               FbdFeedbackProfileLevel app_level,
+               FbdFeedbackProfileLevel event_level)
+{
+  FbdFeedbackProfileLevel level;
+
+  /* Per app configuration can only select a *lower* feedback level */
+  level = MIN (global_level, app_level);
+  /* A hint in an event can only select a *lower* feedback level */
+  level = MIN (level, event_level);
+
+  return level;
+}
+
+static gboolean
+parse_hints (GVariant                *hints,
+             FbdFeedbackProfileLevel *level,
+             gboolean                *hint_important,
+             char                   **hint_sound_file,
+             gboolean                *hint_fire_and_forget,
+             guint                   *hint_deadline)
+{
+  const gchar *profile, *sound_file;
+  gboolean found, important, fire_and_forget;
+  guint deadline;
+  g_auto (GVariantDict) dict = G_VARIANT_DICT_INIT (NULL);
+
+  g_variant_dict_init (&dict, hints);
+
+  found = g_variant_dict_lookup (&dict, "profile", "&s", &profile);
+  if (level && found)
+    *level = fbd_feedback_profile_level (profile);
+
+  found = g_variant_dict_lookup (&dict, "important", "b", &important);
+  if (hint_important && found)
+    *hint_important = important;
+
+  found = g_variant_dict_lookup (&dict, "sound-file", "&s", &sound_file);
+  if (hint_sound_file && found)
+    *hint_sound_file = g_strdup (sound_file);
+
+  found = g_variant_dict_lookup (&dict, "fire-and-forget", "b", &fire_and_forget);
+  if (hint_fire_and_forget && found)
+    *hint_fire_and_forget = fire_and_forget;
+
+  found = g_variant_dict_lookup (&dict, "deadline-ms", "u", &deadline);
+  if (hint_deadline && found)
+    *hint_deadline = deadline;
+
+  return TRUE;
+}
+
+static void
+preempt_vibra (FbdFeedbackManager *self, FbdVibraActuator *actuator)
+{
+  g_autoptr (FbdFeedbackPlayback) owner = g_steal_pointer (&actuator->owner);
+  FbdEvent *event = g_hash_table_lookup (self->events, GUINT_TO_POINTER (owner->event_id));
+
+  g_debug ("Preempting haptic feedback for '%s'", fbd_feedback_get_event_name (owner->feedback));
+
+  /* Detach the playback first so looping events don't restart it */
+  if (event)
+    fbd_event_remove_playback (event, owner);
+  fbd_feedback_playback_end (owner);
+}
+
+/**
+ * apply_duty_budget:
+ * @self: The feedback manager
+ * @actuator: The motor the feedback is about to use
+ * @important: Whether the event has the important hint set
+ *
+ * Weakens haptic feedback via the motor's gain once the motor used up
+ * a good part of its duty cycle budget. Important events always get
+ * full strength.
+ *
+ * Returns: `FALSE` if the budget is used up and the feedback should
+ *   be dropped
+ */
+static gboolean
+apply_duty_budget (FbdFeedbackManager *self, FbdVibraActuator *actuator, gboolean important)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  double scale = 1.0;
+
+  if (!important)
+    scale = fbd_duty_governor_get_scale (fbd_duty_governor_get_default (), actuator->dev);
+
+  if (scale == 0.0) {
+    g_debug ("Duty cycle budget used up, dropping haptic feedback");
+    fbd_stats_count (stats, FBD_STATS_COUNTER_DUTY_DROPPED);
+    return FALSE;
+  }
+
+  actuator->duty_scale = scale;
+  if (fbd_dev_vibra_set_gain (actuator->dev, self->haptic_gain * scale) && scale < 1.0)
+    fbd_stats_count (stats, FBD_STATS_COUNTER_DUTY_SCALED);
+
+  return TRUE;
+}
+
+/**
+ * claim_vibra:
+ * @self: The feedback manager
+ * @playback: The playback of the haptic feedback that wants to use the motor
+ * @important: Whether the event has the important hint set
+ *
+ * Arbitrates access to the haptic motors. Of the motors matching the
+ * feedback's actuator tag and capabilities an idle one is picked,
+ * preferring motors not used by the haptic interface. If all are busy
+ * the running feedback with the lowest priority is preempted if the new
+ * one has a higher priority, otherwise the new feedback is dropped.
+ * Important events use the highest priority. Feedback is also dropped
+ * or weakened when the motor is over its duty cycle budget.
+ *
+ * Returns: `TRUE` if `playback` may use a haptic motor.
+ */
+static gboolean
+claim_vibra (FbdFeedbackManager *self, FbdFeedbackPlayback *playback, gboolean important)
+{
+  FbdFeedbackVibra *fb = FBD_FEEDBACK_VIBRA (playback->feedback);
+  guint priority = important ? FBD_VIBRA_PRIORITY_IMPORTANT : fbd_feedback_vibra_get_priority (fb);
+  FbdDevVibra *haptic_dev = NULL;
+  FbdVibraActuator *idle = NULL, *shared = NULL, *victim = NULL;
+
+  if (self->haptic_manager)
+    haptic_dev = fbd_haptic_manager_get_dev_vibra (self->haptic_manager);
+
+  for (guint i = 0; i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (!fbd_feedback_vibra_supports_device (fb, actuator->dev))
+      continue;
+
+    if (vibra_actuator_busy (self, actuator)) {
+      if (actuator->owner && priority > actuator->owner_priority &&
+          (victim == NULL || actuator->owner_priority < victim->owner_priority))
+        victim = actuator;
+      continue;
+    }
+
+    if (actuator->dev == haptic_dev) {
+      shared = actuator;
+      continue;
+    }
+
+    idle = actuator;
+    break;
+  }
+
+  if (idle == NULL)
+    idle = shared;
+
+  if (idle == NULL) {
+    if (victim == NULL) {
+      g_debug ("Haptic busy, dropping feedback for '%s'",
+               fbd_feedback_get_event_name (FBD_FEEDBACK_BASE (fb)));
+      fbd_stats_count (fbd_stats_get_default (), FBD_STATS_COUNTER_FEEDBACKS_BUSY);
+      return FALSE;
+    }
+    if (!apply_duty_budget (self, victim, important))
+      return FALSE;
+    preempt_vibra (self, victim);
+    idle = victim;
+  } else {
+    /* Events take priority over the haptic interface, it restores the gain when ending */
+    if (idle->dev == haptic_dev)
+      fbd_haptic_manager_end_feedback (self->haptic_manager);
+
+    if (!apply_duty_budget (self, idle, important))
+      return FALSE;
+  }
+
+  fbd_feedback_playback_set_device (playback, idle->dev);
+  g_clear_pointer (&idle->owner, fbd_feedback_playback_unref);
+  idle->owner = fbd_feedback_playback_ref (playback);
+  idle->owner_priority = priority;
+
+  return TRUE;
+}
+
+/**
+ * meets_deadline:
+ * @deadline: The deadline in milliseconds, `0` if there's none
+ *
+ * Checks whether a feedback is expected to start within the client's
+ * deadline. Feedbacks that would start too late are skipped so the
+ * ones that are on time aren't accompanied by e.g. a late sound.
+ *
+ * Returns: `TRUE` if the feedback should be played
+ */
+static gboolean
+meets_deadline (FbdFeedbackBase *feedback, guint deadline)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+
+  if (deadline == 0)
+    return TRUE;
+
+  if (fbd_stats_check_deadline (stats, G_OBJECT_TYPE (feedback), (gint64)deadline * 1000))
+    return TRUE;
+
+  g_debug ("Skipping %s, it would miss the deadline of %ums",
+           G_OBJECT_TYPE_NAME (feedback), deadline);
+  fbd_stats_count (stats, FBD_STATS_COUNTER_DEADLINE_SKIPPED);
+  return FALSE;
+}
+
+/**
+ * find_predecessor:
+ * @feedbacks: The theme entries
+ * @playbacks: The playbacks created for the entries, `NULL` for skipped ones
+ * @after: The index of the entry to follow
+ *
+ * Finds the playback an entry's playback follows. If the entry's
+ * predecessor got skipped (e.g. because it's not available) the
+ * entry follows the one before it.
+ *
+ * Returns:(transfer none)(nullable): The playback to follow
+ */
+static FbdFeedbackPlayback *
+find_predecessor (GArray *feedbacks, FbdFeedbackPlayback **playbacks, int after)
+{
+  while (after >= 0 && playbacks[after] == NULL)
+    after = g_array_index (feedbacks, FbdFeedbackThemeEntry, after).after;
+
+  return after >= 0 ? playbacks[after] : NULL;
+}
+
+
+static FbdEventCapabilities
+get_feedback_kind (FbdFeedbackBase *feedback)
+{
+  if (FBD_IS_FEEDBACK_SOUND (feedback))
+    return FBD_EVENT_CAPABILITY_SOUND;
+  if (FBD_IS_FEEDBACK_VIBRA (feedback))
+    return FBD_EVENT_CAPABILITY_HAPTIC;
+  if (FBD_IS_FEEDBACK_LED (feedback))
+    return FBD_EVENT_CAPABILITY_LED;
+
+  return FBD_EVENT_CAPABILITY_NONE;
+}
+
+
+static FbdEventCapabilities
+get_event_kinds (FbdEvent *event)
+{
+  FbdEventCapabilities kinds = FBD_EVENT_CAPABILITY_NONE;
+
+  for (GSList *l = fbd_event_get_playbacks (event); l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
+
+    kinds |= get_feedback_kind (playback->feedback);
+  }
+
+  return kinds;
+}
+
+
+/**
+ * add_event_feedbacks:
+ *
+ * Add the suitable feedbacks to the event.
+ *
+ * Returns: `TRUE` if at least on feedback was added.
+ */
+static gboolean
+add_event_feedbacks (FbdFeedbackManager      *self,
+                     FbdEvent                *event,
+                     GArray                  *feedbacks,
+                     FbdFeedbackProfileLevel  level,
+                     gboolean                 important,
+                     const char              *sound_file,
+                     guint                    deadline)
+{
+  gboolean has_vibra = FALSE, has_sound = FALSE;
+  guint len = feedbacks ? feedbacks->len : 0;
+  FbdFeedbackPlayback **added = g_newa (FbdFeedbackPlayback *, MAX (len, 1));
+
+  memset (added, 0, sizeof (FbdFeedbackPlayback *) * len);
+
+  /* Synthesize sound event for custom sound */
+  if (sound_file && level >= FBD_FEEDBACK_PROFILE_LEVEL_FULL) {
+    g_autoptr (FbdFeedbackSound) sound = NULL;
+    FbdFeedbackPlayback *playback;
+
+    g_debug ("Using custom sound event '%s'", sound_file);
+    sound = fbd_feedback_sound_new_from_file_name (sound_file);
+
+    /* Skipping the custom sound also skips the theme's sound */
+    has_sound = TRUE;
+    if (meets_deadline (FBD_FEEDBACK_BASE (sound), deadline)) {
+      playback = fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (sound),
+                                         FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+      fbd_feedback_playback_set_deadline (playback, deadline);
+    }
+  }
+
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+    g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+    if (!fbd_feedback_is_available (entry->feedback))
+      continue;
+
+    if (FBD_IS_FEEDBACK_SOUND (entry->feedback) && has_sound)
+      continue;
+
+    if (!meets_deadline (entry->feedback, deadline))
+      continue;
+
+    playback = fbd_feedback_playback_new (entry->feedback, entry->level);
+    fbd_feedback_playback_set_deadline (playback, deadline);
 
     /* Handle one haptic feedback at a time. In practice haptics can handle multiple
      * patterns but none of the devices supports this atm */
-    /* TODO: should respect priorities */
-    if (FBD_IS_FEEDBACK_VIBRA (fb)) {
-      if (fbd_dev_vibra_is_busy (self->vibra))
+    if (FBD_IS_FEEDBACK_VIBRA (entry->feedback)) {
+      if (has_vibra || !claim_vibra (self, playback, important))
+        continue;
+      has_vibra = TRUE;
+    }
+
+    fbd_feedback_playback_set_after (playback, find_predecessor (feedbacks, added, entry->after));
+    fbd_event_add_playback (event, playback);
+    added[i] = playback;
+  }
+
+  return (fbd_event_get_playbacks (event) != NULL);
+}
+
+/**
+ * run_fire_and_forget:
+ *
+ * Run the suitable feedbacks without tracking them via an event.
+ * @kinds is set to the kinds of feedback that were run.
+ *
+ * Returns: `TRUE` if at least one feedback was run.
+ */
+static gboolean
+run_fire_and_forget (FbdFeedbackManager   *self,
+                     GArray               *feedbacks,
+                     gboolean              important,
+                     guint                 deadline,
+                     FbdEventCapabilities *kinds)
+{
+  g_autoptr (GPtrArray) playbacks = NULL;
+  gboolean has_vibra = FALSE;
+
+  playbacks = g_ptr_array_new_with_free_func ((GDestroyNotify)fbd_feedback_playback_unref);
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+    g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+    if (!fbd_feedback_is_available (entry->feedback))
+      continue;
+
+    if (!meets_deadline (entry->feedback, deadline))
+      continue;
+
+    playback = fbd_feedback_playback_new (entry->feedback, entry->level);
+    fbd_feedback_playback_set_deadline (playback, deadline);
+
+    if (FBD_IS_FEEDBACK_VIBRA (entry->feedback)) {
+      if (has_vibra || !claim_vibra (self, playback, important))
         continue;
       has_vibra = TRUE;
     }
 
-    /* Events take priority over the haptic interface */
-    if (has_vibra)
-      fbd_haptic_manager_end_feedback (self->haptic_manager);
+    *kinds |= get_feedback_kind (entry->feedback);
+    g_ptr_array_add (playbacks, g_steal_pointer (&playback));
+  }
+
+  /* The playbacks keep themselves alive until they're done */
+  fbd_feedback_playbacks_run (playbacks);
+
+  return playbacks->len > 0;
+}
+
+
+typedef struct _FbdTriggerArgs {
+  const char              *app_id;
+  const char              *event;
+  int                      timeout;
+  FbdFeedbackProfileLevel  hint_level;
+  gboolean                 hint_important;
+  gboolean                 hint_fire_and_forget;
+  guint                    hint_deadline;
+  char                    *sound_file;
+  /* Whether the client handles FB_EVENT_ID_NO_FEEDBACK */
+  gboolean                 no_feedback_id;
+} FbdTriggerArgs;
+
+
+static void
+trigger_args_clear (FbdTriggerArgs *args)
+{
+  g_clear_pointer (&args->sound_file, g_free);
+}
+
+
+static gboolean
+trigger_args_init (FbdTriggerArgs *args,
+                   const char     *app_id,
+                   const char     *event,
+                   int             timeout,
+                   GError        **err)
+{
+  if (!strlen (app_id)) {
+    g_set_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid app id %s", app_id);
+    return FALSE;
+  }
+
+  if (!strlen (event)) {
+    g_set_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid event %s", event);
+    return FALSE;
+  }
+
+  args->app_id = app_id;
+  args->event = event;
+  args->hint_level = FBD_FEEDBACK_PROFILE_LEVEL_FULL;
+  args->timeout = MAX (timeout, -1);
+
+  return TRUE;
+}
+
+
+static gboolean
+trigger_args_parse (FbdTriggerArgs *args,
+                    const char     *app_id,
+                    const char     *event,
+                    GVariant       *hints,
+                    int             timeout,
+                    GError        **err)
+{
+  if (!trigger_args_init (args, app_id, event, timeout, err))
+    return FALSE;
+
+  if (!parse_hints (hints, &args->hint_level, &args->hint_important, &args->sound_file,
+                    &args->hint_fire_and_forget, &args->hint_deadline)) {
+    g_set_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid hints");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Like `trigger_args_parse()` but for TriggerFeedbackEx's fixed
+ * hints. The dictionary is only looked at if it has entries.
+ */
+static gboolean
+trigger_args_parse_ex (FbdTriggerArgs *args,
+                       const char     *app_id,
+                       const char     *event,
+                       GVariant       *hints,
+                       GVariant       *extra_hints,
+                       int             timeout,
+                       GError        **err)
+{
+  const char *sound_file;
+  guint level, flags;
+
+  if (!trigger_args_init (args, app_id, event, timeout, err))
+    return FALSE;
+
+  /* The method is newer than the reserved id so all its clients handle it */
+  args->no_feedback_id = TRUE;
+
+  g_variant_get (hints, "(uuu&s)", &level, &flags, &args->hint_deadline, &sound_file);
+  if (level > FB_TRIGGER_LEVEL_FULL) {
+    g_set_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid level %u", level);
+    return FALSE;
+  }
+
+  /* The levels follow FbdFeedbackProfileLevel, shifted by one for the default */
+  if (level != FB_TRIGGER_LEVEL_DEFAULT)
+    args->hint_level = level - 1;
+  args->hint_important = !!(flags & FB_TRIGGER_FLAG_IMPORTANT);
+  args->hint_fire_and_forget = !!(flags & FB_TRIGGER_FLAG_FIRE_AND_FORGET);
+  if (*sound_file)
+    args->sound_file = g_strdup (sound_file);
+
+  if (g_variant_n_children (extra_hints) &&
+      !parse_hints (extra_hints, &args->hint_level, &args->hint_important, &args->sound_file,
+                    &args->hint_fire_and_forget, &args->hint_deadline)) {
+    g_set_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid hints");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* The hints as passed to TriggerFeedback so recordings can be replayed */
+static GVariant *
+trigger_args_to_hints (FbdTriggerArgs *args)
+{
+  GVariantBuilder hints;
+
+  g_variant_builder_init (&hints, G_VARIANT_TYPE ("a{sv}"));
+  if (args->hint_level != FBD_FEEDBACK_PROFILE_LEVEL_FULL) {
+    const char *profile = fbd_feedback_profile_level_to_string (args->hint_level);
+
+    g_variant_builder_add (&hints, "{sv}", "profile", g_variant_new_string (profile));
+  }
+  if (args->hint_important)
+    g_variant_builder_add (&hints, "{sv}", "important", g_variant_new_boolean (TRUE));
+  if (args->hint_fire_and_forget)
+    g_variant_builder_add (&hints, "{sv}", "fire-and-forget", g_variant_new_boolean (TRUE));
+  if (args->hint_deadline) {
+    g_variant_builder_add (&hints, "{sv}", "deadline-ms",
+                           g_variant_new_uint32 (args->hint_deadline));
+  }
+  if (args->sound_file) {
+    g_variant_builder_add (&hints, "{sv}", "sound-file",
+                           g_variant_new_string (args->sound_file));
+  }
+
+  return g_variant_builder_end (&hints);
+}
+
+typedef struct _FbdTriggerResult {
+  FbdEvent          *event;
+  guint              event_id;
+  FbdEventEndReason  reason;
+  gboolean           coalesced;
+} FbdTriggerResult;
+
+
+static void
+trigger_result_clear (FbdTriggerResult *result)
+{
+  g_clear_object (&result->event);
+}
+
+/**
+ * attach_event_profile:
+ * @self: The feedback manager
+ * @event: The new event
+ * @args: The event's arguments
+ * @level: The event's effective level
+ * @important: Whether the event may override the global profile
+ *
+ * Remembers what the event needs when the global profile changes. For
+ * looping events the global profile keeps from running at their full
+ * level the feedbacks are looked up now so they can be started later
+ * without another lookup.
+ */
+static void
+attach_event_profile (FbdFeedbackManager      *self,
+                      FbdEvent                *event,
+                      FbdTriggerArgs          *args,
+                      FbdFeedbackProfileLevel  level,
+                      gboolean                 important)
+{
+  FbdEventProfile *profile = g_new0 (FbdEventProfile, 1);
+
+  profile->important = important;
+  if (important)
+    profile->wanted = level;
+  else
+    profile->wanted = MIN (app_get_feedback_level (self, args->app_id), args->hint_level);
+
+  if (profile->wanted > level && args->timeout != FBD_EVENT_TIMEOUT_ONESHOT) {
+    GArray *feedbacks;
+
+    feedbacks = fbd_feedback_theme_lookup_feedbacks (self->theme, profile->wanted, args->event);
+    if (feedbacks)
+      profile->feedbacks = g_array_ref (feedbacks);
+    profile->sound_file = g_strdup (args->sound_file);
+  }
+
+  g_object_set_data_full (G_OBJECT (event), "fbd-profile", profile,
+                          (GDestroyNotify)event_profile_free);
+}
+
+
+static guint
+next_event_id (FbdFeedbackManager *self)
+{
+  /* Skip the reserved id when wrapping around */
+  if (self->next_id == FB_EVENT_ID_NO_FEEDBACK)
+    self->next_id++;
+
+  return self->next_id++;
+}
+
+
+/*
+ * Clients that know about it get the reserved id for events without
+ * feedback and no FeedbackEnded. Older ones expect a real event id
+ * and the signal.
+ */
+static void
+set_not_found (FbdFeedbackManager *self, FbdTriggerArgs *args, FbdTriggerResult *result)
+{
+  fbd_stats_count (fbd_stats_get_default (), FBD_STATS_COUNTER_EVENTS_NOT_FOUND);
+  result->event_id = args->no_feedback_id ? FB_EVENT_ID_NO_FEEDBACK : next_event_id (self);
+  result->reason = FBD_EVENT_END_REASON_NOT_FOUND;
+}
+
+
+/* Whether some feedbacks only start once others ended */
+static gboolean
+has_sequence (GArray *feedbacks)
+{
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    if (g_array_index (feedbacks, FbdFeedbackThemeEntry, i).after >= 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static guint
+get_coalesce_window (GArray *feedbacks)
+{
+  guint window = 0;
+
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+
+    window = MAX (window, fbd_feedback_get_coalesce_window (entry->feedback));
+  }
+
+  return window;
+}
+
+
+/* Whether the theme marks all of the event's feedbacks as fire and forget */
+static gboolean
+get_fire_and_forget (GArray *feedbacks)
+{
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+
+    if (!fbd_feedback_get_fire_and_forget (entry->feedback))
+      return FALSE;
+  }
+
+  return feedbacks != NULL;
+}
+
+
+/* Events that ended right away go to the history as ended */
+static void
+add_history (FbdFeedbackManager      *self,
+             FbdTriggerArgs          *args,
+             FbdTriggerResult        *result,
+             FbdFeedbackProfileLevel  level,
+             FbdEventCapabilities     kinds)
+{
+  fbd_history_add (self->history, result->event_id, args->app_id, args->event, level, kinds);
+  fbd_history_end (self->history, result->event_id, result->reason);
+}
+
+
+/**
+ * trigger_event:
+ * @self: The feedback manager
+ * @sender: The DBus sender of the event
+ * @args: The parsed arguments
+ * @result: (out caller-allocates): The result
+ *
+ * Looks up the feedbacks for an event. Feedbacks are not started yet
+ * as the caller must first reply to the method call. If the event
+ * ended already or got merged into a running one the result's event
+ * is `NULL`. If there's no feedback at all the event id is
+ * `FB_EVENT_ID_NO_FEEDBACK` for clients that handle it.
+ */
+static void
+trigger_event (FbdFeedbackManager *self,
+               const char         *sender,
+               FbdTriggerArgs     *args,
+               FbdTriggerResult   *result)
+{
+  FbdEvent *event;
+  GArray *feedbacks;
+  FbdFeedbackProfileLevel level;
+  g_autofree char *key = NULL;
+  gboolean found_fb, important;
+  guint window;
+  gint64 begin;
+
+  g_debug ("Event '%s' for '%s' from %s", args->event, args->app_id, sender);
+  fbd_stats_count (fbd_stats_get_default (), FBD_STATS_COUNTER_EVENTS_TRIGGERED);
+  self->last_activity = g_get_monotonic_time ();
+
+  important = args->hint_important && app_is_important (self, args->app_id);
+
+  level = fbd_feedback_manager_get_effective_level (self, args->app_id, args->hint_level,
+                                                    args->hint_important);
+  begin = FBD_TRACE_CURRENT_TIME;
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (self->theme, level, args->event);
+  fbd_trace_mark (begin, "theme-lookup", "%s@%s: %s", args->event,
+                  fbd_feedback_profile_level_to_string (level), feedbacks ? "found" : "none");
+
+  /* Nothing to play, don't bother setting up an event */
+  if (feedbacks == NULL && args->sound_file == NULL) {
+    set_not_found (self, args, result);
+    add_history (self, args, result, level, FBD_EVENT_CAPABILITY_NONE);
+    return;
+  }
+
+  /*
+   * Short one shot events (e.g. key presses) don't need to be tracked: they
+   * can't be ended early and there's no client to watch. Sequences need
+   * the event to start the next feedback.
+   */
+  if ((args->hint_fire_and_forget || get_fire_and_forget (feedbacks)) &&
+      args->timeout == FBD_EVENT_TIMEOUT_ONESHOT &&
+      args->sound_file == NULL &&
+      !has_sequence (feedbacks)) {
+    FbdEventCapabilities kinds = FBD_EVENT_CAPABILITY_NONE;
+
+    found_fb = run_fire_and_forget (self, feedbacks, important, args->hint_deadline, &kinds);
+    if (found_fb) {
+      result->event_id = next_event_id (self);
+      result->reason = FBD_EVENT_END_REASON_NATURAL;
+    } else {
+      set_not_found (self, args, result);
+    }
+    add_history (self, args, result, level, kinds);
+    return;
+  }
+
+  window = get_coalesce_window (feedbacks);
+  if (window) {
+    FbdCoalesceEntry *entry;
+    gint64 now = g_get_monotonic_time ();
+
+    key = coalesce_key (sender, args->app_id, args->event);
+    entry = g_hash_table_lookup (self->coalesce, key);
+    if (entry && now - entry->last < (gint64)window * 1000) {
+      g_debug ("Coalescing event '%s' into %d", args->event, fbd_event_get_id (entry->event));
+      /* Extend the window so a steady stream of events stays coalesced */
+      entry->last = now;
+      result->event_id = fbd_event_get_id (entry->event);
+      result->coalesced = TRUE;
+      return;
+    }
+  }
+
+  result->event_id = next_event_id (self);
+  event = fbd_event_new (result->event_id, args->app_id, args->event, args->timeout, sender);
+  g_hash_table_insert (self->events, GUINT_TO_POINTER (result->event_id), event);
+
+  found_fb = add_event_feedbacks (self, event, feedbacks, level, important, args->sound_file,
+                                  args->hint_deadline);
+  if (!found_fb) {
+    g_hash_table_remove (self->events, GUINT_TO_POINTER (result->event_id));
+    set_not_found (self, args, result);
+    add_history (self, args, result, level, FBD_EVENT_CAPABILITY_NONE);
+    return;
+  }
+  fbd_history_add (self->history, result->event_id, args->app_id, args->event, level,
+                   get_event_kinds (event));
+  index_event (self, event, level);
+  attach_event_profile (self, event, args, level, important);
+  fbd_stats_set_active_events (fbd_stats_get_default (), g_hash_table_size (self->events));
+
+  if (window) {
+    FbdCoalesceEntry *entry = g_new0 (FbdCoalesceEntry, 1);
+
+    entry->event = event;
+    entry->last = g_get_monotonic_time ();
+    g_hash_table_insert (self->coalesce, g_steal_pointer (&key), entry);
+  }
+
+  /* Keep the event alive, later events of a batch might preempt its feedbacks */
+  result->event = g_object_ref (event);
+}
+
+/**
+ * start_event:
+ * @self: The feedback manager
+ * @sender: The DBus sender of the event
+ * @result: The result of `trigger_event()`
+ *
+ * Runs the event's feedbacks or notifies the client if the event
+ * already ended. Clients know that events without feedback ended
+ * from the id in the reply so they aren't notified.
+ *
+ * Returns: `TRUE` if the client needs to be watched
+ */
+static gboolean
+start_event (FbdFeedbackManager *self, const char *sender, FbdTriggerResult *result)
+{
+  if (result->coalesced)
+    return TRUE;
+
+  if (result->event == NULL) {
+    if (result->event_id != FB_EVENT_ID_NO_FEEDBACK)
+      emit_feedback_ended (self, sender, result->event_id, result->reason);
+    fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_ENDED, NULL, NULL, NULL,
+                      NULL, 0, result->event_id, result->reason);
+    return FALSE;
+  }
+
+  g_signal_connect_object (result->event, "feedbacks-ended",
+                           (GCallback) on_event_feedbacks_ended,
+                           self,
+                           G_CONNECT_SWAPPED);
+  fbd_event_run_feedbacks (result->event);
+  return TRUE;
+}
+
+
+/**
+ * defer_call:
+ * @self: The feedback manager
+ * @invocation: The method call
+ *
+ * While devices are still being probed feedbacks can't be looked up
+ * reliably as e.g. the motor isn't known yet. Keep the call until
+ * probing is done, it's then dispatched again.
+ *
+ * Returns: `TRUE` if the call got deferred
+ */
+static gboolean
+defer_call (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+{
+  if (self->n_probes == 0)
+    return FALSE;
+
+  g_debug ("Deferring %s until devices are probed",
+           g_dbus_method_invocation_get_method_name (invocation));
+  g_queue_push_tail (&self->deferred_calls, invocation);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_trigger_feedback (LfbGdbusFeedback      *object,
+                                              GDBusMethodInvocation *invocation,
+                                              const gchar           *arg_app_id,
+                                              const gchar           *arg_event,
+                                              GVariant              *arg_hints,
+                                              gint                   arg_timeout)
+{
+  FbdFeedbackManager *self;
+  FbdTriggerArgs args = { 0 };
+  FbdTriggerResult result = { 0 };
+  g_autoptr (GError) err = NULL;
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+  const char *sender;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+  g_return_val_if_fail (arg_app_id, FALSE);
+  g_return_val_if_fail (arg_event, FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  if (defer_call (self, invocation))
+    return TRUE;
+
+  sender = get_sender (self, invocation);
+  if (!fbd_feedback_manager_admit (self, get_rate_limit_sender (self, invocation), 1)) {
+    fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_TRIGGER, sender, arg_app_id,
+                      arg_event, arg_hints, arg_timeout, 0, FBD_RECORD_RESULT_RATE_LIMITED);
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  if (!trigger_args_parse (&args, arg_app_id, arg_event, arg_hints, arg_timeout, &err)) {
+    fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_TRIGGER, sender, arg_app_id,
+                      arg_event, arg_hints, arg_timeout, 0, FBD_RECORD_RESULT_INVALID);
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return TRUE;
+  }
+
+  trigger_event (self, sender, &args, &result);
+  trigger_args_clear (&args);
+  fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_TRIGGER, sender, arg_app_id,
+                    arg_event, arg_hints, arg_timeout, result.event_id, FBD_RECORD_RESULT_OK);
+
+  lfb_gdbus_feedback_complete_trigger_feedback (object, invocation, result.event_id);
+
+  if (start_event (self, sender, &result))
+    watch_client (self, invocation);
+  trigger_result_clear (&result);
+
+  fbd_trace_mark (begin, "TriggerFeedback", "%s %s: %u", arg_app_id, arg_event,
+                  result.event_id);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_trigger_feedback_ex (LfbGdbusFeedback      *object,
+                                                 GDBusMethodInvocation *invocation,
+                                                 const gchar           *arg_app_id,
+                                                 const gchar           *arg_event,
+                                                 GVariant              *arg_hints,
+                                                 GVariant              *arg_extra_hints,
+                                                 gint                   arg_timeout)
+{
+  FbdFeedbackManager *self;
+  FbdRecorder *recorder = fbd_recorder_get_default ();
+  FbdTriggerArgs args = { 0 };
+  FbdTriggerResult result = { 0 };
+  g_autoptr (GVariant) hints = NULL;
+  g_autoptr (GError) err = NULL;
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+  const char *sender;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+  g_return_val_if_fail (arg_app_id, FALSE);
+  g_return_val_if_fail (arg_event, FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  if (defer_call (self, invocation))
+    return TRUE;
+
+  sender = get_sender (self, invocation);
+  if (!fbd_feedback_manager_admit (self, get_rate_limit_sender (self, invocation), 1)) {
+    fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, sender, arg_app_id, arg_event,
+                      arg_extra_hints, arg_timeout, 0, FBD_RECORD_RESULT_RATE_LIMITED);
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  if (!trigger_args_parse_ex (&args, arg_app_id, arg_event, arg_hints, arg_extra_hints,
+                              arg_timeout, &err)) {
+    fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, sender, arg_app_id, arg_event,
+                      arg_extra_hints, arg_timeout, 0, FBD_RECORD_RESULT_INVALID);
+    trigger_args_clear (&args);
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return TRUE;
+  }
+
+  /* Only build the dictionary when someone looks at it */
+  if (recorder)
+    hints = g_variant_ref_sink (trigger_args_to_hints (&args));
+
+  trigger_event (self, sender, &args, &result);
+  trigger_args_clear (&args);
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, sender, arg_app_id, arg_event,
+                    hints, arg_timeout, result.event_id, FBD_RECORD_RESULT_OK);
+
+  lfb_gdbus_feedback_complete_trigger_feedback_ex (object, invocation, result.event_id);
+
+  if (start_event (self, sender, &result))
+    watch_client (self, invocation);
+  trigger_result_clear (&result);
+
+  fbd_trace_mark (begin, "TriggerFeedbackEx", "%s %s: %u", arg_app_id, arg_event,
+                  result.event_id);
+  return TRUE;
+}
+
+
+/* Records each event of a TriggerFeedbacks call */
+static void
+record_triggers (const char *sender, GVariant *events, FbdRecordResult result, GArray *ids)
+{
+  FbdRecorder *recorder = fbd_recorder_get_default ();
+  GVariantIter iter;
+  const char *app_id, *event_name;
+  GVariant *hints;
+  int timeout;
+  guint i = 0;
+
+  if (recorder == NULL)
+    return;
+
+  g_variant_iter_init (&iter, events);
+  while (g_variant_iter_next (&iter, "(&s&s@a{sv}i)", &app_id, &event_name, &hints, &timeout)) {
+    guint event_id = ids && i < ids->len ? g_array_index (ids, guint32, i) : 0;
+
+    fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, sender, app_id, event_name, hints,
+                      timeout, event_id, result);
+    g_variant_unref (hints);
+    i++;
+  }
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_trigger_feedbacks (LfbGdbusFeedback      *object,
+                                               GDBusMethodInvocation *invocation,
+                                               GVariant              *arg_events)
+{
+  FbdFeedbackManager *self;
+  const char *sender;
+  g_autoptr (GArray) args = NULL;
+  g_autoptr (GArray) ids = NULL;
+  g_autoptr (GArray) results = NULL;
+  g_autoptr (GError) err = NULL;
+  GVariantIter iter;
+  const char *app_id, *event_name;
+  GVariant *hints;
+  gboolean needs_watch = FALSE;
+  gsize n_events;
+  int timeout;
+  gint64 begin = FBD_TRACE_CURRENT_TIME;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  if (defer_call (self, invocation))
+    return TRUE;
+
+  sender = get_sender (self, invocation);
+
+  n_events = g_variant_iter_init (&iter, arg_events);
+  if (n_events > TRIGGER_FEEDBACKS_MAX_EVENTS) {
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                           G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                           "Too many events: %" G_GSIZE_FORMAT, n_events);
+    return TRUE;
+  }
+
+  if (!fbd_feedback_manager_admit (self, get_rate_limit_sender (self, invocation), n_events)) {
+    record_triggers (sender, arg_events, FBD_RECORD_RESULT_RATE_LIMITED, NULL);
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  /* Validate the whole batch before triggering anything */
+  args = g_array_sized_new (FALSE, TRUE, sizeof (FbdTriggerArgs), n_events);
+  g_array_set_clear_func (args, (GDestroyNotify)trigger_args_clear);
+  while (g_variant_iter_next (&iter, "(&s&s@a{sv}i)", &app_id, &event_name, &hints, &timeout)) {
+    FbdTriggerArgs entry = { 0 };
+    gboolean success;
+
+    success = trigger_args_parse (&entry, app_id, event_name, hints, timeout, &err);
+    g_variant_unref (hints);
+    if (!success) {
+      record_triggers (sender, arg_events, FBD_RECORD_RESULT_INVALID, NULL);
+      g_dbus_method_invocation_return_gerror (invocation, err);
+      return TRUE;
+    }
+    g_array_append_val (args, entry);
+  }
+
+  ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), n_events);
+  results = g_array_sized_new (FALSE, TRUE, sizeof (FbdTriggerResult), n_events);
+  g_array_set_clear_func (results, (GDestroyNotify)trigger_result_clear);
+  for (guint i = 0; i < args->len; i++) {
+    FbdTriggerResult result = { 0 };
+
+    trigger_event (self, sender, &g_array_index (args, FbdTriggerArgs, i), &result);
+    g_array_append_val (ids, result.event_id);
+    g_array_append_val (results, result);
+  }
+  record_triggers (sender, arg_events, FBD_RECORD_RESULT_OK, ids);
+
+  lfb_gdbus_feedback_complete_trigger_feedbacks (object, invocation,
+                                                 g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                                            ids->data,
+                                                                            ids->len,
+                                                                            sizeof (guint32)));
+
+  for (guint i = 0; i < results->len; i++)
+    needs_watch |= start_event (self, sender, &g_array_index (results, FbdTriggerResult, i));
+
+  /* One watch for the whole batch */
+  if (needs_watch)
+    watch_client (self, invocation);
+
+  fbd_trace_mark (begin, "TriggerFeedbacks", "%u events", args->len);
+  return TRUE;
+}
+
+/**
+ * prepare_event:
+ * @self: The feedback manager
+ * @args: The parsed arguments
+ *
+ * Gets the haptic feedback of an event ready on the motor
+ * `claim_vibra()` would most likely pick so triggering the event
+ * later only needs to start it.
+ *
+ * Returns: `TRUE` if a feedback was prepared
+ */
+static gboolean
+prepare_event (FbdFeedbackManager *self, FbdTriggerArgs *args)
+{
+  FbdFeedbackProfileLevel level;
+  GArray *feedbacks;
+
+  level = fbd_feedback_manager_get_effective_level (self, args->app_id, args->hint_level,
+                                                    args->hint_important);
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (self->theme, level, args->event);
+
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+    FbdFeedbackVibra *fb;
+    FbdDevVibra *dev = NULL;
+
+    if (!FBD_IS_FEEDBACK_VIBRA (entry->feedback))
+      continue;
+
+    fb = FBD_FEEDBACK_VIBRA (entry->feedback);
+    for (guint j = 0; self->vibras && j < self->vibras->len; j++) {
+      FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, j);
 
-    fbd_event_add_feedback (event, fb);
+      if (!fbd_feedback_vibra_supports_device (fb, actuator->dev))
+        continue;
+
+      dev = actuator->dev;
+      if (!vibra_actuator_busy (self, actuator))
+        break;
+    }
+
+    /* Like triggering only one haptic feedback is used */
+    if (dev)
+      return fbd_feedback_vibra_prepare (fb, dev);
   }
 
-  return (fbd_event_get_feedbacks (event) != NULL);
+  return FALSE;
 }
 
 
 static gboolean
-fbd_feedback_manager_handle_trigger_feedback (LfbGdbusFeedback      *object,
+fbd_feedback_manager_handle_prepare_feedback (LfbGdbusFeedback      *object,
                                               GDBusMethodInvocation *invocation,
                                               const gchar           *arg_app_id,
                                               const gchar           *arg_event,
-                                              GVariant              *arg_hints,
-                                              gint                   arg_timeout)
+                                              GVariant              *arg_hints)
 {
   FbdFeedbackManager *self;
-  FbdEvent *event;
-  GSList *feedbacks;
-  guint event_id;
-  const gchar *sender;
-  FbdFeedbackProfileLevel level, hint_level = FBD_FEEDBACK_PROFILE_LEVEL_FULL;
-  gboolean found_fb = FALSE;
-  gboolean hint_important = FALSE;
-  g_autofree char *sound_file = NULL;
-
-  sender = g_dbus_method_invocation_get_sender (invocation);
-  g_debug ("Event '%s' for '%s' from %s", arg_event, arg_app_id, sender);
+  FbdTriggerArgs args = { 0 };
+  g_autoptr (GError) err = NULL;
+  gboolean prepared;
 
   g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
   g_return_val_if_fail (arg_app_id, FALSE);
   g_return_val_if_fail (arg_event, FALSE);
 
   self = FBD_FEEDBACK_MANAGER (object);
-  if (!strlen (arg_app_id)) {
-    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
-                                           G_DBUS_ERROR_INVALID_ARGS,
-                                           "Invalid app id %s", arg_app_id);
+  if (defer_call (self, invocation))
+    return TRUE;
+
+  if (!fbd_feedback_manager_admit (self, get_rate_limit_sender (self, invocation), 1)) {
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  if (!trigger_args_parse (&args, arg_app_id, arg_event, arg_hints,
+                           FBD_EVENT_TIMEOUT_ONESHOT, &err)) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
     return TRUE;
   }
 
-  if (!strlen (arg_event)) {
+  prepared = prepare_event (self, &args);
+  g_debug ("Preparing event '%s' for '%s': %s", args.event, args.app_id,
+           prepared ? "prepared" : "nothing to prepare");
+  trigger_args_clear (&args);
+
+  lfb_gdbus_feedback_complete_prepare_feedback (object, invocation);
+  return TRUE;
+}
+
+
+static gboolean
+has_vibra_for (FbdFeedbackManager *self, FbdFeedbackVibra *fb)
+{
+  for (guint i = 0; self->vibras && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (fbd_feedback_vibra_supports_device (fb, actuator->dev))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * get_event_capabilities:
+ * @self: The feedback manager
+ * @app_id: The application id
+ * @event: The event name
+ *
+ * Looks at the feedbacks that triggering the event without any hints
+ * would use at the current level.
+ *
+ * Returns: The kinds of feedback the event gives
+ */
+static FbdEventCapabilities
+get_event_capabilities (FbdFeedbackManager *self, const char *app_id, const char *event)
+{
+  FbdEventCapabilities caps = FBD_EVENT_CAPABILITY_NONE;
+  FbdFeedbackProfileLevel level;
+  GArray *feedbacks;
+
+  level = fbd_feedback_manager_get_effective_level (self, app_id,
+                                                    FBD_FEEDBACK_PROFILE_LEVEL_FULL, FALSE);
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (self->theme, level, event);
+
+  for (guint i = 0; feedbacks && i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+
+    if (!fbd_feedback_is_available (entry->feedback))
+      continue;
+
+    if (FBD_IS_FEEDBACK_SOUND (entry->feedback))
+      caps |= FBD_EVENT_CAPABILITY_SOUND;
+    else if (FBD_IS_FEEDBACK_VIBRA (entry->feedback) &&
+             has_vibra_for (self, FBD_FEEDBACK_VIBRA (entry->feedback)))
+      caps |= FBD_EVENT_CAPABILITY_HAPTIC;
+    else if (FBD_IS_FEEDBACK_LED (entry->feedback))
+      caps |= FBD_EVENT_CAPABILITY_LED;
+  }
+
+  return caps;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_get_event_capabilities (LfbGdbusFeedback      *object,
+                                                    GDBusMethodInvocation *invocation,
+                                                    const gchar *const    *arg_events,
+                                                    const gchar           *arg_app_id)
+{
+  FbdFeedbackManager *self;
+  GVariantBuilder caps;
+  guint n_events;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+  g_return_val_if_fail (arg_events, FALSE);
+  g_return_val_if_fail (arg_app_id, FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  if (defer_call (self, invocation))
+    return TRUE;
+
+  n_events = g_strv_length ((GStrv)arg_events);
+  if (n_events > TRIGGER_FEEDBACKS_MAX_EVENTS) {
     g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
-                                           G_DBUS_ERROR_INVALID_ARGS,
-                                           "Invalid event %s", arg_event);
+                                           G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                           "Too many events: %u", n_events);
     return TRUE;
   }
 
-  if (!parse_hints (arg_hints, &hint_level, &hint_important, &sound_file)) {
+  if (!strlen (arg_app_id)) {
     g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
                                            G_DBUS_ERROR_INVALID_ARGS,
-                                           "Invalid hints");
+                                           "Invalid app id %s", arg_app_id);
     return TRUE;
   }
 
-  if (arg_timeout < -1)
-    arg_timeout = -1;
+  g_variant_builder_init (&caps, G_VARIANT_TYPE ("au"));
+  for (guint i = 0; i < n_events; i++)
+    g_variant_builder_add (&caps, "u", get_event_capabilities (self, arg_app_id, arg_events[i]));
+
+  lfb_gdbus_feedback_complete_get_event_capabilities (object, invocation,
+                                                      g_variant_builder_end (&caps));
+  return TRUE;
+}
+
+
+static void
+dispatch_deferred_call (FbdFeedbackManager *self, GDBusMethodInvocation *invocation)
+{
+  LfbGdbusFeedback *object = LFB_GDBUS_FEEDBACK (self);
+  const char *method = g_dbus_method_invocation_get_method_name (invocation);
+  GVariant *params = g_dbus_method_invocation_get_parameters (invocation);
+  g_autoptr (GVariant) hints = NULL;
+  g_autoptr (GVariant) events = NULL;
+  const char *app_id, *event;
+  int timeout;
+
+  if (g_str_equal (method, "TriggerFeedback")) {
+    g_variant_get (params, "(&s&s@a{sv}i)", &app_id, &event, &hints, &timeout);
+    fbd_feedback_manager_handle_trigger_feedback (object, invocation, app_id, event, hints,
+                                                  timeout);
+  } else if (g_str_equal (method, "TriggerFeedbackEx")) {
+    g_autoptr (GVariant) extra_hints = NULL;
+
+    g_variant_get (params, "(&s&s@(uuus)@a{sv}i)", &app_id, &event, &hints, &extra_hints,
+                   &timeout);
+    fbd_feedback_manager_handle_trigger_feedback_ex (object, invocation, app_id, event, hints,
+                                                     extra_hints, timeout);
+  } else if (g_str_equal (method, "TriggerFeedbacks")) {
+    g_variant_get (params, "(@a(ssa{sv}i))", &events);
+    fbd_feedback_manager_handle_trigger_feedbacks (object, invocation, events);
+  } else if (g_str_equal (method, "PrepareFeedback")) {
+    g_variant_get (params, "(&s&s@a{sv})", &app_id, &event, &hints);
+    fbd_feedback_manager_handle_prepare_feedback (object, invocation, app_id, event, hints);
+  } else if (g_str_equal (method, "GetEventCapabilities")) {
+    g_autofree const char **names = NULL;
+
+    g_variant_get (params, "(^a&s&s)", &names, &app_id);
+    fbd_feedback_manager_handle_get_event_capabilities (object, invocation, names, app_id);
+  } else {
+    g_assert_not_reached ();
+  }
+}
+
 
-  event_id = self->next_id++;
+static void
+probe_done (FbdFeedbackManager *self)
+{
+  GDBusMethodInvocation *invocation;
+  GDBusConnection *connection;
 
-  event = fbd_event_new (event_id, arg_app_id, arg_event, arg_timeout, sender);
-  g_hash_table_insert (self->events, GUINT_TO_POINTER (event_id), event);
+  g_return_if_fail (self->n_probes > 0);
+
+  self->n_probes--;
+  if (self->n_probes)
+    return;
 
-  level = fbd_feedback_manager_get_effective_level (self, arg_app_id, hint_level, hint_important);
+  g_debug ("Devices probed, %u deferred calls", self->deferred_calls.length);
+  g_clear_object (&self->probe_cancel);
 
-  feedbacks = fbd_feedback_theme_lookup_feedback (self->theme, level, event);
-  found_fb = add_event_feedbacks (self, event, feedbacks, level, sound_file);
-  if (feedbacks)
-    g_slist_free_full (feedbacks, g_object_unref);
+  if (self->haptic_manager == NULL && self->vibras->len) {
+    self->haptic_manager = fbd_haptic_manager_new ();
 
-  lfb_gdbus_feedback_complete_trigger_feedback (object, invocation, event_id);
+    /*
+     * Exported by the daemon if it didn't take the bus name yet. Peers
+     * (e.g. the sessions of a broker) only get the feedback interface.
+     */
+    connection = g_dbus_interface_skeleton_get_connection (G_DBUS_INTERFACE_SKELETON (self));
+    if (connection && g_dbus_connection_get_unique_name (connection)) {
+      g_autoptr (GError) err = NULL;
 
-  if (found_fb) {
-    g_signal_connect_object (event, "feedbacks-ended",
-                             (GCallback) on_event_feedbacks_ended,
-                             self,
-                             G_CONNECT_SWAPPED);
-    fbd_event_run_feedbacks (event);
-    watch_client (self, invocation);
-  } else {
-    g_hash_table_remove (self->events, GUINT_TO_POINTER (event_id));
-    lfb_gdbus_feedback_emit_feedback_ended (LFB_GDBUS_FEEDBACK (self), event_id,
-                                            FBD_EVENT_END_REASON_NOT_FOUND);
+      g_debug ("Exporting haptic manager...");
+      if (!fbd_dispatcher_export (fbd_dispatcher_get_default (),
+                                  G_DBUS_INTERFACE_SKELETON (self->haptic_manager),
+                                  connection,
+                                  FB_DBUS_PATH,
+                                  &err)) {
+        g_warning ("Failed to export haptic manager: %s", err->message);
+      }
+    }
   }
 
-  return TRUE;
+  while ((invocation = g_queue_pop_head (&self->deferred_calls)))
+    dispatch_deferred_call (self, invocation);
+
+  /* Clients might have asked before all devices were known */
+  capabilities_changed (self);
 }
 
+
 static gboolean
 fbd_feedback_manager_handle_end_feedback (LfbGdbusFeedback      *object,
                                           GDBusMethodInvocation *invocation,
@@ -515,17 +2489,25 @@ fbd_feedback_manager_handle_end_feedback (LfbGdbusFeedback      *object,
   g_debug ("Ending feedback for event '%d'", event_id);
 
   g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
-  g_return_val_if_fail (event_id, FALSE);
+
+  /* Events without feedback ended right away */
+  if (event_id == FB_EVENT_ID_NO_FEEDBACK) {
+    lfb_gdbus_feedback_complete_end_feedback (object, invocation);
+    return TRUE;
+  }
 
   self = FBD_FEEDBACK_MANAGER (object);
+  fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_END,
+                    get_sender (self, invocation), NULL, NULL, NULL, 0,
+                    event_id, FBD_RECORD_RESULT_OK);
 
-  event = g_hash_table_lookup (self->events, GUINT_TO_POINTER (event_id));
+  event = lookup_caller_event (self, invocation, event_id);
   if (event) {
     /* The last feedback ending will trigger event disposal via
        `on_fb_ended` */
     fbd_event_end_feedbacks (event);
   } else {
-    g_warning ("Tried to end non-existing event %d", event_id);
+    g_warning ("Tried to end non-existing or foreign event %d", event_id);
   }
 
   lfb_gdbus_feedback_complete_end_feedback (object, invocation);
@@ -533,6 +2515,223 @@ fbd_feedback_manager_handle_end_feedback (LfbGdbusFeedback      *object,
 }
 
 
+static gboolean
+fbd_feedback_manager_handle_end_feedbacks (LfbGdbusFeedback      *object,
+                                           GDBusMethodInvocation *invocation,
+                                           GVariant              *arg_ids)
+{
+  FbdFeedbackManager *self;
+  const guint32 *ids;
+  gsize n_ids;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  ids = g_variant_get_fixed_array (arg_ids, &n_ids, sizeof (guint32));
+  g_debug ("Ending feedback for %" G_GSIZE_FORMAT " events", n_ids);
+
+  for (gsize i = 0; i < n_ids; i++) {
+    FbdEvent *event;
+
+    fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_END,
+                      get_sender (self, invocation), NULL, NULL, NULL, 0,
+                      ids[i], FBD_RECORD_RESULT_OK);
+
+    /* Clients end events in bulk on shutdown, some might have ended meanwhile */
+    event = lookup_caller_event (self, invocation, ids[i]);
+    if (event)
+      fbd_event_end_feedbacks (event);
+  }
+
+  lfb_gdbus_feedback_complete_end_feedbacks (object, invocation);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_end_all_feedbacks_for_sender (LfbGdbusFeedback      *object,
+                                                          GDBusMethodInvocation *invocation)
+{
+  FbdFeedbackManager *self;
+  const char *sender;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  sender = get_sender (self, invocation);
+  g_debug ("Ending all feedbacks of %s", sender);
+
+  /* A single pass over the sender's index */
+  if (sender)
+    end_client_events (self, sender);
+
+  lfb_gdbus_feedback_complete_end_all_feedbacks_for_sender (object, invocation);
+  return TRUE;
+}
+
+
+static void
+on_peer_closed (FbdFeedbackManager *self,
+                gboolean            remote_peer_vanished,
+                GError             *error,
+                GDBusConnection    *conn)
+{
+  FbdPeer *peer = g_hash_table_lookup (self->peers, conn);
+
+  g_return_if_fail (peer);
+
+  g_debug ("Peer %s closed its connection", peer->name);
+
+  g_dbus_interface_skeleton_unexport_from_connection (G_DBUS_INTERFACE_SKELETON (self), conn);
+  end_client_events (self, peer->name);
+  /* The opener's budget stays, reopening shouldn't reset it */
+  if (peer->opener)
+    release_opened_peer (self, peer->opener);
+  else
+    fbd_rate_limiter_forget (self->rate_limiter, peer->name);
+  g_hash_table_remove (self->peers, conn);
+}
+
+
+static gboolean add_peer (FbdFeedbackManager *self,
+                          GDBusConnection    *conn,
+                          const char         *opener,
+                          GError            **error);
+
+static void
+on_peer_connection_ready (GObject      *source_object,
+                          GAsyncResult *res,
+                          FbdPeerOpen  *peer_open)
+{
+  FbdFeedbackManager *self = peer_open->manager;
+  g_autoptr (GDBusConnection) conn = NULL;
+  g_autoptr (GError) err = NULL;
+
+  conn = g_dbus_connection_new_finish (res, &err);
+  if (conn == NULL) {
+    g_debug ("Failed to set up peer connection: %s", err->message);
+    release_opened_peer (self, peer_open->opener);
+  } else if (!add_peer (self, conn, peer_open->opener, &err)) {
+    g_warning ("Failed to export on peer connection: %s", err->message);
+    release_opened_peer (self, peer_open->opener);
+    g_dbus_connection_close (conn, NULL, NULL, NULL);
+  } else {
+    /* Only handle method calls once the interface is exported */
+    g_dbus_connection_start_message_processing (conn);
+  }
+
+  g_object_unref (self);
+  g_free (peer_open->opener);
+  g_free (peer_open);
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_open_peer_connection (LfbGdbusFeedback      *object,
+                                                  GDBusMethodInvocation *invocation,
+                                                  GUnixFDList           *unused)
+{
+  FbdFeedbackManager *self;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  g_autoptr (GSocket) socket = NULL;
+  g_autoptr (GSocketConnection) stream = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *guid = NULL;
+  FbdPeerOpen *peer_open;
+  const char *sender;
+  int fds[2];
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (object), FALSE);
+
+  self = FBD_FEEDBACK_MANAGER (object);
+  sender = g_dbus_method_invocation_get_sender (invocation);
+  if (sender == NULL) {
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                                           "Already on a peer connection");
+    return TRUE;
+  }
+
+  if (!fbd_feedback_manager_admit (self, sender, 1)) {
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  if (g_hash_table_size (self->peers) >= MAX_PEER_CONNECTIONS ||
+      get_n_opened_peers (self, sender) >= MAX_PEER_CONNECTIONS_PER_CLIENT) {
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                           "Too many peer connections");
+    return TRUE;
+  }
+
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    g_dbus_method_invocation_return_error (invocation, G_IO_ERROR,
+                                           g_io_error_from_errno (errno),
+                                           "Failed to create socket: %s", g_strerror (errno));
+    return TRUE;
+  }
+
+  socket = g_socket_new_from_fd (fds[0], &err);
+  if (socket == NULL) {
+    close (fds[0]);
+    close (fds[1]);
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return TRUE;
+  }
+  stream = g_socket_connection_factory_create_connection (socket);
+
+  /* Counts against the client's peers until the connection closes */
+  g_hash_table_insert (self->peer_openers, g_strdup (sender),
+                       GUINT_TO_POINTER (get_n_opened_peers (self, sender) + 1));
+  peer_open = g_new0 (FbdPeerOpen, 1);
+  peer_open->manager = g_object_ref (self);
+  peer_open->opener = g_strdup (sender);
+
+  guid = g_dbus_generate_guid ();
+  g_dbus_connection_new (G_IO_STREAM (stream),
+                         guid,
+                         G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER |
+                         G_DBUS_CONNECTION_FLAGS_DELAY_MESSAGE_PROCESSING,
+                         NULL,
+                         NULL,
+                         (GAsyncReadyCallback)on_peer_connection_ready,
+                         peer_open);
+
+  fd_list = g_unix_fd_list_new_from_array (&fds[1], 1);
+  lfb_gdbus_feedback_complete_open_peer_connection (object,
+                                                    invocation,
+                                                    fd_list,
+                                                    g_variant_new_handle (0));
+  return TRUE;
+}
+
+
+static void
+on_low_power_changed (FbdFeedbackManager *self)
+{
+  gboolean low_power = fbd_power_monitor_get_low_power (self->power_monitor);
+
+  /*
+   * LEDs and haptics use hardware driven patterns where possible
+   * already. Let the remaining software timed effects and event
+   * timeouts wake us up less often.
+   */
+  fbd_timer_wheel_set_min_slack (fbd_timer_wheel_get_default (),
+                                 low_power ? FBD_TIMER_WHEEL_SLACK_LOW_POWER : 0);
+}
+
+
+static gboolean
+on_handle_get_history (FbdFeedbackManager    *self,
+                       GDBusMethodInvocation *invocation,
+                       LfbGdbusFeedbackStats *stats)
+{
+  lfb_gdbus_feedback_stats_complete_get_history (stats, invocation,
+                                                 fbd_history_to_variant (self->history));
+  return TRUE;
+}
+
+
 static void
 fbd_feedback_manager_constructed (GObject *object)
 {
@@ -553,8 +2752,44 @@ fbd_feedback_manager_constructed (GObject *object)
                             G_CALLBACK (on_feedbackd_allow_important_changed), self);
   on_feedbackd_allow_important_changed (self, FEEDBACKD_KEY_ALLOW_IMPORTANT, self->settings);
 
-  if (self->vibra || fbd_debug_flags & FBD_DEBUG_FLAG_FORCE_HAPTIC)
+  self->rate_limiter = fbd_rate_limiter_new (self->settings);
+
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_BROADCAST_FEEDBACK_ENDED,
+                            G_CALLBACK (on_feedbackd_broadcast_feedback_ended_changed), self);
+  on_feedbackd_broadcast_feedback_ended_changed (self, FEEDBACKD_KEY_BROADCAST_FEEDBACK_ENDED,
+                                                 self->settings);
+
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_HAPTIC_GAIN,
+                            G_CALLBACK (on_feedbackd_haptic_gain_changed), self);
+  on_feedbackd_haptic_gain_changed (self, FEEDBACKD_KEY_HAPTIC_GAIN, self->settings);
+
+  g_signal_connect_swapped (self->settings, "changed::" FEEDBACKD_KEY_HAPTIC_DUTY_CYCLE,
+                            G_CALLBACK (on_feedbackd_haptic_duty_cycle_changed), self);
+  on_feedbackd_haptic_duty_cycle_changed (self, FEEDBACKD_KEY_HAPTIC_DUTY_CYCLE, self->settings);
+
+  /* Otherwise created once a motor got probed */
+  if (fbd_debug_flags & FBD_DEBUG_FLAG_FORCE_HAPTIC)
     self->haptic_manager = fbd_haptic_manager_new ();
+
+  self->power_monitor = fbd_power_monitor_new ();
+  g_signal_connect_object (self->power_monitor, "notify::low-power",
+                           G_CALLBACK (on_low_power_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  /* The history is kept here but queried via the stats interface */
+  g_signal_connect_object (fbd_stats_get_default (), "handle-get-history",
+                           G_CALLBACK (on_handle_get_history),
+                           self,
+                           G_CONNECT_SWAPPED);
+}
+
+
+static void
+return_deferred_call (GDBusMethodInvocation *invocation)
+{
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                         "Feedback daemon is shutting down");
 }
 
 
@@ -563,18 +2798,52 @@ fbd_feedback_manager_dispose (GObject *object)
 {
   FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (object);
 
+  g_cancellable_cancel (self->probe_cancel);
+  g_clear_object (&self->probe_cancel);
+  g_queue_clear_full (&self->deferred_calls, (GDestroyNotify)return_deferred_call);
+
   g_clear_object (&self->haptic_manager);
+  g_clear_object (&self->power_monitor);
 
+  g_clear_handle_id (&self->preload_id, g_source_remove);
+  g_clear_handle_id (&self->caps_changed_id, g_source_remove);
   g_clear_object (&self->settings);
+  g_cancellable_cancel (self->theme_cancel);
+  g_clear_object (&self->theme_cancel);
+  g_clear_object (&self->expander);
   g_clear_object (&self->theme);
   g_clear_object (&self->sound);
-  g_clear_object (&self->vibra);
+  g_clear_handle_id (&self->reattach_id, fbd_timeout_remove);
+  g_clear_pointer (&self->suspended_vibras, g_ptr_array_unref);
+  g_clear_pointer (&self->vibras, g_ptr_array_unref);
   g_clear_object (&self->leds);
   g_clear_object (&self->client);
 
-  g_clear_pointer (&self->allow_important, g_strfreev);
+  g_clear_pointer (&self->allow_important, g_hash_table_destroy);
+  g_clear_pointer (&self->sender_events, g_hash_table_destroy);
+  for (int i = 0; i < FBD_FEEDBACK_PROFILE_N_PROFILES; i++)
+    g_clear_pointer (&self->level_events[i], g_hash_table_destroy);
   g_clear_pointer (&self->events, g_hash_table_destroy);
   g_clear_pointer (&self->clients, g_hash_table_destroy);
+  g_clear_pointer (&self->coalesce, g_hash_table_destroy);
+  g_clear_pointer (&self->rate_limiter, fbd_rate_limiter_free);
+  if (self->peers) {
+    GHashTableIter iter;
+    gpointer conn;
+
+    g_hash_table_iter_init (&iter, self->peers);
+    while (g_hash_table_iter_next (&iter, &conn, NULL)) {
+      g_signal_handlers_disconnect_by_data (conn, self);
+      g_dbus_interface_skeleton_unexport_from_connection (G_DBUS_INTERFACE_SKELETON (self), conn);
+      g_dbus_connection_close (conn, NULL, NULL, NULL);
+    }
+    g_clear_pointer (&self->peers, g_hash_table_destroy);
+  }
+  g_clear_pointer (&self->peer_openers, g_hash_table_destroy);
+  /* The LRU links are embedded in the entries */
+  g_clear_pointer (&self->app_levels, g_hash_table_destroy);
+  g_queue_init (&self->app_levels_lru);
+  g_clear_pointer (&self->history, fbd_history_free);
 
   G_OBJECT_CLASS (fbd_feedback_manager_parent_class)->dispose (object);
 }
@@ -583,26 +2852,51 @@ static void
 fbd_feedback_manager_feedback_iface_init (LfbGdbusFeedbackIface *iface)
 {
   iface->handle_trigger_feedback = fbd_feedback_manager_handle_trigger_feedback;
+  iface->handle_trigger_feedback_ex = fbd_feedback_manager_handle_trigger_feedback_ex;
+  iface->handle_trigger_feedbacks = fbd_feedback_manager_handle_trigger_feedbacks;
+  iface->handle_prepare_feedback = fbd_feedback_manager_handle_prepare_feedback;
   iface->handle_end_feedback = fbd_feedback_manager_handle_end_feedback;
+  iface->handle_end_feedbacks = fbd_feedback_manager_handle_end_feedbacks;
+  iface->handle_end_all_feedbacks_for_sender =
+    fbd_feedback_manager_handle_end_all_feedbacks_for_sender;
+  iface->handle_get_event_capabilities = fbd_feedback_manager_handle_get_event_capabilities;
+  iface->handle_open_peer_connection = fbd_feedback_manager_handle_open_peer_connection;
+}
+
+static GDBusInterfaceVTable *
+fbd_feedback_manager_get_vtable (GDBusInterfaceSkeleton *skeleton)
+{
+  GDBusInterfaceSkeletonClass *skeleton_class;
+
+  skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (fbd_feedback_manager_parent_class);
+
+  /* Method calls are handled on the main thread */
+  return fbd_dispatcher_wrap_vtable (skeleton, skeleton_class->get_vtable (skeleton));
 }
 
 static void
 fbd_feedback_manager_class_init (FbdFeedbackManagerClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GDBusInterfaceSkeletonClass *skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (klass);
 
   object_class->constructed = fbd_feedback_manager_constructed;
   object_class->dispose = fbd_feedback_manager_dispose;
+
+  skeleton_class->get_vtable = fbd_feedback_manager_get_vtable;
 }
 
 static void
 fbd_feedback_manager_init (FbdFeedbackManager *self)
 {
-  const gchar * const subsystems[] = { "input", NULL };
+  const gchar * const subsystems[] = { "input", "leds", NULL };
 
   self->next_id = 1;
   self->level = FBD_FEEDBACK_PROFILE_LEVEL_UNKNOWN;
+  lfb_gdbus_feedback_set_version (LFB_GDBUS_FEEDBACK (self), FB_DBUS_VERSION);
 
+  self->vibras = g_ptr_array_new_with_free_func ((GDestroyNotify)vibra_actuator_free);
+  self->suspended_vibras = g_ptr_array_new_with_free_func ((GDestroyNotify)vibra_actuator_free);
   self->client = g_udev_client_new (subsystems);
   g_signal_connect_swapped (G_OBJECT (self->client), "uevent",
                             G_CALLBACK (device_changes), self);
@@ -612,10 +2906,33 @@ fbd_feedback_manager_init (FbdFeedbackManager *self)
                                         g_direct_equal,
                                         NULL,
                                         (GDestroyNotify)g_object_unref);
+  /* Senders are interned, their events share the same string */
+  self->sender_events = g_hash_table_new_full (g_str_hash,
+                                               g_str_equal,
+                                               (GDestroyNotify)g_ref_string_release,
+                                               (GDestroyNotify)g_hash_table_destroy);
+  for (int i = 0; i < FBD_FEEDBACK_PROFILE_N_PROFILES; i++)
+    self->level_events[i] = g_hash_table_new (g_direct_hash, g_direct_equal);
   self->clients = g_hash_table_new_full (g_str_hash,
                                          g_str_equal,
-                                         g_free,
+                                         (GDestroyNotify)g_ref_string_release,
                                          free_client_watch);
+  self->coalesce = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->allow_important = g_hash_table_new_full (g_str_hash,
+                                                 g_str_equal,
+                                                 (GDestroyNotify)g_ref_string_release,
+                                                 NULL);
+  self->peers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                       g_object_unref, (GDestroyNotify)peer_free);
+  self->peer_openers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->history = fbd_history_new ();
+  self->app_levels = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            NULL,
+                                            (GDestroyNotify)app_level_free);
+  g_queue_init (&self->app_levels_lru);
+  g_queue_init (&self->deferred_calls);
+  self->last_activity = g_get_monotonic_time ();
 }
 
 FbdFeedbackManager *
@@ -630,12 +2947,120 @@ fbd_feedback_manager_get_default (void)
   return instance;
 }
 
+/**
+ * fbd_feedback_manager_get_dev_vibra:
+ * @self: The feedback manager
+ *
+ * Get the default vibra device. This is the first one found.
+ *
+ * Returns:(transfer none)(nullable): The vibra device
+ */
 FbdDevVibra *
 fbd_feedback_manager_get_dev_vibra (FbdFeedbackManager *self)
+{
+  FbdVibraActuator *actuator;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), NULL);
+
+  if (self->vibras == NULL || self->vibras->len == 0)
+    return NULL;
+
+  actuator = g_ptr_array_index (self->vibras, 0);
+  return actuator->dev;
+}
+
+/**
+ * fbd_feedback_manager_find_dev_vibra:
+ * @self: The feedback manager
+ * @fb: A haptic feedback
+ *
+ * Find a vibra device that can play the given feedback.
+ *
+ * Returns:(transfer none)(nullable): The vibra device
+ */
+FbdDevVibra *
+fbd_feedback_manager_find_dev_vibra (FbdFeedbackManager *self, FbdFeedbackVibra *fb)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), NULL);
+
+  for (guint i = 0; self->vibras && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (fbd_feedback_vibra_supports_device (fb, actuator->dev))
+      return actuator->dev;
+  }
+
+  return NULL;
+}
+
+/**
+ * fbd_feedback_manager_get_idle_dev_vibra:
+ * @self: The feedback manager
+ *
+ * Get a vibra device that isn't used by an event's feedback, a
+ * haptic session or the haptic interface.
+ *
+ * Returns:(transfer none)(nullable): The vibra device
+ */
+FbdDevVibra *
+fbd_feedback_manager_get_idle_dev_vibra (FbdFeedbackManager *self)
 {
   g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), NULL);
 
-  return self->vibra;
+  for (guint i = 0; self->vibras && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    if (!vibra_actuator_busy (self, actuator))
+      return actuator->dev;
+  }
+
+  return NULL;
+}
+
+/**
+ * fbd_feedback_manager_apply_duty_budget:
+ * @self: The feedback manager
+ * @dev: The vibra device that's about to be used
+ *
+ * Applies the motor's duty cycle budget for haptic feedback that
+ * doesn't come from an event, e.g. via the haptic interface. Call
+ * fbd_feedback_manager_restore_duty_budget() once the motor is free
+ * again.
+ *
+ * Returns: `FALSE` if the budget is used up and the feedback should
+ *   be dropped
+ */
+gboolean
+fbd_feedback_manager_apply_duty_budget (FbdFeedbackManager *self, FbdDevVibra *dev)
+{
+  FbdVibraActuator *actuator;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), FALSE);
+
+  actuator = find_vibra_actuator (self, dev);
+  if (actuator == NULL)
+    return TRUE;
+
+  return apply_duty_budget (self, actuator, FALSE);
+}
+
+/**
+ * fbd_feedback_manager_restore_duty_budget:
+ * @self: The feedback manager
+ * @dev: The vibra device that isn't used anymore
+ *
+ * Undoes the weakening by fbd_feedback_manager_apply_duty_budget().
+ */
+void
+fbd_feedback_manager_restore_duty_budget (FbdFeedbackManager *self, FbdDevVibra *dev)
+{
+  FbdVibraActuator *actuator;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+
+  actuator = find_vibra_actuator (self, dev);
+  if (actuator)
+    restore_duty_scale (self, actuator);
 }
 
 FbdDevSound *
@@ -654,14 +3079,65 @@ fbd_feedback_manager_get_dev_leds (FbdFeedbackManager *self)
   return self->leds;
 }
 
-void
-fbd_feedback_manager_load_theme (FbdFeedbackManager *self)
+/*
+ * Let the sound server cache the theme's sounds so the first play
+ * doesn't lag. This walks all of the theme's feedbacks so it happens
+ * once the daemon is idle.
+ */
+static gboolean
+preload_sounds (gpointer user_data)
 {
-  g_autoptr (FbdThemeExpander) expander = NULL;
-  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  FbdFeedbackManager *self = FBD_FEEDBACK_MANAGER (user_data);
+  g_autoptr (GHashTable) effects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autofree const char **names = NULL;
+
+  self->preload_id = 0;
+
+  if (!self->sound || !self->theme)
+    return G_SOURCE_REMOVE;
+
+  for (int level = 0; level < FBD_FEEDBACK_PROFILE_N_PROFILES; level++) {
+    const char *name = fbd_feedback_profile_level_to_string (level);
+    FbdFeedbackProfile *profile = fbd_feedback_theme_get_profile (self->theme, name);
+
+    if (profile)
+      fbd_feedback_profile_collect_sound_effects (profile, effects);
+  }
+
+  names = (const char **)g_hash_table_get_keys_as_array (effects, NULL);
+  fbd_dev_sound_preload (self->sound, names);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+set_theme (FbdFeedbackManager *self, FbdFeedbackTheme *theme)
+{
+  g_set_object (&self->theme, theme);
+  if (self->preload_id == 0)
+    self->preload_id = g_idle_add_full (G_PRIORITY_LOW, preload_sounds, self, NULL);
+  capabilities_changed (self);
+}
+
+
+static void
+on_theme_changed (FbdFeedbackManager *self, FbdFeedbackTheme *theme)
+{
+  g_debug ("Theme files changed, updating theme");
+  /* Running events keep their feedbacks */
+  set_theme (self, theme);
+}
+
+
+static FbdThemeExpander *
+new_theme_expander (FbdFeedbackManager *self)
+{
+  FbdThemeExpander *expander;
   g_autoptr (GError) err = NULL;
   g_auto (GStrv) compatibles = NULL;
   g_autofree char *theme_name = NULL;
+  g_autofree char *cache_dir = NULL;
   const char *theme_file = g_getenv (FEEDBACKD_THEME_VAR);
 
   compatibles = gm_device_tree_get_compatibles (NULL, &err);
@@ -675,9 +3151,28 @@ fbd_feedback_manager_load_theme (FbdFeedbackManager *self)
 
   expander = fbd_theme_expander_new ((const char *const *)compatibles,
                                      theme_name, theme_file);
-  theme = fbd_theme_expander_load_theme_files (expander, &err);
+  cache_dir = g_build_filename (g_get_user_cache_dir (), "feedbackd", "themes", NULL);
+  fbd_theme_expander_set_cache_dir (expander, cache_dir);
+  fbd_theme_expander_set_system_cache_dir (expander, FEEDBACKD_THEME_CACHE_DIR);
+  fbd_theme_expander_set_watch (expander, TRUE);
+
+  return expander;
+}
+
+
+static void
+use_theme (FbdFeedbackManager *self,
+           FbdThemeExpander   *expander,
+           FbdFeedbackTheme   *theme,
+           GError             *err)
+{
   if (theme) {
-    g_set_object(&self->theme, theme);
+    g_signal_connect_object (expander, "theme-changed",
+                             G_CALLBACK (on_theme_changed),
+                             self,
+                             G_CONNECT_SWAPPED);
+    g_set_object (&self->expander, expander);
+    set_theme (self, theme);
   } else {
     if (self->theme)
       g_warning ("Failed to reload theme: %s", err->message);
@@ -688,14 +3183,209 @@ fbd_feedback_manager_load_theme (FbdFeedbackManager *self)
 
 
 static void
-cancel_running (FbdFeedbackManager *self)
+on_theme_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdThemeExpander *expander = FBD_THEME_EXPANDER (source_object);
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (GError) err = NULL;
+  FbdFeedbackManager *self;
+
+  theme = fbd_theme_expander_load_theme_files_finish (expander, res, &err);
+  /* Superseded by a newer load or the manager is gone */
+  if (theme == NULL && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = FBD_FEEDBACK_MANAGER (user_data);
+  g_clear_object (&self->theme_cancel);
+
+  g_debug ("Theme loaded, switching over");
+  use_theme (self, expander, theme, err);
+}
+
+/**
+ * fbd_feedback_manager_load_theme:
+ * @self: The feedback manager
+ *
+ * Loads the configured theme. The initial load happens right away
+ * as there's nothing to serve events from otherwise. Later loads
+ * happen in a worker thread. Events get looked up in the current
+ * theme until the new one is ready and running events keep their
+ * feedbacks.
+ */
+void
+fbd_feedback_manager_load_theme (FbdFeedbackManager *self)
+{
+  g_autoptr (FbdThemeExpander) expander = NULL;
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_MANAGER (self));
+
+  /* Only the latest load matters */
+  g_cancellable_cancel (self->theme_cancel);
+  g_clear_object (&self->theme_cancel);
+
+  expander = new_theme_expander (self);
+
+  if (self->theme) {
+    self->theme_cancel = g_cancellable_new ();
+    fbd_theme_expander_load_theme_files_async (expander,
+                                               self->theme_cancel,
+                                               on_theme_loaded,
+                                               self);
+    return;
+  }
+
+  theme = fbd_theme_expander_load_theme_files (expander, &err);
+  use_theme (self, expander, theme, err);
+}
+
+
+static gboolean
+event_has_feedback (FbdEvent *event, FbdFeedbackBase *feedback, GType type)
+{
+  for (GSList *l = fbd_event_get_playbacks (event); l; l = l->next) {
+    FbdFeedbackPlayback *playback = l->data;
+
+    if (playback->feedback == feedback)
+      return TRUE;
+    if (type && G_TYPE_CHECK_INSTANCE_TYPE (playback->feedback, type))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * raise_event:
+ * @self: The feedback manager
+ * @event: The running event
+ * @profile: The event's profile
+ * @from: The event's current level
+ * @to: The event's new level
+ *
+ * Starts the event's feedbacks from above @from up to @to that aren't
+ * running yet, e.g. the ringtone's sound when switching from quiet to
+ * full during an incoming call.
+ *
+ * Returns: The number of started feedbacks
+ */
+static guint
+raise_event (FbdFeedbackManager      *self,
+             FbdEvent                *event,
+             FbdEventProfile         *profile,
+             FbdFeedbackProfileLevel  from,
+             FbdFeedbackProfileLevel  to)
+{
+  g_autoptr (GPtrArray) started = g_ptr_array_new ();
+  gboolean has_sound = event_has_feedback (event, NULL, FBD_TYPE_FEEDBACK_SOUND);
+  gboolean has_vibra = event_has_feedback (event, NULL, FBD_TYPE_FEEDBACK_VIBRA);
+  guint len = profile->feedbacks ? profile->feedbacks->len : 0;
+  FbdFeedbackPlayback **added;
+
+  if (!fbd_event_get_looping (event))
+    return 0;
+
+  added = g_newa (FbdFeedbackPlayback *, MAX (len, 1));
+  memset (added, 0, sizeof (FbdFeedbackPlayback *) * len);
+
+  if (profile->sound_file && !has_sound &&
+      from < FBD_FEEDBACK_PROFILE_LEVEL_FULL && to >= FBD_FEEDBACK_PROFILE_LEVEL_FULL) {
+    g_autoptr (FbdFeedbackSound) sound = NULL;
+
+    sound = fbd_feedback_sound_new_from_file_name (profile->sound_file);
+    g_ptr_array_add (started, fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (sound),
+                                                      FBD_FEEDBACK_PROFILE_LEVEL_FULL));
+    has_sound = TRUE;
+  }
+
+  for (guint i = 0; profile->feedbacks && i < profile->feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (profile->feedbacks, FbdFeedbackThemeEntry, i);
+    g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+    if (entry->level <= from || entry->level > to)
+      continue;
+
+    if (!fbd_feedback_is_available (entry->feedback))
+      continue;
+
+    if (FBD_IS_FEEDBACK_SOUND (entry->feedback) && has_sound)
+      continue;
+
+    if (event_has_feedback (event, entry->feedback, G_TYPE_INVALID))
+      continue;
+
+    playback = fbd_feedback_playback_new (entry->feedback, entry->level);
+    if (FBD_IS_FEEDBACK_VIBRA (entry->feedback)) {
+      if (has_vibra || !claim_vibra (self, playback, profile->important))
+        continue;
+      has_vibra = TRUE;
+    }
+
+    fbd_feedback_playback_set_after (playback,
+                                     find_predecessor (profile->feedbacks, added, entry->after));
+    fbd_event_add_playback (event, playback);
+    g_ptr_array_add (started, playback);
+    added[i] = playback;
+  }
+
+  /* Started by the event once their predecessor ended */
+  for (guint i = 0; i < started->len; i++) {
+    if (fbd_feedback_playback_get_after (g_ptr_array_index (started, i)))
+      g_ptr_array_remove_index (started, i--);
+  }
+  fbd_feedback_playbacks_run (started);
+
+  return started->len;
+}
+
+/**
+ * transition_running:
+ * @self: The feedback manager
+ *
+ * Moves the running events to the new global profile level. Only
+ * feedbacks the new level doesn't allow anymore are ended, feedbacks
+ * the new level allows in addition are started. Important events are
+ * not affected.
+ */
+static void
+transition_running (FbdFeedbackManager *self)
 {
-  g_autoptr (GList) running = g_hash_table_get_values (self->events);
+  g_autoptr (GList) running = NULL;
+
+  /* Events already at the new level stay as they are */
+  for (int level = 0; level < FBD_FEEDBACK_PROFILE_N_PROFILES; level++) {
+    if (level != self->level)
+      running = g_list_concat (running, g_hash_table_get_keys (self->level_events[level]));
+  }
+  g_list_foreach (running, (GFunc)g_object_ref, NULL);
 
   for (GList *l = running; l ; l = l->next) {
-    FbdEvent *event = FBD_EVENT (l->data);
+    g_autoptr (FbdEvent) event = l->data;
+    FbdEventProfile *profile = g_object_get_data (G_OBJECT (event), "fbd-profile");
+    FbdFeedbackProfileLevel from, to;
+
+    from = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (event), "fbd-level"));
+    if (profile == NULL || profile->important)
+      continue;
+
+    to = MIN (self->level, profile->wanted);
+    if (to == from)
+      continue;
+
+    if (to < from) {
+      fbd_event_end_feedbacks_by_level (event, to);
+    } else if (raise_event (self, event, profile, from, to)) {
+      g_debug ("Raised event %s from %s to %s", fbd_event_get_event (event),
+               fbd_feedback_profile_level_to_string (from),
+               fbd_feedback_profile_level_to_string (to));
+    }
 
-    fbd_event_end_feedbacks_by_level (event, self->level);
+    /* Still running, so only feedbacks up to the new level are left */
+    if (g_hash_table_remove (self->level_events[from], event)) {
+      g_object_set_data (G_OBJECT (event), "fbd-level", GUINT_TO_POINTER (to));
+      g_hash_table_add (self->level_events[to], event);
+    }
   }
 }
 
@@ -716,11 +3406,14 @@ fbd_feedback_manager_set_profile (FbdFeedbackManager *self, const gchar *profile
     return TRUE;
 
   g_debug ("Switching profile to '%s'", profile);
+  fbd_recorder_add (fbd_recorder_get_default (), FBD_RECORD_KIND_PROFILE, NULL, NULL, profile,
+                    NULL, 0, 0, FBD_RECORD_RESULT_OK);
   self->level = level;
   lfb_gdbus_feedback_set_profile (LFB_GDBUS_FEEDBACK (self), profile);
   g_settings_set_string (self->settings, FEEDBACKD_KEY_PROFILE, profile);
 
-  cancel_running (self);
+  transition_running (self);
+  capabilities_changed (self);
 
   return TRUE;
 }
@@ -734,6 +3427,93 @@ fbd_feedback_manager_get_haptic_manager (FbdFeedbackManager *self)
   return self->haptic_manager;
 }
 
+/**
+ * fbd_feedback_manager_admit:
+ * @self: The feedback manager
+ * @sender: The DBus name of the client
+ * @n_requests: The number of requests the client wants to submit
+ *
+ * Checks whether the client is within its configured rate limit and if
+ * so accounts for the submitted requests. Each client gets a token
+ * bucket that holds `rate-limit-burst` tokens and refills at
+ * `rate-limit-rate` tokens per second.
+ *
+ * Returns: `TRUE` if the requests should be processed, `FALSE` if the
+ *   client is rate limited
+ */
+gboolean
+fbd_feedback_manager_admit (FbdFeedbackManager *self, const char *sender, guint n_requests)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), FALSE);
+
+  if (!fbd_rate_limiter_admit (self->rate_limiter, sender, n_requests, g_get_monotonic_time ())) {
+    g_debug ("Rate limiting %s", sender);
+    fbd_stats_count (fbd_stats_get_default (), FBD_STATS_COUNTER_RATE_LIMITED);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * fbd_feedback_manager_get_vibra_busy:
+ * @self: The feedback manager
+ *
+ * Whether all haptic motors are in use by an event's feedback or the
+ * haptic interface.
+ *
+ * Returns: `TRUE` if the haptic motors are busy
+ */
+gboolean
+fbd_feedback_manager_get_vibra_busy (FbdFeedbackManager *self)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), FALSE);
+
+  if (self->vibras == NULL || self->vibras->len == 0)
+    return FALSE;
+
+  return fbd_feedback_manager_get_idle_dev_vibra (self) == NULL;
+}
+
+/**
+ * fbd_feedback_manager_get_idle_time:
+ * @self: The feedback manager
+ *
+ * Gets for how long the daemon didn't do anything. The daemon is busy
+ * while events are running, devices get probed, a motor is in use,
+ * effects are prepared, haptic sessions are open, the theme is
+ * loaded or clients are connected directly.
+ *
+ * Returns: The idle time in microseconds, `0` when busy
+ */
+gint64
+fbd_feedback_manager_get_idle_time (FbdFeedbackManager *self)
+{
+  gint64 now = g_get_monotonic_time ();
+  gboolean busy;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), 0);
+
+  busy = g_hash_table_size (self->events) ||
+    g_hash_table_size (self->peers) ||
+    self->n_probes ||
+    self->theme_cancel ||
+    (self->haptic_manager && fbd_haptic_manager_has_session (self->haptic_manager, NULL));
+
+  for (guint i = 0; !busy && i < self->vibras->len; i++) {
+    FbdVibraActuator *actuator = g_ptr_array_index (self->vibras, i);
+
+    busy = vibra_actuator_busy (self, actuator) || fbd_dev_vibra_has_prepared (actuator->dev);
+  }
+
+  if (busy) {
+    self->last_activity = now;
+    return 0;
+  }
+
+  return now - self->last_activity;
+}
+
 /**
  * fbd_feedback_manager_get_effective_level:
  * @self: The feedback manager
@@ -755,7 +3535,7 @@ fbd_feedback_manager_get_effective_level (FbdFeedbackManager      *self,
   gboolean can_important;
   FbdFeedbackProfileLevel app_level, level;
 
-  app_level = app_get_feedback_level (app_id);
+  app_level = app_get_feedback_level (self, app_id);
   can_important = app_is_important (self, app_id);
 
   if (important && can_important) {
@@ -766,3 +3546,53 @@ fbd_feedback_manager_get_effective_level (FbdFeedbackManager      *self,
 
   return level;
 }
+
+static gboolean
+add_peer (FbdFeedbackManager *self, GDBusConnection *conn, const char *opener, GError **error)
+{
+  FbdPeer *peer;
+
+  if (g_hash_table_size (self->peers) >= MAX_PEER_CONNECTIONS) {
+    g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED, "Too many peer connections");
+    return FALSE;
+  }
+
+  if (!fbd_dispatcher_export (fbd_dispatcher_get_default (),
+                              G_DBUS_INTERFACE_SKELETON (self),
+                              conn,
+                              FB_DBUS_PATH,
+                              error)) {
+    return FALSE;
+  }
+
+  peer = g_new0 (FbdPeer, 1);
+  peer->name = g_strdup_printf ("peer-%u", ++self->next_peer);
+  peer->opener = g_strdup (opener);
+  g_debug ("New peer connection %s opened by %s", peer->name, opener ?: "broker");
+  g_hash_table_insert (self->peers, g_object_ref (conn), peer);
+  g_signal_connect_object (conn, "closed", G_CALLBACK (on_peer_closed), self, G_CONNECT_SWAPPED);
+
+  return TRUE;
+}
+
+/**
+ * fbd_feedback_manager_add_peer:
+ * @self: The feedback manager
+ * @conn: A peer to peer connection
+ * @error: return location for error or %NULL
+ *
+ * Exports the feedback interface on @conn and tracks the peer until
+ * the connection closes. Used for the sessions connecting to a
+ * broker, connections handed out via `OpenPeerConnection` are added
+ * internally. The caller needs to start message processing on @conn.
+ *
+ * Returns: `TRUE` if the peer was added
+ */
+gboolean
+fbd_feedback_manager_add_peer (FbdFeedbackManager *self, GDBusConnection *conn, GError **error)
+{
+  g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (self), FALSE);
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (conn), FALSE);
+
+  return add_peer (self, conn, NULL, error);
+}
@@ -9,6 +9,7 @@
 #include "fbd-dev-leds.h"
 #include "fbd-dev-sound.h"
 #include "fbd-feedback-profile.h"
+#include "fbd-feedback-vibra.h"
 #include "fbd-haptic-manager.h"
 
 #include "lfb-gdbus.h"
@@ -29,10 +30,25 @@ G_DECLARE_FINAL_TYPE (FbdFeedbackManager, fbd_feedback_manager, FBD, FEEDBACK_MA
 FbdFeedbackManager *fbd_feedback_manager_get_default (void);
 FbdHapticManager   *fbd_feedback_manager_get_haptic_manager (FbdFeedbackManager *self);
 FbdDevVibra *fbd_feedback_manager_get_dev_vibra (FbdFeedbackManager *self);
+FbdDevVibra *fbd_feedback_manager_find_dev_vibra (FbdFeedbackManager *self,
+                                                  FbdFeedbackVibra   *fb);
+FbdDevVibra *fbd_feedback_manager_get_idle_dev_vibra (FbdFeedbackManager *self);
+gboolean     fbd_feedback_manager_apply_duty_budget (FbdFeedbackManager *self,
+                                                     FbdDevVibra        *dev);
+void         fbd_feedback_manager_restore_duty_budget (FbdFeedbackManager *self,
+                                                       FbdDevVibra        *dev);
 FbdDevSound *fbd_feedback_manager_get_dev_sound (FbdFeedbackManager *self);
 FbdDevLeds  *fbd_feedback_manager_get_dev_leds  (FbdFeedbackManager *self);
 void         fbd_feedback_manager_load_theme    (FbdFeedbackManager *self);
 gboolean     fbd_feedback_manager_set_profile (FbdFeedbackManager *self, const gchar *profile);
+gboolean     fbd_feedback_manager_admit (FbdFeedbackManager *self,
+                                         const char         *sender,
+                                         guint               n_requests);
+gboolean     fbd_feedback_manager_get_vibra_busy (FbdFeedbackManager *self);
+gint64       fbd_feedback_manager_get_idle_time (FbdFeedbackManager *self);
+gboolean     fbd_feedback_manager_add_peer (FbdFeedbackManager *self,
+                                            GDBusConnection    *conn,
+                                            GError            **error);
 FbdFeedbackProfileLevel fbd_feedback_manager_get_effective_level (FbdFeedbackManager      *self,
                                                                   const char              *app_id,
                                                                   FbdFeedbackProfileLevel  want_level,
@@ -7,10 +7,13 @@
 #define G_LOG_DOMAIN "fbd-feedback-profile"
 
 #include "fbd-feedback-dummy.h"
+#include "fbd-feedback-group.h"
 #include "fbd-feedback-profile.h"
 #include "fbd-feedback-sound.h"
 #include "fbd-feedback-led.h"
 #include "fbd-feedback-vibra-pattern.h"
+#include "fbd-feedback-vibra-custom.h"
+#include "fbd-feedback-vibra-envelope.h"
 #include "fbd-feedback-vibra-periodic.h"
 #include "fbd-feedback-vibra-rumble.h"
 
@@ -37,15 +40,34 @@ typedef struct _FbdFeedbackProfile {
 
   gchar *name;
   GHashTable *feedbacks; /* key: event name, value: feedback */
+  /* Not yet materialized feedbacks, key: event name, value: JsonNode */
+  GHashTable *nodes;
+  /* Not yet materialized feedbacks from the theme cache: a(ss) */
+  GVariant *cached;
+  /* Lower layer consulted for events not in this profile */
+  FbdFeedbackProfile *lower;
+  /* Whether the above tables are shared with another profile */
+  gboolean shared;
 } FbdFeedbackProfile;
 
 static void json_serializable_iface_init (JsonSerializableIface *iface);
+static void materialize_all (FbdFeedbackProfile *self);
+static void foreach_visible_feedback (FbdFeedbackProfile *self,
+                                      GHashTable         *seen,
+                                      GFunc               func,
+                                      gpointer            user_data);
 
 G_DEFINE_TYPE_WITH_CODE (FbdFeedbackProfile, fbd_feedback_profile, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (JSON_TYPE_SERIALIZABLE,
                                                 json_serializable_iface_init));
 
 
+static void
+serialize_feedback (FbdFeedbackBase *feedback, JsonArray *array)
+{
+  json_array_add_element (array, json_gobject_serialize (G_OBJECT (feedback)));
+}
+
 static JsonNode *
 fbd_feedback_profile_serializable_serialize_property (JsonSerializable *serializable,
                                                       const gchar *property_name,
@@ -56,15 +78,11 @@ fbd_feedback_profile_serializable_serialize_property (JsonSerializable *serializ
   JsonNode *node = NULL;
 
   if (g_strcmp0 (property_name, "feedbacks") == 0) {
-    GHashTableIter iter;
-    gpointer key;
-    FbdFeedbackProfile *profile;
     g_autoptr (JsonArray) array = json_array_sized_new (FBD_FEEDBACK_PROFILE_N_PROFILES);
+    g_autoptr (GHashTable) seen = g_hash_table_new (g_str_hash, g_str_equal);
 
-    g_hash_table_iter_init (&iter, self->feedbacks);
-    while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *) &profile)) {
-      json_array_add_element (array, json_gobject_serialize (G_OBJECT(profile)));
-    }
+    /* Serialize the flattened profile including the lower layers */
+    foreach_visible_feedback (self, seen, (GFunc)serialize_feedback, array);
     node = json_node_init_array (json_node_alloc (), array);
   } else {
     node = json_serializable_default_serialize_property (serializable,
@@ -78,32 +96,56 @@ fbd_feedback_profile_serializable_serialize_property (JsonSerializable *serializ
 static GType
 feedback_get_type (JsonNode *feedback_node)
 {
-  g_autofree gchar *type_name = NULL;
   JsonObject *obj = json_node_get_object (feedback_node);
   JsonNode *type_node = json_object_get_member (obj, "type");
-  GType gtype = 0;
-
-  /* Ensure all feedback types so the json parsing can use them */
-  g_type_ensure (FBD_TYPE_FEEDBACK_DUMMY);
-  g_type_ensure (FBD_TYPE_FEEDBACK_LED);
-  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_PATTERN);
-  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_PERIODIC);
-  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_RUMBLE);
-  g_type_ensure (FBD_TYPE_FEEDBACK_SOUND);
+  GType gtype;
 
   g_return_val_if_fail (type_node, FBD_TYPE_FEEDBACK_DUMMY);
 
-  type_name = g_strdup_printf ("FbdFeedback%s",
-                               json_node_get_string (type_node));
-  type_name[strlen(FBD_FEEDBACK_CLS_PREFIX)] =
-    g_ascii_toupper (type_name[strlen(FBD_FEEDBACK_CLS_PREFIX)]);
-  gtype = g_type_from_name (type_name);
-
-  g_debug ("Feedback %s, type %" G_GSIZE_FORMAT, type_name, gtype);
+  gtype = fbd_feedback_profile_get_feedback_type (json_node_get_string (type_node));
   g_return_val_if_fail (gtype, FBD_TYPE_FEEDBACK_DUMMY);
   return gtype;
 }
 
+static FbdFeedbackBase *
+feedback_from_node (JsonNode *feedback_node)
+{
+  GType gtype = feedback_get_type (feedback_node);
+
+  return FBD_FEEDBACK_BASE (json_gobject_deserialize (gtype, feedback_node));
+}
+
+static void
+collect_node_sound_effect (JsonNode *feedback_node, GHashTable *effects)
+{
+  JsonObject *obj;
+  const char *effect;
+
+  if (!JSON_NODE_HOLDS_OBJECT (feedback_node))
+    return;
+
+  obj = json_node_get_object (feedback_node);
+  if (feedback_get_type (feedback_node) == FBD_TYPE_FEEDBACK_GROUP &&
+      json_object_has_member (obj, "feedbacks")) {
+    JsonArray *feedbacks = json_object_get_array_member (obj, "feedbacks");
+
+    for (guint i = 0; feedbacks && i < json_array_get_length (feedbacks); i++)
+      collect_node_sound_effect (json_array_get_element (feedbacks, i), effects);
+    return;
+  }
+
+  if (feedback_get_type (feedback_node) != FBD_TYPE_FEEDBACK_SOUND)
+    return;
+
+  effect = json_object_get_string_member_with_default (obj, "effect", NULL);
+  if (effect)
+    g_hash_table_add (effects, g_strdup (effect));
+}
+
+/*
+ * Feedbacks aren't built when parsing the theme but on first lookup
+ * so only the JSON nodes are kept.
+ */
 static gboolean
 fbd_feedback_profile_serializable_deserialize_property (JsonSerializable *serializable,
                                                         const gchar *property_name,
@@ -111,6 +153,8 @@ fbd_feedback_profile_serializable_deserialize_property (JsonSerializable *serial
                                                         GParamSpec *pspec,
                                                         JsonNode *property_node)
 {
+  FbdFeedbackProfile *self = FBD_FEEDBACK_PROFILE (serializable);
+
   if (g_strcmp0 (property_name, "feedbacks") == 0) {
     if (JSON_NODE_TYPE (property_node) == JSON_NODE_NULL) {
       g_value_set_pointer (value, NULL);
@@ -126,14 +170,17 @@ fbd_feedback_profile_serializable_deserialize_property (JsonSerializable *serial
         JsonNode *element_node = json_array_get_element (array, i);
 
         if (JSON_NODE_HOLDS_OBJECT (element_node)) {
-          gchar *event_name;
-          FbdFeedbackBase *feedback;
-          GType gtype = feedback_get_type (element_node);
-
-          feedback = FBD_FEEDBACK_BASE (json_gobject_deserialize (gtype, element_node));
-          event_name = g_strdup (fbd_feedback_get_event_name (FBD_FEEDBACK_BASE(feedback)));
-          g_hash_table_insert (feedbacks, event_name, feedback);
+          JsonObject *obj = json_node_get_object (element_node);
+          const char *event_name;
+
+          event_name = json_object_get_string_member_with_default (obj, "event-name", NULL);
+          if (event_name == NULL) {
+            g_warning ("Feedback without event name in profile %s", self->name);
+            continue;
+          }
+          g_hash_table_insert (self->nodes, g_strdup (event_name), json_node_ref (element_node));
         } else {
+          g_hash_table_unref (feedbacks);
           return FALSE;
         }
       }
@@ -189,6 +236,7 @@ fbd_feedback_profile_get_property (GObject  *object,
     g_value_set_string (value, self->name);
     break;
   case PROP_FEEDBACKS:
+    materialize_all (self);
     g_value_set_boxed (value, self->feedbacks);
     break;
   default:
@@ -203,6 +251,9 @@ fbd_feedback_profile_dispose (GObject *object)
   FbdFeedbackProfile *self = FBD_FEEDBACK_PROFILE (object);
 
   g_clear_pointer (&self->feedbacks, g_hash_table_unref);
+  g_clear_pointer (&self->nodes, g_hash_table_unref);
+  g_clear_pointer (&self->cached, g_variant_unref);
+  g_clear_object (&self->lower);
 
   G_OBJECT_CLASS (fbd_feedback_profile_parent_class)->dispose (object);
 }
@@ -276,6 +327,10 @@ fbd_feedback_profile_class_init (FbdFeedbackProfileClass *klass)
 static void
 fbd_feedback_profile_init (FbdFeedbackProfile *self)
 {
+  self->nodes = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify)json_node_unref);
 }
 
 FbdFeedbackProfile *
@@ -286,6 +341,256 @@ fbd_feedback_profile_new (const gchar *name)
                       NULL);
 }
 
+/**
+ * fbd_feedback_profile_new_from_cache:
+ * @name: The profile name
+ * @feedbacks: The profile's feedbacks as `a(ss)` of event name and the
+ *   feedback's JSON description sorted by event name
+ *
+ * Creates a profile from the theme cache. Feedbacks are only
+ * built when looked up.
+ *
+ * Returns: The new profile
+ */
+FbdFeedbackProfile *
+fbd_feedback_profile_new_from_cache (const gchar *name, GVariant *feedbacks)
+{
+  FbdFeedbackProfile *self = fbd_feedback_profile_new (name);
+
+  g_return_val_if_fail (g_variant_is_of_type (feedbacks, G_VARIANT_TYPE ("a(ss)")), self);
+
+  self->cached = g_variant_ref_sink (feedbacks);
+
+  return self;
+}
+
+/**
+ * fbd_feedback_profile_new_overlay:
+ * @layer: The profile providing the feedbacks
+ * @lower:(nullable): The profile for events not in @layer
+ *
+ * Creates a profile that shares @layer's feedbacks instead of copying
+ * them. Events not found in @layer are looked up in @lower. This
+ * makes stacking theme layers cheap as the cost doesn't depend on the
+ * number of feedbacks. The feedback tables are only copied once the
+ * new profile or @layer gets modified.
+ *
+ * Returns: The new profile
+ */
+FbdFeedbackProfile *
+fbd_feedback_profile_new_overlay (FbdFeedbackProfile *layer, FbdFeedbackProfile *lower)
+{
+  FbdFeedbackProfile *self;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_PROFILE (layer), NULL);
+  g_return_val_if_fail (lower == NULL || FBD_IS_FEEDBACK_PROFILE (lower), NULL);
+  g_return_val_if_fail (lower == NULL || g_str_equal (layer->name, lower->name), NULL);
+
+  self = fbd_feedback_profile_new (layer->name);
+
+  /* Keep the layers of an overlay on top of @lower */
+  if (layer->lower) {
+    self->lower = fbd_feedback_profile_new_overlay (layer->lower, lower);
+    lower = NULL;
+  }
+
+  g_hash_table_unref (self->feedbacks);
+  self->feedbacks = g_hash_table_ref (layer->feedbacks);
+  g_hash_table_unref (self->nodes);
+  self->nodes = g_hash_table_ref (layer->nodes);
+  if (layer->cached)
+    self->cached = g_variant_ref (layer->cached);
+  if (lower)
+    self->lower = g_object_ref (lower);
+
+  self->shared = layer->shared = TRUE;
+
+  return self;
+}
+
+/*
+ * Make sure modifications don't affect profiles sharing the
+ * tables. Building feedbacks doesn't count as modification as the
+ * profile's content stays the same.
+ */
+static void
+unshare_tables (FbdFeedbackProfile *self)
+{
+  GHashTable *feedbacks, *nodes;
+  GHashTableIter iter;
+  const char *event_name;
+  gpointer value;
+
+  if (!self->shared)
+    return;
+
+  feedbacks = g_hash_table_new_full (g_str_hash,
+                                     g_str_equal,
+                                     g_free,
+                                     (GDestroyNotify)g_object_unref);
+  g_hash_table_iter_init (&iter, self->feedbacks);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, &value))
+    g_hash_table_insert (feedbacks, g_strdup (event_name), g_object_ref (value));
+
+  nodes = g_hash_table_new_full (g_str_hash,
+                                 g_str_equal,
+                                 g_free,
+                                 (GDestroyNotify)json_node_unref);
+  g_hash_table_iter_init (&iter, self->nodes);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, &value))
+    g_hash_table_insert (nodes, g_strdup (event_name), json_node_ref (value));
+
+  g_hash_table_unref (self->feedbacks);
+  self->feedbacks = feedbacks;
+  g_hash_table_unref (self->nodes);
+  self->nodes = nodes;
+  self->shared = FALSE;
+}
+
+
+static FbdFeedbackBase *
+materialize_feedback (FbdFeedbackProfile *self, gsize index)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  FbdFeedbackBase *feedback;
+  const char *event_name, *json;
+
+  g_variant_get_child (self->cached, index, "(&s&s)", &event_name, &json);
+
+  node = json_from_string (json, &err);
+  if (node == NULL || !JSON_NODE_HOLDS_OBJECT (node)) {
+    g_warning ("Invalid cached feedback for %s: %s", event_name, err ? err->message : "");
+    return NULL;
+  }
+
+  feedback = feedback_from_node (node);
+  g_hash_table_insert (self->feedbacks, g_strdup (event_name), feedback);
+
+  return feedback;
+}
+
+
+static FbdFeedbackBase *
+materialize_node (FbdFeedbackProfile *self, const char *event_name)
+{
+  g_autofree char *key = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  FbdFeedbackBase *feedback;
+
+  if (!g_hash_table_steal_extended (self->nodes, event_name, (gpointer *)&key, (gpointer *)&node))
+    return NULL;
+
+  feedback = feedback_from_node (node);
+  g_hash_table_insert (self->feedbacks, g_steal_pointer (&key), feedback);
+
+  return feedback;
+}
+
+
+static gssize
+find_cached (FbdFeedbackProfile *self, const char *event_name)
+{
+  gsize lo = 0, hi;
+
+  if (self->cached == NULL)
+    return -1;
+
+  hi = g_variant_n_children (self->cached);
+  while (lo < hi) {
+    gsize mid = lo + (hi - lo) / 2;
+    const char *name;
+    int cmp;
+
+    g_variant_get_child (self->cached, mid, "(&s&s)", &name, NULL);
+    cmp = strcmp (event_name, name);
+    if (cmp == 0)
+      return mid;
+    else if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return -1;
+}
+
+
+static FbdFeedbackBase *
+lookup_cached_feedback (FbdFeedbackProfile *self, const char *event_name)
+{
+  gssize index = find_cached (self, event_name);
+
+  if (index < 0)
+    return NULL;
+
+  return materialize_feedback (self, index);
+}
+
+
+static void
+materialize_all (FbdFeedbackProfile *self)
+{
+  g_autoptr (GList) event_names = g_hash_table_get_keys (self->nodes);
+  gsize n;
+
+  for (GList *l = event_names; l; l = l->next)
+    materialize_node (self, l->data);
+
+  if (self->cached == NULL)
+    return;
+
+  n = g_variant_n_children (self->cached);
+  for (gsize i = 0; i < n; i++) {
+    const char *event_name;
+
+    g_variant_get_child (self->cached, i, "(&s&s)", &event_name, NULL);
+    if (!g_hash_table_contains (self->feedbacks, event_name))
+      materialize_feedback (self, i);
+  }
+
+  g_clear_pointer (&self->cached, g_variant_unref);
+}
+
+/**
+ * fbd_feedback_profile_get_feedback_type:
+ * @type_name: The feedback type as used in themes like `Sound`
+ *
+ * Looks up the feedback class for a theme's feedback type.
+ *
+ * Returns: The feedback's type or `G_TYPE_INVALID` if unknown
+ */
+GType
+fbd_feedback_profile_get_feedback_type (const char *type_name)
+{
+  g_autofree gchar *name = NULL;
+  GType gtype;
+
+  /* Ensure all feedback types so the json parsing can use them */
+  g_type_ensure (FBD_TYPE_FEEDBACK_DUMMY);
+  g_type_ensure (FBD_TYPE_FEEDBACK_GROUP);
+  g_type_ensure (FBD_TYPE_FEEDBACK_LED);
+  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_CUSTOM);
+  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_ENVELOPE);
+  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_PATTERN);
+  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_PERIODIC);
+  g_type_ensure (FBD_TYPE_FEEDBACK_VIBRA_RUMBLE);
+  g_type_ensure (FBD_TYPE_FEEDBACK_SOUND);
+
+  if (type_name == NULL || type_name[0] == '\0')
+    return G_TYPE_INVALID;
+
+  name = g_strdup_printf (FBD_FEEDBACK_CLS_PREFIX "%s", type_name);
+  name[strlen(FBD_FEEDBACK_CLS_PREFIX)] = g_ascii_toupper (name[strlen(FBD_FEEDBACK_CLS_PREFIX)]);
+  gtype = g_type_from_name (name);
+
+  g_debug ("Feedback %s, type %" G_GSIZE_FORMAT, name, gtype);
+  if (!g_type_is_a (gtype, FBD_TYPE_FEEDBACK_BASE))
+    return G_TYPE_INVALID;
+
+  return gtype;
+}
+
 const char *
 fbd_feedback_profile_get_name (FbdFeedbackProfile *self)
 {
@@ -300,16 +605,74 @@ fbd_feedback_profile_add_feedback (FbdFeedbackProfile *self, FbdFeedbackBase *fe
   g_return_if_fail (FBD_IS_FEEDBACK_PROFILE (self));
   gchar *name = g_strdup (fbd_feedback_get_event_name (feedback));
 
-  /* TODO: allow for more than one feedback per event and profile */
+  unshare_tables (self);
+  /* Several feedbacks for the same event are put into a #FbdFeedbackGroup */
+  g_hash_table_remove (self->nodes, name);
   g_hash_table_insert (self->feedbacks, name, g_object_ref (feedback));
 }
 
 FbdFeedbackBase *
 fbd_feedback_profile_get_feedback (FbdFeedbackProfile *self, const char *event_name)
 {
+  FbdFeedbackBase *feedback;
+
   g_return_val_if_fail (FBD_IS_FEEDBACK_PROFILE (self), NULL);
 
-  return g_hash_table_lookup (self->feedbacks, event_name);
+  feedback = g_hash_table_lookup (self->feedbacks, event_name);
+  if (feedback == NULL && event_name)
+    feedback = materialize_node (self, event_name);
+  if (feedback == NULL && event_name)
+    feedback = lookup_cached_feedback (self, event_name);
+  if (feedback == NULL && self->lower)
+    feedback = fbd_feedback_profile_get_feedback (self->lower, event_name);
+
+  return feedback;
+}
+
+/* Upper layers hide the lower layers' feedbacks for the same event */
+static void
+foreach_visible_feedback (FbdFeedbackProfile *self,
+                          GHashTable         *seen,
+                          GFunc               func,
+                          gpointer            user_data)
+{
+  GHashTableIter iter;
+  const char *event_name;
+  FbdFeedbackBase *fb;
+
+  materialize_all (self);
+
+  g_hash_table_iter_init (&iter, self->feedbacks);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, (gpointer)&fb)) {
+    if (!g_hash_table_add (seen, (gpointer)event_name))
+      continue;
+    func (fb, user_data);
+  }
+
+  if (self->lower)
+    foreach_visible_feedback (self->lower, seen, func, user_data);
+}
+
+/**
+ * fbd_feedback_profile_foreach_feedback:
+ * @self: The profile
+ * @func: The function to call for each feedback
+ * @user_data: User data passed to `func`
+ *
+ * Calls `func` for each feedback in the profile. For overlays
+ * feedbacks of lower layers are included unless hidden by an upper
+ * layer.
+ */
+void
+fbd_feedback_profile_foreach_feedback (FbdFeedbackProfile *self, GFunc func, gpointer user_data)
+{
+  g_autoptr (GHashTable) seen = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_PROFILE (self));
+  g_return_if_fail (func);
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  foreach_visible_feedback (self, seen, func, user_data);
 }
 
 FbdFeedbackProfileLevel
@@ -361,6 +724,7 @@ fbd_feedback_profile_update (FbdFeedbackProfile *self, FbdFeedbackProfile *new)
   GHashTableIter iter;
   const char *event_name;
   FbdFeedbackBase *fb;
+  JsonNode *node;
 
   g_return_if_fail (FBD_IS_FEEDBACK_PROFILE (self));
   g_return_if_fail (FBD_IS_FEEDBACK_PROFILE (new));
@@ -368,8 +732,108 @@ fbd_feedback_profile_update (FbdFeedbackProfile *self, FbdFeedbackProfile *new)
   g_return_if_fail (g_str_equal (fbd_feedback_profile_get_name (self),
                                  fbd_feedback_profile_get_name (new)));
 
+  unshare_tables (self);
+
+  /* Feedbacks not built yet are merged as JSON nodes */
+  if (new->cached) {
+    gsize n = g_variant_n_children (new->cached);
+
+    for (gsize i = 0; i < n; i++) {
+      const char *json;
+
+      g_variant_get_child (new->cached, i, "(&s&s)", &event_name, &json);
+      if (g_hash_table_contains (new->feedbacks, event_name) ||
+          g_hash_table_contains (new->nodes, event_name))
+        continue;
+
+      node = json_from_string (json, NULL);
+      if (node == NULL)
+        continue;
+      g_hash_table_insert (new->nodes, g_strdup (event_name), node);
+    }
+    g_clear_pointer (&new->cached, g_variant_unref);
+  }
+
+  g_hash_table_iter_init (&iter, new->nodes);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, (gpointer)&node)) {
+    g_hash_table_remove (self->feedbacks, event_name);
+    g_hash_table_insert (self->nodes, g_strdup (event_name), json_node_ref (node));
+  }
+
   g_hash_table_iter_init (&iter, new->feedbacks);
   while (g_hash_table_iter_next (&iter, (gpointer)&event_name, (gpointer)&fb)) {
+    g_hash_table_remove (self->nodes, event_name);
     g_hash_table_insert (self->feedbacks, g_strdup (event_name), g_object_ref (fb));
   }
 }
+
+static void
+collect_sound_effects (FbdFeedbackProfile *self, GHashTable *effects, GHashTable *seen)
+{
+  GHashTableIter iter;
+  const char *event_name;
+  FbdFeedbackBase *fb;
+  JsonNode *node;
+
+  g_hash_table_iter_init (&iter, self->feedbacks);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, (gpointer)&fb)) {
+    const char *effect;
+
+    if (!g_hash_table_add (seen, (gpointer)event_name))
+      continue;
+
+    if (!FBD_IS_FEEDBACK_SOUND (fb))
+      continue;
+
+    effect = fbd_feedback_sound_get_effect (FBD_FEEDBACK_SOUND (fb));
+    if (effect)
+      g_hash_table_add (effects, g_strdup (effect));
+  }
+
+  g_hash_table_iter_init (&iter, self->nodes);
+  while (g_hash_table_iter_next (&iter, (gpointer)&event_name, (gpointer)&node)) {
+    if (g_hash_table_add (seen, (gpointer)event_name))
+      collect_node_sound_effect (node, effects);
+  }
+
+  if (self->cached) {
+    gsize n = g_variant_n_children (self->cached);
+
+    for (gsize i = 0; i < n; i++) {
+      g_autoptr (JsonNode) cached_node = NULL;
+      const char *json;
+
+      g_variant_get_child (self->cached, i, "(&s&s)", &event_name, &json);
+      if (!g_hash_table_add (seen, (gpointer)event_name))
+        continue;
+
+      cached_node = json_from_string (json, NULL);
+      if (cached_node)
+        collect_node_sound_effect (cached_node, effects);
+    }
+  }
+
+  if (self->lower)
+    collect_sound_effects (self->lower, effects, seen);
+}
+
+/**
+ * fbd_feedback_profile_collect_sound_effects:
+ * @self: The profile
+ * @effects: A set of strings to add the effect names to
+ *
+ * Adds the sound effect names of the profile's feedbacks to
+ * @effects. Feedbacks that weren't looked up yet aren't built for
+ * this. @effects needs to free its strings.
+ */
+void
+fbd_feedback_profile_collect_sound_effects (FbdFeedbackProfile *self, GHashTable *effects)
+{
+  g_autoptr (GHashTable) seen = NULL;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_PROFILE (self));
+  g_return_if_fail (effects);
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  collect_sound_effects (self, effects, seen);
+}
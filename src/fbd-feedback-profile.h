@@ -24,6 +24,10 @@ typedef enum _FbdFeedbackProfileLevel {
 G_DECLARE_FINAL_TYPE (FbdFeedbackProfile, fbd_feedback_profile, FBD, FEEDBACK_PROFILE, GObject);
 
 FbdFeedbackProfile      *fbd_feedback_profile_new (const gchar *name);
+FbdFeedbackProfile      *fbd_feedback_profile_new_from_cache (const gchar *name,
+                                                              GVariant    *feedbacks);
+FbdFeedbackProfile      *fbd_feedback_profile_new_overlay (FbdFeedbackProfile *layer,
+                                                           FbdFeedbackProfile *lower);
 void                     fbd_feedback_profile_update (FbdFeedbackProfile *self,
                                                       FbdFeedbackProfile *new);
 const gchar             *fbd_feedback_profile_get_name (FbdFeedbackProfile *self);
@@ -31,6 +35,12 @@ void                     fbd_feedback_profile_add_feedback (FbdFeedbackProfile *
                                                             FbdFeedbackBase *feedback);
 FbdFeedbackBase         *fbd_feedback_profile_get_feedback (FbdFeedbackProfile *self,
 							    const char *event_name);
+void                     fbd_feedback_profile_foreach_feedback (FbdFeedbackProfile *self,
+                                                                GFunc               func,
+                                                                gpointer            user_data);
+void                     fbd_feedback_profile_collect_sound_effects (FbdFeedbackProfile *self,
+                                                                     GHashTable         *effects);
+GType                    fbd_feedback_profile_get_feedback_type (const char *type_name);
 FbdFeedbackProfileLevel  fbd_feedback_profile_level (const char *name);
 const char*              fbd_feedback_profile_level_to_string (FbdFeedbackProfileLevel level);
 
@@ -40,14 +40,13 @@ typedef struct _FbdFeedbackSound {
 G_DEFINE_TYPE (FbdFeedbackSound, fbd_feedback_sound, FBD_TYPE_FEEDBACK_BASE);
 
 static void
-on_effect_finished (FbdFeedbackSound *self)
-
+on_effect_finished (FbdFeedbackPlayback *playback)
 {
-  fbd_feedback_base_done (FBD_FEEDBACK_BASE(self));
+  fbd_feedback_playback_done (playback);
 }
 
 static void
-fbd_feedback_sound_run (FbdFeedbackBase *base)
+fbd_feedback_sound_run (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackSound *self = FBD_FEEDBACK_SOUND (base);
   FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
@@ -55,18 +54,18 @@ fbd_feedback_sound_run (FbdFeedbackBase *base)
 
   g_return_if_fail (FBD_IS_DEV_SOUND (sound));
   g_debug ("Sound event %s", self->effect);
-  fbd_dev_sound_play (sound, self, on_effect_finished);
+  if (!fbd_dev_sound_play (sound, playback, on_effect_finished))
+    fbd_feedback_playback_done (playback);
 }
 
 
 static void
-fbd_feedback_sound_end (FbdFeedbackBase *base)
+fbd_feedback_sound_end (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackSound *self = FBD_FEEDBACK_SOUND (base);
   FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
   FbdDevSound *sound = fbd_feedback_manager_get_dev_sound (manager);
 
-  fbd_dev_sound_stop (sound, self);
+  fbd_dev_sound_stop (sound, playback);
 }
 
 static gboolean
@@ -148,6 +147,7 @@ fbd_feedback_sound_class_init (FbdFeedbackSoundClass *klass)
   object_class->set_property = fbd_feedback_sound_set_property;
   object_class->get_property = fbd_feedback_sound_get_property;
 
+  base_class->start_order = FBD_FEEDBACK_START_ORDER_FIRST;
   base_class->run = fbd_feedback_sound_run;
   base_class->end = fbd_feedback_sound_end;
   base_class->is_available = fbd_feedback_sound_is_available;
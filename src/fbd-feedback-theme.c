@@ -8,13 +8,18 @@
 
 #include "fbd-feedback-base.h"
 #include "fbd-feedback-dummy.h"
+#include "fbd-feedback-group.h"
 #include "fbd-feedback-sound.h"
 #include "fbd-feedback-theme.h"
 #include "fbd-feedback-vibra.h"
 #include "fbd-feedback-profile.h"
+#include "fbd-stats.h"
 
 #include <json-glib/json-glib.h>
 
+/* Event names without feedback kept per level, clients can send arbitrary names */
+#define FBD_FEEDBACK_THEME_MAX_MISSING 256
+
 enum {
   PROP_0,
   PROP_NAME,
@@ -31,6 +36,15 @@ typedef struct _FbdFeedbackTheme {
   char *parent_name;
 
   GHashTable *profiles;
+
+  /*
+   * Per level dispatch table. Key: event name quark, value: GArray of
+   * FbdFeedbackThemeEntry for all feedbacks from that level down to silent.
+   */
+  GHashTable *dispatch[FBD_FEEDBACK_PROFILE_N_PROFILES];
+  /* Per level set of event names that have no feedback */
+  GHashTable *missing[FBD_FEEDBACK_PROFILE_N_PROFILES];
+  gboolean    compiled;
 } FbdFeedbackTheme;
 
 static void json_serializable_iface_init (JsonSerializableIface *iface);
@@ -40,6 +54,18 @@ G_DEFINE_TYPE_WITH_CODE (FbdFeedbackTheme, fbd_feedback_theme, G_TYPE_OBJECT,
                                                 json_serializable_iface_init));
 
 
+static void
+fbd_feedback_theme_invalidate (FbdFeedbackTheme *self)
+{
+  for (int i = 0; i < FBD_FEEDBACK_PROFILE_N_PROFILES; i++) {
+    g_clear_pointer (&self->dispatch[i], g_hash_table_unref);
+    g_clear_pointer (&self->missing[i], g_hash_table_unref);
+  }
+
+  self->compiled = FALSE;
+}
+
+
 static JsonNode *
 fbd_theme_serializable_serialize_property (JsonSerializable *serializable,
 					   const gchar      *property_name,
@@ -135,6 +161,7 @@ fbd_feedback_theme_set_property (GObject      *object,
     if (self->profiles)
       g_hash_table_unref (self->profiles);
     self->profiles = g_value_get_boxed (value);
+    fbd_feedback_theme_invalidate (self);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -172,6 +199,7 @@ fbd_feedback_theme_dispose (GObject *object)
 {
   FbdFeedbackTheme *self = FBD_FEEDBACK_THEME (object);
 
+  fbd_feedback_theme_invalidate (self);
   g_clear_pointer (&self->profiles, g_hash_table_unref);
 
   G_OBJECT_CLASS (fbd_feedback_theme_parent_class)->dispose (object);
@@ -184,6 +212,7 @@ fbd_feedback_theme_finalize (GObject *object)
 
   g_clear_pointer (&self->parent_name, g_free);
   g_clear_pointer (&self->name, g_free);
+  fbd_stats_object_free (fbd_stats_get_default (), FBD_STATS_OBJECT_THEME, sizeof (*self));
 
   G_OBJECT_CLASS (fbd_feedback_theme_parent_class)->finalize (object);
 }
@@ -241,6 +270,7 @@ fbd_feedback_theme_init (FbdFeedbackTheme *self)
                                           g_str_equal,
                                           g_free,
                                           (GDestroyNotify)g_object_unref);
+  fbd_stats_object_new (fbd_stats_get_default (), FBD_STATS_OBJECT_THEME, sizeof (*self));
 }
 
 FbdFeedbackTheme *
@@ -252,6 +282,15 @@ fbd_feedback_theme_new (const gchar *name)
 }
 
 
+FbdFeedbackTheme *
+fbd_feedback_theme_new_from_node (JsonNode *node)
+{
+  g_return_val_if_fail (node, NULL);
+
+  return FBD_FEEDBACK_THEME (json_gobject_deserialize (FBD_TYPE_FEEDBACK_THEME, node));
+}
+
+
 FbdFeedbackTheme *
 fbd_feedback_theme_new_from_data (const gchar *data, GError **error)
 {
@@ -259,7 +298,7 @@ fbd_feedback_theme_new_from_data (const gchar *data, GError **error)
   if (!node)
     return NULL;
 
-  return FBD_FEEDBACK_THEME (json_gobject_deserialize (FBD_TYPE_FEEDBACK_THEME, node));
+  return fbd_feedback_theme_new_from_node (node);
 }
 
 
@@ -331,6 +370,7 @@ fbd_feedback_theme_add_profile (FbdFeedbackTheme *self, FbdFeedbackProfile *prof
   name = g_strdup (fbd_feedback_profile_get_name (profile));
 
   g_hash_table_insert (self->profiles, name, g_object_ref (profile));
+  fbd_feedback_theme_invalidate (self);
 }
 
 FbdFeedbackProfile *
@@ -341,26 +381,159 @@ fbd_feedback_theme_get_profile (FbdFeedbackTheme *self, const char *name)
   return g_hash_table_lookup (self->profiles, name);
 }
 
-GSList *
-fbd_feedback_theme_lookup_feedback (FbdFeedbackTheme *self,
-                                    FbdFeedbackProfileLevel level,
-                                    FbdEvent *event)
+/**
+ * fbd_feedback_theme_compile:
+ * @self: The feedback theme
+ *
+ * Sets up the per level dispatch table used by
+ * `fbd_feedback_theme_lookup_feedbacks()`. This happens automatically
+ * on the first lookup after the theme changed. The table's entries
+ * are filled on the first lookup of each event so feedbacks that
+ * are never triggered don't need to be built.
+ */
+void
+fbd_feedback_theme_compile (FbdFeedbackTheme *self)
 {
-  GSList *feedbacks = NULL;
+  g_return_if_fail (FBD_IS_FEEDBACK_THEME (self));
+
+  if (self->compiled)
+    return;
+
+  fbd_feedback_theme_invalidate (self);
+  for (int i = FBD_FEEDBACK_PROFILE_LEVEL_SILENT; i < FBD_FEEDBACK_PROFILE_N_PROFILES; i++) {
+    self->dispatch[i] = g_hash_table_new_full (g_direct_hash,
+                                               g_direct_equal,
+                                               NULL,
+                                               (GDestroyNotify)g_array_unref);
+    self->missing[i] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  self->compiled = TRUE;
+}
 
-  for (int i = level; i >= FBD_FEEDBACK_PROFILE_LEVEL_SILENT; i--) {
+
+static void
+theme_entry_clear (FbdFeedbackThemeEntry *entry)
+{
+  g_clear_object (&entry->feedback);
+}
+
+static void
+add_entry (GArray *feedbacks, FbdFeedbackBase *feedback, FbdFeedbackProfileLevel level, int after)
+{
+  FbdFeedbackThemeEntry entry;
+
+  entry.feedback = g_object_ref (feedback);
+  entry.level = level;
+  entry.after = after;
+  g_array_append_val (feedbacks, entry);
+}
+
+/*
+ * Collect the event's feedbacks from level silent up to `level`.
+ * Groups are flattened so running an event only needs a single pass
+ * over the entries.
+ */
+static GArray *
+build_feedbacks (FbdFeedbackTheme *self, FbdFeedbackProfileLevel level, const char *event_name)
+{
+  g_autoptr (GArray) feedbacks = g_array_new (FALSE, FALSE, sizeof (FbdFeedbackThemeEntry));
+
+  g_array_set_clear_func (feedbacks, (GDestroyNotify)theme_entry_clear);
+
+  for (int i = FBD_FEEDBACK_PROFILE_LEVEL_SILENT; i <= level; i++) {
     const char *profile_name = fbd_feedback_profile_level_to_string (i);
     FbdFeedbackProfile *profile = fbd_feedback_theme_get_profile (self, profile_name);
-    FbdFeedbackBase *feedback = fbd_feedback_profile_get_feedback (profile,
-								   fbd_event_get_event (event));
-    if (feedback) {
-      g_object_set_data (G_OBJECT (feedback), "fbd-level", GUINT_TO_POINTER (i));
-      feedbacks = g_slist_prepend (feedbacks, g_object_ref (feedback));
+    FbdFeedbackGroup *group;
+    FbdFeedbackBase *feedback;
+    GPtrArray *children;
+    gboolean sequential;
+
+    if (profile == NULL)
+      continue;
+
+    feedback = fbd_feedback_profile_get_feedback (profile, event_name);
+    if (feedback == NULL)
+      continue;
+
+    if (!FBD_IS_FEEDBACK_GROUP (feedback)) {
+      add_entry (feedbacks, feedback, i, -1);
+      continue;
+    }
+
+    group = FBD_FEEDBACK_GROUP (feedback);
+    children = fbd_feedback_group_get_feedbacks (group);
+    sequential = fbd_feedback_group_get_mode (group) == FBD_FEEDBACK_GROUP_MODE_SEQUENTIAL;
+    for (guint j = 0; children && j < children->len; j++) {
+      int after = (sequential && j > 0) ? (int)feedbacks->len - 1 : -1;
+
+      add_entry (feedbacks, g_ptr_array_index (children, j), i, after);
     }
   }
 
-  if (!g_slist_length (feedbacks))
-    g_debug ("No feedback for event %s", fbd_event_get_event (event));
+  if (feedbacks->len == 0)
+    return NULL;
+
+  return g_steal_pointer (&feedbacks);
+}
+
+/**
+ * fbd_feedback_theme_lookup_feedbacks:
+ * @self: The feedback theme
+ * @level: The feedback level
+ * @event_name: The event name
+ *
+ * Looks up the feedbacks for the given event at `level` and all
+ * lower levels. The feedbacks are shared by all events, use a
+ * #FbdFeedbackPlayback to run them. Events without feedback are
+ * remembered too so looking them up again is cheap.
+ *
+ * Returns:(transfer none)(nullable)(element-type FbdFeedbackThemeEntry): The
+ *   feedbacks or `NULL` if there are none. The array is only valid until the
+ *   theme changes.
+ */
+GArray *
+fbd_feedback_theme_lookup_feedbacks (FbdFeedbackTheme        *self,
+                                     FbdFeedbackProfileLevel  level,
+                                     const char              *event_name)
+{
+  GArray *feedbacks;
+  GQuark quark;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_THEME (self), NULL);
+  g_return_val_if_fail (event_name, NULL);
+
+  if (level < FBD_FEEDBACK_PROFILE_LEVEL_SILENT)
+    return NULL;
+
+  level = MIN (level, FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+
+  fbd_feedback_theme_compile (self);
+
+  quark = g_quark_try_string (event_name);
+  if (quark) {
+    feedbacks = g_hash_table_lookup (self->dispatch[level], GUINT_TO_POINTER (quark));
+    if (feedbacks)
+      return feedbacks;
+  }
+
+  if (g_hash_table_contains (self->missing[level], event_name))
+    return NULL;
+
+  feedbacks = build_feedbacks (self, level, event_name);
+  if (feedbacks == NULL) {
+    g_debug ("No feedback for event %s", event_name);
+    /* Start over rather than growing without bounds */
+    if (g_hash_table_size (self->missing[level]) >= FBD_FEEDBACK_THEME_MAX_MISSING)
+      g_hash_table_remove_all (self->missing[level]);
+    g_hash_table_add (self->missing[level], g_strdup (event_name));
+    return NULL;
+  }
+
+  /* Only intern event names the theme knows about, not arbitrary ones sent by clients */
+  quark = g_quark_from_string (event_name);
+  g_hash_table_insert (self->dispatch[level], GUINT_TO_POINTER (quark), feedbacks);
+
   return feedbacks;
 }
 
@@ -373,6 +546,10 @@ fbd_feedback_theme_lookup_feedback (FbdFeedbackTheme *self,
  * Merges two feedback themes. Feedbacks and profiles are read new
  * the `new` theme.  If feedback already exists in the same profile
  * of `self` it is overwritten with the feedback in `new`.
+ *
+ * The profiles of `new` aren't copied but layered on top of the
+ * existing ones (see `fbd_feedback_profile_new_overlay()`) so the
+ * cost only depends on the number of profiles.
  */
 void
 fbd_feedback_theme_update (FbdFeedbackTheme *self, FbdFeedbackTheme *new)
@@ -388,16 +565,13 @@ fbd_feedback_theme_update (FbdFeedbackTheme *self, FbdFeedbackTheme *new)
 
   g_hash_table_iter_init (&iter, new->profiles);
   while (g_hash_table_iter_next (&iter, (gpointer)&profile_name, (gpointer)&profile)) {
-    FbdFeedbackProfile *current;
+    FbdFeedbackProfile *current, *overlay;
 
     current = g_hash_table_lookup (self->profiles, profile_name);
-    if (current == NULL) {
-      current = fbd_feedback_profile_new (profile_name);
-      g_hash_table_insert (self->profiles,
-                           g_strdup (profile_name),
-                           current);
-    }
-
-    fbd_feedback_profile_update (current, profile);
+    overlay = fbd_feedback_profile_new_overlay (profile, current);
+    /* The overlay holds a ref on the replaced profile */
+    g_hash_table_insert (self->profiles, g_strdup (profile_name), overlay);
   }
+
+  fbd_feedback_theme_invalidate (self);
 }
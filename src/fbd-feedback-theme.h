@@ -11,6 +11,7 @@
 #include "fbd-feedback-profile.h"
 
 #include <glib-object.h>
+#include <json-glib/json-glib.h>
 
 G_BEGIN_DECLS
 
@@ -18,7 +19,23 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (FbdFeedbackTheme, fbd_feedback_theme, FBD, FEEDBACK_THEME, GObject);
 
+/**
+ * FbdFeedbackThemeEntry:
+ * @feedback: The feedback
+ * @level: The level of the profile the feedback is in
+ * @after: Index of the entry the feedback is started after or `-1` to
+ *   start it together with the event
+ *
+ * A feedback found by `fbd_feedback_theme_lookup_feedbacks()`.
+ */
+typedef struct _FbdFeedbackThemeEntry {
+  FbdFeedbackBase         *feedback;
+  FbdFeedbackProfileLevel  level;
+  int                      after;
+} FbdFeedbackThemeEntry;
+
 FbdFeedbackTheme   *fbd_feedback_theme_new (const char *name);
+FbdFeedbackTheme   *fbd_feedback_theme_new_from_node (JsonNode *node);
 FbdFeedbackTheme   *fbd_feedback_theme_new_from_data (const gchar *data, GError **error);
 FbdFeedbackTheme   *fbd_feedback_theme_new_from_file (const gchar *filename, GError **error);
 void                fbd_feedback_theme_update (FbdFeedbackTheme *self, FbdFeedbackTheme *from);
@@ -32,8 +49,9 @@ void                fbd_feedback_theme_add_profile (FbdFeedbackTheme *self,
 						    FbdFeedbackProfile *profile);
 FbdFeedbackProfile *fbd_feedback_theme_get_profile (FbdFeedbackTheme *self, const char *name);
 
-GSList             *fbd_feedback_theme_lookup_feedback (FbdFeedbackTheme *self,
-                                                        FbdFeedbackProfileLevel profile,
-                                                        FbdEvent *event);
+void                fbd_feedback_theme_compile (FbdFeedbackTheme *self);
+GArray             *fbd_feedback_theme_lookup_feedbacks (FbdFeedbackTheme        *self,
+                                                         FbdFeedbackProfileLevel  level,
+                                                         const char              *event_name);
 
 G_END_DECLS
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-feedback-vibra-custom"
+
+#include "fbd-feedback-vibra-priv.h"
+#include "fbd-feedback-vibra-custom.h"
+#include "fbd-feedback-manager.h"
+
+#include <gio/gio.h>
+
+#include <string.h>
+
+#define WAVEFORM_SUFFIX ".waveform"
+
+/**
+ * FbdFeedbackVibraCustom:
+ *
+ * Plays a custom waveform via a haptic motor
+ *
+ * The waveform is a named asset in `feedbackd/waveforms/` in the
+ * XDG data dirs. It holds driver specific 16 bit samples (e.g. an
+ * index into the driver's effect library) separated by whitespace,
+ * `#` starts a comment. The waveform is loaded when first used and
+ * then stays uploaded to the device.
+ */
+
+enum {
+  PROP_0,
+  PROP_WAVEFORM,
+  PROP_MAGNITUDE,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef struct _FbdFeedbackVibraCustom {
+  FbdFeedbackVibra parent;
+
+  char            *waveform;
+  double           magnitude;
+
+  GArray          *samples;
+  gboolean         load_failed;
+} FbdFeedbackVibraCustom;
+
+G_DEFINE_TYPE (FbdFeedbackVibraCustom, fbd_feedback_vibra_custom, FBD_TYPE_FEEDBACK_VIBRA)
+
+
+static char *
+find_waveform (const char *name)
+{
+  const char * const *xdg_data_dirs = g_get_system_data_dirs ();
+  g_autofree char *file_name = g_strconcat (name, WAVEFORM_SUFFIX, NULL);
+  g_autofree char *path = NULL;
+
+  path = g_build_filename (g_get_user_data_dir (), "feedbackd", "waveforms", file_name, NULL);
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    return g_steal_pointer (&path);
+
+  for (int i = 0; xdg_data_dirs[i]; i++) {
+    g_free (path);
+    path = g_build_filename (xdg_data_dirs[i], "feedbackd", "waveforms", file_name, NULL);
+    if (g_file_test (path, G_FILE_TEST_EXISTS))
+      return g_steal_pointer (&path);
+  }
+
+  return NULL;
+}
+
+
+static GArray *
+load_waveform (const char *name, GError **error)
+{
+  g_autoptr (GArray) samples = g_array_new (FALSE, FALSE, sizeof (gint16));
+  g_autofree char *contents = NULL;
+  g_autofree char *path = NULL;
+  g_auto (GStrv) lines = NULL;
+
+  if (name == NULL || name[0] == '\0' || strchr (name, G_DIR_SEPARATOR)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+                 "Invalid waveform name '%s'", name ?: "");
+    return NULL;
+  }
+
+  path = find_waveform (name);
+  if (path == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Waveform '%s' not found", name);
+    return NULL;
+  }
+
+  if (!g_file_get_contents (path, &contents, NULL, error))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (int i = 0; lines[i]; i++) {
+    g_auto (GStrv) tokens = NULL;
+    char *comment = strchr (lines[i], '#');
+
+    if (comment)
+      *comment = '\0';
+
+    tokens = g_strsplit_set (lines[i], " \t\r", -1);
+    for (int j = 0; tokens[j]; j++) {
+      gint64 sample;
+      gint16 value;
+
+      if (tokens[j][0] == '\0')
+        continue;
+
+      if (!g_ascii_string_to_signed (tokens[j], 10, G_MININT16, G_MAXINT16, &sample, error)) {
+        g_prefix_error (error, "%s:%d: ", path, i + 1);
+        return NULL;
+      }
+      value = sample;
+      g_array_append_val (samples, value);
+    }
+  }
+
+  if (samples->len == 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Waveform '%s' is empty", path);
+    return NULL;
+  }
+
+  g_debug ("Loaded waveform '%s' with %u samples", path, samples->len);
+  return g_steal_pointer (&samples);
+}
+
+
+static void
+fbd_feedback_vibra_custom_set_property (GObject      *object,
+                                        guint         property_id,
+                                        const GValue *value,
+                                        GParamSpec   *pspec)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (object);
+
+  switch (property_id) {
+  case PROP_WAVEFORM:
+    g_free (self->waveform);
+    self->waveform = g_value_dup_string (value);
+    g_clear_pointer (&self->samples, g_array_unref);
+    self->load_failed = FALSE;
+    break;
+  case PROP_MAGNITUDE:
+    self->magnitude = g_value_get_double (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+fbd_feedback_vibra_custom_get_property (GObject    *object,
+                                        guint       property_id,
+                                        GValue     *value,
+                                        GParamSpec *pspec)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (object);
+
+  switch (property_id) {
+  case PROP_WAVEFORM:
+    g_value_set_string (value, self->waveform);
+    break;
+  case PROP_MAGNITUDE:
+    g_value_set_double (value, self->magnitude);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+fbd_feedback_vibra_custom_finalize (GObject *object)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (object);
+
+  g_clear_pointer (&self->waveform, g_free);
+  g_clear_pointer (&self->samples, g_array_unref);
+
+  G_OBJECT_CLASS (fbd_feedback_vibra_custom_parent_class)->finalize (object);
+}
+
+static double
+get_magnitude (FbdFeedbackVibraCustom *self)
+{
+  double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
+
+  return MIN (self->magnitude, max_strength);
+}
+
+static void
+fbd_feedback_vibra_custom_end_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+
+  /* The waveform stays uploaded */
+  fbd_dev_vibra_remove_effect (dev);
+}
+
+static gboolean
+fbd_feedback_vibra_custom_supports_device (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (vibra);
+
+  if (!fbd_dev_vibra_has_custom (dev))
+    return FALSE;
+
+  return fbd_feedback_vibra_custom_get_samples (self, NULL) != NULL;
+}
+
+static gboolean
+fbd_feedback_vibra_custom_prepare_vibra (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (vibra);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
+  const gint16 *samples;
+  guint n_samples;
+
+  samples = fbd_feedback_vibra_custom_get_samples (self, &n_samples);
+  if (samples == NULL)
+    return FALSE;
+
+  return fbd_dev_vibra_prepare_custom (dev, duration, get_magnitude (self), samples, n_samples);
+}
+
+static void
+fbd_feedback_vibra_custom_start_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibraCustom *self = FBD_FEEDBACK_VIBRA_CUSTOM (vibra);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
+  const gint16 *samples;
+  guint n_samples;
+
+  g_return_if_fail (FBD_IS_DEV_VIBRA (dev));
+
+  samples = fbd_feedback_vibra_custom_get_samples (self, &n_samples);
+  g_return_if_fail (samples);
+
+  g_debug ("Custom Vibra: '%s' (%f,%d)", self->waveform, get_magnitude (self), duration);
+  fbd_dev_vibra_custom (dev, duration, get_magnitude (self), samples, n_samples);
+}
+
+
+static void
+fbd_feedback_vibra_custom_class_init (FbdFeedbackVibraCustomClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  FbdFeedbackVibraClass *vibra_class = FBD_FEEDBACK_VIBRA_CLASS (klass);
+
+  object_class->set_property = fbd_feedback_vibra_custom_set_property;
+  object_class->get_property = fbd_feedback_vibra_custom_get_property;
+  object_class->finalize = fbd_feedback_vibra_custom_finalize;
+
+  vibra_class->start_vibra = fbd_feedback_vibra_custom_start_vibra;
+  vibra_class->prepare_vibra = fbd_feedback_vibra_custom_prepare_vibra;
+  vibra_class->end_vibra = fbd_feedback_vibra_custom_end_vibra;
+  vibra_class->supports_device = fbd_feedback_vibra_custom_supports_device;
+
+  /**
+   * FbdFeedbackVibraCustom:waveform:
+   *
+   * The name of the waveform asset to play.
+   */
+  props[PROP_WAVEFORM] =
+    g_param_spec_string ("waveform", "", "",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  props[PROP_MAGNITUDE] =
+    g_param_spec_double ("magnitude", "", "",
+                         0.0, 1.0, 1.0,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+static void
+fbd_feedback_vibra_custom_init (FbdFeedbackVibraCustom *self)
+{
+  self->magnitude = 1.0;
+}
+
+/**
+ * fbd_feedback_vibra_custom_get_samples:
+ * @self: The custom haptic feedback
+ * @n_samples:(out)(optional): The number of samples
+ *
+ * Gets the samples of the waveform, loading it on first use.
+ *
+ * Returns:(transfer none)(nullable): The samples or `NULL` if the
+ *   waveform can't be loaded
+ */
+const gint16 *
+fbd_feedback_vibra_custom_get_samples (FbdFeedbackVibraCustom *self, guint *n_samples)
+{
+  g_autoptr (GError) err = NULL;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA_CUSTOM (self), NULL);
+
+  if (self->samples == NULL && !self->load_failed) {
+    self->samples = load_waveform (self->waveform, &err);
+    if (self->samples == NULL) {
+      g_warning ("Failed to load waveform: %s", err->message);
+      self->load_failed = TRUE;
+    }
+  }
+
+  if (self->samples == NULL)
+    return NULL;
+
+  if (n_samples)
+    *n_samples = self->samples->len;
+
+  return (const gint16 *)self->samples->data;
+}
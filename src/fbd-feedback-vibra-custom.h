@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-feedback-vibra.h"
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_FEEDBACK_VIBRA_CUSTOM (fbd_feedback_vibra_custom_get_type())
+
+G_DECLARE_FINAL_TYPE (FbdFeedbackVibraCustom, fbd_feedback_vibra_custom, FBD,
+                      FEEDBACK_VIBRA_CUSTOM, FbdFeedbackVibra);
+
+const gint16 *fbd_feedback_vibra_custom_get_samples (FbdFeedbackVibraCustom *self,
+                                                     guint                  *n_samples);
+
+G_END_DECLS
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2026 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-feedback-vibra-envelope"
+
+#include "fbd-enums.h"
+#include "fbd-feedback-vibra-priv.h"
+#include "fbd-feedback-vibra-envelope.h"
+#include "fbd-feedback-manager.h"
+#include "fbd-timer-wheel.h"
+
+#include <float.h>
+
+/* Length of a step in ms when the device can't do envelopes */
+#define FBD_FEEDBACK_VIBRA_ENVELOPE_STEP 20
+
+/**
+ * FbdFeedbackVibraEnvelope:
+ *
+ * Describes a haptic feedback with an amplitude envelope
+ *
+ * The magnitude ramps from the attack level to the sustain magnitude,
+ * stays there and then fades to the fade level. The envelope is
+ * handed to the kernel as part of a single effect. Only if the device
+ * can't shape effects the envelope is approximated by a sequence of
+ * rumbles.
+ */
+
+enum {
+  PROP_0,
+  PROP_MAGNITUDE,
+  PROP_ATTACK_LEVEL,
+  PROP_ATTACK_TIME,
+  PROP_FADE_LEVEL,
+  PROP_FADE_TIME,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef struct _FbdFeedbackVibraEnvelope {
+  FbdFeedbackVibra parent;
+
+  double           magnitude;
+  double           attack_level;
+  guint            attack_time;
+  double           fade_level;
+  guint            fade_time;
+
+  /* Fallback when the device has no envelope support, shared by all playbacks */
+  GArray          *magnitudes;
+  GArray          *durations;
+  double           steps_strength;
+} FbdFeedbackVibraEnvelope;
+
+G_DEFINE_TYPE (FbdFeedbackVibraEnvelope, fbd_feedback_vibra_envelope, FBD_TYPE_FEEDBACK_VIBRA)
+
+
+static void
+fbd_feedback_vibra_envelope_set_property (GObject      *object,
+                                          guint         property_id,
+                                          const GValue *value,
+                                          GParamSpec   *pspec)
+{
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (object);
+
+  switch (property_id) {
+  case PROP_MAGNITUDE:
+    self->magnitude = g_value_get_double (value);
+    break;
+  case PROP_ATTACK_LEVEL:
+    self->attack_level = g_value_get_double (value);
+    break;
+  case PROP_ATTACK_TIME:
+    self->attack_time = g_value_get_uint (value);
+    break;
+  case PROP_FADE_LEVEL:
+    self->fade_level = g_value_get_double (value);
+    break;
+  case PROP_FADE_TIME:
+    self->fade_time = g_value_get_uint (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_feedback_vibra_envelope_get_property (GObject    *object,
+                                          guint       property_id,
+                                          GValue     *value,
+                                          GParamSpec *pspec)
+{
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (object);
+
+  switch (property_id) {
+  case PROP_MAGNITUDE:
+    g_value_set_double (value, self->magnitude);
+    break;
+  case PROP_ATTACK_LEVEL:
+    g_value_set_double (value, self->attack_level);
+    break;
+  case PROP_ATTACK_TIME:
+    g_value_set_uint (value, self->attack_time);
+    break;
+  case PROP_FADE_LEVEL:
+    g_value_set_double (value, self->fade_level);
+    break;
+  case PROP_FADE_TIME:
+    g_value_set_uint (value, self->fade_time);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+append_step (FbdFeedbackVibraEnvelope *self, double magnitude, guint duration)
+{
+  g_array_append_val (self->magnitudes, magnitude);
+  g_array_append_val (self->durations, duration);
+}
+
+
+static void
+append_ramp (FbdFeedbackVibraEnvelope *self, double from, double to, guint duration)
+{
+  guint n_steps = (duration + FBD_FEEDBACK_VIBRA_ENVELOPE_STEP - 1) / FBD_FEEDBACK_VIBRA_ENVELOPE_STEP;
+
+  for (guint i = 0; i < n_steps; i++) {
+    guint start = i * FBD_FEEDBACK_VIBRA_ENVELOPE_STEP;
+    guint len = MIN (FBD_FEEDBACK_VIBRA_ENVELOPE_STEP, duration - start);
+    /* Use the level in the middle of the step */
+    double t = (start + len / 2.0) / duration;
+
+    append_step (self, from + (to - from) * t, len);
+  }
+}
+
+/*
+ * Approximate the envelope by a pattern of rumbles for devices
+ * without periodic or constant effects.
+ */
+static void
+build_steps (FbdFeedbackVibraEnvelope *self,
+             guint                     duration,
+             double                    magnitude,
+             double                    attack_level,
+             guint                     attack_time,
+             double                    fade_level,
+             guint                     fade_time)
+{
+  guint sustain;
+
+  g_clear_pointer (&self->magnitudes, g_array_unref);
+  g_clear_pointer (&self->durations, g_array_unref);
+  self->magnitudes = g_array_new (FALSE, FALSE, sizeof (double));
+  self->durations = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  attack_time = MIN (attack_time, duration);
+  fade_time = MIN (fade_time, duration - attack_time);
+  sustain = duration - attack_time - fade_time;
+
+  append_ramp (self, attack_level, magnitude, attack_time);
+  if (sustain)
+    append_step (self, magnitude, sustain);
+  append_ramp (self, magnitude, fade_level, fade_time);
+}
+
+
+static void on_timer_expired (gpointer data);
+
+
+static void
+do_envelope_step (FbdFeedbackVibraEnvelope *self, FbdFeedbackPlayback *playback)
+{
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (FBD_FEEDBACK_VIBRA (self), playback);
+  double magnitude = g_array_index (self->magnitudes, double, playback->pos);
+  guint duration = g_array_index (self->durations, guint, playback->pos);
+
+  fbd_dev_vibra_remove_effect (dev);
+  if (magnitude != 0.0)
+    fbd_dev_vibra_rumble (dev, magnitude, duration, TRUE);
+
+  /* Steps shape the envelope so don't delay them */
+  playback->step_id = fbd_timeout_add_once (duration, 0, on_timer_expired, playback);
+}
+
+
+static void
+on_timer_expired (gpointer data)
+{
+  FbdFeedbackPlayback *playback = data;
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (playback->feedback);
+
+  playback->step_id = 0;
+  playback->pos++;
+  /* The steps might have been rebuilt by another playback */
+  if (playback->pos >= self->durations->len) {
+    playback->pos = 0;
+    return;
+  }
+
+  do_envelope_step (self, playback);
+}
+
+
+static void
+fbd_feedback_vibra_envelope_end_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+
+  playback->pos = 0;
+  g_clear_handle_id (&playback->step_id, fbd_timeout_remove);
+
+  if (dev)
+    fbd_dev_vibra_stop (dev);
+}
+
+
+static void
+get_levels (FbdFeedbackVibraEnvelope *self,
+            double                   *magnitude,
+            double                   *attack_level,
+            double                   *fade_level)
+{
+  double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
+  double scale = 1.0;
+
+  /* Keep the shape of the envelope when limiting the strength */
+  if (self->magnitude > max_strength)
+    scale = max_strength / self->magnitude;
+  *magnitude = self->magnitude * scale;
+  *attack_level = MIN (self->attack_level * scale, max_strength);
+  *fade_level = MIN (self->fade_level * scale, max_strength);
+}
+
+
+static gboolean
+fbd_feedback_vibra_envelope_prepare_vibra (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (vibra);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
+  double magnitude, attack_level, fade_level;
+
+  /* Steps are cheap rumbles, only a kernel envelope is worth uploading early */
+  get_levels (self, &magnitude, &attack_level, &fade_level);
+  return fbd_dev_vibra_prepare_envelope (dev, duration, magnitude,
+                                         attack_level, self->attack_time,
+                                         fade_level, self->fade_time);
+}
+
+
+static void
+fbd_feedback_vibra_envelope_start_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (vibra);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
+  double max_strength = fbd_feedback_vibra_get_max_strength (vibra);
+  double magnitude, attack_level, fade_level;
+
+  g_return_if_fail (FBD_IS_DEV_VIBRA (dev));
+
+  get_levels (self, &magnitude, &attack_level, &fade_level);
+
+  g_debug ("Envelope Vibra: (%f,%u) (%f,%u) (%f,%u)",
+           attack_level, self->attack_time, magnitude, duration, fade_level, self->fade_time);
+
+  if (fbd_dev_vibra_envelope (dev, duration, magnitude,
+                              attack_level, self->attack_time,
+                              fade_level, self->fade_time))
+    return;
+
+  if (fbd_dev_vibra_has_envelope (dev))
+    return;
+
+  /* The steps only change with the haptic strength */
+  if (self->durations == NULL || !G_APPROX_VALUE (self->steps_strength, max_strength, DBL_EPSILON)) {
+    build_steps (self, duration, magnitude, attack_level, self->attack_time,
+                 fade_level, self->fade_time);
+    self->steps_strength = max_strength;
+  }
+  if (self->durations->len == 0)
+    return;
+
+  g_debug ("No envelope support, using %u steps", self->durations->len);
+  if (fbd_dev_vibra_step_pattern (dev,
+                                  (const double *)self->magnitudes->data,
+                                  (const guint *)self->durations->data,
+                                  self->durations->len))
+    return;
+
+  playback->pos = 0;
+  do_envelope_step (self, playback);
+}
+
+
+static void
+fbd_feedback_vibra_envelope_finalize (GObject *object)
+{
+  FbdFeedbackVibraEnvelope *self = FBD_FEEDBACK_VIBRA_ENVELOPE (object);
+
+  g_clear_pointer (&self->magnitudes, g_array_unref);
+  g_clear_pointer (&self->durations, g_array_unref);
+
+  G_OBJECT_CLASS (fbd_feedback_vibra_envelope_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_feedback_vibra_envelope_class_init (FbdFeedbackVibraEnvelopeClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  FbdFeedbackVibraClass *vibra_class = FBD_FEEDBACK_VIBRA_CLASS (klass);
+
+  object_class->finalize = fbd_feedback_vibra_envelope_finalize;
+  object_class->set_property = fbd_feedback_vibra_envelope_set_property;
+  object_class->get_property = fbd_feedback_vibra_envelope_get_property;
+
+  vibra_class->start_vibra = fbd_feedback_vibra_envelope_start_vibra;
+  vibra_class->prepare_vibra = fbd_feedback_vibra_envelope_prepare_vibra;
+  vibra_class->end_vibra = fbd_feedback_vibra_envelope_end_vibra;
+
+  /**
+   * FbdFeedbackVibraEnvelope:magnitude
+   *
+   * The relative magnitude between attack and fade (sustain).
+   */
+  props[PROP_MAGNITUDE] =
+    g_param_spec_double ("magnitude", "", "",
+                         0.0, 1.0, 0.5,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraEnvelope:attack-level
+   *
+   * The relative magnitude at the start of the feedback.
+   */
+  props[PROP_ATTACK_LEVEL] =
+    g_param_spec_double ("attack-level", "", "",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraEnvelope:attack-time
+   *
+   * The time in ms to ramp from the attack level to the magnitude.
+   */
+  props[PROP_ATTACK_TIME] =
+    g_param_spec_uint ("attack-time", "", "",
+                       0, G_MAXUINT16, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraEnvelope:fade-level
+   *
+   * The relative magnitude at the end of the feedback.
+   */
+  props[PROP_FADE_LEVEL] =
+    g_param_spec_double ("fade-level", "", "",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraEnvelope:fade-time
+   *
+   * The time in ms to ramp from the magnitude to the fade level.
+   */
+  props[PROP_FADE_TIME] =
+    g_param_spec_uint ("fade-time", "", "",
+                       0, G_MAXUINT16, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+fbd_feedback_vibra_envelope_init (FbdFeedbackVibraEnvelope *self)
+{
+  self->magnitude = 0.5;
+}
@@ -0,0 +1,18 @@
+/*
+ * Copyright (C) 2026 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-feedback-vibra.h"
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_FEEDBACK_VIBRA_ENVELOPE (fbd_feedback_vibra_envelope_get_type())
+
+G_DECLARE_FINAL_TYPE (FbdFeedbackVibraEnvelope, fbd_feedback_vibra_envelope, FBD,
+                      FEEDBACK_VIBRA_ENVELOPE,
+                      FbdFeedbackVibra);
+
+G_END_DECLS
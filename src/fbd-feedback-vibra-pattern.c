@@ -12,6 +12,7 @@
 #include "fbd-feedback-vibra-pattern.h"
 #include "fbd-feedback-vibra-priv.h"
 #include "fbd-feedback-manager.h"
+#include "fbd-timer-wheel.h"
 
 #include <json-glib/json-glib.h>
 
@@ -23,12 +24,33 @@
  * The #FbdVibraVibraPattern describes the properties of a haptic feedback
  * event. It knows nothing about the hardware itself but calls
  * #FbdDevVibra for that.
+ *
+ * Motors that need time to spin up and down would swallow short
+ * steps so the played steps are compensated for the motor's latency,
+ * see `fbd_feedback_vibra_pattern_compensate()`. They're then
+ * optimized so that runs of equal steps and steps too short to be
+ * noticed don't cost extra timers and effect uploads, see
+ * `fbd_feedback_vibra_pattern_optimize()`. The result is kept until a
+ * different motor is used.
+ *
+ * Motors that can only be switched on and off would play every
+ * rumble at full strength. For them steps are dithered into on and
+ * off pulses whose ratio matches the magnitude, see
+ * `fbd_feedback_vibra_pattern_dither()`.
+ *
+ * Looping patterns like heart beats or ring rhythms are given once
+ * with a #FbdFeedbackVibraPattern:repeat-count, the steps from
+ * #FbdFeedbackVibraPattern:repeat-from on are then played again that
+ * many times.
  */
 
 enum {
   PROP_0,
   PROP_MAGNITUDES,
   PROP_DURATIONS,
+  PROP_KERNEL_PLAYBACK,
+  PROP_REPEAT_COUNT,
+  PROP_REPEAT_FROM,
   PROP_LAST_PROP,
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -38,9 +60,17 @@ typedef struct _FbdFeedbackVibraPattern {
 
   GArray          *magnitudes;
   GArray          *durations;
-  int              pos;
-
-  guint            timer_id;
+  gboolean         kernel_playback;
+  guint            repeat_count;
+  guint            repeat_from;
+
+  /* The steps as played */
+  GArray          *steps_magnitudes;
+  GArray          *steps_durations;
+  guint            steps_repeat_from;
+  guint            steps_spin_up;
+  guint            steps_spin_down;
+  gboolean         steps_dithered;
 } FbdFeedbackVibraPattern;
 
 static void json_serializable_iface_init (JsonSerializableIface *iface);
@@ -107,28 +137,158 @@ fbd_feedback_vibra_pattern_serializable_deserialize_property (JsonSerializable *
 }
 
 
+/* Out of range values repeat the whole pattern */
+static guint
+get_repeat_from (FbdFeedbackVibraPattern *self)
+{
+  if (self->magnitudes == NULL || self->durations == NULL ||
+      self->repeat_from >= MIN (self->magnitudes->len, self->durations->len))
+    return 0;
+
+  return self->repeat_from;
+}
+
+
+static void
+clear_steps (FbdFeedbackVibraPattern *self)
+{
+  g_clear_pointer (&self->steps_magnitudes, g_array_unref);
+  g_clear_pointer (&self->steps_durations, g_array_unref);
+}
+
+
+/* Compensate and optimize the steps in [from, to) and append them */
+static void
+append_steps (FbdFeedbackVibraPattern *self, guint from, guint to)
+{
+  g_autoptr (GArray) magnitudes = NULL, durations = NULL;
+  g_autoptr (GArray) out_magnitudes = NULL, out_durations = NULL;
+
+  if (from == to)
+    return;
+
+  magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), to - from);
+  g_array_append_vals (magnitudes, &g_array_index (self->magnitudes, double, from), to - from);
+  durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), to - from);
+  g_array_append_vals (durations, &g_array_index (self->durations, guint, from), to - from);
+
+  if (self->steps_spin_up || self->steps_spin_down) {
+    g_autoptr (GArray) compensated_magnitudes = NULL, compensated_durations = NULL;
+
+    fbd_feedback_vibra_pattern_compensate (magnitudes, durations,
+                                           self->steps_spin_up, self->steps_spin_down,
+                                           &compensated_magnitudes, &compensated_durations);
+    g_array_unref (magnitudes);
+    magnitudes = g_steal_pointer (&compensated_magnitudes);
+    g_array_unref (durations);
+    durations = g_steal_pointer (&compensated_durations);
+  }
+
+  if (self->steps_dithered) {
+    g_autoptr (GArray) dithered_magnitudes = NULL, dithered_durations = NULL;
+
+    fbd_feedback_vibra_pattern_dither (magnitudes, durations,
+                                       FBD_FEEDBACK_VIBRA_PATTERN_DITHER_PERIOD,
+                                       FBD_FEEDBACK_VIBRA_PATTERN_MIN_STEP,
+                                       &dithered_magnitudes, &dithered_durations);
+    g_array_unref (magnitudes);
+    magnitudes = g_steal_pointer (&dithered_magnitudes);
+    g_array_unref (durations);
+    durations = g_steal_pointer (&dithered_durations);
+  }
+
+  fbd_feedback_vibra_pattern_optimize (magnitudes, durations, FBD_FEEDBACK_VIBRA_PATTERN_MIN_STEP,
+                                       &out_magnitudes, &out_durations);
+  g_array_append_vals (self->steps_magnitudes, out_magnitudes->data, out_magnitudes->len);
+  g_array_append_vals (self->steps_durations, out_durations->data, out_durations->len);
+}
+
+
+/* Build the steps as played on the motor the pattern is played on */
+static void
+update_steps (FbdFeedbackVibraPattern *self, FbdDevVibra *dev)
+{
+  guint spin_up = dev ? fbd_dev_vibra_get_spin_up (dev) : 0;
+  guint spin_down = dev ? fbd_dev_vibra_get_spin_down (dev) : 0;
+  gboolean dithered = dev &&
+    fbd_dev_vibra_get_actuator_class (dev) == FBD_DEV_VIBRA_ACTUATOR_CLASS_ON_OFF;
+  guint from = get_repeat_from (self);
+  guint len = MIN (self->magnitudes->len, self->durations->len);
+
+  if (self->steps_magnitudes && self->steps_spin_up == spin_up &&
+      self->steps_spin_down == spin_down && self->steps_dithered == dithered)
+    return;
+
+  clear_steps (self);
+  self->steps_spin_up = spin_up;
+  self->steps_spin_down = spin_down;
+  self->steps_dithered = dithered;
+  self->steps_magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), len);
+  self->steps_durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), len);
+
+  /* Build the repeated steps on their own so they can be jumped to */
+  append_steps (self, 0, from);
+  self->steps_repeat_from = self->steps_magnitudes->len;
+  append_steps (self, from, len);
+
+  g_debug ("Built %u steps from %u for spin up %ums, down %ums%s",
+           self->steps_magnitudes->len, len, spin_up, spin_down,
+           dithered ? ", dithered" : "");
+}
+
+
+/* The total duration includes the repeated steps */
+static void
+update_duration (FbdFeedbackVibraPattern *self)
+{
+  guint64 total_duration = 0, loop_duration = 0;
+
+  if (self->durations == NULL)
+    return;
+
+  for (guint i = 0; i < self->durations->len; i++) {
+    guint duration = g_array_index (self->durations, guint, i);
+
+    total_duration += duration;
+    if (i >= get_repeat_from (self))
+      loop_duration += duration;
+  }
+  total_duration += loop_duration * self->repeat_count;
+
+  fbd_feedback_vibra_set_duration (FBD_FEEDBACK_VIBRA (self), MIN (total_duration, G_MAXUINT));
+}
+
+
 static void
 set_magnitudes (FbdFeedbackVibraPattern *self, GArray *magnitudes)
 {
+  clear_steps (self);
   g_clear_pointer (&self->magnitudes, g_array_unref);
   self->magnitudes = g_array_ref (magnitudes);
+
+  update_duration (self);
 }
 
 
 static void
 set_durations (FbdFeedbackVibraPattern *self, GArray *durations)
 {
-  guint total_duration = 0;
-
+  clear_steps (self);
   g_clear_pointer (&self->durations, g_array_unref);
   self->durations = g_array_ref (durations);
 
-  for (int i = 0; i < self->durations->len; i++) {
-    guint *duration = &g_array_index (self->durations, guint, i);
-    total_duration += *duration;
-  }
+  update_duration (self);
+}
+
+
+static void
+set_repeat (FbdFeedbackVibraPattern *self, guint repeat_count, guint repeat_from)
+{
+  clear_steps (self);
+  self->repeat_count = repeat_count;
+  self->repeat_from = repeat_from;
 
-  fbd_feedback_vibra_set_duration (FBD_FEEDBACK_VIBRA (self), total_duration);
+  update_duration (self);
 }
 
 
@@ -147,6 +307,15 @@ fbd_feedback_vibra_pattern_set_property (GObject      *object,
   case PROP_DURATIONS:
     set_durations (self, g_value_get_boxed (value));
     break;
+  case PROP_KERNEL_PLAYBACK:
+    self->kernel_playback = g_value_get_boolean (value);
+    break;
+  case PROP_REPEAT_COUNT:
+    set_repeat (self, g_value_get_uint (value), self->repeat_from);
+    break;
+  case PROP_REPEAT_FROM:
+    set_repeat (self, self->repeat_count, g_value_get_uint (value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -169,6 +338,15 @@ fbd_feedback_vibra_pattern_get_property (GObject    *object,
   case PROP_DURATIONS:
     g_value_set_boxed (value, self->durations);
     break;
+  case PROP_KERNEL_PLAYBACK:
+    g_value_set_boolean (value, self->kernel_playback);
+    break;
+  case PROP_REPEAT_COUNT:
+    g_value_set_uint (value, self->repeat_count);
+    break;
+  case PROP_REPEAT_FROM:
+    g_value_set_uint (value, self->repeat_from);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -180,68 +358,133 @@ static void on_timer_expired (gpointer data);
 
 
 static void
-do_pattern_step (FbdFeedbackVibraPattern *self)
+do_pattern_step (FbdFeedbackVibraPattern *self, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (FBD_FEEDBACK_VIBRA (self), playback);
   double magnitude;
   guint duration;
 
-  magnitude = g_array_index (self->magnitudes, double, self->pos);
-  duration = g_array_index (self->durations, guint, self->pos);
+  magnitude = g_array_index (self->steps_magnitudes, double, playback->pos);
+  duration = g_array_index (self->steps_durations, guint, playback->pos);
 
-  g_debug ("step: pos: %d/%d, magn: %f, timeout %u",
-           self->pos,
-           self->durations->len,
+  g_debug ("step: pos: %u/%u, magn: %f, timeout %u",
+           playback->pos,
+           self->steps_durations->len,
            magnitude,
            duration);
 
-  /* Remove any pending effect */
-  fbd_dev_vibra_remove_effect (dev);
-
   if (magnitude != 0.0) {
     double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
 
+    /* Updates the previous step's effect in place */
     magnitude = MIN (magnitude, max_strength);
-    fbd_dev_vibra_rumble (dev, magnitude, duration, TRUE);
+    fbd_dev_vibra_retune (dev, magnitude, duration);
+  } else {
+    fbd_dev_vibra_remove_effect (dev);
   }
 
-  self->timer_id = g_timeout_add_once (duration,
-                                       on_timer_expired,
-                                       self);
-  g_source_set_name_by_id (self->timer_id, "feedback-vibra-pattern-timer");
+  /* Steps make up the pattern so don't delay them */
+  playback->step_id = fbd_timeout_add_once (duration, 0, on_timer_expired, playback);
 }
 
 
 static void
 on_timer_expired (gpointer data)
 {
-  FbdFeedbackVibraPattern *self = data;
+  FbdFeedbackPlayback *playback = data;
+  FbdFeedbackVibraPattern *self = FBD_FEEDBACK_VIBRA_PATTERN (playback->feedback);
 
-  g_return_if_fail (FBD_IS_FEEDBACK_VIBRA_PATTERN (self));
-  g_return_if_fail (self->pos < self->durations->len);
+  g_return_if_fail (playback->pos < self->steps_durations->len);
 
-  self->pos++;
+  playback->step_id = 0;
+  playback->pos++;
 
-  if (self->pos == self->durations->len) {
-    self->pos = 0;
-    self->timer_id = 0;
+  if (playback->pos == self->steps_durations->len && playback->loop < self->repeat_count) {
+    playback->loop++;
+    playback->pos = self->steps_repeat_from;
+  }
+
+  if (playback->pos == self->steps_durations->len) {
+    playback->pos = 0;
     return;
   }
 
-  do_pattern_step (self);
+  do_pattern_step (self, playback);
 }
 
 
+/* Appends the steps from @from on, capped at the max strength */
 static void
-fbd_feedback_vibra_pattern_end_vibra (FbdFeedbackVibra *vibra)
+copy_steps (FbdFeedbackVibraPattern *self, GArray *magnitudes, GArray *durations, guint from)
 {
-  FbdFeedbackVibraPattern *self = FBD_FEEDBACK_VIBRA_PATTERN (vibra);
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
+
+  for (guint i = from; i < self->steps_magnitudes->len; i++) {
+    double magnitude = MIN (g_array_index (self->steps_magnitudes, double, i), max_strength);
+
+    g_array_append_val (magnitudes, magnitude);
+    g_array_append_val (durations, g_array_index (self->steps_durations, guint, i));
+  }
+}
+
+/*
+ * Let the kernel or the haptic thread play the pattern so it isn't
+ * affected by main loop latency. Playback starts @skip ms into step
+ * @pos of repetition @loop so a resumed pattern continues where it
+ * was paused.
+ */
+static gboolean
+play_pattern_on_device (FbdFeedbackVibraPattern *self,
+                        FbdDevVibra             *dev,
+                        guint                    pos,
+                        guint                    skip,
+                        guint                    loop)
+{
+  guint n_steps = self->steps_magnitudes->len;
+  guint repeat_count = self->repeat_count;
+  guint repeat_from = self->steps_repeat_from;
+  g_autoptr (GArray) magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), n_steps);
+  g_autoptr (GArray) durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_steps);
+  guint *first;
+
+  copy_steps (self, magnitudes, durations, pos);
+  if (pos <= repeat_from) {
+    repeat_from -= pos;
+    repeat_count -= MIN (loop, repeat_count);
+  } else if (repeat_count > loop) {
+    /* Finish the current repetition, then loop over the remaining ones */
+    repeat_from = magnitudes->len;
+    repeat_count -= loop + 1;
+    copy_steps (self, magnitudes, durations, self->steps_repeat_from);
+  } else {
+    repeat_from = 0;
+    repeat_count = 0;
+  }
+
+  first = &g_array_index (durations, guint, 0);
+  if (skip < *first)
+    *first -= skip;
+
+  /* The kernel can only delay the effects once */
+  if (self->kernel_playback && repeat_count == 0 &&
+      fbd_dev_vibra_play_pattern (dev, (const double *)magnitudes->data,
+                                  (const guint *)durations->data, magnitudes->len))
+    return TRUE;
+
+  return fbd_dev_vibra_loop_pattern (dev, (const double *)magnitudes->data,
+                                     (const guint *)durations->data, magnitudes->len,
+                                     repeat_count, repeat_from);
+}
 
-  self->pos = 0;
-  g_clear_handle_id (&self->timer_id, g_source_remove);
+
+static void
+fbd_feedback_vibra_pattern_end_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+
+  playback->pos = 0;
+  playback->loop = 0;
+  g_clear_handle_id (&playback->step_id, fbd_timeout_remove);
 
   if (dev)
     fbd_dev_vibra_stop (dev);
@@ -249,36 +492,73 @@ fbd_feedback_vibra_pattern_end_vibra (FbdFeedbackVibra *vibra)
 
 
 static void
-fbd_feedback_vibra_pattern_start_vibra (FbdFeedbackVibra *vibra)
+fbd_feedback_vibra_pattern_start_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackVibraPattern *self = FBD_FEEDBACK_VIBRA_PATTERN (vibra);
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
 
   g_return_if_fail (FBD_IS_DEV_VIBRA (dev));
   g_return_if_fail (self->magnitudes);
   g_return_if_fail (self->durations);
   g_return_if_fail (self->durations->len == self->magnitudes->len);
 
-  if (self->pos)
-    fbd_feedback_vibra_pattern_end_vibra (FBD_FEEDBACK_VIBRA (self));
+  if (playback->step_id)
+    fbd_feedback_vibra_pattern_end_vibra (vibra, playback);
+  playback->loop = 0;
 
   g_debug ("Pattern Vibra: %u elements", self->durations->len);
 
   if (self->durations->len == 0)
     return;
 
-  do_pattern_step (self);
+  update_steps (self, dev);
+  if (play_pattern_on_device (self, dev, 0, 0, 0))
+    return;
+
+  do_pattern_step (self, playback);
 }
 
 
-static gboolean
-fbd_feedback_vibra_pattern_is_available (FbdFeedbackBase *base)
+/* Continue with the step the pattern was paused in */
+static void
+fbd_feedback_vibra_pattern_resume_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdFeedbackVibraPattern *self = FBD_FEEDBACK_VIBRA_PATTERN (vibra);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+  guint elapsed = 0, head = 0, loop = 0, offset = playback->offset;
+
+  if (self->durations == NULL || self->durations->len == 0)
+    return;
+
+  /* Compensating keeps the total duration so the offset still fits */
+  update_steps (self, dev);
 
-  return FBD_IS_DEV_VIBRA (dev);
+  /* Find the repetition the offset is in */
+  for (guint i = 0; i < self->steps_durations->len; i++) {
+    if (i < self->steps_repeat_from)
+      head += g_array_index (self->steps_durations, guint, i);
+    else
+      loop += g_array_index (self->steps_durations, guint, i);
+  }
+  playback->loop = 0;
+  if (self->repeat_count && loop && offset >= head) {
+    playback->loop = MIN ((offset - head) / loop, self->repeat_count);
+    offset -= playback->loop * loop;
+  }
+
+  for (playback->pos = 0; playback->pos < self->steps_durations->len - 1; playback->pos++) {
+    guint duration = g_array_index (self->steps_durations, guint, playback->pos);
+
+    if (elapsed + duration > offset)
+      break;
+    elapsed += duration;
+  }
+
+  if (play_pattern_on_device (self, dev, playback->pos, offset - elapsed, playback->loop))
+    return;
+
+  /* The main loop can only continue at a step boundary */
+  do_pattern_step (self, playback);
 }
 
 
@@ -287,7 +567,7 @@ fbd_feedback_vibra_pattern_finalize (GObject *object)
 {
   FbdFeedbackVibraPattern *self = FBD_FEEDBACK_VIBRA_PATTERN (object);
 
-  fbd_feedback_vibra_pattern_end_vibra (FBD_FEEDBACK_VIBRA (self));
+  clear_steps (self);
   g_clear_pointer (&self->magnitudes, g_array_unref);
   g_clear_pointer (&self->durations, g_array_unref);
 
@@ -304,17 +584,15 @@ static void
 fbd_feedback_vibra_pattern_class_init (FbdFeedbackVibraPatternClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  FbdFeedbackBaseClass *base_class = FBD_FEEDBACK_BASE_CLASS (klass);
   FbdFeedbackVibraClass *vibra_class = FBD_FEEDBACK_VIBRA_CLASS (klass);
 
   object_class->finalize = fbd_feedback_vibra_pattern_finalize;
   object_class->set_property = fbd_feedback_vibra_pattern_set_property;
   object_class->get_property = fbd_feedback_vibra_pattern_get_property;
 
-  base_class->is_available = fbd_feedback_vibra_pattern_is_available;
-
   vibra_class->start_vibra = fbd_feedback_vibra_pattern_start_vibra;
   vibra_class->end_vibra = fbd_feedback_vibra_pattern_end_vibra;
+  vibra_class->resume_vibra = fbd_feedback_vibra_pattern_resume_vibra;
 
   /**
    * FbdFeedbackVibraPattern:magnitudes
@@ -337,6 +615,39 @@ fbd_feedback_vibra_pattern_class_init (FbdFeedbackVibraPatternClass *klass)
     g_param_spec_boxed ("durations", "", "",
                         G_TYPE_ARRAY,
                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraPattern:kernel-playback
+   *
+   * Whether to hand the whole pattern to the kernel which then does
+   * the timing. This gives accurate timing but needs an effect slot
+   * per rumble. If the pattern doesn't fit the device the steps are
+   * played one by one.
+   */
+  props[PROP_KERNEL_PLAYBACK] =
+    g_param_spec_boolean ("kernel-playback", "", "",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraPattern:repeat-count
+   *
+   * How often the steps starting at
+   * #FbdFeedbackVibraPattern:repeat-from are played again after the
+   * pattern was played once.
+   */
+  props[PROP_REPEAT_COUNT] =
+    g_param_spec_uint ("repeat-count", "", "",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdFeedbackVibraPattern:repeat-from
+   *
+   * The index of the first step that is repeated. Indices past the
+   * last step repeat the whole pattern.
+   */
+  props[PROP_REPEAT_FROM] =
+    g_param_spec_uint ("repeat-from", "", "",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
@@ -356,3 +667,316 @@ fbd_feedback_vibra_pattern_new (GArray *magnitudes, GArray *durations)
                        "durations", durations,
                        NULL);
 }
+
+/**
+ * fbd_feedback_vibra_pattern_new_repeat:
+ * @magnitudes:(element-type double): The relative magnitude of each step
+ * @durations:(element-type guint): The duration of each step in ms
+ * @repeat_count: How often to play the steps from @repeat_from again
+ * @repeat_from: The first step that is repeated
+ *
+ * Like `fbd_feedback_vibra_pattern_new()` but repeats the end of the
+ * pattern.
+ *
+ * Returns:(transfer full): The pattern feedback
+ */
+FbdFeedbackVibraPattern *
+fbd_feedback_vibra_pattern_new_repeat (GArray *magnitudes,
+                                       GArray *durations,
+                                       guint   repeat_count,
+                                       guint   repeat_from)
+{
+  return g_object_new (FBD_TYPE_FEEDBACK_VIBRA_PATTERN,
+                       "magnitudes", magnitudes,
+                       "durations", durations,
+                       "repeat-count", repeat_count,
+                       "repeat-from", repeat_from,
+                       NULL);
+}
+
+/**
+ * fbd_feedback_vibra_pattern_compensate:
+ * @magnitudes:(element-type double): The relative magnitude of each step
+ * @durations:(element-type guint): The duration of each step in ms
+ * @spin_up: The time in ms the motor needs to spin up
+ * @spin_down: The time in ms the motor needs to spin down
+ * @out_magnitudes:(out)(transfer full)(element-type double): The compensated magnitudes
+ * @out_durations:(out)(transfer full)(element-type guint): The compensated durations
+ *
+ * Compensates a pattern for the latency of a motor. Rumbles that
+ * start from rest are overdriven at full strength for up to
+ * @spin_up ms so the motor gets up to speed quickly. Rumbles that
+ * end in a pause are stopped up to @spin_down ms early so the motor
+ * has stopped when the pause starts. Neither takes more than half of
+ * a step so short steps stay noticeable. The total duration isn't
+ * changed.
+ */
+void
+fbd_feedback_vibra_pattern_compensate (GArray  *magnitudes,
+                                       GArray  *durations,
+                                       guint    spin_up,
+                                       guint    spin_down,
+                                       GArray **out_magnitudes,
+                                       GArray **out_durations)
+{
+  g_autoptr (GArray) steps_magnitudes = NULL;
+  g_autoptr (GArray) steps_durations = NULL;
+  const double full = 1.0, pause = 0.0;
+  guint carry = 0;
+
+  g_return_if_fail (magnitudes && durations);
+  g_return_if_fail (magnitudes->len == durations->len);
+  g_return_if_fail (out_magnitudes && out_durations);
+
+  steps_magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), magnitudes->len + 1);
+  steps_durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), durations->len + 1);
+
+  for (guint i = 0; i < magnitudes->len; i++) {
+    double magnitude = g_array_index (magnitudes, double, i);
+    guint duration = g_array_index (durations, guint, i);
+    gboolean from_rest, to_rest;
+    guint lead = 0;
+
+    if (magnitude == 0.0) {
+      /* Gets the time the previous rumble stopped early */
+      duration += carry;
+      carry = 0;
+      g_array_append_val (steps_magnitudes, magnitude);
+      g_array_append_val (steps_durations, duration);
+      continue;
+    }
+
+    from_rest = i == 0 || g_array_index (magnitudes, double, i - 1) == 0.0;
+    to_rest = i == magnitudes->len - 1 || g_array_index (magnitudes, double, i + 1) == 0.0;
+
+    if (to_rest) {
+      carry = MIN (spin_down, duration / 2);
+      duration -= carry;
+    }
+
+    if (from_rest && magnitude < full)
+      lead = MIN (spin_up, duration / 2);
+
+    if (lead) {
+      g_array_append_val (steps_magnitudes, full);
+      g_array_append_val (steps_durations, lead);
+      duration -= lead;
+    }
+
+    g_array_append_val (steps_magnitudes, magnitude);
+    g_array_append_val (steps_durations, duration);
+  }
+
+  /* Keep the total duration */
+  if (carry) {
+    g_array_append_val (steps_magnitudes, pause);
+    g_array_append_val (steps_durations, carry);
+  }
+
+  *out_magnitudes = g_steal_pointer (&steps_magnitudes);
+  *out_durations = g_steal_pointer (&steps_durations);
+}
+
+/* Whether a short step can be folded into its neighbour without losing it */
+static gboolean
+can_fold_into (double magnitude, double neighbour)
+{
+  if (magnitude == 0.0)
+    return neighbour == 0.0;
+
+  /* Don't weaken a short kick, e.g. a spin up, into a weaker rumble */
+  return neighbour >= magnitude;
+}
+
+/**
+ * fbd_feedback_vibra_pattern_optimize:
+ * @magnitudes:(element-type double): The relative magnitude of each step
+ * @durations:(element-type guint): The duration of each step in ms
+ * @min_step: The shortest step in ms that is played on its own
+ * @out_magnitudes:(out)(transfer full)(element-type double): The optimized magnitudes
+ * @out_durations:(out)(transfer full)(element-type guint): The optimized durations
+ *
+ * Reduces a pattern to as few steps as possible. Adjacent steps with
+ * the same magnitude, including pauses, are merged into one and steps
+ * without a duration are dropped. Steps shorter than @min_step are
+ * folded into a neighbour that is in the same on or off state and
+ * at least as strong. Otherwise they're stretched to @min_step taking
+ * the time from a neighbour that is long enough or are kept as they
+ * are, so a short rumble is never lost. The total duration isn't
+ * changed and a pattern with steps never becomes empty.
+ */
+void
+fbd_feedback_vibra_pattern_optimize (GArray  *magnitudes,
+                                     GArray  *durations,
+                                     guint    min_step,
+                                     GArray **out_magnitudes,
+                                     GArray **out_durations)
+{
+  g_autoptr (GArray) merged_magnitudes = NULL;
+  g_autoptr (GArray) merged_durations = NULL;
+  g_autoptr (GArray) steps_magnitudes = NULL;
+  g_autoptr (GArray) steps_durations = NULL;
+
+  g_return_if_fail (magnitudes && durations);
+  g_return_if_fail (magnitudes->len == durations->len);
+  g_return_if_fail (out_magnitudes && out_durations);
+
+  merged_magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), magnitudes->len);
+  merged_durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), durations->len);
+
+  /* Merge runs of equal steps first so their total length counts */
+  for (guint i = 0; i < magnitudes->len; i++) {
+    double magnitude = g_array_index (magnitudes, double, i);
+    guint duration = g_array_index (durations, guint, i);
+    guint n_steps = merged_magnitudes->len;
+
+    if (duration == 0)
+      continue;
+
+    if (n_steps && g_array_index (merged_magnitudes, double, n_steps - 1) == magnitude) {
+      guint *last = &g_array_index (merged_durations, guint, n_steps - 1);
+
+      *last = MIN ((guint64)*last + duration, G_MAXUINT);
+      continue;
+    }
+
+    g_array_append_val (merged_magnitudes, magnitude);
+    g_array_append_val (merged_durations, duration);
+  }
+
+  /* Nothing to play, keep one step */
+  if (merged_magnitudes->len == 0 && magnitudes->len) {
+    g_array_append_val (merged_magnitudes, g_array_index (magnitudes, double, magnitudes->len - 1));
+    g_array_append_val (merged_durations, g_array_index (durations, guint, durations->len - 1));
+  }
+
+  steps_magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), merged_magnitudes->len);
+  steps_durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), merged_durations->len);
+
+  for (guint i = 0; i < merged_magnitudes->len; i++) {
+    double magnitude = g_array_index (merged_magnitudes, double, i);
+    guint duration = g_array_index (merged_durations, guint, i);
+    guint n_steps = steps_magnitudes->len;
+    guint *prev = n_steps ? &g_array_index (steps_durations, guint, n_steps - 1) : NULL;
+    double prev_magnitude = n_steps ? g_array_index (steps_magnitudes, double, n_steps - 1) : 0.0;
+    gboolean has_next = i + 1 < merged_magnitudes->len;
+    guint *next = has_next ? &g_array_index (merged_durations, guint, i + 1) : NULL;
+    double next_magnitude = has_next ? g_array_index (merged_magnitudes, double, i + 1) : 0.0;
+
+    if (duration < min_step) {
+      guint needed = min_step - duration;
+
+      if (prev && can_fold_into (magnitude, prev_magnitude)) {
+        *prev = MIN ((guint64)*prev + duration, G_MAXUINT);
+        continue;
+      }
+
+      if (next && can_fold_into (magnitude, next_magnitude)) {
+        *next = MIN ((guint64)*next + duration, G_MAXUINT);
+        continue;
+      }
+
+      if (prev && *prev >= min_step + needed) {
+        *prev -= needed;
+        duration = min_step;
+      } else if (next && *next >= min_step + needed) {
+        *next -= needed;
+        duration = min_step;
+      }
+    }
+
+    /* Folding might have made neighbours equal */
+    if (prev && prev_magnitude == magnitude) {
+      *prev = MIN ((guint64)*prev + duration, G_MAXUINT);
+      continue;
+    }
+
+    g_array_append_val (steps_magnitudes, magnitude);
+    g_array_append_val (steps_durations, duration);
+  }
+
+  *out_magnitudes = g_steal_pointer (&steps_magnitudes);
+  *out_durations = g_steal_pointer (&steps_durations);
+}
+
+/**
+ * fbd_feedback_vibra_pattern_dither:
+ * @magnitudes:(element-type double): The relative magnitude of each step
+ * @durations:(element-type guint): The duration of each step in ms
+ * @period: The length of an on and off cycle in ms
+ * @min_step: The shortest pulse or gap in ms
+ * @out_magnitudes:(out)(transfer full)(element-type double): The dithered magnitudes
+ * @out_durations:(out)(transfer full)(element-type guint): The dithered durations
+ *
+ * Turns a pattern into one that only switches between off and full
+ * strength for motors that can't do anything else. Steps in between
+ * are split into cycles of @period ms. Each cycle is on for the
+ * step's magnitude of the time. What's lost by rounding to ms and to
+ * @min_step is carried over to the next cycle so a step's on time
+ * still matches its magnitude. The total duration isn't changed.
+ */
+void
+fbd_feedback_vibra_pattern_dither (GArray  *magnitudes,
+                                   GArray  *durations,
+                                   guint    period,
+                                   guint    min_step,
+                                   GArray **out_magnitudes,
+                                   GArray **out_durations)
+{
+  g_autoptr (GArray) steps_magnitudes = NULL;
+  g_autoptr (GArray) steps_durations = NULL;
+  const double full = 1.0, pause = 0.0;
+
+  g_return_if_fail (magnitudes && durations);
+  g_return_if_fail (magnitudes->len == durations->len);
+  g_return_if_fail (period > 0);
+  g_return_if_fail (out_magnitudes && out_durations);
+
+  steps_magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), magnitudes->len);
+  steps_durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), durations->len);
+
+  for (guint i = 0; i < magnitudes->len; i++) {
+    double magnitude = g_array_index (magnitudes, double, i);
+    guint duration = g_array_index (durations, guint, i);
+    double error = 0.0;
+
+    if (magnitude == 0.0) {
+      g_array_append_val (steps_magnitudes, pause);
+      g_array_append_val (steps_durations, duration);
+      continue;
+    }
+
+    if (magnitude >= full) {
+      g_array_append_val (steps_magnitudes, full);
+      g_array_append_val (steps_durations, duration);
+      continue;
+    }
+
+    for (guint done = 0; done < duration;) {
+      guint len = MIN (period, duration - done);
+      double wanted = magnitude * len + error;
+      guint on = (guint)CLAMP (wanted + 0.5, 0.0, (double)len);
+      guint off;
+
+      if (on < min_step)
+        on = 0;
+      else if (len - on < min_step)
+        on = len;
+      off = len - on;
+      error = wanted - on;
+
+      if (on) {
+        g_array_append_val (steps_magnitudes, full);
+        g_array_append_val (steps_durations, on);
+      }
+      if (off) {
+        g_array_append_val (steps_magnitudes, pause);
+        g_array_append_val (steps_durations, off);
+      }
+      done += len;
+    }
+  }
+
+  *out_magnitudes = g_steal_pointer (&steps_magnitudes);
+  *out_durations = g_steal_pointer (&steps_durations);
+}
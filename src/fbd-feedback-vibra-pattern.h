@@ -11,10 +11,36 @@ G_BEGIN_DECLS
 
 #define FBD_TYPE_FEEDBACK_VIBRA_PATTERN (fbd_feedback_vibra_pattern_get_type())
 
+/* Steps shorter than this (in ms) get folded into their neighbours */
+#define FBD_FEEDBACK_VIBRA_PATTERN_MIN_STEP 5
+/* Length (in ms) of an on and off cycle when dithering for on/off motors */
+#define FBD_FEEDBACK_VIBRA_PATTERN_DITHER_PERIOD 40
+
 G_DECLARE_FINAL_TYPE (FbdFeedbackVibraPattern, fbd_feedback_vibra_pattern, FBD,
 		      FEEDBACK_VIBRA_PATTERN,
 		      FbdFeedbackVibra);
 
 FbdFeedbackVibraPattern *fbd_feedback_vibra_pattern_new (GArray *magnitudes, GArray *durations);
+FbdFeedbackVibraPattern *fbd_feedback_vibra_pattern_new_repeat (GArray *magnitudes,
+                                                                GArray *durations,
+                                                                guint   repeat_count,
+                                                                guint   repeat_from);
+void                     fbd_feedback_vibra_pattern_compensate (GArray  *magnitudes,
+                                                                GArray  *durations,
+                                                                guint    spin_up,
+                                                                guint    spin_down,
+                                                                GArray **out_magnitudes,
+                                                                GArray **out_durations);
+void                     fbd_feedback_vibra_pattern_optimize (GArray  *magnitudes,
+                                                              GArray  *durations,
+                                                              guint    min_step,
+                                                              GArray **out_magnitudes,
+                                                              GArray **out_durations);
+void                     fbd_feedback_vibra_pattern_dither (GArray  *magnitudes,
+                                                            GArray  *durations,
+                                                            guint    period,
+                                                            guint    min_step,
+                                                            GArray **out_magnitudes,
+                                                            GArray **out_durations);
 
 G_END_DECLS
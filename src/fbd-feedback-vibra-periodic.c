@@ -137,28 +137,51 @@ fbd_feedback_vibra_periodic_get_property (GObject  *object,
 }
 
 static void
-fbd_feedback_vibra_periodic_end_vibra (FbdFeedbackVibra *vibra)
+fbd_feedback_vibra_periodic_end_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
 
   fbd_dev_vibra_stop (dev);
 }
 
+static gboolean
+fbd_feedback_vibra_periodic_supports_device (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  return fbd_dev_vibra_has_periodic (dev);
+}
+
 static void
-fbd_feedback_vibra_periodic_start_vibra (FbdFeedbackVibra *vibra)
+get_levels (FbdFeedbackVibraPeriodic *self, double *max_magnitude, double *fade_in_level)
 {
-  FbdFeedbackVibraPeriodic *self = FBD_FEEDBACK_VIBRA_PERIODIC (vibra);
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
-  guint duration = fbd_feedback_vibra_get_duration (vibra);
   double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
   double fade_in_ratio = self->fade_in_level / self->magnitude;
+
+  *max_magnitude = MIN (max_strength, self->magnitude);
+  *fade_in_level = MIN (*max_magnitude * fade_in_ratio, self->fade_in_level);
+}
+
+static gboolean
+fbd_feedback_vibra_periodic_prepare_vibra (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraPeriodic *self = FBD_FEEDBACK_VIBRA_PERIODIC (vibra);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
+  double max_magnitude, fade_in_level;
+
+  get_levels (self, &max_magnitude, &fade_in_level);
+  return fbd_dev_vibra_prepare_periodic (dev, duration, max_magnitude, fade_in_level,
+                                         self->fade_in_time);
+}
+
+static void
+fbd_feedback_vibra_periodic_start_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibraPeriodic *self = FBD_FEEDBACK_VIBRA_PERIODIC (vibra);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
+  guint duration = fbd_feedback_vibra_get_duration (vibra);
   double max_magnitude, fade_in_level;
 
   g_return_if_fail (FBD_IS_DEV_VIBRA (dev));
-  max_magnitude = MIN (max_strength, self->magnitude);
-  fade_in_level = MIN (max_magnitude * fade_in_ratio, self->fade_in_level);
+  get_levels (self, &max_magnitude, &fade_in_level);
 
   g_debug ("Periodic Vibra: (%f,%d) (%f,%d)",
 	   max_magnitude, duration, fade_in_level, self->fade_in_time);
@@ -166,15 +189,6 @@ fbd_feedback_vibra_periodic_start_vibra (FbdFeedbackVibra *vibra)
   fbd_dev_vibra_periodic (dev, duration, max_magnitude, fade_in_level, self->fade_in_time);
 }
 
-static gboolean
-fbd_feedback_vibra_periodic_is_available (FbdFeedbackBase *base)
-{
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
-
-  return FBD_IS_DEV_VIBRA (dev);
-}
-
 
 static void
 json_serializable_iface_init (JsonSerializableIface *iface)
@@ -187,16 +201,15 @@ static void
 fbd_feedback_vibra_periodic_class_init (FbdFeedbackVibraPeriodicClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  FbdFeedbackBaseClass *base_class = FBD_FEEDBACK_BASE_CLASS (klass);
   FbdFeedbackVibraClass *vibra_class = FBD_FEEDBACK_VIBRA_CLASS (klass);
 
   object_class->set_property = fbd_feedback_vibra_periodic_set_property;
   object_class->get_property = fbd_feedback_vibra_periodic_get_property;
 
-  base_class->is_available = fbd_feedback_vibra_periodic_is_available;
-
   vibra_class->start_vibra = fbd_feedback_vibra_periodic_start_vibra;
+  vibra_class->prepare_vibra = fbd_feedback_vibra_periodic_prepare_vibra;
   vibra_class->end_vibra = fbd_feedback_vibra_periodic_end_vibra;
+  vibra_class->supports_device = fbd_feedback_vibra_periodic_supports_device;
 
   props[PROP_MAGNITUDE] =
     g_param_spec_double ("magnitude", "", "",
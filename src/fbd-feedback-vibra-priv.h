@@ -11,5 +11,6 @@ G_BEGIN_DECLS
 
 void   fbd_feedback_vibra_set_duration (FbdFeedbackVibra *self, guint duration);
 double fbd_feedback_vibra_get_max_strength (FbdFeedbackVibra *self);
+FbdDevVibra *fbd_feedback_vibra_get_device (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback);
 
 G_END_DECLS
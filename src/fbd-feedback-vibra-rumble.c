@@ -10,6 +10,7 @@
 #include "fbd-feedback-vibra-priv.h"
 #include "fbd-feedback-vibra-rumble.h"
 #include "fbd-feedback-manager.h"
+#include "fbd-timer-wheel.h"
 
 /**
  * SECTION:fbd-feedback-vibra
@@ -39,11 +40,15 @@ typedef struct _FbdFeedbackVibraRumble {
   guint            pause;     /* pause in msecs */
 
   double           magnitude; /* magnitude [0.0, 1.0] */
-  guint            rumble;    /* rumble in msecs */
-  guint            periods;   /* number of periods to play */
-  guint            timer_id;
 } FbdFeedbackVibraRumble;
 
+/* The timing of the rumbles derived from the feedback's properties */
+typedef struct _FbdVibraRumbleTiming {
+  guint count;
+  guint pause;
+  guint rumble;
+} FbdVibraRumbleTiming;
+
 G_DEFINE_TYPE (FbdFeedbackVibraRumble, fbd_feedback_vibra_rumble, FBD_TYPE_FEEDBACK_VIBRA);
 
 static void
@@ -94,89 +99,124 @@ fbd_feedback_vibra_rumble_get_property (GObject    *object,
   }
 }
 
-static gboolean
-on_period_ended (FbdFeedbackVibraRumble *self)
+static void
+get_timing (FbdFeedbackVibraRumble *self, FbdVibraRumbleTiming *timing)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  guint duration = fbd_feedback_vibra_get_duration (FBD_FEEDBACK_VIBRA (self));
+  int rumble = (int)(duration / self->count) - (int)self->pause;
+
+  if (rumble <= 0) {
+    timing->rumble = FBD_FEEDBACK_VIBRA_DEFAULT_DURATION;
+    timing->pause = 0;
+    timing->count = 1;
+    return;
+  }
 
-  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA_RUMBLE (self), G_SOURCE_REMOVE);
+  timing->rumble = rumble;
+  timing->pause = self->pause;
+  timing->count = self->count;
+}
+
+/* The playback's `pos` holds the number of periods left to play */
+static gboolean
+on_period_ended (FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibraRumble *self = FBD_FEEDBACK_VIBRA_RUMBLE (playback->feedback);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (FBD_FEEDBACK_VIBRA (self), playback);
 
-  if (self->periods) {
+  if (playback->pos) {
     double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
+    FbdVibraRumbleTiming timing;
     double magnitude;
 
+    get_timing (self, &timing);
     magnitude = MIN (self->magnitude, max_strength);
-    fbd_dev_vibra_rumble (dev, magnitude, self->rumble, FALSE);
-    self->periods--;
+    fbd_dev_vibra_rumble (dev, magnitude, timing.rumble, FALSE);
+    playback->pos--;
     return G_SOURCE_CONTINUE;
   }
+
+  playback->step_id = 0;
   return G_SOURCE_REMOVE;
 }
 
+/* Let the haptic thread time the rumbles if there is one */
+static gboolean
+step_rumbles (FbdVibraRumbleTiming *timing, FbdDevVibra *dev, double magnitude)
+{
+  guint n_steps = 2 * timing->count - 1;
+  g_autofree double *magnitudes = g_new0 (double, n_steps);
+  g_autofree guint *durations = g_new0 (guint, n_steps);
+
+  for (guint i = 0; i < n_steps; i++) {
+    gboolean is_rumble = (i % 2) == 0;
+
+    magnitudes[i] = is_rumble ? magnitude : 0.0;
+    durations[i] = is_rumble ? timing->rumble : timing->pause;
+  }
+
+  return fbd_dev_vibra_step_pattern (dev, magnitudes, durations, n_steps);
+}
+
 static void
-fbd_feedback_vibra_rumble_end_vibra (FbdFeedbackVibra *vibra)
+fbd_feedback_vibra_rumble_end_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
 {
-  FbdFeedbackVibraRumble *self = FBD_FEEDBACK_VIBRA_RUMBLE (vibra);
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
 
   fbd_dev_vibra_stop (dev);
-  g_clear_handle_id(&self->timer_id, g_source_remove);
+  g_clear_handle_id (&playback->step_id, fbd_timeout_remove);
+}
+
+static gboolean
+fbd_feedback_vibra_rumble_prepare_vibra (FbdFeedbackVibra *vibra, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraRumble *self = FBD_FEEDBACK_VIBRA_RUMBLE (vibra);
+  double max_strength = fbd_feedback_vibra_get_max_strength (vibra);
+  FbdVibraRumbleTiming timing;
+
+  /* All rumbles use the same effect */
+  get_timing (self, &timing);
+  return fbd_dev_vibra_prepare_rumble (dev, MIN (self->magnitude, max_strength), timing.rumble);
 }
 
 static void
-fbd_feedback_vibra_rumble_start_vibra (FbdFeedbackVibra *vibra)
+fbd_feedback_vibra_rumble_start_vibra (FbdFeedbackVibra *vibra, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackVibraRumble *self = FBD_FEEDBACK_VIBRA_RUMBLE (vibra);
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (vibra, playback);
   guint duration = fbd_feedback_vibra_get_duration (vibra);
   double max_strength = fbd_feedback_vibra_get_max_strength (FBD_FEEDBACK_VIBRA (self));
+  FbdVibraRumbleTiming timing;
   double magnitude;
   guint period;
 
-  self->rumble = (duration / self->count) - self->pause;
-  if (self->rumble <= 0) {
-    self->rumble = FBD_FEEDBACK_VIBRA_DEFAULT_DURATION;
-    self->pause = 0;
-    self->count = 1;
-  }
-  period = self->rumble + self->pause;
-  self->periods = self->count;
+  get_timing (self, &timing);
+  period = timing.rumble + timing.pause;
 
   magnitude = MIN (self->magnitude, max_strength);
   g_debug ("Rumble Vibra event: magnitude: %f, duration %d, rumble: %d, pause: %d, period: %d",
-           magnitude, duration, self->rumble, self->pause, period);
-  fbd_dev_vibra_rumble (dev, magnitude, self->rumble, TRUE);
-  self->periods--;
-  if (self->periods) {
-    self->timer_id = g_timeout_add (period, (GSourceFunc) on_period_ended, self);
+           magnitude, duration, timing.rumble, timing.pause, period);
+  if (step_rumbles (&timing, dev, magnitude))
+    return;
+
+  fbd_dev_vibra_rumble (dev, magnitude, timing.rumble, TRUE);
+  playback->pos = timing.count - 1;
+  if (playback->pos) {
+    playback->step_id = fbd_timeout_add (period, 0, (GSourceFunc) on_period_ended, playback);
   }
 }
 
-static gboolean
-fbd_feedback_vibra_rumble_is_available (FbdFeedbackBase *base)
-{
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
-
-  return FBD_IS_DEV_VIBRA (dev);
-}
-
 static void
 fbd_feedback_vibra_rumble_class_init (FbdFeedbackVibraRumbleClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  FbdFeedbackBaseClass *base_class = FBD_FEEDBACK_BASE_CLASS (klass);
   FbdFeedbackVibraClass *vibra_class = FBD_FEEDBACK_VIBRA_CLASS (klass);
 
   object_class->set_property = fbd_feedback_vibra_rumble_set_property;
   object_class->get_property = fbd_feedback_vibra_rumble_get_property;
 
-  base_class->is_available = fbd_feedback_vibra_rumble_is_available;
-
   vibra_class->start_vibra = fbd_feedback_vibra_rumble_start_vibra;
+  vibra_class->prepare_vibra = fbd_feedback_vibra_rumble_prepare_vibra;
   vibra_class->end_vibra = fbd_feedback_vibra_rumble_end_vibra;
 
   props[PROP_COUNT] =
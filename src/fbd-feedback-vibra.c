@@ -10,10 +10,12 @@
 #define G_LOG_DOMAIN "fbd-feedback-vibra"
 
 #include "fbd.h"
+#include "fbd-duty-governor.h"
 #include "fbd-enums.h"
 #include "fbd-feedback-vibra.h"
 #include "fbd-feedback-vibra-priv.h"
 #include "fbd-feedback-manager.h"
+#include "fbd-timer-wheel.h"
 
 /**
  * SECTION:fbd-feedback-vibra
@@ -28,13 +30,16 @@
 enum {
   PROP_0,
   PROP_DURATION,
+  PROP_PRIORITY,
+  PROP_ACTUATOR,
   PROP_LAST_PROP,
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
 typedef struct _FbdFeedbackVibraPrivate {
   guint      duration;
-  guint      timer_id;
+  guint      priority;
+  char      *actuator;
   double     max_strength;
 
   GSettings *settings;
@@ -53,21 +58,53 @@ on_max_haptic_strength_changed (FbdFeedbackVibra *self)
 }
 
 
+/* Let the governor know how long the motor is in use */
 static void
-on_timeout_expired (FbdFeedbackVibra *self)
+track_motor (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback, gboolean on)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
-  FbdFeedbackVibraPrivate *priv = fbd_feedback_vibra_get_instance_private (self);
-  FbdDevVibra *dev = fbd_feedback_manager_get_dev_vibra (manager);
+  FbdDutyGovernor *governor = fbd_duty_governor_get_default ();
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (self, playback);
+
+  if (dev == NULL)
+    return;
+
+  if (on) {
+    fbd_duty_governor_start (governor, dev,
+                             g_udev_device_get_name (fbd_dev_vibra_get_device (dev)));
+  } else {
+    fbd_duty_governor_stop (governor, dev);
+  }
+}
+
+
+static void
+on_timeout_expired (FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibra *self = FBD_FEEDBACK_VIBRA (playback->feedback);
+  FbdFeedbackVibraClass *klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
+
+  /* Stops the motor and any pending steps */
+  klass->end_vibra (self, playback);
+  track_motor (self, playback, FALSE);
+  playback->timer_id = 0;
+  fbd_feedback_playback_done (playback);
+}
+
+
+static void
+fbd_feedback_vibra_prepare_playback (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibra *self = FBD_FEEDBACK_VIBRA (base);
+  FbdDevVibra *dev = fbd_feedback_vibra_get_device (self, playback);
 
-  fbd_dev_vibra_stop (dev);
-  priv->timer_id = 0;
-  fbd_feedback_base_done (FBD_FEEDBACK_BASE (self));
+  /* Upload the effect so starting it is a single write */
+  if (dev)
+    fbd_feedback_vibra_prepare (self, dev);
 }
 
 
 static void
-fbd_feedback_vibra_run (FbdFeedbackBase *base)
+fbd_feedback_vibra_run (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackVibra *self = FBD_FEEDBACK_VIBRA (base);
   FbdFeedbackVibraPrivate *priv = fbd_feedback_vibra_get_instance_private (self);
@@ -75,29 +112,46 @@ fbd_feedback_vibra_run (FbdFeedbackBase *base)
 
   klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
   g_return_if_fail (klass->start_vibra);
-  klass->start_vibra (self);
+  klass->start_vibra (self, playback);
+  track_motor (self, playback, TRUE);
 
-  priv->timer_id = g_timeout_add_once (priv->duration,
-                                       (GSourceOnceFunc)on_timeout_expired,
-                                       self);
-  g_source_set_name_by_id (priv->timer_id, "feedback-vibra-timer");
+  playback->timer_id = fbd_timeout_add_once (priv->duration,
+                                             FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                             (GSourceOnceFunc)on_timeout_expired,
+                                             playback);
 }
 
 
 static void
-fbd_feedback_vibra_end (FbdFeedbackBase *base)
+fbd_feedback_vibra_end (FbdFeedbackBase *base, FbdFeedbackPlayback *playback)
 {
   FbdFeedbackVibra *self = FBD_FEEDBACK_VIBRA (base);
-  FbdFeedbackVibraPrivate *priv = fbd_feedback_vibra_get_instance_private (self);
   FbdFeedbackVibraClass *klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
 
-  if (!priv->timer_id)
+  /* The motor was already stopped when pausing */
+  if (fbd_feedback_playback_get_paused (playback)) {
+    playback->offset = 0;
+    fbd_feedback_playback_done (playback);
+    return;
+  }
+
+  if (!playback->timer_id)
     return;
 
   g_return_if_fail (klass->end_vibra);
-  klass->end_vibra (self);
-  g_clear_handle_id (&priv->timer_id, g_source_remove);
-  fbd_feedback_base_done (FBD_FEEDBACK_BASE (self));
+  klass->end_vibra (self, playback);
+  track_motor (self, playback, FALSE);
+  g_clear_handle_id (&playback->timer_id, fbd_timeout_remove);
+  fbd_feedback_playback_done (playback);
+}
+
+
+static gboolean
+fbd_feedback_vibra_is_available (FbdFeedbackBase *base)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+
+  return fbd_feedback_manager_find_dev_vibra (manager, FBD_FEEDBACK_VIBRA (base)) != NULL;
 }
 
 
@@ -114,6 +168,13 @@ fbd_feedback_vibra_set_property (GObject      *object,
   case PROP_DURATION:
     priv->duration = g_value_get_uint (value);
     break;
+  case PROP_PRIORITY:
+    priv->priority = g_value_get_uint (value);
+    break;
+  case PROP_ACTUATOR:
+    g_free (priv->actuator);
+    priv->actuator = g_value_dup_string (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -133,6 +194,12 @@ fbd_feedback_vibra_get_property (GObject    *object,
   case PROP_DURATION:
     g_value_set_uint (value, priv->duration);
     break;
+  case PROP_PRIORITY:
+    g_value_set_uint (value, priv->priority);
+    break;
+  case PROP_ACTUATOR:
+    g_value_set_string (value, priv->actuator);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -147,6 +214,7 @@ fbd_feedback_vibra_finalize (GObject *object)
   FbdFeedbackVibraPrivate *priv = fbd_feedback_vibra_get_instance_private (self);
 
   g_clear_object (&priv->settings);
+  g_free (priv->actuator);
 
   G_OBJECT_CLASS (fbd_feedback_vibra_parent_class)->finalize (object);
 }
@@ -162,8 +230,11 @@ fbd_feedback_vibra_class_init (FbdFeedbackVibraClass *klass)
   object_class->set_property = fbd_feedback_vibra_set_property;
   object_class->get_property = fbd_feedback_vibra_get_property;
 
+  base_class->start_order = FBD_FEEDBACK_START_ORDER_EARLY;
+  base_class->prepare = fbd_feedback_vibra_prepare_playback;
   base_class->run = fbd_feedback_vibra_run;
   base_class->end = fbd_feedback_vibra_end;
+  base_class->is_available = fbd_feedback_vibra_is_available;
 
   /**
    * FbdFeedbackVibra:duration:
@@ -176,6 +247,31 @@ fbd_feedback_vibra_class_init (FbdFeedbackVibraClass *klass)
       0, G_MAXUINT, FBD_FEEDBACK_VIBRA_DEFAULT_DURATION,
       G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * FbdFeedbackVibra:priority:
+   *
+   * Priority of the haptic feedback. If all suitable haptic motors are
+   * in use a feedback with a higher priority preempts a running one
+   * while feedbacks with lower or equal priority are dropped.
+   */
+  props[PROP_PRIORITY] =
+    g_param_spec_uint (
+      "priority", "", "",
+      0, 255, 0,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * FbdFeedbackVibra:actuator:
+   *
+   * The tag of the haptic motor to use. If unset any motor that supports
+   * the feedback is used.
+   */
+  props[PROP_ACTUATOR] =
+    g_param_spec_string (
+      "actuator", "", "",
+      NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
 
@@ -204,6 +300,17 @@ fbd_feedback_vibra_get_duration (FbdFeedbackVibra *self)
 }
 
 
+guint
+fbd_feedback_vibra_get_priority (FbdFeedbackVibra *self)
+{
+  FbdFeedbackVibraPrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA (self), 0);
+  priv = fbd_feedback_vibra_get_instance_private (self);
+  return priv->priority;
+}
+
+
 void
 fbd_feedback_vibra_set_duration (FbdFeedbackVibra *self, guint duration)
 {
@@ -232,3 +339,182 @@ fbd_feedback_vibra_get_max_strength (FbdFeedbackVibra *self)
 
   return priv->max_strength;
 }
+
+
+const char *
+fbd_feedback_vibra_get_actuator (FbdFeedbackVibra *self)
+{
+  FbdFeedbackVibraPrivate *priv;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA (self), NULL);
+
+  priv = fbd_feedback_vibra_get_instance_private (self);
+
+  return priv->actuator;
+}
+
+/**
+ * fbd_feedback_vibra_supports_device:
+ * @self: The haptic feedback
+ * @dev: The vibra device
+ *
+ * Check whether the feedback can be played on the given device. This
+ * takes the actuator tag and the device's capabilities into account.
+ *
+ * Returns: `TRUE` if @dev can play the feedback
+ */
+gboolean
+fbd_feedback_vibra_supports_device (FbdFeedbackVibra *self, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraPrivate *priv;
+  FbdFeedbackVibraClass *klass;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA (self), FALSE);
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (dev), FALSE);
+
+  priv = fbd_feedback_vibra_get_instance_private (self);
+  klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
+
+  if (priv->actuator && g_strcmp0 (priv->actuator, fbd_dev_vibra_get_actuator (dev)))
+    return FALSE;
+
+  if (klass->supports_device)
+    return klass->supports_device (self, dev);
+
+  return TRUE;
+}
+
+/**
+ * fbd_feedback_vibra_prepare:
+ * @self: The haptic feedback
+ * @dev: The vibra device the feedback will likely be played on
+ *
+ * Gets @dev ready to play the feedback (e.g. by uploading the
+ * effect) without playing anything.
+ *
+ * Returns: `TRUE` if the feedback was prepared
+ */
+gboolean
+fbd_feedback_vibra_prepare (FbdFeedbackVibra *self, FbdDevVibra *dev)
+{
+  FbdFeedbackVibraClass *klass;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA (self), FALSE);
+  g_return_val_if_fail (FBD_IS_DEV_VIBRA (dev), FALSE);
+
+  klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
+  if (klass->prepare_vibra == NULL)
+    return FALSE;
+
+  return klass->prepare_vibra (self, dev);
+}
+
+/**
+ * fbd_feedback_vibra_get_device:
+ * @self: The haptic feedback
+ * @playback: The playback of the feedback
+ *
+ * Get the device @playback is played on. If the manager didn't pick
+ * one this is the default vibra device.
+ *
+ * Returns:(transfer none)(nullable): The vibra device
+ */
+FbdDevVibra *
+fbd_feedback_vibra_get_device (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback)
+{
+  FbdDevVibra *dev;
+
+  g_return_val_if_fail (FBD_IS_FEEDBACK_VIBRA (self), NULL);
+  g_return_val_if_fail (playback, NULL);
+
+  dev = fbd_feedback_playback_get_device (playback);
+  if (dev)
+    return dev;
+
+  return fbd_feedback_manager_get_dev_vibra (fbd_feedback_manager_get_default ());
+}
+
+/**
+ * fbd_feedback_vibra_pause:
+ * @self: The haptic feedback
+ * @playback: The running playback
+ *
+ * Stops the motor but keeps @playback running, e.g. when its device
+ * got unplugged. The position is kept so fbd_feedback_vibra_resume()
+ * can continue from there.
+ */
+void
+fbd_feedback_vibra_pause (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback)
+{
+  FbdFeedbackVibraPrivate *priv;
+  FbdFeedbackVibraClass *klass;
+  gint64 elapsed;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_VIBRA (self));
+  g_return_if_fail (playback);
+
+  if (!playback->timer_id || fbd_feedback_playback_get_paused (playback))
+    return;
+
+  priv = fbd_feedback_vibra_get_instance_private (self);
+  klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
+
+  elapsed = (g_get_monotonic_time () - playback->run_time) / 1000;
+  playback->offset = MIN (elapsed, priv->duration);
+  g_debug ("Pausing '%s' at %ums", fbd_feedback_get_event_name (FBD_FEEDBACK_BASE (self)),
+           playback->offset);
+
+  klass->end_vibra (self, playback);
+  track_motor (self, playback, FALSE);
+  g_clear_handle_id (&playback->timer_id, fbd_timeout_remove);
+  fbd_feedback_playback_set_device (playback, NULL);
+  fbd_feedback_playback_set_paused (playback, TRUE);
+}
+
+/**
+ * fbd_feedback_vibra_resume:
+ * @self: The haptic feedback
+ * @playback: The paused playback
+ * @dev: The device to continue on
+ *
+ * Continues a playback paused with fbd_feedback_vibra_pause() on
+ * @dev. Feedback types that can't seek start over but still end
+ * when the original run would have ended.
+ */
+void
+fbd_feedback_vibra_resume (FbdFeedbackVibra    *self,
+                           FbdFeedbackPlayback *playback,
+                           FbdDevVibra         *dev)
+{
+  FbdFeedbackVibraPrivate *priv;
+  FbdFeedbackVibraClass *klass;
+
+  g_return_if_fail (FBD_IS_FEEDBACK_VIBRA (self));
+  g_return_if_fail (playback);
+  g_return_if_fail (FBD_IS_DEV_VIBRA (dev));
+
+  if (!fbd_feedback_playback_get_paused (playback))
+    return;
+
+  priv = fbd_feedback_vibra_get_instance_private (self);
+  klass = FBD_FEEDBACK_VIBRA_GET_CLASS (self);
+
+  g_debug ("Resuming '%s' at %ums", fbd_feedback_get_event_name (FBD_FEEDBACK_BASE (self)),
+           playback->offset);
+
+  fbd_feedback_playback_set_paused (playback, FALSE);
+  fbd_feedback_playback_set_device (playback, dev);
+  playback->run_time = g_get_monotonic_time () - (gint64)playback->offset * 1000;
+
+  if (klass->resume_vibra)
+    klass->resume_vibra (self, playback);
+  else
+    klass->start_vibra (self, playback);
+  track_motor (self, playback, TRUE);
+
+  playback->timer_id = fbd_timeout_add_once (priv->duration - playback->offset,
+                                             FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                             (GSourceOnceFunc)on_timeout_expired,
+                                             playback);
+  playback->offset = 0;
+}
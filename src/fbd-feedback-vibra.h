@@ -6,6 +6,7 @@
 #pragma once
 
 #include "fbd-feedback-base.h"
+#include "fbd-dev-vibra.h"
 
 G_BEGIN_DECLS
 
@@ -19,10 +20,21 @@ struct _FbdFeedbackVibraClass
 {
   FbdFeedbackBaseClass parent_class;
 
-  void (*start_vibra) (FbdFeedbackVibra *self);
-  void (*end_vibra) (FbdFeedbackVibra *self);
+  void (*start_vibra) (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback);
+  void (*end_vibra) (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback);
+  gboolean (*supports_device) (FbdFeedbackVibra *self, FbdDevVibra *dev);
+  gboolean (*prepare_vibra) (FbdFeedbackVibra *self, FbdDevVibra *dev);
+  void (*resume_vibra) (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback);
 };
 
 guint fbd_feedback_vibra_get_duration (FbdFeedbackVibra *self);
+guint fbd_feedback_vibra_get_priority (FbdFeedbackVibra *self);
+const char *fbd_feedback_vibra_get_actuator (FbdFeedbackVibra *self);
+gboolean fbd_feedback_vibra_supports_device (FbdFeedbackVibra *self, FbdDevVibra *dev);
+gboolean fbd_feedback_vibra_prepare (FbdFeedbackVibra *self, FbdDevVibra *dev);
+void fbd_feedback_vibra_pause (FbdFeedbackVibra *self, FbdFeedbackPlayback *playback);
+void fbd_feedback_vibra_resume (FbdFeedbackVibra    *self,
+                                FbdFeedbackPlayback *playback,
+                                FbdDevVibra         *dev);
 
 G_END_DECLS
@@ -6,18 +6,35 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  */
 
+#define _GNU_SOURCE
 #define G_LOG_DOMAIN "fbd-haptic-manager"
 
+#include "fbd-dispatcher.h"
+#include "fbd-duty-governor.h"
 #include "fbd-feedback-manager.h"
 #include "fbd-haptic-manager.h"
+#include "fbd-haptic-pattern.h"
 #include "fbd-feedback-base.h"
 #include "fbd-feedback-profile.h"
 #include "fbd-feedback-vibra-pattern.h"
+#include "fbd-feedback-vibra-priv.h"
+#include "fbd-recorder.h"
+#include "fbd-timer-wheel.h"
 
+#include "lfb-names.h"
+
+#include <gio/gunixfdlist.h>
 #include <glib.h>
 
+#include <unistd.h>
+
 #define MAX_ITEMS 10
-#define MAX_LEN 10000
+#define MAX_LEN FBD_HAPTIC_PATTERN_MAX_DURATION
+#define MAX_REPEAT_COUNT 1000
+
+#define MAX_SESSIONS 16
+/* The motor stops if a session isn't updated within this time (ms) */
+#define SESSION_UPDATE_TIMEOUT 1000
 
 /**
  * FbdHapticManager:
@@ -25,10 +42,28 @@
  * Handles the org.sigxcpu.Feedback.Haptic interface
  */
 
+typedef struct _FbdHapticSession {
+  guint        id;
+  char        *sender;
+  guint        watch_id;
+  FbdDevVibra *dev;
+  /* Whether the motor runs, it stops on its own after SESSION_UPDATE_TIMEOUT */
+  gboolean     on;
+  guint        off_id;
+} FbdHapticSession;
+
 struct _FbdHapticManager {
   LfbGdbusFeedbackHapticSkeleton parent;
 
-  FbdFeedbackVibraPattern       *vibra;
+  /* The playback of the running haptic pattern */
+  FbdFeedbackPlayback           *vibra;
+
+  /* Patterns passed via memfd */
+  FbdHapticPatternCache         *patterns;
+
+  /* Key: session id, value: FbdHapticSession */
+  GHashTable                    *sessions;
+  guint                          next_session_id;
 };
 
 static void fbd_feedback_manager_feedback_haptic_iface_init (LfbGdbusFeedbackHapticIface *iface);
@@ -41,6 +76,112 @@ G_DEFINE_TYPE_WITH_CODE (FbdHapticManager,
                            fbd_feedback_manager_feedback_haptic_iface_init));
 
 
+static void on_session_motor_off (gpointer data);
+
+/* Let the governor know how long the session's motor runs */
+static void
+track_session_motor (FbdHapticSession *session, gboolean on)
+{
+  FbdDutyGovernor *governor = fbd_duty_governor_get_default ();
+
+  g_clear_handle_id (&session->off_id, fbd_timeout_remove);
+
+  if (on && !session->on) {
+    fbd_duty_governor_start (governor, session->dev,
+                             g_udev_device_get_name (fbd_dev_vibra_get_device (session->dev)));
+  } else if (!on && session->on) {
+    fbd_duty_governor_stop (governor, session->dev);
+  }
+  session->on = on;
+
+  if (on) {
+    session->off_id = fbd_timeout_add_once (SESSION_UPDATE_TIMEOUT, FBD_TIMER_WHEEL_SLACK_DEFAULT,
+                                            on_session_motor_off, session);
+  }
+}
+
+
+static void
+on_session_motor_off (gpointer data)
+{
+  FbdHapticSession *session = data;
+
+  session->off_id = 0;
+  track_session_motor (session, FALSE);
+  fbd_feedback_manager_restore_duty_budget (fbd_feedback_manager_get_default (), session->dev);
+}
+
+
+static void
+haptic_session_free (FbdHapticSession *session)
+{
+  g_debug ("Closing haptic session %u of %s", session->id, session->sender);
+
+  fbd_dev_vibra_stop (session->dev);
+  track_session_motor (session, FALSE);
+  g_clear_handle_id (&session->watch_id, g_bus_unwatch_name);
+  g_clear_object (&session->dev);
+  g_free (session->sender);
+  g_free (session);
+}
+
+
+static gboolean
+session_has_sender (gpointer key, gpointer value, gpointer user_data)
+{
+  FbdHapticSession *session = value;
+
+  return g_strcmp0 (session->sender, user_data) == 0;
+}
+
+
+static void
+on_session_client_vanished (GDBusConnection *connection,
+                            const gchar     *name,
+                            gpointer         user_data)
+{
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (user_data);
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdHapticSession *session;
+  GHashTableIter iter;
+
+  g_debug ("Haptic session client %s vanished", name);
+  g_hash_table_iter_init (&iter, self->sessions);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&session)) {
+    if (!session_has_sender (NULL, session, (gpointer)name))
+      continue;
+
+    fbd_feedback_manager_restore_duty_budget (manager, session->dev);
+    g_hash_table_iter_remove (&iter);
+  }
+}
+
+
+static gboolean
+session_uses_device (gpointer key, gpointer value, gpointer user_data)
+{
+  FbdHapticSession *session = value;
+
+  return user_data == NULL || session->dev == user_data;
+}
+
+
+static FbdHapticSession *
+lookup_session (FbdHapticManager *self, GDBusMethodInvocation *invocation, guint id)
+{
+  FbdHapticSession *session = g_hash_table_lookup (self->sessions, GUINT_TO_POINTER (id));
+
+  if (session == NULL ||
+      g_strcmp0 (session->sender, g_dbus_method_invocation_get_sender (invocation))) {
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                           "No haptic session %u", id);
+    return NULL;
+  }
+
+  return session;
+}
+
+
 /**
  * build_pattern:
  * @pattern: The pattern as GVariant
@@ -87,6 +228,111 @@ build_pattern (GVariant *pattern, GArray **out_magnitudes, GArray **out_duration
 }
 
 
+static void
+on_vibra_ended (FbdFeedbackPlayback *playback, gpointer unused)
+{
+  FbdDevVibra *dev = fbd_feedback_playback_get_device (playback);
+
+  fbd_feedback_manager_restore_duty_budget (fbd_feedback_manager_get_default (), dev);
+}
+
+
+/**
+ * play_pattern:
+ * @self: The haptic manager
+ * @app_id: The app id of the app that wants to vibrate
+ * @magnitudes:(nullable): The magnitudes
+ * @durations:(nullable): The durations
+ * @repeat_count: How often to play the steps from @repeat_from again
+ * @repeat_from: The first step that is repeated
+ *
+ * Plays the pattern replacing any running one. If the pattern is
+ * `NULL` the running pattern is ended.
+ *
+ * Returns: `TRUE` if the pattern is played
+ */
+static gboolean
+play_pattern (FbdHapticManager *self,
+              const char       *app_id,
+              GArray           *magnitudes,
+              GArray           *durations,
+              guint             repeat_count,
+              guint             repeat_from)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdDevVibra *vibra_dev;
+  FbdFeedbackProfileLevel level;
+  g_autoptr (FbdFeedbackVibraPattern) fb = NULL;
+
+  level = fbd_feedback_manager_get_effective_level (manager,
+                                                    app_id,
+                                                    FBD_FEEDBACK_PROFILE_LEVEL_QUIET,
+                                                    FALSE);
+  if (level < FBD_FEEDBACK_PROFILE_LEVEL_QUIET) {
+    g_debug ("Feedback level too low for haptic");
+    return FALSE;
+  }
+
+  if (!fbd_feedback_manager_get_dev_vibra (manager)) {
+    g_debug ("No haptic device");
+    return FALSE;
+  }
+
+  if (magnitudes == NULL) {
+    g_debug ("Empty pattern, ending feedback");
+    fbd_haptic_manager_end_feedback (self);
+    return TRUE;
+  }
+
+  if (self->vibra)
+    fbd_feedback_playback_end (self->vibra);
+  vibra_dev = fbd_feedback_manager_get_idle_dev_vibra (manager);
+  if (!vibra_dev) {
+    g_debug ("Haptic busy");
+    /* If there's an event with haptic deny haptic pattern */
+    return FALSE;
+  }
+
+  if (!fbd_feedback_manager_apply_duty_budget (manager, vibra_dev))
+    return FALSE;
+
+  fb = fbd_feedback_vibra_pattern_new_repeat (magnitudes, durations, repeat_count, repeat_from);
+  g_clear_pointer (&self->vibra, fbd_feedback_playback_unref);
+  self->vibra = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (fb), FBD_FEEDBACK_PROFILE_LEVEL_QUIET);
+  fbd_feedback_playback_set_device (self->vibra, vibra_dev);
+  fbd_feedback_playback_set_ended_func (self->vibra, on_vibra_ended, NULL);
+  fbd_feedback_playback_run (self->vibra);
+
+  return TRUE;
+}
+
+
+static void
+record_vibrate (GDBusMethodInvocation *invocation,
+                const char            *app_id,
+                GVariant              *pattern,
+                guint                  repeat_count,
+                guint                  repeat_from,
+                FbdRecordResult        result)
+{
+  FbdRecorder *recorder = fbd_recorder_get_default ();
+  GVariantDict hints;
+
+  if (recorder == NULL)
+    return;
+
+  g_variant_dict_init (&hints, NULL);
+  g_variant_dict_insert_value (&hints, "pattern", pattern);
+  if (repeat_count) {
+    g_variant_dict_insert (&hints, "repeat-count", "u", repeat_count);
+    g_variant_dict_insert (&hints, "repeat-from", "u", repeat_from);
+  }
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_VIBRATE,
+                    g_dbus_method_invocation_get_sender (invocation), app_id, NULL,
+                    g_variant_dict_end (&hints), 0, 0, result);
+}
+
+
 static gboolean
 fbd_feedback_manager_handle_vibrate (LfbGdbusFeedbackHaptic *object,
                                      GDBusMethodInvocation  *invocation,
@@ -95,54 +341,231 @@ fbd_feedback_manager_handle_vibrate (LfbGdbusFeedbackHaptic *object,
 {
   FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
   FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
-  FbdDevVibra *vibra_dev;
-  FbdFeedbackProfileLevel level;
-  gboolean non_empty;
-  g_autoptr (FbdFeedbackVibraPattern) fb = NULL;
+  gboolean success;
   g_autoptr (GArray) magnitudes = NULL, durations = NULL;
 
   g_debug ("Haptic triggered for %s", app_id);
 
+  if (!fbd_feedback_manager_admit (manager, g_dbus_method_invocation_get_sender (invocation), 1)) {
+    record_vibrate (invocation, app_id, pattern, 0, 0, FBD_RECORD_RESULT_RATE_LIMITED);
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many haptic requests");
+    return TRUE;
+  }
+
+  build_pattern (pattern, &magnitudes, &durations);
+  success = play_pattern (self, app_id, magnitudes, durations, 0, 0);
+  record_vibrate (invocation, app_id, pattern, 0, 0,
+                  success ? FBD_RECORD_RESULT_OK : FBD_RECORD_RESULT_DROPPED);
+
+  lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, success);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_vibrate_ex (LfbGdbusFeedbackHaptic *object,
+                                        GDBusMethodInvocation  *invocation,
+                                        const gchar            *app_id,
+                                        GVariant               *pattern,
+                                        guint                   repeat_count,
+                                        guint                   repeat_from)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
+  gboolean success;
+  g_autoptr (GArray) magnitudes = NULL, durations = NULL;
+
+  g_debug ("Haptic triggered for %s, repeating from %u %u times", app_id, repeat_from,
+           repeat_count);
+
+  if (!fbd_feedback_manager_admit (manager, g_dbus_method_invocation_get_sender (invocation), 1)) {
+    record_vibrate (invocation, app_id, pattern, repeat_count, repeat_from,
+                    FBD_RECORD_RESULT_RATE_LIMITED);
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many haptic requests");
+    return TRUE;
+  }
+
+  if (build_pattern (pattern, &magnitudes, &durations) && repeat_from >= magnitudes->len) {
+    record_vibrate (invocation, app_id, pattern, repeat_count, repeat_from,
+                    FBD_RECORD_RESULT_INVALID);
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                           "Repeat index %u not within pattern", repeat_from);
+    return TRUE;
+  }
+
+  repeat_count = MIN (repeat_count, MAX_REPEAT_COUNT);
+  success = play_pattern (self, app_id, magnitudes, durations, repeat_count, repeat_from);
+  record_vibrate (invocation, app_id, pattern, repeat_count, repeat_from,
+                  success ? FBD_RECORD_RESULT_OK : FBD_RECORD_RESULT_DROPPED);
+
+  lfb_gdbus_feedback_haptic_complete_vibrate_ex (object, invocation, success);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_vibrate_fd (LfbGdbusFeedbackHaptic *object,
+                                        GDBusMethodInvocation  *invocation,
+                                        GUnixFDList            *fd_list,
+                                        const gchar            *app_id,
+                                        gint                    pattern_handle)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
+  const FbdHapticPattern *pattern;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  gboolean success;
+  int fd;
+
+  g_debug ("Haptic via memfd triggered for %s", app_id);
+
+  if (!fbd_feedback_manager_admit (manager, g_dbus_method_invocation_get_sender (invocation), 1)) {
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many haptic requests");
+    return TRUE;
+  }
+
+  fd = g_unix_fd_list_get (fd_list, pattern_handle, &err);
+  if (fd < 0) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return TRUE;
+  }
+
+  bytes = fbd_haptic_pattern_map_fd (fd, &err);
+  close (fd);
+  if (!bytes) {
+    g_dbus_method_invocation_return_gerror (invocation, err);
+    return TRUE;
+  }
+
+  pattern = fbd_haptic_pattern_cache_lookup (self->patterns, bytes);
+  success = play_pattern (self, app_id,
+                          pattern ? pattern->magnitudes : NULL,
+                          pattern ? pattern->durations : NULL,
+                          0, 0);
+
+  lfb_gdbus_feedback_haptic_complete_vibrate_fd (object, invocation, NULL, success);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_open_session (LfbGdbusFeedbackHaptic *object,
+                                          GDBusMethodInvocation  *invocation,
+                                          const gchar            *app_id)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+  FbdHapticSession *session;
+  FbdFeedbackProfileLevel level;
+  FbdDevVibra *vibra_dev;
+
+  g_debug ("Haptic session requested by %s", app_id);
+
+  if (!fbd_feedback_manager_admit (manager, sender, 1)) {
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many haptic requests");
+    return TRUE;
+  }
+
+  if (g_hash_table_size (self->sessions) >= MAX_SESSIONS) {
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                           "Too many haptic sessions");
+    return TRUE;
+  }
+
   level = fbd_feedback_manager_get_effective_level (manager,
                                                     app_id,
                                                     FBD_FEEDBACK_PROFILE_LEVEL_QUIET,
                                                     FALSE);
   if (level < FBD_FEEDBACK_PROFILE_LEVEL_QUIET) {
     g_debug ("Feedback level too low for haptic");
-    lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, FALSE);
+    lfb_gdbus_feedback_haptic_complete_open_session (object, invocation, 0);
     return TRUE;
   }
 
-  vibra_dev = fbd_feedback_manager_get_dev_vibra (manager);
+  /* Motors of other sessions aren't idle */
+  vibra_dev = fbd_feedback_manager_get_idle_dev_vibra (manager);
   if (!vibra_dev) {
-    g_debug ("No haptic device");
-    lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, FALSE);
+    g_debug ("Haptic busy");
+    lfb_gdbus_feedback_haptic_complete_open_session (object, invocation, 0);
     return TRUE;
   }
 
-  non_empty = build_pattern (pattern, &magnitudes, &durations);
-  if (!non_empty) {
-    g_debug ("Empty pattern, ending feedback");
-    fbd_haptic_manager_end_feedback (self);
-    g_clear_object (&self->vibra);
-    lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, TRUE);
+  session = g_new0 (FbdHapticSession, 1);
+  session->id = self->next_session_id++;
+  if (session->id == 0)
+    session->id = self->next_session_id++;
+  session->sender = g_strdup (sender);
+  session->dev = g_object_ref (vibra_dev);
+  session->watch_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                      sender,
+                                                      G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                      NULL,
+                                                      on_session_client_vanished,
+                                                      self,
+                                                      NULL);
+  g_hash_table_insert (self->sessions, GUINT_TO_POINTER (session->id), session);
+
+  g_debug ("Opened haptic session %u for %s", session->id, sender);
+  lfb_gdbus_feedback_haptic_complete_open_session (object, invocation, session->id);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_update_magnitude (LfbGdbusFeedbackHaptic *object,
+                                              GDBusMethodInvocation  *invocation,
+                                              guint                   id,
+                                              double                  magnitude)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
+  FbdHapticSession *session;
+
+  session = lookup_session (self, invocation, id);
+  if (session == NULL)
     return TRUE;
+
+  magnitude = MAX (0.0, MIN (magnitude, 1.0));
+  if (magnitude > 0.0 && !fbd_feedback_manager_apply_duty_budget (manager, session->dev)) {
+    g_debug ("Duty cycle budget used up, stopping haptic session %u", id);
+    magnitude = 0.0;
   }
 
-  if (self->vibra)
-    fbd_feedback_end (FBD_FEEDBACK_BASE (self->vibra));
-  if (fbd_dev_vibra_is_busy (vibra_dev)) {
-    g_debug ("Haptic busy");
-    /* If there's an event with haptic deny haptic pattern */
-    lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, FALSE);
+  if (magnitude == 0.0)
+    fbd_dev_vibra_stop (session->dev);
+  else
+    fbd_dev_vibra_retune (session->dev, magnitude, SESSION_UPDATE_TIMEOUT);
+  track_session_motor (session, magnitude > 0.0);
+  if (magnitude == 0.0)
+    fbd_feedback_manager_restore_duty_budget (manager, session->dev);
+
+  lfb_gdbus_feedback_haptic_complete_update_magnitude (object, invocation);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_feedback_manager_handle_close_session (LfbGdbusFeedbackHaptic *object,
+                                           GDBusMethodInvocation  *invocation,
+                                           guint                   id)
+{
+  FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
+  FbdHapticSession *session;
+
+  session = lookup_session (self, invocation, id);
+  if (session == NULL)
     return TRUE;
-  }
 
-  fb = fbd_feedback_vibra_pattern_new (magnitudes, durations);
-  fbd_feedback_run (FBD_FEEDBACK_BASE (fb));
-  self->vibra = g_steal_pointer (&fb);
+  fbd_feedback_manager_restore_duty_budget (fbd_feedback_manager_get_default (), session->dev);
+  g_hash_table_remove (self->sessions, GUINT_TO_POINTER (id));
 
-  lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, TRUE);
+  lfb_gdbus_feedback_haptic_complete_close_session (object, invocation);
   return TRUE;
 }
 
@@ -151,6 +574,11 @@ static void
 fbd_feedback_manager_feedback_haptic_iface_init (LfbGdbusFeedbackHapticIface *iface)
 {
   iface->handle_vibrate = fbd_feedback_manager_handle_vibrate;
+  iface->handle_vibrate_ex = fbd_feedback_manager_handle_vibrate_ex;
+  iface->handle_vibrate_fd = fbd_feedback_manager_handle_vibrate_fd;
+  iface->handle_open_session = fbd_feedback_manager_handle_open_session;
+  iface->handle_update_magnitude = fbd_feedback_manager_handle_update_magnitude;
+  iface->handle_close_session = fbd_feedback_manager_handle_close_session;
 }
 
 
@@ -159,24 +587,50 @@ fbd_haptic_manager_finalize (GObject *object)
 {
   FbdHapticManager *self = FBD_HAPTIC_MANAGER (object);
 
+  /* The feedback manager that owns the gain might be gone already */
+  if (self->vibra)
+    fbd_feedback_playback_set_ended_func (self->vibra, NULL, NULL);
   fbd_haptic_manager_end_feedback (self);
+  g_clear_pointer (&self->sessions, g_hash_table_destroy);
+  g_clear_pointer (&self->patterns, fbd_haptic_pattern_cache_free);
 
   G_OBJECT_CLASS (fbd_haptic_manager_parent_class)->finalize (object);
 }
 
 
+static GDBusInterfaceVTable *
+fbd_haptic_manager_get_vtable (GDBusInterfaceSkeleton *skeleton)
+{
+  GDBusInterfaceSkeletonClass *skeleton_class;
+
+  skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (fbd_haptic_manager_parent_class);
+
+  /* Method calls are handled on the main thread */
+  return fbd_dispatcher_wrap_vtable (skeleton, skeleton_class->get_vtable (skeleton));
+}
+
+
 static void
 fbd_haptic_manager_class_init (FbdHapticManagerClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GDBusInterfaceSkeletonClass *skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (klass);
 
   object_class->finalize = fbd_haptic_manager_finalize;
+
+  skeleton_class->get_vtable = fbd_haptic_manager_get_vtable;
 }
 
 
 static void
 fbd_haptic_manager_init (FbdHapticManager *self)
 {
+  self->patterns = fbd_haptic_pattern_cache_new ();
+  self->next_session_id = 1;
+  self->sessions = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify)haptic_session_free);
 }
 
 
@@ -195,6 +649,45 @@ fbd_haptic_manager_end_feedback (FbdHapticManager *self)
   if (!self->vibra)
     return;
 
-  fbd_feedback_end (FBD_FEEDBACK_BASE (self->vibra));
-  g_clear_object (&self->vibra);
+  fbd_feedback_playback_end (self->vibra);
+  g_clear_pointer (&self->vibra, fbd_feedback_playback_unref);
+}
+
+
+/**
+ * fbd_haptic_manager_get_dev_vibra:
+ * @self: The haptic manager
+ *
+ * Get the device used by the currently running haptic pattern.
+ *
+ * Returns:(transfer none)(nullable): The vibra device
+ */
+FbdDevVibra *
+fbd_haptic_manager_get_dev_vibra (FbdHapticManager *self)
+{
+  g_return_val_if_fail (FBD_IS_HAPTIC_MANAGER (self), NULL);
+
+  if (!self->vibra || fbd_feedback_playback_get_ended (self->vibra))
+    return NULL;
+
+  return fbd_feedback_vibra_get_device (FBD_FEEDBACK_VIBRA (self->vibra->feedback), self->vibra);
+}
+
+/**
+ * fbd_haptic_manager_has_session:
+ * @self: The haptic manager
+ * @dev: (nullable): The vibra device
+ *
+ * Checks whether a haptic session holds @dev or any device if @dev
+ * is `NULL`. Sessions keep their motor from being used by anything
+ * else until they're closed.
+ *
+ * Returns: `TRUE` if there's a matching session
+ */
+gboolean
+fbd_haptic_manager_has_session (FbdHapticManager *self, FbdDevVibra *dev)
+{
+  g_return_val_if_fail (FBD_IS_HAPTIC_MANAGER (self), FALSE);
+
+  return g_hash_table_find (self->sessions, session_uses_device, dev) != NULL;
 }
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "fbd-dev-vibra.h"
 #include "lfb-gdbus.h"
 #include <glib-object.h>
 
@@ -18,6 +19,8 @@ G_DECLARE_FINAL_TYPE (FbdHapticManager, fbd_haptic_manager, FBD, HAPTIC_MANAGER,
 
 FbdHapticManager *fbd_haptic_manager_new          (void);
 void              fbd_haptic_manager_end_feedback (FbdHapticManager *self);
+FbdDevVibra      *fbd_haptic_manager_get_dev_vibra (FbdHapticManager *self);
+gboolean          fbd_haptic_manager_has_session (FbdHapticManager *self, FbdDevVibra *dev);
 
 
 G_END_DECLS
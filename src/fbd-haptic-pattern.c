@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define _GNU_SOURCE
+#define G_LOG_DOMAIN "fbd-haptic-pattern"
+
+#include "fbd-haptic-pattern.h"
+
+#include <gio/gio.h>
+
+#include <fcntl.h>
+
+#define PATTERN_CACHE_SIZE 16
+#define REQUIRED_SEALS (F_SEAL_WRITE | F_SEAL_SHRINK)
+
+/**
+ * FbdHapticPatternCache:
+ *
+ * Haptic patterns passed via memfd (see `VibrateFd`) are usually the
+ * same over and over again, so keep the parsed patterns around keyed
+ * by their contents. The cache is dropped as a whole once it's full.
+ */
+
+struct _FbdHapticPatternCache {
+  /* Key: memfd contents as GBytes, value: FbdHapticPattern */
+  GHashTable *patterns;
+};
+
+
+static void
+haptic_pattern_free (FbdHapticPattern *pattern)
+{
+  g_array_unref (pattern->magnitudes);
+  g_array_unref (pattern->durations);
+  g_free (pattern);
+}
+
+/**
+ * build_pattern_from_bytes:
+ * @bytes: The packed pattern steps
+ * @out_magnitudes:(out): The magnitudes
+ * @out_durations: The durations
+ *
+ * Parses the packed pattern steps applying the limits.
+ *
+ * Returns: The `TRUE` if here were elements in the pattern, otherwise `FALSE`
+ */
+static gboolean
+build_pattern_from_bytes (GBytes *bytes, GArray **out_magnitudes, GArray **out_durations)
+{
+  gsize size;
+  const FbdHapticStep *steps = g_bytes_get_data (bytes, &size);
+  guint n_items = size / sizeof (FbdHapticStep);
+  GArray *durations, *magnitudes;
+
+  if (n_items == 0)
+    return FALSE;
+
+  durations = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_items);
+  magnitudes = g_array_sized_new (FALSE, FALSE, sizeof (double), n_items);
+
+  for (guint pos = 0; pos < n_items; pos++) {
+    guint duration = MIN (steps[pos].duration, FBD_HAPTIC_PATTERN_MAX_DURATION);
+    /* Also maps NaN to 0.0 */
+    double magnitude = steps[pos].magnitude > 0.0 ? MIN (steps[pos].magnitude, 1.0) : 0.0;
+
+    g_array_append_val (durations, duration);
+    g_array_append_val (magnitudes, magnitude);
+  }
+
+  *out_durations = durations;
+  *out_magnitudes = magnitudes;
+
+  return TRUE;
+}
+
+/**
+ * fbd_haptic_pattern_map_fd:
+ * @fd: A memfd holding packed #FbdHapticStep
+ * @error: return location for error or %NULL
+ *
+ * Maps the pattern in @fd. The memfd must be sealed against writing
+ * and shrinking and hold at most `FBD_HAPTIC_PATTERN_MAX_FD_STEPS`
+ * complete steps.
+ *
+ * Returns:(transfer full): The pattern's contents
+ */
+GBytes *
+fbd_haptic_pattern_map_fd (int fd, GError **error)
+{
+  g_autoptr (GMappedFile) mapped = NULL;
+  int seals;
+
+  seals = fcntl (fd, F_GET_SEALS);
+  if (seals == -1 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS) {
+    g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Pattern memfd not sealed");
+    return NULL;
+  }
+
+  mapped = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (!mapped)
+    return NULL;
+
+  if (g_mapped_file_get_length (mapped) % sizeof (FbdHapticStep) ||
+      g_mapped_file_get_length (mapped) > FBD_HAPTIC_PATTERN_MAX_FD_STEPS * sizeof (FbdHapticStep)) {
+    g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "Invalid pattern size %" G_GSIZE_FORMAT,
+                 g_mapped_file_get_length (mapped));
+    return NULL;
+  }
+
+  return g_mapped_file_get_bytes (mapped);
+}
+
+
+FbdHapticPatternCache *
+fbd_haptic_pattern_cache_new (void)
+{
+  FbdHapticPatternCache *self = g_new0 (FbdHapticPatternCache, 1);
+
+  self->patterns = g_hash_table_new_full (g_bytes_hash,
+                                          (GEqualFunc)g_bytes_equal,
+                                          (GDestroyNotify)g_bytes_unref,
+                                          (GDestroyNotify)haptic_pattern_free);
+  return self;
+}
+
+
+void
+fbd_haptic_pattern_cache_free (FbdHapticPatternCache *self)
+{
+  g_clear_pointer (&self->patterns, g_hash_table_destroy);
+  g_free (self);
+}
+
+/**
+ * fbd_haptic_pattern_cache_lookup:
+ * @self: The cache
+ * @bytes: The pattern's contents as returned by fbd_haptic_pattern_map_fd()
+ *
+ * Looks up the pattern in the cache, parsing and adding it if it's not
+ * there yet.
+ *
+ * Returns:(transfer none)(nullable): The pattern or %NULL if it has no steps
+ */
+const FbdHapticPattern *
+fbd_haptic_pattern_cache_lookup (FbdHapticPatternCache *self, GBytes *bytes)
+{
+  FbdHapticPattern *pattern;
+  gconstpointer data;
+  gsize size;
+
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (bytes, NULL);
+
+  pattern = g_hash_table_lookup (self->patterns, bytes);
+  if (pattern) {
+    g_debug ("Using cached haptic pattern");
+    return pattern;
+  }
+
+  pattern = g_new0 (FbdHapticPattern, 1);
+  if (!build_pattern_from_bytes (bytes, &pattern->magnitudes, &pattern->durations)) {
+    g_free (pattern);
+    return NULL;
+  }
+
+  if (g_hash_table_size (self->patterns) >= PATTERN_CACHE_SIZE)
+    g_hash_table_remove_all (self->patterns);
+
+  /* Don't keep the client's memfd mapped */
+  data = g_bytes_get_data (bytes, &size);
+  g_hash_table_insert (self->patterns, g_bytes_new (data, size), pattern);
+
+  return pattern;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Longest duration of a pattern step in ms */
+#define FBD_HAPTIC_PATTERN_MAX_DURATION 10000
+/* Most steps a pattern passed via memfd can have */
+#define FBD_HAPTIC_PATTERN_MAX_FD_STEPS 1024
+
+/**
+ * FbdHapticStep:
+ * @magnitude: The magnitude from 0.0 to 1.0
+ * @duration: The duration in ms
+ *
+ * The layout of a pattern step in a memfd.
+ */
+typedef struct _FbdHapticStep {
+  float   magnitude;
+  guint32 duration;
+} FbdHapticStep;
+G_STATIC_ASSERT (sizeof (FbdHapticStep) == 8);
+
+/**
+ * FbdHapticPattern:
+ * @magnitudes: The magnitudes
+ * @durations: The durations
+ *
+ * A parsed pattern with the limits applied.
+ */
+typedef struct _FbdHapticPattern {
+  GArray *magnitudes;
+  GArray *durations;
+} FbdHapticPattern;
+
+typedef struct _FbdHapticPatternCache FbdHapticPatternCache;
+
+GBytes                 *fbd_haptic_pattern_map_fd (int fd, GError **error);
+FbdHapticPatternCache  *fbd_haptic_pattern_cache_new (void);
+void                    fbd_haptic_pattern_cache_free (FbdHapticPatternCache *self);
+const FbdHapticPattern *fbd_haptic_pattern_cache_lookup (FbdHapticPatternCache *self,
+                                                         GBytes                *bytes);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdHapticPatternCache, fbd_haptic_pattern_cache_free)
+
+G_END_DECLS
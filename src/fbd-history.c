@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-history"
+
+#include "fbd-history.h"
+
+/**
+ * FbdHistory:
+ *
+ * Remembers the last `FBD_HISTORY_SIZE` events so one can look at
+ * what happened to an event after the fact, e.g. when a notification
+ * didn't give haptic feedback, without having debug logging enabled.
+ *
+ * All entries are allocated up front so adding events is cheap
+ * enough to always happen. Once the history is full the oldest event
+ * gets overwritten. The history must only be used from the main
+ * thread.
+ */
+
+struct _FbdHistory {
+  FbdHistoryEntry entries[FBD_HISTORY_SIZE];
+  /* The slot the next event goes to */
+  guint           head;
+  guint           len;
+};
+
+
+static void
+copy_name (char *dest, const char *src)
+{
+  const char *end;
+
+  g_strlcpy (dest, src ?: "", FBD_HISTORY_NAME_LEN);
+  /* Don't leave half a character when truncating */
+  if (!g_utf8_validate (dest, -1, &end))
+    *(char *)end = '\0';
+}
+
+
+static const char *
+reason_to_string (FbdHistoryEntry *entry)
+{
+  if (!entry->ended)
+    return "";
+
+  switch (entry->reason) {
+  case FBD_EVENT_END_REASON_NOT_FOUND:
+    return "not-found";
+  case FBD_EVENT_END_REASON_NATURAL:
+    return "natural";
+  case FBD_EVENT_END_REASON_EXPIRED:
+    return "expired";
+  case FBD_EVENT_END_REASON_EXPLICIT:
+    return "explicit";
+  default:
+    g_return_val_if_reached ("");
+  }
+}
+
+
+FbdHistory *
+fbd_history_new (void)
+{
+  return g_new0 (FbdHistory, 1);
+}
+
+
+void
+fbd_history_free (FbdHistory *self)
+{
+  g_free (self);
+}
+
+/**
+ * fbd_history_add:
+ * @self: The history
+ * @id: The event's id
+ * @app_id: The app that triggered the event
+ * @event: The event name
+ * @level: The effective feedback level
+ * @feedbacks: The kinds of feedback that were chosen
+ *
+ * Adds an event to the history. Use fbd_history_end() once its
+ * feedbacks ended.
+ */
+void
+fbd_history_add (FbdHistory              *self,
+                 guint                    id,
+                 const char              *app_id,
+                 const char              *event,
+                 FbdFeedbackProfileLevel  level,
+                 FbdEventCapabilities     feedbacks)
+{
+  FbdHistoryEntry *entry;
+
+  g_return_if_fail (self);
+
+  entry = &self->entries[self->head];
+  entry->id = id;
+  copy_name (entry->app_id, app_id);
+  copy_name (entry->event, event);
+  entry->level = level;
+  entry->feedbacks = feedbacks;
+  entry->ended = FALSE;
+  entry->reason = FBD_EVENT_END_REASON_NATURAL;
+  entry->time = g_get_real_time ();
+  entry->start = g_get_monotonic_time ();
+  entry->duration = 0;
+
+  self->head = (self->head + 1) % FBD_HISTORY_SIZE;
+  self->len = MIN (self->len + 1, FBD_HISTORY_SIZE);
+}
+
+/**
+ * fbd_history_end:
+ * @self: The history
+ * @id: The event's id
+ * @reason: Why the event's feedbacks ended
+ *
+ * Records that the event's feedbacks ended. Does nothing if the event
+ * already dropped out of the history.
+ */
+void
+fbd_history_end (FbdHistory *self, guint id, FbdEventEndReason reason)
+{
+  g_return_if_fail (self);
+
+  /* Events usually end soon so look at the newest ones first */
+  for (guint i = 0; i < self->len; i++) {
+    FbdHistoryEntry *entry = (FbdHistoryEntry *)fbd_history_get_entry (self, i);
+
+    if (entry->id != id || entry->ended)
+      continue;
+
+    entry->ended = TRUE;
+    entry->reason = reason;
+    entry->duration = g_get_monotonic_time () - entry->start;
+    return;
+  }
+}
+
+
+guint
+fbd_history_get_n_entries (FbdHistory *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return self->len;
+}
+
+/**
+ * fbd_history_get_entry:
+ * @self: The history
+ * @index: The entry's index, 0 is the newest event
+ *
+ * Returns:(transfer none): The entry
+ */
+const FbdHistoryEntry *
+fbd_history_get_entry (FbdHistory *self, guint index)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (index < self->len, NULL);
+
+  return &self->entries[(self->head + FBD_HISTORY_SIZE - 1 - index) % FBD_HISTORY_SIZE];
+}
+
+/**
+ * fbd_history_to_variant:
+ * @self: The history
+ *
+ * Gets the history in the format of the `GetHistory` DBus method,
+ * oldest event first.
+ *
+ * Returns:(transfer floating): The history
+ */
+GVariant *
+fbd_history_to_variant (FbdHistory *self)
+{
+  GVariantBuilder builder;
+
+  g_return_val_if_fail (self, NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(usssassxx)"));
+  for (int i = self->len - 1; i >= 0; i--) {
+    FbdHistoryEntry *entry = (FbdHistoryEntry *)fbd_history_get_entry (self, i);
+    const char *feedbacks[4] = { NULL };
+    guint n = 0;
+
+    if (entry->feedbacks & FBD_EVENT_CAPABILITY_SOUND)
+      feedbacks[n++] = "sound";
+    if (entry->feedbacks & FBD_EVENT_CAPABILITY_HAPTIC)
+      feedbacks[n++] = "haptic";
+    if (entry->feedbacks & FBD_EVENT_CAPABILITY_LED)
+      feedbacks[n++] = "led";
+
+    g_variant_builder_add (&builder, "(usss^assxx)",
+                           entry->id,
+                           entry->app_id,
+                           entry->event,
+                           fbd_feedback_profile_level_to_string (entry->level),
+                           feedbacks,
+                           reason_to_string (entry),
+                           entry->time,
+                           entry->duration);
+  }
+
+  return g_variant_builder_end (&builder);
+}
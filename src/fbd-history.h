@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include "fbd-event.h"
+#include "fbd-feedback-profile.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Number of events kept in the history */
+#define FBD_HISTORY_SIZE     128
+/* Longer app ids and event names get truncated */
+#define FBD_HISTORY_NAME_LEN 64
+
+/**
+ * FbdHistoryEntry:
+ * @id: The event id
+ * @app_id: The app that triggered the event
+ * @event: The event name
+ * @level: The effective feedback level
+ * @feedbacks: The kinds of feedback that were chosen
+ * @ended: Whether the event's feedbacks ended
+ * @reason: Why the event's feedbacks ended
+ * @time: When the event was triggered in wall clock µs
+ * @start: When the event was triggered in monotonic µs
+ * @duration: How long the event's feedbacks ran in µs
+ *
+ * An event in the history.
+ */
+typedef struct _FbdHistoryEntry {
+  guint                   id;
+  char                    app_id[FBD_HISTORY_NAME_LEN];
+  char                    event[FBD_HISTORY_NAME_LEN];
+  FbdFeedbackProfileLevel level;
+  FbdEventCapabilities    feedbacks;
+  gboolean                ended;
+  FbdEventEndReason       reason;
+  gint64                  time;
+  gint64                  start;
+  gint64                  duration;
+} FbdHistoryEntry;
+
+typedef struct _FbdHistory FbdHistory;
+
+FbdHistory *fbd_history_new (void);
+void        fbd_history_free (FbdHistory *self);
+void        fbd_history_add (FbdHistory              *self,
+                             guint                    id,
+                             const char              *app_id,
+                             const char              *event,
+                             FbdFeedbackProfileLevel  level,
+                             FbdEventCapabilities     feedbacks);
+void        fbd_history_end (FbdHistory *self, guint id, FbdEventEndReason reason);
+guint       fbd_history_get_n_entries (FbdHistory *self);
+const FbdHistoryEntry *fbd_history_get_entry (FbdHistory *self, guint index);
+GVariant   *fbd_history_to_variant (FbdHistory *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdHistory, fbd_history_free)
+
+G_END_DECLS
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-led-animation"
+
+#include "fbd-led-animation.h"
+
+#include <math.h>
+
+/**
+ * FbdLedAnimation:
+ *
+ * A sequence of brightness and color steps for an LED. Brightness
+ * values are in percent of the LED's maximum brightness, durations
+ * in milliseconds. Steps without a color keep the current one.
+ *
+ * Animations are immutable once handed to a #FbdDevLed.
+ */
+struct _FbdLedAnimation {
+  GArray   *steps;
+  guint     duration;
+  gboolean  repeat;
+
+  /* Compiled pattern trigger string, 0 if not compiled yet */
+  char     *pattern;
+  guint     pattern_max_brightness;
+};
+
+
+static void
+fbd_led_animation_clear (FbdLedAnimation *self)
+{
+  g_array_unref (self->steps);
+  g_free (self->pattern);
+}
+
+G_DEFINE_BOXED_TYPE (FbdLedAnimation, fbd_led_animation, fbd_led_animation_ref, fbd_led_animation_unref)
+
+/**
+ * fbd_led_animation_new:
+ * @repeat: Whether the animation repeats until stopped
+ *
+ * Creates an empty animation. Use fbd_led_animation_add_step() to
+ * fill it.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new (gboolean repeat)
+{
+  FbdLedAnimation *self = g_rc_box_new0 (FbdLedAnimation);
+
+  self->steps = g_array_new (FALSE, FALSE, sizeof (FbdLedStep));
+  self->repeat = repeat;
+
+  return self;
+}
+
+/**
+ * fbd_led_animation_new_blink:
+ * @freq: The frequency in mHz
+ * @brightness: The brightness in percent
+ *
+ * Creates an animation that switches the LED on and off.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new_blink (guint freq, guint brightness)
+{
+  FbdLedAnimation *self = fbd_led_animation_new (TRUE);
+  /*          ms     mHz    T/2 */
+  guint t = 1000 * 1000 / MAX (freq, 1) / 2;
+
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, t, brightness, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, t, 0, NULL);
+
+  return self;
+}
+
+/**
+ * fbd_led_animation_new_breathe:
+ * @freq: The frequency in mHz
+ * @brightness: The brightness in percent
+ *
+ * Creates an animation that fades the LED in and out like the
+ * kernel's pattern trigger does for a `0 T/2 max T/2` pattern.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new_breathe (guint freq, guint brightness)
+{
+  FbdLedAnimation *self = fbd_led_animation_new (TRUE);
+  /*          ms     mHz    T/2 */
+  guint t = 1000 * 1000 / MAX (freq, 1) / 2;
+
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t, brightness, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t, 0, NULL);
+
+  return self;
+}
+
+/**
+ * fbd_led_animation_new_fade_in:
+ * @freq: The frequency in mHz
+ * @brightness: The brightness in percent
+ *
+ * Creates an animation that fades the LED in over most of the
+ * period, keeps it on for the rest and then switches it off.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new_fade_in (guint freq, guint brightness)
+{
+  FbdLedAnimation *self = fbd_led_animation_new (TRUE);
+  /*          ms     mHz */
+  guint t = 1000 * 1000 / MAX (freq, 1);
+
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, 0, 0, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t * 3 / 4, brightness, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, t / 4, brightness, NULL);
+
+  return self;
+}
+
+/**
+ * fbd_led_animation_new_heartbeat:
+ * @freq: The frequency in mHz
+ * @brightness: The brightness in percent
+ *
+ * Creates an animation that pulses the LED twice in quick
+ * succession and keeps it off for the rest of the period.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new_heartbeat (guint freq, guint brightness)
+{
+  FbdLedAnimation *self = fbd_led_animation_new (TRUE);
+  /*          ms     mHz */
+  guint t = 1000 * 1000 / MAX (freq, 1);
+
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t / 10, brightness, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t / 10, 0, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t / 10, brightness, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, t / 5, 0, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, t - t / 2, 0, NULL);
+
+  return self;
+}
+
+/**
+ * fbd_led_animation_new_ramp:
+ * @duration: The duration of the ramp in ms
+ * @from: The start brightness in percent
+ * @to: The end brightness in percent
+ *
+ * Creates an animation that fades from one brightness to another
+ * and keeps the final brightness.
+ *
+ * Returns: (transfer full): The new animation
+ */
+FbdLedAnimation *
+fbd_led_animation_new_ramp (guint duration, guint from, guint to)
+{
+  FbdLedAnimation *self = fbd_led_animation_new (FALSE);
+
+  fbd_led_animation_add_step (self, FBD_LED_STEP_HOLD, 0, from, NULL);
+  fbd_led_animation_add_step (self, FBD_LED_STEP_RAMP, duration, to, NULL);
+
+  return self;
+}
+
+
+FbdLedAnimation *
+fbd_led_animation_ref (FbdLedAnimation *self)
+{
+  return g_rc_box_acquire (self);
+}
+
+
+void
+fbd_led_animation_unref (FbdLedAnimation *self)
+{
+  g_rc_box_release_full (self, (GDestroyNotify) fbd_led_animation_clear);
+}
+
+/**
+ * fbd_led_animation_add_step:
+ * @self: The animation
+ * @kind: How to get to the step's value
+ * @duration: The step's duration in ms
+ * @brightness: The brightness in percent
+ * @rgb: (nullable): The color to use
+ *
+ * Appends a step to the animation.
+ */
+void
+fbd_led_animation_add_step (FbdLedAnimation      *self,
+                            FbdLedStepKind        kind,
+                            guint                 duration,
+                            guint                 brightness,
+                            const FbdLedRgbColor *rgb)
+{
+  FbdLedStep step = {
+    .kind = kind,
+    .duration = duration,
+    .brightness = MIN (brightness, 100),
+    .has_color = !!rgb,
+  };
+
+  if (rgb)
+    step.rgb = *rgb;
+
+  g_array_append_val (self->steps, step);
+  self->duration += duration;
+  g_clear_pointer (&self->pattern, g_free);
+  self->pattern_max_brightness = 0;
+}
+
+
+guint
+fbd_led_animation_get_n_steps (FbdLedAnimation *self)
+{
+  return self->steps->len;
+}
+
+
+const FbdLedStep *
+fbd_led_animation_get_step (FbdLedAnimation *self, guint index)
+{
+  g_return_val_if_fail (index < self->steps->len, NULL);
+
+  return &g_array_index (self->steps, FbdLedStep, index);
+}
+
+/**
+ * fbd_led_animation_get_duration:
+ * @self: The animation
+ *
+ * Returns: The duration of a single run of the animation in ms
+ */
+guint
+fbd_led_animation_get_duration (FbdLedAnimation *self)
+{
+  return self->duration;
+}
+
+
+gboolean
+fbd_led_animation_get_repeat (FbdLedAnimation *self)
+{
+  return self->repeat;
+}
+
+
+static void
+append_entry (GString *pattern, guint brightness, guint duration)
+{
+  g_string_append_printf (pattern, "%u %u ", brightness, duration);
+}
+
+/*
+ * The pattern trigger ramps linearly from each entry's brightness to
+ * the next one's over the entry's duration and holds when both are
+ * the same. Zero length entries switch instantly.
+ */
+static char *
+compile_pattern (FbdLedAnimation *self, guint max_brightness)
+{
+  g_autoptr (GString) pattern = g_string_new (NULL);
+  const FbdLedStep *last;
+  gboolean ramping = FALSE;
+  guint n_entries = 0;
+  int first = -1;
+  guint cur;
+
+  if (!self->repeat || self->steps->len == 0)
+    return NULL;
+
+  last = &g_array_index (self->steps, FbdLedStep, self->steps->len - 1);
+  cur = round (max_brightness * last->brightness / 100.0);
+
+  for (guint i = 0; i < self->steps->len; i++) {
+    const FbdLedStep *step = &g_array_index (self->steps, FbdLedStep, i);
+    guint brightness = round (max_brightness * step->brightness / 100.0);
+    guint start = step->kind == FBD_LED_STEP_RAMP ? cur : brightness;
+
+    /* The trigger only scales the brightness, colors are up to the LED */
+    if (step->has_color)
+      return NULL;
+
+    if (step->duration == 0) {
+      cur = brightness;
+      continue;
+    }
+
+    /* Finish a previous ramp at its target */
+    if (ramping && start != cur) {
+      append_entry (pattern, cur, 0);
+      n_entries++;
+    }
+
+    if (first < 0)
+      first = start;
+
+    append_entry (pattern, start, step->duration);
+    n_entries++;
+    ramping = step->kind == FBD_LED_STEP_RAMP;
+    if (!ramping) {
+      append_entry (pattern, brightness, 0);
+      n_entries++;
+    }
+    cur = brightness;
+  }
+
+  if (ramping && first != cur) {
+    append_entry (pattern, cur, 0);
+    n_entries++;
+  }
+
+  if (n_entries < 2)
+    return NULL;
+
+  g_string_truncate (pattern, pattern->len - 1);
+  g_string_append_c (pattern, '\n');
+
+  return g_string_free (g_steal_pointer (&pattern), FALSE);
+}
+
+/**
+ * fbd_led_animation_get_pattern:
+ * @self: The animation
+ * @max_brightness: The LED's maximum brightness
+ *
+ * Gets the animation in the format of the kernel's `pattern`
+ * trigger so the kernel can run it without any wakeups in
+ * feedbackd. The compiled pattern is kept with the animation so
+ * running it again doesn't need to compile it again.
+ *
+ * Returns: (nullable): The pattern or %NULL if the animation can't be
+ *   expressed as pattern, e.g. because it doesn't repeat or changes
+ *   colors.
+ */
+const char *
+fbd_led_animation_get_pattern (FbdLedAnimation *self, guint max_brightness)
+{
+  g_return_val_if_fail (max_brightness, NULL);
+
+  if (self->pattern_max_brightness == max_brightness)
+    return self->pattern;
+
+  g_clear_pointer (&self->pattern, g_free);
+  self->pattern = compile_pattern (self, max_brightness);
+  self->pattern_max_brightness = max_brightness;
+
+  return self->pattern;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-feedback-led.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FbdLedStepKind:
+ * @FBD_LED_STEP_HOLD: Switch to the step's value and keep it
+ * @FBD_LED_STEP_RAMP: Gradually change from the previous step's value
+ *
+ * How a step in an LED animation gets to its value.
+ */
+typedef enum {
+  FBD_LED_STEP_HOLD,
+  FBD_LED_STEP_RAMP,
+} FbdLedStepKind;
+
+typedef struct _FbdLedStep {
+  FbdLedStepKind kind;
+  guint          duration;
+  guint          brightness;
+  gboolean       has_color;
+  FbdLedRgbColor rgb;
+} FbdLedStep;
+
+typedef struct _FbdLedAnimation FbdLedAnimation;
+
+#define FBD_TYPE_LED_ANIMATION (fbd_led_animation_get_type ())
+
+GType             fbd_led_animation_get_type (void);
+FbdLedAnimation  *fbd_led_animation_new (gboolean repeat);
+FbdLedAnimation  *fbd_led_animation_new_blink (guint freq, guint brightness);
+FbdLedAnimation  *fbd_led_animation_new_breathe (guint freq, guint brightness);
+FbdLedAnimation  *fbd_led_animation_new_fade_in (guint freq, guint brightness);
+FbdLedAnimation  *fbd_led_animation_new_heartbeat (guint freq, guint brightness);
+FbdLedAnimation  *fbd_led_animation_new_ramp (guint duration, guint from, guint to);
+FbdLedAnimation  *fbd_led_animation_ref (FbdLedAnimation *self);
+void              fbd_led_animation_unref (FbdLedAnimation *self);
+void              fbd_led_animation_add_step (FbdLedAnimation      *self,
+                                              FbdLedStepKind        kind,
+                                              guint                 duration,
+                                              guint                 brightness,
+                                              const FbdLedRgbColor *rgb);
+guint             fbd_led_animation_get_n_steps (FbdLedAnimation *self);
+const FbdLedStep *fbd_led_animation_get_step (FbdLedAnimation *self, guint index);
+guint             fbd_led_animation_get_duration (FbdLedAnimation *self);
+gboolean          fbd_led_animation_get_repeat (FbdLedAnimation *self);
+const char       *fbd_led_animation_get_pattern (FbdLedAnimation *self, guint max_brightness);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdLedAnimation, fbd_led_animation_unref)
+
+G_END_DECLS
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-power-monitor"
+
+#include "fbd-power-monitor.h"
+
+#include <gio/gio.h>
+
+#define LOGIND_BUS_NAME          "org.freedesktop.login1"
+#define LOGIND_OBJECT_PATH       "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIND_SESSION_INTERFACE "org.freedesktop.login1.Session"
+
+/**
+ * FbdPowerMonitor:
+ *
+ * Tracks whether the daemon should save power. This is the case
+ * while logind reports the session as idle (e.g. because the screen
+ * got blanked) and while the system prepares for sleep.
+ *
+ * If logind isn't available the daemon never enters low power mode.
+ */
+
+enum {
+  PROP_0,
+  PROP_LOW_POWER,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+struct _FbdPowerMonitor {
+  GObject       parent;
+
+  GCancellable *cancel;
+  GDBusProxy   *manager_proxy;
+  GDBusProxy   *session_proxy;
+
+  gboolean      idle;
+  gboolean      preparing_for_sleep;
+  gboolean      low_power;
+};
+
+G_DEFINE_TYPE (FbdPowerMonitor, fbd_power_monitor, G_TYPE_OBJECT)
+
+
+static void
+update_low_power (FbdPowerMonitor *self)
+{
+  gboolean low_power = self->idle || self->preparing_for_sleep;
+
+  if (self->low_power == low_power)
+    return;
+
+  self->low_power = low_power;
+  g_debug ("Low power mode %s", low_power ? "enabled" : "disabled");
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LOW_POWER]);
+}
+
+
+static void
+on_session_properties_changed (FbdPowerMonitor *self)
+{
+  g_autoptr (GVariant) idle_hint = NULL;
+
+  idle_hint = g_dbus_proxy_get_cached_property (self->session_proxy, "IdleHint");
+  if (idle_hint == NULL)
+    return;
+
+  self->idle = g_variant_get_boolean (idle_hint);
+  update_low_power (self);
+}
+
+
+static void
+on_session_proxy_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdPowerMonitor *self;
+  g_autoptr (GError) err = NULL;
+  GDBusProxy *proxy;
+
+  proxy = g_dbus_proxy_new_finish (res, &err);
+  if (proxy == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug ("Failed to get logind session: %s", err->message);
+    return;
+  }
+
+  self = FBD_POWER_MONITOR (user_data);
+  self->session_proxy = proxy;
+  g_signal_connect_object (self->session_proxy, "g-properties-changed",
+                           G_CALLBACK (on_session_properties_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+  on_session_properties_changed (self);
+}
+
+
+static void
+on_get_session_finished (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdPowerMonitor *self;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) ret = NULL;
+  const char *path;
+
+  ret = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &err);
+  if (ret == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug ("Failed to find logind session: %s", err->message);
+    return;
+  }
+
+  self = FBD_POWER_MONITOR (user_data);
+  g_variant_get (ret, "(&o)", &path);
+  g_debug ("Watching logind session %s", path);
+
+  g_dbus_proxy_new (g_dbus_proxy_get_connection (self->manager_proxy),
+                    G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                    NULL,
+                    LOGIND_BUS_NAME,
+                    path,
+                    LOGIND_SESSION_INTERFACE,
+                    self->cancel,
+                    on_session_proxy_ready,
+                    self);
+}
+
+
+static void
+on_manager_signal (FbdPowerMonitor *self,
+                   const char      *sender_name,
+                   const char      *signal_name,
+                   GVariant        *parameters)
+{
+  if (g_strcmp0 (signal_name, "PrepareForSleep"))
+    return;
+
+  g_variant_get (parameters, "(b)", &self->preparing_for_sleep);
+  update_low_power (self);
+}
+
+
+static void
+on_manager_proxy_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FbdPowerMonitor *self;
+  g_autoptr (GError) err = NULL;
+  GDBusProxy *proxy;
+
+  proxy = g_dbus_proxy_new_for_bus_finish (res, &err);
+  if (proxy == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_debug ("Failed to connect to logind: %s", err->message);
+    return;
+  }
+
+  self = FBD_POWER_MONITOR (user_data);
+  self->manager_proxy = proxy;
+  g_signal_connect_object (self->manager_proxy, "g-signal",
+                           G_CALLBACK (on_manager_signal),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  /* "auto" resolves to the session of the daemon */
+  g_dbus_proxy_call (self->manager_proxy,
+                     "GetSession",
+                     g_variant_new ("(s)", "auto"),
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     self->cancel,
+                     on_get_session_finished,
+                     self);
+}
+
+
+static void
+fbd_power_monitor_get_property (GObject    *object,
+                                guint       property_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  FbdPowerMonitor *self = FBD_POWER_MONITOR (object);
+
+  switch (property_id) {
+  case PROP_LOW_POWER:
+    g_value_set_boolean (value, self->low_power);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_power_monitor_constructed (GObject *object)
+{
+  FbdPowerMonitor *self = FBD_POWER_MONITOR (object);
+
+  G_OBJECT_CLASS (fbd_power_monitor_parent_class)->constructed (object);
+
+  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                            G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                            NULL,
+                            LOGIND_BUS_NAME,
+                            LOGIND_OBJECT_PATH,
+                            LOGIND_MANAGER_INTERFACE,
+                            self->cancel,
+                            on_manager_proxy_ready,
+                            self);
+}
+
+
+static void
+fbd_power_monitor_dispose (GObject *object)
+{
+  FbdPowerMonitor *self = FBD_POWER_MONITOR (object);
+
+  g_cancellable_cancel (self->cancel);
+  g_clear_object (&self->cancel);
+  g_clear_object (&self->session_proxy);
+  g_clear_object (&self->manager_proxy);
+
+  G_OBJECT_CLASS (fbd_power_monitor_parent_class)->dispose (object);
+}
+
+
+static void
+fbd_power_monitor_class_init (FbdPowerMonitorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = fbd_power_monitor_constructed;
+  object_class->dispose = fbd_power_monitor_dispose;
+  object_class->get_property = fbd_power_monitor_get_property;
+
+  /**
+   * FbdPowerMonitor:low-power:
+   *
+   * Whether the daemon should avoid waking up the CPU.
+   */
+  props[PROP_LOW_POWER] =
+    g_param_spec_boolean ("low-power", "", "",
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+fbd_power_monitor_init (FbdPowerMonitor *self)
+{
+  self->cancel = g_cancellable_new ();
+}
+
+
+FbdPowerMonitor *
+fbd_power_monitor_new (void)
+{
+  return g_object_new (FBD_TYPE_POWER_MONITOR, NULL);
+}
+
+/**
+ * fbd_power_monitor_get_low_power:
+ * @self: The power monitor
+ *
+ * Gets whether the daemon should save power.
+ *
+ * Returns: `TRUE` in low power mode
+ */
+gboolean
+fbd_power_monitor_get_low_power (FbdPowerMonitor *self)
+{
+  g_return_val_if_fail (FBD_IS_POWER_MONITOR (self), FALSE);
+
+  return self->low_power;
+}
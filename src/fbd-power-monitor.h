@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_POWER_MONITOR (fbd_power_monitor_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdPowerMonitor, fbd_power_monitor, FBD, POWER_MONITOR, GObject)
+
+FbdPowerMonitor *fbd_power_monitor_new (void);
+gboolean         fbd_power_monitor_get_low_power (FbdPowerMonitor *self);
+
+G_END_DECLS
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-rate-limiter"
+
+#include "fbd-rate-limiter.h"
+
+#define FEEDBACKD_KEY_RATE_LIMIT_BURST "rate-limit-burst"
+#define FEEDBACKD_KEY_RATE_LIMIT_RATE "rate-limit-rate"
+
+/* Drop idle buckets once we track more senders than this */
+#define RATE_LIMIT_PRUNE_SIZE 64
+
+/**
+ * FbdRateLimiter:
+ *
+ * Gives each sender a token bucket that holds `burst` tokens and
+ * refills at `rate` tokens per second. Each request takes a token.
+ *
+ * The caller passes in the current monotonic time so the arithmetic
+ * doesn't depend on the clock. When created with #GSettings the
+ * limits follow the `rate-limit-burst` and `rate-limit-rate` keys.
+ * The rate limiter must only be used from the main thread.
+ */
+
+typedef struct _FbdRateLimit {
+  double tokens;
+  gint64 last;
+} FbdRateLimit;
+
+struct _FbdRateLimiter {
+  GSettings  *settings;
+  guint       burst;
+  guint       rate;
+  /* Key: interned sender, value: FbdRateLimit */
+  GHashTable *buckets;
+};
+
+
+static void
+rate_limit_refill (FbdRateLimiter *self, FbdRateLimit *bucket, gint64 now)
+{
+  bucket->tokens += (double)(now - bucket->last) * self->rate / G_USEC_PER_SEC;
+  bucket->tokens = MIN (bucket->tokens, self->burst);
+  bucket->last = now;
+}
+
+
+static void
+rate_limit_prune (FbdRateLimiter *self, gint64 now)
+{
+  GHashTableIter iter;
+  FbdRateLimit *bucket;
+
+  g_hash_table_iter_init (&iter, self->buckets);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&bucket)) {
+    rate_limit_refill (self, bucket, now);
+    /* A full bucket is the same as no bucket at all */
+    if (bucket->tokens >= self->burst)
+      g_hash_table_iter_remove (&iter);
+  }
+}
+
+
+static void
+on_rate_limit_changed (FbdRateLimiter *self, const char *key, GSettings *settings)
+{
+  fbd_rate_limiter_set_limits (self,
+                               g_settings_get_uint (settings, FEEDBACKD_KEY_RATE_LIMIT_BURST),
+                               g_settings_get_uint (settings, FEEDBACKD_KEY_RATE_LIMIT_RATE));
+}
+
+/**
+ * fbd_rate_limiter_new:
+ * @settings:(nullable): The daemon's settings
+ *
+ * Creates a rate limiter. Without @settings rate limiting is disabled
+ * until limits are set via fbd_rate_limiter_set_limits().
+ *
+ * Returns: The new rate limiter
+ */
+FbdRateLimiter *
+fbd_rate_limiter_new (GSettings *settings)
+{
+  FbdRateLimiter *self;
+
+  g_return_val_if_fail (settings == NULL || G_IS_SETTINGS (settings), NULL);
+
+  self = g_new0 (FbdRateLimiter, 1);
+  self->buckets = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         (GDestroyNotify)g_ref_string_release,
+                                         g_free);
+
+  if (settings) {
+    self->settings = g_object_ref (settings);
+    g_signal_connect_swapped (settings, "changed::" FEEDBACKD_KEY_RATE_LIMIT_BURST,
+                              G_CALLBACK (on_rate_limit_changed), self);
+    g_signal_connect_swapped (settings, "changed::" FEEDBACKD_KEY_RATE_LIMIT_RATE,
+                              G_CALLBACK (on_rate_limit_changed), self);
+    on_rate_limit_changed (self, FEEDBACKD_KEY_RATE_LIMIT_BURST, settings);
+  }
+
+  return self;
+}
+
+
+void
+fbd_rate_limiter_free (FbdRateLimiter *self)
+{
+  if (self->settings) {
+    g_signal_handlers_disconnect_by_data (self->settings, self);
+    g_clear_object (&self->settings);
+  }
+  g_clear_pointer (&self->buckets, g_hash_table_destroy);
+  g_free (self);
+}
+
+/**
+ * fbd_rate_limiter_set_limits:
+ * @self: The rate limiter
+ * @burst: The number of requests a sender can submit in a row, `0`
+ *   disables rate limiting
+ * @rate: The number of requests per second a sender can submit
+ *   in the long run
+ *
+ * Sets new limits. All senders start over with a full bucket.
+ */
+void
+fbd_rate_limiter_set_limits (FbdRateLimiter *self, guint burst, guint rate)
+{
+  g_return_if_fail (self);
+
+  self->burst = burst;
+  self->rate = rate;
+  g_hash_table_remove_all (self->buckets);
+}
+
+/**
+ * fbd_rate_limiter_admit:
+ * @self: The rate limiter
+ * @sender:(nullable): The DBus name of the client
+ * @n_requests: The number of requests the client wants to submit
+ * @now: The current monotonic time in µs
+ *
+ * Checks whether the client is within its rate limit and if so
+ * accounts for the submitted requests.
+ *
+ * Returns: `TRUE` if the requests should be processed, `FALSE` if the
+ *   client is rate limited
+ */
+gboolean
+fbd_rate_limiter_admit (FbdRateLimiter *self, const char *sender, guint n_requests, gint64 now)
+{
+  FbdRateLimit *bucket;
+
+  g_return_val_if_fail (self, FALSE);
+
+  /* Peer to peer connections have no sender */
+  if (self->burst == 0 || sender == NULL)
+    return TRUE;
+
+  bucket = g_hash_table_lookup (self->buckets, sender);
+  if (bucket) {
+    rate_limit_refill (self, bucket, now);
+  } else {
+    if (g_hash_table_size (self->buckets) >= RATE_LIMIT_PRUNE_SIZE)
+      rate_limit_prune (self, now);
+
+    bucket = g_new0 (FbdRateLimit, 1);
+    bucket->tokens = self->burst;
+    bucket->last = now;
+    g_hash_table_insert (self->buckets, g_ref_string_new_intern (sender), bucket);
+  }
+
+  if (bucket->tokens < n_requests)
+    return FALSE;
+
+  bucket->tokens -= n_requests;
+  return TRUE;
+}
+
+/**
+ * fbd_rate_limiter_forget:
+ * @self: The rate limiter
+ * @sender: The DBus name of the client
+ *
+ * Drops the sender's bucket, e.g. when the client went away.
+ */
+void
+fbd_rate_limiter_forget (FbdRateLimiter *self, const char *sender)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (sender);
+
+  g_hash_table_remove (self->buckets, sender);
+}
+
+/**
+ * fbd_rate_limiter_get_n_senders:
+ * @self: The rate limiter
+ *
+ * Gets the number of senders that currently have a bucket.
+ *
+ * Returns: The number of tracked senders
+ */
+guint
+fbd_rate_limiter_get_n_senders (FbdRateLimiter *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return g_hash_table_size (self->buckets);
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FbdRateLimiter FbdRateLimiter;
+
+FbdRateLimiter *fbd_rate_limiter_new (GSettings *settings);
+void            fbd_rate_limiter_free (FbdRateLimiter *self);
+void            fbd_rate_limiter_set_limits (FbdRateLimiter *self, guint burst, guint rate);
+gboolean        fbd_rate_limiter_admit (FbdRateLimiter *self,
+                                        const char     *sender,
+                                        guint           n_requests,
+                                        gint64          now);
+void            fbd_rate_limiter_forget (FbdRateLimiter *self, const char *sender);
+guint           fbd_rate_limiter_get_n_senders (FbdRateLimiter *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdRateLimiter, fbd_rate_limiter_free)
+
+G_END_DECLS
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The trace written by #FbdRecorder and read by fbd-replay. It starts
+ * with the magic and the version as little endian guint32 followed by
+ * records. Each record is a little endian guint32 size followed by a
+ * serialized little endian #GVariant of FBD_RECORD_TYPE.
+ *
+ * This header only depends on GLib so tools outside the daemon can use it.
+ */
+#define FBD_RECORD_MAGIC         "FBDTRACE"
+#define FBD_RECORD_MAGIC_LEN     8
+#define FBD_RECORD_VERSION       1
+/* Records larger than this are considered corrupt */
+#define FBD_RECORD_MAX_SIZE      (64 * 1024)
+
+/*
+ * kind, µs since the start of the recording, sender, app id, event or
+ * profile name, hints, timeout, event id, result
+ */
+#define FBD_RECORD_TYPE          "(yxsss@a{sv}iuu)"
+
+/**
+ * FbdRecordKind:
+ * @FBD_RECORD_KIND_TRIGGER: A triggered event, the result is the #FbdRecordResult
+ * @FBD_RECORD_KIND_END: A client ended an event
+ * @FBD_RECORD_KIND_ENDED: The feedbacks of an event ended, the result is the end reason
+ * @FBD_RECORD_KIND_VIBRATE: A haptic pattern, the `pattern` hint holds it, the result
+ *   is the #FbdRecordResult
+ * @FBD_RECORD_KIND_PROFILE: The global profile changed
+ *
+ * The recorded operations.
+ */
+typedef enum {
+  FBD_RECORD_KIND_TRIGGER = 'T',
+  FBD_RECORD_KIND_END     = 'E',
+  FBD_RECORD_KIND_ENDED   = 'F',
+  FBD_RECORD_KIND_VIBRATE = 'V',
+  FBD_RECORD_KIND_PROFILE = 'P',
+} FbdRecordKind;
+
+/**
+ * FbdRecordResult:
+ * @FBD_RECORD_RESULT_OK: The request was handled
+ * @FBD_RECORD_RESULT_RATE_LIMITED: The request was rejected due to the rate limit
+ * @FBD_RECORD_RESULT_INVALID: The request had invalid arguments
+ * @FBD_RECORD_RESULT_DROPPED: The request was accepted but nothing was played
+ *
+ * The outcome of recorded requests.
+ */
+typedef enum {
+  FBD_RECORD_RESULT_OK           = 0,
+  FBD_RECORD_RESULT_RATE_LIMITED = 1,
+  FBD_RECORD_RESULT_INVALID      = 2,
+  FBD_RECORD_RESULT_DROPPED      = 3,
+} FbdRecordResult;
+
+G_END_DECLS
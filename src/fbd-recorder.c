@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-recorder"
+
+#include "fbd-recorder.h"
+#include "fbd-timer-wheel.h"
+
+#include <gio/gio.h>
+
+#define FBD_RECORD_ENV "FEEDBACKD_RECORD"
+/* How long records are buffered before they hit the disk */
+#define FLUSH_INTERVAL 1000
+
+/**
+ * FbdRecorder:
+ *
+ * Records the requests the daemon handles to a compact binary trace
+ * so the workload can be replayed later with `fbd-replay`, see
+ * fbd-record-format.h for the format.
+ *
+ * The daemon records if the `FEEDBACKD_RECORD` environment variable
+ * holds the path of the trace file.
+ */
+
+enum {
+  PROP_0,
+  PROP_PATH,
+  PROP_LAST_PROP,
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+struct _FbdRecorder {
+  GObject        parent;
+
+  char          *path;
+  GOutputStream *stream;
+  GByteArray    *buffer;
+  gint64         start;
+  guint          flush_id;
+};
+
+static void initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdRecorder, fbd_recorder, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init))
+
+
+static void
+on_flush_timeout (gpointer data)
+{
+  FbdRecorder *self = FBD_RECORDER (data);
+  g_autoptr (GError) err = NULL;
+
+  self->flush_id = 0;
+  if (!fbd_recorder_flush (self, &err))
+    g_warning ("Failed to write trace: %s", err->message);
+}
+
+
+static void
+append_le32 (GByteArray *buffer, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  g_byte_array_append (buffer, (guint8 *)&value, sizeof (value));
+}
+
+
+static gboolean
+initable_init (GInitable     *initable,
+               GCancellable  *cancellable,
+               GError       **error)
+{
+  FbdRecorder *self = FBD_RECORDER (initable);
+  g_autoptr (GFile) file = NULL;
+  GFileOutputStream *stream;
+
+  file = g_file_new_for_path (self->path);
+  stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, cancellable, error);
+  if (stream == NULL)
+    return FALSE;
+
+  self->stream = G_OUTPUT_STREAM (stream);
+  self->start = g_get_monotonic_time ();
+
+  g_byte_array_append (self->buffer, (guint8 *)FBD_RECORD_MAGIC, FBD_RECORD_MAGIC_LEN);
+  append_le32 (self->buffer, FBD_RECORD_VERSION);
+
+  g_debug ("Recording trace to %s", self->path);
+  return fbd_recorder_flush (self, error);
+}
+
+
+static void
+initable_iface_init (GInitableIface *iface)
+{
+  iface->init = initable_init;
+}
+
+
+static void
+fbd_recorder_set_property (GObject      *object,
+                           guint         property_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  FbdRecorder *self = FBD_RECORDER (object);
+
+  switch (property_id) {
+  case PROP_PATH:
+    g_free (self->path);
+    self->path = g_value_dup_string (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_recorder_get_property (GObject    *object,
+                           guint       property_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  FbdRecorder *self = FBD_RECORDER (object);
+
+  switch (property_id) {
+  case PROP_PATH:
+    g_value_set_string (value, self->path);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+fbd_recorder_finalize (GObject *object)
+{
+  FbdRecorder *self = FBD_RECORDER (object);
+  g_autoptr (GError) err = NULL;
+
+  g_clear_handle_id (&self->flush_id, fbd_timeout_remove);
+  if (self->stream) {
+    if (!fbd_recorder_flush (self, &err) ||
+        !g_output_stream_close (self->stream, NULL, &err))
+      g_warning ("Failed to write trace: %s", err->message);
+  }
+  g_clear_object (&self->stream);
+  g_clear_pointer (&self->buffer, g_byte_array_unref);
+  g_free (self->path);
+
+  G_OBJECT_CLASS (fbd_recorder_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_recorder_class_init (FbdRecorderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = fbd_recorder_finalize;
+  object_class->set_property = fbd_recorder_set_property;
+  object_class->get_property = fbd_recorder_get_property;
+
+  /**
+   * FbdRecorder:path:
+   *
+   * The path of the trace file. An existing file is replaced.
+   */
+  props[PROP_PATH] =
+    g_param_spec_string ("path", "", "",
+                         NULL,
+                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+fbd_recorder_init (FbdRecorder *self)
+{
+  self->buffer = g_byte_array_new ();
+}
+
+
+FbdRecorder *
+fbd_recorder_new (const char *path, GError **error)
+{
+  g_return_val_if_fail (path, NULL);
+
+  return g_initable_new (FBD_TYPE_RECORDER, NULL, error, "path", path, NULL);
+}
+
+/**
+ * fbd_recorder_get_default:
+ *
+ * Gets the daemon's recorder. The first call creates it if recording
+ * was requested via the environment.
+ *
+ * Returns:(transfer none)(nullable): The recorder or `NULL` if the
+ *   daemon doesn't record
+ */
+FbdRecorder *
+fbd_recorder_get_default (void)
+{
+  static FbdRecorder *instance;
+  static gboolean initialized;
+  g_autoptr (GError) err = NULL;
+  const char *path;
+
+  if (initialized)
+    return instance;
+
+  initialized = TRUE;
+  path = g_getenv (FBD_RECORD_ENV);
+  if (path == NULL || path[0] == '\0')
+    return NULL;
+
+  instance = fbd_recorder_new (path, &err);
+  if (instance == NULL) {
+    g_warning ("Failed to record to %s: %s", path, err->message);
+    return NULL;
+  }
+  g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+
+  return instance;
+}
+
+/**
+ * fbd_recorder_add:
+ * @self:(nullable): The recorder
+ * @kind: The kind of the record
+ * @sender:(nullable): The DBus name of the client
+ * @app_id:(nullable): The app id sent by the client
+ * @name:(nullable): The event or profile name
+ * @hints:(nullable): The hints sent by the client
+ * @timeout: The timeout sent by the client
+ * @event_id: The id of the affected event
+ * @result: The outcome, see #FbdRecordKind
+ *
+ * Adds a record to the trace. Does nothing if @self is `NULL` so
+ * callers can pass fbd_recorder_get_default() unconditionally.
+ */
+void
+fbd_recorder_add (FbdRecorder   *self,
+                  FbdRecordKind  kind,
+                  const char    *sender,
+                  const char    *app_id,
+                  const char    *name,
+                  GVariant      *hints,
+                  int            timeout,
+                  guint          event_id,
+                  guint          result)
+{
+  g_autoptr (GVariant) record = NULL;
+
+  if (self == NULL)
+    return;
+
+  g_return_if_fail (FBD_IS_RECORDER (self));
+
+  if (hints == NULL)
+    hints = g_variant_new ("a{sv}", NULL);
+
+  record = g_variant_new (FBD_RECORD_TYPE,
+                          (guchar)kind,
+                          (gint64)(g_get_monotonic_time () - self->start),
+                          sender ?: "",
+                          app_id ?: "",
+                          name ?: "",
+                          hints,
+                          timeout,
+                          event_id,
+                          result);
+  g_variant_ref_sink (record);
+
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant *swapped = g_variant_byteswap (record);
+
+    g_variant_unref (record);
+    record = swapped;
+  }
+
+  append_le32 (self->buffer, g_variant_get_size (record));
+  g_byte_array_append (self->buffer, g_variant_get_data (record), g_variant_get_size (record));
+
+  if (self->flush_id == 0) {
+    self->flush_id = fbd_timeout_add_once (FLUSH_INTERVAL,
+                                           FBD_TIMER_WHEEL_SLACK_COARSE,
+                                           on_flush_timeout,
+                                           self);
+  }
+}
+
+/**
+ * fbd_recorder_flush:
+ * @self: The recorder
+ * @error: The error location
+ *
+ * Writes buffered records to the trace file.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_recorder_flush (FbdRecorder *self, GError **error)
+{
+  gboolean success;
+
+  g_return_val_if_fail (FBD_IS_RECORDER (self), FALSE);
+
+  if (self->buffer->len == 0)
+    return TRUE;
+
+  success = g_output_stream_write_all (self->stream, self->buffer->data, self->buffer->len,
+                                       NULL, NULL, error);
+  g_byte_array_set_size (self->buffer, 0);
+
+  return success && g_output_stream_flush (self->stream, NULL, error);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include "fbd-record-format.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_RECORDER (fbd_recorder_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdRecorder, fbd_recorder, FBD, RECORDER, GObject)
+
+FbdRecorder *fbd_recorder_new (const char *path, GError **error);
+FbdRecorder *fbd_recorder_get_default (void);
+void         fbd_recorder_add (FbdRecorder   *self,
+                               FbdRecordKind  kind,
+                               const char    *sender,
+                               const char    *app_id,
+                               const char    *name,
+                               GVariant      *hints,
+                               int            timeout,
+                               guint          event_id,
+                               guint          result);
+gboolean     fbd_recorder_flush (FbdRecorder *self, GError **error);
+
+G_END_DECLS
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-slider-filter"
+
+#include "fbd-slider-filter.h"
+
+/**
+ * FbdSliderFilter:
+ *
+ * Debounces the position of a slider. Values are read in frames
+ * that end with `fbd_slider_filter_commit()`, only the last value of
+ * a frame is used. A position is reported once no new frame arrived
+ * for the settle time and it differs from the last reported one so a
+ * bouncing slider results in a single change.
+ *
+ * The filter uses the default main context.
+ */
+
+struct _FbdSliderFilter {
+  /* The position last reported */
+  int                 position;
+  /* The position of the last complete frame */
+  int                 frame_position;
+  /* The value of the frame currently being read */
+  int                 value;
+  gboolean            has_value;
+
+  guint               settle_time;
+  guint               settle_id;
+  FbdSliderFilterFunc func;
+  gpointer            user_data;
+};
+
+/**
+ * fbd_slider_filter_new:
+ * @position: The slider's current position
+ * @settle_time: How long the slider needs to stay put in ms
+ * @func: Invoked with the new position
+ * @user_data: The user data for @func
+ *
+ * Returns:(transfer full): A new slider filter
+ */
+FbdSliderFilter *
+fbd_slider_filter_new (int position, guint settle_time, FbdSliderFilterFunc func, gpointer user_data)
+{
+  FbdSliderFilter *self;
+
+  g_return_val_if_fail (func, NULL);
+
+  self = g_new0 (FbdSliderFilter, 1);
+  self->position = self->frame_position = position;
+  self->settle_time = settle_time;
+  self->func = func;
+  self->user_data = user_data;
+
+  return self;
+}
+
+
+void
+fbd_slider_filter_free (FbdSliderFilter *self)
+{
+  g_clear_handle_id (&self->settle_id, g_source_remove);
+  g_free (self);
+}
+
+
+static void
+on_settled (gpointer data)
+{
+  FbdSliderFilter *self = data;
+
+  self->settle_id = 0;
+  if (self->frame_position == self->position)
+    return;
+
+  self->position = self->frame_position;
+  self->func (self->position, self->user_data);
+}
+
+/**
+ * fbd_slider_filter_set_value:
+ * @self: The slider filter
+ * @value: The value read from the device
+ *
+ * Sets the value of the current frame. Replaces earlier values of
+ * the same frame.
+ */
+void
+fbd_slider_filter_set_value (FbdSliderFilter *self, int value)
+{
+  g_return_if_fail (self);
+
+  self->value = value;
+  self->has_value = TRUE;
+}
+
+/**
+ * fbd_slider_filter_commit:
+ * @self: The slider filter
+ *
+ * Ends the current frame. If the frame had a value the settle time
+ * starts over.
+ */
+void
+fbd_slider_filter_commit (FbdSliderFilter *self)
+{
+  g_return_if_fail (self);
+
+  if (!self->has_value)
+    return;
+
+  self->frame_position = self->value;
+  self->has_value = FALSE;
+
+  g_clear_handle_id (&self->settle_id, g_source_remove);
+  self->settle_id = g_timeout_add_once (self->settle_time, on_settled, self);
+}
+
+/**
+ * fbd_slider_filter_get_position:
+ * @self: The slider filter
+ *
+ * Returns: The position last reported
+ */
+int
+fbd_slider_filter_get_position (FbdSliderFilter *self)
+{
+  g_return_val_if_fail (self, -1);
+
+  return self->position;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FbdSliderFilterFunc:
+ * @position: The position the slider settled at
+ * @user_data: The user data
+ *
+ * Invoked when the slider settled at a new position.
+ */
+typedef void (*FbdSliderFilterFunc) (int position, gpointer user_data);
+
+typedef struct _FbdSliderFilter FbdSliderFilter;
+
+FbdSliderFilter *fbd_slider_filter_new (int                 position,
+                                        guint               settle_time,
+                                        FbdSliderFilterFunc func,
+                                        gpointer            user_data);
+void             fbd_slider_filter_free (FbdSliderFilter *self);
+void             fbd_slider_filter_set_value (FbdSliderFilter *self, int value);
+void             fbd_slider_filter_commit (FbdSliderFilter *self);
+int              fbd_slider_filter_get_position (FbdSliderFilter *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdSliderFilter, fbd_slider_filter_free)
+
+G_END_DECLS
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020 Purism SPC
+ *               2025 Phosh.mobi e.V.
+ * SPDX-License-Identifier: GPL-3.0+
+ * Author: Guido Günther <agx@sigxcpu.org>
+ */
+
+#define G_LOG_DOMAIN "fbd-sound-backend-gsound"
+
+#include "fbd-sound-backend-gsound.h"
+
+#include <gsound.h>
+
+/**
+ * SECTION:fbd-sound-backend-gsound
+ * @short_description: GSound based sound backend
+ * @Title: FbdSoundBackendGSound
+ *
+ * Plays sounds via GSound and thereby libcanberra which in turn talks
+ * to the sound server.
+ */
+
+typedef struct _FbdSoundBackendGSound {
+  FbdSoundBackend parent;
+
+  GSoundContext  *ctx;
+} FbdSoundBackendGSound;
+
+static void initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdSoundBackendGSound, fbd_sound_backend_gsound, FBD_TYPE_SOUND_BACKEND,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
+
+
+static void
+on_sound_play_finished_callback (GSoundContext *ctx,
+                                 GAsyncResult  *res,
+                                 GTask         *task)
+{
+  g_autoptr (GError) err = NULL;
+
+  if (gsound_context_play_full_finish (ctx, res, &err)) {
+    g_task_return_boolean (task, TRUE);
+  } else if (err->domain == GSOUND_ERROR && err->code == GSOUND_ERROR_NOTFOUND) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "%s", err->message);
+  } else {
+    g_task_return_error (task, g_steal_pointer (&err));
+  }
+
+  g_object_unref (task);
+}
+
+
+static void
+fbd_sound_backend_gsound_play (FbdSoundBackend     *backend,
+                               FbdFeedbackSound    *feedback,
+                               const char          *role,
+                               gint64               loop_until,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+  FbdSoundBackendGSound *self = FBD_SOUND_BACKEND_GSOUND (backend);
+  const char *filename;
+  GTask *task;
+
+  /* The sound server has no loop mode, the sound is played once */
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fbd_sound_backend_gsound_play);
+
+  filename = fbd_feedback_sound_get_file_name (feedback);
+  if (filename) {
+    gsound_context_play_full (self->ctx, cancellable,
+                              (GAsyncReadyCallback) on_sound_play_finished_callback,
+                              task,
+                              GSOUND_ATTR_MEDIA_FILENAME, filename,
+                              GSOUND_ATTR_EVENT_DESCRIPTION, "Feedbackd custom sound feedback",
+                              GSOUND_ATTR_MEDIA_ROLE, role,
+                              NULL);
+  } else {
+    gsound_context_play_full (self->ctx, cancellable,
+                              (GAsyncReadyCallback) on_sound_play_finished_callback,
+                              task,
+                              GSOUND_ATTR_EVENT_ID, fbd_feedback_sound_get_effect (feedback),
+                              GSOUND_ATTR_EVENT_DESCRIPTION, "Feedbackd sound feedback",
+                              GSOUND_ATTR_MEDIA_ROLE, role,
+                              NULL);
+  }
+}
+
+
+static gboolean
+fbd_sound_backend_gsound_play_finish (FbdSoundBackend *backend,
+                                      GAsyncResult    *res,
+                                      GError         **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, backend), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+
+static gboolean
+fbd_sound_backend_gsound_cache (FbdSoundBackend *backend, const char *effect, GError **error)
+{
+  FbdSoundBackendGSound *self = FBD_SOUND_BACKEND_GSOUND (backend);
+
+  return gsound_context_cache (self->ctx, error, GSOUND_ATTR_EVENT_ID, effect, NULL);
+}
+
+
+static gboolean
+fbd_sound_backend_gsound_set_theme_name (FbdSoundBackend *backend,
+                                         const char      *name,
+                                         GError         **error)
+{
+  FbdSoundBackendGSound *self = FBD_SOUND_BACKEND_GSOUND (backend);
+
+  return gsound_context_set_attributes (self->ctx,
+                                        error,
+                                        GSOUND_ATTR_CANBERRA_XDG_THEME_NAME,
+                                        name,
+                                        NULL);
+}
+
+
+static gboolean
+initable_init (GInitable    *initable,
+               GCancellable *cancellable,
+               GError      **error)
+{
+  FbdSoundBackendGSound *self = FBD_SOUND_BACKEND_GSOUND (initable);
+
+  self->ctx = gsound_context_new (NULL, error);
+
+  return self->ctx != NULL;
+}
+
+
+static void
+initable_iface_init (GInitableIface *iface)
+{
+    iface->init = initable_init;
+}
+
+
+static void
+fbd_sound_backend_gsound_dispose (GObject *object)
+{
+  FbdSoundBackendGSound *self = FBD_SOUND_BACKEND_GSOUND (object);
+
+  g_clear_object (&self->ctx);
+
+  G_OBJECT_CLASS (fbd_sound_backend_gsound_parent_class)->dispose (object);
+}
+
+
+static void
+fbd_sound_backend_gsound_class_init (FbdSoundBackendGSoundClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  FbdSoundBackendClass *backend_class = FBD_SOUND_BACKEND_CLASS (klass);
+
+  object_class->dispose = fbd_sound_backend_gsound_dispose;
+
+  backend_class->play = fbd_sound_backend_gsound_play;
+  backend_class->play_finish = fbd_sound_backend_gsound_play_finish;
+  backend_class->cache = fbd_sound_backend_gsound_cache;
+  backend_class->set_theme_name = fbd_sound_backend_gsound_set_theme_name;
+}
+
+
+static void
+fbd_sound_backend_gsound_init (FbdSoundBackendGSound *self)
+{
+}
+
+
+FbdSoundBackend *
+fbd_sound_backend_gsound_new (GError **error)
+{
+  return FBD_SOUND_BACKEND (g_initable_new (FBD_TYPE_SOUND_BACKEND_GSOUND, NULL, error, NULL));
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-sound-backend.h"
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_SOUND_BACKEND_GSOUND (fbd_sound_backend_gsound_get_type())
+
+G_DECLARE_FINAL_TYPE (FbdSoundBackendGSound, fbd_sound_backend_gsound, FBD, SOUND_BACKEND_GSOUND,
+                      FbdSoundBackend);
+
+FbdSoundBackend *fbd_sound_backend_gsound_new (GError **error);
+
+G_END_DECLS
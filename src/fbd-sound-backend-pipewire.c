@@ -0,0 +1,731 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-sound-backend-pipewire"
+
+#include "fbd-sound-backend-pipewire.h"
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+#include <sndfile.h>
+
+#include <errno.h>
+#include <string.h>
+
+/* We always mix in stereo */
+#define FBD_PW_CHANNELS          2
+/* Buffer size requested from the graph (in frames at the sample's rate) */
+#define FBD_PW_LATENCY_FRAMES    256
+/* Longer sounds aren't played from memory */
+#define FBD_PW_MAX_SECONDS       30
+/* Longer sounds aren't kept in memory after playback */
+#define FBD_PW_MAX_CACHED_SECONDS 5
+/* Silent buffers to play before pausing an idle stream */
+#define FBD_PW_IDLE_CYCLES       16
+
+#define FBD_PW_DEFAULT_THEME     "freedesktop"
+
+/**
+ * SECTION:fbd-sound-backend-pipewire
+ * @short_description: Native PipeWire sound backend
+ * @Title: FbdSoundBackendPipewire
+ *
+ * Plays sounds by mixing them into a persistent PipeWire stream per
+ * media role and sample rate. Sounds are looked up via the XDG sound
+ * theme spec, decoded once and kept in memory so playing a sound
+ * doesn't need any lookup, decoding or stream setup.
+ *
+ * Looping sounds wrap around within the same buffer so there's no
+ * gap between two runs.
+ *
+ * Streams are paused when there's nothing to play and resumed when
+ * a new sound starts. All stream state is only touched with the
+ * PipeWire thread loop locked.
+ */
+
+typedef struct _FbdPwSample {
+  float *data;            /* interleaved stereo */
+  gsize  n_frames;
+  guint  rate;
+} FbdPwSample;
+
+typedef struct _FbdPwVoice {
+  FbdPwSample *sample;
+  gsize        pos;
+  gint64       loop_until;
+  GTask       *task;
+} FbdPwVoice;
+
+typedef struct _FbdPwStream {
+  struct pw_stream *stream;
+  struct spa_hook   listener;
+  GPtrArray        *voices;
+  guint             idle_cycles;
+} FbdPwStream;
+
+typedef struct _FbdSoundBackendPipewire {
+  FbdSoundBackend        parent;
+
+  struct pw_thread_loop *loop;
+  struct pw_context     *context;
+  struct pw_core        *core;
+  struct spa_hook        core_listener;
+  gboolean               core_failed;
+  /* "role/rate" -> FbdPwStream */
+  GHashTable            *streams;
+
+  char                  *theme_name;
+  /* sound effect or file -> FbdPwSample */
+  GHashTable            *samples;
+} FbdSoundBackendPipewire;
+
+static void initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdSoundBackendPipewire, fbd_sound_backend_pipewire, FBD_TYPE_SOUND_BACKEND,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
+
+static const char * const sound_exts[] = { "oga", "ogg", "wav", NULL };
+
+
+static void
+fbd_pw_sample_clear (FbdPwSample *sample)
+{
+  g_free (sample->data);
+}
+
+
+static void
+fbd_pw_sample_unref (FbdPwSample *sample)
+{
+  g_atomic_rc_box_release_full (sample, (GDestroyNotify) fbd_pw_sample_clear);
+}
+
+
+static void
+fbd_pw_voice_free (FbdPwVoice *voice)
+{
+  fbd_pw_sample_unref (voice->sample);
+  g_clear_object (&voice->task);
+  g_free (voice);
+}
+
+
+static void
+mix_voices (FbdPwStream *stream, float *dst, guint32 n_frames)
+{
+  for (guint i = stream->voices->len; i > 0; i--) {
+    FbdPwVoice *voice = g_ptr_array_index (stream->voices, i - 1);
+    gsize filled = 0;
+
+    if (g_task_return_error_if_cancelled (voice->task)) {
+      g_ptr_array_remove_index_fast (stream->voices, i - 1);
+      continue;
+    }
+
+    while (filled < n_frames) {
+      gsize n = MIN (n_frames - filled, voice->sample->n_frames - voice->pos);
+      const float *src = voice->sample->data + voice->pos * FBD_PW_CHANNELS;
+      float *out = dst + filled * FBD_PW_CHANNELS;
+
+      for (gsize j = 0; j < n * FBD_PW_CHANNELS; j++)
+        out[j] += src[j];
+      voice->pos += n;
+      filled += n;
+
+      if (voice->pos < voice->sample->n_frames ||
+          voice->sample->n_frames == 0 ||
+          g_get_monotonic_time () >= voice->loop_until)
+        break;
+
+      voice->pos = 0;
+    }
+
+    if (voice->pos == voice->sample->n_frames) {
+      g_task_return_boolean (voice->task, TRUE);
+      g_ptr_array_remove_index_fast (stream->voices, i - 1);
+    }
+  }
+
+  for (gsize j = 0; j < n_frames * FBD_PW_CHANNELS; j++)
+    dst[j] = CLAMP (dst[j], -1.0f, 1.0f);
+}
+
+
+static void
+on_stream_process (void *data)
+{
+  FbdPwStream *stream = data;
+  const guint32 stride = sizeof (float) * FBD_PW_CHANNELS;
+  struct pw_buffer *buf;
+  struct spa_data *d;
+  guint32 n_frames;
+
+  buf = pw_stream_dequeue_buffer (stream->stream);
+  if (buf == NULL)
+    return;
+
+  d = &buf->buffer->datas[0];
+  if (d->data == NULL) {
+    pw_stream_queue_buffer (stream->stream, buf);
+    return;
+  }
+
+  n_frames = d->maxsize / stride;
+  if (buf->requested)
+    n_frames = MIN (buf->requested, n_frames);
+
+  memset (d->data, 0, n_frames * stride);
+  mix_voices (stream, d->data, n_frames);
+
+  d->chunk->offset = 0;
+  d->chunk->stride = stride;
+  d->chunk->size = n_frames * stride;
+  pw_stream_queue_buffer (stream->stream, buf);
+
+  if (stream->voices->len == 0 && ++stream->idle_cycles == FBD_PW_IDLE_CYCLES)
+    pw_stream_set_active (stream->stream, false);
+}
+
+
+static void
+on_stream_state_changed (void                 *data,
+                         enum pw_stream_state  old,
+                         enum pw_stream_state  state,
+                         const char           *error)
+{
+  if (state == PW_STREAM_STATE_ERROR)
+    g_warning ("Sound stream failed: %s", error);
+}
+
+
+static const struct pw_stream_events stream_events = {
+  PW_VERSION_STREAM_EVENTS,
+  .state_changed = on_stream_state_changed,
+  .process = on_stream_process,
+};
+
+
+static void
+fbd_pw_stream_free (FbdPwStream *stream)
+{
+  for (guint i = 0; i < stream->voices->len; i++) {
+    FbdPwVoice *voice = g_ptr_array_index (stream->voices, i);
+
+    g_task_return_new_error (voice->task, G_IO_ERROR, G_IO_ERROR_CLOSED, "Sound stream closed");
+  }
+  g_ptr_array_unref (stream->voices);
+
+  spa_hook_remove (&stream->listener);
+  pw_stream_destroy (stream->stream);
+  g_free (stream);
+}
+
+
+/* The role names used by the media-role-nodes config, themes mostly use them already */
+static const char *
+get_pw_role (const char *role)
+{
+  if (g_str_equal (role, "event"))
+    return "Notification";
+
+  return role;
+}
+
+
+static FbdPwStream *
+fbd_pw_stream_new (FbdSoundBackendPipewire *self, const char *role, guint rate, GError **error)
+{
+  guint8 buffer[1024];
+  struct spa_pod_builder builder = SPA_POD_BUILDER_INIT (buffer, sizeof (buffer));
+  struct spa_audio_info_raw info = {
+    .format = SPA_AUDIO_FORMAT_F32,
+    .rate = rate,
+    .channels = FBD_PW_CHANNELS,
+    .position = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR },
+  };
+  const struct spa_pod *params[1];
+  g_autofree char *latency = g_strdup_printf ("%u/%u", FBD_PW_LATENCY_FRAMES, rate);
+  struct pw_properties *props;
+  FbdPwStream *stream;
+  int ret;
+
+  props = pw_properties_new (PW_KEY_MEDIA_TYPE, "Audio",
+                             PW_KEY_MEDIA_CATEGORY, "Playback",
+                             PW_KEY_MEDIA_ROLE, get_pw_role (role),
+                             PW_KEY_MEDIA_NAME, "Feedbackd sound feedback",
+                             PW_KEY_NODE_LATENCY, latency,
+                             NULL);
+
+  stream = g_new0 (FbdPwStream, 1);
+  stream->voices = g_ptr_array_new_with_free_func ((GDestroyNotify) fbd_pw_voice_free);
+  stream->stream = pw_stream_new (self->core, "feedbackd", props);
+  if (stream->stream == NULL) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to create sound stream: %s", g_strerror (errno));
+    g_ptr_array_unref (stream->voices);
+    g_free (stream);
+    return NULL;
+  }
+  pw_stream_add_listener (stream->stream, &stream->listener, &stream_events, stream);
+
+  params[0] = spa_format_audio_raw_build (&builder, SPA_PARAM_EnumFormat, &info);
+  ret = pw_stream_connect (stream->stream,
+                           PW_DIRECTION_OUTPUT,
+                           PW_ID_ANY,
+                           PW_STREAM_FLAG_AUTOCONNECT |
+                           PW_STREAM_FLAG_MAP_BUFFERS |
+                           PW_STREAM_FLAG_INACTIVE,
+                           params, G_N_ELEMENTS (params));
+  if (ret < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (-ret),
+                 "Failed to connect sound stream: %s", g_strerror (-ret));
+    fbd_pw_stream_free (stream);
+    return NULL;
+  }
+
+  g_debug ("New sound stream for role %s at %uHz", role, rate);
+  return stream;
+}
+
+
+static void
+on_core_error (void *data, uint32_t id, int seq, int res, const char *message)
+{
+  FbdSoundBackendPipewire *self = data;
+
+  if (id == PW_ID_CORE && res == -EPIPE) {
+    g_warning ("Lost connection to PipeWire: %s", message);
+    self->core_failed = TRUE;
+  }
+}
+
+
+static const struct pw_core_events core_events = {
+  PW_VERSION_CORE_EVENTS,
+  .error = on_core_error,
+};
+
+
+/* Must be called with the loop locked */
+static gboolean
+connect_core (FbdSoundBackendPipewire *self, GError **error)
+{
+  g_hash_table_remove_all (self->streams);
+  if (self->core) {
+    spa_hook_remove (&self->core_listener);
+    g_clear_pointer (&self->core, pw_core_disconnect);
+  }
+
+  self->core_failed = FALSE;
+  self->core = pw_context_connect (self->context, NULL, 0);
+  if (self->core == NULL) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to connect to PipeWire: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  spa_zero (self->core_listener);
+  pw_core_add_listener (self->core, &self->core_listener, &core_events, self);
+  return TRUE;
+}
+
+
+/* Must be called with the loop locked */
+static FbdPwStream *
+get_stream (FbdSoundBackendPipewire *self, const char *role, guint rate, GError **error)
+{
+  g_autofree char *key = g_strdup_printf ("%s/%u", role, rate);
+  FbdPwStream *stream;
+
+  if (self->core_failed && !connect_core (self, error))
+    return NULL;
+
+  stream = g_hash_table_lookup (self->streams, key);
+  if (stream && pw_stream_get_state (stream->stream, NULL) != PW_STREAM_STATE_ERROR)
+    return stream;
+
+  g_hash_table_remove (self->streams, key);
+  stream = fbd_pw_stream_new (self, role, rate, error);
+  if (stream)
+    g_hash_table_insert (self->streams, g_steal_pointer (&key), stream);
+
+  return stream;
+}
+
+
+static char *
+lookup_in_theme (const char *theme, const char *name, GHashTable *seen)
+{
+  g_autoptr (GPtrArray) data_dirs = g_ptr_array_new ();
+  g_autoptr (GPtrArray) parents = g_ptr_array_new_with_free_func (g_free);
+  const char * const *system_dirs = g_get_system_data_dirs ();
+
+  if (!g_hash_table_add (seen, g_strdup (theme)))
+    return NULL;
+
+  g_ptr_array_add (data_dirs, (gpointer) g_get_user_data_dir ());
+  for (guint i = 0; system_dirs[i]; i++)
+    g_ptr_array_add (data_dirs, (gpointer) system_dirs[i]);
+
+  for (guint i = 0; i < data_dirs->len; i++) {
+    g_autofree char *theme_dir = g_build_filename (g_ptr_array_index (data_dirs, i),
+                                                   "sounds", theme, NULL);
+    g_autofree char *index_path = g_build_filename (theme_dir, "index.theme", NULL);
+    g_autoptr (GKeyFile) index = g_key_file_new ();
+    g_auto (GStrv) subdirs = NULL;
+    g_auto (GStrv) inherits = NULL;
+
+    if (!g_key_file_load_from_file (index, index_path, G_KEY_FILE_NONE, NULL))
+      continue;
+
+    subdirs = g_key_file_get_string_list (index, "Sound Theme", "Directories", NULL, NULL);
+    for (guint j = 0; subdirs && subdirs[j]; j++) {
+      for (guint k = 0; sound_exts[k]; k++) {
+        g_autofree char *basename = g_strdup_printf ("%s.%s", name, sound_exts[k]);
+        g_autofree char *path = g_build_filename (theme_dir, subdirs[j], basename, NULL);
+
+        if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+          return g_steal_pointer (&path);
+      }
+    }
+
+    inherits = g_key_file_get_string_list (index, "Sound Theme", "Inherits", NULL, NULL);
+    for (guint j = 0; inherits && inherits[j]; j++)
+      g_ptr_array_add (parents, g_strdup (inherits[j]));
+  }
+
+  for (guint i = 0; i < parents->len; i++) {
+    char *path = lookup_in_theme (g_ptr_array_index (parents, i), name, seen);
+
+    if (path)
+      return path;
+  }
+
+  return NULL;
+}
+
+/*
+ * Look up the sound file for an effect like libcanberra does: try the
+ * theme, its parents and the default theme. If nothing is found,
+ * drop the last component of the effect name and try again.
+ */
+static char *
+find_sound_file (FbdSoundBackendPipewire *self, const char *effect)
+{
+  g_autofree char *name = g_strdup (effect);
+  const char *theme = self->theme_name ?: FBD_PW_DEFAULT_THEME;
+
+  while (TRUE) {
+    g_autoptr (GHashTable) seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    char *path, *sep;
+
+    path = lookup_in_theme (theme, name, seen);
+    if (path == NULL)
+      path = lookup_in_theme (FBD_PW_DEFAULT_THEME, name, seen);
+    if (path)
+      return path;
+
+    sep = strrchr (name, '-');
+    if (sep == NULL)
+      return NULL;
+    *sep = '\0';
+  }
+}
+
+
+static FbdPwSample *
+decode_sample (const char *path, GError **error)
+{
+  SF_INFO info = { 0 };
+  SNDFILE *file;
+  g_autofree float *frames = NULL;
+  FbdPwSample *sample;
+  sf_count_t n_read;
+
+  file = sf_open (path, SFM_READ, &info);
+  if (file == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Failed to open '%s': %s", path, sf_strerror (NULL));
+    return NULL;
+  }
+
+  if (info.channels < 1 || info.samplerate < 1 ||
+      info.frames > (sf_count_t) info.samplerate * FBD_PW_MAX_SECONDS) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Can't play '%s' from memory", path);
+    sf_close (file);
+    return NULL;
+  }
+
+  frames = g_new (float, info.frames * info.channels);
+  n_read = sf_readf_float (file, frames, info.frames);
+  sf_close (file);
+
+  sample = g_atomic_rc_box_new0 (FbdPwSample);
+  sample->rate = info.samplerate;
+  sample->n_frames = MAX (n_read, 0);
+  sample->data = g_new (float, sample->n_frames * FBD_PW_CHANNELS);
+  for (gsize i = 0; i < sample->n_frames; i++) {
+    const float *src = frames + i * info.channels;
+
+    sample->data[i * FBD_PW_CHANNELS] = src[0];
+    sample->data[i * FBD_PW_CHANNELS + 1] = info.channels > 1 ? src[1] : src[0];
+  }
+
+  return sample;
+}
+
+
+static FbdPwSample *
+get_sample (FbdSoundBackendPipewire *self,
+            const char              *effect,
+            const char              *filename,
+            GError                 **error)
+{
+  g_autofree char *key = NULL;
+  g_autofree char *path = NULL;
+  FbdPwSample *sample;
+
+  if (filename)
+    key = g_strconcat ("file:", filename, NULL);
+  else
+    key = g_strconcat ("effect:", effect, NULL);
+
+  sample = g_hash_table_lookup (self->samples, key);
+  if (sample)
+    return g_atomic_rc_box_acquire (sample);
+
+  path = filename ? g_strdup (filename) : find_sound_file (self, effect);
+  if (path == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No sound for '%s'", effect);
+    return NULL;
+  }
+
+  sample = decode_sample (path, error);
+  if (sample == NULL)
+    return NULL;
+
+  g_debug ("Decoded '%s': %" G_GSIZE_FORMAT " frames at %uHz", path, sample->n_frames, sample->rate);
+  if (sample->n_frames <= (gsize) sample->rate * FBD_PW_MAX_CACHED_SECONDS)
+    g_hash_table_insert (self->samples, g_steal_pointer (&key), g_atomic_rc_box_acquire (sample));
+
+  return sample;
+}
+
+
+static gboolean
+add_voice (FbdSoundBackendPipewire *self,
+           const char              *role,
+           FbdPwSample             *sample,
+           gint64                   loop_until,
+           GTask                   *task,
+           GError                 **error)
+{
+  FbdPwStream *stream;
+  FbdPwVoice *voice;
+
+  pw_thread_loop_lock (self->loop);
+
+  stream = get_stream (self, role, sample->rate, error);
+  if (stream == NULL) {
+    pw_thread_loop_unlock (self->loop);
+    return FALSE;
+  }
+
+  voice = g_new0 (FbdPwVoice, 1);
+  voice->sample = sample;
+  voice->loop_until = loop_until;
+  voice->task = task;
+  g_ptr_array_add (stream->voices, voice);
+
+  stream->idle_cycles = 0;
+  pw_stream_set_active (stream->stream, true);
+
+  pw_thread_loop_unlock (self->loop);
+  return TRUE;
+}
+
+
+static void
+fbd_sound_backend_pipewire_play (FbdSoundBackend     *backend,
+                                 FbdFeedbackSound    *feedback,
+                                 const char          *role,
+                                 gint64               loop_until,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  FbdSoundBackendPipewire *self = FBD_SOUND_BACKEND_PIPEWIRE (backend);
+  g_autoptr (GError) err = NULL;
+  FbdPwSample *sample;
+  GTask *task;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fbd_sound_backend_pipewire_play);
+
+  sample = get_sample (self,
+                       fbd_feedback_sound_get_effect (feedback),
+                       fbd_feedback_sound_get_file_name (feedback),
+                       &err);
+  if (sample == NULL) {
+    g_task_return_error (task, g_steal_pointer (&err));
+    g_object_unref (task);
+    return;
+  }
+
+  /* The voice takes over sample and task */
+  if (!add_voice (self, role, sample, loop_until, task, &err)) {
+    fbd_pw_sample_unref (sample);
+    g_task_return_error (task, g_steal_pointer (&err));
+    g_object_unref (task);
+  }
+}
+
+
+static gboolean
+fbd_sound_backend_pipewire_play_finish (FbdSoundBackend *backend,
+                                        GAsyncResult    *res,
+                                        GError         **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, backend), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+
+static gboolean
+fbd_sound_backend_pipewire_cache (FbdSoundBackend *backend, const char *effect, GError **error)
+{
+  FbdSoundBackendPipewire *self = FBD_SOUND_BACKEND_PIPEWIRE (backend);
+  FbdPwSample *sample;
+
+  sample = get_sample (self, effect, NULL, error);
+  if (sample == NULL)
+    return FALSE;
+
+  fbd_pw_sample_unref (sample);
+  return TRUE;
+}
+
+
+static gboolean
+fbd_sound_backend_pipewire_set_theme_name (FbdSoundBackend *backend,
+                                           const char      *name,
+                                           GError         **error)
+{
+  FbdSoundBackendPipewire *self = FBD_SOUND_BACKEND_PIPEWIRE (backend);
+
+  if (g_strcmp0 (self->theme_name, name) == 0)
+    return TRUE;
+
+  g_free (self->theme_name);
+  self->theme_name = g_strdup (name);
+  /* Playing voices keep their samples */
+  g_hash_table_remove_all (self->samples);
+
+  return TRUE;
+}
+
+
+static gboolean
+initable_init (GInitable    *initable,
+               GCancellable *cancellable,
+               GError      **error)
+{
+  FbdSoundBackendPipewire *self = FBD_SOUND_BACKEND_PIPEWIRE (initable);
+  gboolean ok;
+
+  pw_init (NULL, NULL);
+
+  self->loop = pw_thread_loop_new ("fbd-sound", NULL);
+  if (self->loop == NULL) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to create PipeWire loop: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  self->context = pw_context_new (pw_thread_loop_get_loop (self->loop), NULL, 0);
+  if (self->context == NULL) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to create PipeWire context: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  if (pw_thread_loop_start (self->loop) < 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to start PipeWire loop");
+    return FALSE;
+  }
+
+  pw_thread_loop_lock (self->loop);
+  ok = connect_core (self, error);
+  pw_thread_loop_unlock (self->loop);
+
+  return ok;
+}
+
+
+static void
+initable_iface_init (GInitableIface *iface)
+{
+    iface->init = initable_init;
+}
+
+
+static void
+fbd_sound_backend_pipewire_dispose (GObject *object)
+{
+  FbdSoundBackendPipewire *self = FBD_SOUND_BACKEND_PIPEWIRE (object);
+
+  if (self->loop) {
+    pw_thread_loop_lock (self->loop);
+    g_clear_pointer (&self->streams, g_hash_table_destroy);
+    if (self->core) {
+      spa_hook_remove (&self->core_listener);
+      g_clear_pointer (&self->core, pw_core_disconnect);
+    }
+    pw_thread_loop_unlock (self->loop);
+    pw_thread_loop_stop (self->loop);
+  }
+
+  g_clear_pointer (&self->context, pw_context_destroy);
+  g_clear_pointer (&self->loop, pw_thread_loop_destroy);
+  g_clear_pointer (&self->streams, g_hash_table_destroy);
+  g_clear_pointer (&self->samples, g_hash_table_destroy);
+  g_clear_pointer (&self->theme_name, g_free);
+
+  G_OBJECT_CLASS (fbd_sound_backend_pipewire_parent_class)->dispose (object);
+}
+
+
+static void
+fbd_sound_backend_pipewire_class_init (FbdSoundBackendPipewireClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  FbdSoundBackendClass *backend_class = FBD_SOUND_BACKEND_CLASS (klass);
+
+  object_class->dispose = fbd_sound_backend_pipewire_dispose;
+
+  backend_class->play = fbd_sound_backend_pipewire_play;
+  backend_class->play_finish = fbd_sound_backend_pipewire_play_finish;
+  backend_class->cache = fbd_sound_backend_pipewire_cache;
+  backend_class->set_theme_name = fbd_sound_backend_pipewire_set_theme_name;
+}
+
+
+static void
+fbd_sound_backend_pipewire_init (FbdSoundBackendPipewire *self)
+{
+  self->streams = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) fbd_pw_stream_free);
+  self->samples = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) fbd_pw_sample_unref);
+}
+
+
+FbdSoundBackend *
+fbd_sound_backend_pipewire_new (GError **error)
+{
+  return FBD_SOUND_BACKEND (g_initable_new (FBD_TYPE_SOUND_BACKEND_PIPEWIRE, NULL, error, NULL));
+}
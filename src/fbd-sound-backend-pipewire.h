@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-sound-backend.h"
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_SOUND_BACKEND_PIPEWIRE (fbd_sound_backend_pipewire_get_type())
+
+G_DECLARE_FINAL_TYPE (FbdSoundBackendPipewire, fbd_sound_backend_pipewire, FBD,
+                      SOUND_BACKEND_PIPEWIRE, FbdSoundBackend);
+
+FbdSoundBackend *fbd_sound_backend_pipewire_new (GError **error);
+
+G_END_DECLS
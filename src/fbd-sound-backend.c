@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-sound-backend"
+
+#include "fbd-sound-backend.h"
+
+/**
+ * SECTION:fbd-sound-backend
+ * @short_description: Base class for sound backends
+ * @Title: FbdSoundBackend
+ *
+ * A #FbdSoundBackend knows how to get a sound effect or file to the
+ * audio system. #FbdDevSound uses it to play the sounds of
+ * #FbdFeedbackSound feedbacks. Playback errors use the `G_IO_ERROR`
+ * domain: `G_IO_ERROR_NOT_FOUND` if the sound doesn't exist,
+ * `G_IO_ERROR_CANCELLED` if playback got cancelled and
+ * `G_IO_ERROR_NOT_SUPPORTED` if the backend can't play the sound.
+ *
+ * Backends that keep the decoded sound around can loop it without
+ * tearing down and setting up a stream in between. Backends that
+ * can't just play the sound once, the event then starts it again.
+ */
+
+G_DEFINE_ABSTRACT_TYPE (FbdSoundBackend, fbd_sound_backend, G_TYPE_OBJECT)
+
+static gboolean
+fbd_sound_backend_cache_default (FbdSoundBackend *self, const char *effect, GError **error)
+{
+  return TRUE;
+}
+
+static void
+fbd_sound_backend_class_init (FbdSoundBackendClass *klass)
+{
+  klass->cache = fbd_sound_backend_cache_default;
+}
+
+static void
+fbd_sound_backend_init (FbdSoundBackend *self)
+{
+}
+
+/**
+ * fbd_sound_backend_play:
+ * @self: The sound backend
+ * @feedback: The feedback to play
+ * @role: The media role to play the sound with
+ * @loop_until: Monotonic time until which to loop the sound, `0` to play it once
+ * @cancellable: Cancellable to stop the playback
+ * @callback: Invoked when playback finished
+ * @user_data: The user data for the callback
+ *
+ * Plays the sound effect or file of @feedback. When looping, the
+ * sound is started again right away as long as @loop_until didn't
+ * pass, so the sound finishes once the run in progress at
+ * @loop_until is done.
+ */
+void
+fbd_sound_backend_play (FbdSoundBackend     *self,
+                        FbdFeedbackSound    *feedback,
+                        const char          *role,
+                        gint64               loop_until,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+  g_return_if_fail (FBD_IS_SOUND_BACKEND (self));
+  g_return_if_fail (FBD_IS_FEEDBACK_SOUND (feedback));
+  g_return_if_fail (FBD_SOUND_BACKEND_GET_CLASS (self)->play);
+
+  FBD_SOUND_BACKEND_GET_CLASS (self)->play (self, feedback, role, loop_until, cancellable,
+                                            callback, user_data);
+}
+
+gboolean
+fbd_sound_backend_play_finish (FbdSoundBackend *self, GAsyncResult *res, GError **error)
+{
+  g_return_val_if_fail (FBD_IS_SOUND_BACKEND (self), FALSE);
+  g_return_val_if_fail (FBD_SOUND_BACKEND_GET_CLASS (self)->play_finish, FALSE);
+
+  return FBD_SOUND_BACKEND_GET_CLASS (self)->play_finish (self, res, error);
+}
+
+/**
+ * fbd_sound_backend_cache:
+ * @self: The sound backend
+ * @effect: The sound effect name
+ * @error: Return location for error
+ *
+ * Prepares the sound effect so it can be played without delay.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_sound_backend_cache (FbdSoundBackend *self, const char *effect, GError **error)
+{
+  g_return_val_if_fail (FBD_IS_SOUND_BACKEND (self), FALSE);
+
+  return FBD_SOUND_BACKEND_GET_CLASS (self)->cache (self, effect, error);
+}
+
+/**
+ * fbd_sound_backend_set_theme_name:
+ * @self: The sound backend
+ * @name: The sound theme name
+ * @error: Return location for error
+ *
+ * Sets the XDG sound theme to look up sound effects in.
+ *
+ * Returns: `TRUE` on success, otherwise `FALSE`
+ */
+gboolean
+fbd_sound_backend_set_theme_name (FbdSoundBackend *self, const char *name, GError **error)
+{
+  g_return_val_if_fail (FBD_IS_SOUND_BACKEND (self), FALSE);
+  g_return_val_if_fail (FBD_SOUND_BACKEND_GET_CLASS (self)->set_theme_name, FALSE);
+
+  return FBD_SOUND_BACKEND_GET_CLASS (self)->set_theme_name (self, name, error);
+}
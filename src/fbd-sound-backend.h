@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+#pragma once
+
+#include "fbd-feedback-sound.h"
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define FBD_TYPE_SOUND_BACKEND (fbd_sound_backend_get_type())
+
+G_DECLARE_DERIVABLE_TYPE (FbdSoundBackend, fbd_sound_backend, FBD, SOUND_BACKEND, GObject);
+
+struct _FbdSoundBackendClass
+{
+  GObjectClass parent_class;
+
+  void     (*play)           (FbdSoundBackend     *self,
+                              FbdFeedbackSound    *feedback,
+                              const char          *role,
+                              gint64               loop_until,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data);
+  gboolean (*play_finish)    (FbdSoundBackend     *self,
+                              GAsyncResult        *res,
+                              GError             **error);
+  gboolean (*cache)          (FbdSoundBackend     *self,
+                              const char          *effect,
+                              GError             **error);
+  gboolean (*set_theme_name) (FbdSoundBackend     *self,
+                              const char          *name,
+                              GError             **error);
+};
+
+void         fbd_sound_backend_play (FbdSoundBackend     *self,
+                                     FbdFeedbackSound    *feedback,
+                                     const char          *role,
+                                     gint64               loop_until,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data);
+gboolean     fbd_sound_backend_play_finish (FbdSoundBackend *self,
+                                            GAsyncResult    *res,
+                                            GError         **error);
+gboolean     fbd_sound_backend_cache (FbdSoundBackend *self,
+                                      const char      *effect,
+                                      GError         **error);
+gboolean     fbd_sound_backend_set_theme_name (FbdSoundBackend *self,
+                                               const char      *name,
+                                               GError         **error);
+
+G_END_DECLS
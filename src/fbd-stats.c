@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-stats"
+
+#include "fbd-stats.h"
+
+#include <string.h>
+
+/**
+ * FbdStats:
+ *
+ * Handles the org.sigxcpu.Feedback.Stats interface. It keeps counters
+ * and latency histograms of the daemon. Samples can be added from any
+ * thread.
+ *
+ * Histograms use power of two buckets in microseconds: bucket 0 holds
+ * samples below 1µs, bucket n samples from 2^(n-1)µs to below 2^nµs.
+ *
+ * To spot leaks in the long running daemon the number of live objects
+ * and the memory they use is tracked per kind of object. Like the
+ * number of active events these survive resets.
+ *
+ * Additionally a moving average of the latency of each feedback type
+ * is kept so the daemon can skip feedbacks that would miss a client's
+ * deadline. The estimates survive resets.
+ */
+
+#define LATENCY_TYPE_PREFIX "FbdFeedback"
+/* Weight of a new sample in the latency estimate is 1/2^n */
+#define LATENCY_ESTIMATE_SHIFT 3
+
+typedef struct _FbdStatsHistogram {
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+  guint64 buckets[FBD_STATS_N_BUCKETS];
+} FbdStatsHistogram;
+
+struct _FbdStats {
+  LfbGdbusFeedbackStatsSkeleton parent;
+
+  GMutex                        lock;
+  guint64                       counters[FBD_STATS_N_COUNTERS];
+  guint                         active_events;
+  guint                         active_events_peak;
+  FbdStatsHistogram             durations[FBD_STATS_N_DURATIONS];
+  /* Key: GType of the feedback, value: FbdStatsHistogram */
+  GHashTable                   *latencies;
+  /* Key: GType of the feedback, value: gint64 estimated latency */
+  GHashTable                   *estimates;
+  /* Key: actuator name, value: used duty cycle budget in permille */
+  GHashTable                   *duty_cycles;
+  guint64                       objects[FBD_STATS_N_OBJECTS];
+  guint64                       object_bytes[FBD_STATS_N_OBJECTS];
+};
+
+static const char * const counter_names[] = {
+  "events-triggered",
+  "events-not-found",
+  "rate-limited",
+  "feedbacks-busy",
+  "timer-wakeups",
+  "deadline-skipped",
+  "deadline-missed",
+  "duty-scaled",
+  "duty-dropped",
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (counter_names) == FBD_STATS_N_COUNTERS);
+
+static const char * const duration_names[] = {
+  "eviocsff",
+  "sysfs-write",
+  "sound-start",
+  "sound-play",
+  "start-skew",
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (duration_names) == FBD_STATS_N_DURATIONS);
+
+static const char * const object_names[] = {
+  "events",
+  "playbacks",
+  "client-watches",
+  "sounds",
+  "themes",
+};
+G_STATIC_ASSERT (G_N_ELEMENTS (object_names) == FBD_STATS_N_OBJECTS);
+
+static void fbd_stats_iface_init (LfbGdbusFeedbackStatsIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FbdStats,
+                         fbd_stats,
+                         LFB_GDBUS_TYPE_FEEDBACK_STATS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (
+                           LFB_GDBUS_TYPE_FEEDBACK_STATS,
+                           fbd_stats_iface_init));
+
+
+static void
+histogram_add (FbdStatsHistogram *histogram, gint64 usec)
+{
+  guint bucket = 0;
+
+  /* The monotonic clock can't go backwards but be defensive */
+  usec = MAX (usec, 0);
+  if (usec > 0)
+    bucket = MIN (g_bit_storage (usec), FBD_STATS_N_BUCKETS - 1);
+
+  histogram->count++;
+  histogram->sum += usec;
+  histogram->max = MAX (histogram->max, (guint64)usec);
+  histogram->buckets[bucket]++;
+}
+
+
+static GVariant *
+histogram_to_variant (FbdStatsHistogram *histogram)
+{
+  GVariantBuilder buckets;
+
+  g_variant_builder_init (&buckets, G_VARIANT_TYPE ("at"));
+  for (guint i = 0; i < FBD_STATS_N_BUCKETS; i++)
+    g_variant_builder_add (&buckets, "t", histogram->buckets[i]);
+
+  return g_variant_new ("(ttt@at)",
+                        histogram->count,
+                        histogram->sum,
+                        histogram->max,
+                        g_variant_builder_end (&buckets));
+}
+
+
+static char *
+get_latency_name (GType type)
+{
+  const char *name = g_type_name (type);
+
+  if (g_str_has_prefix (name, LATENCY_TYPE_PREFIX))
+    name += strlen (LATENCY_TYPE_PREFIX);
+
+  return g_strdup_printf ("latency-%s", name);
+}
+
+
+static gboolean
+fbd_stats_handle_get_stats (LfbGdbusFeedbackStats *object,
+                            GDBusMethodInvocation *invocation)
+{
+  FbdStats *self = FBD_STATS (object);
+
+  lfb_gdbus_feedback_stats_complete_get_stats (object,
+                                               invocation,
+                                               fbd_stats_get_counters (self),
+                                               fbd_stats_get_histograms (self));
+  return TRUE;
+}
+
+
+static gboolean
+fbd_stats_handle_reset (LfbGdbusFeedbackStats *object,
+                        GDBusMethodInvocation *invocation)
+{
+  fbd_stats_reset (FBD_STATS (object));
+
+  lfb_gdbus_feedback_stats_complete_reset (object, invocation);
+  return TRUE;
+}
+
+
+static void
+fbd_stats_iface_init (LfbGdbusFeedbackStatsIface *iface)
+{
+  iface->handle_get_stats = fbd_stats_handle_get_stats;
+  iface->handle_reset = fbd_stats_handle_reset;
+}
+
+
+static void
+fbd_stats_finalize (GObject *object)
+{
+  FbdStats *self = FBD_STATS (object);
+
+  g_clear_pointer (&self->latencies, g_hash_table_destroy);
+  g_clear_pointer (&self->estimates, g_hash_table_destroy);
+  g_clear_pointer (&self->duty_cycles, g_hash_table_destroy);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (fbd_stats_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_stats_class_init (FbdStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = fbd_stats_finalize;
+}
+
+
+static void
+fbd_stats_init (FbdStats *self)
+{
+  g_mutex_init (&self->lock);
+  self->latencies = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  self->estimates = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  self->duty_cycles = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/**
+ * fbd_stats_get_default:
+ *
+ * Gets the daemon's stats. The first call creates them.
+ *
+ * Returns:(transfer none): The stats
+ */
+FbdStats *
+fbd_stats_get_default (void)
+{
+  static FbdStats *instance;
+  G_LOCK_DEFINE_STATIC (default_stats);
+
+  G_LOCK (default_stats);
+  if (instance == NULL) {
+    instance = g_object_new (FBD_TYPE_STATS, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+  G_UNLOCK (default_stats);
+
+  return instance;
+}
+
+/**
+ * fbd_stats_count:
+ * @self: The stats
+ * @counter: The counter to increment
+ *
+ * Increments the given counter by one.
+ */
+void
+fbd_stats_count (FbdStats *self, FbdStatsCounter counter)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+  g_return_if_fail (counter < FBD_STATS_N_COUNTERS);
+
+  g_mutex_lock (&self->lock);
+  self->counters[counter]++;
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_get_count:
+ * @self: The stats
+ * @counter: The counter
+ *
+ * Gets the current value of a counter.
+ *
+ * Returns: The counter's value
+ */
+guint64
+fbd_stats_get_count (FbdStats *self, FbdStatsCounter counter)
+{
+  guint64 count;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), 0);
+  g_return_val_if_fail (counter < FBD_STATS_N_COUNTERS, 0);
+
+  g_mutex_lock (&self->lock);
+  count = self->counters[counter];
+  g_mutex_unlock (&self->lock);
+
+  return count;
+}
+
+/**
+ * fbd_stats_add_duration:
+ * @self: The stats
+ * @duration: What took the time
+ * @usec: The duration in microseconds
+ *
+ * Adds a sample to the histogram of @duration.
+ */
+void
+fbd_stats_add_duration (FbdStats *self, FbdStatsDuration duration, gint64 usec)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+  g_return_if_fail (duration < FBD_STATS_N_DURATIONS);
+
+  g_mutex_lock (&self->lock);
+  histogram_add (&self->durations[duration], usec);
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_add_latency:
+ * @self: The stats
+ * @feedback_type: The type of the feedback
+ * @usec: The time from triggering the feedback to its first output
+ *
+ * Adds a sample to the latency histogram of the given feedback type.
+ */
+void
+fbd_stats_add_latency (FbdStats *self, GType feedback_type, gint64 usec)
+{
+  FbdStatsHistogram *histogram;
+  gint64 *estimate;
+
+  g_return_if_fail (FBD_IS_STATS (self));
+
+  usec = MAX (usec, 0);
+
+  g_mutex_lock (&self->lock);
+  histogram = g_hash_table_lookup (self->latencies, GSIZE_TO_POINTER (feedback_type));
+  if (histogram == NULL) {
+    histogram = g_new0 (FbdStatsHistogram, 1);
+    g_hash_table_insert (self->latencies, GSIZE_TO_POINTER (feedback_type), histogram);
+  }
+  histogram_add (histogram, usec);
+
+  estimate = g_hash_table_lookup (self->estimates, GSIZE_TO_POINTER (feedback_type));
+  if (estimate == NULL) {
+    estimate = g_new (gint64, 1);
+    *estimate = usec;
+    g_hash_table_insert (self->estimates, GSIZE_TO_POINTER (feedback_type), estimate);
+  } else {
+    *estimate += (usec - *estimate) / (1 << LATENCY_ESTIMATE_SHIFT);
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_get_latency_estimate:
+ * @self: The stats
+ * @feedback_type: The type of the feedback
+ *
+ * Gets the expected latency of the given feedback type based on the
+ * previous samples.
+ *
+ * Returns: The estimated latency in microseconds or `-1` if there were
+ *   no samples yet
+ */
+gint64
+fbd_stats_get_latency_estimate (FbdStats *self, GType feedback_type)
+{
+  gint64 *estimate, ret = -1;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), -1);
+
+  g_mutex_lock (&self->lock);
+  estimate = g_hash_table_lookup (self->estimates, GSIZE_TO_POINTER (feedback_type));
+  if (estimate)
+    ret = *estimate;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+/**
+ * fbd_stats_check_deadline:
+ * @self: The stats
+ * @feedback_type: The type of the feedback
+ * @usec: The deadline in microseconds
+ *
+ * Checks whether a feedback of the given type is expected to start
+ * within the deadline. If not the estimate is lowered a bit so the
+ * feedback type gets another chance once latencies improve.
+ *
+ * Returns: `TRUE` if the feedback is expected to meet the deadline
+ */
+gboolean
+fbd_stats_check_deadline (FbdStats *self, GType feedback_type, gint64 usec)
+{
+  gint64 *estimate;
+  gboolean ret = TRUE;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), TRUE);
+
+  g_mutex_lock (&self->lock);
+  estimate = g_hash_table_lookup (self->estimates, GSIZE_TO_POINTER (feedback_type));
+  if (estimate && *estimate > usec) {
+    *estimate -= *estimate / (1 << LATENCY_ESTIMATE_SHIFT);
+    ret = FALSE;
+  }
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+/**
+ * fbd_stats_set_active_events:
+ * @self: The stats
+ * @n_events: The number of active events
+ *
+ * Updates the number of active events and their peak.
+ */
+void
+fbd_stats_set_active_events (FbdStats *self, guint n_events)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+
+  g_mutex_lock (&self->lock);
+  self->active_events = n_events;
+  self->active_events_peak = MAX (self->active_events_peak, n_events);
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_set_duty_cycle:
+ * @self: The stats
+ * @actuator: The actuator's name
+ * @permille: The used duty cycle budget in permille, `-1` to remove the actuator
+ *
+ * Updates how much of an actuator's duty cycle budget is used up.
+ */
+void
+fbd_stats_set_duty_cycle (FbdStats *self, const char *actuator, int permille)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+  g_return_if_fail (actuator);
+
+  g_mutex_lock (&self->lock);
+  if (permille < 0)
+    g_hash_table_remove (self->duty_cycles, actuator);
+  else
+    g_hash_table_insert (self->duty_cycles, g_strdup (actuator), GINT_TO_POINTER (permille));
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_object_new:
+ * @self: The stats
+ * @object: The kind of object
+ * @size: The memory the object uses in bytes
+ *
+ * Tracks that an object got allocated. Call fbd_stats_object_free()
+ * with the same @size when it's freed.
+ */
+void
+fbd_stats_object_new (FbdStats *self, FbdStatsObject object, gsize size)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+  g_return_if_fail (object < FBD_STATS_N_OBJECTS);
+
+  g_mutex_lock (&self->lock);
+  self->objects[object]++;
+  self->object_bytes[object] += size;
+  g_mutex_unlock (&self->lock);
+}
+
+/**
+ * fbd_stats_object_free:
+ * @self: The stats
+ * @object: The kind of object
+ * @size: The memory the object used in bytes
+ *
+ * Tracks that an object got freed.
+ */
+void
+fbd_stats_object_free (FbdStats *self, FbdStatsObject object, gsize size)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+  g_return_if_fail (object < FBD_STATS_N_OBJECTS);
+
+  g_mutex_lock (&self->lock);
+  if (self->objects[object] == 0 || self->object_bytes[object] < size)
+    g_critical ("More %s freed than allocated", object_names[object]);
+  self->objects[object] -= MIN (self->objects[object], 1);
+  self->object_bytes[object] -= MIN (self->object_bytes[object], size);
+  g_mutex_unlock (&self->lock);
+}
+
+
+guint64
+fbd_stats_get_n_objects (FbdStats *self, FbdStatsObject object)
+{
+  guint64 n;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), 0);
+  g_return_val_if_fail (object < FBD_STATS_N_OBJECTS, 0);
+
+  g_mutex_lock (&self->lock);
+  n = self->objects[object];
+  g_mutex_unlock (&self->lock);
+
+  return n;
+}
+
+/**
+ * fbd_stats_get_counters:
+ * @self: The stats
+ *
+ * Gets a snapshot of the counters including the active events, the
+ * used duty cycle budgets and the live objects.
+ *
+ * Returns:(transfer floating): The counters as `a{st}`
+ */
+GVariant *
+fbd_stats_get_counters (FbdStats *self)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+  g_mutex_lock (&self->lock);
+  for (guint i = 0; i < FBD_STATS_N_COUNTERS; i++)
+    g_variant_builder_add (&builder, "{st}", counter_names[i], self->counters[i]);
+  g_variant_builder_add (&builder, "{st}", "active-events", (guint64)self->active_events);
+  g_variant_builder_add (&builder, "{st}", "active-events-peak",
+                         (guint64)self->active_events_peak);
+
+  g_hash_table_iter_init (&iter, self->duty_cycles);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_autofree char *name = g_strdup_printf ("duty-cycle-%s", (char *)key);
+
+    g_variant_builder_add (&builder, "{st}", name, (guint64)GPOINTER_TO_INT (value));
+  }
+
+  for (guint i = 0; i < FBD_STATS_N_OBJECTS; i++) {
+    g_autofree char *name = g_strdup_printf ("live-%s", object_names[i]);
+    g_autofree char *bytes = g_strdup_printf ("live-%s-bytes", object_names[i]);
+
+    g_variant_builder_add (&builder, "{st}", name, self->objects[i]);
+    g_variant_builder_add (&builder, "{st}", bytes, self->object_bytes[i]);
+  }
+  g_mutex_unlock (&self->lock);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * fbd_stats_get_histograms:
+ * @self: The stats
+ *
+ * Gets a snapshot of the histograms. Latency histograms are only
+ * included for feedback types that had samples.
+ *
+ * Returns:(transfer floating): The histograms as `a{s(tttat)}`
+ */
+GVariant *
+fbd_stats_get_histograms (FbdStats *self)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_return_val_if_fail (FBD_IS_STATS (self), NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tttat)}"));
+
+  g_mutex_lock (&self->lock);
+  for (guint i = 0; i < FBD_STATS_N_DURATIONS; i++) {
+    g_variant_builder_add (&builder, "{s@(tttat)}", duration_names[i],
+                           histogram_to_variant (&self->durations[i]));
+  }
+
+  g_hash_table_iter_init (&iter, self->latencies);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_autofree char *name = get_latency_name (GPOINTER_TO_SIZE (key));
+
+    g_variant_builder_add (&builder, "{s@(tttat)}", name, histogram_to_variant (value));
+  }
+  g_mutex_unlock (&self->lock);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * fbd_stats_reset:
+ * @self: The stats
+ *
+ * Resets the counters and histograms. The number of active events is
+ * kept and becomes the new peak. Live objects are kept too.
+ */
+void
+fbd_stats_reset (FbdStats *self)
+{
+  g_return_if_fail (FBD_IS_STATS (self));
+
+  g_debug ("Resetting stats");
+
+  g_mutex_lock (&self->lock);
+  memset (self->counters, 0, sizeof (self->counters));
+  memset (self->durations, 0, sizeof (self->durations));
+  g_hash_table_remove_all (self->latencies);
+  self->active_events_peak = self->active_events;
+  g_mutex_unlock (&self->lock);
+}
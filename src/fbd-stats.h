@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include "lfb-gdbus.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Bucket 0 holds samples below 1µs, the last one everything >= 2^22µs */
+#define FBD_STATS_N_BUCKETS 24
+
+/**
+ * FbdStatsCounter:
+ * @FBD_STATS_COUNTER_EVENTS_TRIGGERED: Events submitted by clients
+ * @FBD_STATS_COUNTER_EVENTS_NOT_FOUND: Events without any feedback
+ * @FBD_STATS_COUNTER_RATE_LIMITED: Method calls rejected due to the rate limit
+ * @FBD_STATS_COUNTER_FEEDBACKS_BUSY: Haptic feedbacks dropped as all motors were busy
+ * @FBD_STATS_COUNTER_TIMER_WAKEUPS: Wakeups of the daemon's timers
+ * @FBD_STATS_COUNTER_DEADLINE_SKIPPED: Feedbacks skipped as they were expected to miss the deadline
+ * @FBD_STATS_COUNTER_DEADLINE_MISSED: Feedbacks that started after their deadline
+ * @FBD_STATS_COUNTER_DUTY_SCALED: Haptic feedbacks weakened to stay within the duty cycle budget
+ * @FBD_STATS_COUNTER_DUTY_DROPPED: Haptic feedbacks dropped as the duty cycle budget was used up
+ *
+ * The counters tracked by #FbdStats.
+ */
+typedef enum {
+  FBD_STATS_COUNTER_EVENTS_TRIGGERED,
+  FBD_STATS_COUNTER_EVENTS_NOT_FOUND,
+  FBD_STATS_COUNTER_RATE_LIMITED,
+  FBD_STATS_COUNTER_FEEDBACKS_BUSY,
+  FBD_STATS_COUNTER_TIMER_WAKEUPS,
+  FBD_STATS_COUNTER_DEADLINE_SKIPPED,
+  FBD_STATS_COUNTER_DEADLINE_MISSED,
+  FBD_STATS_COUNTER_DUTY_SCALED,
+  FBD_STATS_COUNTER_DUTY_DROPPED,
+  FBD_STATS_N_COUNTERS,
+} FbdStatsCounter;
+
+/**
+ * FbdStatsDuration:
+ * @FBD_STATS_DURATION_EVIOCSFF: Uploading a haptic effect
+ * @FBD_STATS_DURATION_SYSFS_WRITE: Writing a sysfs attribute
+ * @FBD_STATS_DURATION_SOUND_START: Handing a sound to the sound backend
+ * @FBD_STATS_DURATION_SOUND_PLAY: Playing a sound until it finished
+ * @FBD_STATS_DURATION_START_SKEW: Starting all feedbacks of an event
+ *
+ * The durations #FbdStats keeps histograms of.
+ */
+typedef enum {
+  FBD_STATS_DURATION_EVIOCSFF,
+  FBD_STATS_DURATION_SYSFS_WRITE,
+  FBD_STATS_DURATION_SOUND_START,
+  FBD_STATS_DURATION_SOUND_PLAY,
+  FBD_STATS_DURATION_START_SKEW,
+  FBD_STATS_N_DURATIONS,
+} FbdStatsDuration;
+
+/**
+ * FbdStatsObject:
+ * @FBD_STATS_OBJECT_EVENT: Events, see #FbdEvent
+ * @FBD_STATS_OBJECT_PLAYBACK: Feedbacks attached to events, see #FbdFeedbackPlayback
+ * @FBD_STATS_OBJECT_CLIENT_WATCH: Watches of clients with running events
+ * @FBD_STATS_OBJECT_SOUND: Sounds handed to the sound backend including pooled ones
+ * @FBD_STATS_OBJECT_THEME: Feedback themes, see #FbdFeedbackTheme
+ *
+ * The objects #FbdStats keeps track of to spot leaks.
+ */
+typedef enum {
+  FBD_STATS_OBJECT_EVENT,
+  FBD_STATS_OBJECT_PLAYBACK,
+  FBD_STATS_OBJECT_CLIENT_WATCH,
+  FBD_STATS_OBJECT_SOUND,
+  FBD_STATS_OBJECT_THEME,
+  FBD_STATS_N_OBJECTS,
+} FbdStatsObject;
+
+#define FBD_TYPE_STATS (fbd_stats_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdStats, fbd_stats, FBD, STATS, LfbGdbusFeedbackStatsSkeleton)
+
+FbdStats *fbd_stats_get_default (void);
+void      fbd_stats_count (FbdStats *self, FbdStatsCounter counter);
+guint64   fbd_stats_get_count (FbdStats *self, FbdStatsCounter counter);
+void      fbd_stats_add_duration (FbdStats *self, FbdStatsDuration duration, gint64 usec);
+void      fbd_stats_add_latency (FbdStats *self, GType feedback_type, gint64 usec);
+gint64    fbd_stats_get_latency_estimate (FbdStats *self, GType feedback_type);
+gboolean  fbd_stats_check_deadline (FbdStats *self, GType feedback_type, gint64 usec);
+void      fbd_stats_set_active_events (FbdStats *self, guint n_events);
+void      fbd_stats_set_duty_cycle (FbdStats *self, const char *actuator, int permille);
+void      fbd_stats_object_new (FbdStats *self, FbdStatsObject object, gsize size);
+void      fbd_stats_object_free (FbdStats *self, FbdStatsObject object, gsize size);
+guint64   fbd_stats_get_n_objects (FbdStats *self, FbdStatsObject object);
+GVariant *fbd_stats_get_counters (FbdStats *self);
+GVariant *fbd_stats_get_histograms (FbdStats *self);
+void      fbd_stats_reset (FbdStats *self);
+
+G_END_DECLS
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-theme-cache"
+
+#include "fbd-feedback-profile.h"
+#include "fbd-feedback-theme.h"
+#include "fbd-theme-cache.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * SECTION:theme-cache
+ * @short_description: Compiled theme cache
+ * @Title: FbdThemeCache
+ *
+ * The theme cache stores the merged result of a theme's parent chain
+ * so it can be mmapped on the next start instead of parsing and merging
+ * all theme files again. It's keyed by the theme name, the compatibles
+ * and the path, mtime and size of all theme files involved.
+ *
+ * Each feedback is stored as its JSON description sorted by event name
+ * so profiles only need to build the feedbacks that are looked up.
+ */
+
+#define FBD_THEME_CACHE_VERSION 1
+/* version, key, sources (name, path, mtime, size), profiles (name, (event name, feedback)) */
+#define FBD_THEME_CACHE_TYPE    "(usa(sstt)a(sa(ss)))"
+
+
+FbdThemeCacheLayer *
+fbd_theme_cache_layer_new (const char *name, const char *path, JsonNode *node)
+{
+  FbdThemeCacheLayer *layer = g_new0 (FbdThemeCacheLayer, 1);
+
+  layer->name = g_strdup (name);
+  layer->path = g_strdup (path);
+  layer->node = node ? json_node_ref (node) : NULL;
+
+  return layer;
+}
+
+
+void
+fbd_theme_cache_layer_free (FbdThemeCacheLayer *layer)
+{
+  g_free (layer->name);
+  g_free (layer->path);
+  g_clear_pointer (&layer->node, json_node_unref);
+  g_clear_object (&layer->theme);
+  g_free (layer);
+}
+
+
+static gboolean
+get_file_info (const char *path, guint64 *mtime, guint64 *size)
+{
+  GStatBuf st;
+
+  if (g_stat (path, &st) != 0)
+    return FALSE;
+
+  *mtime = (guint64) st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+  *size = st.st_size;
+
+  return TRUE;
+}
+
+/**
+ * fbd_theme_cache_get_path:
+ * @cache_dir: The directory holding cache files
+ * @key: The key identifying the theme
+ *
+ * Returns: (transfer full): The path of the cache file for @key
+ */
+char *
+fbd_theme_cache_get_path (const char *cache_dir, const char *key)
+{
+  g_autofree char *checksum = NULL;
+  g_autofree char *filename = NULL;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+  filename = g_strdup_printf ("%s.cache", checksum);
+
+  return g_build_filename (cache_dir, filename, NULL);
+}
+
+
+static void
+merge_layer (GHashTable *profiles, JsonNode *node)
+{
+  JsonArray *array;
+
+  if (!JSON_NODE_HOLDS_OBJECT (node))
+    return;
+
+  array = json_object_get_array_member (json_node_get_object (node), "profiles");
+  if (array == NULL)
+    return;
+
+  for (guint i = 0; i < json_array_get_length (array); i++) {
+    JsonObject *profile = json_array_get_object_element (array, i);
+    JsonArray *feedbacks;
+    GHashTable *events;
+    const char *name;
+
+    if (profile == NULL)
+      continue;
+
+    name = json_object_get_string_member_with_default (profile, "name", NULL);
+    feedbacks = json_object_get_array_member (profile, "feedbacks");
+    if (name == NULL || feedbacks == NULL)
+      continue;
+
+    events = g_hash_table_lookup (profiles, name);
+    if (events == NULL) {
+      events = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      g_hash_table_insert (profiles, g_strdup (name), events);
+    }
+
+    /* Like fbd_feedback_profile_update() feedbacks of upper layers win */
+    for (guint j = 0; j < json_array_get_length (feedbacks); j++) {
+      JsonNode *feedback = json_array_get_element (feedbacks, j);
+      const char *event_name;
+
+      if (!JSON_NODE_HOLDS_OBJECT (feedback))
+        continue;
+
+      event_name = json_object_get_string_member_with_default (json_node_get_object (feedback),
+                                                               "event-name", NULL);
+      if (event_name == NULL)
+        continue;
+
+      g_hash_table_insert (events, g_strdup (event_name), json_to_string (feedback, FALSE));
+    }
+  }
+}
+
+
+static int
+compare_strings (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **)a, *(const char **)b);
+}
+
+/**
+ * fbd_theme_cache_save:
+ * @path: The cache file to write
+ * @key: The key identifying the theme
+ * @layers: (element-type FbdThemeCacheLayer): The theme's layers starting with
+ *   the theme itself followed by its parents
+ * @error: Return location for an error
+ *
+ * Merges the layers like the theme expander does and stores the
+ * result in @path.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_theme_cache_save (const char  *path,
+                      const char  *key,
+                      GPtrArray   *layers,
+                      GError     **error)
+{
+  g_autoptr (GHashTable) profiles = NULL;
+  g_autoptr (GVariant) cache = NULL;
+  g_autofree char *dir = NULL;
+  GVariantBuilder sources, builder;
+  GHashTableIter iter;
+  const char *profile_name;
+  GHashTable *events;
+
+  g_return_val_if_fail (path, FALSE);
+  g_return_val_if_fail (key, FALSE);
+  g_return_val_if_fail (layers && layers->len, FALSE);
+
+  profiles = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                    g_free, (GDestroyNotify)g_hash_table_unref);
+
+  g_variant_builder_init (&sources, G_VARIANT_TYPE ("a(sstt)"));
+  for (guint i = 0; i < layers->len; i++) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (layers, i);
+    guint64 mtime, size;
+
+    if (!get_file_info (layer->path, &mtime, &size)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Can't stat %s", layer->path);
+      return FALSE;
+    }
+
+    g_variant_builder_add (&sources, "(sstt)", layer->name ? layer->name : "", layer->path,
+                           mtime, size);
+  }
+
+  /* Merge bottom to top */
+  for (int i = layers->len - 1; i >= 0; i--) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (layers, i);
+
+    merge_layer (profiles, layer->node);
+  }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa(ss))"));
+  g_hash_table_iter_init (&iter, profiles);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&profile_name, (gpointer *)&events)) {
+    g_autoptr (GPtrArray) names = g_ptr_array_new ();
+    GHashTableIter event_iter;
+    const char *event_name;
+
+    g_hash_table_iter_init (&event_iter, events);
+    while (g_hash_table_iter_next (&event_iter, (gpointer *)&event_name, NULL))
+      g_ptr_array_add (names, (gpointer)event_name);
+    /* Sorted so profiles can bisect */
+    g_ptr_array_sort (names, compare_strings);
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sa(ss))"));
+    g_variant_builder_add (&builder, "s", profile_name);
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ss)"));
+    for (guint i = 0; i < names->len; i++) {
+      event_name = g_ptr_array_index (names, i);
+      g_variant_builder_add (&builder, "(ss)", event_name, g_hash_table_lookup (events, event_name));
+    }
+    g_variant_builder_close (&builder);
+    g_variant_builder_close (&builder);
+  }
+
+  cache = g_variant_ref_sink (g_variant_new (FBD_THEME_CACHE_TYPE,
+                                             FBD_THEME_CACHE_VERSION,
+                                             key,
+                                             &sources,
+                                             &builder));
+
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0700) != 0) {
+    int saved_errno = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "Failed to create %s: %s", dir, g_strerror (saved_errno));
+    return FALSE;
+  }
+
+  return g_file_set_contents (path,
+                              g_variant_get_data (cache),
+                              g_variant_get_size (cache),
+                              error);
+}
+
+
+static gboolean
+check_sources (GVariant                  *sources,
+               const char                *theme_path,
+               FbdThemeCacheResolveFunc   resolve,
+               gpointer                   user_data,
+               GPtrArray                 *layers)
+{
+  gsize n = g_variant_n_children (sources);
+
+  if (n == 0)
+    return FALSE;
+
+  for (gsize i = 0; i < n; i++) {
+    g_autofree char *resolved = NULL;
+    const char *name, *path;
+    guint64 mtime, size, cur_mtime, cur_size;
+
+    g_variant_get_child (sources, i, "(&s&stt)", &name, &path, &mtime, &size);
+
+    /* The same parents must resolve to the same files */
+    if (i == 0)
+      resolved = g_strdup (theme_path);
+    else
+      resolved = resolve (name, user_data);
+
+    if (g_strcmp0 (resolved, path)) {
+      g_debug ("Theme '%s' now at %s, was %s", name, resolved, path);
+      return FALSE;
+    }
+
+    if (!get_file_info (path, &cur_mtime, &cur_size) || cur_mtime != mtime || cur_size != size) {
+      g_debug ("Theme file %s changed", path);
+      return FALSE;
+    }
+
+    if (layers)
+      g_ptr_array_add (layers, fbd_theme_cache_layer_new (i ? name : NULL, path, NULL));
+  }
+
+  return TRUE;
+}
+
+/**
+ * fbd_theme_cache_load:
+ * @path: The cache file to load
+ * @key: The key identifying the theme
+ * @theme_path: The path of the theme's file
+ * @resolve: Function to look up parent themes
+ * @user_data: User data for @resolve
+ * @layers:(nullable)(element-type FbdThemeCacheLayer): Return location for
+ *   the theme's layers
+ * @error: Return location for an error
+ *
+ * Maps the cache file and builds a theme when the cache is still valid
+ * for @key and all the theme files it was built from are unchanged.
+ * The theme's feedbacks are only built when looked up.
+ *
+ * If @layers is given the theme files the cache was built from are
+ * added to it. The layers' nodes are unset as the files weren't parsed.
+ *
+ * Returns: (transfer full)(nullable): The merged theme
+ */
+FbdFeedbackTheme *
+fbd_theme_cache_load (const char                *path,
+                      const char                *key,
+                      const char                *theme_path,
+                      FbdThemeCacheResolveFunc   resolve,
+                      gpointer                   user_data,
+                      GPtrArray                 *layers,
+                      GError                   **error)
+{
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GVariant) cache = NULL;
+  g_autoptr (GVariant) sources = NULL;
+  g_autoptr (GVariant) profiles = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  const char *cached_key;
+  guint32 version;
+  gsize n;
+
+  g_return_val_if_fail (path, NULL);
+  g_return_val_if_fail (key, NULL);
+  g_return_val_if_fail (resolve, NULL);
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  cache = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FBD_THEME_CACHE_TYPE),
+                                                        bytes,
+                                                        FALSE));
+
+  g_variant_get_child (cache, 0, "u", &version);
+  g_variant_get_child (cache, 1, "&s", &cached_key);
+  if (version != FBD_THEME_CACHE_VERSION || g_strcmp0 (cached_key, key)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Cache %s doesn't match", path);
+    return NULL;
+  }
+
+  sources = g_variant_get_child_value (cache, 2);
+  if (!check_sources (sources, theme_path, resolve, user_data, layers)) {
+    if (layers)
+      g_ptr_array_set_size (layers, 0);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Cache %s is outdated", path);
+    return NULL;
+  }
+
+  theme = fbd_feedback_theme_new ("merged-theme");
+  profiles = g_variant_get_child_value (cache, 3);
+  n = g_variant_n_children (profiles);
+  for (gsize i = 0; i < n; i++) {
+    g_autoptr (FbdFeedbackProfile) profile = NULL;
+    g_autoptr (GVariant) feedbacks = NULL;
+    const char *name;
+
+    g_variant_get_child (profiles, i, "(&s@a(ss))", &name, &feedbacks);
+    profile = fbd_feedback_profile_new_from_cache (name, feedbacks);
+    fbd_feedback_theme_add_profile (theme, profile);
+  }
+
+  g_debug ("Loaded theme from cache %s", path);
+  return g_steal_pointer (&theme);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include "fbd-feedback-theme.h"
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FbdThemeCacheLayer:
+ * @name: The theme name used to look up the layer's file or %NULL for
+ *   the theme the expansion started with
+ * @path: The path of the theme file
+ * @node:(nullable): The parsed theme file
+ * @theme:(nullable): The theme built from @node
+ *
+ * A theme file in a theme's parent chain.
+ */
+typedef struct _FbdThemeCacheLayer {
+  char             *name;
+  char             *path;
+  JsonNode         *node;
+  FbdFeedbackTheme *theme;
+} FbdThemeCacheLayer;
+
+/**
+ * FbdThemeCacheResolveFunc:
+ * @name: The theme name to look up
+ * @user_data: The user data
+ *
+ * Looks up a theme file the same way the theme expansion did.
+ *
+ * Returns: (transfer full): The theme file's path
+ */
+typedef char *(*FbdThemeCacheResolveFunc) (const char *name, gpointer user_data);
+
+FbdThemeCacheLayer *fbd_theme_cache_layer_new (const char *name,
+                                               const char *path,
+                                               JsonNode   *node);
+void                fbd_theme_cache_layer_free (FbdThemeCacheLayer *layer);
+
+char               *fbd_theme_cache_get_path (const char         *cache_dir,
+                                              const char         *key);
+gboolean            fbd_theme_cache_save (const char         *path,
+                                          const char         *key,
+                                          GPtrArray          *layers,
+                                          GError            **error);
+FbdFeedbackTheme   *fbd_theme_cache_load (const char               *path,
+                                          const char               *key,
+                                          const char               *theme_path,
+                                          FbdThemeCacheResolveFunc  resolve,
+                                          gpointer                  user_data,
+                                          GPtrArray                *layers,
+                                          GError                  **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdThemeCacheLayer, fbd_theme_cache_layer_free)
+
+G_END_DECLS
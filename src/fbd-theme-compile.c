@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd"
+
+#include "fbd-theme-cache.h"
+#include "fbd-theme-expander.h"
+#include "fbd-theme-parser.h"
+
+#include <gio/gio.h>
+
+#include <string.h>
+
+#define BLURP "- Check and precompile feedback themes"
+
+/* See doc/Event-naming-spec-0.0.0.md */
+#define EVENT_NAME_CHARS "abcdefghijklmnopqrstuvwxyz0123456789_-."
+
+G_NORETURN
+static void
+print_version (void)
+{
+  g_print ("%s %s " BLURP "\n", g_get_prgname(), FBD_VERSION);
+  exit (0);
+}
+
+
+static JsonArray *
+get_profiles (JsonNode *node)
+{
+  if (!JSON_NODE_HOLDS_OBJECT (node))
+    return NULL;
+
+  return json_object_get_array_member (json_node_get_object (node), "profiles");
+}
+
+
+static JsonArray *
+get_feedbacks (JsonObject *profile)
+{
+  if (!json_object_has_member (profile, "feedbacks"))
+    return NULL;
+
+  return json_object_get_array_member (profile, "feedbacks");
+}
+
+
+static JsonNode *
+find_feedback (JsonNode *node, const char *profile_name, const char *event_name)
+{
+  JsonArray *profiles = get_profiles (node);
+
+  if (profiles == NULL)
+    return NULL;
+
+  for (guint i = 0; i < json_array_get_length (profiles); i++) {
+    JsonObject *profile = json_array_get_object_element (profiles, i);
+    JsonArray *feedbacks;
+
+    if (g_strcmp0 (json_object_get_string_member_with_default (profile, "name", NULL),
+                   profile_name))
+      continue;
+
+    feedbacks = get_feedbacks (profile);
+    if (feedbacks == NULL)
+      return NULL;
+
+    for (guint j = 0; j < json_array_get_length (feedbacks); j++) {
+      JsonNode *feedback = json_array_get_element (feedbacks, j);
+      const char *name;
+
+      name = json_object_get_string_member_with_default (json_node_get_object (feedback),
+                                                         "event-name", NULL);
+      if (g_strcmp0 (name, event_name) == 0)
+        return feedback;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Event names must follow the naming spec and feedbacks that are the
+ * same as the ones they override in a parent theme are never
+ * noticeable.
+ */
+static guint
+check_layers (GPtrArray *layers)
+{
+  guint problems = 0;
+
+  for (guint i = 0; i < layers->len; i++) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (layers, i);
+    JsonArray *profiles = get_profiles (layer->node);
+
+    if (profiles == NULL)
+      continue;
+
+    for (guint j = 0; j < json_array_get_length (profiles); j++) {
+      JsonObject *profile = json_array_get_object_element (profiles, j);
+      const char *profile_name;
+      JsonArray *feedbacks;
+
+      profile_name = json_object_get_string_member_with_default (profile, "name", NULL);
+      feedbacks = get_feedbacks (profile);
+      if (feedbacks == NULL)
+        continue;
+
+      for (guint k = 0; k < json_array_get_length (feedbacks); k++) {
+        JsonNode *feedback = json_array_get_element (feedbacks, k);
+        const char *event_name;
+
+        event_name = json_object_get_string_member_with_default (json_node_get_object (feedback),
+                                                                 "event-name", NULL);
+        if (event_name == NULL)
+          continue;
+
+        if (strspn (event_name, EVENT_NAME_CHARS) != strlen (event_name)) {
+          g_printerr ("%s: Event name '%s' in profile '%s' violates the event naming spec\n",
+                      layer->path, event_name, profile_name);
+          problems++;
+        }
+
+        for (guint l = i + 1; l < layers->len; l++) {
+          FbdThemeCacheLayer *lower = g_ptr_array_index (layers, l);
+          JsonNode *overridden = find_feedback (lower->node, profile_name, event_name);
+
+          if (overridden == NULL)
+            continue;
+
+          if (json_node_equal (feedback, overridden)) {
+            g_printerr ("%s: Feedback for '%s' in profile '%s' is the same as in %s\n",
+                        layer->path, event_name, profile_name, lower->path);
+            problems++;
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  return problems;
+}
+
+/* Only the first compatible with a theme is used */
+static guint
+check_compatibles (const char * const *compatibles)
+{
+  const char * const *xdg_data_dirs = g_get_system_data_dirs ();
+  const char *used = NULL;
+  guint problems = 0;
+
+  for (int i = 0; compatibles && compatibles[i]; i++) {
+    g_autofree char *file_name = g_strconcat (compatibles[i], ".json", NULL);
+
+    for (int j = 0; xdg_data_dirs[j]; j++) {
+      g_autofree char *path = g_build_filename (xdg_data_dirs[j], "feedbackd", "themes",
+                                                file_name, NULL);
+
+      if (!g_file_test (path, G_FILE_TEST_EXISTS))
+        continue;
+
+      if (used) {
+        g_printerr ("%s: Unreachable as the theme for compatible '%s' is used\n", path, used);
+        problems++;
+      } else {
+        used = compatibles[i];
+      }
+      break;
+    }
+  }
+
+  return problems;
+}
+
+
+static gboolean
+compile_theme (const char * const *compatibles,
+               const char         *theme_name,
+               const char         *theme_file,
+               const char         *cache_dir)
+{
+  g_autoptr (FbdThemeExpander) expander = NULL;
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  g_autoptr (GError) err = NULL;
+  const char *name = theme_file ?: (theme_name ?: "default");
+  guint problems;
+
+  /* Check the theme itself before checking how it expands */
+  if (theme_file)
+    node = fbd_theme_parser_load_file (theme_file, FBD_THEME_PARSER_FLAG_VALIDATE, &err);
+
+  if (theme_file == NULL || node) {
+    expander = fbd_theme_expander_new (compatibles, theme_name, theme_file);
+    theme = fbd_theme_expander_load_theme_files (expander, &err);
+  }
+
+  if (theme == NULL) {
+    g_printerr ("Loading '%s' failed: %s\n", name, err->message);
+    return FALSE;
+  }
+
+  problems = check_layers (fbd_theme_expander_get_layers (expander));
+  if (theme_file == NULL)
+    problems += check_compatibles (compatibles);
+
+  if (problems) {
+    g_printerr ("Found %u problem(s) in '%s'\n", problems, name);
+    return FALSE;
+  }
+
+  if (cache_dir && !fbd_theme_expander_save_cache (expander, cache_dir, &err)) {
+    g_printerr ("Compiling '%s' failed: %s\n", name, err->message);
+    return FALSE;
+  }
+
+  g_print ("%s: OK\n", name);
+  return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autofree char *cache_dir = NULL;
+  g_autofree char *theme_name = NULL;
+  g_auto (GStrv) compatibles = NULL;
+  g_auto (GStrv) args = NULL;
+  gboolean version = FALSE;
+  int ret = EXIT_SUCCESS;
+
+  const GOptionEntry options [] = {
+    {"version", 0, 0, G_OPTION_ARG_NONE, &version,
+     "Show version information", NULL},
+    {"compatible", 0, 0, G_OPTION_ARG_STRING_ARRAY, &compatibles,
+     "The device compatibles, most specific first", "COMPATIBLE"},
+    {"theme", 0, 0, G_OPTION_ARG_STRING, &theme_name,
+     "The theme to compile when no theme file is given", "NAME"},
+    {"cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir,
+     "Directory to store the compiled themes in", "DIR"},
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &args, NULL, NULL },
+    G_OPTION_ENTRY_NULL,
+  };
+
+  opt_context = g_option_context_new ("[THEME-FILE...] " BLURP);
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_warning ("%s", err->message);
+    g_clear_error (&err);
+    return 1;
+  }
+
+  if (version) {
+    print_version ();
+  }
+
+  /* Resolve the theme like the daemon does */
+  if (args == NULL) {
+    if (!compile_theme ((const char * const *)compatibles, theme_name, NULL, cache_dir))
+      ret = EXIT_FAILURE;
+    return ret;
+  }
+
+  for (int i = 0; args[i]; i++) {
+    if (!compile_theme ((const char * const *)compatibles, theme_name, args[i], cache_dir))
+      ret = EXIT_FAILURE;
+  }
+
+  return ret;
+}
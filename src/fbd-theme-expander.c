@@ -10,13 +10,20 @@
 
 #include "fbd.h"
 #include "fbd-feedback-theme.h"
+#include "fbd-theme-cache.h"
 #include "fbd-theme-expander.h"
+#include "fbd-theme-parser.h"
+
+#include <gio/gio.h>
 
 #define DEFAULT_THEME_NAME  "default"
 #define DEVICE_THEME_NAME   "$device"
 
 #define MAX_THEME_DEPTH 10
 
+/* Editors usually write files in several steps */
+#define RELOAD_DELAY_MS 100
+
 /**
  * SECTION:theme-expander
  * @short_description: Feedback theme expander
@@ -24,6 +31,22 @@
  *
  * The theme expander reads themes from disks and expands references
  * to other themes
+ *
+ * When `watch` is set the theme files are monitored. If one changes only
+ * that file is parsed again and the merged theme is rebuilt from the
+ * other layers. It's passed on via #FbdThemeExpander::theme-changed.
+ *
+ * Theme names and compatibles are resolved via an index of the theme
+ * directories' contents so resolving doesn't need to probe for files
+ * in every directory. The index is built once per load. When watching
+ * it's kept until the theme directories change. Themes that appear or
+ * vanish then trigger a full reload as the theme chain might resolve
+ * differently.
+ *
+ * fbd_theme_expander_load_theme_files_async() does the resolving,
+ * parsing and merging in a worker thread so the main loop isn't
+ * blocked by it. The expander must not be used until the load is
+ * finished.
  */
 
 enum {
@@ -31,17 +54,45 @@ enum {
   PROP_THEME_NAME,
   PROP_THEME_FILE,
   PROP_COMPATIBLES,
+  PROP_CACHE_DIR,
+  PROP_SYSTEM_CACHE_DIR,
+  PROP_WATCH,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+enum {
+  SIGNAL_THEME_CHANGED,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS];
+
 struct _FbdThemeExpander {
   GObject    parent;
 
   char      *theme_name;
   char      *theme_file;
+  gboolean   theme_file_set;
   gboolean   device_theme_loaded;
   GStrv      compatibles;
+  char      *cache_dir;
+  char      *system_cache_dir;
+
+  /* FbdThemeCacheLayer of the last load, the theme itself first */
+  GPtrArray *layers;
+  gboolean   watch;
+  GPtrArray *monitors;
+  guint      reload_id;
+  gboolean   reload_all;
+
+  /* Key: theme name or compatible, value: path of the theme file */
+  GHashTable *user_themes;
+  GHashTable *system_themes;
+  gboolean    index_stale;
+  GPtrArray  *dir_monitors;
+
+  /* Loading in a worker thread, monitors get set up when done */
+  gboolean    loading;
 };
 G_DEFINE_TYPE (FbdThemeExpander, fbd_theme_expander, G_TYPE_OBJECT)
 
@@ -80,31 +131,137 @@ fbd_theme_expander_set_theme_file (FbdThemeExpander *self, const char *theme_fil
 
   g_free (self->theme_file);
   self->theme_file = g_strdup (theme_file);
+  self->theme_file_set = !!theme_file;
 
   /* Make sure we reload the device theme */
   self->device_theme_loaded = FALSE;
 }
 
 
-static char *
-fbd_theme_expander_find_theme_in_xdg_data (const char *theme_name)
+/* Earlier directories take precedence so existing entries are kept */
+static void
+index_theme_dir (GHashTable *index, const char *dir_path)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *file_name;
+
+  dir = g_dir_open (dir_path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((file_name = g_dir_read_name (dir))) {
+    g_autofree char *theme_name = NULL;
+
+    if (!g_str_has_suffix (file_name, ".json"))
+      continue;
+
+    theme_name = g_strndup (file_name, strlen (file_name) - strlen (".json"));
+    if (g_hash_table_contains (index, theme_name))
+      continue;
+
+    g_hash_table_insert (index,
+                         g_steal_pointer (&theme_name),
+                         g_build_filename (dir_path, file_name, NULL));
+  }
+}
+
+
+static void
+watch_theme_dir (FbdThemeExpander *self, const char *dir_path)
+{
+  g_autoptr (GFile) dir = g_file_new_for_path (dir_path);
+  g_autoptr (GError) err = NULL;
+  GFileMonitor *monitor;
+
+  monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE, NULL, &err);
+  if (monitor == NULL) {
+    g_debug ("Failed to watch theme dir %s: %s", dir_path, err->message);
+    return;
+  }
+
+  g_signal_connect_object (monitor, "changed",
+                           G_CALLBACK (on_theme_dir_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_ptr_array_add (self->dir_monitors, monitor);
+}
+
+
+static void
+watch_theme_dirs (FbdThemeExpander *self)
 {
   const char * const *xdg_data_dirs = g_get_system_data_dirs ();
-  g_autofree char *theme_file_name = g_strconcat (theme_name, ".json", NULL);
+  g_autofree char *user_dir = NULL;
+
+  user_dir = g_build_filename (g_get_user_config_dir (), "feedbackd", "themes", NULL);
+  watch_theme_dir (self, user_dir);
 
   for (int i = 0; xdg_data_dirs[i] != NULL; i++) {
-    g_autofree char *theme_path = NULL;
+    g_autofree char *dir = g_build_filename (xdg_data_dirs[i], "feedbackd", "themes", NULL);
 
-    theme_path = g_build_filename (xdg_data_dirs[i], "feedbackd", "themes",
-                                   theme_file_name, NULL);
-    g_debug ("Looking for theme file at %s", theme_path);
+    watch_theme_dir (self, dir);
+  }
+}
 
-    /* Check if file exist */
-    if (g_file_test (theme_path, (G_FILE_TEST_EXISTS))) {
-      g_info ("Loading theme file at '%s'", theme_path);
-      return g_steal_pointer (&theme_path);
-    }
+
+static void
+invalidate_theme_index (FbdThemeExpander *self)
+{
+  g_clear_pointer (&self->user_themes, g_hash_table_unref);
+  g_clear_pointer (&self->system_themes, g_hash_table_unref);
+  g_ptr_array_set_size (self->dir_monitors, 0);
+  self->index_stale = FALSE;
+}
+
+
+static void
+ensure_theme_index (FbdThemeExpander *self)
+{
+  const char * const *xdg_data_dirs = g_get_system_data_dirs ();
+  g_autofree char *user_dir = NULL;
+
+  if (self->index_stale)
+    invalidate_theme_index (self);
+
+  if (self->system_themes)
+    return;
+
+  self->user_themes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->system_themes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  user_dir = g_build_filename (g_get_user_config_dir (), "feedbackd", "themes", NULL);
+  index_theme_dir (self->user_themes, user_dir);
+
+  for (int i = 0; xdg_data_dirs[i] != NULL; i++) {
+    g_autofree char *dir = g_build_filename (xdg_data_dirs[i], "feedbackd", "themes", NULL);
+
+    index_theme_dir (self->system_themes, dir);
+  }
+
+  /* Monitors need the main thread, set up once a threaded load is done */
+  if (self->watch && !self->loading)
+    watch_theme_dirs (self);
+
+  g_debug ("Indexed %u user and %u system themes",
+           g_hash_table_size (self->user_themes),
+           g_hash_table_size (self->system_themes));
+}
+
+
+static char *
+fbd_theme_expander_find_theme_in_xdg_data (FbdThemeExpander *self, const char *theme_name)
+{
+  const char *theme_path;
+
+  ensure_theme_index (self);
+
+  theme_path = g_hash_table_lookup (self->system_themes, theme_name);
+  if (theme_path) {
+    g_info ("Loading theme file at '%s'", theme_path);
+    return g_strdup (theme_path);
   }
+
+  g_debug ("No theme file for '%s' in the XDG data dirs", theme_name);
   return NULL;
 }
 
@@ -131,7 +288,7 @@ fbd_theme_expander_find_device_theme_path (FbdThemeExpander *self, const char *t
     const char *compatible = self->compatibles[i];
     g_autofree char *theme_path = NULL;
 
-    theme_path = fbd_theme_expander_find_theme_in_xdg_data (compatible);
+    theme_path = fbd_theme_expander_find_theme_in_xdg_data (self, compatible);
     if (theme_path) {
       g_debug ("Loading themefile for compatible '%s' at: %s", compatible, theme_path);
       return g_steal_pointer (&theme_path);
@@ -144,16 +301,16 @@ fbd_theme_expander_find_device_theme_path (FbdThemeExpander *self, const char *t
 
 
 static char *
-fbd_theme_expander_find_user_theme_path (const char *theme_name)
+fbd_theme_expander_find_user_theme_path (FbdThemeExpander *self, const char *theme_name)
 {
-  g_autofree char *filename = g_strdup_printf ("%s.json", theme_name);
-  g_autofree char *user_config_path = NULL;
+  const char *user_config_path;
+
+  ensure_theme_index (self);
 
-  user_config_path = g_build_filename (g_get_user_config_dir (), "feedbackd",
-                                       "themes", filename, NULL);
-  if (g_file_test (user_config_path, (G_FILE_TEST_EXISTS))) {
+  user_config_path = g_hash_table_lookup (self->user_themes, theme_name);
+  if (user_config_path) {
     g_info ("Found theme file at: %s", user_config_path);
-    return g_steal_pointer (&user_config_path);
+    return g_strdup (user_config_path);
   }
 
   g_debug ("No user theme found for '%s'", theme_name);
@@ -169,7 +326,7 @@ fbd_theme_expander_find_theme_path (FbdThemeExpander *self, const char *theme_na
 
   g_assert (theme_name);
 
-  theme_path = fbd_theme_expander_find_user_theme_path (theme_name);
+  theme_path = fbd_theme_expander_find_user_theme_path (self, theme_name);
   if (theme_path)
     return theme_path;
 
@@ -180,7 +337,7 @@ fbd_theme_expander_find_theme_path (FbdThemeExpander *self, const char *theme_na
   if (g_str_equal (theme_name, DEFAULT_THEME_NAME) == FALSE)
     g_critical ("Theme '%s' not found, falling back to default theme", theme_name);
 
-  theme_path = fbd_theme_expander_find_theme_in_xdg_data (DEFAULT_THEME_NAME);
+  theme_path = fbd_theme_expander_find_theme_in_xdg_data (self, DEFAULT_THEME_NAME);
   if (theme_path)
     return theme_path;
 
@@ -209,6 +366,15 @@ fbd_theme_expander_set_property (GObject      *object,
   case PROP_COMPATIBLES:
     fbd_theme_expander_set_compatibles (self, g_value_get_boxed (value));
     break;
+  case PROP_CACHE_DIR:
+    fbd_theme_expander_set_cache_dir (self, g_value_get_string (value));
+    break;
+  case PROP_SYSTEM_CACHE_DIR:
+    fbd_theme_expander_set_system_cache_dir (self, g_value_get_string (value));
+    break;
+  case PROP_WATCH:
+    fbd_theme_expander_set_watch (self, g_value_get_boolean (value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -234,6 +400,15 @@ fbd_theme_expander_get_property (GObject    *object,
   case PROP_COMPATIBLES:
     g_value_set_boxed (value, fbd_theme_expander_get_compatibles (self));
     break;
+  case PROP_CACHE_DIR:
+    g_value_set_string (value, self->cache_dir);
+    break;
+  case PROP_SYSTEM_CACHE_DIR:
+    g_value_set_string (value, self->system_cache_dir);
+    break;
+  case PROP_WATCH:
+    g_value_set_boolean (value, self->watch);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -246,9 +421,16 @@ fbd_theme_expander_finalize (GObject *object)
 {
   FbdThemeExpander *self = FBD_THEME_EXPANDER(object);
 
+  g_clear_handle_id (&self->reload_id, g_source_remove);
+  g_clear_pointer (&self->monitors, g_ptr_array_unref);
+  invalidate_theme_index (self);
+  g_clear_pointer (&self->dir_monitors, g_ptr_array_unref);
+  g_clear_pointer (&self->layers, g_ptr_array_unref);
   g_clear_pointer (&self->theme_name, g_free);
   g_clear_pointer (&self->theme_file, g_free);
   g_clear_pointer (&self->compatibles, g_strfreev);
+  g_clear_pointer (&self->cache_dir, g_free);
+  g_clear_pointer (&self->system_cache_dir, g_free);
 
   G_OBJECT_CLASS (fbd_theme_expander_parent_class)->finalize (object);
 }
@@ -298,14 +480,69 @@ fbd_theme_expander_class_init (FbdThemeExpanderClass *klass)
     g_param_spec_boxed ("compatibles", "", "",
                         G_TYPE_STRV,
                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdThemeExpander:cache-dir:
+   *
+   * Directory to store the compiled theme in. When set the merged theme
+   * is loaded from there as long as none of the theme files changed.
+   */
+  props[PROP_CACHE_DIR] =
+    g_param_spec_string ("cache-dir", "", "",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdThemeExpander:system-cache-dir:
+   *
+   * Directory with compiled themes built by `fbd-theme-compile`. It's
+   * only read, when the compiled theme in `cache-dir` is missing or
+   * outdated the one in here is used if it's still up to date.
+   */
+  props[PROP_SYSTEM_CACHE_DIR] =
+    g_param_spec_string ("system-cache-dir", "", "",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * FbdThemeExpander:watch:
+   *
+   * Whether to monitor the theme files of the last load for changes.
+   */
+  props[PROP_WATCH] =
+    g_param_spec_boolean ("watch", "", "",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+
+  /**
+   * FbdThemeExpander::theme-changed:
+   * @expander: The theme expander
+   * @theme: The new merged theme
+   *
+   * Emitted when a watched theme file changed and the theme got rebuilt.
+   */
+  signals[SIGNAL_THEME_CHANGED] = g_signal_new ("theme-changed",
+                                                G_TYPE_FROM_CLASS (klass),
+                                                G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+                                                NULL,
+                                                G_TYPE_NONE,
+                                                1,
+                                                FBD_TYPE_FEEDBACK_THEME);
+}
+
+
+static void
+monitor_free (GFileMonitor *monitor)
+{
+  g_file_monitor_cancel (monitor);
+  g_object_unref (monitor);
 }
 
 
 static void
 fbd_theme_expander_init (FbdThemeExpander *self)
 {
+  self->monitors = g_ptr_array_new_with_free_func ((GDestroyNotify)monitor_free);
+  self->dir_monitors = g_ptr_array_new_with_free_func ((GDestroyNotify)monitor_free);
 }
 
 
@@ -322,102 +559,523 @@ fbd_theme_expander_new (const char * const *compatibles,
 }
 
 
+static FbdFeedbackTheme *
+load_layer (const char *name, const char *path, GPtrArray *layers, GError **err)
+{
+  g_autoptr (JsonNode) node = NULL;
+  FbdThemeCacheLayer *layer;
+
+  node = fbd_theme_parser_load_file (path, FBD_THEME_PARSER_FLAG_NONE, err);
+  if (node == NULL)
+    return NULL;
+
+  layer = fbd_theme_cache_layer_new (name, path, node);
+  layer->theme = fbd_feedback_theme_new_from_node (node);
+  g_ptr_array_add (layers, layer);
+
+  return layer->theme;
+}
+
+
+static gboolean
+check_layer (FbdFeedbackTheme *theme, const char *path, GError **err)
+{
+  const char *theme_name = fbd_feedback_theme_get_name (theme);
+
+  if (theme_name == NULL || theme_name[0] == '\0') {
+    g_set_error (err, fbd_error_quark(), FBD_ERROR_THEME_EXPAND,
+                 "Theme name of %s can't be empty", path);
+    return FALSE;
+  }
+
+  if (fbd_feedback_theme_get_parent_name (theme) &&
+      g_str_equal (theme_name, DEFAULT_THEME_NAME)) {
+    g_set_error (err, fbd_error_quark(), FBD_ERROR_THEME_EXPAND,
+                 "Default theme can't specify a parent");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static FbdFeedbackTheme *
+merge_layers (FbdThemeExpander *self, GPtrArray *layers)
+{
+  FbdFeedbackTheme *merged = fbd_feedback_theme_new ("merged-theme");
+
+  /* Merge themes bottom to top */
+  for (int i = layers->len - 1; i >= 0; i--) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (layers, i);
+
+    fbd_feedback_theme_update (merged, layer->theme);
+  }
+
+  fbd_feedback_theme_set_name (merged, self->theme_name);
+  fbd_feedback_theme_compile (merged);
+  return merged;
+}
+
+
+static char *
+resolve_parent (const char *name, gpointer user_data)
+{
+  FbdThemeExpander *self = FBD_THEME_EXPANDER (user_data);
+
+  return fbd_theme_expander_find_theme_path (self, name);
+}
+
+
+static char *
+get_cache_key (FbdThemeExpander *self)
+{
+  g_autofree char *compatibles = NULL;
+
+  if (self->compatibles)
+    compatibles = g_strjoinv (";", self->compatibles);
+
+  return g_strdup_printf ("%s\n%s", self->theme_name, compatibles ?: "");
+}
+
+
+static FbdFeedbackTheme *
+load_cached_theme (FbdThemeExpander *self, const char *cache_dir, const char *key,
+                   GPtrArray *layers)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *cache_path = NULL;
+  FbdFeedbackTheme *theme;
+  gboolean device_theme_loaded = self->device_theme_loaded;
+
+  cache_path = fbd_theme_cache_get_path (cache_dir, key);
+  theme = fbd_theme_cache_load (cache_path, key, self->theme_file, resolve_parent, self,
+                                layers, &err);
+  if (theme == NULL) {
+    g_debug ("Not using theme cache: %s", err->message);
+    /* Resolving parents must start over when parsing the theme files */
+    self->device_theme_loaded = device_theme_loaded;
+  }
+
+  return theme;
+}
+
+
 static void
-update_theme (gpointer data, gpointer user_data)
+save_cached_theme (FbdThemeExpander *self, GPtrArray *layers)
 {
-  FbdFeedbackTheme *theme = FBD_FEEDBACK_THEME (data);
-  FbdFeedbackTheme *merged = FBD_FEEDBACK_THEME (user_data);
+  g_autoptr (GError) err = NULL;
+  g_autofree char *cache_path = NULL;
+  g_autofree char *key = get_cache_key (self);
 
-  g_assert (FBD_IS_FEEDBACK_THEME (theme));
-  g_assert (FBD_IS_FEEDBACK_THEME (merged));
+  cache_path = fbd_theme_cache_get_path (self->cache_dir, key);
+  if (!fbd_theme_cache_save (cache_path, key, layers, &err))
+    g_warning ("Failed to write theme cache %s: %s", cache_path, err->message);
+}
+
+
+static void on_theme_file_changed (FbdThemeExpander  *self,
+                                   GFile             *file,
+                                   GFile             *other_file,
+                                   GFileMonitorEvent  event,
+                                   GFileMonitor      *monitor);
 
-  fbd_feedback_theme_update (merged, theme);
+static void on_theme_dir_changed (FbdThemeExpander  *self,
+                                  GFile             *file,
+                                  GFile             *other_file,
+                                  GFileMonitorEvent  event,
+                                  GFileMonitor      *monitor);
+
+static void
+watch_layers (FbdThemeExpander *self)
+{
+  g_ptr_array_set_size (self->monitors, 0);
+
+  if (!self->watch || self->loading || self->layers == NULL)
+    return;
+
+  for (guint i = 0; i < self->layers->len; i++) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (self->layers, i);
+    g_autoptr (GFile) file = g_file_new_for_path (layer->path);
+    g_autoptr (GError) err = NULL;
+    GFileMonitor *monitor;
+
+    monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &err);
+    if (monitor == NULL) {
+      g_warning ("Failed to watch theme file %s: %s", layer->path, err->message);
+      continue;
+    }
+
+    g_object_set_data (G_OBJECT (monitor), "fbd-layer", layer);
+    g_signal_connect_object (monitor, "changed",
+                             G_CALLBACK (on_theme_file_changed),
+                             self,
+                             G_CONNECT_SWAPPED);
+    g_ptr_array_add (self->monitors, monitor);
+  }
 }
 
 
+static void
+set_layers (FbdThemeExpander *self, GPtrArray *layers)
+{
+  g_clear_handle_id (&self->reload_id, g_source_remove);
+  g_clear_pointer (&self->layers, g_ptr_array_unref);
+  self->layers = g_ptr_array_ref (layers);
+
+  watch_layers (self);
+}
+
+
+static void
+emit_theme_changed (FbdThemeExpander *self, FbdFeedbackTheme *theme)
+{
+  g_signal_emit (self, signals[SIGNAL_THEME_CHANGED], 0, theme);
+}
+
+
+static void
+reload_theme_files (FbdThemeExpander *self)
+{
+  g_autoptr (FbdFeedbackTheme) merged = NULL;
+  g_autoptr (GError) err = NULL;
+
+  merged = fbd_theme_expander_load_theme_files (self, &err);
+  if (merged == NULL) {
+    g_warning ("Failed to reload theme: %s", err->message);
+    return;
+  }
+
+  emit_theme_changed (self, merged);
+}
+
+/*
+ * Parse the layers that changed (or weren't parsed at all since they
+ * came from the cache) and merge them with the others. If a change
+ * affects how parents resolve everything is loaded again.
+ */
+static void
+reload_layers (FbdThemeExpander *self)
+{
+  g_autoptr (FbdFeedbackTheme) merged = NULL;
+
+  for (guint i = 0; i < self->layers->len; i++) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (self->layers, i);
+    g_autoptr (FbdFeedbackTheme) theme = NULL;
+    g_autoptr (JsonNode) node = NULL;
+    g_autoptr (GError) err = NULL;
+    const char *parent_name = NULL;
+
+    if (layer->theme)
+      continue;
+
+    if (!g_file_test (layer->path, G_FILE_TEST_EXISTS)) {
+      g_debug ("Theme file %s is gone", layer->path);
+      reload_theme_files (self);
+      return;
+    }
+
+    node = fbd_theme_parser_load_file (layer->path, FBD_THEME_PARSER_FLAG_NONE, &err);
+    if (node == NULL) {
+      g_warning ("Failed to reload %s: %s", layer->path, err->message);
+      return;
+    }
+
+    theme = fbd_feedback_theme_new_from_node (node);
+    if (!check_layer (theme, layer->path, &err)) {
+      g_warning ("Failed to reload %s: %s", layer->path, err->message);
+      return;
+    }
+
+    if (i + 1 < self->layers->len)
+      parent_name = ((FbdThemeCacheLayer *)g_ptr_array_index (self->layers, i + 1))->name;
+
+    if (g_strcmp0 (fbd_feedback_theme_get_parent_name (theme), parent_name)) {
+      g_debug ("Parent of %s changed", layer->path);
+      reload_theme_files (self);
+      return;
+    }
+
+    layer->node = g_steal_pointer (&node);
+    layer->theme = g_steal_pointer (&theme);
+  }
+
+  g_debug ("Rebuilding theme from %u layers", self->layers->len);
+  merged = merge_layers (self, self->layers);
+
+  if (self->cache_dir)
+    save_cached_theme (self, self->layers);
+
+  emit_theme_changed (self, merged);
+}
+
+
+static gboolean
+on_reload_timeout (gpointer user_data)
+{
+  FbdThemeExpander *self = FBD_THEME_EXPANDER (user_data);
+
+  self->reload_id = 0;
+  if (self->reload_all) {
+    self->reload_all = FALSE;
+    reload_theme_files (self);
+  } else {
+    reload_layers (self);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_theme_file_changed (FbdThemeExpander  *self,
+                       GFile             *file,
+                       GFile             *other_file,
+                       GFileMonitorEvent  event,
+                       GFileMonitor      *monitor)
+{
+  FbdThemeCacheLayer *layer;
+
+  g_assert (FBD_IS_THEME_EXPANDER (self));
+
+  switch (event) {
+  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_DELETED:
+    break;
+  default:
+    return;
+  }
+
+  layer = g_object_get_data (G_OBJECT (monitor), "fbd-layer");
+  g_debug ("Theme file %s changed", layer->path);
+
+  /* Parsed again on reload */
+  g_clear_object (&layer->theme);
+  g_clear_pointer (&layer->node, json_node_unref);
+
+  g_clear_handle_id (&self->reload_id, g_source_remove);
+  self->reload_id = g_timeout_add (RELOAD_DELAY_MS, on_reload_timeout, self);
+}
+
+
+static void
+on_theme_dir_changed (FbdThemeExpander  *self,
+                      GFile             *file,
+                      GFile             *other_file,
+                      GFileMonitorEvent  event,
+                      GFileMonitor      *monitor)
+{
+  g_autofree char *path = g_file_get_path (file);
+  g_autofree char *basename = g_file_get_basename (file);
+  g_autofree char *theme_name = NULL;
+  const char *indexed;
+
+  g_assert (FBD_IS_THEME_EXPANDER (self));
+
+  if (event != G_FILE_MONITOR_EVENT_CREATED && event != G_FILE_MONITOR_EVENT_DELETED)
+    return;
+
+  if (basename == NULL || !g_str_has_suffix (basename, ".json"))
+    return;
+
+  theme_name = g_strndup (basename, strlen (basename) - strlen (".json"));
+  indexed = g_hash_table_lookup (self->user_themes, theme_name);
+  if (g_strcmp0 (indexed, path))
+    indexed = g_hash_table_lookup (self->system_themes, theme_name);
+
+  /* Replacing a known theme file is handled by the layer's monitor */
+  if (event == G_FILE_MONITOR_EVENT_CREATED && g_strcmp0 (indexed, path) == 0)
+    return;
+
+  g_debug ("Theme %s %s", path, event == G_FILE_MONITOR_EVENT_CREATED ? "appeared" : "vanished");
+  /* Rebuilding the index drops the monitors, so not done from here */
+  self->index_stale = TRUE;
+  self->reload_all = TRUE;
+  g_clear_handle_id (&self->reload_id, g_source_remove);
+  self->reload_id = g_timeout_add (RELOAD_DELAY_MS, on_reload_timeout, self);
+}
+
 /**
  * fbd_theme_expander_load_theme_files:
  * @self: The theme expander
  * @err: return location for error or %NULL
  *
  * Parses a theme recursively taking the theme's `parent-name` relations into
- * account as well as the expander's list of `compatibles`.
+ * account as well as the expander's list of `compatibles`. If
+ * `cache-dir` is set an up to date compiled theme
+ * is used instead and written out otherwise.
  *
  * Returns: (transfer full)(allow-none): The parsed theme or %NULL on error
  */
 FbdFeedbackTheme *
 fbd_theme_expander_load_theme_files (FbdThemeExpander *self, GError **err)
 {
-  g_autoqueue (FbdFeedbackTheme) queue = g_queue_new ();
-  g_autoptr (FbdFeedbackTheme) merged = fbd_feedback_theme_new ("merged-theme");
-  g_autoptr (FbdFeedbackTheme) theme = NULL;
-  g_autofree char *theme_file = NULL;
+  g_autoptr (GPtrArray) layers = NULL;
+  g_autofree char *key = NULL;
+  FbdFeedbackTheme *merged, *theme;
   guint len = 0;
 
   g_return_val_if_fail (FBD_IS_THEME_EXPANDER (self), NULL);
   g_return_val_if_fail (err == NULL || *err == NULL, NULL);
 
-  if (self->theme_file) {
-    theme_file = g_strdup (self->theme_file);
-  } else {
-    theme_file = fbd_theme_expander_find_theme_path (self, self->theme_name);
+  /* Resolve the theme chain from scratch */
+  self->device_theme_loaded = FALSE;
+  if (!self->watch)
+    invalidate_theme_index (self);
+  if (!self->theme_file_set) {
+    g_autofree char *theme_file = fbd_theme_expander_find_theme_path (self, self->theme_name);
+
     if (g_strcmp0 (self->theme_file, theme_file)) {
+      g_free (self->theme_file);
       self->theme_file = g_steal_pointer (&theme_file);
       g_object_notify_by_pspec (G_OBJECT (self), props[PROP_THEME_FILE]);
     }
   }
 
+  layers = g_ptr_array_new_with_free_func ((GDestroyNotify)fbd_theme_cache_layer_free);
+
+  if (self->cache_dir || self->system_cache_dir) {
+    key = get_cache_key (self);
+    merged = NULL;
+    if (self->cache_dir)
+      merged = load_cached_theme (self, self->cache_dir, key, layers);
+    if (merged == NULL && self->system_cache_dir)
+      merged = load_cached_theme (self, self->system_cache_dir, key, layers);
+    if (merged) {
+      set_layers (self, layers);
+      fbd_feedback_theme_set_name (merged, self->theme_name);
+      fbd_feedback_theme_compile (merged);
+      return merged;
+    }
+  }
+
   g_info ("Loading theme file at '%s'", self->theme_file);
-  theme = fbd_feedback_theme_new_from_file (self->theme_file, err);
+  theme = load_layer (NULL, self->theme_file, layers, err);
   if (theme == NULL)
       return NULL;
 
   /* Build a list of themes */
   while (TRUE) {
     g_autofree char *parent_path = NULL;
-    const char *parent_name, *theme_name;
+    const char *parent_name;
 
     if (len > MAX_THEME_DEPTH) {
       g_set_error (err, fbd_error_quark(), FBD_ERROR_THEME_EXPAND, "Theme depth exceeded");
       return NULL;
     }
 
-    theme_name = fbd_feedback_theme_get_name (theme);
-    if (theme_name == NULL || theme_name[0] == '\0') {
-      g_set_error (err, fbd_error_quark(), FBD_ERROR_THEME_EXPAND,
-                   "Theme name of %s can't be empty", self->theme_file);
+    if (!check_layer (theme, self->theme_file, err))
       return NULL;
-    }
 
     parent_name = fbd_feedback_theme_get_parent_name (theme);
-
-    if (parent_name &&
-        g_str_equal (fbd_feedback_theme_get_name (theme), DEFAULT_THEME_NAME)) {
-      g_set_error (err, fbd_error_quark(), FBD_ERROR_THEME_EXPAND,
-                   "Default theme can't specify a parent");
-      return NULL;
-    }
-
-    parent_name = fbd_feedback_theme_get_parent_name (theme);
-
-    g_queue_push_head (queue, g_steal_pointer (&theme));
-
     if (parent_name == NULL)
       break;
 
     parent_path = fbd_theme_expander_find_theme_path (self, parent_name);
-    theme = fbd_feedback_theme_new_from_file (parent_path, err);
+    theme = load_layer (parent_name, parent_path, layers, err);
     if (theme == NULL)
       return NULL;
 
     len++;
   }
 
-  /* Merge themes bottom to top */
-  g_queue_foreach (queue, update_theme, merged);
+  merged = merge_layers (self, layers);
 
-  fbd_feedback_theme_set_name (merged, self->theme_name);
-  return g_steal_pointer (&merged);
+  if (self->cache_dir)
+    save_cached_theme (self, layers);
+
+  set_layers (self, layers);
+  return merged;
+}
+
+
+
+static void
+load_theme_files_thread (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+  FbdThemeExpander *self = FBD_THEME_EXPANDER (source_object);
+  FbdFeedbackTheme *theme;
+  GError *err = NULL;
+
+  theme = fbd_theme_expander_load_theme_files (self, &err);
+  if (theme == NULL) {
+    g_task_return_error (task, err);
+    return;
+  }
+
+  g_task_return_pointer (task, theme, g_object_unref);
+}
+
+/**
+ * fbd_theme_expander_load_theme_files_async:
+ * @self: The theme expander
+ * @cancellable: (nullable): A cancellable
+ * @callback: The callback to invoke when the theme is loaded
+ * @user_data: The data passed to @callback
+ *
+ * Like fbd_theme_expander_load_theme_files() but does the work in a
+ * worker thread. File monitors are set up when the load is finished
+ * via fbd_theme_expander_load_theme_files_finish(). The expander must
+ * not be used in the meantime. Cancelling only drops the result as
+ * loading isn't interrupted.
+ */
+void
+fbd_theme_expander_load_theme_files_async (FbdThemeExpander    *self,
+                                           GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (FBD_IS_THEME_EXPANDER (self));
+  g_return_if_fail (!self->loading);
+
+  /* Drop everything the worker must not touch */
+  g_clear_handle_id (&self->reload_id, g_source_remove);
+  g_ptr_array_set_size (self->monitors, 0);
+  g_ptr_array_set_size (self->dir_monitors, 0);
+  self->loading = TRUE;
+  /* Notifications get emitted on the main thread when thawing */
+  g_object_freeze_notify (G_OBJECT (self));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fbd_theme_expander_load_theme_files_async);
+  g_task_set_check_cancellable (task, TRUE);
+  g_task_run_in_thread (task, load_theme_files_thread);
+}
+
+/**
+ * fbd_theme_expander_load_theme_files_finish:
+ * @self: The theme expander
+ * @res: The result
+ * @err: return location for error or %NULL
+ *
+ * Finishes fbd_theme_expander_load_theme_files_async(). Must be
+ * called for every load.
+ *
+ * Returns: (transfer full)(allow-none): The parsed theme or %NULL on error
+ */
+FbdFeedbackTheme *
+fbd_theme_expander_load_theme_files_finish (FbdThemeExpander  *self,
+                                            GAsyncResult      *res,
+                                            GError           **err)
+{
+  g_return_val_if_fail (FBD_IS_THEME_EXPANDER (self), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+  g_return_val_if_fail (self->loading, NULL);
+
+  self->loading = FALSE;
+  if (self->watch) {
+    watch_layers (self);
+    if (self->system_themes && self->dir_monitors->len == 0)
+      watch_theme_dirs (self);
+  }
+  g_object_thaw_notify (G_OBJECT (self));
+
+  return g_task_propagate_pointer (G_TASK (res), err);
 }
 
 const char *
@@ -444,3 +1102,128 @@ fbd_theme_expander_get_compatibles (FbdThemeExpander *self)
 
   return (const char * const*)self->compatibles;
 }
+
+/**
+ * fbd_theme_expander_set_cache_dir:
+ * @self: The theme expander
+ * @cache_dir:(nullable): The directory for the compiled theme
+ *
+ * Sets the directory to cache the compiled theme in. %NULL disables
+ * the cache.
+ */
+void
+fbd_theme_expander_set_cache_dir (FbdThemeExpander *self, const char *cache_dir)
+{
+  g_return_if_fail (FBD_IS_THEME_EXPANDER (self));
+
+  if (g_strcmp0 (self->cache_dir, cache_dir) == 0)
+    return;
+
+  g_free (self->cache_dir);
+  self->cache_dir = g_strdup (cache_dir);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_CACHE_DIR]);
+}
+
+/**
+ * fbd_theme_expander_set_watch:
+ * @self: The theme expander
+ * @watch: Whether to watch the theme files
+ *
+ * Sets whether the theme files of the last load should be monitored.
+ */
+void
+fbd_theme_expander_set_watch (FbdThemeExpander *self, gboolean watch)
+{
+  g_return_if_fail (FBD_IS_THEME_EXPANDER (self));
+
+  watch = !!watch;
+  if (self->watch == watch)
+    return;
+
+  self->watch = watch;
+  watch_layers (self);
+  /* Rebuilt with or without directory monitors on the next load */
+  invalidate_theme_index (self);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_WATCH]);
+}
+
+/**
+ * fbd_theme_expander_set_system_cache_dir:
+ * @self: The theme expander
+ * @system_cache_dir:(nullable): The directory with precompiled themes
+ *
+ * Sets the directory to look up precompiled themes in. %NULL disables
+ * the lookup.
+ */
+void
+fbd_theme_expander_set_system_cache_dir (FbdThemeExpander *self, const char *system_cache_dir)
+{
+  g_return_if_fail (FBD_IS_THEME_EXPANDER (self));
+
+  if (g_strcmp0 (self->system_cache_dir, system_cache_dir) == 0)
+    return;
+
+  g_free (self->system_cache_dir);
+  self->system_cache_dir = g_strdup (system_cache_dir);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_SYSTEM_CACHE_DIR]);
+}
+
+/**
+ * fbd_theme_expander_get_layers:
+ * @self: The theme expander
+ *
+ * Gets the theme files of the last load starting with the theme
+ * itself followed by its parents.
+ *
+ * Returns:(transfer none)(nullable)(element-type FbdThemeCacheLayer): The layers
+ */
+GPtrArray *
+fbd_theme_expander_get_layers (FbdThemeExpander *self)
+{
+  g_return_val_if_fail (FBD_IS_THEME_EXPANDER (self), NULL);
+
+  return self->layers;
+}
+
+/**
+ * fbd_theme_expander_save_cache:
+ * @self: The theme expander
+ * @cache_dir: The directory to store the compiled theme in
+ * @err: return location for error or %NULL
+ *
+ * Stores the compiled theme of the last load in @cache_dir so it can
+ * be used via #FbdThemeExpander:cache-dir or
+ * #FbdThemeExpander:system-cache-dir. The theme must have been loaded
+ * from the theme files rather than a cache.
+ *
+ * Returns: `TRUE` on success
+ */
+gboolean
+fbd_theme_expander_save_cache (FbdThemeExpander *self, const char *cache_dir, GError **err)
+{
+  g_autofree char *cache_path = NULL;
+  g_autofree char *key = NULL;
+
+  g_return_val_if_fail (FBD_IS_THEME_EXPANDER (self), FALSE);
+  g_return_val_if_fail (cache_dir, FALSE);
+
+  if (self->layers == NULL || self->layers->len == 0) {
+    g_set_error (err, fbd_error_quark (), FBD_ERROR_THEME_EXPAND, "No theme loaded");
+    return FALSE;
+  }
+
+  for (guint i = 0; i < self->layers->len; i++) {
+    FbdThemeCacheLayer *layer = g_ptr_array_index (self->layers, i);
+
+    if (layer->node == NULL) {
+      g_set_error (err, fbd_error_quark (), FBD_ERROR_THEME_EXPAND,
+                   "Theme file %s wasn't parsed", layer->path);
+      return FALSE;
+    }
+  }
+
+  key = get_cache_key (self);
+  cache_path = fbd_theme_cache_get_path (cache_dir, key);
+
+  return fbd_theme_cache_save (cache_path, key, self->layers, err);
+}
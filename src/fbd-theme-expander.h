@@ -10,7 +10,7 @@
 
 #include "fbd-feedback-theme.h"
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -24,8 +24,25 @@ FbdThemeExpander   *fbd_theme_expander_new (const char * const *compatibles,
                                             const char *theme_file);
 FbdFeedbackTheme   *fbd_theme_expander_load_theme_files (FbdThemeExpander  *self,
                                                          GError           **err);
+void                fbd_theme_expander_load_theme_files_async (FbdThemeExpander    *self,
+                                                               GCancellable        *cancellable,
+                                                               GAsyncReadyCallback  callback,
+                                                               gpointer             user_data);
+FbdFeedbackTheme   *fbd_theme_expander_load_theme_files_finish (FbdThemeExpander  *self,
+                                                                GAsyncResult      *res,
+                                                                GError           **err);
 const char         *fbd_theme_expander_get_theme_name (FbdThemeExpander *self);
 const char         *fbd_theme_expander_get_theme_file (FbdThemeExpander *self);
 const char * const *fbd_theme_expander_get_compatibles (FbdThemeExpander *self);
+void                fbd_theme_expander_set_cache_dir (FbdThemeExpander *self,
+                                                      const char       *cache_dir);
+void                fbd_theme_expander_set_system_cache_dir (FbdThemeExpander *self,
+                                                             const char       *system_cache_dir);
+void                fbd_theme_expander_set_watch (FbdThemeExpander *self,
+                                                  gboolean          watch);
+GPtrArray          *fbd_theme_expander_get_layers (FbdThemeExpander *self);
+gboolean            fbd_theme_expander_save_cache (FbdThemeExpander  *self,
+                                                   const char        *cache_dir,
+                                                   GError           **err);
 
 G_END_DECLS
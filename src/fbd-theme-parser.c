@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-theme-parser"
+
+#include "fbd.h"
+#include "fbd-feedback-group.h"
+#include "fbd-feedback-profile.h"
+#include "fbd-feedback-theme.h"
+#include "fbd-theme-parser.h"
+
+/**
+ * SECTION:theme-parser
+ * @short_description: Theme file parser
+ * @Title: FbdThemeParser
+ *
+ * Parses theme files into #JsonNode trees. Feedbacks are only built
+ * from those on lookup (see #FbdFeedbackProfile).
+ *
+ * When validating, the parser records where each JSON object starts
+ * while parsing. The theme, its profiles and their feedbacks are then
+ * checked against the properties of the classes they will be built
+ * from. Errors carry the line and column of the offending object. No
+ * feedback objects are built for this.
+ */
+
+typedef struct _FbdThemePos {
+  guint line;
+  guint column;
+} FbdThemePos;
+
+typedef struct _FbdThemeParseCtx {
+  const char *name;
+  /* FbdThemePos of the objects currently being parsed */
+  GArray     *open;
+  /* Key: JsonObject, value: FbdThemePos */
+  GHashTable *positions;
+} FbdThemeParseCtx;
+
+
+static void
+on_object_start (JsonParser *parser, FbdThemeParseCtx *ctx)
+{
+  FbdThemePos pos = {
+    .line = json_parser_get_current_line (parser),
+    .column = json_parser_get_current_pos (parser),
+  };
+
+  g_array_append_val (ctx->open, pos);
+}
+
+
+static void
+on_object_end (JsonParser *parser, JsonObject *object, FbdThemeParseCtx *ctx)
+{
+  FbdThemePos *pos;
+
+  g_return_if_fail (ctx->open->len);
+
+  pos = g_new (FbdThemePos, 1);
+  *pos = g_array_index (ctx->open, FbdThemePos, ctx->open->len - 1);
+  g_array_set_size (ctx->open, ctx->open->len - 1);
+
+  g_hash_table_insert (ctx->positions, object, pos);
+}
+
+
+G_GNUC_PRINTF (4, 5)
+static gboolean
+set_error_at (FbdThemeParseCtx *ctx, JsonObject *object, GError **err, const char *fmt, ...)
+{
+  g_autofree char *msg = NULL;
+  FbdThemePos *pos = NULL;
+  va_list args;
+
+  va_start (args, fmt);
+  msg = g_strdup_vprintf (fmt, args);
+  va_end (args);
+
+  if (object)
+    pos = g_hash_table_lookup (ctx->positions, object);
+
+  if (pos) {
+    g_set_error (err, fbd_error_quark (), FBD_ERROR_THEME_INVALID,
+                 "%s:%u:%u: %s", ctx->name, pos->line, pos->column, msg);
+  } else {
+    g_set_error (err, fbd_error_quark (), FBD_ERROR_THEME_INVALID,
+                 "%s: %s", ctx->name, msg);
+  }
+
+  return FALSE;
+}
+
+
+static char *
+check_range (GParamSpec *pspec, double value)
+{
+  double min, max;
+
+  if (G_IS_PARAM_SPEC_INT (pspec)) {
+    min = G_PARAM_SPEC_INT (pspec)->minimum;
+    max = G_PARAM_SPEC_INT (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_UINT (pspec)) {
+    min = G_PARAM_SPEC_UINT (pspec)->minimum;
+    max = G_PARAM_SPEC_UINT (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_INT64 (pspec)) {
+    min = G_PARAM_SPEC_INT64 (pspec)->minimum;
+    max = G_PARAM_SPEC_INT64 (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_UINT64 (pspec)) {
+    min = G_PARAM_SPEC_UINT64 (pspec)->minimum;
+    max = G_PARAM_SPEC_UINT64 (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_LONG (pspec)) {
+    min = G_PARAM_SPEC_LONG (pspec)->minimum;
+    max = G_PARAM_SPEC_LONG (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_ULONG (pspec)) {
+    min = G_PARAM_SPEC_ULONG (pspec)->minimum;
+    max = G_PARAM_SPEC_ULONG (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_FLOAT (pspec)) {
+    min = G_PARAM_SPEC_FLOAT (pspec)->minimum;
+    max = G_PARAM_SPEC_FLOAT (pspec)->maximum;
+  } else if (G_IS_PARAM_SPEC_DOUBLE (pspec)) {
+    min = G_PARAM_SPEC_DOUBLE (pspec)->minimum;
+    max = G_PARAM_SPEC_DOUBLE (pspec)->maximum;
+  } else {
+    return NULL;
+  }
+
+  if (value < min || value > max)
+    return g_strdup_printf ("%g is not within [%g, %g]", value, min, max);
+
+  return NULL;
+}
+
+/*
+ * Check a JSON value against what json-glib (or the classes' own
+ * deserializers) will accept for the property.
+ */
+static char *
+check_value (JsonNode *node, GParamSpec *pspec)
+{
+  GType type = G_PARAM_SPEC_VALUE_TYPE (pspec);
+  GType value_type = G_TYPE_INVALID;
+
+  if (JSON_NODE_HOLDS_VALUE (node))
+    value_type = json_node_get_value_type (node);
+
+  switch (G_TYPE_FUNDAMENTAL (type)) {
+  case G_TYPE_STRING:
+    if (value_type != G_TYPE_STRING && !JSON_NODE_HOLDS_NULL (node))
+      return g_strdup ("expected a string");
+    break;
+  case G_TYPE_BOOLEAN:
+    if (value_type != G_TYPE_BOOLEAN)
+      return g_strdup ("expected a boolean");
+    break;
+  case G_TYPE_INT:
+  case G_TYPE_UINT:
+  case G_TYPE_INT64:
+  case G_TYPE_UINT64:
+  case G_TYPE_LONG:
+  case G_TYPE_ULONG:
+    if (value_type != G_TYPE_INT64)
+      return g_strdup ("expected an integer");
+    return check_range (pspec, json_node_get_int (node));
+  case G_TYPE_FLOAT:
+  case G_TYPE_DOUBLE:
+    if (value_type != G_TYPE_INT64 && value_type != G_TYPE_DOUBLE)
+      return g_strdup ("expected a number");
+    return check_range (pspec, json_node_get_double (node));
+  case G_TYPE_ENUM: {
+    g_autoptr (GEnumClass) enum_class = g_type_class_ref (type);
+
+    if (value_type == G_TYPE_STRING) {
+      const char *nick = json_node_get_string (node);
+
+      if (g_enum_get_value_by_nick (enum_class, nick) == NULL &&
+          g_enum_get_value_by_name (enum_class, nick) == NULL)
+        return g_strdup_printf ("unknown value '%s'", nick);
+    } else if (value_type == G_TYPE_INT64) {
+      if (g_enum_get_value (enum_class, json_node_get_int (node)) == NULL)
+        return g_strdup_printf ("unknown value %" G_GINT64_FORMAT, json_node_get_int (node));
+    } else {
+      return g_strdup ("expected a string");
+    }
+    break;
+  }
+  case G_TYPE_BOXED:
+    if (!JSON_NODE_HOLDS_ARRAY (node) && !JSON_NODE_HOLDS_OBJECT (node) &&
+        !JSON_NODE_HOLDS_NULL (node))
+      return g_strdup ("expected an array or object");
+    break;
+  default:
+    break;
+  }
+
+  return NULL;
+}
+
+
+static gboolean
+validate_members (FbdThemeParseCtx  *ctx,
+                  JsonObject        *object,
+                  GType              type,
+                  const char        *what,
+                  const char        *skip,
+                  GError           **err)
+{
+  g_autoptr (GList) members = json_object_get_members (object);
+  GObjectClass *klass = g_type_class_ref (type);
+  gboolean ret = TRUE;
+
+  for (GList *l = members; l && ret; l = l->next) {
+    const char *member = l->data;
+    g_autofree char *problem = NULL;
+    GParamSpec *pspec;
+
+    if (g_strcmp0 (member, skip) == 0)
+      continue;
+
+    pspec = g_object_class_find_property (klass, member);
+    if (pspec == NULL) {
+      ret = set_error_at (ctx, object, err, "Unknown property '%s' for %s", member, what);
+    } else if (!(pspec->flags & G_PARAM_WRITABLE)) {
+      ret = set_error_at (ctx, object, err, "Property '%s' of %s can't be set", member, what);
+    } else {
+      problem = check_value (json_object_get_member (object, member), pspec);
+      if (problem)
+        ret = set_error_at (ctx, object, err, "Invalid '%s' for %s: %s", member, what, problem);
+    }
+  }
+
+  g_type_class_unref (klass);
+  return ret;
+}
+
+
+static gboolean
+validate_group (FbdThemeParseCtx *ctx, JsonObject *group, GError **err)
+{
+  JsonArray *feedbacks;
+
+  if (json_object_has_member (group, "delay"))
+    return set_error_at (ctx, group, err, "Delays of a group must be set on its feedbacks");
+
+  if (!json_object_has_member (group, "feedbacks"))
+    return set_error_at (ctx, group, err, "Group has no feedbacks");
+
+  feedbacks = json_object_get_array_member (group, "feedbacks");
+  if (feedbacks == NULL)
+    return set_error_at (ctx, group, err, "Feedbacks of a group must be an array");
+
+  for (guint i = 0; i < json_array_get_length (feedbacks); i++) {
+    JsonNode *node = json_array_get_element (feedbacks, i);
+    JsonObject *feedback;
+    const char *type_name;
+    GType type;
+
+    if (!JSON_NODE_HOLDS_OBJECT (node))
+      return set_error_at (ctx, group, err, "Feedback %u of group must be an object", i);
+
+    feedback = json_node_get_object (node);
+    type_name = json_object_get_string_member_with_default (feedback, "type", NULL);
+    if (type_name == NULL)
+      return set_error_at (ctx, feedback, err, "Feedback has no type");
+
+    type = fbd_feedback_profile_get_feedback_type (type_name);
+    if (type == G_TYPE_INVALID || G_TYPE_IS_ABSTRACT (type))
+      return set_error_at (ctx, feedback, err, "Unknown feedback type '%s'", type_name);
+
+    if (type == FBD_TYPE_FEEDBACK_GROUP)
+      return set_error_at (ctx, feedback, err, "Groups can't be nested");
+
+    if (!validate_members (ctx, feedback, type, type_name, "type", err))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+validate_feedback (FbdThemeParseCtx *ctx, JsonObject *feedback, GHashTable *events, GError **err)
+{
+  const char *type_name, *event_name;
+  GType type;
+
+  type_name = json_object_get_string_member_with_default (feedback, "type", NULL);
+  if (type_name == NULL)
+    return set_error_at (ctx, feedback, err, "Feedback has no type");
+
+  type = fbd_feedback_profile_get_feedback_type (type_name);
+  if (type == G_TYPE_INVALID || G_TYPE_IS_ABSTRACT (type))
+    return set_error_at (ctx, feedback, err, "Unknown feedback type '%s'", type_name);
+
+  event_name = json_object_get_string_member_with_default (feedback, "event-name", NULL);
+  if (event_name == NULL || event_name[0] == '\0')
+    return set_error_at (ctx, feedback, err, "Feedback has no event name");
+
+  if (!g_hash_table_add (events, (gpointer)event_name))
+    return set_error_at (ctx, feedback, err, "Duplicate feedback for '%s'", event_name);
+
+  if (type == FBD_TYPE_FEEDBACK_GROUP && !validate_group (ctx, feedback, err))
+    return FALSE;
+
+  return validate_members (ctx, feedback, type, type_name, "type", err);
+}
+
+
+static gboolean
+validate_profile (FbdThemeParseCtx *ctx, JsonObject *profile, GHashTable *profiles, GError **err)
+{
+  g_autoptr (GHashTable) events = g_hash_table_new (g_str_hash, g_str_equal);
+  const char *name;
+  JsonArray *feedbacks;
+
+  if (!validate_members (ctx, profile, FBD_TYPE_FEEDBACK_PROFILE, "profile", NULL, err))
+    return FALSE;
+
+  name = json_object_get_string_member_with_default (profile, "name", NULL);
+  if (name == NULL)
+    return set_error_at (ctx, profile, err, "Profile has no name");
+
+  if (fbd_feedback_profile_level (name) == FBD_FEEDBACK_PROFILE_LEVEL_UNKNOWN)
+    return set_error_at (ctx, profile, err, "Unknown profile '%s'", name);
+
+  if (!g_hash_table_add (profiles, (gpointer)name))
+    return set_error_at (ctx, profile, err, "Duplicate profile '%s'", name);
+
+  if (!json_object_has_member (profile, "feedbacks"))
+    return TRUE;
+
+  feedbacks = json_object_get_array_member (profile, "feedbacks");
+  if (feedbacks == NULL)
+    return set_error_at (ctx, profile, err, "Feedbacks of profile '%s' must be an array", name);
+
+  for (guint i = 0; i < json_array_get_length (feedbacks); i++) {
+    JsonNode *node = json_array_get_element (feedbacks, i);
+
+    if (!JSON_NODE_HOLDS_OBJECT (node))
+      return set_error_at (ctx, profile, err, "Feedback %u of profile '%s' must be an object",
+                           i, name);
+
+    if (!validate_feedback (ctx, json_node_get_object (node), events, err))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+validate_theme (FbdThemeParseCtx *ctx, JsonNode *root, GError **err)
+{
+  g_autoptr (GHashTable) profiles = g_hash_table_new (g_str_hash, g_str_equal);
+  JsonObject *theme;
+  JsonArray *array;
+  const char *name;
+
+  if (!JSON_NODE_HOLDS_OBJECT (root))
+    return set_error_at (ctx, NULL, err, "Theme must be an object");
+
+  theme = json_node_get_object (root);
+  if (!validate_members (ctx, theme, FBD_TYPE_FEEDBACK_THEME, "theme", NULL, err))
+    return FALSE;
+
+  name = json_object_get_string_member_with_default (theme, "name", NULL);
+  if (name == NULL || name[0] == '\0')
+    return set_error_at (ctx, theme, err, "Theme has no name");
+
+  if (!json_object_has_member (theme, "profiles"))
+    return TRUE;
+
+  array = json_object_get_array_member (theme, "profiles");
+  if (array == NULL)
+    return set_error_at (ctx, theme, err, "Profiles must be an array");
+
+  for (guint i = 0; i < json_array_get_length (array); i++) {
+    JsonNode *node = json_array_get_element (array, i);
+
+    if (!JSON_NODE_HOLDS_OBJECT (node))
+      return set_error_at (ctx, theme, err, "Profile %u must be an object", i);
+
+    if (!validate_profile (ctx, json_node_get_object (node), profiles, err))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static JsonNode *
+parse (const char *path, const char *data, gssize length, FbdThemeParserFlags flags, GError **err)
+{
+  g_autoptr (JsonParser) parser = json_parser_new ();
+  g_autoptr (GHashTable) positions = NULL;
+  g_autoptr (GArray) open = NULL;
+  FbdThemeParseCtx ctx = { .name = path ?: "<data>" };
+  gboolean validate = !!(flags & FBD_THEME_PARSER_FLAG_VALIDATE);
+  JsonNode *root;
+  gboolean success;
+
+  if (validate) {
+    open = g_array_new (FALSE, FALSE, sizeof (FbdThemePos));
+    positions = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    ctx.open = open;
+    ctx.positions = positions;
+
+    g_signal_connect (parser, "object-start", G_CALLBACK (on_object_start), &ctx);
+    g_signal_connect (parser, "object-end", G_CALLBACK (on_object_end), &ctx);
+  }
+
+  if (path)
+    success = json_parser_load_from_file (parser, path, err);
+  else
+    success = json_parser_load_from_data (parser, data, length, err);
+  if (!success)
+    return NULL;
+
+  root = json_parser_get_root (parser);
+  if (root == NULL) {
+    /* Empty documents don't set an error */
+    g_set_error (err, fbd_error_quark (), FBD_ERROR_THEME_INVALID, "%s: Theme is empty", ctx.name);
+    return NULL;
+  }
+
+  if (validate && !validate_theme (&ctx, root, err))
+    return NULL;
+
+  return json_node_ref (root);
+}
+
+/**
+ * fbd_theme_parser_load_file:
+ * @path: The theme file
+ * @flags: Flags affecting the parsing
+ * @err: Return location for an error
+ *
+ * Parses a theme file.
+ *
+ * Returns:(transfer full)(nullable): The theme's root node
+ */
+JsonNode *
+fbd_theme_parser_load_file (const char *path, FbdThemeParserFlags flags, GError **err)
+{
+  g_return_val_if_fail (path, NULL);
+  g_return_val_if_fail (err == NULL || *err == NULL, NULL);
+
+  return parse (path, NULL, -1, flags, err);
+}
+
+/**
+ * fbd_theme_parser_load_data:
+ * @data: The theme's JSON
+ * @length: The length of @data or -1 if it's NUL terminated
+ * @flags: Flags affecting the parsing
+ * @err: Return location for an error
+ *
+ * Like fbd_theme_parser_load_file() but parses a theme from memory.
+ *
+ * Returns:(transfer full)(nullable): The theme's root node
+ */
+JsonNode *
+fbd_theme_parser_load_data (const char *data, gssize length, FbdThemeParserFlags flags, GError **err)
+{
+  g_return_val_if_fail (data, NULL);
+  g_return_val_if_fail (err == NULL || *err == NULL, NULL);
+
+  return parse (NULL, data, length, flags, err);
+}
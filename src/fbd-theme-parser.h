@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FbdThemeParserFlags:
+ * @FBD_THEME_PARSER_FLAG_NONE: Only check the JSON syntax
+ * @FBD_THEME_PARSER_FLAG_VALIDATE: Also check the theme, profiles and
+ *   feedbacks against their properties
+ *
+ * Flags for parsing theme files.
+ */
+typedef enum {
+  FBD_THEME_PARSER_FLAG_NONE     = 0,
+  FBD_THEME_PARSER_FLAG_VALIDATE = (1 << 0),
+} FbdThemeParserFlags;
+
+JsonNode *fbd_theme_parser_load_file (const char           *path,
+                                      FbdThemeParserFlags   flags,
+                                      GError              **err);
+JsonNode *fbd_theme_parser_load_data (const char           *data,
+                                      gssize                length,
+                                      FbdThemeParserFlags   flags,
+                                      GError              **err);
+
+G_END_DECLS
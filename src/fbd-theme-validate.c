@@ -7,6 +7,7 @@
 #define G_LOG_DOMAIN "fbd"
 
 #include "fbd-theme-expander.h"
+#include "fbd-theme-parser.h"
 
 #include <gio/gio.h>
 
@@ -36,6 +37,7 @@ int main(int argc, char *argv[])
   g_autoptr (GOptionContext) opt_context = NULL;
   g_autoptr (FbdThemeExpander) expander = NULL;
   g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (JsonNode) node = NULL;
   g_autofree char *theme_file = NULL;
   const char *compatible = NULL;
   gboolean version = FALSE;
@@ -76,8 +78,14 @@ int main(int argc, char *argv[])
 
   compatibles[0] = compatible;
   theme_file = *args;
-  expander = fbd_theme_expander_new (compatibles, NULL, theme_file);
-  theme = fbd_theme_expander_load_theme_files (expander, &err);
+
+  /* Check the theme itself before checking how it expands */
+  node = fbd_theme_parser_load_file (theme_file, FBD_THEME_PARSER_FLAG_VALIDATE, &err);
+  if (node) {
+    expander = fbd_theme_expander_new (compatibles, NULL, theme_file);
+    theme = fbd_theme_expander_load_theme_files (expander, &err);
+  }
+
   if (theme == NULL) {
     g_printerr ("Validation of '%s' failed \n\n", theme_file);
     g_printerr ("error: %s\n\n", err->message);
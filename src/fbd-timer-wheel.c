@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-timer-wheel"
+
+#include "fbd-stats.h"
+#include "fbd-timer-wheel.h"
+
+/**
+ * FbdTimerWheel:
+ *
+ * Runs the daemon's timers (event timeouts, feedback durations,
+ * pattern steps, …) from a single #GSource instead of one source per
+ * timer.
+ *
+ * Each timer has a slack: it may fire up to that many milliseconds
+ * late. The wheel wakes up at the earliest time some timer can't wait
+ * any longer and then fires all timers that are due. This batches
+ * wakeups of timers that expire close to each other. Timers are only
+ * ever fired late, never early.
+ *
+ * To save power the slack of all timers can be raised via
+ * `fbd_timer_wheel_set_min_slack()`. Timers without any slack aren't
+ * affected as they need to be exact.
+ *
+ * Timers are kept sorted by their deadline. The wheel is attached to
+ * the default main context and must only be used from the main thread.
+ */
+
+typedef struct _FbdTimer {
+  guint            id;
+  gint64           deadline;
+  guint            interval;
+  guint            slack;
+  GSourceFunc      func;
+  GSourceOnceFunc  once_func;
+  gpointer         data;
+  /* NULL while the timer's callback runs */
+  GSequenceIter   *iter;
+  gboolean         removed;
+} FbdTimer;
+
+typedef struct _FbdTimerWheelSource {
+  GSource        source;
+  FbdTimerWheel *wheel;
+} FbdTimerWheelSource;
+
+struct _FbdTimerWheel {
+  GObject    parent;
+
+  GSource   *source;
+  /* The armed timers sorted by deadline */
+  GSequence *timers;
+  /* Key: timer id, value: FbdTimer */
+  GHashTable *ids;
+  guint      next_id;
+  guint      min_slack;
+};
+
+G_DEFINE_TYPE (FbdTimerWheel, fbd_timer_wheel, G_TYPE_OBJECT)
+
+
+static int
+compare_timers (gconstpointer a, gconstpointer b, gpointer unused)
+{
+  const FbdTimer *timer_a = a;
+  const FbdTimer *timer_b = b;
+
+  if (timer_a->deadline != timer_b->deadline)
+    return timer_a->deadline < timer_b->deadline ? -1 : 1;
+
+  /* Timers with the same deadline fire in the order they were added */
+  return timer_a->id < timer_b->id ? -1 : (timer_a->id > timer_b->id);
+}
+
+
+static guint
+get_slack (FbdTimerWheel *self, FbdTimer *timer)
+{
+  if (timer->slack == 0)
+    return 0;
+
+  return MAX (timer->slack, self->min_slack);
+}
+
+
+static void
+update_ready_time (FbdTimerWheel *self)
+{
+  GSequenceIter *iter;
+  gint64 ready_time = G_MAXINT64;
+
+  /*
+   * Wake up when the first timer runs out of slack. Timers are sorted
+   * by deadline so any timer after one with a deadline past that
+   * point can't move it any earlier.
+   */
+  for (iter = g_sequence_get_begin_iter (self->timers);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    FbdTimer *timer = g_sequence_get (iter);
+
+    if (timer->deadline > ready_time)
+      break;
+
+    ready_time = MIN (ready_time, timer->deadline + (gint64)get_slack (self, timer) * 1000);
+  }
+
+  g_source_set_ready_time (self->source, ready_time == G_MAXINT64 ? -1 : ready_time);
+}
+
+
+static void
+insert_timer (FbdTimerWheel *self, FbdTimer *timer)
+{
+  timer->iter = g_sequence_insert_sorted (self->timers, timer, compare_timers, NULL);
+}
+
+
+static void
+dispatch_timers (FbdTimerWheel *self)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  fbd_stats_count (fbd_stats_get_default (), FBD_STATS_COUNTER_TIMER_WAKEUPS);
+
+  while (TRUE) {
+    GSequenceIter *iter = g_sequence_get_begin_iter (self->timers);
+    FbdTimer *timer;
+    gboolean again = FALSE;
+
+    if (g_sequence_iter_is_end (iter))
+      break;
+
+    timer = g_sequence_get (iter);
+    if (timer->deadline > now)
+      break;
+
+    g_sequence_remove (iter);
+    timer->iter = NULL;
+
+    if (timer->once_func)
+      timer->once_func (timer->data);
+    else
+      again = timer->func (timer->data);
+
+    if (again && !timer->removed) {
+      /* Stay on the grid unless we fell behind */
+      timer->deadline = MAX (timer->deadline + (gint64)timer->interval * 1000, now + 1);
+      insert_timer (self, timer);
+    } else {
+      g_hash_table_remove (self->ids, GUINT_TO_POINTER (timer->id));
+    }
+  }
+
+  update_ready_time (self);
+}
+
+
+static gboolean
+wheel_source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  FbdTimerWheelSource *wheel_source = (FbdTimerWheelSource *)source;
+  g_autoptr (FbdTimerWheel) wheel = g_object_ref (wheel_source->wheel);
+
+  dispatch_timers (wheel);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static GSourceFuncs wheel_source_funcs = {
+  .dispatch = wheel_source_dispatch,
+};
+
+
+static guint
+add_timer (FbdTimerWheel   *self,
+           guint            interval,
+           guint            slack,
+           GSourceFunc      func,
+           GSourceOnceFunc  once_func,
+           gpointer         data)
+{
+  FbdTimer *timer = g_new0 (FbdTimer, 1);
+
+  do {
+    timer->id = self->next_id++;
+  } while (timer->id == 0 || g_hash_table_contains (self->ids, GUINT_TO_POINTER (timer->id)));
+
+  timer->deadline = g_get_monotonic_time () + (gint64)interval * 1000;
+  timer->interval = interval;
+  timer->slack = slack;
+  timer->func = func;
+  timer->once_func = once_func;
+  timer->data = data;
+
+  g_hash_table_insert (self->ids, GUINT_TO_POINTER (timer->id), timer);
+  insert_timer (self, timer);
+  update_ready_time (self);
+
+  return timer->id;
+}
+
+
+static void
+fbd_timer_wheel_finalize (GObject *object)
+{
+  FbdTimerWheel *self = FBD_TIMER_WHEEL (object);
+
+  g_source_destroy (self->source);
+  g_clear_pointer (&self->source, g_source_unref);
+  g_clear_pointer (&self->timers, g_sequence_free);
+  g_clear_pointer (&self->ids, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (fbd_timer_wheel_parent_class)->finalize (object);
+}
+
+
+static void
+fbd_timer_wheel_class_init (FbdTimerWheelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = fbd_timer_wheel_finalize;
+}
+
+
+static void
+fbd_timer_wheel_init (FbdTimerWheel *self)
+{
+  FbdTimerWheelSource *wheel_source;
+
+  self->next_id = 1;
+  self->timers = g_sequence_new (NULL);
+  self->ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+  self->source = g_source_new (&wheel_source_funcs, sizeof (FbdTimerWheelSource));
+  wheel_source = (FbdTimerWheelSource *)self->source;
+  wheel_source->wheel = self;
+  g_source_set_name (self->source, "fbd-timer-wheel");
+  g_source_attach (self->source, NULL);
+}
+
+/**
+ * fbd_timer_wheel_get_default:
+ *
+ * Gets the daemon's timer wheel. The first call creates it.
+ *
+ * Returns:(transfer none): The timer wheel
+ */
+FbdTimerWheel *
+fbd_timer_wheel_get_default (void)
+{
+  static FbdTimerWheel *instance;
+
+  if (instance == NULL) {
+    instance = g_object_new (FBD_TYPE_TIMER_WHEEL, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+
+  return instance;
+}
+
+/**
+ * fbd_timer_wheel_add:
+ * @self: The timer wheel
+ * @interval: The interval in milliseconds
+ * @slack: How many milliseconds the timer may fire late
+ * @func: The function to call
+ * @data: Data to pass to @func
+ *
+ * Like `g_timeout_add()`: @func is called every @interval
+ * milliseconds until it returns `G_SOURCE_REMOVE`.
+ *
+ * Returns: The id of the timer, never `0`
+ */
+guint
+fbd_timer_wheel_add (FbdTimerWheel *self,
+                     guint          interval,
+                     guint          slack,
+                     GSourceFunc    func,
+                     gpointer       data)
+{
+  g_return_val_if_fail (FBD_IS_TIMER_WHEEL (self), 0);
+  g_return_val_if_fail (func, 0);
+
+  return add_timer (self, interval, slack, func, NULL, data);
+}
+
+/**
+ * fbd_timer_wheel_add_once:
+ * @self: The timer wheel
+ * @interval: The interval in milliseconds
+ * @slack: How many milliseconds the timer may fire late
+ * @func: The function to call
+ * @data: Data to pass to @func
+ *
+ * Like `g_timeout_add_once()`: @func is called once after @interval
+ * milliseconds.
+ *
+ * Returns: The id of the timer, never `0`
+ */
+guint
+fbd_timer_wheel_add_once (FbdTimerWheel   *self,
+                          guint            interval,
+                          guint            slack,
+                          GSourceOnceFunc  func,
+                          gpointer         data)
+{
+  g_return_val_if_fail (FBD_IS_TIMER_WHEEL (self), 0);
+  g_return_val_if_fail (func, 0);
+
+  return add_timer (self, interval, slack, NULL, func, data);
+}
+
+/**
+ * fbd_timer_wheel_remove:
+ * @self: The timer wheel
+ * @id: The id of the timer
+ *
+ * Removes the timer so its function isn't called anymore. A timer
+ * can remove itself from its function.
+ */
+void
+fbd_timer_wheel_remove (FbdTimerWheel *self, guint id)
+{
+  FbdTimer *timer;
+
+  g_return_if_fail (FBD_IS_TIMER_WHEEL (self));
+
+  timer = g_hash_table_lookup (self->ids, GUINT_TO_POINTER (id));
+  g_return_if_fail (timer);
+
+  /* Freed once its function returns */
+  if (timer->iter == NULL) {
+    timer->removed = TRUE;
+    return;
+  }
+
+  g_sequence_remove (timer->iter);
+  g_hash_table_remove (self->ids, GUINT_TO_POINTER (id));
+  update_ready_time (self);
+}
+
+/**
+ * fbd_timer_wheel_set_min_slack:
+ * @self: The timer wheel
+ * @min_slack: The minimum slack in milliseconds
+ *
+ * Raises the slack of all timers that have a slack to at least
+ * @min_slack. Use `0` to use the timers' own slack again.
+ */
+void
+fbd_timer_wheel_set_min_slack (FbdTimerWheel *self, guint min_slack)
+{
+  g_return_if_fail (FBD_IS_TIMER_WHEEL (self));
+
+  if (self->min_slack == min_slack)
+    return;
+
+  g_debug ("Minimum timer slack: %ums", min_slack);
+  self->min_slack = min_slack;
+  update_ready_time (self);
+}
+
+/**
+ * fbd_timer_wheel_get_n_timers:
+ * @self: The timer wheel
+ *
+ * Gets the number of timers that are armed or currently firing.
+ *
+ * Returns: The number of timers
+ */
+guint
+fbd_timer_wheel_get_n_timers (FbdTimerWheel *self)
+{
+  g_return_val_if_fail (FBD_IS_TIMER_WHEEL (self), 0);
+
+  return g_hash_table_size (self->ids);
+}
+
+/**
+ * fbd_timeout_add:
+ * @interval: The interval in milliseconds
+ * @slack: How many milliseconds the timer may fire late
+ * @func: The function to call
+ * @data: Data to pass to @func
+ *
+ * Adds a timer to the default timer wheel. See `fbd_timer_wheel_add()`.
+ *
+ * Returns: The id of the timer
+ */
+guint
+fbd_timeout_add (guint interval, guint slack, GSourceFunc func, gpointer data)
+{
+  return fbd_timer_wheel_add (fbd_timer_wheel_get_default (), interval, slack, func, data);
+}
+
+/**
+ * fbd_timeout_add_once:
+ * @interval: The interval in milliseconds
+ * @slack: How many milliseconds the timer may fire late
+ * @func: The function to call
+ * @data: Data to pass to @func
+ *
+ * Adds a one shot timer to the default timer wheel. See
+ * `fbd_timer_wheel_add_once()`.
+ *
+ * Returns: The id of the timer
+ */
+guint
+fbd_timeout_add_once (guint interval, guint slack, GSourceOnceFunc func, gpointer data)
+{
+  return fbd_timer_wheel_add_once (fbd_timer_wheel_get_default (), interval, slack, func, data);
+}
+
+/**
+ * fbd_timeout_remove:
+ * @id: The id of the timer
+ *
+ * Removes a timer from the default timer wheel. Can be used with
+ * `g_clear_handle_id()`.
+ */
+void
+fbd_timeout_remove (guint id)
+{
+  fbd_timer_wheel_remove (fbd_timer_wheel_get_default (), id);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Feedback durations, a few milliseconds late isn't noticeable */
+#define FBD_TIMER_WHEEL_SLACK_DEFAULT 10
+/* Timeouts given in seconds */
+#define FBD_TIMER_WHEEL_SLACK_COARSE  500
+/* Minimum slack in low power mode */
+#define FBD_TIMER_WHEEL_SLACK_LOW_POWER 1000
+
+#define FBD_TYPE_TIMER_WHEEL (fbd_timer_wheel_get_type ())
+
+G_DECLARE_FINAL_TYPE (FbdTimerWheel, fbd_timer_wheel, FBD, TIMER_WHEEL, GObject)
+
+FbdTimerWheel *fbd_timer_wheel_get_default (void);
+guint          fbd_timer_wheel_add (FbdTimerWheel *self,
+                                    guint          interval,
+                                    guint          slack,
+                                    GSourceFunc    func,
+                                    gpointer       data);
+guint          fbd_timer_wheel_add_once (FbdTimerWheel   *self,
+                                         guint            interval,
+                                         guint            slack,
+                                         GSourceOnceFunc  func,
+                                         gpointer         data);
+void           fbd_timer_wheel_remove (FbdTimerWheel *self, guint id);
+void           fbd_timer_wheel_set_min_slack (FbdTimerWheel *self, guint min_slack);
+guint          fbd_timer_wheel_get_n_timers (FbdTimerWheel *self);
+
+guint          fbd_timeout_add (guint interval, guint slack, GSourceFunc func, gpointer data);
+guint          fbd_timeout_add_once (guint           interval,
+                                     guint           slack,
+                                     GSourceOnceFunc func,
+                                     gpointer        data);
+void           fbd_timeout_remove (guint id);
+
+G_END_DECLS
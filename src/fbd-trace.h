@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include "fbd-config.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Trace marks along the feedback pipeline. When built with
+ * `-Dtracing=enabled` they end up in sysprof captures, otherwise they
+ * compile to nothing. Times are in nanoseconds of the monotonic clock
+ * so `g_get_monotonic_time () * 1000` can be used as @begin too:
+ *
+ *   gint64 begin = FBD_TRACE_CURRENT_TIME;
+ *   …
+ *   fbd_trace_mark (begin, "theme-lookup", "%s", event);
+ */
+#ifdef FBD_HAVE_SYSPROF
+
+#include <sysprof-capture.h>
+
+#define FBD_TRACE_CURRENT_TIME SYSPROF_CAPTURE_CURRENT_TIME
+
+#define fbd_trace_mark(begin, name, ...)                                \
+  sysprof_collector_mark_printf ((begin),                               \
+                                 SYSPROF_CAPTURE_CURRENT_TIME - (begin), \
+                                 "feedbackd", (name), __VA_ARGS__)
+
+#else
+
+#define FBD_TRACE_CURRENT_TIME 0
+
+#define fbd_trace_mark(begin, name, ...) G_STMT_START { (void) (begin); } G_STMT_END
+
+#endif
+
+G_END_DECLS
@@ -8,79 +8,394 @@
 #define G_LOG_DOMAIN "fbd-udev"
 
 #include "fbd-udev.h"
+#include "fbd-stats.h"
+#include "fbd-trace.h"
 
 #include <gio/gio.h>
 
+#include <linux/magic.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 
-gboolean
-fbd_udev_set_sysfs_path_attr_as_string (GUdevDevice *dev, const gchar *attr,
-                                        const gchar *s, GError **err)
+#define FBD_UDEV_ATTRS_KEY "fbd-sysfs-attrs"
+
+/* Devices written to in parallel */
+#define FBD_UDEV_IO_THREADS 2
+
+typedef struct _FbdSysfsDev FbdSysfsDev;
+
+/*
+ * Sysfs attributes are kept open and rewritten at offset 0 so updating
+ * an attribute is a single syscall. The attributes are attached to
+ * their GUdevDevice and closed along with it.
+ */
+typedef struct _FbdSysfsAttr {
+  FbdSysfsDev *owner;
+  char        *path;
+  int          fd;
+  /* Not on sysfs (e.g. when testing), need to drop old contents */
+  gboolean     truncate;
+  /* Queued value and the device we hold a ref on while queued */
+  char        *pending;
+  GUdevDevice *pending_dev;
+} FbdSysfsAttr;
+
+typedef struct _FbdSysfsWrite {
+  FbdSysfsAttr *attr;
+  char         *value;
+} FbdSysfsWrite;
+
+/*
+ * Some drivers (e.g. LED controllers on I2C) block for milliseconds
+ * per write so queued writes happen in a worker pool. A device is only
+ * handled by one worker at a time which keeps its writes in order.
+ * While that happens the worker owns the device's attributes and
+ * holds a ref on the device that is dropped on the main loop.
+ */
+struct _FbdSysfsDev {
+  GHashTable  *attrs;
+  /* Protected by io_lock */
+  GQueue       writes;
+  GUdevDevice *running;
+};
+
+/* Attributes with queued writes in the order they need to be written */
+static GQueue pending_attrs = G_QUEUE_INIT;
+static guint flush_id;
+
+static GThreadPool *io_pool;
+static GMutex io_lock;
+static GCond io_cond;
+static guint n_running;
+
+
+static void
+fbd_sysfs_attr_free (FbdSysfsAttr *attr)
 {
-  gint fd;
-  int len;
-  g_autofree gchar *path = g_strjoin ("/", g_udev_device_get_sysfs_path (dev),
-                                      attr, NULL);
+  g_assert (attr->pending == NULL);
 
-  fd = open (path, O_WRONLY|O_TRUNC, 0666);
-  if (fd < 0) {
+  if (attr->fd >= 0)
+    close (attr->fd);
+  g_free (attr->path);
+  g_free (attr);
+}
+
+
+static void
+fbd_sysfs_dev_free (FbdSysfsDev *sdev)
+{
+  g_assert (sdev->running == NULL && g_queue_is_empty (&sdev->writes));
+
+  g_hash_table_unref (sdev->attrs);
+  g_free (sdev);
+}
+
+
+static gboolean
+fbd_sysfs_attr_open (FbdSysfsAttr *attr, GError **err)
+{
+  struct statfs fs;
+
+  attr->fd = open (attr->path, O_WRONLY | O_CLOEXEC);
+  if (attr->fd < 0) {
     g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to open %s: %s",
-                 path, strerror (errno));
+                 attr->path, strerror (errno));
     return FALSE;
   }
 
-  len = strlen (s);
-  if (write (fd, s, len) < 0) {
-    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to write %s to %s: %s",
-                 s, path, strerror (errno));
-    close (fd);
-    return FALSE;
-  }
+  attr->truncate = fstatfs (attr->fd, &fs) == 0 && fs.f_type != SYSFS_MAGIC;
+  return TRUE;
+}
+
 
-  if (close (fd) < 0) {
-    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to close %s: %s",
-                 path, strerror (errno));
+static gboolean
+fbd_sysfs_attr_write_value (FbdSysfsAttr *attr, const gchar *s, GError **err)
+{
+  gsize len = strlen (s);
+
+  if (attr->fd < 0 && !fbd_sysfs_attr_open (attr, err))
     return FALSE;
+
+  if (pwrite (attr->fd, s, len, 0) < (gssize) len) {
+    /* Attributes get recreated e.g. on trigger changes, so reopen once */
+    if (errno != ENODEV && errno != ENOENT)
+      goto err;
+
+    close (attr->fd);
+    if (!fbd_sysfs_attr_open (attr, err))
+      return FALSE;
+
+    if (pwrite (attr->fd, s, len, 0) < (gssize) len)
+      goto err;
   }
 
+  if (attr->truncate && ftruncate (attr->fd, len) < 0)
+    goto err;
+
   return TRUE;
+
+ err:
+  g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to write %s to %s: %s",
+               s, attr->path, strerror (errno));
+  return FALSE;
+}
+
+
+static gboolean
+fbd_sysfs_attr_write (FbdSysfsAttr *attr, const gchar *s, GError **err)
+{
+  gint64 start = g_get_monotonic_time ();
+  gboolean success;
+
+  success = fbd_sysfs_attr_write_value (attr, s, err);
+  fbd_stats_add_duration (fbd_stats_get_default (), FBD_STATS_DURATION_SYSFS_WRITE,
+                          g_get_monotonic_time () - start);
+  fbd_trace_mark (start * 1000, "sysfs-write", "%s: %s", attr->path, s);
+
+  return success;
 }
 
+
+static FbdSysfsAttr *
+get_attr (GUdevDevice *dev, const gchar *name, GError **err)
+{
+  FbdSysfsDev *sdev = g_object_get_data (G_OBJECT (dev), FBD_UDEV_ATTRS_KEY);
+  FbdSysfsAttr *attr;
+
+  if (sdev == NULL) {
+    sdev = g_new0 (FbdSysfsDev, 1);
+    sdev->attrs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) fbd_sysfs_attr_free);
+    g_queue_init (&sdev->writes);
+    g_object_set_data_full (G_OBJECT (dev), FBD_UDEV_ATTRS_KEY, sdev,
+                            (GDestroyNotify) fbd_sysfs_dev_free);
+  }
+
+  attr = g_hash_table_lookup (sdev->attrs, name);
+  if (attr)
+    return attr;
+
+  attr = g_new0 (FbdSysfsAttr, 1);
+  attr->owner = sdev;
+  attr->path = g_strjoin ("/", g_udev_device_get_sysfs_path (dev), name, NULL);
+  if (!fbd_sysfs_attr_open (attr, err)) {
+    fbd_sysfs_attr_free (attr);
+    return NULL;
+  }
+
+  g_hash_table_insert (sdev->attrs, g_strdup (name), attr);
+  return attr;
+}
+
+
+static gboolean
+on_device_written (gpointer data)
+{
+  GUdevDevice *dev = data;
+
+  g_object_unref (dev);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs in the worker pool */
+static void
+write_device (gpointer data, gpointer unused)
+{
+  FbdSysfsDev *sdev = data;
+
+  while (TRUE) {
+    g_autoptr (GError) err = NULL;
+    FbdSysfsWrite *item;
+    GUdevDevice *dev;
+
+    g_mutex_lock (&io_lock);
+    item = g_queue_pop_head (&sdev->writes);
+    if (item == NULL) {
+      dev = g_steal_pointer (&sdev->running);
+      n_running--;
+      g_cond_broadcast (&io_cond);
+      g_mutex_unlock (&io_lock);
+
+      /* Device and attributes go away on the main loop only */
+      g_idle_add_full (G_PRIORITY_HIGH_IDLE, on_device_written, dev, NULL);
+      return;
+    }
+    g_mutex_unlock (&io_lock);
+
+    if (!fbd_sysfs_attr_write (item->attr, item->value, &err))
+      g_warning ("%s", err->message);
+
+    g_free (item->value);
+    g_free (item);
+  }
+}
+
+/* Hands all queued writes to the worker pool */
+static void
+dispatch_pending (void)
+{
+  FbdSysfsAttr *attr;
+
+  g_clear_handle_id (&flush_id, g_source_remove);
+
+  if (g_queue_is_empty (&pending_attrs))
+    return;
+
+  if (io_pool == NULL) {
+    io_pool = g_thread_pool_new (write_device, NULL, FBD_UDEV_IO_THREADS, FALSE, NULL);
+    g_assert (io_pool);
+  }
+
+  g_mutex_lock (&io_lock);
+  while ((attr = g_queue_pop_head (&pending_attrs))) {
+    g_autoptr (GUdevDevice) dev = g_steal_pointer (&attr->pending_dev);
+    FbdSysfsDev *sdev = attr->owner;
+    FbdSysfsWrite *item = g_new0 (FbdSysfsWrite, 1);
+
+    item->attr = attr;
+    item->value = g_steal_pointer (&attr->pending);
+    g_queue_push_tail (&sdev->writes, item);
+
+    if (sdev->running == NULL) {
+      sdev->running = g_steal_pointer (&dev);
+      n_running++;
+      g_thread_pool_push (io_pool, sdev, NULL);
+    }
+  }
+  g_mutex_unlock (&io_lock);
+}
+
+/**
+ * fbd_udev_flush_sysfs_attrs:
+ *
+ * Writes out all queued sysfs attribute updates in the order they
+ * were queued and waits until they're written. Queued updates are
+ * handed to the I/O workers automatically when the main loop is idle
+ * so this is only needed when the hardware needs to be up to date,
+ * e.g. on shutdown.
+ */
+void
+fbd_udev_flush_sysfs_attrs (void)
+{
+  dispatch_pending ();
+
+  g_mutex_lock (&io_lock);
+  while (n_running)
+    g_cond_wait (&io_cond, &io_lock);
+  g_mutex_unlock (&io_lock);
+}
+
+
+static gboolean
+on_flush_idle (gpointer unused)
+{
+  flush_id = 0;
+  dispatch_pending ();
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * fbd_udev_set_sysfs_path_attr_as_string:
+ * @dev: The device
+ * @attr: The attribute name
+ * @s: The value to write
+ * @err: Return location for error
+ *
+ * Writes @s to the sysfs attribute @attr after all writes queued
+ * before. The value is written right away so the caller can fall
+ * back when the driver rejects it, use
+ * fbd_udev_queue_sysfs_path_attr_as_string() if that's not needed.
+ *
+ * Returns: `TRUE` if the value was written, otherwise `FALSE`.
+ */
+gboolean
+fbd_udev_set_sysfs_path_attr_as_string (GUdevDevice *dev, const gchar *attr,
+                                        const gchar *s, GError **err)
+{
+  FbdSysfsAttr *sysfs_attr;
+
+  sysfs_attr = get_attr (dev, attr, err);
+  if (sysfs_attr == NULL)
+    return FALSE;
+
+  /* Keep the order with writes queued before */
+  dispatch_pending ();
+  g_mutex_lock (&io_lock);
+  while (sysfs_attr->owner->running)
+    g_cond_wait (&io_cond, &io_lock);
+  g_mutex_unlock (&io_lock);
+
+  return fbd_sysfs_attr_write (sysfs_attr, s, err);
+}
+
+
 gboolean
 fbd_udev_set_sysfs_path_attr_as_int (GUdevDevice *dev, const gchar *attr,
                                      gint val, GError **err)
 {
-  gint fd;
-  int len;
-  g_autofree gchar *s = NULL;
+  char s[16];
 
-  g_autofree gchar *path = g_strjoin ("/", g_udev_device_get_sysfs_path (dev),
-                                      attr, NULL);
+  g_snprintf (s, sizeof (s), "%d", val);
 
-  fd = open (path, O_WRONLY|O_TRUNC, 0666);
-  if (fd < 0) {
-    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to open %s: %s",
-                 path, strerror (errno));
-    return FALSE;
-  }
+  return fbd_udev_set_sysfs_path_attr_as_string (dev, attr, s, err);
+}
+
+/**
+ * fbd_udev_queue_sysfs_path_attr_as_string:
+ * @dev: The device
+ * @attr: The attribute name
+ * @s: The value to write
+ * @err: Return location for error
+ *
+ * Queues a write of @s to the sysfs attribute @attr. Writes queued
+ * within one main loop iteration are handed to the I/O workers
+ * together, an attribute queued several times is only written once
+ * with the last value.
+ *
+ * Returns: `TRUE` if the attribute is writable, otherwise `FALSE`.
+ *   Errors writing the value are only logged.
+ */
+gboolean
+fbd_udev_queue_sysfs_path_attr_as_string (GUdevDevice *dev, const gchar *attr,
+                                          const gchar *s, GError **err)
+{
+  FbdSysfsAttr *sysfs_attr;
 
-  s = g_strdup_printf ("%d", val);
-  len = strlen (s);
-  if (write (fd, s, len) < len) {
-    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to write %s: %s",
-                 path, strerror (errno));
-    close (fd);
+  sysfs_attr = get_attr (dev, attr, err);
+  if (sysfs_attr == NULL)
     return FALSE;
+
+  if (sysfs_attr->pending) {
+    /* Written after everything queued before */
+    g_queue_remove (&pending_attrs, sysfs_attr);
+    g_free (sysfs_attr->pending);
+  } else {
+    sysfs_attr->pending_dev = g_object_ref (dev);
   }
+  sysfs_attr->pending = g_strdup (s);
+  g_queue_push_tail (&pending_attrs, sysfs_attr);
 
-  if (close (fd) < 0) {
-    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to close %s: %s",
-                 path, strerror (errno));
-    return FALSE;
+  if (flush_id == 0) {
+    flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, on_flush_idle, NULL, NULL);
+    g_source_set_name_by_id (flush_id, "fbd-udev-flush-sysfs");
   }
 
   return TRUE;
 }
+
+gboolean
+fbd_udev_queue_sysfs_path_attr_as_int (GUdevDevice *dev, const gchar *attr,
+                                       gint val, GError **err)
+{
+  char s[16];
+
+  g_snprintf (s, sizeof (s), "%d", val);
+
+  return fbd_udev_queue_sysfs_path_attr_as_string (dev, attr, s, err);
+}
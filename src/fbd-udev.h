@@ -15,5 +15,10 @@ gboolean fbd_udev_set_sysfs_path_attr_as_string (GUdevDevice *dev, const gchar *
 						 const gchar *s, GError **err);
 gboolean fbd_udev_set_sysfs_path_attr_as_int (GUdevDevice *dev, const gchar *attr,
 					      gint val, GError **err);
+gboolean fbd_udev_queue_sysfs_path_attr_as_string (GUdevDevice *dev, const gchar *attr,
+						   const gchar *s, GError **err);
+gboolean fbd_udev_queue_sysfs_path_attr_as_int (GUdevDevice *dev, const gchar *attr,
+						gint val, GError **err);
+void     fbd_udev_flush_sysfs_attrs (void);
 
 G_END_DECLS
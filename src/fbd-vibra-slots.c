@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "fbd-vibra-slots"
+
+#include "fbd-vibra-slots.h"
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * FbdVibraSlots:
+ *
+ * A small cache of effects uploaded to a force feedback device so
+ * repeatedly played effects don't need to be uploaded again.
+ *
+ * When all slots are in use the least recently used effect is evicted
+ * unless it's playing, part of a pattern, prepared or resident. Custom
+ * waveforms stay resident as long as that leaves a slot for everything
+ * else.
+ *
+ * The cache only does the bookkeeping, talking to the device happens
+ * via #FbdVibraSlotsOps. The caller passes in the current monotonic
+ * time so the eviction order doesn't depend on the clock.
+ */
+
+struct _FbdVibraSlots {
+  FbdVibraSlot            slots[FBD_VIBRA_SLOTS_MAX];
+  guint                   n_slots;
+
+  const FbdVibraSlotsOps *ops;
+  gpointer                user_data;
+};
+
+
+gboolean
+fbd_vibra_effect_is_custom (const struct ff_effect *effect)
+{
+  return effect->type == FF_PERIODIC && effect->u.periodic.waveform == FF_CUSTOM;
+}
+
+
+gint16 *
+fbd_vibra_effect_dup_custom_data (const struct ff_effect *effect)
+{
+  return g_memdup2 (effect->u.periodic.custom_data,
+                    sizeof (gint16) * effect->u.periodic.custom_len);
+}
+
+
+gboolean
+fbd_vibra_effect_equal (const struct ff_effect *a, const struct ff_effect *b)
+{
+  struct ff_effect tmp = *b;
+
+  /* Effects are built from zeroed memory so padding compares equal */
+  tmp.id = a->id;
+
+  /* Custom waveforms are compared by their samples */
+  if (fbd_vibra_effect_is_custom (a) && fbd_vibra_effect_is_custom (b)) {
+    if (a->u.periodic.custom_len != b->u.periodic.custom_len)
+      return FALSE;
+    if (memcmp (a->u.periodic.custom_data, b->u.periodic.custom_data,
+                sizeof (gint16) * a->u.periodic.custom_len))
+      return FALSE;
+    tmp.u.periodic.custom_data = a->u.periodic.custom_data;
+  }
+
+  return memcmp (a, &tmp, sizeof (tmp)) == 0;
+}
+
+
+FbdVibraSlots *
+fbd_vibra_slots_new (guint n_slots, const FbdVibraSlotsOps *ops, gpointer user_data)
+{
+  FbdVibraSlots *self;
+
+  g_return_val_if_fail (ops, NULL);
+
+  self = g_new0 (FbdVibraSlots, 1);
+  self->n_slots = CLAMP (n_slots, 1, FBD_VIBRA_SLOTS_MAX);
+  self->ops = ops;
+  self->user_data = user_data;
+
+  for (guint i = 0; i < FBD_VIBRA_SLOTS_MAX; i++)
+    self->slots[i].effect.id = -1;
+
+  return self;
+}
+
+/**
+ * fbd_vibra_slots_free:
+ * @self: The slot cache
+ *
+ * Frees the cache. This doesn't erase the uploaded effects, closing
+ * the device does that.
+ */
+void
+fbd_vibra_slots_free (FbdVibraSlots *self)
+{
+  if (self == NULL)
+    return;
+
+  for (guint i = 0; i < FBD_VIBRA_SLOTS_MAX; i++)
+    g_free (self->slots[i].custom_data);
+
+  g_free (self);
+}
+
+
+guint
+fbd_vibra_slots_get_n_slots (FbdVibraSlots *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return self->n_slots;
+}
+
+/**
+ * fbd_vibra_slots_find:
+ * @self: The slot cache
+ * @id: The effect id, `-1` for a free slot
+ *
+ * Returns: (nullable): The slot holding the effect
+ */
+FbdVibraSlot *
+fbd_vibra_slots_find (FbdVibraSlots *self, int id)
+{
+  g_return_val_if_fail (self, NULL);
+
+  for (guint i = 0; i < self->n_slots; i++) {
+    if (self->slots[i].effect.id == id)
+      return &self->slots[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * fbd_vibra_slots_find_tuned:
+ * @self: The slot cache
+ *
+ * Returns: (nullable): The slot holding the effect of an earlier retune
+ */
+FbdVibraSlot *
+fbd_vibra_slots_find_tuned (FbdVibraSlots *self)
+{
+  FbdVibraSlot *slot = NULL;
+
+  g_return_val_if_fail (self, NULL);
+
+  for (guint i = 0; i < self->n_slots; i++) {
+    if (self->slots[i].effect.id != -1 && self->slots[i].tuned)
+      slot = &self->slots[i];
+  }
+
+  return slot;
+}
+
+
+static void
+erase_slot (FbdVibraSlots *self, FbdVibraSlot *slot)
+{
+  g_debug ("Erasing vibra effect %d", slot->effect.id);
+  self->ops->erase (slot->effect.id, self->user_data);
+
+  slot->effect.id = -1;
+  slot->resident = FALSE;
+  slot->tuned = FALSE;
+  g_clear_pointer (&slot->custom_data, g_free);
+}
+
+
+static void
+store_slot (FbdVibraSlots *self, FbdVibraSlot *slot, const struct ff_effect *effect)
+{
+  guint n_resident = 0;
+
+  g_clear_pointer (&slot->custom_data, g_free);
+  slot->effect = *effect;
+  slot->resident = FALSE;
+  slot->tuned = FALSE;
+
+  if (!fbd_vibra_effect_is_custom (effect))
+    return;
+
+  slot->custom_data = fbd_vibra_effect_dup_custom_data (effect);
+  slot->effect.u.periodic.custom_data = slot->custom_data;
+
+  /* Leave at least one slot for everything else */
+  for (guint i = 0; i < self->n_slots; i++)
+    n_resident += !!self->slots[i].resident;
+  if (n_resident + 1 < self->n_slots) {
+    g_debug ("Keeping custom vibra effect %d resident", effect->id);
+    slot->resident = TRUE;
+  }
+}
+
+/**
+ * fbd_vibra_slots_evict:
+ * @self: The slot cache
+ * @now: The current monotonic time in µs
+ *
+ * Erases the least recently used effect that isn't currently playing
+ * or prepared to be played.
+ *
+ * Returns: (nullable): The freed slot or `NULL` if there's none to free
+ */
+FbdVibraSlot *
+fbd_vibra_slots_evict (FbdVibraSlots *self, gint64 now)
+{
+  FbdVibraSlot *lru = NULL;
+
+  g_return_val_if_fail (self, NULL);
+
+  for (guint i = 0; i < self->n_slots; i++) {
+    FbdVibraSlot *slot = &self->slots[i];
+
+    if (slot->effect.id == -1 || slot->reserved_until > now || slot->resident)
+      continue;
+
+    if (self->ops->is_busy (slot->effect.id, self->user_data))
+      continue;
+
+    if (lru == NULL || slot->last_used < lru->last_used)
+      lru = slot;
+  }
+
+  if (lru)
+    erase_slot (self, lru);
+
+  return lru;
+}
+
+/**
+ * fbd_vibra_slots_upload:
+ * @self: The slot cache
+ * @effect: The effect to upload. The id must be `-1`.
+ * @now: The current monotonic time in µs
+ *
+ * Looks up the effect in the cache and uploads it if it's not
+ * there yet. On success the effect's id is set.
+ *
+ * Returns: `TRUE` if the effect is ready to be played
+ */
+gboolean
+fbd_vibra_slots_upload (FbdVibraSlots *self, struct ff_effect *effect, gint64 now)
+{
+  g_return_val_if_fail (self, FALSE);
+
+  for (guint i = 0; i < self->n_slots; i++) {
+    FbdVibraSlot *slot = &self->slots[i];
+
+    if (slot->effect.id != -1 && !slot->tuned && fbd_vibra_effect_equal (&slot->effect, effect)) {
+      g_debug ("Reusing vibra effect %d", slot->effect.id);
+      slot->last_used = now;
+      slot->reserved_until = 0;
+      effect->id = slot->effect.id;
+      return TRUE;
+    }
+  }
+
+  return fbd_vibra_slots_upload_new (self, effect, now);
+}
+
+/**
+ * fbd_vibra_slots_upload_new:
+ * @self: The slot cache
+ * @effect: The effect to upload. The id must be `-1`.
+ * @now: The current monotonic time in µs
+ *
+ * Like `fbd_vibra_slots_upload()` but doesn't reuse cached effects.
+ * If the device is out of effects as another client holds some one of
+ * ours is evicted and the upload retried. If no slot is left to track
+ * the effect the caller needs to erase it once released.
+ *
+ * Returns: `TRUE` if the effect is ready to be played
+ */
+gboolean
+fbd_vibra_slots_upload_new (FbdVibraSlots *self, struct ff_effect *effect, gint64 now)
+{
+  FbdVibraSlot *slot = NULL;
+
+  g_return_val_if_fail (self, FALSE);
+
+  slot = fbd_vibra_slots_find (self, -1);
+  if (slot == NULL)
+    slot = fbd_vibra_slots_evict (self, now);
+
+  if (self->ops->upload (effect, self->user_data) == -1) {
+    /* Another client might hold effects, free one of ours and retry */
+    if (errno != ENOSPC || (slot = fbd_vibra_slots_evict (self, now)) == NULL ||
+        self->ops->upload (effect, self->user_data) == -1) {
+      g_warning ("Failed to upload vibra effect: %s", g_strerror (errno));
+      return FALSE;
+    }
+  }
+
+  /* No slot to track it, it gets erased once released */
+  if (slot == NULL)
+    return TRUE;
+
+  store_slot (self, slot, effect);
+  slot->last_used = now;
+  slot->reserved_until = 0;
+  return TRUE;
+}
+
+/**
+ * fbd_vibra_slots_prepare:
+ * @self: The slot cache
+ * @effect: The effect to prepare. The id must be `-1`.
+ * @now: The current monotonic time in µs
+ * @until: Until when the effect must not be evicted in monotonic µs
+ *
+ * Uploads the effect without playing it and keeps it from being
+ * evicted for a short while so playing it later only needs the
+ * write to start it.
+ *
+ * Returns: `TRUE` if the effect is ready to be played
+ */
+gboolean
+fbd_vibra_slots_prepare (FbdVibraSlots    *self,
+                         struct ff_effect *effect,
+                         gint64            now,
+                         gint64            until)
+{
+  FbdVibraSlot *slot;
+
+  g_return_val_if_fail (self, FALSE);
+
+  if (!fbd_vibra_slots_upload (self, effect, now))
+    return FALSE;
+
+  slot = fbd_vibra_slots_find (self, effect->id);
+  if (slot == NULL) {
+    /* No slot left to keep it in so don't leak it */
+    self->ops->erase (effect->id, self->user_data);
+    return FALSE;
+  }
+
+  g_debug ("Prepared vibra effect %d", effect->id);
+  slot->reserved_until = until;
+  return TRUE;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <linux/input.h>
+
+G_BEGIN_DECLS
+
+/* Upper bound for the number of effects we keep uploaded */
+#define FBD_VIBRA_SLOTS_MAX 8
+
+/**
+ * FbdVibraSlot:
+ * @effect: The uploaded effect, free slots have an id of `-1`
+ * @last_used: When the effect was last uploaded or reused in monotonic µs
+ * @reserved_until: Prepared effects aren't evicted before that
+ * @custom_data: The samples of custom effects, @effect points to them
+ * @resident: Whether the effect is never evicted
+ * @tuned: Whether the effect was uploaded via retune. It's changed in
+ *   place so it's never shared.
+ *
+ * An effect kept uploaded to the device.
+ */
+typedef struct _FbdVibraSlot {
+  struct ff_effect effect;
+  gint64           last_used;
+  gint64           reserved_until;
+  gint16          *custom_data;
+  gboolean         resident;
+  gboolean         tuned;
+} FbdVibraSlot;
+
+/**
+ * FbdVibraSlotsOps:
+ * @upload: Uploads an effect to the device and sets its id. Returns
+ *   `-1` and sets `errno` on failure.
+ * @erase: Erases the effect with the given id from the device
+ * @is_busy: Whether the effect with the given id is playing or part
+ *   of a pattern and must not be evicted
+ *
+ * How the slot cache talks to the device.
+ */
+typedef struct _FbdVibraSlotsOps {
+  int      (*upload)  (struct ff_effect *effect, gpointer user_data);
+  void     (*erase)   (int id, gpointer user_data);
+  gboolean (*is_busy) (int id, gpointer user_data);
+} FbdVibraSlotsOps;
+
+typedef struct _FbdVibraSlots FbdVibraSlots;
+
+FbdVibraSlots *fbd_vibra_slots_new (guint n_slots, const FbdVibraSlotsOps *ops, gpointer user_data);
+void           fbd_vibra_slots_free (FbdVibraSlots *self);
+guint          fbd_vibra_slots_get_n_slots (FbdVibraSlots *self);
+FbdVibraSlot  *fbd_vibra_slots_find (FbdVibraSlots *self, int id);
+FbdVibraSlot  *fbd_vibra_slots_find_tuned (FbdVibraSlots *self);
+FbdVibraSlot  *fbd_vibra_slots_evict (FbdVibraSlots *self, gint64 now);
+gboolean       fbd_vibra_slots_upload (FbdVibraSlots *self, struct ff_effect *effect, gint64 now);
+gboolean       fbd_vibra_slots_upload_new (FbdVibraSlots    *self,
+                                           struct ff_effect *effect,
+                                           gint64            now);
+gboolean       fbd_vibra_slots_prepare (FbdVibraSlots    *self,
+                                        struct ff_effect *effect,
+                                        gint64            now,
+                                        gint64            until);
+
+gboolean       fbd_vibra_effect_is_custom (const struct ff_effect *effect);
+gint16        *fbd_vibra_effect_dup_custom_data (const struct ff_effect *effect);
+gboolean       fbd_vibra_effect_equal (const struct ff_effect *a, const struct ff_effect *b);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdVibraSlots, fbd_vibra_slots_free)
+
+G_END_DECLS
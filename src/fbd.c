@@ -12,16 +12,31 @@
 #include "fbd-config.h"
 
 #include "fbd.h"
+#include "fbd-broker-frontend.h"
+#include "fbd-dispatcher.h"
 #include "fbd-feedback-manager.h"
 #include "fbd-haptic-manager.h"
+#include "fbd-recorder.h"
+#include "fbd-stats.h"
+#include "fbd-timer-wheel.h"
 #include "lfb-names.h"
 #include "lfb-gdbus.h"
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <glib-unix.h>
 
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <unistd.h>
+
 static GMainLoop *loop;
 static gboolean name_acquired;
+static guint name_id;
+static int idle_exit;
+/* Set when forwarding to a broker instead of driving devices */
+static FbdBrokerFrontend *frontend;
 
 static GDebugKey debug_keys[] =
 {
@@ -47,8 +62,13 @@ quit_cb (gpointer user_data)
 static gboolean
 reload_cb (gpointer user_data)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default();
+  FbdFeedbackManager *manager;
+
+  /* The broker owns the theme */
+  if (frontend)
+    return TRUE;
 
+  manager = fbd_feedback_manager_get_default ();
   g_return_val_if_fail (FBD_IS_FEEDBACK_MANAGER (manager), FALSE);
 
   g_debug ("Caught signal, reloading feedback theme...");
@@ -57,31 +77,71 @@ reload_cb (gpointer user_data)
   return TRUE;
 }
 
+static void
+on_idle_exit_check (gpointer user_data)
+{
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  gint64 idle = fbd_feedback_manager_get_idle_time (manager);
+  gint64 remaining = (gint64)idle_exit * G_USEC_PER_SEC - idle;
+
+  if (remaining <= 0) {
+    g_info ("Idle for %ds, shutting down...", idle_exit);
+    /* Requests from now on activate a new instance */
+    g_clear_handle_id (&name_id, g_bus_unown_name);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  fbd_timeout_add_once (remaining / 1000, FBD_TIMER_WHEEL_SLACK_COARSE,
+                        on_idle_exit_check, NULL);
+}
+
 static void
 bus_acquired_cb (GDBusConnection *connection,
                  const gchar     *name,
                  gpointer         user_data)
 {
-  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  FbdFeedbackManager *manager;
+  FbdDispatcher      *dispatcher;
   FbdHapticManager   *haptic_manager;
 
+  if (frontend) {
+    g_autoptr (GError) err = NULL;
+
+    g_debug ("Bus acquired, exporting broker front-end...");
+    if (!fbd_broker_frontend_export (frontend, connection, &err))
+      g_warning ("Failed to export broker front-end: %s", err->message);
+    return;
+  }
+
+  manager = fbd_feedback_manager_get_default ();
+  dispatcher = fbd_dispatcher_get_default ();
   g_assert (FBD_IS_FEEDBACK_MANAGER (manager));
 
   g_debug ("Bus acquired, exporting manager...");
 
-  g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (manager),
-                                    connection,
-                                    FB_DBUS_PATH,
-                                    NULL);
+  /* Taps shouldn't wait for housekeeping on the main context */
+  fbd_dispatcher_export (dispatcher,
+                         G_DBUS_INTERFACE_SKELETON (manager),
+                         connection,
+                         FB_DBUS_PATH,
+                         NULL);
 
   haptic_manager = fbd_feedback_manager_get_haptic_manager (manager);
   if (haptic_manager) {
     g_debug ("Exporting haptic manager...");
-    g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (haptic_manager),
-                                      connection,
-                                      FB_DBUS_PATH,
-                                      NULL);
+    fbd_dispatcher_export (dispatcher,
+                           G_DBUS_INTERFACE_SKELETON (haptic_manager),
+                           connection,
+                           FB_DBUS_PATH,
+                           NULL);
   }
+
+  g_debug ("Exporting stats...");
+  g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (fbd_stats_get_default ()),
+                                    connection,
+                                    FB_DBUS_PATH,
+                                    NULL);
 }
 
 
@@ -125,13 +185,175 @@ out:
 }
 
 
+static gboolean
+user_in_group (uid_t uid, gid_t gid)
+{
+  struct passwd *pw = getpwuid (uid);
+  g_autofree gid_t *groups = NULL;
+  int n_groups = 0;
+
+  if (pw == NULL)
+    return FALSE;
+
+  if (pw->pw_gid == gid)
+    return TRUE;
+
+  /* Get the number of groups first */
+  getgrouplist (pw->pw_name, pw->pw_gid, NULL, &n_groups);
+  groups = g_new0 (gid_t, n_groups);
+  if (getgrouplist (pw->pw_name, pw->pw_gid, groups, &n_groups) < 0)
+    return FALSE;
+
+  for (int i = 0; i < n_groups; i++) {
+    if (groups[i] == gid)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static gboolean
+on_broker_allow_mechanism (GDBusAuthObserver *observer, const char *mechanism, gpointer unused)
+{
+  /* We need the peer's credentials */
+  return g_str_equal (mechanism, "EXTERNAL");
+}
+
+
+static gboolean
+on_broker_authorize_peer (GDBusAuthObserver *observer,
+                          GIOStream         *stream,
+                          GCredentials      *credentials,
+                          gpointer           user_data)
+{
+  struct group *gr = getgrnam (FEEDBACKD_BROKER_GROUP);
+  uid_t uid;
+
+  if (credentials == NULL) {
+    g_warning ("Rejecting session without credentials");
+    return FALSE;
+  }
+
+  uid = g_credentials_get_unix_user (credentials, NULL);
+  if (uid == (uid_t)-1)
+    return FALSE;
+
+  if (uid == 0 || uid == geteuid ())
+    return TRUE;
+
+  if (gr && user_in_group (uid, gr->gr_gid))
+    return TRUE;
+
+  g_warning ("Rejecting session of uid %d, not in group '%s'", (int)uid, FEEDBACKD_BROKER_GROUP);
+  return FALSE;
+}
+
+
+static gboolean
+on_broker_new_connection (GDBusServer        *server,
+                          GDBusConnection    *connection,
+                          FbdFeedbackManager *manager)
+{
+  g_autoptr (GError) err = NULL;
+
+  /* The server starts message processing once we return */
+  if (!fbd_feedback_manager_add_peer (manager, connection, &err)) {
+    g_warning ("Failed to add session: %s", err->message);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * A broker owns the devices and the theme. The user sessions connect
+ * to it via a private socket and show up as peers of the feedback
+ * manager so all their events go through the same scheduler. Only
+ * root, the broker's own user and members of FEEDBACKD_BROKER_GROUP
+ * may connect: the socket is only accessible to that group and peers
+ * are checked again via their credentials.
+ */
+static GDBusServer *
+broker_start (FbdFeedbackManager *manager, const char *path, GError **error)
+{
+  g_autoptr (GDBusServer) server = NULL;
+  g_autoptr (GDBusAuthObserver) observer = NULL;
+  g_autofree char *dir = g_path_get_dirname (path);
+  g_autofree char *escaped = g_dbus_address_escape_value (path);
+  g_autofree char *address = g_strdup_printf ("unix:path=%s", escaped);
+  g_autofree char *guid = g_dbus_generate_guid ();
+  struct group *gr;
+
+  if (g_mkdir_with_parents (dir, 0755) < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to create %s: %s", dir, g_strerror (errno));
+    return NULL;
+  }
+  /* Left over by a previous broker */
+  g_unlink (path);
+
+  observer = g_dbus_auth_observer_new ();
+  g_signal_connect (observer, "allow-mechanism", G_CALLBACK (on_broker_allow_mechanism), NULL);
+  g_signal_connect (observer, "authorize-authenticated-peer",
+                    G_CALLBACK (on_broker_authorize_peer), NULL);
+
+  server = g_dbus_server_new_sync (address, G_DBUS_SERVER_FLAGS_NONE, guid, observer, NULL, error);
+  if (server == NULL)
+    return NULL;
+
+  g_signal_connect_object (server, "new-connection",
+                           G_CALLBACK (on_broker_new_connection), manager, 0);
+
+  gr = getgrnam (FEEDBACKD_BROKER_GROUP);
+  if (gr == NULL) {
+    g_warning ("No group '%s', only uid %d can connect", FEEDBACKD_BROKER_GROUP, (int)geteuid ());
+    if (g_chmod (path, 0600) < 0)
+      g_warning ("Failed to restrict %s: %s", path, g_strerror (errno));
+  } else if (chown (path, -1, gr->gr_gid) < 0 || g_chmod (path, 0660) < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to set permissions of %s: %s", path, g_strerror (errno));
+    return NULL;
+  }
+
+  g_dbus_server_start (server);
+
+  g_info ("Broker listening on %s", path);
+  return g_steal_pointer (&server);
+}
+
+
+static void
+on_broker_closed (GDBusConnection *connection,
+                  gboolean         remote_peer_vanished,
+                  GError          *error,
+                  gpointer         user_data)
+{
+  int *ret = user_data;
+
+  g_warning ("Lost connection to broker");
+  *ret = EXIT_FAILURE;
+  g_main_loop_quit (loop);
+}
+
+
 int
 main (int argc, char *argv[])
 {
   g_autoptr (GError) err = NULL;
   gboolean opt_verbose = FALSE, opt_replace = FALSE, opt_version = FALSE;
+  gboolean opt_broker = FALSE, opt_frontend = FALSE;
+  g_autofree char *opt_broker_socket = NULL;
   g_autoptr (GOptionContext) opt_context = NULL;
+  /* Outlives the manager so its devices can still account for samples */
+  g_autoptr (FbdStats) stats = NULL;
+  /* Flushes the trace on exit */
+  g_autoptr (FbdRecorder) recorder = NULL;
+  /* Outlives the manager so pending method calls can still be handled */
+  g_autoptr (FbdDispatcher) dispatcher = NULL;
   g_autoptr (FbdFeedbackManager) manager = NULL;
+  g_autoptr (GDBusServer) broker = NULL;
+  g_autoptr (FbdBrokerFrontend) broker_frontend = NULL;
   gboolean ret = EXIT_SUCCESS;
   const char *debugenv;
   GOptionEntry options[] = {
@@ -139,6 +361,14 @@ main (int argc, char *argv[])
       "Print debug information during command processing", NULL },
     { "replace", 'r', 0, G_OPTION_ARG_NONE, &opt_replace, "Replace a running instance", NULL },
     { "version", 0, 0, G_OPTION_ARG_NONE, &opt_version, "Print program version", NULL },
+    { "idle-exit", 0, 0, G_OPTION_ARG_INT, &idle_exit,
+      "Exit after being idle for the given number of seconds", "SECONDS" },
+    { "broker", 0, 0, G_OPTION_ARG_NONE, &opt_broker,
+      "Drive the devices for all user sessions", NULL },
+    { "frontend", 0, 0, G_OPTION_ARG_NONE, &opt_frontend,
+      "Forward the session's feedback requests to a broker", NULL },
+    { "broker-socket", 0, 0, G_OPTION_ARG_FILENAME, &opt_broker_socket,
+      "The socket of the broker (default: " FEEDBACKD_BROKER_SOCKET ")", "PATH" },
     { NULL }
   };
 
@@ -163,27 +393,82 @@ main (int argc, char *argv[])
                                           debug_keys,
                                           G_N_ELEMENTS (debug_keys));
 
-  manager = fbd_feedback_manager_get_default ();
-  fbd_feedback_manager_load_theme (manager);
+  if (opt_broker && opt_frontend) {
+    g_warning ("--broker and --frontend are mutually exclusive");
+    return EXIT_FAILURE;
+  }
+
+  if (opt_broker_socket == NULL)
+    opt_broker_socket = g_strdup (FEEDBACKD_BROKER_SOCKET);
+
+  if (opt_frontend) {
+    g_autoptr (GDBusConnection) connection = NULL;
+    g_autofree char *escaped = g_dbus_address_escape_value (opt_broker_socket);
+    g_autofree char *address = g_strdup_printf ("unix:path=%s", escaped);
+
+    /* No devices to probe and no theme to parse */
+    connection = g_dbus_connection_new_for_address_sync (
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+      NULL,
+      NULL,
+      &err);
+    if (connection == NULL) {
+      g_warning ("Failed to connect to broker at %s: %s", opt_broker_socket, err->message);
+      return EXIT_FAILURE;
+    }
+    g_signal_connect (connection, "closed", G_CALLBACK (on_broker_closed), &ret);
+
+    broker_frontend = fbd_broker_frontend_new (connection);
+    frontend = broker_frontend;
+  } else {
+    stats = fbd_stats_get_default ();
+    recorder = fbd_recorder_get_default ();
+    dispatcher = fbd_dispatcher_get_default ();
+    manager = fbd_feedback_manager_get_default ();
+    fbd_feedback_manager_load_theme (manager);
+  }
 
   g_unix_signal_add (SIGTERM, quit_cb, NULL);
   g_unix_signal_add (SIGINT, quit_cb, NULL);
   g_unix_signal_add (SIGHUP, reload_cb, NULL);
 
+  if (opt_broker) {
+    broker = broker_start (manager, opt_broker_socket, &err);
+    if (broker == NULL) {
+      g_warning ("Failed to start broker: %s", err->message);
+      return EXIT_FAILURE;
+    }
+
+    loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (loop);
+    g_dbus_server_stop (broker);
+    g_unlink (opt_broker_socket);
+    g_main_loop_unref (loop);
+
+    return ret;
+  }
+
   loop = g_main_loop_new (NULL, FALSE);
 
-  g_bus_own_name (FB_DBUS_TYPE,
-                  FB_DBUS_NAME,
-                  G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
-                  (opt_replace ? G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
-                  bus_acquired_cb,
-                  name_acquired_cb,
-                  name_lost_cb,
-                  &ret,
-                  NULL);
+  name_id = g_bus_own_name (FB_DBUS_TYPE,
+                            FB_DBUS_NAME,
+                            G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
+                            (opt_replace ? G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
+                            bus_acquired_cb,
+                            name_acquired_cb,
+                            name_lost_cb,
+                            &ret,
+                            NULL);
+
+  if (idle_exit > 0 && frontend == NULL)
+    on_idle_exit_check (NULL);
 
   g_main_loop_run (loop);
   g_main_loop_unref (loop);
+  if (broker_frontend)
+    fbd_broker_frontend_unexport (broker_frontend);
+  frontend = NULL;
 
   return ret;
 }
@@ -10,12 +10,27 @@ G_BEGIN_DECLS
  */
 #define FEEDBACKD_UDEV_ATTR    "FEEDBACKD_TYPE"
 #define FEEDBACKD_UDEV_VAL_LED "led"
+#define FEEDBACKD_UDEV_VAL_VIBRA "vibra"
+/* Optional tag so themes can pick a haptic motor */
+#define FEEDBACKD_UDEV_ACTUATOR "FEEDBACKD_ACTUATOR"
+/* Optional time in ms a haptic motor needs to spin up and down */
+#define FEEDBACKD_UDEV_SPIN_UP   "FEEDBACKD_SPIN_UP"
+#define FEEDBACKD_UDEV_SPIN_DOWN "FEEDBACKD_SPIN_DOWN"
+/* Optional class of haptic motors that can't be driven at different strengths */
+#define FEEDBACKD_UDEV_ACTUATOR_CLASS        "FEEDBACKD_ACTUATOR_CLASS"
+#define FEEDBACKD_UDEV_VAL_ACTUATOR_ON_OFF   "on-off"
 
 #define FEEDBACKD_SCHEMA_ID "org.sigxcpu.feedbackd"
 
+/* Where a broker listens for the front-ends of the user sessions */
+#define FEEDBACKD_BROKER_SOCKET "/run/feedbackd/broker"
+/* Members of this group may connect to the broker */
+#define FEEDBACKD_BROKER_GROUP "feedbackd"
+
 typedef enum {
     FBD_ERROR_FAILED = 0,
     FBD_ERROR_THEME_EXPAND = 1,
+    FBD_ERROR_THEME_INVALID = 2,
 } FbdError;
 
 GQuark fbd_error_quark (void);
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * Microbenchmarks for the paths involved in dispatching an event:
+ * theme loading and lookup, running feedbacks via an event and
+ * driving the LEDs. Run via `meson test --benchmark`.
+ */
+
+#include "benchlib.h"
+#include "testlib.h"
+
+#include "fbd-dev-leds.h"
+#include "fbd-event.h"
+#include "fbd-feedback-dummy.h"
+#include "fbd-theme-expander.h"
+#include "fbd-udev.h"
+
+#include <glib.h>
+
+#include <stdlib.h>
+
+static FbdFeedbackTheme *
+load_theme (void)
+{
+  const char *compatibles[] = { "doesnotexist", NULL };
+  g_autoptr (FbdThemeExpander) expander = fbd_theme_expander_new (compatibles, NULL, NULL);
+  g_autoptr (GError) err = NULL;
+  FbdFeedbackTheme *theme;
+
+  theme = fbd_theme_expander_load_theme_files (expander, &err);
+  g_assert_no_error (err);
+
+  return theme;
+}
+
+
+static void
+bench_theme_expand (gpointer unused)
+{
+  g_object_unref (load_theme ());
+}
+
+
+static void
+bench_theme_lookup (gpointer data)
+{
+  FbdFeedbackTheme *theme = FBD_FEEDBACK_THEME (data);
+  GArray *feedbacks;
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "test-dummy-0");
+  g_assert_nonnull (feedbacks);
+}
+
+
+static void
+bench_theme_lookup_missing (gpointer data)
+{
+  FbdFeedbackTheme *theme = FBD_FEEDBACK_THEME (data);
+  GArray *feedbacks;
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "does-not-exist");
+  g_assert_null (feedbacks);
+}
+
+
+/* Like the manager's trigger path for a tracked event minus D-Bus */
+static void
+bench_event_trigger (gpointer data)
+{
+  FbdFeedbackTheme *theme = FBD_FEEDBACK_THEME (data);
+  g_autoptr (FbdEvent) event = NULL;
+  GArray *feedbacks;
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "test-dummy-0");
+  event = fbd_event_new (1, "org.sigxcpu.bench", "test-dummy-0", FBD_EVENT_TIMEOUT_ONESHOT,
+                         ":1.1");
+  for (guint i = 0; i < feedbacks->len; i++) {
+    FbdFeedbackThemeEntry *entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, i);
+
+    fbd_event_add_feedback (event, entry->feedback, entry->level);
+  }
+  fbd_event_run_feedbacks (event);
+  g_assert_true (fbd_event_get_feedbacks_ended (event));
+}
+
+
+static void
+bench_playback_run (gpointer data)
+{
+  FbdFeedbackBase *feedback = FBD_FEEDBACK_BASE (data);
+  g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+  playback = fbd_feedback_playback_new (feedback, FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+  fbd_feedback_playback_run (playback);
+}
+
+
+static void
+bench_leds_periodic (gpointer data)
+{
+  FbdDevLeds *leds = FBD_DEV_LEDS (data);
+  static guint freq = 1000;
+  int owner;
+
+  /* Alternate so the pattern actually gets written */
+  freq = freq == 1000 ? 2000 : 1000;
+  fbd_dev_leds_start_periodic (leds, &owner, 10, FBD_FEEDBACK_LED_COLOR_WHITE, NULL, 100, freq);
+  fbd_dev_leds_stop (leds, &owner);
+  fbd_udev_flush_sysfs_attrs ();
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  FbdUmockdevFixture fixture = { 0 };
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (FbdFeedbackDummy) dummy = NULL;
+  g_autoptr (FbdDevLeds) leds = NULL;
+  g_autoptr (GError) err = NULL;
+
+  theme = load_theme ();
+  dummy = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, "event-name", "bench", NULL);
+
+  fbd_bench_run ("theme/expand", bench_theme_expand, NULL);
+  fbd_bench_run ("theme/lookup", bench_theme_lookup, theme);
+  fbd_bench_run ("theme/lookup-missing", bench_theme_lookup_missing, theme);
+  fbd_bench_run ("playback/run", bench_playback_run, dummy);
+  fbd_bench_run ("event/trigger", bench_event_trigger, theme);
+
+  fbd_test_umockdev_setup (&fixture, "led-simple");
+  leds = fbd_dev_leds_new (&err);
+  g_assert_no_error (err);
+  fbd_bench_run ("leds/periodic", bench_leds_periodic, leds);
+  g_clear_object (&leds);
+  fbd_test_umockdev_teardown (&fixture, NULL);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * Microbenchmarks for the client side of triggering events: creating
+ * events, building their hints, the sync and async trigger paths
+ * including the FeedbackEnded dispatch and tearing down libfeedback
+ * with running events. Runs against feedbackd on a private bus. Run
+ * via `meson test --benchmark`.
+ *
+ * Toolkits trigger events on every key press so keep the numbers
+ * in check.
+ */
+
+#include "benchlib.h"
+
+#include "libfeedback.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <stdlib.h>
+
+/* Disable rate limiting in the daemon so it doesn't skew the results */
+#define SETTINGS_KEYFILE                                                \
+  "[org/sigxcpu/feedbackd]\n"                                           \
+  "rate-limit-burst=uint32 0\n"
+
+/* Dummy feedbacks from the test theme: one ending right away and one running for 10s */
+#define EVENT_ONESHOT "test-dummy-0"
+#define EVENT_RUNNING "test-dummy-10"
+
+typedef struct _LfbBenchEvent {
+  LfbEvent *event;
+  guint     n_ended;
+  gboolean  done;
+} LfbBenchEvent;
+
+
+static void
+on_feedback_ended (LfbEvent *event, LfbBenchEvent *bench)
+{
+  bench->n_ended++;
+}
+
+
+static void
+bench_event_init (LfbBenchEvent *bench, const char *name)
+{
+  bench->event = lfb_event_new (name);
+  g_signal_connect (bench->event, "feedback-ended", G_CALLBACK (on_feedback_ended), bench);
+}
+
+/* Runs the main context until the daemon told us the feedbacks ended */
+static void
+wait_ended (LfbBenchEvent *bench, guint n_ended)
+{
+  while (bench->n_ended < n_ended)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+
+static void
+bench_event_new (gpointer unused)
+{
+  LfbEvent *event = lfb_event_new (EVENT_ONESHOT);
+
+  g_object_unref (event);
+}
+
+
+static void
+bench_trigger_sync (gpointer data)
+{
+  LfbBenchEvent *bench = data;
+  guint n_ended = bench->n_ended;
+  g_autoptr (GError) err = NULL;
+
+  g_assert_true (lfb_event_trigger_feedback (bench->event, &err));
+  g_assert_no_error (err);
+  wait_ended (bench, n_ended + 1);
+}
+
+/* Changing a hint drops the cached hints so they get built again */
+static void
+bench_trigger_sync_hints (gpointer data)
+{
+  LfbBenchEvent *bench = data;
+
+  lfb_event_set_important (bench->event, !lfb_event_get_important (bench->event));
+  bench_trigger_sync (data);
+}
+
+
+static void
+on_trigger_done (LfbEvent *event, GAsyncResult *res, LfbBenchEvent *bench)
+{
+  g_autoptr (GError) err = NULL;
+
+  g_assert_true (lfb_event_trigger_feedback_finish (event, res, &err));
+  g_assert_no_error (err);
+  bench->done = TRUE;
+}
+
+
+static void
+bench_trigger_async (gpointer data)
+{
+  LfbBenchEvent *bench = data;
+  guint n_ended = bench->n_ended;
+
+  bench->done = FALSE;
+  lfb_event_trigger_feedback_async (bench->event,
+                                    NULL,
+                                    (GAsyncReadyCallback)on_trigger_done,
+                                    bench);
+  wait_ended (bench, n_ended + 1);
+  while (!bench->done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+
+static void
+bench_retrigger (gpointer data)
+{
+  LfbBenchEvent *bench = data;
+  guint n_ended = bench->n_ended;
+
+  lfb_event_retrigger_async (bench->event, NULL);
+  wait_ended (bench, n_ended + 1);
+}
+
+/* Uninit needs to end the running events and cancel pending calls */
+static void
+bench_uninit (gpointer unused)
+{
+  g_autoptr (LfbEvent) running = lfb_event_new (EVENT_RUNNING);
+  g_autoptr (LfbEvent) pending = lfb_event_new (EVENT_RUNNING);
+  g_autoptr (GError) err = NULL;
+
+  g_assert_true (lfb_init (TEST_APP_ID, &err));
+  g_assert_no_error (err);
+
+  g_assert_true (lfb_event_trigger_feedback (running, &err));
+  g_assert_no_error (err);
+  lfb_event_trigger_feedback_async (pending, NULL, NULL, NULL);
+
+  lfb_uninit ();
+  /* Let cancelled calls complete */
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+
+static char *
+write_config (void)
+{
+  g_autoptr (GError) err = NULL;
+  char *tmpdir = g_dir_make_tmp ("bench-lfb-XXXXXX", &err);
+  g_autofree char *settings_dir = NULL;
+  g_autofree char *keyfile = NULL;
+
+  g_assert_no_error (err);
+  settings_dir = g_build_filename (tmpdir, "glib-2.0", "settings", NULL);
+  keyfile = g_build_filename (settings_dir, "keyfile", NULL);
+  g_assert_cmpint (g_mkdir_with_parents (settings_dir, 0700), ==, 0);
+  g_file_set_contents (keyfile, SETTINGS_KEYFILE, -1, &err);
+  g_assert_no_error (err);
+
+  return tmpdir;
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GTestDBus) dbus = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *builddir = NULL;
+  g_autofree char *servicesdir = NULL;
+  LfbBenchEvent oneshot = { 0 };
+
+  /* Inherited by the bus and thus the daemon */
+  tmpdir = write_config ();
+  g_setenv ("FEEDBACK_THEME", TEST_DATA_DIR "/test.json", TRUE);
+  g_setenv ("XDG_CONFIG_HOME", tmpdir, TRUE);
+  g_setenv ("GSETTINGS_BACKEND", "keyfile", TRUE);
+
+  dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  builddir = g_strdup (g_getenv ("G_TEST_BUILDDIR"));
+  if (builddir == NULL)
+    builddir = g_path_get_dirname (argv[0]);
+  servicesdir = g_canonicalize_filename ("services", builddir);
+  g_test_dbus_add_service_dir (dbus, servicesdir);
+  g_test_dbus_up (dbus);
+
+  fbd_bench_run ("event/new", bench_event_new, NULL);
+
+  if (!lfb_init (TEST_APP_ID, &err)) {
+    g_printerr ("Failed to init libfeedback: %s\n", err->message);
+    return EXIT_FAILURE;
+  }
+
+  bench_event_init (&oneshot, EVENT_ONESHOT);
+  fbd_bench_run ("event/trigger-sync", bench_trigger_sync, &oneshot);
+  fbd_bench_run ("event/trigger-sync-hints", bench_trigger_sync_hints, &oneshot);
+  fbd_bench_run ("event/trigger-async", bench_trigger_async, &oneshot);
+  fbd_bench_run ("event/retrigger", bench_retrigger, &oneshot);
+  g_clear_object (&oneshot.event);
+
+  lfb_uninit ();
+  fbd_bench_run ("lfb/uninit", bench_uninit, NULL);
+
+  g_test_dbus_down (dbus);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * A minimal benchmark harness shared by the benchmarks
+ */
+
+#include "benchlib.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef __GLIBC__
+/*
+ * Count allocations by wrapping glibc's allocator. Atomic as GLib
+ * might allocate from its worker threads.
+ */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static guint64 n_allocs;
+
+void *
+malloc (size_t size)
+{
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc (ptr, size);
+}
+
+static guint64
+get_n_allocs (void)
+{
+  return __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+}
+#define HAVE_ALLOC_COUNT 1
+#else
+static guint64
+get_n_allocs (void)
+{
+  return 0;
+}
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+
+static gint64
+get_time_ns (clockid_t clock)
+{
+  struct timespec ts;
+
+  clock_gettime (clock, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+typedef struct _FbdBenchSample {
+  gint64  elapsed;
+  gint64  cpu;
+  guint64 allocs;
+} FbdBenchSample;
+
+
+static void
+measure (FbdBenchFunc func, gpointer data, guint64 iterations, FbdBenchSample *sample)
+{
+  guint64 allocs = get_n_allocs ();
+  gint64 cpu = get_time_ns (CLOCK_PROCESS_CPUTIME_ID);
+  gint64 start = get_time_ns (CLOCK_MONOTONIC);
+
+  for (guint64 i = 0; i < iterations; i++)
+    func (data);
+
+  sample->elapsed = get_time_ns (CLOCK_MONOTONIC) - start;
+  sample->cpu = get_time_ns (CLOCK_PROCESS_CPUTIME_ID) - cpu;
+  sample->allocs = get_n_allocs () - allocs;
+}
+
+/**
+ * fbd_bench_run:
+ * @name: The benchmark's name
+ * @func: The operation to measure
+ * @data: Data passed to @func
+ *
+ * Runs @func repeatedly for about `FBD_BENCH_TIME` milliseconds and
+ * prints the wall clock time, the CPU time of the whole process per
+ * 1000 operations and, with glibc, the allocations per operation.
+ * CPU time includes the process' worker threads, e.g. GDBus'.
+ */
+void
+fbd_bench_run (const char *name, FbdBenchFunc func, gpointer data)
+{
+  static gint64 bench_time_ns;
+  guint64 iterations = 1;
+  FbdBenchSample sample;
+
+  if (bench_time_ns == 0) {
+    const char *env = g_getenv ("FBD_BENCH_TIME");
+    guint64 ms = FBD_BENCH_DEFAULT_TIME;
+
+    if (env)
+      ms = g_ascii_strtoull (env, NULL, 10);
+    bench_time_ns = MAX (ms, 1) * 1000000;
+  }
+
+  /* Warm up caches and pools, then grow the iterations until it takes long enough */
+  func (data);
+  while (TRUE) {
+    measure (func, data, iterations, &sample);
+
+    if (sample.elapsed >= bench_time_ns / 10 || iterations >= G_MAXUINT32)
+      break;
+    iterations *= 10;
+  }
+  /* Scale up to the requested time and measure for real */
+  if (sample.elapsed > 0 && sample.elapsed < bench_time_ns) {
+    iterations = MAX (iterations * bench_time_ns / sample.elapsed, 1);
+    measure (func, data, iterations, &sample);
+  }
+
+  g_print ("%-28s %12" G_GUINT64_FORMAT " ops %12.1f ns/op %10.3f cpu ms/1k ops",
+           name, iterations, (double)sample.elapsed / iterations,
+           (double)sample.cpu / iterations / 1000.0);
+  if (HAVE_ALLOC_COUNT)
+    g_print (" %10.2f allocs/op", (double)sample.allocs / iterations);
+  g_print ("\n");
+}
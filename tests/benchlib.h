@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include <glib.h>
+
+#pragma once
+
+G_BEGIN_DECLS
+
+/* How long to run each benchmark, can be overridden via FBD_BENCH_TIME (ms) */
+#define FBD_BENCH_DEFAULT_TIME 500
+
+typedef void (*FbdBenchFunc) (gpointer data);
+
+void fbd_bench_run (const char *name, FbdBenchFunc func, gpointer data);
+
+G_END_DECLS
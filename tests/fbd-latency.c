@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * End to end latency harness: starts feedbackd on a private bus
+ * against umockdev devices, triggers feedback at a fixed rate via
+ * libfeedback and timestamps when the output reaches the mock
+ * devices. Run via `meson test --benchmark fbd-latency` or directly
+ * under `umockdev-wrapper`.
+ */
+
+#include "testlib.h"
+
+#include "libfeedback.h"
+#include "lfb-names.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define LED_PATH "/sys/devices/LNXSYSTM:00/LNXSYBUS:00/PURI4543:00/leds/blue:status"
+#define LED_EVENT "x-fbd-latency-led"
+/* Output that didn't show up within this time (µs) counts as lost */
+#define OUTPUT_TIMEOUT (G_USEC_PER_SEC)
+
+#define THEME_JSON                                                      \
+  "{\n"                                                                 \
+  "  \"name\" : \"latency\",\n"                                         \
+  "  \"profiles\" : [ {\n"                                              \
+  "    \"name\" : \"full\",\n"                                          \
+  "    \"feedbacks\" : [\n"                                             \
+  "      { \"event-name\" : \"" LED_EVENT "\", \"type\" : \"Led\",\n"   \
+  "        \"color\" : \"white\", \"frequency\" : 1000 }\n"             \
+  "    ]\n"                                                             \
+  "  } ]\n"                                                             \
+  "}\n"
+
+/* Disable rate limiting in the daemon so it doesn't skew the results */
+#define SETTINGS_KEYFILE                                                \
+  "[org/sigxcpu/feedbackd]\n"                                           \
+  "rate-limit-burst=uint32 0\n"
+
+typedef struct _FbdLatency {
+  GMainLoop              *loop;
+  int                     inotify_fd;
+  int                     pattern_wd;
+
+  /* The current LED event, ended once triggered and its output showed up */
+  LfbEvent               *event;
+  gint64                  trigger_time;
+  gboolean                triggered;
+  gboolean                output_seen;
+
+  LfbGdbusFeedbackHaptic *haptic;
+
+  /* Samples in µs */
+  GArray                 *output;
+  GArray                 *trigger_rtt;
+  GArray                 *vibrate_rtt;
+  guint                   lost;
+  guint                   overruns;
+  guint                   errors;
+} FbdLatency;
+
+
+static int
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  gint64 sa = *(const gint64 *)a;
+  gint64 sb = *(const gint64 *)b;
+
+  return (sa > sb) - (sa < sb);
+}
+
+
+static void
+print_report (const char *name, GArray *samples)
+{
+  double mean = 0.0, var = 0.0;
+  gint64 *values;
+  guint n = samples->len;
+
+  if (n == 0) {
+    g_print ("%-32s no samples\n", name);
+    return;
+  }
+
+  g_array_sort (samples, compare_samples);
+  values = (gint64 *)samples->data;
+
+  for (guint i = 0; i < n; i++)
+    mean += values[i];
+  mean /= n;
+  for (guint i = 0; i < n; i++)
+    var += (values[i] - mean) * (values[i] - mean);
+
+  g_print ("%-32s n=%-6u p50=%-8" G_GINT64_FORMAT " p90=%-8" G_GINT64_FORMAT
+           " p99=%-8" G_GINT64_FORMAT " max=%-8" G_GINT64_FORMAT " jitter=%.1f (µs)\n",
+           name, n,
+           values[(n - 1) * 50 / 100],
+           values[(n - 1) * 90 / 100],
+           values[(n - 1) * 99 / 100],
+           values[n - 1],
+           sqrt (var / n));
+}
+
+
+static void
+on_end_feedback_finished (LfbEvent *event, GAsyncResult *res, FbdLatency *self)
+{
+  g_autoptr (GError) err = NULL;
+
+  if (!lfb_event_end_feedback_finish (event, res, &err)) {
+    g_warning ("Failed to end feedback: %s", err->message);
+    self->errors++;
+  }
+  g_object_unref (event);
+}
+
+
+static void
+end_led_event (FbdLatency *self)
+{
+  LfbEvent *event = g_steal_pointer (&self->event);
+
+  /* Without an event id there's nothing to end */
+  if (!self->triggered) {
+    g_object_unref (event);
+    return;
+  }
+
+  /* The reference is dropped once the daemon ended the event */
+  lfb_event_end_feedback_async (event, NULL,
+                                (GAsyncReadyCallback)on_end_feedback_finished,
+                                self);
+}
+
+
+static void
+maybe_end_led_event (FbdLatency *self)
+{
+  if (self->event && self->triggered && self->output_seen)
+    end_led_event (self);
+}
+
+
+static gboolean
+on_inotify (int fd, GIOCondition condition, FbdLatency *self)
+{
+  gint64 now = g_get_monotonic_time ();
+  char buf[sizeof (struct inotify_event) * 16] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  gboolean modified = FALSE;
+  gssize len;
+
+  len = read (fd, buf, sizeof (buf));
+  for (char *p = buf; len > 0 && p < buf + len;) {
+    struct inotify_event *ev = (struct inotify_event *)p;
+
+    if (ev->wd == self->pattern_wd && (ev->mask & IN_MODIFY))
+      modified = TRUE;
+    p += sizeof (struct inotify_event) + ev->len;
+  }
+
+  /* Writes are followed by a truncate, only the first change counts */
+  if (modified && self->event && !self->output_seen) {
+    gint64 latency = now - self->trigger_time;
+
+    g_array_append_val (self->output, latency);
+    self->output_seen = TRUE;
+    maybe_end_led_event (self);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+typedef struct _FbdTriggerData {
+  FbdLatency *self;
+  gint64      start;
+} FbdTriggerData;
+
+
+static void
+on_trigger_feedback_finished (LfbEvent *event, GAsyncResult *res, FbdTriggerData *data)
+{
+  g_autoptr (GError) err = NULL;
+  gint64 rtt = g_get_monotonic_time () - data->start;
+
+  if (lfb_event_trigger_feedback_finish (event, res, &err)) {
+    g_array_append_val (data->self->trigger_rtt, rtt);
+    if (event == data->self->event) {
+      data->self->triggered = TRUE;
+      maybe_end_led_event (data->self);
+    }
+  } else {
+    g_warning ("Failed to trigger feedback: %s", err->message);
+    data->self->errors++;
+  }
+
+  g_free (data);
+}
+
+
+static void
+on_vibrate_finished (LfbGdbusFeedbackHaptic *proxy, GAsyncResult *res, FbdTriggerData *data)
+{
+  g_autoptr (GError) err = NULL;
+  gint64 rtt = g_get_monotonic_time () - data->start;
+
+  if (lfb_gdbus_feedback_haptic_call_vibrate_finish (proxy, NULL, res, &err)) {
+    g_array_append_val (data->self->vibrate_rtt, rtt);
+  } else {
+    g_warning ("Failed to vibrate: %s", err->message);
+    data->self->errors++;
+  }
+
+  g_free (data);
+}
+
+
+static gboolean
+on_tick (FbdLatency *self)
+{
+  FbdTriggerData *data;
+  gint64 now = g_get_monotonic_time ();
+
+  if (self->event) {
+    if (now - self->trigger_time < OUTPUT_TIMEOUT) {
+      self->overruns++;
+      return G_SOURCE_CONTINUE;
+    }
+    self->lost++;
+    end_led_event (self);
+  }
+
+  self->event = lfb_event_new (LED_EVENT);
+  self->trigger_time = now;
+  self->triggered = FALSE;
+  self->output_seen = FALSE;
+
+  data = g_new0 (FbdTriggerData, 1);
+  data->self = self;
+  data->start = now;
+  lfb_event_trigger_feedback_async (self->event, NULL,
+                                    (GAsyncReadyCallback)on_trigger_feedback_finished,
+                                    data);
+
+  if (self->haptic) {
+    GVariantBuilder pattern;
+
+    g_variant_builder_init (&pattern, G_VARIANT_TYPE ("a(du)"));
+    g_variant_builder_add (&pattern, "(du)", 1.0, 20);
+
+    data = g_new0 (FbdTriggerData, 1);
+    data->self = self;
+    data->start = g_get_monotonic_time ();
+    lfb_gdbus_feedback_haptic_call_vibrate (self->haptic,
+                                            lfb_get_app_id (),
+                                            g_variant_builder_end (&pattern),
+                                            NULL,
+                                            (GAsyncReadyCallback)on_vibrate_finished,
+                                            data);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+on_duration_expired (FbdLatency *self)
+{
+  g_main_loop_quit (self->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+print_daemon_stats (void)
+{
+  g_autoptr (LfbGdbusFeedbackStats) stats = NULL;
+  g_autoptr (GVariant) counters = NULL;
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GError) err = NULL;
+  GVariantIter iter;
+  const char *name;
+  guint64 value;
+
+  stats = lfb_gdbus_feedback_stats_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                           G_DBUS_PROXY_FLAGS_NONE,
+                                                           FB_DBUS_NAME,
+                                                           FB_DBUS_PATH,
+                                                           NULL,
+                                                           &err);
+  if (stats == NULL ||
+      !lfb_gdbus_feedback_stats_call_get_stats_sync (stats, &counters, &histograms, NULL, &err)) {
+    g_warning ("Failed to get daemon stats: %s", err->message);
+    return;
+  }
+
+  g_print ("Daemon counters:\n");
+  g_variant_iter_init (&iter, counters);
+  while (g_variant_iter_next (&iter, "{&st}", &name, &value))
+    g_print ("  %-20s %" G_GUINT64_FORMAT "\n", name, value);
+}
+
+
+static char *
+write_config (const char *tmpdir)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *settings_dir = g_build_filename (tmpdir, "glib-2.0", "settings", NULL);
+  g_autofree char *keyfile = g_build_filename (settings_dir, "keyfile", NULL);
+  char *theme = g_build_filename (tmpdir, "latency.json", NULL);
+
+  g_assert_cmpint (g_mkdir_with_parents (settings_dir, 0700), ==, 0);
+  g_file_set_contents (keyfile, SETTINGS_KEYFILE, -1, &err);
+  g_assert_no_error (err);
+  g_file_set_contents (theme, THEME_JSON, -1, &err);
+  g_assert_no_error (err);
+
+  return theme;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GTestDBus) dbus = NULL;
+  g_autofree char *vibra_fixture = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *theme = NULL;
+  g_autofree char *servicesdir = NULL;
+  g_autofree char *pattern_file = NULL;
+  g_autofree char *builddir = NULL;
+  FbdUmockdevFixture fixture = { 0 };
+  FbdLatency self = { 0 };
+  int rate = 20, duration = 10;
+  const GOptionEntry options[] = {
+    { "rate", 'r', 0, G_OPTION_ARG_INT, &rate, "Events per second", NULL },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Duration of the run in seconds", NULL },
+    { "vibra-fixture", 'V', 0, G_OPTION_ARG_FILENAME, &vibra_fixture,
+      "umockdev file with a haptic device to also measure Haptic.Vibrate", NULL },
+    { NULL }
+  };
+
+  opt_context = g_option_context_new ("- feedbackd end to end latency harness");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return EXIT_FAILURE;
+  }
+  rate = CLAMP (rate, 1, 1000);
+  duration = MAX (duration, 1);
+
+  /* The testbed's environment is inherited by the bus and thus the daemon */
+  fbd_test_umockdev_setup (&fixture, "led-simple");
+  if (vibra_fixture) {
+    umockdev_testbed_add_from_file (fixture.testbed, vibra_fixture, &err);
+    g_assert_no_error (err);
+  }
+
+  tmpdir = g_dir_make_tmp ("fbd-latency-XXXXXX", &err);
+  g_assert_no_error (err);
+  theme = write_config (tmpdir);
+  g_setenv ("FEEDBACK_THEME", theme, TRUE);
+  g_setenv ("XDG_CONFIG_HOME", tmpdir, TRUE);
+  g_setenv ("GSETTINGS_BACKEND", "keyfile", TRUE);
+
+  dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  builddir = g_strdup (g_getenv ("G_TEST_BUILDDIR"));
+  if (builddir == NULL)
+    builddir = g_path_get_dirname (argv[0]);
+  servicesdir = g_canonicalize_filename ("services", builddir);
+  g_test_dbus_add_service_dir (dbus, servicesdir);
+  g_test_dbus_up (dbus);
+
+  if (!lfb_init (TEST_APP_ID, &err)) {
+    g_printerr ("Failed to init libfeedback: %s\n", err->message);
+    return EXIT_FAILURE;
+  }
+
+  if (vibra_fixture) {
+    self.haptic = lfb_gdbus_feedback_haptic_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                                    G_DBUS_PROXY_FLAGS_NONE,
+                                                                    FB_DBUS_NAME,
+                                                                    FB_DBUS_PATH,
+                                                                    NULL,
+                                                                    &err);
+    g_assert_no_error (err);
+  }
+
+  self.output = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self.trigger_rtt = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self.vibrate_rtt = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self.loop = g_main_loop_new (NULL, FALSE);
+
+  pattern_file = g_build_filename (umockdev_testbed_get_root_dir (fixture.testbed),
+                                   LED_PATH, "pattern", NULL);
+  self.inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  g_assert_cmpint (self.inotify_fd, >=, 0);
+  self.pattern_wd = inotify_add_watch (self.inotify_fd, pattern_file, IN_MODIFY);
+  g_assert_cmpint (self.pattern_wd, >=, 0);
+  g_unix_fd_add (self.inotify_fd, G_IO_IN, (GUnixFDSourceFunc)on_inotify, &self);
+
+  g_print ("Triggering %d events/s for %ds\n", rate, duration);
+  g_timeout_add (1000 / rate, (GSourceFunc)on_tick, &self);
+  g_timeout_add_seconds (duration, (GSourceFunc)on_duration_expired, &self);
+  g_main_loop_run (self.loop);
+
+  print_report ("LED output (trigger → sysfs)", self.output);
+  print_report ("TriggerFeedback round trip", self.trigger_rtt);
+  if (self.haptic)
+    print_report ("Haptic.Vibrate round trip", self.vibrate_rtt);
+  g_print ("lost: %u, overruns: %u, errors: %u\n", self.lost, self.overruns, self.errors);
+  print_daemon_stats ();
+
+  g_clear_object (&self.event);
+  g_clear_object (&self.haptic);
+  g_array_unref (self.output);
+  g_array_unref (self.trigger_rtt);
+  g_array_unref (self.vibrate_rtt);
+  g_main_loop_unref (self.loop);
+  close (self.inotify_fd);
+
+  lfb_uninit ();
+  g_test_dbus_down (dbus);
+  fbd_test_umockdev_teardown (&fixture, NULL);
+
+  return self.lost || self.errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
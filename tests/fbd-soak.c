@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * Leak regression test: starts feedbackd on a private bus against
+ * umockdev devices and replays a synthetic workload of triggered and
+ * ended events, theme reloads, LED hotplug and vanishing clients.
+ * Afterwards the daemon's live objects (see the `live-*` counters of
+ * the stats interface) and its resident memory must be back where
+ * they were after a warm up round.
+ *
+ * It takes minutes so it's registered as a benchmark and not run by
+ * default:
+ *
+ *   meson test --benchmark fbd-soak
+ *
+ * To look at the daemon's heap run it under massif:
+ *
+ *   FBD_WRAPPER="valgrind --tool=massif" meson test --benchmark fbd-soak
+ */
+
+#include "testlib.h"
+
+#include "libfeedback.h"
+#include "lfb-names.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_PATH "/sys/devices/LNXSYSTM:00/LNXSYBUS:00/PURI4543:00/leds/blue:status"
+#define LED_EVENT "x-fbd-soak-led"
+#define DUMMY_EVENT "x-fbd-soak-dummy"
+/* How long to wait for the daemon to end all events (µs) */
+#define SETTLE_TIMEOUT (5 * G_USEC_PER_SEC)
+/* How much the daemon's resident memory may grow in KiB */
+#define MAX_RSS_GROWTH 4096
+
+#define THEME_JSON                                                      \
+  "{\n"                                                                 \
+  "  \"name\" : \"soak\",\n"                                            \
+  "  \"profiles\" : [ {\n"                                              \
+  "    \"name\" : \"full\",\n"                                          \
+  "    \"feedbacks\" : [\n"                                             \
+  "      { \"event-name\" : \"" LED_EVENT "\", \"type\" : \"Led\",\n"   \
+  "        \"color\" : \"white\", \"frequency\" : 1000 },\n"            \
+  "      { \"event-name\" : \"" DUMMY_EVENT "\", \"type\" : \"Dummy\",\n" \
+  "        \"duration\" : 5 }\n"                                        \
+  "    ]\n"                                                             \
+  "  } ]\n"                                                             \
+  "}\n"
+
+/* Disable rate limiting in the daemon so the workload isn't throttled */
+#define SETTINGS_KEYFILE                                                \
+  "[org/sigxcpu/feedbackd]\n"                                           \
+  "rate-limit-burst=uint32 0\n"
+
+typedef struct _FbdSoak {
+  GTestDBus             *dbus;
+  UMockdevTestbed       *testbed;
+  LfbGdbusFeedbackStats *stats;
+  guint                  pid;
+} FbdSoak;
+
+
+static char *
+write_config (const char *tmpdir)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *settings_dir = g_build_filename (tmpdir, "glib-2.0", "settings", NULL);
+  g_autofree char *keyfile = g_build_filename (settings_dir, "keyfile", NULL);
+  char *theme = g_build_filename (tmpdir, "soak.json", NULL);
+
+  g_assert_cmpint (g_mkdir_with_parents (settings_dir, 0700), ==, 0);
+  g_file_set_contents (keyfile, SETTINGS_KEYFILE, -1, &err);
+  g_assert_no_error (err);
+  g_file_set_contents (theme, THEME_JSON, -1, &err);
+  g_assert_no_error (err);
+
+  return theme;
+}
+
+
+static guint
+get_daemon_pid (void)
+{
+  g_autoptr (GDBusConnection) conn = NULL;
+  g_autoptr (GVariant) ret = NULL;
+  g_autoptr (GError) err = NULL;
+  guint pid;
+
+  conn = g_bus_get_sync (FB_DBUS_TYPE, NULL, &err);
+  g_assert_no_error (err);
+  ret = g_dbus_connection_call_sync (conn,
+                                     "org.freedesktop.DBus",
+                                     "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus",
+                                     "GetConnectionUnixProcessID",
+                                     g_variant_new ("(s)", FB_DBUS_NAME),
+                                     G_VARIANT_TYPE ("(u)"),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1,
+                                     NULL,
+                                     &err);
+  g_assert_no_error (err);
+  g_variant_get (ret, "(u)", &pid);
+
+  return pid;
+}
+
+
+static guint64
+get_rss (FbdSoak *self)
+{
+  g_autofree char *path = g_strdup_printf ("/proc/%u/status", self->pid);
+  g_autofree char *status = NULL;
+  const char *rss;
+
+  if (!g_file_get_contents (path, &status, NULL, NULL))
+    return 0;
+
+  rss = strstr (status, "VmRSS:");
+  if (rss == NULL)
+    return 0;
+
+  return g_ascii_strtoull (rss + strlen ("VmRSS:"), NULL, 10);
+}
+
+
+static GVariant *
+get_counters (FbdSoak *self)
+{
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GError) err = NULL;
+  GVariant *counters = NULL;
+
+  lfb_gdbus_feedback_stats_call_get_stats_sync (self->stats, &counters, &histograms, NULL, &err);
+  g_assert_no_error (err);
+
+  return counters;
+}
+
+
+static guint64
+lookup_counter (GVariant *counters, const char *name)
+{
+  guint64 value = 0;
+
+  g_assert_true (g_variant_lookup (counters, name, "t", &value));
+  return value;
+}
+
+
+static void
+iterate (guint ms)
+{
+  gint64 until = g_get_monotonic_time () + ms * 1000;
+
+  while (g_get_monotonic_time () < until) {
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+  }
+}
+
+/* Wait until the daemon ended all events and dropped all client watches */
+static GVariant *
+settle (FbdSoak *self)
+{
+  gint64 until = g_get_monotonic_time () + SETTLE_TIMEOUT;
+  GVariant *counters;
+
+  while (TRUE) {
+    counters = get_counters (self);
+    if (lookup_counter (counters, "live-events") == 0 &&
+        lookup_counter (counters, "live-client-watches") == 0)
+      return counters;
+
+    if (g_get_monotonic_time () > until)
+      return counters;
+
+    g_variant_unref (counters);
+    iterate (50);
+  }
+}
+
+
+static void
+trigger_events (void)
+{
+  g_autoptr (GError) err = NULL;
+
+  /* One shot events that end on their own */
+  for (int i = 0; i < 10; i++) {
+    g_autoptr (LfbEvent) event = lfb_event_new (i % 2 ? LED_EVENT : DUMMY_EVENT);
+
+    lfb_event_trigger_feedback (event, &err);
+    g_assert_no_error (err);
+  }
+
+  /* And looping ones that get ended explicitly */
+  for (int i = 0; i < 5; i++) {
+    g_autoptr (LfbEvent) event = lfb_event_new (i % 2 ? LED_EVENT : DUMMY_EVENT);
+
+    lfb_event_set_timeout (event, 0);
+    lfb_event_trigger_feedback (event, &err);
+    g_assert_no_error (err);
+    lfb_event_end_feedback (event, &err);
+    g_assert_no_error (err);
+  }
+}
+
+/* A client that vanishes with a looping event still running */
+static void
+vanish_client (FbdSoak *self)
+{
+  g_autoptr (GDBusConnection) conn = NULL;
+  g_autoptr (LfbGdbusFeedback) proxy = NULL;
+  g_autoptr (GError) err = NULL;
+  guint id;
+
+  conn = g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (self->dbus),
+                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                 G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                 NULL, NULL, &err);
+  g_assert_no_error (err);
+
+  proxy = lfb_gdbus_feedback_proxy_new_sync (conn, G_DBUS_PROXY_FLAGS_NONE, FB_DBUS_NAME,
+                                             FB_DBUS_PATH, NULL, &err);
+  g_assert_no_error (err);
+
+  lfb_gdbus_feedback_call_trigger_feedback_sync (proxy, TEST_APP_ID ".vanish", DUMMY_EVENT,
+                                                 g_variant_new ("a{sv}", NULL), 0, &id,
+                                                 NULL, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (id, >, 0);
+
+  g_dbus_connection_close_sync (conn, NULL, &err);
+  g_assert_no_error (err);
+}
+
+
+static void
+hotplug_led (FbdSoak *self)
+{
+  umockdev_testbed_uevent (self->testbed, LED_PATH, "remove");
+  iterate (10);
+  umockdev_testbed_uevent (self->testbed, LED_PATH, "add");
+}
+
+
+static void
+reload_theme (FbdSoak *self)
+{
+  g_assert_cmpint (kill (self->pid, SIGHUP), ==, 0);
+}
+
+
+static void
+run_round (FbdSoak *self, guint round)
+{
+  trigger_events ();
+  vanish_client (self);
+
+  if (round % 10 == 0)
+    reload_theme (self);
+  if (round % 10 == 5)
+    hotplug_led (self);
+
+  iterate (20);
+}
+
+
+static gboolean
+check_counter (GVariant *baseline, GVariant *counters, const char *name, guint64 slack)
+{
+  guint64 before = lookup_counter (baseline, name);
+  guint64 after = lookup_counter (counters, name);
+
+  g_print ("  %-28s %10" G_GUINT64_FORMAT " → %10" G_GUINT64_FORMAT "\n", name, before, after);
+  if (after > before + slack) {
+    g_printerr ("%s grew from %" G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT "\n",
+                name, before, after);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) baseline = NULL;
+  g_autoptr (GVariant) counters = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *theme = NULL;
+  g_autofree char *servicesdir = NULL;
+  g_autofree char *builddir = NULL;
+  FbdUmockdevFixture fixture = { 0 };
+  FbdSoak self = { 0 };
+  guint64 rss_before, rss_after;
+  gboolean ok = TRUE;
+  int rounds = 200;
+  const GOptionEntry options[] = {
+    { "rounds", 'r', 0, G_OPTION_ARG_INT, &rounds, "Number of workload rounds", NULL },
+    { NULL }
+  };
+  const char *objects[] = { "events", "playbacks", "client-watches", "sounds", "themes" };
+
+  opt_context = g_option_context_new ("- feedbackd leak regression test");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return EXIT_FAILURE;
+  }
+  rounds = MAX (rounds, 1);
+
+  /* The testbed's environment is inherited by the bus and thus the daemon */
+  fbd_test_umockdev_setup (&fixture, "led-simple");
+  self.testbed = fixture.testbed;
+
+  tmpdir = g_dir_make_tmp ("fbd-soak-XXXXXX", &err);
+  g_assert_no_error (err);
+  theme = write_config (tmpdir);
+  g_setenv ("FEEDBACK_THEME", theme, TRUE);
+  g_setenv ("XDG_CONFIG_HOME", tmpdir, TRUE);
+  g_setenv ("GSETTINGS_BACKEND", "keyfile", TRUE);
+
+  self.dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  builddir = g_strdup (g_getenv ("G_TEST_BUILDDIR"));
+  if (builddir == NULL)
+    builddir = g_path_get_dirname (argv[0]);
+  servicesdir = g_canonicalize_filename ("services", builddir);
+  g_test_dbus_add_service_dir (self.dbus, servicesdir);
+  g_test_dbus_up (self.dbus);
+
+  if (!lfb_init (TEST_APP_ID, &err)) {
+    g_printerr ("Failed to init libfeedback: %s\n", err->message);
+    return EXIT_FAILURE;
+  }
+  self.pid = get_daemon_pid ();
+  self.stats = lfb_gdbus_feedback_stats_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                                G_DBUS_PROXY_FLAGS_NONE,
+                                                                FB_DBUS_NAME,
+                                                                FB_DBUS_PATH,
+                                                                NULL,
+                                                                &err);
+  g_assert_no_error (err);
+
+  /* Fill caches and pools before taking the baseline */
+  for (guint i = 0; i < 10; i++)
+    run_round (&self, i);
+  baseline = settle (&self);
+  rss_before = get_rss (&self);
+
+  g_print ("Running %d rounds\n", rounds);
+  for (guint i = 0; i < (guint)rounds; i++)
+    run_round (&self, i);
+  counters = settle (&self);
+  rss_after = get_rss (&self);
+
+  g_print ("Live objects (after warm up → after workload):\n");
+  for (guint i = 0; i < G_N_ELEMENTS (objects); i++) {
+    g_autofree char *name = g_strdup_printf ("live-%s", objects[i]);
+    g_autofree char *bytes = g_strdup_printf ("live-%s-bytes", objects[i]);
+
+    ok &= check_counter (baseline, counters, name, 0);
+    ok &= check_counter (baseline, counters, bytes, 0);
+  }
+  g_assert_cmpuint (lookup_counter (counters, "live-events"), ==, 0);
+  g_assert_cmpuint (lookup_counter (counters, "live-client-watches"), ==, 0);
+
+  g_print ("  %-28s %10" G_GUINT64_FORMAT " → %10" G_GUINT64_FORMAT " KiB\n", "rss",
+           rss_before, rss_after);
+  if (rss_before && rss_after > rss_before + MAX_RSS_GROWTH) {
+    g_printerr ("Resident memory grew by %" G_GUINT64_FORMAT " KiB\n", rss_after - rss_before);
+    ok = FALSE;
+  }
+
+  g_clear_object (&self.stats);
+  lfb_uninit ();
+  g_test_dbus_down (self.dbus);
+  g_clear_object (&self.dbus);
+  fbd_test_umockdev_teardown (&fixture, NULL);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-broker-frontend.h"
+#include "lfb-gdbus.h"
+#include "lfb-names.h"
+
+#include "testlib.h"
+
+#define TEST_EVENT_ID 42
+
+#define TEST_TYPE_BROKER (test_broker_get_type ())
+G_DECLARE_FINAL_TYPE (TestBroker, test_broker, TEST, BROKER, LfbGdbusFeedbackSkeleton)
+
+struct _TestBroker {
+  LfbGdbusFeedbackSkeleton parent;
+
+  guint n_triggered;
+  guint n_ended;
+};
+
+static void test_broker_iface_init (LfbGdbusFeedbackIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestBroker, test_broker, LFB_GDBUS_TYPE_FEEDBACK_SKELETON,
+                         G_IMPLEMENT_INTERFACE (LFB_GDBUS_TYPE_FEEDBACK,
+                                                test_broker_iface_init))
+
+
+static gboolean
+test_broker_handle_trigger_feedback (LfbGdbusFeedback      *object,
+                                     GDBusMethodInvocation *invocation,
+                                     const char            *app_id,
+                                     const char            *event,
+                                     GVariant              *hints,
+                                     int                    timeout)
+{
+  TestBroker *self = TEST_BROKER (object);
+
+  if (g_str_equal (event, "rate-limited")) {
+    g_dbus_method_invocation_return_dbus_error (invocation, FB_DBUS_ERROR_RATE_LIMITED,
+                                                "Too many feedback requests");
+    return TRUE;
+  }
+
+  self->n_triggered++;
+  lfb_gdbus_feedback_complete_trigger_feedback (object, invocation, TEST_EVENT_ID);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_broker_handle_end_feedback (LfbGdbusFeedback      *object,
+                                 GDBusMethodInvocation *invocation,
+                                 guint                  event_id)
+{
+  TestBroker *self = TEST_BROKER (object);
+
+  self->n_ended++;
+  lfb_gdbus_feedback_complete_end_feedback (object, invocation);
+  lfb_gdbus_feedback_emit_feedback_ended (object, event_id, 1);
+
+  return TRUE;
+}
+
+
+static void
+test_broker_iface_init (LfbGdbusFeedbackIface *iface)
+{
+  iface->handle_trigger_feedback = test_broker_handle_trigger_feedback;
+  iface->handle_end_feedback = test_broker_handle_end_feedback;
+}
+
+
+static void
+test_broker_class_init (TestBrokerClass *klass)
+{
+}
+
+
+static void
+test_broker_init (TestBroker *self)
+{
+}
+
+
+typedef struct _TestBrokerThread {
+  TestBroker      *broker;
+  GDBusConnection *connection;
+  GMainContext    *context;
+  GMainLoop       *loop;
+  GThread         *thread;
+  GAsyncQueue     *ready;
+} TestBrokerThread;
+
+/* Like a separate process the broker doesn't block on the front-end */
+static gpointer
+broker_thread (gpointer data)
+{
+  TestBrokerThread *bt = data;
+  g_autoptr (GError) err = NULL;
+
+  g_main_context_push_thread_default (bt->context);
+
+  g_assert_true (g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (bt->broker),
+                                                   bt->connection,
+                                                   FB_DBUS_PATH,
+                                                   &err));
+  g_assert_no_error (err);
+  g_dbus_connection_start_message_processing (bt->connection);
+  g_async_queue_push (bt->ready, bt);
+
+  g_main_loop_run (bt->loop);
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (bt->broker));
+
+  g_main_context_pop_thread_default (bt->context);
+
+  return NULL;
+}
+
+
+static void
+broker_thread_start (TestBrokerThread *bt, TestBroker *broker, GDBusConnection *connection)
+{
+  bt->broker = broker;
+  bt->connection = connection;
+  bt->context = g_main_context_new ();
+  bt->loop = g_main_loop_new (bt->context, FALSE);
+  bt->ready = g_async_queue_new ();
+  bt->thread = g_thread_new ("test-broker", broker_thread, bt);
+
+  g_async_queue_pop (bt->ready);
+}
+
+
+static gboolean
+quit_loop (gpointer data)
+{
+  g_main_loop_quit (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+broker_thread_stop (TestBrokerThread *bt)
+{
+  g_main_context_invoke (bt->context, quit_loop, bt->loop);
+  g_thread_join (bt->thread);
+
+  g_async_queue_unref (bt->ready);
+  g_main_loop_unref (bt->loop);
+  g_main_context_unref (bt->context);
+}
+
+
+static void
+on_call_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GTask *task = user_data;
+  GError *err = NULL;
+  GVariant *reply;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &err);
+  if (reply)
+    g_task_return_pointer (task, reply, (GDestroyNotify) g_variant_unref);
+  else
+    g_task_return_error (task, err);
+  g_object_unref (task);
+}
+
+/* Calls a method on the front-end running the main loop until it replies */
+static GVariant *
+call_frontend_on (GDBusConnection *client,
+                  const char      *destination,
+                  const char      *interface_name,
+                  const char      *method_name,
+                  GVariant        *parameters,
+                  GError         **error)
+{
+  g_autoptr (GTask) task = g_task_new (NULL, NULL, NULL, NULL);
+
+  g_dbus_connection_call (client,
+                          destination,
+                          FB_DBUS_PATH,
+                          interface_name,
+                          method_name,
+                          parameters,
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_call_done,
+                          g_object_ref (task));
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, TRUE);
+
+  return g_task_propagate_pointer (task, error);
+}
+
+
+static GVariant *
+call_frontend (GDBusConnection *client,
+               const char      *interface_name,
+               const char      *method_name,
+               GVariant        *parameters,
+               GError         **error)
+{
+  return call_frontend_on (client, NULL, interface_name, method_name, parameters, error);
+}
+
+
+static void
+on_feedback_ended (GDBusConnection *connection,
+                   const char      *sender_name,
+                   const char      *object_path,
+                   const char      *interface_name,
+                   const char      *signal_name,
+                   GVariant        *parameters,
+                   gpointer         user_data)
+{
+  guint *ended_id = user_data;
+
+  g_variant_get (parameters, "(uu)", ended_id, NULL);
+}
+
+
+static GVariant *
+empty_hints (void)
+{
+  return g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0);
+}
+
+
+static void
+test_fbd_broker_frontend_forward (void)
+{
+  g_autoptr (GDBusConnection) broker_server = NULL, broker_client = NULL;
+  g_autoptr (GDBusConnection) session_server = NULL, session_client = NULL;
+  g_autoptr (FbdBrokerFrontend) frontend = NULL;
+  TestBroker *broker = g_object_new (TEST_TYPE_BROKER, NULL);
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GVariant) value = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *remote_error = NULL;
+  TestBrokerThread bt = { 0 };
+  guint event_id = 0, ended_id = 0, signal_id;
+
+  fbd_test_new_connection_pair (&broker_server, &broker_client);
+  fbd_test_new_connection_pair (&session_server, &session_client);
+
+  lfb_gdbus_feedback_set_version (LFB_GDBUS_FEEDBACK (broker), 7);
+  broker_thread_start (&bt, broker, broker_server);
+
+  frontend = fbd_broker_frontend_new (broker_client);
+  g_assert_true (fbd_broker_frontend_export (frontend, session_server, &err));
+  g_assert_no_error (err);
+  g_dbus_connection_start_message_processing (session_server);
+
+  signal_id = g_dbus_connection_signal_subscribe (session_client,
+                                                  NULL,
+                                                  FB_DBUS_NAME,
+                                                  "FeedbackEnded",
+                                                  FB_DBUS_PATH,
+                                                  NULL,
+                                                  G_DBUS_SIGNAL_FLAGS_NONE,
+                                                  on_feedback_ended,
+                                                  &ended_id,
+                                                  NULL);
+
+  /* Triggers reach the broker */
+  reply = call_frontend (session_client, FB_DBUS_NAME, "TriggerFeedback",
+                         g_variant_new ("(ss@a{sv}i)", "org.example.test", "bell",
+                                        empty_hints (), -1),
+                         &err);
+  g_assert_no_error (err);
+  g_variant_get (reply, "(u)", &event_id);
+  g_assert_cmpuint (event_id, ==, TEST_EVENT_ID);
+  g_assert_cmpuint (broker->n_triggered, ==, 1);
+  g_clear_pointer (&reply, g_variant_unref);
+
+  /* The broker's error names are kept */
+  reply = call_frontend (session_client, FB_DBUS_NAME, "TriggerFeedback",
+                         g_variant_new ("(ss@a{sv}i)", "org.example.test", "rate-limited",
+                                        empty_hints (), -1),
+                         &err);
+  g_assert_null (reply);
+  remote_error = g_dbus_error_get_remote_error (err);
+  g_assert_cmpstr (remote_error, ==, FB_DBUS_ERROR_RATE_LIMITED);
+  g_clear_error (&err);
+
+  /* The end of the event is passed on */
+  reply = call_frontend (session_client, FB_DBUS_NAME, "EndFeedback",
+                         g_variant_new ("(u)", event_id),
+                         &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (broker->n_ended, ==, 1);
+  g_clear_pointer (&reply, g_variant_unref);
+  while (ended_id == 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (ended_id, ==, TEST_EVENT_ID);
+
+  /* Properties are the broker's */
+  reply = call_frontend (session_client, "org.freedesktop.DBus.Properties", "Get",
+                         g_variant_new ("(ss)", FB_DBUS_NAME, "Version"),
+                         &err);
+  g_assert_no_error (err);
+  g_variant_get (reply, "(v)", &value);
+  g_assert_cmpuint (g_variant_get_uint32 (value), ==, 7);
+
+  g_dbus_connection_signal_unsubscribe (session_client, signal_id);
+  fbd_broker_frontend_unexport (frontend);
+  broker_thread_stop (&bt);
+  g_object_unref (broker);
+}
+
+static GDBusConnection *
+new_bus_connection (GTestDBus *dbus)
+{
+  g_autoptr (GError) err = NULL;
+  GDBusConnection *connection;
+
+  connection = g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (dbus),
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                       G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                       NULL,
+                                                       NULL,
+                                                       &err);
+  g_assert_no_error (err);
+
+  return connection;
+}
+
+
+static void
+test_fbd_broker_frontend_end_foreign (void)
+{
+  g_autoptr (GTestDBus) dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_autoptr (GDBusConnection) broker_server = NULL, broker_client = NULL;
+  g_autoptr (GDBusConnection) session = NULL, client = NULL, other = NULL;
+  g_autoptr (FbdBrokerFrontend) frontend = NULL;
+  TestBroker *broker = g_object_new (TEST_TYPE_BROKER, NULL);
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) err = NULL;
+  TestBrokerThread bt = { 0 };
+  const char *name;
+  guint event_id = 0;
+
+  g_test_dbus_up (dbus);
+  session = new_bus_connection (dbus);
+  client = new_bus_connection (dbus);
+  other = new_bus_connection (dbus);
+  name = g_dbus_connection_get_unique_name (session);
+
+  fbd_test_new_connection_pair (&broker_server, &broker_client);
+  broker_thread_start (&bt, broker, broker_server);
+
+  frontend = fbd_broker_frontend_new (broker_client);
+  g_assert_true (fbd_broker_frontend_export (frontend, session, &err));
+  g_assert_no_error (err);
+
+  reply = call_frontend_on (client, name, FB_DBUS_NAME, "TriggerFeedback",
+                            g_variant_new ("(ss@a{sv}i)", "org.example.test", "bell",
+                                           empty_hints (), -1),
+                            &err);
+  g_assert_no_error (err);
+  g_variant_get (reply, "(u)", &event_id);
+  g_clear_pointer (&reply, g_variant_unref);
+
+  /* Other clients can't end the event */
+  g_test_expect_message ("fbd-broker-frontend", G_LOG_LEVEL_WARNING, "*foreign event*");
+  reply = call_frontend_on (other, name, FB_DBUS_NAME, "EndFeedback",
+                            g_variant_new ("(u)", event_id), &err);
+  g_assert_no_error (err);
+  g_clear_pointer (&reply, g_variant_unref);
+  g_test_expect_message ("fbd-broker-frontend", G_LOG_LEVEL_WARNING, "*foreign event*");
+  reply = call_frontend_on (other, name, FB_DBUS_NAME, "EndFeedbacks",
+                            g_variant_new_parsed ("([%u],)", event_id), &err);
+  g_assert_no_error (err);
+  g_clear_pointer (&reply, g_variant_unref);
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (broker->n_ended, ==, 0);
+
+  /* The triggering client can */
+  reply = call_frontend_on (client, name, FB_DBUS_NAME, "EndFeedback",
+                            g_variant_new ("(u)", event_id), &err);
+  g_assert_no_error (err);
+  g_clear_pointer (&reply, g_variant_unref);
+  g_assert_cmpuint (broker->n_ended, ==, 1);
+
+  /* Haptic calls fail instead of hitting an unknown interface */
+  reply = call_frontend_on (client, name, "org.sigxcpu.Feedback.Haptic", "Vibrate",
+                            g_variant_new_parsed ("('org.example.test', [(1.0, uint32 10)])"),
+                            &err);
+  g_assert_null (reply);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED);
+
+  fbd_broker_frontend_unexport (frontend);
+  broker_thread_stop (&bt);
+  g_object_unref (broker);
+
+  g_dbus_connection_close_sync (other, NULL, NULL);
+  g_dbus_connection_close_sync (client, NULL, NULL);
+  g_dbus_connection_close_sync (session, NULL, NULL);
+  g_test_dbus_down (dbus);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/broker-frontend/forward", test_fbd_broker_frontend_forward);
+  g_test_add_func ("/feedbackd/fbd/broker-frontend/end-foreign",
+                   test_fbd_broker_frontend_end_foreign);
+
+  return g_test_run ();
+}
@@ -11,9 +11,15 @@
 #include "fbd-dev-led-multicolor.h"
 #include "fbd-dev-led-qcom.h"
 #include "fbd-dev-led-qcom-multicolor.h"
+#include "fbd-dev-leds.h"
+#include "fbd-udev.h"
 
 #include "testlib.h"
 
+#include <glib/gstdio.h>
+
+#include <unistd.h>
+
 
 static void
 test_fbd_dev_led_simple (FbdUmockdevFixture *fixture, gconstpointer unused)
@@ -97,6 +103,57 @@ test_fbd_dev_led_flash (FbdUmockdevFixture *fixture, gconstpointer unused)
   g_assert_true (fbd_dev_led_supports_color (led, FBD_FEEDBACK_LED_COLOR_FLASH));
   g_assert_true (fbd_dev_led_start_periodic (led, 50, 50));
   g_assert_true (fbd_dev_led_start_periodic (led, 50, 0));
+  g_assert_true (fbd_dev_led_stop (led));
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_led_flash_strobe (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *value = NULL;
+  FbdDevLed *led;
+  GUdevDevice *dev;
+  const char *path;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+  path = g_udev_device_get_sysfs_path (dev);
+
+  led = fbd_dev_led_flash_new (dev, &err);
+  g_assert_no_error (err);
+
+  /* 2 Hz: 250ms pulses at 50% of 1.5A */
+  g_assert_true (fbd_dev_led_start_periodic (led, 50, 2000));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "flash_brightness");
+  g_assert_cmpstr (value, ==, "750000");
+  g_clear_pointer (&value, g_free);
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "flash_timeout");
+  g_assert_cmpstr (value, ==, "250000");
+  g_clear_pointer (&value, g_free);
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "flash_strobe");
+  g_assert_cmpstr (value, ==, "1");
+  g_clear_pointer (&value, g_free);
+
+  /* Pulses are capped at the maximum timeout */
+  g_assert_true (fbd_dev_led_start_periodic (led, 100, 50));
+  fbd_udev_flush_sysfs_attrs ();
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "flash_timeout");
+  g_assert_cmpstr (value, ==, "1280000");
+  g_clear_pointer (&value, g_free);
+
+  g_assert_true (fbd_dev_led_stop (led));
+  fbd_udev_flush_sysfs_attrs ();
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "flash_strobe");
+  g_assert_cmpstr (value, ==, "0");
 
   g_assert_finalize_object (led);
 }
@@ -188,6 +245,500 @@ test_fbd_dev_led_legacy (FbdUmockdevFixture *fixture, gconstpointer unused)
 }
 
 
+static void
+test_fbd_dev_led_queued_writes (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *brightness = NULL;
+  GUdevDevice *dev;
+  const char *path;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+  path = g_udev_device_get_sysfs_path (dev);
+
+  g_assert_true (fbd_udev_queue_sysfs_path_attr_as_int (dev, "brightness", 255, &err));
+  g_assert_no_error (err);
+  g_assert_true (fbd_udev_queue_sysfs_path_attr_as_int (dev, "brightness", 7, &err));
+  g_assert_no_error (err);
+  fbd_udev_flush_sysfs_attrs ();
+
+  /* Only the last value got written and old contents are gone */
+  brightness = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "brightness");
+  g_assert_cmpstr (brightness, ==, "7");
+
+  g_assert_false (fbd_udev_queue_sysfs_path_attr_as_int (dev, "doesnotexist", 1, &err));
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_FAILED);
+}
+
+
+static void
+test_fbd_dev_led_software_pattern (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (FbdLedAnimation) animation = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *brightness = NULL;
+  FbdDevLed *led;
+  GUdevDevice *dev;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+
+  led = fbd_dev_led_new (dev, &err);
+  g_assert_no_error (err);
+  g_assert_true (fbd_dev_led_supports_color (led, FBD_FEEDBACK_LED_COLOR_BLUE));
+
+  /* No pattern trigger, so this animates in software */
+  g_assert_true (fbd_dev_led_start_periodic (led, 50, 50));
+  g_assert_true (fbd_dev_led_is_animating (led));
+  g_assert_true (fbd_dev_led_stop (led));
+  g_assert_false (fbd_dev_led_is_animating (led));
+
+  /* A non repeating animation ends with its last step */
+  animation = fbd_led_animation_new (FALSE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 0, 100, NULL);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  brightness = umockdev_testbed_get_sysfs_attr (fixture->testbed,
+                                                g_udev_device_get_sysfs_path (dev),
+                                                "brightness");
+  g_assert_cmpstr (brightness, ==, "255");
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_led_pattern_animation (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (FbdLedAnimation) animation = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *pattern = NULL;
+  FbdLedRgbColor red = { .r = 255 };
+  FbdDevLed *led;
+  GUdevDevice *dev;
+  const char *path;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+  path = g_udev_device_get_sysfs_path (dev);
+
+  led = fbd_dev_led_new (dev, &err);
+  g_assert_no_error (err);
+
+  /* Holds keep the brightness, the trigger would ramp otherwise */
+  animation = fbd_led_animation_new_blink (1000, 100);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "255 500 255 0 0 500 0 0\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+  g_clear_pointer (&pattern, g_free);
+
+  /* Ramps are interpolated by the kernel */
+  animation = fbd_led_animation_new_breathe (1000, 100);
+  g_assert_cmpstr (fbd_led_animation_get_pattern (animation, 255), ==, "0 500 255 500\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  animation = fbd_led_animation_new_fade_in (1000, 50);
+  g_assert_cmpstr (fbd_led_animation_get_pattern (animation, 255), ==,
+                   "0 750 128 250 128 0\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  animation = fbd_led_animation_new_heartbeat (1000, 100);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "0 100 255 100 0 100 255 200 0 500 0 0\n");
+  /* The compiled pattern is kept */
+  g_assert_true (fbd_led_animation_get_pattern (animation, 255) ==
+                 fbd_led_animation_get_pattern (animation, 255));
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  /* A ramp into a hold needs to end at the ramp's target */
+  animation = fbd_led_animation_new (TRUE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_RAMP, 200, 100, NULL);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 300, 0, NULL);
+  g_assert_cmpstr (fbd_led_animation_get_pattern (animation, 255), ==,
+                   "0 200 255 0 0 300 0 0\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  /* Colors and animations that end need the software engine */
+  animation = fbd_led_animation_new (TRUE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 100, &red);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 0, NULL);
+  g_assert_null (fbd_led_animation_get_pattern (animation, 255));
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_true (fbd_dev_led_is_animating (led));
+  g_assert_true (fbd_dev_led_stop (led));
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  animation = fbd_led_animation_new_ramp (500, 0, 100);
+  g_assert_null (fbd_led_animation_get_pattern (animation, 255));
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_led_async_io (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GUdevClient) client = NULL;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *value = NULL;
+  GUdevDevice *dev;
+  const char *path;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+  path = g_udev_device_get_sysfs_path (dev);
+
+  /* Writes happen in the workers but in the order they were issued */
+  for (int i = 0; i < 100; i++) {
+    g_assert_true (fbd_udev_queue_sysfs_path_attr_as_int (dev, "brightness", i, &err));
+    g_assert_true (fbd_udev_set_sysfs_path_attr_as_int (dev, "pattern", i, &err));
+  }
+  g_assert_true (fbd_udev_queue_sysfs_path_attr_as_int (dev, "brightness", 42, &err));
+  g_assert_no_error (err);
+  fbd_udev_flush_sysfs_attrs ();
+
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "brightness");
+  g_assert_cmpstr (value, ==, "42");
+  g_clear_pointer (&value, g_free);
+  value = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (value, ==, "99");
+
+  /* Missing attributes are still reported right away */
+  g_assert_false (fbd_udev_set_sysfs_path_attr_as_string (dev, "doesnotexist", "1", &err));
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_FAILED);
+}
+
+
+static void
+test_fbd_dev_led_pattern_fallback (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GUdevClient) client = NULL;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (FbdLedAnimation) animation = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *pattern = NULL;
+  FbdDevLed *led;
+  GUdevDevice *dev;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+
+  led = fbd_dev_led_new (dev, &err);
+  g_assert_no_error (err);
+
+  /* Make the driver reject the pattern */
+  pattern = g_build_filename (umockdev_testbed_get_root_dir (fixture->testbed),
+                              g_udev_device_get_sysfs_path (dev), "pattern", NULL);
+  g_assert_cmpint (g_unlink (pattern), ==, 0);
+  g_assert_cmpint (symlink ("/dev/full", pattern), ==, 0);
+
+  g_test_expect_message ("fbd-dev-led", G_LOG_LEVEL_WARNING, "Failed to set led pattern*");
+  animation = fbd_led_animation_new_blink (1000, 100);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_test_assert_expected_messages ();
+  /* So it's animated in software */
+  g_assert_true (fbd_dev_led_is_animating (led));
+  g_assert_true (fbd_dev_led_stop (led));
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_led_qcom_animation (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (FbdLedAnimation) animation = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *pattern = NULL;
+  FbdDevLed *led;
+  GUdevDevice *dev;
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+
+  led = fbd_dev_led_qcom_new (dev, &err);
+  g_assert_no_error (err);
+
+  /* Short holds at the start and end use the LPG's pauses */
+  animation = fbd_led_animation_new_blink (1000, 100);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed,
+                                             g_udev_device_get_sysfs_path (dev),
+                                             "hw_pattern");
+  g_assert_cmpstr (pattern, ==, "511 500 511 0 0 500 0 0\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+  g_clear_pointer (&pattern, g_free);
+
+  /* Ramps are approximated by steps */
+  animation = fbd_led_animation_new_breathe (1000, 100);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed,
+                                             g_udev_device_get_sysfs_path (dev),
+                                             "hw_pattern");
+  g_assert_cmpstr (pattern, ==,
+                   "128 125 128 0 256 125 256 0 383 125 383 0 511 125 511 0 "
+                   "383 125 383 0 256 125 256 0 128 125 128 0 0 125 0 0\n");
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  g_clear_pointer (&pattern, g_free);
+
+  /* Too many steps for the LPG, so this uses the pattern trigger */
+  animation = fbd_led_animation_new (TRUE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_RAMP, 500, 100, NULL);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_RAMP, 499, 0, NULL);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed,
+                                             g_udev_device_get_sysfs_path (dev),
+                                             "pattern");
+  g_assert_cmpstr (pattern, ==, "0 500 511 499\n");
+  g_assert_true (fbd_dev_led_stop (led));
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_led_qcom_multicolor_animation (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  GUdevClient *client;
+  g_autolist (GUdevDevice) leds = NULL;
+  g_autoptr (FbdLedAnimation) animation = NULL;
+  g_autoptr (GError) err = NULL;
+  FbdDevLed *led;
+  GUdevDevice *dev;
+  FbdLedRgbColor red = { .r = 255 }, blue = { .b = 255 };
+
+  client = g_udev_client_new ((const char *const []){ "leds", NULL});
+  leds = g_udev_client_query_by_subsystem (client, "leds");
+  g_assert_cmpint (g_list_length (leds), ==, 1);
+  dev = G_UDEV_DEVICE (leds->data);
+
+  led = fbd_dev_led_qcom_multicolor_new (dev, &err);
+  g_assert_no_error (err);
+
+  /* A single color fits the hardware pattern */
+  animation = fbd_led_animation_new (TRUE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 100, &red);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 0, &red);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_false (fbd_dev_led_is_animating (led));
+  g_clear_pointer (&animation, fbd_led_animation_unref);
+
+  /* Color sequences need the software engine */
+  animation = fbd_led_animation_new (TRUE);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 100, &red);
+  fbd_led_animation_add_step (animation, FBD_LED_STEP_HOLD, 200, 100, &blue);
+  g_assert_true (fbd_dev_led_start_animation (led, animation));
+  g_assert_true (fbd_dev_led_is_animating (led));
+  g_assert_true (fbd_dev_led_stop (led));
+
+  g_assert_finalize_object (led);
+}
+
+
+static void
+test_fbd_dev_leds_compose (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevLeds) leds = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *pattern = NULL;
+  g_autofree char *brightness = NULL;
+  const char *path = "/sys/devices/LNXSYSTM:00/LNXSYBUS:00/PURI4543:00/leds/blue:status";
+  int low, high;
+
+  leds = fbd_dev_leds_new (&err);
+  g_assert_no_error (err);
+
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &low, 10, FBD_FEEDBACK_LED_COLOR_WHITE,
+                                              NULL, 100, 1000));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "0 500 255 500\n");
+  g_clear_pointer (&pattern, g_free);
+
+  /* Higher priority wins */
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &high, 20, FBD_FEEDBACK_LED_COLOR_WHITE,
+                                              NULL, 100, 2000));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "0 250 255 250\n");
+  g_clear_pointer (&pattern, g_free);
+
+  /* Updating a lower priority request keeps the LED as is */
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &low, 10, FBD_FEEDBACK_LED_COLOR_WHITE,
+                                              NULL, 100, 500));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "0 250 255 250\n");
+  g_clear_pointer (&pattern, g_free);
+
+  /* Ending the winner shows the next pattern */
+  g_assert_true (fbd_dev_leds_stop (leds, &high));
+  fbd_udev_flush_sysfs_attrs ();
+  pattern = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "pattern");
+  g_assert_cmpstr (pattern, ==, "0 1000 255 1000\n");
+
+  g_assert_true (fbd_dev_leds_stop (leds, &low));
+  fbd_udev_flush_sysfs_attrs ();
+  brightness = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "brightness");
+  g_assert_cmpstr (brightness, ==, "0");
+
+  /* Unknown owners are fine */
+  g_assert_true (fbd_dev_leds_stop (leds, &low));
+}
+
+
+static void
+on_dev_leds_probed (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GAsyncResult **result = user_data;
+
+  *result = g_object_ref (res);
+}
+
+
+static void
+test_fbd_dev_leds_async (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevLeds) leds = NULL;
+  g_autoptr (GAsyncResult) res = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *brightness = NULL;
+  const char *path = "/sys/devices/LNXSYSTM:00/LNXSYBUS:00/PURI4543:00/leds/blue:status";
+  int owner;
+
+  fbd_dev_leds_new_async (NULL, on_dev_leds_probed, &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  leds = fbd_dev_leds_new_finish (res, &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_DEV_LEDS (leds));
+
+  /* The LEDs probed in the worker thread are usable */
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &owner, 10, FBD_FEEDBACK_LED_COLOR_WHITE,
+                                              NULL, 100, 1000));
+  g_assert_true (fbd_dev_leds_stop (leds, &owner));
+  fbd_udev_flush_sysfs_attrs ();
+  brightness = umockdev_testbed_get_sysfs_attr (fixture->testbed, path, "brightness");
+  g_assert_cmpstr (brightness, ==, "0");
+}
+
+
+static char *
+add_led (FbdUmockdevFixture *fixture, const char *name, const char *type)
+{
+  return umockdev_testbed_add_device (fixture->testbed, "leds", name, NULL,
+                                      /* attributes */
+                                      "brightness", "0\n",
+                                      "max_brightness", "255\n",
+                                      "pattern", "",
+                                      "trigger", "none [pattern]\n",
+                                      NULL,
+                                      /* properties */
+                                      "FEEDBACKD_TYPE", type,
+                                      NULL);
+}
+
+
+static GUdevDevice *
+get_led (const char *sysfs_path)
+{
+  g_autoptr (GUdevClient) client = g_udev_client_new (NULL);
+  GUdevDevice *dev = g_udev_client_query_by_sysfs_path (client, sysfs_path);
+
+  g_assert_nonnull (dev);
+  return dev;
+}
+
+
+static void
+test_fbd_dev_leds_hotplug (FbdUmockdevFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevLeds) leds = NULL;
+  g_autoptr (GUdevDevice) blue = NULL;
+  g_autoptr (GUdevDevice) red = NULL;
+  g_autoptr (GUdevDevice) green = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *red_path = NULL;
+  g_autofree char *green_path = NULL;
+  const char *blue_path = "/sys/devices/LNXSYSTM:00/LNXSYBUS:00/PURI4543:00/leds/blue:status";
+  int red_owner, blue_owner;
+
+  /* LEDs not tagged for feedbackd are left alone */
+  green_path = add_led (fixture, "green:status", "other");
+  leds = fbd_dev_leds_new (&err);
+  g_assert_no_error (err);
+  g_assert_true (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_BLUE));
+  g_assert_false (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_GREEN));
+  g_assert_false (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_RED));
+
+  /* A LED plugged in later gets used */
+  red_path = add_led (fixture, "red:status", "led");
+  red = get_led (red_path);
+  g_assert_true (fbd_dev_leds_add_device (leds, red));
+  g_assert_true (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_RED));
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &red_owner, 10, FBD_FEEDBACK_LED_COLOR_RED,
+                                              NULL, 100, 1000));
+
+  /* Adding it again replaces it, requests for the old one are gone */
+  g_assert_true (fbd_dev_leds_add_device (leds, red));
+  g_assert_true (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_RED));
+  g_assert_true (fbd_dev_leds_stop (leds, &red_owner));
+
+  /* Unplugging drops the LED and its requests */
+  blue = get_led (blue_path);
+  g_assert_true (fbd_dev_leds_start_periodic (leds, &blue_owner, 10, FBD_FEEDBACK_LED_COLOR_BLUE,
+                                              NULL, 100, 1000));
+  g_assert_true (fbd_dev_leds_remove_device (leds, blue));
+  g_assert_false (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_BLUE));
+  g_assert_false (fbd_dev_leds_remove_device (leds, blue));
+  g_assert_true (fbd_dev_leds_stop (leds, &blue_owner));
+
+  g_assert_true (fbd_dev_leds_remove_device (leds, red));
+  g_assert_false (fbd_dev_leds_has_led (leds, FBD_FEEDBACK_LED_COLOR_RED));
+
+  /* Unused LEDs can't be removed */
+  green = get_led (green_path);
+  g_assert_false (fbd_dev_leds_remove_device (leds, green));
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -202,15 +753,48 @@ main (gint argc, gchar *argv[])
   FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/flash",
                          test_fbd_dev_led_flash,
                          "led-flash");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/flash-strobe",
+                         test_fbd_dev_led_flash_strobe,
+                         "led-flash");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/pattern-animation",
+                         test_fbd_dev_led_pattern_animation,
+                         "led-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/async-io",
+                         test_fbd_dev_led_async_io,
+                         "led-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/pattern-fallback",
+                         test_fbd_dev_led_pattern_fallback,
+                         "led-simple");
   FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/qcom/simple",
                          test_fbd_dev_led_qcom_simple,
                          "led-qcom-simple");
   FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/qcom/multicolor",
                          test_fbd_dev_led_qcom_multicolor,
                          "led-qcom-multicolor");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/qcom/animation",
+                         test_fbd_dev_led_qcom_animation,
+                         "led-qcom-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/qcom/multicolor-animation",
+                         test_fbd_dev_led_qcom_multicolor_animation,
+                         "led-qcom-multicolor");
   FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/legacy",
                          test_fbd_dev_led_legacy,
                          "led-legacy");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/software-pattern",
+                         test_fbd_dev_led_software_pattern,
+                         "led-nopattern");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/leds/compose",
+                         test_fbd_dev_leds_compose,
+                         "led-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/leds/async",
+                         test_fbd_dev_leds_async,
+                         "led-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/leds/hotplug",
+                         test_fbd_dev_leds_hotplug,
+                         "led-simple");
+  FBD_UMOCKDEV_TEST_ADD ("/feedbackd/fbd/dev/led/queued-writes",
+                         test_fbd_dev_led_queued_writes,
+                         "led-simple");
 
   return g_test_run();
 }
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-dev-sound.h"
+#include "fbd-sound-backend.h"
+#include "fbd-stats.h"
+
+/* A sound backend that plays sounds until told to finish them */
+#define TEST_TYPE_SOUND_BACKEND (test_sound_backend_get_type ())
+G_DECLARE_FINAL_TYPE (TestSoundBackend, test_sound_backend, TEST, SOUND_BACKEND, FbdSoundBackend)
+
+struct _TestSoundBackend {
+  FbdSoundBackend parent;
+
+  /* The tasks of playing sounds */
+  GPtrArray      *playing;
+  /* The names of all sounds played */
+  GPtrArray      *played;
+  GPtrArray      *cached;
+  guint           n_cancelled;
+  gboolean        unsupported;
+};
+
+G_DEFINE_TYPE (TestSoundBackend, test_sound_backend, FBD_TYPE_SOUND_BACKEND)
+
+
+static void
+test_sound_backend_play (FbdSoundBackend     *backend,
+                         FbdFeedbackSound    *feedback,
+                         const char          *role,
+                         gint64               loop_until,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+  TestSoundBackend *self = TEST_SOUND_BACKEND (backend);
+  const char *sound = fbd_feedback_sound_get_file_name (feedback);
+  GTask *task;
+
+  sound = sound ?: fbd_feedback_sound_get_effect (feedback);
+  g_ptr_array_add (self->played, g_strdup (sound));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  if (self->unsupported) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Can't play %s", sound);
+    g_object_unref (task);
+    return;
+  }
+
+  g_ptr_array_add (self->playing, task);
+}
+
+
+static gboolean
+test_sound_backend_play_finish (FbdSoundBackend *backend, GAsyncResult *res, GError **error)
+{
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+
+static gboolean
+test_sound_backend_cache (FbdSoundBackend *backend, const char *effect, GError **error)
+{
+  TestSoundBackend *self = TEST_SOUND_BACKEND (backend);
+
+  g_ptr_array_add (self->cached, g_strdup (effect));
+  return TRUE;
+}
+
+
+static gboolean
+test_sound_backend_set_theme_name (FbdSoundBackend *backend, const char *name, GError **error)
+{
+  return TRUE;
+}
+
+
+static void
+test_sound_backend_finalize (GObject *object)
+{
+  TestSoundBackend *self = TEST_SOUND_BACKEND (object);
+
+  g_assert_cmpuint (self->playing->len, ==, 0);
+  g_ptr_array_unref (self->playing);
+  g_ptr_array_unref (self->played);
+  g_ptr_array_unref (self->cached);
+
+  G_OBJECT_CLASS (test_sound_backend_parent_class)->finalize (object);
+}
+
+
+static void
+test_sound_backend_class_init (TestSoundBackendClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  FbdSoundBackendClass *backend_class = FBD_SOUND_BACKEND_CLASS (klass);
+
+  object_class->finalize = test_sound_backend_finalize;
+
+  backend_class->play = test_sound_backend_play;
+  backend_class->play_finish = test_sound_backend_play_finish;
+  backend_class->cache = test_sound_backend_cache;
+  backend_class->set_theme_name = test_sound_backend_set_theme_name;
+}
+
+
+static void
+test_sound_backend_init (TestSoundBackend *self)
+{
+  self->playing = g_ptr_array_new ();
+  self->played = g_ptr_array_new_with_free_func (g_free);
+  self->cached = g_ptr_array_new_with_free_func (g_free);
+}
+
+
+/* Ends all playing sounds, cancelled ones with an error */
+static void
+test_sound_backend_finish (TestSoundBackend *self)
+{
+  g_autoptr (GPtrArray) playing = g_steal_pointer (&self->playing);
+
+  self->playing = g_ptr_array_new ();
+  for (guint i = 0; i < playing->len; i++) {
+    GTask *task = g_ptr_array_index (playing, i);
+
+    if (g_task_return_error_if_cancelled (task))
+      self->n_cancelled++;
+    else
+      g_task_return_boolean (task, TRUE);
+    g_object_unref (task);
+  }
+
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+
+static void
+on_sound_played (FbdFeedbackPlayback *playback)
+{
+  guint *n_played = g_object_get_data (G_OBJECT (playback->feedback), "n-played");
+
+  (*n_played)++;
+}
+
+
+static FbdFeedbackSound *
+new_sound_feedback (const char *effect, guint *n_played)
+{
+  FbdFeedbackSound *feedback;
+
+  feedback = g_object_new (FBD_TYPE_FEEDBACK_SOUND,
+                           "event-name", "test-event",
+                           "effect", effect,
+                           NULL);
+  g_object_set_data (G_OBJECT (feedback), "n-played", n_played);
+
+  return feedback;
+}
+
+
+static FbdDevSound *
+new_dev_sound (TestSoundBackend *backend, TestSoundBackend *fallback)
+{
+  g_autoptr (GError) err = NULL;
+  FbdDevSound *dev;
+
+  dev = g_initable_new (FBD_TYPE_DEV_SOUND, NULL, &err,
+                        "backend", backend,
+                        "fallback", fallback,
+                        NULL);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_DEV_SOUND (dev));
+
+  return dev;
+}
+
+
+static void
+test_fbd_dev_sound_backend (void)
+{
+  TestSoundBackend *backend = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  FbdDevSound *dev = new_dev_sound (backend, NULL);
+  guint n_played = 0;
+  g_autoptr (FbdFeedbackSound) feedback = new_sound_feedback ("bell", &n_played);
+  g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+  playback = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (feedback), 0);
+  g_assert_true (fbd_dev_sound_play (dev, playback, on_sound_played));
+  g_assert_cmpuint (backend->played->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (backend->played, 0), ==, "bell");
+
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (n_played, ==, 1);
+
+  /* Stopping a sound that finished does nothing */
+  g_assert_false (fbd_dev_sound_stop (dev, playback));
+
+  /* Stopped sounds end as well */
+  g_assert_true (fbd_dev_sound_play (dev, playback, on_sound_played));
+  g_assert_true (fbd_dev_sound_stop (dev, playback));
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (n_played, ==, 2);
+
+  g_assert_finalize_object (dev);
+  g_assert_finalize_object (backend);
+}
+
+
+static void
+test_fbd_dev_sound_fallback (void)
+{
+  TestSoundBackend *backend = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  TestSoundBackend *fallback = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  FbdDevSound *dev = new_dev_sound (backend, fallback);
+  guint n_played = 0;
+  g_autoptr (FbdFeedbackSound) feedback = new_sound_feedback ("bell", &n_played);
+  g_autoptr (FbdFeedbackPlayback) playback = NULL;
+
+  /* Sounds the backend can't play go to the fallback */
+  backend->unsupported = TRUE;
+  playback = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (feedback), 0);
+  g_assert_true (fbd_dev_sound_play (dev, playback, on_sound_played));
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (backend->played->len, ==, 1);
+  g_assert_cmpuint (fallback->played->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (fallback->played, 0), ==, "bell");
+  g_assert_cmpuint (n_played, ==, 0);
+
+  test_sound_backend_finish (fallback);
+  g_assert_cmpuint (n_played, ==, 1);
+
+  /* Without a fallback the sound just ends */
+  g_clear_object (&dev);
+  g_assert_finalize_object (fallback);
+  dev = new_dev_sound (backend, NULL);
+  g_test_expect_message ("fbd-dev-sound", G_LOG_LEVEL_WARNING, "Failed to play sound 'bell'*");
+  g_assert_true (fbd_dev_sound_play (dev, playback, on_sound_played));
+  while (g_main_context_iteration (NULL, FALSE));
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (n_played, ==, 2);
+
+  g_assert_finalize_object (dev);
+  g_assert_finalize_object (backend);
+}
+
+
+static void
+test_fbd_dev_sound_preload (void)
+{
+  TestSoundBackend *backend = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  FbdDevSound *dev = new_dev_sound (backend, NULL);
+  const char *effects[] = { "bell", "button-pressed", NULL };
+  const char *other_effects[] = { "message-new-instant", NULL };
+
+  /* Sounds are cached from an idle callback */
+  fbd_dev_sound_preload (dev, effects);
+  g_assert_cmpuint (backend->cached->len, ==, 0);
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (backend->cached->len, ==, 2);
+  g_assert_cmpstr (g_ptr_array_index (backend->cached, 0), ==, "bell");
+  g_assert_cmpstr (g_ptr_array_index (backend->cached, 1), ==, "button-pressed");
+
+  /* A new set replaces the old one */
+  fbd_dev_sound_preload (dev, other_effects);
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (backend->cached->len, ==, 3);
+  g_assert_cmpstr (g_ptr_array_index (backend->cached, 2), ==, "message-new-instant");
+
+  /* Nothing to load */
+  fbd_dev_sound_preload (dev, NULL);
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (backend->cached->len, ==, 3);
+
+  g_assert_finalize_object (dev);
+  g_assert_finalize_object (backend);
+}
+
+
+static void
+set_voice_limits (guint max_voices, guint max_instances, const char *policy)
+{
+  g_autoptr (GSettings) settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+
+  g_settings_set_uint (settings, "sound-max-voices", max_voices);
+  g_settings_set_uint (settings, "sound-max-instances", max_instances);
+  g_settings_set_string (settings, "sound-voice-policy", policy);
+}
+
+
+static void
+reset_voice_limits (void)
+{
+  g_autoptr (GSettings) settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+
+  g_settings_reset (settings, "sound-max-voices");
+  g_settings_reset (settings, "sound-max-instances");
+  g_settings_reset (settings, "sound-voice-policy");
+}
+
+
+static void
+test_fbd_dev_sound_voices (void)
+{
+  TestSoundBackend *backend = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  FbdDevSound *dev;
+  const char *effects[] = { "bell", "button-pressed", "message-new-instant" };
+  FbdFeedbackSound *feedbacks[G_N_ELEMENTS (effects)];
+  FbdFeedbackPlayback *playbacks[G_N_ELEMENTS (effects)];
+  guint n_played = 0;
+
+  set_voice_limits (2, 0, "steal-oldest");
+  dev = new_dev_sound (backend, NULL);
+  for (guint i = 0; i < G_N_ELEMENTS (effects); i++) {
+    feedbacks[i] = new_sound_feedback (effects[i], &n_played);
+    playbacks[i] = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (feedbacks[i]), 0);
+  }
+
+  /* The third sound stops the oldest one */
+  for (guint i = 0; i < G_N_ELEMENTS (effects); i++)
+    g_assert_true (fbd_dev_sound_play (dev, playbacks[i], on_sound_played));
+  g_assert_cmpuint (backend->played->len, ==, 3);
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (backend->n_cancelled, ==, 1);
+  g_assert_cmpuint (n_played, ==, 3);
+
+  /* The new sound isn't played */
+  set_voice_limits (2, 0, "drop-new");
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_true (fbd_dev_sound_play (dev, playbacks[0], on_sound_played));
+  g_assert_true (fbd_dev_sound_play (dev, playbacks[1], on_sound_played));
+  g_assert_false (fbd_dev_sound_play (dev, playbacks[2], on_sound_played));
+  g_assert_cmpuint (backend->played->len, ==, 5);
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (backend->n_cancelled, ==, 1);
+  g_assert_cmpuint (n_played, ==, 5);
+
+  for (guint i = 0; i < G_N_ELEMENTS (effects); i++) {
+    fbd_feedback_playback_unref (playbacks[i]);
+    g_assert_finalize_object (feedbacks[i]);
+  }
+  g_assert_finalize_object (dev);
+  g_assert_finalize_object (backend);
+  reset_voice_limits ();
+}
+
+
+static void
+test_fbd_dev_sound_instances (void)
+{
+  TestSoundBackend *backend = g_object_new (TEST_TYPE_SOUND_BACKEND, NULL);
+  FbdStats *stats = fbd_stats_get_default ();
+  FbdDevSound *dev;
+  guint n_played = 0;
+  g_autoptr (FbdFeedbackSound) feedback = new_sound_feedback ("bell", &n_played);
+  g_autoptr (FbdFeedbackSound) other = new_sound_feedback ("button-pressed", &n_played);
+  g_autoptr (FbdFeedbackPlayback) first = NULL, second = NULL, third = NULL;
+  guint64 n_sounds;
+
+  set_voice_limits (8, 1, "steal-oldest");
+  dev = new_dev_sound (backend, NULL);
+  first = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (feedback), 0);
+  second = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (feedback), 0);
+  third = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (other), 0);
+
+  /* Playing the same sound again stops the running one, others keep playing */
+  n_sounds = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_SOUND);
+  g_assert_true (fbd_dev_sound_play (dev, third, on_sound_played));
+  g_assert_true (fbd_dev_sound_play (dev, first, on_sound_played));
+  g_assert_true (fbd_dev_sound_play (dev, second, on_sound_played));
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (backend->n_cancelled, ==, 1);
+  g_assert_cmpuint (n_played, ==, 3);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_SOUND), ==, n_sounds + 3);
+
+  /* Playback data gets reused */
+  g_assert_true (fbd_dev_sound_play (dev, first, on_sound_played));
+  g_assert_true (fbd_dev_sound_play (dev, third, on_sound_played));
+  test_sound_backend_finish (backend);
+  g_assert_cmpuint (n_played, ==, 5);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_SOUND), ==, n_sounds + 3);
+
+  g_assert_finalize_object (dev);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_SOUND), ==, n_sounds);
+  g_assert_finalize_object (backend);
+  reset_voice_limits ();
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/dev-sound/backend", test_fbd_dev_sound_backend);
+  g_test_add_func ("/feedbackd/fbd/dev-sound/fallback", test_fbd_dev_sound_fallback);
+  g_test_add_func ("/feedbackd/fbd/dev-sound/preload", test_fbd_dev_sound_preload);
+  g_test_add_func ("/feedbackd/fbd/dev-sound/voices", test_fbd_dev_sound_voices);
+  g_test_add_func ("/feedbackd/fbd/dev-sound/instances", test_fbd_dev_sound_instances);
+
+  return g_test_run ();
+}
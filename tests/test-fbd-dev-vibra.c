@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-dev-vibra.h"
+#include "fbd-feedback-profile.h"
+#include "fbd-feedback-vibra-pattern.h"
+
+#include "vibralib.h"
+
+typedef struct {
+  UMockdevTestbed *testbed;
+  FbdTestVibra    *vibra;
+  GUdevDevice     *device;
+  GSettings       *settings;
+} FbdTestVibraFixture;
+
+
+static void
+fixture_setup (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  fixture->testbed = umockdev_testbed_new ();
+  fixture->vibra = fbd_test_vibra_new (fixture->testbed, "event0", 4);
+  umockdev_testbed_enable (fixture->testbed);
+  fixture->device = fbd_test_vibra_get_udev_device (fixture->vibra);
+  fixture->settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+}
+
+
+static void
+fixture_teardown (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_settings_reset (fixture->settings, "haptic-thread");
+  g_clear_object (&fixture->settings);
+  g_clear_object (&fixture->device);
+  g_clear_pointer (&fixture->vibra, fbd_test_vibra_free);
+  umockdev_testbed_clear (fixture->testbed);
+  umockdev_testbed_disable (fixture->testbed);
+  g_clear_object (&fixture->testbed);
+}
+
+
+static FbdDevVibra *
+new_dev_vibra (FbdTestVibraFixture *fixture, gboolean haptic_thread)
+{
+  g_autoptr (GError) err = NULL;
+  FbdDevVibra *dev;
+
+  g_settings_set_boolean (fixture->settings, "haptic-thread", haptic_thread);
+  dev = fbd_dev_vibra_new (fixture->device, &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_DEV_VIBRA (dev));
+
+  return dev;
+}
+
+
+static void
+test_fbd_dev_vibra_probe (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, FALSE);
+
+  g_assert_true (fbd_dev_vibra_has_periodic (dev));
+  g_assert_true (fbd_dev_vibra_has_custom (dev));
+  g_assert_cmpint (fbd_test_vibra_get_gain (fixture->vibra), ==, 0xC000);
+  g_assert_cmpint (fbd_dev_vibra_get_actuator_class (dev), ==,
+                   FBD_DEV_VIBRA_ACTUATOR_CLASS_GRADED);
+
+  g_assert_true (fbd_dev_vibra_rumble (dev, 0.5, 100, TRUE));
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 1);
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), !=, -1);
+
+  g_assert_true (fbd_dev_vibra_stop (dev));
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), ==, -1);
+}
+
+
+static void
+test_fbd_dev_vibra_thread (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, TRUE);
+  const double magnitudes[] = { 0.25, 0.0, 0.75 };
+  const guint durations[] = { 20, 20, 20 };
+  int id;
+
+  g_assert_true (fbd_dev_vibra_rumble (dev, 0.5, 100, TRUE));
+  fbd_test_vibra_wait_for_plays (fixture->vibra, 1);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 0.5));
+
+  /* The thread times the steps, the pause doesn't play anything */
+  g_assert_true (fbd_dev_vibra_step_pattern (dev, magnitudes, durations, G_N_ELEMENTS (durations)));
+  fbd_test_vibra_wait_for_plays (fixture->vibra, 3);
+  /* The last step updates the effect of the first one */
+  g_assert_cmpuint (fbd_test_vibra_get_n_uploads (fixture->vibra), ==, 2);
+  g_assert_cmpuint (fbd_test_vibra_get_n_updates (fixture->vibra), ==, 1);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 0.75));
+
+  g_assert_true (fbd_dev_vibra_stop (dev));
+  fbd_test_vibra_wait_until_stopped (fixture->vibra);
+
+  /* Joins the thread */
+  g_clear_object (&dev);
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 3);
+}
+
+
+static void
+test_fbd_dev_vibra_no_thread (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, FALSE);
+  const double magnitudes[] = { 0.25, 0.75 };
+  const guint durations[] = { 20, 20 };
+
+  /* Without the thread the caller needs to time the steps */
+  g_assert_false (fbd_dev_vibra_step_pattern (dev, magnitudes, durations, G_N_ELEMENTS (durations)));
+  g_assert_false (fbd_dev_vibra_loop_pattern (dev, magnitudes, durations,
+                                              G_N_ELEMENTS (durations), 2, 0));
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 0);
+}
+
+
+static void
+test_fbd_dev_vibra_retune (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, FALSE);
+  int id;
+
+  g_assert_true (fbd_dev_vibra_retune (dev, 0.25, 100));
+  g_assert_cmpuint (fbd_test_vibra_get_n_uploads (fixture->vibra), ==, 1);
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 1);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpint (id, !=, -1);
+
+  /* Changing the magnitude updates the playing effect */
+  g_assert_true (fbd_dev_vibra_retune (dev, 0.75, 100));
+  g_assert_cmpuint (fbd_test_vibra_get_n_uploads (fixture->vibra), ==, 1);
+  g_assert_cmpuint (fbd_test_vibra_get_n_updates (fixture->vibra), ==, 1);
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 2);
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), ==, id);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 0.75));
+
+  /* An unchanged effect is only replayed */
+  g_assert_true (fbd_dev_vibra_retune (dev, 0.75, 100));
+  g_assert_cmpuint (fbd_test_vibra_get_n_updates (fixture->vibra), ==, 1);
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 3);
+
+  /* The tuned effect is reused after a stop */
+  g_assert_true (fbd_dev_vibra_stop (dev));
+  g_assert_true (fbd_dev_vibra_retune (dev, 0.5, 100));
+  g_assert_cmpuint (fbd_test_vibra_get_n_uploads (fixture->vibra), ==, 1);
+  g_assert_cmpuint (fbd_test_vibra_get_n_updates (fixture->vibra), ==, 2);
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), ==, id);
+  g_assert_cmpuint (fbd_test_vibra_get_n_erases (fixture->vibra), ==, 0);
+}
+
+
+static void
+test_fbd_dev_vibra_gain (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, FALSE);
+
+  g_assert_cmpint (fbd_test_vibra_get_gain (fixture->vibra), ==, 0xC000);
+  g_assert_cmpuint (fbd_test_vibra_get_n_gains (fixture->vibra), ==, 1);
+
+  g_assert_true (fbd_dev_vibra_rumble (dev, 0.5, 100, TRUE));
+  g_assert_true (fbd_dev_vibra_set_gain (dev, 0.5));
+  g_assert_cmpint (fbd_test_vibra_get_gain (fixture->vibra), ==, (int)(0xFFFF * 0.5));
+  g_assert_cmpuint (fbd_test_vibra_get_n_gains (fixture->vibra), ==, 2);
+  /* Scaling needs no new upload */
+  g_assert_cmpuint (fbd_test_vibra_get_n_uploads (fixture->vibra), ==, 1);
+
+  /* Unchanged gains aren't written again */
+  g_assert_true (fbd_dev_vibra_set_gain (dev, 0.5));
+  g_assert_cmpuint (fbd_test_vibra_get_n_gains (fixture->vibra), ==, 2);
+
+  g_assert_true (fbd_dev_vibra_set_gain (dev, 1.0));
+  g_assert_cmpint (fbd_test_vibra_get_gain (fixture->vibra), ==, 0xFFFF);
+  g_assert_cmpuint (fbd_test_vibra_get_n_gains (fixture->vibra), ==, 3);
+}
+
+
+static void
+on_dev_vibra_probed (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GAsyncResult **result = user_data;
+
+  *result = g_object_ref (res);
+}
+
+
+static void
+test_fbd_dev_vibra_async (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = NULL;
+  g_autoptr (GAsyncResult) res = NULL;
+  g_autoptr (GCancellable) cancel = g_cancellable_new ();
+  g_autoptr (GError) err = NULL;
+
+  fbd_dev_vibra_new_async (fixture->device, NULL, on_dev_vibra_probed, &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  dev = fbd_dev_vibra_new_finish (res, &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_DEV_VIBRA (dev));
+  g_assert_cmpint (fbd_test_vibra_get_gain (fixture->vibra), ==, 0xC000);
+  g_assert_true (fbd_dev_vibra_rumble (dev, 0.5, 100, TRUE));
+  g_assert_cmpuint (fbd_test_vibra_get_n_plays (fixture->vibra), ==, 1);
+  g_clear_object (&dev);
+  g_clear_object (&res);
+
+  /* A cancelled probe doesn't hand out the device */
+  g_cancellable_cancel (cancel);
+  fbd_dev_vibra_new_async (fixture->device, cancel, on_dev_vibra_probed, &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  dev = fbd_dev_vibra_new_finish (res, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (dev);
+}
+
+
+static void
+on_timeout (gpointer user_data)
+{
+  gboolean *done = user_data;
+
+  *done = TRUE;
+}
+
+
+static void
+run_main_loop (guint timeout)
+{
+  gboolean done = FALSE;
+
+  g_timeout_add_once (timeout, on_timeout, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+
+static void
+on_playback_ended (FbdFeedbackPlayback *playback, gpointer user_data)
+{
+  gboolean *ended = user_data;
+
+  *ended = TRUE;
+}
+
+
+static void
+test_fbd_dev_vibra_hotplug (FbdTestVibraFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (FbdDevVibra) dev = new_dev_vibra (fixture, FALSE);
+  g_autoptr (FbdFeedbackVibraPattern) pattern = NULL;
+  g_autoptr (GArray) magnitudes = g_array_new (FALSE, FALSE, sizeof (double));
+  g_autoptr (GArray) durations = g_array_new (FALSE, FALSE, sizeof (guint));
+  const double steps_magnitudes[] = { 0.5, 0.25, 1.0 };
+  const guint steps_durations[] = { 200, 200, 200 };
+  FbdFeedbackPlayback *playback;
+  gboolean ended = FALSE;
+  int id;
+
+  g_array_append_vals (magnitudes, steps_magnitudes, G_N_ELEMENTS (steps_magnitudes));
+  g_array_append_vals (durations, steps_durations, G_N_ELEMENTS (steps_durations));
+  pattern = fbd_feedback_vibra_pattern_new (magnitudes, durations);
+
+  playback = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (pattern), FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+  fbd_feedback_playback_set_ended_func (playback, on_playback_ended, &ended);
+  fbd_feedback_playback_set_device (playback, dev);
+  fbd_feedback_playback_run (playback);
+  run_main_loop (300);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 0.25));
+
+  /* Pausing stops the motor but keeps the playback */
+  fbd_feedback_vibra_pause (FBD_FEEDBACK_VIBRA (pattern), playback);
+  g_assert_true (fbd_feedback_playback_get_paused (playback));
+  g_assert_null (fbd_feedback_playback_get_device (playback));
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), ==, -1);
+  g_assert_false (ended);
+
+  /* The device goes away and comes back under a new name */
+  g_clear_object (&dev);
+  g_clear_object (&fixture->device);
+  fbd_test_vibra_remove (fixture->vibra);
+  g_clear_pointer (&fixture->vibra, fbd_test_vibra_free);
+  fixture->vibra = fbd_test_vibra_new (fixture->testbed, "event1", 4);
+  fixture->device = fbd_test_vibra_get_udev_device (fixture->vibra);
+  dev = new_dev_vibra (fixture, FALSE);
+
+  /* The pattern continues with the step it was paused in */
+  fbd_feedback_vibra_resume (FBD_FEEDBACK_VIBRA (pattern), playback, dev);
+  g_assert_false (fbd_feedback_playback_get_paused (playback));
+  g_assert_true (fbd_feedback_playback_get_device (playback) == dev);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpint (id, !=, -1);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 0.25));
+
+  /* and still ends when the original run would have ended */
+  run_main_loop (250);
+  id = fbd_test_vibra_get_playing (fixture->vibra);
+  g_assert_cmpuint (fbd_test_vibra_get_magnitude (fixture->vibra, id), ==, (guint16)(0xFFFF * 1.0));
+  while (!ended)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_false (fbd_feedback_playback_get_paused (playback));
+  g_assert_cmpint (fbd_test_vibra_get_playing (fixture->vibra), ==, -1);
+
+  fbd_feedback_playback_set_ended_func (playback, NULL, NULL);
+  fbd_feedback_playback_set_device (playback, NULL);
+  fbd_feedback_playback_unref (playback);
+}
+
+
+#define FBD_TEST_VIBRA_ADD(name, func) g_test_add ((name), FbdTestVibraFixture, NULL, \
+                                                   fixture_setup, (func), fixture_teardown)
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/probe", test_fbd_dev_vibra_probe);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/async", test_fbd_dev_vibra_async);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/thread", test_fbd_dev_vibra_thread);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/no-thread", test_fbd_dev_vibra_no_thread);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/retune", test_fbd_dev_vibra_retune);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/gain", test_fbd_dev_vibra_gain);
+  FBD_TEST_VIBRA_ADD ("/feedbackd/fbd/dev-vibra/hotplug", test_fbd_dev_vibra_hotplug);
+
+  return g_test_run ();
+}
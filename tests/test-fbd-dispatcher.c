@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-dispatcher.h"
+#include "lfb-gdbus.h"
+
+#include "testlib.h"
+
+#define TEST_PATH "/org/sigxcpu/Feedback"
+
+#define TEST_TYPE_HAPTIC (test_haptic_get_type ())
+G_DECLARE_FINAL_TYPE (TestHaptic, test_haptic, TEST, HAPTIC, LfbGdbusFeedbackHapticSkeleton)
+
+struct _TestHaptic {
+  LfbGdbusFeedbackHapticSkeleton parent;
+
+  GThread *thread;
+  guint    n_calls;
+};
+
+static void test_haptic_iface_init (LfbGdbusFeedbackHapticIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestHaptic, test_haptic, LFB_GDBUS_TYPE_FEEDBACK_HAPTIC_SKELETON,
+                         G_IMPLEMENT_INTERFACE (LFB_GDBUS_TYPE_FEEDBACK_HAPTIC,
+                                                test_haptic_iface_init))
+
+
+static gboolean
+test_haptic_handle_vibrate (LfbGdbusFeedbackHaptic *object,
+                            GDBusMethodInvocation  *invocation,
+                            const char             *app_id,
+                            GVariant               *pattern)
+{
+  TestHaptic *self = TEST_HAPTIC (object);
+
+  self->thread = g_thread_self ();
+  self->n_calls++;
+  lfb_gdbus_feedback_haptic_complete_vibrate (object, invocation, TRUE);
+
+  return TRUE;
+}
+
+
+static void
+test_haptic_iface_init (LfbGdbusFeedbackHapticIface *iface)
+{
+  iface->handle_vibrate = test_haptic_handle_vibrate;
+}
+
+
+static GDBusInterfaceVTable *
+test_haptic_get_vtable (GDBusInterfaceSkeleton *skeleton)
+{
+  GDBusInterfaceSkeletonClass *skeleton_class;
+
+  skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (test_haptic_parent_class);
+
+  return fbd_dispatcher_wrap_vtable (skeleton, skeleton_class->get_vtable (skeleton));
+}
+
+
+static void
+test_haptic_class_init (TestHapticClass *klass)
+{
+  GDBusInterfaceSkeletonClass *skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (klass);
+
+  skeleton_class->get_vtable = test_haptic_get_vtable;
+}
+
+
+static void
+test_haptic_init (TestHaptic *self)
+{
+}
+
+
+#define TEST_TYPE_FEEDBACK (test_feedback_get_type ())
+G_DECLARE_FINAL_TYPE (TestFeedback, test_feedback, TEST, FEEDBACK, LfbGdbusFeedbackSkeleton)
+
+struct _TestFeedback {
+  LfbGdbusFeedbackSkeleton parent;
+};
+
+G_DEFINE_TYPE (TestFeedback, test_feedback, LFB_GDBUS_TYPE_FEEDBACK_SKELETON)
+
+static GDBusInterfaceVTable *feedback_vtable;
+static int n_get_property;
+
+
+static GVariant *
+test_feedback_get_property (GDBusConnection  *connection,
+                            const char       *sender,
+                            const char       *object_path,
+                            const char       *interface_name,
+                            const char       *property_name,
+                            GError          **error,
+                            gpointer          user_data)
+{
+  g_atomic_int_inc (&n_get_property);
+
+  return feedback_vtable->get_property (connection, sender, object_path, interface_name,
+                                        property_name, error, user_data);
+}
+
+
+static GDBusInterfaceVTable *
+test_feedback_get_vtable (GDBusInterfaceSkeleton *skeleton)
+{
+  static GDBusInterfaceVTable vtable;
+  GDBusInterfaceSkeletonClass *skeleton_class;
+
+  skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (test_feedback_parent_class);
+  if (feedback_vtable == NULL) {
+    feedback_vtable = skeleton_class->get_vtable (skeleton);
+    vtable = *feedback_vtable;
+    vtable.get_property = test_feedback_get_property;
+  }
+
+  return fbd_dispatcher_wrap_vtable (skeleton, &vtable);
+}
+
+
+static void
+test_feedback_class_init (TestFeedbackClass *klass)
+{
+  GDBusInterfaceSkeletonClass *skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS (klass);
+
+  skeleton_class->get_vtable = test_feedback_get_vtable;
+}
+
+
+static void
+test_feedback_init (TestFeedback *self)
+{
+}
+
+
+static void
+on_vibrate_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GVariant **reply = user_data;
+  g_autoptr (GError) err = NULL;
+
+  *reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &err);
+  g_assert_no_error (err);
+}
+
+
+static void
+test_fbd_dispatcher_method_call (void)
+{
+  g_autoptr (FbdDispatcher) dispatcher = fbd_dispatcher_get_default ();
+  g_autoptr (GDBusConnection) server = NULL, client = NULL;
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) err = NULL;
+  TestHaptic *haptic = g_object_new (TEST_TYPE_HAPTIC, NULL);
+  gboolean success = FALSE;
+
+  fbd_test_new_connection_pair (&server, &client);
+
+  g_assert_true (fbd_dispatcher_export (dispatcher,
+                                        G_DBUS_INTERFACE_SKELETON (haptic),
+                                        server,
+                                        TEST_PATH,
+                                        &err));
+  g_assert_no_error (err);
+  g_dbus_connection_start_message_processing (server);
+
+  g_dbus_connection_call (client,
+                          NULL,
+                          TEST_PATH,
+                          "org.sigxcpu.Feedback.Haptic",
+                          "Vibrate",
+                          g_variant_new_parsed ("('org.example.test', [(1.0, uint32 10)])"),
+                          G_VARIANT_TYPE ("(b)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_vibrate_done,
+                          &reply);
+  while (reply == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_variant_get (reply, "(b)", &success);
+  g_assert_true (success);
+  g_assert_cmpuint (haptic->n_calls, ==, 1);
+  /* Received on the dispatcher's thread but handled on the main thread */
+  g_assert_true (haptic->thread == g_thread_self ());
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (haptic));
+  g_object_unref (haptic);
+}
+
+
+static void
+on_get_all_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GVariant **reply = user_data;
+  g_autoptr (GError) err = NULL;
+
+  *reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &err);
+  g_assert_no_error (err);
+}
+
+
+static void
+test_fbd_dispatcher_get_all_during_export (void)
+{
+  g_autoptr (FbdDispatcher) dispatcher = fbd_dispatcher_get_default ();
+  g_autoptr (GDBusConnection) server = NULL, client = NULL;
+  g_autoptr (GPtrArray) exported = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GVariant) props = NULL;
+  g_autoptr (GError) err = NULL;
+  TestFeedback *feedback = g_object_new (TEST_TYPE_FEEDBACK, NULL);
+
+  fbd_test_new_connection_pair (&server, &client);
+
+  g_assert_true (fbd_dispatcher_export (dispatcher,
+                                        G_DBUS_INTERFACE_SKELETON (feedback),
+                                        server,
+                                        TEST_PATH,
+                                        &err));
+  g_assert_no_error (err);
+  g_dbus_connection_start_message_processing (server);
+
+  g_dbus_connection_call (client,
+                          NULL,
+                          TEST_PATH,
+                          "org.freedesktop.DBus.Properties",
+                          "GetAll",
+                          g_variant_new ("(s)", "org.sigxcpu.Feedback"),
+                          G_VARIANT_TYPE ("(a{sv})"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_get_all_done,
+                          &reply);
+
+  /*
+   * Keep exporting without running the main context until the GetAll
+   * got handled. That can only happen while waiting for an export.
+   */
+  while (g_atomic_int_get (&n_get_property) == 0) {
+    TestFeedback *other = g_object_new (TEST_TYPE_FEEDBACK, NULL);
+    g_autofree char *path = g_strdup_printf ("%s/%u", TEST_PATH, exported->len);
+
+    g_assert_true (fbd_dispatcher_export (dispatcher,
+                                          G_DBUS_INTERFACE_SKELETON (other),
+                                          server,
+                                          path,
+                                          &err));
+    g_assert_no_error (err);
+    g_ptr_array_add (exported, other);
+  }
+
+  while (reply == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_variant_get (reply, "(@a{sv})", &props);
+  g_assert_true (g_variant_lookup (props, "Version", "u", NULL));
+
+  for (guint i = 0; i < exported->len; i++)
+    g_dbus_interface_skeleton_unexport (g_ptr_array_index (exported, i));
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (feedback));
+  g_object_unref (feedback);
+}
+
+static void
+test_fbd_dispatcher_finalize_during_get (void)
+{
+  FbdDispatcher *dispatcher = fbd_dispatcher_get_default ();
+  g_autoptr (GDBusConnection) server = NULL, client = NULL;
+  g_autoptr (GError) err = NULL;
+  TestFeedback *feedback = g_object_new (TEST_TYPE_FEEDBACK, NULL);
+
+  fbd_test_new_connection_pair (&server, &client);
+
+  g_assert_true (fbd_dispatcher_export (dispatcher,
+                                        G_DBUS_INTERFACE_SKELETON (feedback),
+                                        server,
+                                        TEST_PATH,
+                                        &err));
+  g_assert_no_error (err);
+  g_dbus_connection_start_message_processing (server);
+  g_atomic_int_set (&n_get_property, 0);
+
+  g_dbus_connection_call (client,
+                          NULL,
+                          TEST_PATH,
+                          "org.freedesktop.DBus.Properties",
+                          "Get",
+                          g_variant_new ("(ss)", "org.sigxcpu.Feedback", "Version"),
+                          G_VARIANT_TYPE ("(v)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  /* Give the dispatcher's thread time to block on the main thread */
+  g_usleep (G_USEC_PER_SEC / 10);
+
+  /* Must not wait for the main thread to handle the Get */
+  g_object_unref (dispatcher);
+  g_assert_cmpint (g_atomic_int_get (&n_get_property), ==, 0);
+
+  g_dbus_connection_close_sync (client, NULL, NULL);
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (feedback));
+  g_object_unref (feedback);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/dispatcher/method-call", test_fbd_dispatcher_method_call);
+  g_test_add_func ("/feedbackd/fbd/dispatcher/get-all-during-export",
+                   test_fbd_dispatcher_get_all_during_export);
+  g_test_add_func ("/feedbackd/fbd/dispatcher/finalize-during-get",
+                   test_fbd_dispatcher_finalize_during_get);
+
+  return g_test_run ();
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-duty-governor.c"
+
+#define SEC(s) ((gint64) (s) * G_USEC_PER_SEC)
+
+static int motor;
+
+
+static void
+test_fbd_duty_governor_usage (void)
+{
+  g_autoptr (FbdDutyGovernor) governor = g_object_new (FBD_TYPE_DUTY_GOVERNOR, NULL);
+  g_autoptr (GVariant) counters = NULL;
+  guint64 permille;
+
+  fbd_duty_governor_set_budget (governor, 0.25);
+  g_assert_cmpfloat (get_usage_at (governor, &motor, 0), ==, 0.0);
+
+  /* 60s window at 25% allows for 15s, on for 10s drains 2.5s */
+  start_at (governor, &motor, "vibra0", SEC (100));
+  stop_at (governor, &motor, SEC (110));
+  g_assert_cmpfloat_with_epsilon (get_usage_at (governor, &motor, SEC (110)), 0.5, 0.001);
+
+  counters = g_variant_ref_sink (fbd_stats_get_counters (fbd_stats_get_default ()));
+  g_assert_true (g_variant_lookup (counters, "duty-cycle-vibra0", "t", &permille));
+  g_assert_cmpuint (permille, ==, 500);
+
+  /* Drains at the budgeted rate while off */
+  g_assert_cmpfloat_with_epsilon (get_usage_at (governor, &motor, SEC (120)), 1.0 / 3.0, 0.001);
+  g_assert_cmpfloat (get_usage_at (governor, &motor, SEC (200)), ==, 0.0);
+
+  /* Starting twice needs stopping twice */
+  start_at (governor, &motor, "vibra0", SEC (200));
+  start_at (governor, &motor, "vibra0", SEC (200));
+  stop_at (governor, &motor, SEC (204));
+  stop_at (governor, &motor, SEC (208));
+  g_assert_cmpfloat_with_epsilon (get_usage_at (governor, &motor, SEC (208)), 0.4, 0.001);
+
+  fbd_duty_governor_remove (governor, &motor);
+  g_assert_cmpfloat (get_usage_at (governor, &motor, SEC (208)), ==, 0.0);
+}
+
+
+static void
+test_fbd_duty_governor_scale (void)
+{
+  g_autoptr (FbdDutyGovernor) governor = g_object_new (FBD_TYPE_DUTY_GOVERNOR, NULL);
+
+  fbd_duty_governor_set_budget (governor, 0.25);
+
+  start_at (governor, &motor, "vibra0", 0);
+  /* Below half of the budget feedback stays as is */
+  g_assert_cmpfloat (get_scale_at (governor, &motor, SEC (8)), ==, 1.0);
+  /* Then gets weaker */
+  g_assert_cmpfloat_with_epsilon (get_scale_at (governor, &motor, SEC (15)), 0.65, 0.001);
+  /* And is dropped once the budget is used up */
+  g_assert_cmpfloat (get_scale_at (governor, &motor, SEC (20)), ==, 0.0);
+  stop_at (governor, &motor, SEC (20));
+
+  g_assert_cmpfloat (get_scale_at (governor, &motor, SEC (100)), ==, 1.0);
+}
+
+
+static void
+test_fbd_duty_governor_unlimited (void)
+{
+  g_autoptr (FbdDutyGovernor) governor = g_object_new (FBD_TYPE_DUTY_GOVERNOR, NULL);
+
+  g_assert_cmpfloat (fbd_duty_governor_get_budget (governor), ==, 1.0);
+
+  start_at (governor, &motor, "vibra0", 0);
+  g_assert_cmpfloat (get_usage_at (governor, &motor, SEC (600)), ==, 0.0);
+  g_assert_cmpfloat (get_scale_at (governor, &motor, SEC (600)), ==, 1.0);
+  stop_at (governor, &motor, SEC (600));
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/duty-governor/usage", test_fbd_duty_governor_usage);
+  g_test_add_func ("/feedbackd/fbd/duty-governor/scale", test_fbd_duty_governor_scale);
+  g_test_add_func ("/feedbackd/fbd/duty-governor/unlimited", test_fbd_duty_governor_unlimited);
+
+  return g_test_run ();
+}
@@ -60,25 +60,25 @@ test_fbd_event_feedback (void)
   feedback1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
   feedback2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
 
-  feedbacks = fbd_event_get_feedbacks (event);
+  feedbacks = fbd_event_get_playbacks (event);
   g_assert_cmpint (g_slist_length (feedbacks), ==, 0);
 
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
-  feedbacks = fbd_event_get_feedbacks (event);
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 0);
+  feedbacks = fbd_event_get_playbacks (event);
   g_assert_cmpint (g_slist_length (feedbacks), ==, 1);
 
   /* Remove non existing feedback */
   fbd_event_remove_feedback (event, FBD_FEEDBACK_BASE (feedback2));
-  feedbacks = fbd_event_get_feedbacks (event);
+  feedbacks = fbd_event_get_playbacks (event);
   g_assert_cmpint (g_slist_length (feedbacks), ==, 1);
 
   fbd_event_remove_feedback (event, FBD_FEEDBACK_BASE (feedback1));
-  feedbacks = fbd_event_get_feedbacks (event);
+  feedbacks = fbd_event_get_playbacks (event);
   g_assert_cmpint (g_slist_length (feedbacks), ==, 0);
 
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
-  feedbacks = fbd_event_get_feedbacks (event);
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 0);
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 0);
+  feedbacks = fbd_event_get_playbacks (event);
   g_assert_cmpint (g_slist_length (feedbacks), ==, 2);
 
   g_assert_false (fbd_event_get_feedbacks_ended (event));
@@ -86,7 +86,7 @@ test_fbd_event_feedback (void)
   /* Dummy feedback ends immediately */
   g_assert_true (fbd_event_get_feedbacks_ended (event));
 
-  /* event holds a ref on the feedbacks so finalize it first */
+  /* The event's playbacks hold a ref on the feedbacks so finalize it first */
   g_assert_finalize_object (event);
   g_assert_finalize_object (feedback2);
   g_assert_finalize_object (feedback1);
@@ -110,10 +110,10 @@ test_fbd_event_feedback_ended (void)
 
   event = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_ONESHOT, NULL);
   feedback1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 0);
 
   feedback2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 0);
 
   g_signal_connect (event, "feedbacks-ended",
                     (GCallback)on_feedbacks_ended, &ended);
@@ -131,34 +131,31 @@ test_fbd_event_feedback_end_by_level (void)
   gboolean ended;
 
   feedback1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  g_object_set_data (G_OBJECT (feedback1), "fbd-level", GUINT_TO_POINTER (10));
-
   feedback2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  g_object_set_data (G_OBJECT (feedback2), "fbd-level", GUINT_TO_POINTER (5));
 
   event = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_ONESHOT, NULL);
   g_signal_connect (event, "feedbacks-ended",
                     (GCallback)on_feedbacks_ended, &ended);
 
   /* End all feedback at once */
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 10);
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 5);
   fbd_event_end_feedbacks_by_level (event, 3);
-  g_assert_cmpint (g_slist_length (fbd_event_get_feedbacks (event)), ==, 0);
+  g_assert_cmpint (g_slist_length (fbd_event_get_playbacks (event)), ==, 0);
   g_assert_cmpint (fbd_event_get_end_reason (event), ==, FBD_EVENT_END_REASON_EXPLICIT);
   g_assert_true (ended);
 
   /* End feedback one by one */
   ended = FALSE;
   fbd_event_set_end_reason (event, FBD_EVENT_END_REASON_NATURAL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 10);
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 5);
   fbd_event_end_feedbacks_by_level (event, 7);
-  g_assert_cmpint (g_slist_length (fbd_event_get_feedbacks (event)), ==, 1);
+  g_assert_cmpint (g_slist_length (fbd_event_get_playbacks (event)), ==, 1);
   g_assert_cmpint (fbd_event_get_end_reason (event), ==, FBD_EVENT_END_REASON_NATURAL);
   g_assert_false (ended);
   fbd_event_end_feedbacks_by_level (event, 4);
-  g_assert_cmpint (g_slist_length (fbd_event_get_feedbacks (event)), ==, 0);
+  g_assert_cmpint (g_slist_length (fbd_event_get_playbacks (event)), ==, 0);
   g_assert_cmpint (fbd_event_get_end_reason (event), ==, FBD_EVENT_END_REASON_EXPLICIT);
   g_assert_true (ended);
 
@@ -178,9 +175,9 @@ test_fbd_event_feedback_loop (void)
 
   event = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_LOOP, NULL);
   feedback1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 0);
   feedback2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 0);
 
   g_signal_connect (event, "feedbacks-ended",
                     (GCallback)on_feedbacks_ended, &ended);
@@ -200,9 +197,9 @@ test_fbd_event_feedback_timeout (void)
 
   event = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, 1, NULL);
   feedback1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback1), 0);
   feedback2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
-  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2));
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (feedback2), 0);
 
   g_signal_connect (event, "feedbacks-ended",
                     (GCallback)on_feedbacks_ended, &ended);
@@ -212,6 +209,89 @@ test_fbd_event_feedback_timeout (void)
   g_assert_true (ended);
 }
 
+static void
+test_fbd_event_feedback_loop_until (void)
+{
+  g_autoptr (FbdEvent) loop = NULL, timeout = NULL, oneshot = NULL;
+  g_autoptr (FbdFeedbackDummy) feedback = NULL;
+  FbdFeedbackPlayback *playback, *first, *second;
+  gint64 now = g_get_monotonic_time ();
+
+  feedback = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, "duration", 10000, NULL);
+
+  loop = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_LOOP, NULL);
+  playback = fbd_event_add_feedback (loop, FBD_FEEDBACK_BASE (feedback), 0);
+  fbd_event_run_feedbacks (loop);
+  g_assert_cmpint (playback->loop_until, ==, G_MAXINT64);
+  fbd_event_end_feedbacks (loop);
+
+  /* Feedbacks can loop on their own until the timeout */
+  timeout = fbd_event_new (2, TEST_APP_ID, TEST_EVENT, 2, NULL);
+  playback = fbd_event_add_feedback (timeout, FBD_FEEDBACK_BASE (feedback), 0);
+  fbd_event_run_feedbacks (timeout);
+  g_assert_cmpint (playback->loop_until, >=, now + 2 * G_USEC_PER_SEC);
+  g_assert_cmpint (playback->loop_until, <=, g_get_monotonic_time () + 2 * G_USEC_PER_SEC);
+  fbd_event_end_feedbacks (timeout);
+
+  /* Oneshot events and sequences don't loop on their own */
+  oneshot = fbd_event_new (3, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_ONESHOT, NULL);
+  playback = fbd_event_add_feedback (oneshot, FBD_FEEDBACK_BASE (feedback), 0);
+  fbd_event_run_feedbacks (oneshot);
+  g_assert_cmpint (playback->loop_until, ==, 0);
+  fbd_event_end_feedbacks (oneshot);
+
+  g_clear_object (&loop);
+  loop = fbd_event_new (4, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_LOOP, NULL);
+  first = fbd_event_add_feedback (loop, FBD_FEEDBACK_BASE (feedback), 0);
+  second = fbd_event_add_feedback (loop, FBD_FEEDBACK_BASE (feedback), 0);
+  fbd_feedback_playback_set_after (second, first);
+  fbd_event_run_feedbacks (loop);
+  g_assert_cmpint (first->loop_until, ==, 0);
+  fbd_event_end_feedbacks (loop);
+}
+
+static void
+test_fbd_event_feedback_shared (void)
+{
+  g_autoptr (FbdEvent) event1 = NULL;
+  g_autoptr (FbdEvent) event2 = NULL;
+  g_autoptr (FbdFeedbackDummy) feedback = NULL;
+  FbdFeedbackPlayback *playback1, *playback2;
+  gboolean ended1 = FALSE, ended2 = FALSE;
+
+  feedback = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, "duration", 10000, NULL);
+
+  event1 = fbd_event_new (1, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_ONESHOT, NULL);
+  playback1 = fbd_event_add_feedback (event1, FBD_FEEDBACK_BASE (feedback), 0);
+  g_signal_connect (event1, "feedbacks-ended", (GCallback)on_feedbacks_ended, &ended1);
+
+  event2 = fbd_event_new (2, TEST_APP_ID, TEST_EVENT, FBD_EVENT_TIMEOUT_ONESHOT, NULL);
+  playback2 = fbd_event_add_feedback (event2, FBD_FEEDBACK_BASE (feedback), 0);
+  g_signal_connect (event2, "feedbacks-ended", (GCallback)on_feedbacks_ended, &ended2);
+
+  /* Both events play the same feedback at once */
+  g_assert_true (playback1 != playback2);
+  g_assert_true (playback1->feedback == playback2->feedback);
+  g_assert_cmpint (playback1->event_id, ==, 1);
+  g_assert_cmpint (playback2->event_id, ==, 2);
+
+  fbd_event_run_feedbacks (event1);
+  fbd_event_run_feedbacks (event2);
+  g_assert_cmpint (playback1->timer_id, !=, 0);
+  g_assert_cmpint (playback2->timer_id, !=, 0);
+
+  /* Ending one doesn't affect the other */
+  fbd_event_end_feedbacks (event1);
+  g_assert_true (ended1);
+  g_assert_cmpint (playback1->timer_id, ==, 0);
+  g_assert_false (ended2);
+  g_assert_false (fbd_event_get_feedbacks_ended (event2));
+  g_assert_cmpint (playback2->timer_id, !=, 0);
+
+  fbd_event_end_feedbacks (event2);
+  g_assert_true (ended2);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -224,6 +304,9 @@ main (gint argc, gchar *argv[])
                    test_fbd_event_feedback_end_by_level);
   g_test_add_func ("/feedbackd/fbd/event/feedbacks/loop", test_fbd_event_feedback_loop);
   g_test_add_func ("/feedbackd/fbd/event/feedbacks/timeout", test_fbd_event_feedback_timeout);
+  g_test_add_func ("/feedbackd/fbd/event/feedbacks/loop-until",
+                   test_fbd_event_feedback_loop_until);
+  g_test_add_func ("/feedbackd/fbd/event/feedbacks/shared", test_fbd_event_feedback_shared);
 
   return g_test_run ();
 }
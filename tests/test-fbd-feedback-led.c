@@ -57,6 +57,89 @@ test_fbd_feedback_led_color_string_to_color (void)
 }
 
 
+static void
+test_fbd_feedback_led_steps (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  g_autoptr (FbdLedAnimation) steps = NULL;
+  const FbdLedStep *step;
+  GObject *object;
+
+  node = json_from_string ("{"
+                           " \"event-name\" : \"message-new-instant\","
+                           " \"type\"       : \"Led\","
+                           " \"color\"      : \"#00ff00\","
+                           " \"steps\"      : ["
+                           "   { \"duration\": 200, \"brightness\": 80, \"color\": \"red\" },"
+                           "   { \"duration\": 300, \"ramp\": true }"
+                           " ]"
+                           "}", &err);
+  g_assert_no_error (err);
+
+  object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_LED, node);
+  g_object_get (object, "steps", &steps, NULL);
+  g_assert_nonnull (steps);
+  g_assert_cmpint (fbd_led_animation_get_n_steps (steps), ==, 2);
+  g_assert_true (fbd_led_animation_get_repeat (steps));
+
+  step = fbd_led_animation_get_step (steps, 0);
+  g_assert_cmpint (step->kind, ==, FBD_LED_STEP_HOLD);
+  g_assert_cmpint (step->duration, ==, 200);
+  g_assert_cmpint (step->brightness, ==, 80);
+  g_assert_true (step->has_color);
+  g_assert_cmpint (step->rgb.r, ==, 255);
+  g_assert_cmpint (step->rgb.g, ==, 0);
+
+  step = fbd_led_animation_get_step (steps, 1);
+  g_assert_cmpint (step->kind, ==, FBD_LED_STEP_RAMP);
+  g_assert_cmpint (step->duration, ==, 300);
+  g_assert_cmpint (step->brightness, ==, 100);
+  g_assert_false (step->has_color);
+
+  g_assert_finalize_object (object);
+}
+
+
+static void
+test_fbd_feedback_led_shape (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  FbdLedAnimation *animation;
+  FbdFeedbackLed *self;
+  GObject *object;
+
+  node = json_from_string ("{"
+                           " \"event-name\"     : \"message-new-instant\","
+                           " \"type\"           : \"Led\","
+                           " \"color\"          : \"blue\","
+                           " \"frequency\"      : 1000,"
+                           " \"max-brightness\" : 50,"
+                           " \"shape\"          : \"heartbeat\""
+                           "}", &err);
+  g_assert_no_error (err);
+
+  object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_LED, node);
+  self = FBD_FEEDBACK_LED (object);
+  g_assert_cmpint (self->shape, ==, FBD_FEEDBACK_LED_SHAPE_HEARTBEAT);
+
+  /* Built once so the compiled pattern is reused */
+  animation = get_shape_animation (self);
+  g_assert_nonnull (animation);
+  g_assert_true (get_shape_animation (self) == animation);
+  g_assert_cmpint (fbd_led_animation_get_n_steps (animation), ==, 5);
+  g_assert_cmpint (fbd_led_animation_get_duration (animation), ==, 1000);
+  g_assert_cmpint (fbd_led_animation_get_step (animation, 0)->brightness, ==, 50);
+  g_assert_finalize_object (object);
+
+  /* Breathing is the periodic pattern itself */
+  object = g_object_new (FBD_TYPE_FEEDBACK_LED, "frequency", 1000, NULL);
+  g_assert_null (get_shape_animation (FBD_FEEDBACK_LED (object)));
+  g_assert_finalize_object (object);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -65,6 +148,8 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/feedbackd/fbd/feedback-led/parse-color", test_fbd_feedback_led_parse_color);
   g_test_add_func("/feedbackd/fbd/feedback-led/color-string-to-color",
                   test_fbd_feedback_led_color_string_to_color);
+  g_test_add_func("/feedbackd/fbd/feedback-led/steps", test_fbd_feedback_led_steps);
+  g_test_add_func("/feedbackd/fbd/feedback-led/shape", test_fbd_feedback_led_shape);
 
   return g_test_run();
 }
@@ -0,0 +1,562 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-event.h"
+#include "fbd-feedback-manager.h"
+#include "fbd-stats.h"
+#include "lfb-names.h"
+
+#include "testlib.h"
+
+#define TEST_APP_SCHEMA FEEDBACKD_SCHEMA_ID ".application"
+#define TEST_APP_PREFIX "/org/sigxcpu/feedbackd/application/"
+/* Matches the manager's per app level cache */
+#define TEST_APP_LEVEL_CACHE_SIZE 32
+#define TEST_WAIT_TIMEOUT (5 * G_USEC_PER_SEC)
+
+typedef struct {
+  GTestDBus          *dbus;
+  GDBusConnection    *connection;
+  FbdFeedbackManager *manager;
+  const char         *name;
+} TestFixture;
+
+typedef struct {
+  guint n_ended;
+  guint id;
+  int   reason;
+} TestEnded;
+
+
+static GDBusConnection *
+new_bus_connection (GTestDBus *dbus)
+{
+  g_autoptr (GError) err = NULL;
+  GDBusConnection *connection;
+
+  connection = g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (dbus),
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                       G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                       NULL,
+                                                       NULL,
+                                                       &err);
+  g_assert_no_error (err);
+
+  return connection;
+}
+
+
+static void
+fixture_setup (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GError) err = NULL;
+
+  g_setenv ("FEEDBACK_THEME", TEST_DATA_DIR "/test.json", TRUE);
+
+  fixture->dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (fixture->dbus);
+  fixture->connection = new_bus_connection (fixture->dbus);
+  fixture->name = g_dbus_connection_get_unique_name (fixture->connection);
+
+  /* Method calls arrive on the main thread so no dispatcher is needed */
+  fixture->manager = fbd_feedback_manager_get_default ();
+  fbd_feedback_manager_load_theme (fixture->manager);
+  g_assert_true (g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (fixture->manager),
+                                                   fixture->connection,
+                                                   FB_DBUS_PATH,
+                                                   &err));
+  g_assert_no_error (err);
+}
+
+
+static void
+fixture_teardown (TestFixture *fixture, gconstpointer unused)
+{
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (fixture->manager));
+  g_clear_object (&fixture->manager);
+
+  g_dbus_connection_close_sync (fixture->connection, NULL, NULL);
+  g_clear_object (&fixture->connection);
+  g_test_dbus_down (fixture->dbus);
+  g_clear_object (&fixture->dbus);
+}
+
+
+static void
+on_call_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GTask *task = user_data;
+  GError *err = NULL;
+  GVariant *reply;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &err);
+  if (reply)
+    g_task_return_pointer (task, reply, (GDestroyNotify) g_variant_unref);
+  else
+    g_task_return_error (task, err);
+  g_object_unref (task);
+}
+
+/* Calls a method on the manager, @task completes with the reply */
+static void
+start_call (TestFixture     *fixture,
+            GDBusConnection *client,
+            const char      *method_name,
+            GVariant        *parameters,
+            GTask           *task)
+{
+  g_dbus_connection_call (client,
+                          fixture->name,
+                          FB_DBUS_PATH,
+                          FB_DBUS_NAME,
+                          method_name,
+                          parameters,
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_call_done,
+                          g_object_ref (task));
+}
+
+
+/* Calls a method on the manager running the main loop until it replies */
+static GVariant *
+call_manager (TestFixture     *fixture,
+              GDBusConnection *client,
+              const char      *method_name,
+              GVariant        *parameters)
+{
+  g_autoptr (GTask) task = g_task_new (NULL, NULL, NULL, NULL);
+  g_autoptr (GError) err = NULL;
+  GVariant *reply;
+
+  start_call (fixture, client, method_name, parameters, task);
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, TRUE);
+
+  reply = g_task_propagate_pointer (task, &err);
+  g_assert_no_error (err);
+
+  return reply;
+}
+
+
+static guint
+trigger (TestFixture *fixture, GDBusConnection *client, const char *app_id, const char *event)
+{
+  g_autoptr (GVariant) reply = NULL;
+  guint id;
+
+  reply = call_manager (fixture, client, "TriggerFeedback",
+                        g_variant_new_parsed ("(%s, %s, @a{sv} {}, -1)", app_id, event));
+  g_variant_get (reply, "(u)", &id);
+
+  return id;
+}
+
+
+static void
+end_feedback (TestFixture *fixture, GDBusConnection *client, guint id)
+{
+  g_autoptr (GVariant) reply = NULL;
+
+  reply = call_manager (fixture, client, "EndFeedback", g_variant_new ("(u)", id));
+}
+
+
+static void
+get_capabilities (TestFixture *fixture, GDBusConnection *client, const char *app_id)
+{
+  g_autoptr (GVariant) reply = NULL;
+  const char *events[] = { "test-dummy-0", NULL };
+
+  reply = call_manager (fixture, client, "GetEventCapabilities",
+                        g_variant_new ("(^ass)", events, app_id));
+}
+
+
+/* Makes sure all earlier signals from the manager reached @client */
+static void
+sync_client (TestFixture *fixture, GDBusConnection *client)
+{
+  get_capabilities (fixture, client, TEST_APP_ID);
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+
+static void
+wait_for_n_objects (FbdStatsObject object, guint64 n)
+{
+  gint64 end = g_get_monotonic_time () + TEST_WAIT_TIMEOUT;
+
+  while (fbd_stats_get_n_objects (fbd_stats_get_default (), object) != n) {
+    g_assert_cmpint (g_get_monotonic_time (), <, end);
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+  }
+}
+
+
+static void
+on_feedback_ended (GDBusConnection *connection,
+                   const char      *sender_name,
+                   const char      *object_path,
+                   const char      *interface_name,
+                   const char      *signal_name,
+                   GVariant        *parameters,
+                   gpointer         user_data)
+{
+  TestEnded *ended = user_data;
+  guint reason;
+
+  g_variant_get (parameters, "(uu)", &ended->id, &reason);
+  ended->reason = (int)reason;
+  ended->n_ended++;
+}
+
+
+static guint
+subscribe_feedback_ended (GDBusConnection *client, TestEnded *ended)
+{
+  return g_dbus_connection_signal_subscribe (client,
+                                             NULL,
+                                             FB_DBUS_NAME,
+                                             "FeedbackEnded",
+                                             FB_DBUS_PATH,
+                                             NULL,
+                                             G_DBUS_SIGNAL_FLAGS_NONE,
+                                             on_feedback_ended,
+                                             ended,
+                                             NULL);
+}
+
+
+static void
+wait_for_ended (TestEnded *ended, guint n_ended)
+{
+  gint64 end = g_get_monotonic_time () + TEST_WAIT_TIMEOUT;
+
+  while (ended->n_ended < n_ended) {
+    g_assert_cmpint (g_get_monotonic_time (), <, end);
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+  }
+}
+
+
+static void
+set_app_profile (const char *munged_app_id, const char *profile)
+{
+  g_autofree char *path = g_strconcat (TEST_APP_PREFIX, munged_app_id, "/", NULL);
+  g_autoptr (GSettings) settings = g_settings_new_with_path (TEST_APP_SCHEMA, path);
+
+  g_settings_set_string (settings, "profile", profile);
+}
+
+
+static void
+test_fbd_feedback_manager_client_vanished (TestFixture *fixture, gconstpointer unused)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  guint64 n_events, n_watches;
+  guint ids[2];
+
+  /* Probing finishes before the first call is handled */
+  sync_client (fixture, client);
+  n_events = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT);
+  n_watches = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_CLIENT_WATCH);
+
+  /* One watch for all of the client's events */
+  ids[0] = trigger (fixture, client, TEST_APP_ID, "test-dummy-10");
+  ids[1] = trigger (fixture, client, TEST_APP_ID, "test-dummy-10");
+  g_assert_cmpuint (ids[0], !=, ids[1]);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT), ==, n_events + 2);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_CLIENT_WATCH), ==,
+                    n_watches + 1);
+
+  /* Ending one event keeps the watch */
+  end_feedback (fixture, client, ids[0]);
+  wait_for_n_objects (FBD_STATS_OBJECT_EVENT, n_events + 1);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_CLIENT_WATCH), ==,
+                    n_watches + 1);
+
+  /* The client vanishing ends its remaining event and drops the watch */
+  g_dbus_connection_close_sync (client, NULL, NULL);
+  g_clear_object (&client);
+  wait_for_n_objects (FBD_STATS_OBJECT_EVENT, n_events);
+  wait_for_n_objects (FBD_STATS_OBJECT_CLIENT_WATCH, n_watches);
+
+  /* The watch is also dropped with the last event of a client that stays around */
+  client = new_bus_connection (fixture->dbus);
+  ids[0] = trigger (fixture, client, TEST_APP_ID, "test-dummy-10");
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_CLIENT_WATCH), ==,
+                    n_watches + 1);
+  end_feedback (fixture, client, ids[0]);
+  wait_for_n_objects (FBD_STATS_OBJECT_EVENT, n_events);
+  wait_for_n_objects (FBD_STATS_OBJECT_CLIENT_WATCH, n_watches);
+}
+
+
+static void
+test_fbd_feedback_manager_unicast_ended (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  g_autoptr (GDBusConnection) other = new_bus_connection (fixture->dbus);
+  TestEnded client_ended = { 0 }, other_ended = { 0 };
+  guint client_sub, other_sub;
+  guint id;
+
+  client_sub = subscribe_feedback_ended (client, &client_ended);
+  other_sub = subscribe_feedback_ended (other, &other_ended);
+  sync_client (fixture, client);
+  sync_client (fixture, other);
+
+  id = trigger (fixture, client, TEST_APP_ID, "test-dummy-0");
+  wait_for_ended (&client_ended, 1);
+  g_assert_cmpuint (client_ended.id, ==, id);
+  g_assert_cmpint (client_ended.reason, ==, FBD_EVENT_END_REASON_NATURAL);
+
+  /* A broadcast would have reached the other client before its reply */
+  sync_client (fixture, other);
+  g_assert_cmpuint (other_ended.n_ended, ==, 0);
+
+  /* Not found events are only reported to their sender as well */
+  id = trigger (fixture, other, TEST_APP_ID, "does-not-exist");
+  wait_for_ended (&other_ended, 1);
+  g_assert_cmpuint (other_ended.id, ==, id);
+  g_assert_cmpint (other_ended.reason, ==, FBD_EVENT_END_REASON_NOT_FOUND);
+  sync_client (fixture, client);
+  g_assert_cmpuint (client_ended.n_ended, ==, 1);
+
+  g_dbus_connection_signal_unsubscribe (client, client_sub);
+  g_dbus_connection_signal_unsubscribe (other, other_sub);
+}
+
+
+static void
+test_fbd_feedback_manager_app_profile (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  TestEnded ended = { 0 };
+  guint sub, id;
+
+  sub = subscribe_feedback_ended (client, &ended);
+
+  id = trigger (fixture, client, "org.example.Profile", "test-dummy-0");
+  wait_for_ended (&ended, 1);
+  g_assert_cmpuint (ended.id, ==, id);
+  g_assert_cmpint (ended.reason, ==, FBD_EVENT_END_REASON_NATURAL);
+
+  /* The cached level follows the app's settings */
+  set_app_profile ("org-example-profile", "silent");
+  while (g_main_context_iteration (NULL, FALSE));
+
+  id = trigger (fixture, client, "org.example.Profile", "test-dummy-0");
+  wait_for_ended (&ended, 2);
+  g_assert_cmpuint (ended.id, ==, id);
+  g_assert_cmpint (ended.reason, ==, FBD_EVENT_END_REASON_NOT_FOUND);
+
+  /* Other apps aren't affected */
+  id = trigger (fixture, client, "org.example.Other", "test-dummy-0");
+  wait_for_ended (&ended, 3);
+  g_assert_cmpuint (ended.id, ==, id);
+  g_assert_cmpint (ended.reason, ==, FBD_EVENT_END_REASON_NATURAL);
+
+  g_dbus_connection_signal_unsubscribe (client, sub);
+}
+
+
+static void
+test_fbd_feedback_manager_deferred (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  g_autoptr (GTask) triggered = g_task_new (NULL, NULL, NULL, NULL);
+  g_autoptr (GTask) prepared = g_task_new (NULL, NULL, NULL, NULL);
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) err = NULL;
+  TestEnded ended = { 0 };
+  guint sub, id;
+
+  sub = subscribe_feedback_ended (client, &ended);
+
+  /* Devices are still being probed so the calls are kept until that's done */
+  start_call (fixture, client, "PrepareFeedback",
+              g_variant_new_parsed ("(%s, %s, @a{sv} {})", TEST_APP_ID, "test-dummy-0"),
+              prepared);
+  start_call (fixture, client, "TriggerFeedback",
+              g_variant_new_parsed ("(%s, %s, @a{sv} {}, -1)", TEST_APP_ID, "test-dummy-0"),
+              triggered);
+  while (!g_task_get_completed (prepared) || !g_task_get_completed (triggered))
+    g_main_context_iteration (NULL, TRUE);
+
+  reply = g_task_propagate_pointer (prepared, &err);
+  g_assert_no_error (err);
+  g_clear_pointer (&reply, g_variant_unref);
+
+  reply = g_task_propagate_pointer (triggered, &err);
+  g_assert_no_error (err);
+  g_variant_get (reply, "(u)", &id);
+  g_assert_cmpuint (id, >, 0);
+
+  /* The deferred event runs like any other */
+  wait_for_ended (&ended, 1);
+  g_assert_cmpuint (ended.id, ==, id);
+  g_assert_cmpint (ended.reason, ==, FBD_EVENT_END_REASON_NATURAL);
+
+  g_dbus_connection_signal_unsubscribe (client, sub);
+}
+
+
+static void
+test_fbd_feedback_manager_idle_time (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  guint64 n_events;
+  gint64 start, now, idle;
+  guint id;
+
+  /* Probing keeps the daemon busy */
+  sync_client (fixture, client);
+  n_events = fbd_stats_get_n_objects (fbd_stats_get_default (), FBD_STATS_OBJECT_EVENT);
+  start = g_get_monotonic_time ();
+
+  g_usleep (1000);
+  g_assert_cmpint (fbd_feedback_manager_get_idle_time (fixture->manager), >=, 1000);
+
+  /* Running events keep the daemon busy */
+  id = trigger (fixture, client, TEST_APP_ID, "test-dummy-10");
+  g_assert_cmpint (fbd_feedback_manager_get_idle_time (fixture->manager), ==, 0);
+
+  /* Once they ended the idle time starts over */
+  end_feedback (fixture, client, id);
+  wait_for_n_objects (FBD_STATS_OBJECT_EVENT, n_events);
+  idle = fbd_feedback_manager_get_idle_time (fixture->manager);
+  now = g_get_monotonic_time ();
+  g_assert_cmpint (idle, <=, now - start - 1000);
+}
+
+
+static void
+test_fbd_feedback_manager_profile_transition (TestFixture *fixture, gconstpointer unused)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  g_autoptr (GVariant) reply = NULL;
+  guint64 n_events, n_playbacks;
+  guint id;
+
+  sync_client (fixture, client);
+  g_assert_true (fbd_feedback_manager_set_profile (fixture->manager, "quiet"));
+  n_events = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT);
+  n_playbacks = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK);
+
+  /* A looping event only gets the quiet feedback */
+  reply = call_manager (fixture, client, "TriggerFeedback",
+                        g_variant_new_parsed ("(%s, %s, @a{sv} {}, 0)",
+                                              TEST_APP_ID, "test-dummy-10"));
+  g_variant_get (reply, "(u)", &id);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK), ==,
+                    n_playbacks + 1);
+
+  /* Raising the level starts the full feedback next to the running one */
+  g_assert_true (fbd_feedback_manager_set_profile (fixture->manager, "full"));
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK), ==,
+                    n_playbacks + 2);
+
+  /* Lowering it again only ends the full feedback */
+  g_assert_true (fbd_feedback_manager_set_profile (fixture->manager, "quiet"));
+  wait_for_n_objects (FBD_STATS_OBJECT_PLAYBACK, n_playbacks + 1);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT), ==, n_events + 1);
+
+  /* Switching to the same level changes nothing */
+  g_assert_true (fbd_feedback_manager_set_profile (fixture->manager, "quiet"));
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK), ==,
+                    n_playbacks + 1);
+
+  end_feedback (fixture, client, id);
+  wait_for_n_objects (FBD_STATS_OBJECT_EVENT, n_events);
+  wait_for_n_objects (FBD_STATS_OBJECT_PLAYBACK, n_playbacks);
+
+  g_assert_true (fbd_feedback_manager_set_profile (fixture->manager, "full"));
+}
+
+
+static void
+on_capabilities_changed (guint *n_changed)
+{
+  (*n_changed)++;
+}
+
+
+static void
+test_fbd_feedback_manager_app_level_lru (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDBusConnection) client = new_bus_connection (fixture->dbus);
+  guint n_changed = 0;
+
+  /* Fill the cache, the first app is the least recently used one */
+  for (guint i = 0; i < TEST_APP_LEVEL_CACHE_SIZE; i++) {
+    g_autofree char *app_id = g_strdup_printf ("org.example.Lru%u", i);
+
+    get_capabilities (fixture, client, app_id);
+  }
+  while (g_main_context_iteration (NULL, FALSE));
+
+  g_signal_connect_swapped (fixture->manager, "capabilities-changed",
+                            G_CALLBACK (on_capabilities_changed), &n_changed);
+
+  /* Cached apps get notified about changes */
+  set_app_profile ("org-example-lru0", "quiet");
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (n_changed, ==, 1);
+
+  /* Using the first app again makes the second one the least recently used */
+  get_capabilities (fixture, client, "org.example.Lru0");
+  get_capabilities (fixture, client, "org.example.Lru32");
+  while (g_main_context_iteration (NULL, FALSE));
+
+  /* Evicted apps don't watch their settings anymore */
+  set_app_profile ("org-example-lru1", "quiet");
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (n_changed, ==, 1);
+
+  /* The reused and the new app are still cached */
+  set_app_profile ("org-example-lru0", "silent");
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (n_changed, ==, 2);
+  set_app_profile ("org-example-lru32", "silent");
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (n_changed, ==, 3);
+
+  g_signal_handlers_disconnect_by_data (fixture->manager, &n_changed);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/feedbackd/fbd/feedback-manager/client-vanished", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_client_vanished, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/unicast-ended", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_unicast_ended, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/deferred", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_deferred, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/idle-time", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_idle_time, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/app-profile", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_app_profile, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/profile-transition", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_profile_transition, fixture_teardown);
+  g_test_add ("/feedbackd/fbd/feedback-manager/app-level-lru", TestFixture, NULL,
+              fixture_setup, test_fbd_feedback_manager_app_level_lru, fixture_teardown);
+
+  return g_test_run ();
+}
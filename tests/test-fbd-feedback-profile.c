@@ -6,6 +6,7 @@
 
 #include "fbd-feedback-profile.h"
 #include "fbd-feedback-dummy.h"
+#include "fbd-feedback-sound.h"
 #include "fbd-feedback-vibra.h"
 
 #include <json-glib/json-glib.h>
@@ -124,6 +125,126 @@ test_fbd_feedback_profile_update (void)
 }
 
 
+static void
+test_fbd_feedback_profile_lazy (void)
+{
+  const char *json ="                             "
+        "    {                                    "
+        "      \"name\" : \"test\",               "
+        "      \"feedbacks\" : [                  "
+        "        {                                "
+        "          \"type\" : \"sound\",          "
+        "          \"event-name\" : \"event1\",   "
+        "          \"effect\" : \"bell\"          "
+        "        },                               "
+        "        {                                "
+        "          \"type\" : \"vibra\",          "
+        "          \"event-name\" : \"event2\"    "
+        "        }                                "
+        "      ]                                  "
+        "    }                                    ";
+  g_autoptr (GHashTable) effects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr (FbdFeedbackDummy) fb2 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY,
+                                                   "event-name", "event2",
+                                                   NULL);
+  g_autoptr (FbdFeedbackDummy) fb3 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY,
+                                                   "event-name", "event3",
+                                                   NULL);
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  FbdFeedbackProfile *merged = fbd_feedback_profile_new (PROFILE_NAME);
+  FbdFeedbackProfile *parsed;
+  FbdFeedbackBase *fb;
+
+  node = json_from_string (json, &err);
+  g_assert_no_error (err);
+  parsed = FBD_FEEDBACK_PROFILE (json_gobject_deserialize (FBD_TYPE_FEEDBACK_PROFILE, node));
+
+  /* Parsed feedbacks replace built ones */
+  fbd_feedback_profile_add_feedback (merged, FBD_FEEDBACK_BASE (fb2));
+  fbd_feedback_profile_add_feedback (merged, FBD_FEEDBACK_BASE (fb3));
+  fbd_feedback_profile_update (merged, parsed);
+
+  fbd_feedback_profile_collect_sound_effects (merged, effects);
+  g_assert_cmpint (g_hash_table_size (effects), ==, 1);
+  g_assert_true (g_hash_table_contains (effects, "bell"));
+
+  fb = fbd_feedback_profile_get_feedback (merged, "event1");
+  g_assert_true (FBD_IS_FEEDBACK_SOUND (fb));
+  g_assert_cmpstr (fbd_feedback_sound_get_effect (FBD_FEEDBACK_SOUND (fb)), ==, "bell");
+  fb = fbd_feedback_profile_get_feedback (merged, "event2");
+  g_assert_true (FBD_IS_FEEDBACK_VIBRA (fb));
+  fb = fbd_feedback_profile_get_feedback (merged, "event3");
+  g_assert_true (fb == FBD_FEEDBACK_BASE (fb3));
+
+  /* Built feedbacks are found as well */
+  g_hash_table_remove_all (effects);
+  fbd_feedback_profile_collect_sound_effects (merged, effects);
+  g_assert_true (g_hash_table_contains (effects, "bell"));
+
+  g_assert_finalize_object (parsed);
+  g_assert_finalize_object (merged);
+}
+
+
+static void
+count_feedback (FbdFeedbackBase *feedback, guint *n)
+{
+  (*n)++;
+}
+
+
+static void
+test_fbd_feedback_profile_overlay (void)
+{
+  g_autoptr (GHashTable) effects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_autoptr (FbdFeedbackDummy) fb_1 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY,
+                                                    "event-name", "event1",
+                                                    NULL);
+  g_autoptr (FbdFeedbackSound) fb_2 = g_object_new (FBD_TYPE_FEEDBACK_SOUND,
+                                                    "event-name", "event2",
+                                                    "effect", "bell",
+                                                    NULL);
+  g_autoptr (FbdFeedbackVibra) fb_2_top = g_object_new (FBD_TYPE_FEEDBACK_VIBRA,
+                                                        "event-name", "event2",
+                                                        NULL);
+  g_autoptr (FbdFeedbackDummy) fb_3 = g_object_new (FBD_TYPE_FEEDBACK_DUMMY,
+                                                    "event-name", "event3",
+                                                    NULL);
+  FbdFeedbackProfile *base = fbd_feedback_profile_new (PROFILE_NAME);
+  FbdFeedbackProfile *top = fbd_feedback_profile_new (PROFILE_NAME);
+  FbdFeedbackProfile *overlay;
+  guint n = 0;
+
+  fbd_feedback_profile_add_feedback (base, FBD_FEEDBACK_BASE (fb_1));
+  fbd_feedback_profile_add_feedback (base, FBD_FEEDBACK_BASE (fb_2));
+  fbd_feedback_profile_add_feedback (top, FBD_FEEDBACK_BASE (fb_2_top));
+
+  overlay = fbd_feedback_profile_new_overlay (top, base);
+  g_assert_true (fbd_feedback_profile_get_feedback (overlay, "event1") == FBD_FEEDBACK_BASE (fb_1));
+  g_assert_true (fbd_feedback_profile_get_feedback (overlay, "event2") == FBD_FEEDBACK_BASE (fb_2_top));
+  g_assert_null (fbd_feedback_profile_get_feedback (overlay, "event3"));
+
+  /* Hidden feedbacks aren't visited */
+  fbd_feedback_profile_foreach_feedback (overlay, (GFunc)count_feedback, &n);
+  g_assert_cmpuint (n, ==, 2);
+  fbd_feedback_profile_collect_sound_effects (overlay, effects);
+  g_assert_cmpint (g_hash_table_size (effects), ==, 0);
+
+  /* Modifications don't leak into the sharing profile */
+  fbd_feedback_profile_add_feedback (overlay, FBD_FEEDBACK_BASE (fb_3));
+  g_assert_true (fbd_feedback_profile_get_feedback (overlay, "event3") == FBD_FEEDBACK_BASE (fb_3));
+  g_assert_null (fbd_feedback_profile_get_feedback (top, "event3"));
+  fbd_feedback_profile_add_feedback (top, FBD_FEEDBACK_BASE (fb_1));
+  g_assert_true (fbd_feedback_profile_get_feedback (top, "event1") == FBD_FEEDBACK_BASE (fb_1));
+  g_assert_true (fbd_feedback_profile_get_feedback (overlay, "event2") == FBD_FEEDBACK_BASE (fb_2_top));
+
+  g_assert_finalize_object (overlay);
+  g_assert_finalize_object (top);
+  g_assert_finalize_object (base);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -133,6 +254,8 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/feedbackd/fbd/feedback-profile/feedbacks", test_fbd_feedback_profile_feedbacks);
   g_test_add_func("/feedbackd/fbd/feedback-profile/parse", test_fbd_feedback_profile_parse);
   g_test_add_func("/feedbackd/fbd/feedback-profile/update", test_fbd_feedback_profile_update);
+  g_test_add_func("/feedbackd/fbd/feedback-profile/lazy", test_fbd_feedback_profile_lazy);
+  g_test_add_func("/feedbackd/fbd/feedback-profile/overlay", test_fbd_feedback_profile_overlay);
 
   return g_test_run();
 }
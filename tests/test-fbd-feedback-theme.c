@@ -126,6 +126,164 @@ test_fbd_feedback_theme_parse (void)
 }
 
 
+static void
+test_fbd_feedback_theme_lookup (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  g_autoptr (FbdFeedbackProfile) silent = fbd_feedback_profile_new ("silent");
+  g_autoptr (FbdFeedbackDummy) silent_fb = g_object_new (FBD_TYPE_FEEDBACK_DUMMY,
+                                                         "event-name", "test-dummy-10",
+                                                         NULL);
+  FbdFeedbackProfile *profile;
+  FbdFeedbackThemeEntry *entry;
+  GArray *feedbacks;
+  FbdFeedbackBase *fb;
+
+  theme = fbd_feedback_theme_new_from_file (TEST_DATA_DIR "/parent/base.json", &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_FEEDBACK_THEME (theme));
+
+  /* Found at full and quiet level, lowest level first */
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "test-dummy-00");
+  g_assert_nonnull (feedbacks);
+  g_assert_cmpint (feedbacks->len, ==, 2);
+  profile = fbd_feedback_theme_get_profile (theme, "quiet");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-00");
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 0);
+  g_assert_true (entry->feedback == fb);
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_QUIET);
+  profile = fbd_feedback_theme_get_profile (theme, "full");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-00");
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 1);
+  g_assert_true (entry->feedback == fb);
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_QUIET,
+                                                   "test-dummy-00");
+  g_assert_cmpint (feedbacks->len, ==, 1);
+
+  /* No silent profile */
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_SILENT,
+                                                   "test-dummy-00");
+  g_assert_null (feedbacks);
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "does-not-exist");
+  g_assert_null (feedbacks);
+  /* Served from the cached misses */
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "does-not-exist");
+  g_assert_null (feedbacks);
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_UNKNOWN,
+                                                   "test-dummy-00");
+  g_assert_null (feedbacks);
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_SILENT,
+                                                   "test-dummy-10");
+  g_assert_null (feedbacks);
+
+  /* Adding a profile invalidates the table */
+  fbd_feedback_profile_add_feedback (silent, FBD_FEEDBACK_BASE (silent_fb));
+  fbd_feedback_theme_add_profile (theme, silent);
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "test-dummy-10");
+  g_assert_nonnull (feedbacks);
+  g_assert_cmpint (feedbacks->len, ==, 1);
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 0);
+  g_assert_true (entry->feedback == FBD_FEEDBACK_BASE (silent_fb));
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_SILENT);
+
+  /* The cached misses are gone too */
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_SILENT,
+                                                   "test-dummy-10");
+  g_assert_nonnull (feedbacks);
+}
+
+
+static void
+test_fbd_feedback_theme_group (void)
+{
+  const char *json = " {                      "
+        "  \"name\" : \"test\",               "
+        "  \"profiles\" : [                   "
+        "    {                                "
+        "      \"name\" : \"quiet\",          "
+        "      \"feedbacks\" : [              "
+        "        {                            "
+        "          \"type\" : \"dummy\",      "
+        "          \"event-name\" : \"event1\""
+        "        }                            "
+        "      ]                              "
+        "    },                               "
+        "    {                                "
+        "      \"name\" : \"full\",           "
+        "      \"feedbacks\" : [              "
+        "        {                            "
+        "          \"type\" : \"group\",      "
+        "          \"event-name\" : \"event1\","
+        "          \"mode\" : \"sequential\", "
+        "          \"feedbacks\" : [          "
+        "            {                        "
+        "              \"type\" : \"dummy\",  "
+        "              \"duration\" : 10      "
+        "            },                       "
+        "            {                        "
+        "              \"type\" : \"dummy\",  "
+        "              \"delay\" : 20         "
+        "            },                       "
+        "            {                        "
+        "              \"type\" : \"dummy\"   "
+        "            }                        "
+        "          ]                          "
+        "        }                            "
+        "      ]                              "
+        "    }                                "
+        "  ]                                  "
+        "}                                    ";
+  g_autoptr (GError) err = NULL;
+  g_autoptr (FbdFeedbackTheme) theme = NULL;
+  FbdFeedbackThemeEntry *entry;
+  GArray *feedbacks;
+
+  theme = fbd_feedback_theme_new_from_data (json, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (theme);
+
+  /* The group is replaced by its feedbacks */
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                   "event1");
+  g_assert_nonnull (feedbacks);
+  g_assert_cmpint (feedbacks->len, ==, 4);
+
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 0);
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_QUIET);
+  g_assert_cmpint (entry->after, ==, -1);
+
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 1);
+  g_assert_true (FBD_IS_FEEDBACK_DUMMY (entry->feedback));
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (entry->feedback)), ==, 10);
+  g_assert_cmpint (entry->after, ==, -1);
+
+  /* Each feedback follows the previous one of the group */
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 2);
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_FULL);
+  g_assert_cmpint (fbd_feedback_get_delay (entry->feedback), ==, 20);
+  g_assert_cmpint (entry->after, ==, 1);
+
+  entry = &g_array_index (feedbacks, FbdFeedbackThemeEntry, 3);
+  g_assert_cmpint (fbd_feedback_get_delay (entry->feedback), ==, 0);
+  g_assert_cmpint (entry->after, ==, 2);
+
+  feedbacks = fbd_feedback_theme_lookup_feedbacks (theme, FBD_FEEDBACK_PROFILE_LEVEL_QUIET,
+                                                   "event1");
+  g_assert_cmpint (feedbacks->len, ==, 1);
+}
+
+
 static void
 test_fbd_feedback_theme_update (void)
 {
@@ -198,6 +356,8 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/feedbackd/fbd/feedback-theme/name", test_fbd_feedback_theme_name);
   g_test_add_func("/feedbackd/fbd/feedback-theme/profiles", test_fbd_feedback_theme_profiles);
   g_test_add_func("/feedbackd/fbd/feedback-theme/parse", test_fbd_feedback_theme_parse);
+  g_test_add_func("/feedbackd/fbd/feedback-theme/lookup", test_fbd_feedback_theme_lookup);
+  g_test_add_func("/feedbackd/fbd/feedback-theme/group", test_fbd_feedback_theme_group);
   g_test_add_func("/feedbackd/fbd/feedback-theme/update", test_fbd_feedback_theme_update);
 
   return g_test_run();
@@ -8,7 +8,9 @@
 
 #define GMOBILE_USE_UNSTABLE_API
 #include "fbd-feedback-manager.h"
+#include "fbd-feedback-vibra-custom.h"
 #include "fbd-feedback-vibra-pattern.h"
+#include "fbd-feedback-vibra-envelope.h"
 #include "fbd-feedback-vibra-periodic.h"
 #include "fbd-feedback-vibra-rumble.h"
 
@@ -25,14 +27,17 @@ test_fbd_feedback_vibra_rumble (void)
   g_autoptr (JsonNode) node = NULL;
   GObject *object;
   double magnitude;
-  guint count, duration;
+  guint count, duration, priority;
+  g_autofree char *actuator = NULL;
 
   node = json_from_string("{"
                           " \"event-name\" : \"button-pressed\","
                           " \"type\"       : \"VibraRumble\","
                           " \"magnitude\"  : 0.7,"
                           " \"duration\"   : 100,"
-                          " \"count\"      : 2"
+                          " \"count\"      : 2,"
+                          " \"priority\"   : 10,"
+                          " \"actuator\"   : \"gamepad\""
                           "}", &err);
   g_assert_no_error (err);
 
@@ -43,11 +48,18 @@ test_fbd_feedback_vibra_rumble (void)
                 "magnitude", &magnitude,
                 "duration", &duration,
                 "count", &count,
+                "priority", &priority,
+                "actuator", &actuator,
                 NULL);
 
   g_assert_cmpfloat_with_epsilon (magnitude, 0.7, FLT_EPSILON);
   g_assert_cmpint (duration, ==, 100);
   g_assert_cmpint (count, ==, 2);
+  g_assert_cmpint (priority, ==, 10);
+  g_assert_cmpint (fbd_feedback_vibra_get_priority (FBD_FEEDBACK_VIBRA (object)), ==, 10);
+  g_assert_cmpstr (actuator, ==, "gamepad");
+  /* No motor with that tag */
+  g_assert_false (fbd_feedback_is_available (FBD_FEEDBACK_BASE (object)));
 
   g_assert_finalize_object (object);
   g_assert_finalize_object (manager);
@@ -66,20 +78,27 @@ test_fbd_feedback_vibra_pattern (void)
   GObject *object;
   guint *duration;
   double *magnitude;
+  gboolean kernel_playback;
 
   node = json_from_string("{"
-                          " \"event-name\" : \"button-pressed\","
-                          " \"type\"       : \"VibraPattern\","
-                          " \"magnitudes\" : [ 0.2, 1.0 ],"
-                          " \"durations\"  : [ 7, 3 ]"
+                          " \"event-name\"      : \"button-pressed\","
+                          " \"type\"            : \"VibraPattern\","
+                          " \"magnitudes\"      : [ 0.2, 1.0 ],"
+                          " \"durations\"       : [ 7, 3 ],"
+                          " \"kernel-playback\" : true"
                           "}", &err);
   g_assert_no_error (err);
 
   object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_VIBRA_PATTERN, node);
-  g_object_get (object, "durations", &durations, "magnitudes", &magnitudes, NULL);
+  g_object_get (object,
+                "durations", &durations,
+                "magnitudes", &magnitudes,
+                "kernel-playback", &kernel_playback,
+                NULL);
 
   g_assert_nonnull(durations);
   g_assert_nonnull(magnitudes);
+  g_assert_true (kernel_playback);
 
   duration = &g_array_index (durations, guint, 0);
   g_assert_cmpint (*duration, ==, 7);
@@ -96,6 +115,183 @@ test_fbd_feedback_vibra_pattern (void)
 }
 
 
+static void
+test_fbd_feedback_vibra_pattern_repeat (void)
+{
+  /* Create manager upfront so we can dispose it, otherwise creating
+   * any feedback would create it implicitly */
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  GObject *object;
+  guint repeat_count, repeat_from;
+
+  node = json_from_string("{"
+                          " \"event-name\"   : \"phone-incoming-call\","
+                          " \"type\"         : \"VibraPattern\","
+                          " \"magnitudes\"   : [ 1.0, 0.0, 0.5, 0.0 ],"
+                          " \"durations\"    : [ 100, 50, 100, 250 ],"
+                          " \"repeat-count\" : 3,"
+                          " \"repeat-from\"  : 2"
+                          "}", &err);
+  g_assert_no_error (err);
+
+  object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_VIBRA_PATTERN, node);
+  g_object_get (object,
+                "repeat-count", &repeat_count,
+                "repeat-from", &repeat_from,
+                NULL);
+  g_assert_cmpuint (repeat_count, ==, 3);
+  g_assert_cmpuint (repeat_from, ==, 2);
+  /* The pattern once and the last two steps three more times */
+  g_assert_cmpuint (fbd_feedback_vibra_get_duration (FBD_FEEDBACK_VIBRA (object)), ==,
+                    500 + 3 * 350);
+
+  /* Out of range indices repeat the whole pattern */
+  g_object_set (object, "repeat-from", 4, NULL);
+  g_assert_cmpuint (fbd_feedback_vibra_get_duration (FBD_FEEDBACK_VIBRA (object)), ==, 4 * 500);
+
+  g_assert_finalize_object (object);
+  g_assert_finalize_object (manager);
+}
+
+
+static void
+test_fbd_feedback_vibra_pattern_compensate (void)
+{
+  const double magnitudes[] = { 0.5, 0.0, 1.0, 0.3, 0.4 };
+  const guint durations[] = { 100, 50, 20, 40, 10 };
+  const double expected_magnitudes[] = { 1.0, 0.5, 0.0, 1.0, 0.3, 0.4, 0.0 };
+  const guint expected_durations[] = { 30, 40, 80, 20, 40, 5, 5 };
+  g_autoptr (GArray) in_magnitudes = g_array_new (FALSE, FALSE, sizeof (double));
+  g_autoptr (GArray) in_durations = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_autoptr (GArray) out_magnitudes = NULL;
+  g_autoptr (GArray) out_durations = NULL;
+  guint total = 0;
+
+  g_array_append_vals (in_magnitudes, magnitudes, G_N_ELEMENTS (magnitudes));
+  g_array_append_vals (in_durations, durations, G_N_ELEMENTS (durations));
+
+  fbd_feedback_vibra_pattern_compensate (in_magnitudes, in_durations, 30, 30,
+                                         &out_magnitudes, &out_durations);
+
+  g_assert_cmpuint (out_magnitudes->len, ==, G_N_ELEMENTS (expected_magnitudes));
+  g_assert_cmpuint (out_durations->len, ==, out_magnitudes->len);
+  for (guint i = 0; i < out_magnitudes->len; i++) {
+    g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, i),
+                                    expected_magnitudes[i], FLT_EPSILON);
+    g_assert_cmpuint (g_array_index (out_durations, guint, i), ==, expected_durations[i]);
+    total += g_array_index (out_durations, guint, i);
+  }
+  /* The pattern keeps its length */
+  g_assert_cmpuint (total, ==, 220);
+}
+
+
+static void
+test_fbd_feedback_vibra_pattern_optimize (void)
+{
+  /*
+   * A short kick before a weaker rumble, a run of equal rumbles, merged
+   * pauses and a short bump between pauses. The short steps are
+   * stretched by taking time from their neighbours.
+   */
+  const double magnitudes[] = { 0.7, 0.5, 0.5, 0.5, 0.0, 0.0, 1.0, 0.0, 0.3 };
+  const guint durations[] = { 2, 20, 30, 0, 40, 60, 3, 50, 10 };
+  const double expected_magnitudes[] = { 0.7, 0.5, 0.0, 1.0, 0.0, 0.3 };
+  const guint expected_durations[] = { 5, 47, 98, 5, 50, 10 };
+  const double short_magnitudes[] = { 1.0, 0.5 };
+  const guint short_durations[] = { 1, 2 };
+  const double fold_magnitudes[] = { 0.5, 0.3, 0.5, 0.0, 0.0 };
+  const guint fold_durations[] = { 20, 2, 20, 3, 40 };
+  g_autoptr (GArray) in_magnitudes = g_array_new (FALSE, FALSE, sizeof (double));
+  g_autoptr (GArray) in_durations = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_autoptr (GArray) out_magnitudes = NULL;
+  g_autoptr (GArray) out_durations = NULL;
+  guint total = 0;
+
+  g_array_append_vals (in_magnitudes, magnitudes, G_N_ELEMENTS (magnitudes));
+  g_array_append_vals (in_durations, durations, G_N_ELEMENTS (durations));
+
+  fbd_feedback_vibra_pattern_optimize (in_magnitudes, in_durations, 5,
+                                       &out_magnitudes, &out_durations);
+
+  g_assert_cmpuint (out_magnitudes->len, ==, G_N_ELEMENTS (expected_magnitudes));
+  g_assert_cmpuint (out_durations->len, ==, out_magnitudes->len);
+  for (guint i = 0; i < out_magnitudes->len; i++) {
+    g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, i),
+                                    expected_magnitudes[i], FLT_EPSILON);
+    g_assert_cmpuint (g_array_index (out_durations, guint, i), ==, expected_durations[i]);
+    total += g_array_index (out_durations, guint, i);
+  }
+  /* The pattern keeps its length */
+  g_assert_cmpuint (total, ==, 215);
+  g_clear_pointer (&out_magnitudes, g_array_unref);
+  g_clear_pointer (&out_durations, g_array_unref);
+
+  /* Only short steps still leave one */
+  g_array_set_size (in_magnitudes, 0);
+  g_array_set_size (in_durations, 0);
+  g_array_append_vals (in_magnitudes, short_magnitudes, G_N_ELEMENTS (short_magnitudes));
+  g_array_append_vals (in_durations, short_durations, G_N_ELEMENTS (short_durations));
+
+  fbd_feedback_vibra_pattern_optimize (in_magnitudes, in_durations, 5,
+                                       &out_magnitudes, &out_durations);
+  g_assert_cmpuint (out_magnitudes->len, ==, 1);
+  g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, 0), 1.0, FLT_EPSILON);
+  g_assert_cmpuint (g_array_index (out_durations, guint, 0), ==, 3);
+  g_clear_pointer (&out_magnitudes, g_array_unref);
+  g_clear_pointer (&out_durations, g_array_unref);
+
+  /* Short steps fold into stronger rumbles or pauses */
+  g_array_set_size (in_magnitudes, 0);
+  g_array_set_size (in_durations, 0);
+  g_array_append_vals (in_magnitudes, fold_magnitudes, G_N_ELEMENTS (fold_magnitudes));
+  g_array_append_vals (in_durations, fold_durations, G_N_ELEMENTS (fold_durations));
+
+  fbd_feedback_vibra_pattern_optimize (in_magnitudes, in_durations, 5,
+                                       &out_magnitudes, &out_durations);
+  g_assert_cmpuint (out_magnitudes->len, ==, 2);
+  g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, 0), 0.5, FLT_EPSILON);
+  g_assert_cmpuint (g_array_index (out_durations, guint, 0), ==, 42);
+  g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, 1), 0.0, FLT_EPSILON);
+  g_assert_cmpuint (g_array_index (out_durations, guint, 1), ==, 43);
+}
+
+
+static void
+test_fbd_feedback_vibra_pattern_dither (void)
+{
+  const double magnitudes[] = { 0.5, 0.0, 1.0, 0.1 };
+  const guint durations[] = { 100, 20, 30, 80 };
+  const double expected_magnitudes[] = { 1.0, 0.0, 1.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 1.0, 0.0 };
+  const guint expected_durations[] = { 20, 20, 20, 20, 10, 10, 20, 30, 40, 8, 32 };
+  g_autoptr (GArray) in_magnitudes = g_array_new (FALSE, FALSE, sizeof (double));
+  g_autoptr (GArray) in_durations = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_autoptr (GArray) out_magnitudes = NULL;
+  g_autoptr (GArray) out_durations = NULL;
+  guint total = 0;
+
+  g_array_append_vals (in_magnitudes, magnitudes, G_N_ELEMENTS (magnitudes));
+  g_array_append_vals (in_durations, durations, G_N_ELEMENTS (durations));
+
+  /* The short pulse of the weak step is carried over to the next cycle */
+  fbd_feedback_vibra_pattern_dither (in_magnitudes, in_durations, 40, 5,
+                                     &out_magnitudes, &out_durations);
+
+  g_assert_cmpuint (out_magnitudes->len, ==, G_N_ELEMENTS (expected_magnitudes));
+  g_assert_cmpuint (out_durations->len, ==, out_magnitudes->len);
+  for (guint i = 0; i < out_magnitudes->len; i++) {
+    g_assert_cmpfloat_with_epsilon (g_array_index (out_magnitudes, double, i),
+                                    expected_magnitudes[i], FLT_EPSILON);
+    g_assert_cmpuint (g_array_index (out_durations, guint, i), ==, expected_durations[i]);
+    total += g_array_index (out_durations, guint, i);
+  }
+  /* The pattern keeps its length */
+  g_assert_cmpuint (total, ==, 230);
+}
+
+
 static void
 test_fbd_feedback_vibra_periodic (void)
 {
@@ -176,6 +372,100 @@ test_fbd_feedback_vibra_periodic_fallback (void)
 }
 
 
+static void
+test_fbd_feedback_vibra_envelope (void)
+{
+  /* Create manager upfront so we can dispose it, otherwise creating
+   * any feedback would create it implicitly */
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  GObject *object;
+  double magnitude, attack_level, fade_level;
+  guint duration, attack_time, fade_time;
+
+  node = json_from_string("{"
+                          " \"event-name\"    : \"button-pressed\","
+                          " \"type\"          : \"VibraEnvelope\","
+                          " \"duration\"      : 300,"
+                          " \"magnitude\"     : 0.8,"
+                          " \"attack-level\"  : 0.1,"
+                          " \"attack-time\"   : 100,"
+                          " \"fade-time\"     : 150"
+                          "}", &err);
+  g_assert_no_error (err);
+
+  object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_VIBRA_ENVELOPE, node);
+  g_object_get (object,
+                "duration", &duration,
+                "magnitude", &magnitude,
+                "attack-level", &attack_level,
+                "attack-time", &attack_time,
+                "fade-level", &fade_level,
+                "fade-time", &fade_time,
+                NULL);
+
+  g_assert_cmpint (duration, ==, 300);
+  g_assert_cmpfloat_with_epsilon (magnitude, 0.8, FLT_EPSILON);
+  g_assert_cmpfloat_with_epsilon (attack_level, 0.1, FLT_EPSILON);
+  g_assert_cmpint (attack_time, ==, 100);
+  g_assert_cmpfloat_with_epsilon (fade_level, 0.0, FLT_EPSILON);
+  g_assert_cmpint (fade_time, ==, 150);
+
+  g_assert_finalize_object (object);
+  g_assert_finalize_object (manager);
+}
+
+
+static void
+test_fbd_feedback_vibra_custom (void)
+{
+  /* Create manager upfront so we can dispose it, otherwise creating
+   * any feedback would create it implicitly */
+  FbdFeedbackManager *manager = fbd_feedback_manager_get_default ();
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+  g_autofree char *waveform = NULL;
+  const gint16 *samples;
+  GObject *object;
+  double magnitude;
+  guint n_samples;
+
+  node = json_from_string("{"
+                          " \"event-name\" : \"button-pressed\","
+                          " \"type\"       : \"VibraCustom\","
+                          " \"duration\"   : 30,"
+                          " \"waveform\"   : \"click\""
+                          "}", &err);
+  g_assert_no_error (err);
+
+  object = json_gobject_deserialize (FBD_TYPE_FEEDBACK_VIBRA_CUSTOM, node);
+  g_object_get (object,
+                "waveform", &waveform,
+                "magnitude", &magnitude,
+                NULL);
+  g_assert_cmpstr (waveform, ==, "click");
+  g_assert_cmpfloat_with_epsilon (magnitude, 1.0, FLT_EPSILON);
+
+  samples = fbd_feedback_vibra_custom_get_samples (FBD_FEEDBACK_VIBRA_CUSTOM (object), &n_samples);
+  g_assert_nonnull (samples);
+  g_assert_cmpuint (n_samples, ==, 4);
+  g_assert_cmpint (samples[1], ==, 1024);
+  g_assert_cmpint (samples[2], ==, -1024);
+  g_assert_cmpint (samples[3], ==, 512);
+
+  /* Missing waveforms are only reported once */
+  g_object_set (object, "waveform", "doesnotexist", NULL);
+  g_test_expect_message ("fbd-feedback-vibra-custom", G_LOG_LEVEL_WARNING, "*not found*");
+  g_assert_null (fbd_feedback_vibra_custom_get_samples (FBD_FEEDBACK_VIBRA_CUSTOM (object), NULL));
+  g_assert_null (fbd_feedback_vibra_custom_get_samples (FBD_FEEDBACK_VIBRA_CUSTOM (object), NULL));
+  g_test_assert_expected_messages ();
+
+  g_assert_finalize_object (object);
+  g_assert_finalize_object (manager);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -183,9 +473,19 @@ main (gint argc, gchar *argv[])
 
   g_test_add_func("/feedbackd/fbd/feedback-vibra/rumble", test_fbd_feedback_vibra_rumble);
   g_test_add_func("/feedbackd/fbd/feedback-vibra/pattern", test_fbd_feedback_vibra_pattern);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/pattern/repeat",
+                  test_fbd_feedback_vibra_pattern_repeat);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/pattern/compensate",
+                  test_fbd_feedback_vibra_pattern_compensate);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/pattern/optimize",
+                  test_fbd_feedback_vibra_pattern_optimize);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/pattern/dither",
+                  test_fbd_feedback_vibra_pattern_dither);
   g_test_add_func("/feedbackd/fbd/feedback-vibra/periodic", test_fbd_feedback_vibra_periodic);
   g_test_add_func("/feedbackd/fbd/feedback-vibra/periodic/fallback",
                   test_fbd_feedback_vibra_periodic_fallback);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/envelope", test_fbd_feedback_vibra_envelope);
+  g_test_add_func("/feedbackd/fbd/feedback-vibra/custom", test_fbd_feedback_vibra_custom);
 
   return g_test_run();
 }
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define _GNU_SOURCE
+
+#include "fbd-haptic-pattern.h"
+
+#include <gio/gio.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+static int
+new_pattern_fd (gconstpointer data, gsize size, int seals)
+{
+  int fd = memfd_create ("test-pattern", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  g_assert_cmpint (fd, >=, 0);
+  g_assert_cmpint (write (fd, data, size), ==, size);
+  if (seals)
+    g_assert_cmpint (fcntl (fd, F_ADD_SEALS, seals), ==, 0);
+
+  return fd;
+}
+
+
+static GBytes *
+map_pattern (gconstpointer data, gsize size, int seals, GError **error)
+{
+  int fd = new_pattern_fd (data, size, seals);
+  GBytes *bytes;
+
+  bytes = fbd_haptic_pattern_map_fd (fd, error);
+  close (fd);
+
+  return bytes;
+}
+
+
+static void
+test_fbd_haptic_pattern_seals (void)
+{
+  FbdHapticStep steps[] = { { 1.0, 10 } };
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GError) err = NULL;
+
+  /* Unsealed memfds could change while we parse them */
+  bytes = map_pattern (steps, sizeof (steps), 0, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_null (bytes);
+  g_clear_error (&err);
+
+  bytes = map_pattern (steps, sizeof (steps), F_SEAL_WRITE, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_null (bytes);
+  g_clear_error (&err);
+
+  bytes = map_pattern (steps, sizeof (steps), F_SEAL_SHRINK, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_null (bytes);
+  g_clear_error (&err);
+
+  bytes = map_pattern (steps, sizeof (steps), F_SEAL_WRITE | F_SEAL_SHRINK, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_bytes_get_size (bytes), ==, sizeof (steps));
+}
+
+
+static void
+test_fbd_haptic_pattern_size (void)
+{
+  g_autofree FbdHapticStep *steps = g_new0 (FbdHapticStep, FBD_HAPTIC_PATTERN_MAX_FD_STEPS + 1);
+  int seals = F_SEAL_WRITE | F_SEAL_SHRINK;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GError) err = NULL;
+
+  /* Only complete steps */
+  bytes = map_pattern (steps, sizeof (FbdHapticStep) + 4, seals, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_null (bytes);
+  g_clear_error (&err);
+
+  bytes = map_pattern (steps, (FBD_HAPTIC_PATTERN_MAX_FD_STEPS + 1) * sizeof (FbdHapticStep),
+                       seals, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_null (bytes);
+  g_clear_error (&err);
+
+  bytes = map_pattern (steps, FBD_HAPTIC_PATTERN_MAX_FD_STEPS * sizeof (FbdHapticStep),
+                       seals, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (bytes);
+}
+
+
+static void
+test_fbd_haptic_pattern_limits (void)
+{
+  g_autoptr (FbdHapticPatternCache) cache = fbd_haptic_pattern_cache_new ();
+  FbdHapticStep steps[] = {
+    { NAN, 10 },
+    { -0.5, 20 },
+    { 1.5, G_MAXUINT32 },
+    { 0.25, 30 },
+  };
+  g_autoptr (GBytes) bytes = g_bytes_new (steps, sizeof (steps));
+  g_autoptr (GBytes) empty = g_bytes_new (NULL, 0);
+  const FbdHapticPattern *pattern;
+
+  pattern = fbd_haptic_pattern_cache_lookup (cache, bytes);
+  g_assert_nonnull (pattern);
+  g_assert_cmpuint (pattern->magnitudes->len, ==, G_N_ELEMENTS (steps));
+  g_assert_cmpuint (pattern->durations->len, ==, G_N_ELEMENTS (steps));
+
+  g_assert_cmpfloat (g_array_index (pattern->magnitudes, double, 0), ==, 0.0);
+  g_assert_cmpfloat (g_array_index (pattern->magnitudes, double, 1), ==, 0.0);
+  g_assert_cmpfloat (g_array_index (pattern->magnitudes, double, 2), ==, 1.0);
+  g_assert_cmpfloat (g_array_index (pattern->magnitudes, double, 3), ==, 0.25);
+
+  g_assert_cmpuint (g_array_index (pattern->durations, guint, 0), ==, 10);
+  g_assert_cmpuint (g_array_index (pattern->durations, guint, 2), ==,
+                    FBD_HAPTIC_PATTERN_MAX_DURATION);
+
+  /* Empty patterns end the running one */
+  g_assert_null (fbd_haptic_pattern_cache_lookup (cache, empty));
+}
+
+
+static void
+test_fbd_haptic_pattern_cache (void)
+{
+  g_autoptr (FbdHapticPatternCache) cache = fbd_haptic_pattern_cache_new ();
+  FbdHapticStep steps[] = { { 1.0, 10 }, { 0.5, 20 } };
+  FbdHapticStep other_steps[] = { { 0.5, 10 } };
+  g_autoptr (GBytes) bytes = NULL, again = NULL, other = NULL;
+  const FbdHapticPattern *pattern;
+  g_autoptr (GError) err = NULL;
+  int seals = F_SEAL_WRITE | F_SEAL_SHRINK;
+
+  bytes = map_pattern (steps, sizeof (steps), seals, &err);
+  g_assert_no_error (err);
+  pattern = fbd_haptic_pattern_cache_lookup (cache, bytes);
+  g_assert_nonnull (pattern);
+
+  /* The same contents in another memfd hit the cache */
+  again = map_pattern (steps, sizeof (steps), seals, &err);
+  g_assert_no_error (err);
+  g_assert_true (fbd_haptic_pattern_cache_lookup (cache, again) == pattern);
+
+  other = map_pattern (other_steps, sizeof (other_steps), seals, &err);
+  g_assert_no_error (err);
+  g_assert_true (fbd_haptic_pattern_cache_lookup (cache, other) != pattern);
+
+  /* The cached pattern doesn't need the client's mapping */
+  g_clear_pointer (&bytes, g_bytes_unref);
+  g_clear_pointer (&again, g_bytes_unref);
+  bytes = g_bytes_new (steps, sizeof (steps));
+  pattern = fbd_haptic_pattern_cache_lookup (cache, bytes);
+  g_assert_cmpfloat (g_array_index (pattern->magnitudes, double, 1), ==, 0.5);
+  g_assert_cmpuint (g_array_index (pattern->durations, guint, 1), ==, 20);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/haptic-pattern/seals", test_fbd_haptic_pattern_seals);
+  g_test_add_func ("/feedbackd/fbd/haptic-pattern/size", test_fbd_haptic_pattern_size);
+  g_test_add_func ("/feedbackd/fbd/haptic-pattern/limits", test_fbd_haptic_pattern_limits);
+  g_test_add_func ("/feedbackd/fbd/haptic-pattern/cache", test_fbd_haptic_pattern_cache);
+
+  return g_test_run ();
+}
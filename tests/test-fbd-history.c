@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-history.h"
+
+#include <string.h>
+
+
+static void
+test_fbd_history_add (void)
+{
+  g_autoptr (FbdHistory) history = fbd_history_new ();
+  const FbdHistoryEntry *entry;
+
+  g_assert_cmpuint (fbd_history_get_n_entries (history), ==, 0);
+
+  fbd_history_add (history, 1, "org.example.App", "message-new-instant",
+                   FBD_FEEDBACK_PROFILE_LEVEL_QUIET,
+                   FBD_EVENT_CAPABILITY_HAPTIC | FBD_EVENT_CAPABILITY_LED);
+  fbd_history_add (history, 2, "org.example.App", "button-pressed",
+                   FBD_FEEDBACK_PROFILE_LEVEL_FULL, FBD_EVENT_CAPABILITY_SOUND);
+  g_assert_cmpuint (fbd_history_get_n_entries (history), ==, 2);
+
+  /* Newest first */
+  entry = fbd_history_get_entry (history, 0);
+  g_assert_cmpuint (entry->id, ==, 2);
+  g_assert_cmpstr (entry->event, ==, "button-pressed");
+  g_assert_false (entry->ended);
+
+  fbd_history_end (history, 1, FBD_EVENT_END_REASON_EXPLICIT);
+  entry = fbd_history_get_entry (history, 1);
+  g_assert_cmpuint (entry->id, ==, 1);
+  g_assert_cmpstr (entry->app_id, ==, "org.example.App");
+  g_assert_cmpint (entry->level, ==, FBD_FEEDBACK_PROFILE_LEVEL_QUIET);
+  g_assert_true (entry->ended);
+  g_assert_cmpint (entry->reason, ==, FBD_EVENT_END_REASON_EXPLICIT);
+  g_assert_cmpint (entry->duration, >=, 0);
+
+  /* Unknown events are ignored */
+  fbd_history_end (history, 3, FBD_EVENT_END_REASON_NATURAL);
+}
+
+
+static void
+test_fbd_history_wrap (void)
+{
+  g_autoptr (FbdHistory) history = fbd_history_new ();
+  g_autofree char *long_name = g_strnfill (FBD_HISTORY_NAME_LEN * 2, 'a');
+  const FbdHistoryEntry *entry;
+
+  for (guint i = 1; i <= FBD_HISTORY_SIZE + 10; i++) {
+    fbd_history_add (history, i, long_name, "button-pressed", FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                     FBD_EVENT_CAPABILITY_NONE);
+  }
+
+  /* The oldest events got overwritten */
+  g_assert_cmpuint (fbd_history_get_n_entries (history), ==, FBD_HISTORY_SIZE);
+  g_assert_cmpuint (fbd_history_get_entry (history, 0)->id, ==, FBD_HISTORY_SIZE + 10);
+  entry = fbd_history_get_entry (history, FBD_HISTORY_SIZE - 1);
+  g_assert_cmpuint (entry->id, ==, 11);
+  g_assert_cmpuint (strlen (entry->app_id), ==, FBD_HISTORY_NAME_LEN - 1);
+
+  /* Events that dropped out can't be ended */
+  fbd_history_end (history, 5, FBD_EVENT_END_REASON_NATURAL);
+  for (guint i = 0; i < FBD_HISTORY_SIZE; i++)
+    g_assert_false (fbd_history_get_entry (history, i)->ended);
+}
+
+
+static void
+test_fbd_history_truncate_utf8 (void)
+{
+  g_autoptr (FbdHistory) history = fbd_history_new ();
+  g_autoptr (GString) name = g_string_new (NULL);
+  const FbdHistoryEntry *entry;
+
+  /* Puts a two byte character across the truncation point */
+  g_string_append_len (name, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+                       FBD_HISTORY_NAME_LEN - 2);
+  g_string_append (name, "ää");
+
+  fbd_history_add (history, 1, "org.example.App", name->str, FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                   FBD_EVENT_CAPABILITY_NONE);
+  entry = fbd_history_get_entry (history, 0);
+  g_assert_true (g_utf8_validate (entry->event, -1, NULL));
+  g_assert_cmpuint (strlen (entry->event), ==, FBD_HISTORY_NAME_LEN - 2);
+}
+
+
+static void
+test_fbd_history_variant (void)
+{
+  g_autoptr (FbdHistory) history = fbd_history_new ();
+  g_autoptr (GVariant) events = NULL;
+  g_autoptr (GVariant) event = NULL;
+  g_autofree const char **feedbacks = NULL;
+  const char *app_id, *name, *level, *reason;
+  gint64 time, duration;
+  guint id;
+
+  fbd_history_add (history, 0, "org.example.App", "does-not-exist",
+                   FBD_FEEDBACK_PROFILE_LEVEL_FULL, FBD_EVENT_CAPABILITY_NONE);
+  fbd_history_end (history, 0, FBD_EVENT_END_REASON_NOT_FOUND);
+  fbd_history_add (history, 7, "org.example.App", "alarm-clock-elapsed",
+                   FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                   FBD_EVENT_CAPABILITY_SOUND | FBD_EVENT_CAPABILITY_HAPTIC);
+
+  events = g_variant_ref_sink (fbd_history_to_variant (history));
+  g_assert_cmpuint (g_variant_n_children (events), ==, 2);
+
+  /* Oldest first */
+  event = g_variant_get_child_value (events, 0);
+  g_variant_get (event, "(u&s&s&s^a&s&sxx)", &id, &app_id, &name, &level, &feedbacks,
+                 &reason, &time, &duration);
+  g_assert_cmpuint (id, ==, 0);
+  g_assert_cmpstr (reason, ==, "not-found");
+  g_assert_cmpuint (g_strv_length ((GStrv)feedbacks), ==, 0);
+  g_clear_pointer (&feedbacks, g_free);
+  g_clear_pointer (&event, g_variant_unref);
+
+  event = g_variant_get_child_value (events, 1);
+  g_variant_get (event, "(u&s&s&s^a&s&sxx)", &id, &app_id, &name, &level, &feedbacks,
+                 &reason, &time, &duration);
+  g_assert_cmpuint (id, ==, 7);
+  g_assert_cmpstr (app_id, ==, "org.example.App");
+  g_assert_cmpstr (name, ==, "alarm-clock-elapsed");
+  g_assert_cmpstr (level, ==, "full");
+  g_assert_cmpuint (g_strv_length ((GStrv)feedbacks), ==, 2);
+  g_assert_cmpstr (feedbacks[0], ==, "sound");
+  g_assert_cmpstr (feedbacks[1], ==, "haptic");
+  /* Still running */
+  g_assert_cmpstr (reason, ==, "");
+  g_assert_cmpint (time, >, 0);
+  g_assert_cmpint (duration, ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/history/add", test_fbd_history_add);
+  g_test_add_func ("/feedbackd/fbd/history/wrap", test_fbd_history_wrap);
+  g_test_add_func ("/feedbackd/fbd/history/truncate-utf8", test_fbd_history_truncate_utf8);
+  g_test_add_func ("/feedbackd/fbd/history/variant", test_fbd_history_variant);
+
+  return g_test_run ();
+}
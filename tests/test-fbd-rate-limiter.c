@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-rate-limiter.h"
+
+#define TEST_SENDER ":1.42"
+#define TEST_OTHER_SENDER ":1.43"
+
+
+static void
+test_fbd_rate_limiter_burst (void)
+{
+  g_autoptr (FbdRateLimiter) limiter = fbd_rate_limiter_new (NULL);
+  gint64 now = 1000 * G_USEC_PER_SEC;
+
+  /* No limits by default */
+  for (guint i = 0; i < 100; i++)
+    g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 0);
+
+  fbd_rate_limiter_set_limits (limiter, 5, 1);
+
+  /* A full bucket takes a burst of requests at once */
+  for (guint i = 0; i < 5; i++)
+    g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* No partial admission of several requests */
+  fbd_rate_limiter_forget (limiter, TEST_SENDER);
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 6, now));
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 5, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* Peer to peer connections without a sender aren't limited */
+  g_assert_true (fbd_rate_limiter_admit (limiter, NULL, 100, now));
+}
+
+
+static void
+test_fbd_rate_limiter_refill (void)
+{
+  g_autoptr (FbdRateLimiter) limiter = fbd_rate_limiter_new (NULL);
+  gint64 now = 1000 * G_USEC_PER_SEC;
+
+  fbd_rate_limiter_set_limits (limiter, 4, 2);
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 4, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* Two tokens per second, after 250ms there's only half a token */
+  now += G_USEC_PER_SEC / 4;
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  now += G_USEC_PER_SEC / 4;
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* The bucket doesn't grow beyond its burst size */
+  now += 60 * G_USEC_PER_SEC;
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 5, now));
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 4, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+}
+
+
+static void
+test_fbd_rate_limiter_senders (void)
+{
+  g_autoptr (FbdRateLimiter) limiter = fbd_rate_limiter_new (NULL);
+  gint64 now = 1000 * G_USEC_PER_SEC;
+
+  fbd_rate_limiter_set_limits (limiter, 2, 1);
+
+  /* Each sender has its own bucket */
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 2, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_OTHER_SENDER, 2, now));
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 2);
+
+  /* Forgetting a sender gives it a full bucket again */
+  fbd_rate_limiter_forget (limiter, TEST_SENDER);
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 1);
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 2, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_OTHER_SENDER, 1, now));
+}
+
+
+static void
+test_fbd_rate_limiter_prune (void)
+{
+  g_autoptr (FbdRateLimiter) limiter = fbd_rate_limiter_new (NULL);
+  gint64 now = 1000 * G_USEC_PER_SEC;
+
+  fbd_rate_limiter_set_limits (limiter, 2, 1);
+
+  for (guint i = 0; i < 64; i++) {
+    g_autofree char *sender = g_strdup_printf (":1.%u", i);
+
+    g_assert_true (fbd_rate_limiter_admit (limiter, sender, 1, now));
+  }
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 64);
+
+  /* Once all buckets are full again they're dropped on the next new sender */
+  now += G_USEC_PER_SEC;
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 1);
+}
+
+
+static void
+test_fbd_rate_limiter_settings (void)
+{
+  g_autoptr (GSettings) settings = g_settings_new (FEEDBACKD_SCHEMA_ID);
+  g_autoptr (FbdRateLimiter) limiter = NULL;
+  gint64 now = 1000 * G_USEC_PER_SEC;
+
+  g_settings_set_uint (settings, "rate-limit-burst", 3);
+  g_settings_set_uint (settings, "rate-limit-rate", 1);
+  limiter = fbd_rate_limiter_new (settings);
+
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 3, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* New limits apply right away and refill all buckets */
+  g_settings_set_uint (settings, "rate-limit-burst", 10);
+  g_assert_cmpuint (fbd_rate_limiter_get_n_senders (limiter), ==, 0);
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 10, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  g_settings_set_uint (settings, "rate-limit-rate", 10);
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 10, now));
+  now += G_USEC_PER_SEC / 2;
+  g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 5, now));
+  g_assert_false (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  /* A burst of 0 disables rate limiting */
+  g_settings_set_uint (settings, "rate-limit-burst", 0);
+  for (guint i = 0; i < 100; i++)
+    g_assert_true (fbd_rate_limiter_admit (limiter, TEST_SENDER, 1, now));
+
+  g_settings_reset (settings, "rate-limit-burst");
+  g_settings_reset (settings, "rate-limit-rate");
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/rate-limiter/burst", test_fbd_rate_limiter_burst);
+  g_test_add_func ("/feedbackd/fbd/rate-limiter/refill", test_fbd_rate_limiter_refill);
+  g_test_add_func ("/feedbackd/fbd/rate-limiter/senders", test_fbd_rate_limiter_senders);
+  g_test_add_func ("/feedbackd/fbd/rate-limiter/prune", test_fbd_rate_limiter_prune);
+  g_test_add_func ("/feedbackd/fbd/rate-limiter/settings", test_fbd_rate_limiter_settings);
+
+  return g_test_run ();
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-recorder.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+/* FBD_RECORD_TYPE with borrowed strings */
+#define RECORD_FORMAT "(yx&s&s&s@a{sv}iuu)"
+
+/* Parses a trace the way fbd-replay does */
+static GPtrArray *
+read_records (const char *path)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *contents = NULL;
+  GPtrArray *records = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+  gsize len, pos;
+  guint32 version;
+
+  g_file_get_contents (path, &contents, &len, &err);
+  g_assert_no_error (err);
+
+  g_assert_cmpuint (len, >=, FBD_RECORD_MAGIC_LEN + sizeof (guint32));
+  g_assert_cmpmem (contents, FBD_RECORD_MAGIC_LEN, FBD_RECORD_MAGIC, FBD_RECORD_MAGIC_LEN);
+  memcpy (&version, contents + FBD_RECORD_MAGIC_LEN, sizeof (version));
+  g_assert_cmpuint (GUINT32_FROM_LE (version), ==, FBD_RECORD_VERSION);
+
+  pos = FBD_RECORD_MAGIC_LEN + sizeof (version);
+  while (pos < len) {
+    g_autoptr (GBytes) bytes = NULL;
+    GVariant *record;
+    guint32 size;
+
+    g_assert_cmpuint (pos + sizeof (size), <=, len);
+    memcpy (&size, contents + pos, sizeof (size));
+    size = GUINT32_FROM_LE (size);
+    pos += sizeof (size);
+    g_assert_cmpuint (size, <=, FBD_RECORD_MAX_SIZE);
+    g_assert_cmpuint (pos + size, <=, len);
+
+    bytes = g_bytes_new (contents + pos, size);
+    record = g_variant_new_from_bytes (G_VARIANT_TYPE (FBD_RECORD_TYPE), bytes, FALSE);
+    if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+      GVariant *swapped = g_variant_byteswap (record);
+
+      g_variant_unref (record);
+      record = swapped;
+    }
+    g_ptr_array_add (records, g_variant_ref_sink (record));
+    pos += size;
+  }
+
+  return records;
+}
+
+
+static void
+test_fbd_recorder_roundtrip (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *tmp_dir = NULL;
+  g_autofree char *path = NULL;
+  g_autoptr (GPtrArray) records = NULL;
+  g_autoptr (GVariant) hints = NULL;
+  g_autoptr (GVariant) expected = NULL;
+  FbdRecorder *recorder;
+  const char *sender, *app_id, *name;
+  gint64 timestamp, last = 0;
+  guchar kind;
+  int timeout;
+  guint event_id, result;
+
+  tmp_dir = g_dir_make_tmp ("fbd-recorder-XXXXXX", &err);
+  g_assert_no_error (err);
+  path = g_build_filename (tmp_dir, "trace", NULL);
+
+  recorder = fbd_recorder_new (path, &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_RECORDER (recorder));
+
+  expected = g_variant_ref_sink (g_variant_new_parsed ("{'profile': <'quiet'>}"));
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, ":1.42", "org.example.App",
+                    "message-new-instant", expected, -1, 1, FBD_RECORD_RESULT_OK);
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_END, ":1.42", NULL, NULL, NULL, 0, 1, 0);
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_PROFILE, NULL, NULL, "silent", NULL, 0, 0, 0);
+  /* Writing the trace doesn't lose buffered records */
+  g_assert_true (fbd_recorder_flush (recorder, &err));
+  g_assert_no_error (err);
+  fbd_recorder_add (recorder, FBD_RECORD_KIND_TRIGGER, ":1.43", "org.example.Other",
+                    "button-pressed", NULL, 0, 2, FBD_RECORD_RESULT_RATE_LIMITED);
+  /* Finalizing writes out the rest */
+  g_assert_finalize_object (recorder);
+
+  records = read_records (path);
+  g_assert_cmpuint (records->len, ==, 4);
+
+  g_variant_get (g_ptr_array_index (records, 0), RECORD_FORMAT,
+                 &kind, &timestamp, &sender, &app_id, &name, &hints, &timeout, &event_id, &result);
+  g_assert_cmpint (kind, ==, FBD_RECORD_KIND_TRIGGER);
+  g_assert_cmpint (timestamp, >=, 0);
+  g_assert_cmpstr (sender, ==, ":1.42");
+  g_assert_cmpstr (app_id, ==, "org.example.App");
+  g_assert_cmpstr (name, ==, "message-new-instant");
+  g_assert_true (g_variant_equal (hints, expected));
+  g_assert_cmpint (timeout, ==, -1);
+  g_assert_cmpuint (event_id, ==, 1);
+  g_assert_cmpuint (result, ==, FBD_RECORD_RESULT_OK);
+  g_clear_pointer (&hints, g_variant_unref);
+  last = timestamp;
+
+  /* Missing strings and hints are recorded empty */
+  g_variant_get (g_ptr_array_index (records, 1), RECORD_FORMAT,
+                 &kind, &timestamp, &sender, &app_id, &name, &hints, &timeout, &event_id, &result);
+  g_assert_cmpint (kind, ==, FBD_RECORD_KIND_END);
+  g_assert_cmpint (timestamp, >=, last);
+  g_assert_cmpstr (app_id, ==, "");
+  g_assert_cmpstr (name, ==, "");
+  g_assert_cmpuint (g_variant_n_children (hints), ==, 0);
+  g_assert_cmpuint (event_id, ==, 1);
+  g_clear_pointer (&hints, g_variant_unref);
+  last = timestamp;
+
+  g_variant_get (g_ptr_array_index (records, 2), RECORD_FORMAT,
+                 &kind, &timestamp, &sender, &app_id, &name, &hints, &timeout, &event_id, &result);
+  g_assert_cmpint (kind, ==, FBD_RECORD_KIND_PROFILE);
+  g_assert_cmpint (timestamp, >=, last);
+  g_assert_cmpstr (sender, ==, "");
+  g_assert_cmpstr (name, ==, "silent");
+  g_clear_pointer (&hints, g_variant_unref);
+  last = timestamp;
+
+  g_variant_get (g_ptr_array_index (records, 3), RECORD_FORMAT,
+                 &kind, &timestamp, &sender, &app_id, &name, &hints, &timeout, &event_id, &result);
+  g_assert_cmpint (kind, ==, FBD_RECORD_KIND_TRIGGER);
+  g_assert_cmpint (timestamp, >=, last);
+  g_assert_cmpstr (sender, ==, ":1.43");
+  g_assert_cmpstr (name, ==, "button-pressed");
+  g_assert_cmpuint (event_id, ==, 2);
+  g_assert_cmpuint (result, ==, FBD_RECORD_RESULT_RATE_LIMITED);
+  g_clear_pointer (&hints, g_variant_unref);
+
+  g_assert_cmpint (g_unlink (path), ==, 0);
+  g_assert_cmpint (g_rmdir (tmp_dir), ==, 0);
+}
+
+
+static void
+test_fbd_recorder_error (void)
+{
+  g_autoptr (GError) err = NULL;
+  FbdRecorder *recorder;
+
+  recorder = fbd_recorder_new ("/does/not/exist/trace", &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_null (recorder);
+
+  /* Callers don't need to check whether the daemon records */
+  fbd_recorder_add (NULL, FBD_RECORD_KIND_TRIGGER, ":1.42", "org.example.App",
+                    "button-pressed", NULL, 0, 1, FBD_RECORD_RESULT_OK);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/recorder/roundtrip", test_fbd_recorder_roundtrip);
+  g_test_add_func ("/feedbackd/fbd/recorder/error", test_fbd_recorder_error);
+
+  return g_test_run ();
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-slider-filter.h"
+
+#define TEST_SETTLE_TIME 20
+
+typedef struct {
+  guint n_settled;
+  int   position;
+} TestSettled;
+
+
+static void
+on_settled (int position, gpointer user_data)
+{
+  TestSettled *settled = user_data;
+
+  settled->position = position;
+  settled->n_settled++;
+}
+
+
+static void
+on_timeout (gpointer user_data)
+{
+  gboolean *done = user_data;
+
+  *done = TRUE;
+}
+
+/* Runs the main loop for longer than the settle time */
+static void
+wait_settled (void)
+{
+  gboolean done = FALSE;
+
+  g_timeout_add_once (TEST_SETTLE_TIME * 3, on_timeout, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+
+static void
+feed_frame (FbdSliderFilter *filter, int value)
+{
+  fbd_slider_filter_set_value (filter, value);
+  fbd_slider_filter_commit (filter);
+}
+
+
+static void
+test_fbd_slider_filter_settle (void)
+{
+  TestSettled settled = { 0 };
+  g_autoptr (FbdSliderFilter) filter = fbd_slider_filter_new (2, TEST_SETTLE_TIME,
+                                                              on_settled, &settled);
+
+  /* Only the final position of a bouncing slider is used */
+  feed_frame (filter, 1);
+  feed_frame (filter, 0);
+  feed_frame (filter, 1);
+  g_assert_cmpuint (settled.n_settled, ==, 0);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 1);
+  g_assert_cmpint (settled.position, ==, 1);
+  g_assert_cmpint (fbd_slider_filter_get_position (filter), ==, 1);
+
+  /* Only the last value of a frame counts */
+  fbd_slider_filter_set_value (filter, 2);
+  fbd_slider_filter_set_value (filter, 0);
+  fbd_slider_filter_commit (filter);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 2);
+  g_assert_cmpint (settled.position, ==, 0);
+}
+
+
+static void
+test_fbd_slider_filter_unchanged (void)
+{
+  TestSettled settled = { 0 };
+  g_autoptr (FbdSliderFilter) filter = fbd_slider_filter_new (2, TEST_SETTLE_TIME,
+                                                              on_settled, &settled);
+
+  /* Bouncing back to where the slider was isn't a change */
+  feed_frame (filter, 1);
+  feed_frame (filter, 2);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 0);
+
+  /* Frames without a value don't restart the settle time */
+  fbd_slider_filter_commit (filter);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 0);
+
+  /* Values only count once their frame is complete */
+  fbd_slider_filter_set_value (filter, 0);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 0);
+  fbd_slider_filter_commit (filter);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 1);
+  g_assert_cmpint (settled.position, ==, 0);
+}
+
+
+static void
+test_fbd_slider_filter_free (void)
+{
+  TestSettled settled = { 0 };
+  FbdSliderFilter *filter = fbd_slider_filter_new (2, TEST_SETTLE_TIME, on_settled, &settled);
+
+  /* A pending position isn't reported after the filter is gone */
+  feed_frame (filter, 0);
+  fbd_slider_filter_free (filter);
+  wait_settled ();
+  g_assert_cmpuint (settled.n_settled, ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/slider-filter/settle", test_fbd_slider_filter_settle);
+  g_test_add_func ("/feedbackd/fbd/slider-filter/unchanged", test_fbd_slider_filter_unchanged);
+  g_test_add_func ("/feedbackd/fbd/slider-filter/free", test_fbd_slider_filter_free);
+
+  return g_test_run ();
+}
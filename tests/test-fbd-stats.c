@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-event.h"
+#include "fbd-feedback-dummy.h"
+#include "fbd-stats.h"
+
+
+static guint64
+lookup_counter (GVariant *counters, const char *name)
+{
+  guint64 value = G_MAXUINT64;
+
+  g_assert_true (g_variant_lookup (counters, name, "t", &value));
+  return value;
+}
+
+
+static void
+test_fbd_stats_counters (void)
+{
+  g_autoptr (FbdStats) stats = g_object_new (FBD_TYPE_STATS, NULL);
+  g_autoptr (GVariant) counters = NULL;
+
+  fbd_stats_count (stats, FBD_STATS_COUNTER_EVENTS_TRIGGERED);
+  fbd_stats_count (stats, FBD_STATS_COUNTER_EVENTS_TRIGGERED);
+  fbd_stats_count (stats, FBD_STATS_COUNTER_FEEDBACKS_BUSY);
+  fbd_stats_set_active_events (stats, 3);
+  fbd_stats_set_active_events (stats, 1);
+
+  g_assert_cmpuint (fbd_stats_get_count (stats, FBD_STATS_COUNTER_EVENTS_TRIGGERED), ==, 2);
+
+  counters = g_variant_ref_sink (fbd_stats_get_counters (stats));
+  g_assert_cmpuint (lookup_counter (counters, "events-triggered"), ==, 2);
+  g_assert_cmpuint (lookup_counter (counters, "events-not-found"), ==, 0);
+  g_assert_cmpuint (lookup_counter (counters, "feedbacks-busy"), ==, 1);
+  g_assert_cmpuint (lookup_counter (counters, "active-events"), ==, 1);
+  g_assert_cmpuint (lookup_counter (counters, "active-events-peak"), ==, 3);
+  g_clear_pointer (&counters, g_variant_unref);
+
+  /* The active events stay and become the new peak */
+  fbd_stats_reset (stats);
+  counters = g_variant_ref_sink (fbd_stats_get_counters (stats));
+  g_assert_cmpuint (lookup_counter (counters, "events-triggered"), ==, 0);
+  g_assert_cmpuint (lookup_counter (counters, "active-events"), ==, 1);
+  g_assert_cmpuint (lookup_counter (counters, "active-events-peak"), ==, 1);
+}
+
+
+static void
+test_fbd_stats_histograms (void)
+{
+  g_autoptr (FbdStats) stats = g_object_new (FBD_TYPE_STATS, NULL);
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GVariant) buckets = NULL;
+  const guint64 *values;
+  guint64 count, sum, max;
+  gsize n_buckets;
+
+  fbd_stats_add_duration (stats, FBD_STATS_DURATION_EVIOCSFF, 0);
+  fbd_stats_add_duration (stats, FBD_STATS_DURATION_EVIOCSFF, 1);
+  fbd_stats_add_duration (stats, FBD_STATS_DURATION_EVIOCSFF, 3);
+  fbd_stats_add_duration (stats, FBD_STATS_DURATION_EVIOCSFF, 1000);
+  fbd_stats_add_duration (stats, FBD_STATS_DURATION_EVIOCSFF, (gint64)G_USEC_PER_SEC * 3600);
+  fbd_stats_add_latency (stats, FBD_TYPE_FEEDBACK_DUMMY, 100);
+
+  histograms = g_variant_ref_sink (fbd_stats_get_histograms (stats));
+  g_assert_true (g_variant_lookup (histograms, "eviocsff", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 5);
+  g_assert_cmpuint (sum, ==, 1004 + (gint64)G_USEC_PER_SEC * 3600);
+  g_assert_cmpuint (max, ==, (gint64)G_USEC_PER_SEC * 3600);
+
+  values = g_variant_get_fixed_array (buckets, &n_buckets, sizeof (guint64));
+  g_assert_cmpuint (n_buckets, ==, FBD_STATS_N_BUCKETS);
+  g_assert_cmpuint (values[0], ==, 1);
+  g_assert_cmpuint (values[1], ==, 1);
+  g_assert_cmpuint (values[2], ==, 1);
+  /* 512µs <= 1000µs < 1024µs */
+  g_assert_cmpuint (values[10], ==, 1);
+  g_assert_cmpuint (values[FBD_STATS_N_BUCKETS - 1], ==, 1);
+  g_clear_pointer (&buckets, g_variant_unref);
+
+  g_assert_true (g_variant_lookup (histograms, "sysfs-write", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 0);
+  g_clear_pointer (&buckets, g_variant_unref);
+
+  g_assert_true (g_variant_lookup (histograms, "latency-Dummy", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 1);
+  g_assert_cmpuint (max, ==, 100);
+  g_clear_pointer (&buckets, g_variant_unref);
+  g_clear_pointer (&histograms, g_variant_unref);
+
+  fbd_stats_reset (stats);
+  histograms = g_variant_ref_sink (fbd_stats_get_histograms (stats));
+  g_assert_false (g_variant_lookup (histograms, "latency-Dummy", "(ttt@at)",
+                                    &count, &sum, &max, &buckets));
+  g_assert_true (g_variant_lookup (histograms, "eviocsff", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 0);
+}
+
+
+static void
+test_fbd_stats_playback (void)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  g_autoptr (FbdFeedbackDummy) dummy = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
+  g_autoptr (FbdFeedbackPlayback) playback = NULL;
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GVariant) buckets = NULL;
+  guint64 count, sum, max;
+
+  fbd_stats_reset (stats);
+
+  playback = fbd_feedback_playback_new (FBD_FEEDBACK_BASE (dummy), 0);
+  /* Without a duration the dummy is done right away */
+  fbd_feedback_playback_run (playback);
+  g_assert_true (fbd_feedback_playback_get_ended (playback));
+  /* Looping doesn't count as another trigger */
+  fbd_feedback_playback_run (playback);
+
+  histograms = g_variant_ref_sink (fbd_stats_get_histograms (stats));
+  g_assert_true (g_variant_lookup (histograms, "latency-Dummy", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 1);
+}
+
+
+static void
+test_fbd_stats_start_skew (void)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  g_autoptr (FbdFeedbackDummy) dummy = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
+  g_autoptr (GPtrArray) playbacks = NULL;
+  g_autoptr (GVariant) histograms = NULL;
+  g_autoptr (GVariant) buckets = NULL;
+  guint64 count, sum, max;
+
+  fbd_stats_reset (stats);
+  playbacks = g_ptr_array_new_with_free_func ((GDestroyNotify)fbd_feedback_playback_unref);
+
+  /* A single feedback has nothing to be skewed against */
+  g_ptr_array_add (playbacks, fbd_feedback_playback_new (FBD_FEEDBACK_BASE (dummy), 0));
+  fbd_feedback_playbacks_run (playbacks);
+
+  g_ptr_array_add (playbacks, fbd_feedback_playback_new (FBD_FEEDBACK_BASE (dummy), 0));
+  fbd_feedback_playbacks_run (playbacks);
+  for (guint i = 0; i < playbacks->len; i++)
+    g_assert_true (fbd_feedback_playback_get_ended (g_ptr_array_index (playbacks, i)));
+
+  histograms = g_variant_ref_sink (fbd_stats_get_histograms (stats));
+  g_assert_true (g_variant_lookup (histograms, "start-skew", "(ttt@at)",
+                                   &count, &sum, &max, &buckets));
+  g_assert_cmpuint (count, ==, 1);
+}
+
+
+static void
+test_fbd_stats_objects (void)
+{
+  FbdStats *stats = fbd_stats_get_default ();
+  g_autoptr (FbdFeedbackDummy) dummy = g_object_new (FBD_TYPE_FEEDBACK_DUMMY, NULL);
+  g_autoptr (GVariant) counters = NULL;
+  guint64 events, playbacks;
+  FbdEvent *event;
+
+  events = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT);
+  playbacks = fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK);
+
+  event = fbd_event_new (1, "org.example.App", "test-dummy", FBD_EVENT_TIMEOUT_ONESHOT, ":1.1");
+  fbd_event_add_feedback (event, FBD_FEEDBACK_BASE (dummy), 0);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT), ==, events + 1);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK), ==,
+                    playbacks + 1);
+
+  /* Live objects survive resets */
+  fbd_stats_reset (stats);
+  counters = g_variant_ref_sink (fbd_stats_get_counters (stats));
+  g_assert_cmpuint (lookup_counter (counters, "live-events"), ==, events + 1);
+  g_assert_cmpuint (lookup_counter (counters, "live-events-bytes"), >, 0);
+  g_assert_cmpuint (lookup_counter (counters, "live-client-watches"), ==, 0);
+
+  g_assert_finalize_object (event);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_EVENT), ==, events);
+  g_assert_cmpuint (fbd_stats_get_n_objects (stats, FBD_STATS_OBJECT_PLAYBACK), ==, playbacks);
+}
+
+
+static void
+test_fbd_stats_deadline (void)
+{
+  g_autoptr (FbdStats) stats = g_object_new (FBD_TYPE_STATS, NULL);
+  gint64 estimate;
+
+  /* Without samples everything is expected to be on time */
+  g_assert_cmpint (fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY), ==, -1);
+  g_assert_true (fbd_stats_check_deadline (stats, FBD_TYPE_FEEDBACK_DUMMY, 1000));
+
+  fbd_stats_add_latency (stats, FBD_TYPE_FEEDBACK_DUMMY, 8000);
+  g_assert_cmpint (fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY), ==, 8000);
+  /* A single fast sample only moves the estimate a bit */
+  fbd_stats_add_latency (stats, FBD_TYPE_FEEDBACK_DUMMY, 0);
+  g_assert_cmpint (fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY), ==, 7000);
+
+  g_assert_true (fbd_stats_check_deadline (stats, FBD_TYPE_FEEDBACK_DUMMY, 7000));
+  g_assert_false (fbd_stats_check_deadline (stats, FBD_TYPE_FEEDBACK_DUMMY, 5000));
+
+  /* Skipped feedbacks lower the estimate so they get probed again */
+  estimate = fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY);
+  g_assert_cmpint (estimate, <, 7000);
+  while (!fbd_stats_check_deadline (stats, FBD_TYPE_FEEDBACK_DUMMY, 5000))
+    g_assert_cmpint (fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY), <, estimate);
+
+  /* Estimates survive a reset */
+  fbd_stats_reset (stats);
+  g_assert_cmpint (fbd_stats_get_latency_estimate (stats, FBD_TYPE_FEEDBACK_DUMMY), <=, 5000);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/stats/counters", test_fbd_stats_counters);
+  g_test_add_func ("/feedbackd/fbd/stats/histograms", test_fbd_stats_histograms);
+  g_test_add_func ("/feedbackd/fbd/stats/playback", test_fbd_stats_playback);
+  g_test_add_func ("/feedbackd/fbd/stats/start-skew", test_fbd_stats_start_skew);
+  g_test_add_func ("/feedbackd/fbd/stats/deadline", test_fbd_stats_deadline);
+  g_test_add_func ("/feedbackd/fbd/stats/objects", test_fbd_stats_objects);
+
+  return g_test_run ();
+}
@@ -7,6 +7,7 @@
 #include "fbd-feedback-dummy.h"
 #include "fbd-theme-expander.h"
 
+#include <glib/gstdio.h>
 #include <json-glib/json-glib.h>
 
 
@@ -119,14 +120,303 @@ test_fbd_theme_expander_custom (void)
   g_assert_finalize_object (expander);
 }
 
+
+static void
+test_fbd_theme_expander_cache (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *cache_dir = NULL;
+  g_autoptr (GDir) dir = NULL;
+  g_autofree char *cache_file = NULL;
+  const char *compatibles[] = { "replace", NULL };
+  const char *name;
+  FbdFeedbackProfile *profile;
+  FbdThemeExpander *expander;
+  FbdFeedbackTheme *theme;
+  FbdFeedbackBase *fb;
+
+  cache_dir = g_dir_make_tmp ("fbd-theme-cache-XXXXXX", &err);
+  g_assert_no_error (err);
+
+  for (int i = 0; i < 2; i++) {
+    /* First run writes the cache, second one uses it */
+    expander = fbd_theme_expander_new (compatibles, "custom", NULL);
+    fbd_theme_expander_set_cache_dir (expander, cache_dir);
+    theme = fbd_theme_expander_load_theme_files (expander, &err);
+    g_assert_no_error (err);
+    g_assert_cmpstr (fbd_feedback_theme_get_name (theme), ==, "custom");
+
+    profile = fbd_feedback_theme_get_profile (theme, "full");
+    g_assert_true (FBD_IS_FEEDBACK_PROFILE (profile));
+    fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+    g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 0x10);
+    fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-2");
+    g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 0x30);
+    g_assert_null (fbd_feedback_profile_get_feedback (profile, "does-not-exist"));
+    g_assert_nonnull (fbd_feedback_theme_lookup_feedbacks (theme,
+                                                           FBD_FEEDBACK_PROFILE_LEVEL_FULL,
+                                                           "test-dummy-2"));
+    g_assert_finalize_object (theme);
+    g_assert_finalize_object (expander);
+  }
+
+  dir = g_dir_open (cache_dir, 0, &err);
+  g_assert_no_error (err);
+  name = g_dir_read_name (dir);
+  g_assert_nonnull (name);
+  g_assert_true (g_str_has_suffix (name, ".cache"));
+  cache_file = g_build_filename (cache_dir, name, NULL);
+  g_assert_null (g_dir_read_name (dir));
+
+  g_assert_cmpint (g_unlink (cache_file), ==, 0);
+  g_assert_cmpint (g_rmdir (cache_dir), ==, 0);
+}
+
+#define WATCH_THEME \
+  "{ \"name\": \"watch\", \"parent-name\": \"default\", \"profiles\": [ " \
+  "  { \"name\": \"full\", \"feedbacks\": [ " \
+  "    { \"event-name\": \"test-dummy-0\", \"type\": \"Dummy\", \"duration\": %d } ] } ] }"
+
+static void
+on_theme_changed (FbdThemeExpander *expander, FbdFeedbackTheme *theme, gpointer user_data)
+{
+  FbdFeedbackTheme **changed = user_data;
+
+  g_assert_null (*changed);
+  *changed = g_object_ref (theme);
+}
+
+
+static void
+write_watch_theme (const char *path, int duration)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *data = g_strdup_printf (WATCH_THEME, duration);
+
+  g_file_set_contents (path, data, -1, &err);
+  g_assert_no_error (err);
+}
+
+
+static void
+test_fbd_theme_expander_watch (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *tmp_dir = NULL;
+  g_autofree char *theme_file = NULL;
+  const char *compatibles[] = { "replace", NULL };
+  FbdFeedbackTheme *changed = NULL;
+  FbdFeedbackProfile *profile;
+  FbdThemeExpander *expander;
+  FbdFeedbackTheme *theme;
+  FbdFeedbackBase *fb;
+
+  tmp_dir = g_dir_make_tmp ("fbd-theme-watch-XXXXXX", &err);
+  g_assert_no_error (err);
+  theme_file = g_build_filename (tmp_dir, "watch.json", NULL);
+  write_watch_theme (theme_file, 1);
+
+  expander = fbd_theme_expander_new (compatibles, NULL, theme_file);
+  fbd_theme_expander_set_watch (expander, TRUE);
+  g_signal_connect (expander, "theme-changed", G_CALLBACK (on_theme_changed), &changed);
+  theme = fbd_theme_expander_load_theme_files (expander, &err);
+  g_assert_no_error (err);
+
+  profile = fbd_feedback_theme_get_profile (theme, "full");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 1);
+  g_assert_nonnull (fbd_feedback_profile_get_feedback (profile, "test-dummy-1"));
+
+  write_watch_theme (theme_file, 2);
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  profile = fbd_feedback_theme_get_profile (changed, "full");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 2);
+  /* Unchanged files are still merged in */
+  g_assert_nonnull (fbd_feedback_profile_get_feedback (profile, "test-dummy-1"));
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-2");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 0x20);
+
+  g_assert_finalize_object (theme);
+  g_assert_finalize_object (changed);
+  g_assert_finalize_object (expander);
+
+  g_assert_cmpint (g_unlink (theme_file), ==, 0);
+  g_assert_cmpint (g_rmdir (tmp_dir), ==, 0);
+}
+
+
+
+static void
+on_theme_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GAsyncResult **result = user_data;
+
+  *result = g_object_ref (res);
+}
+
+
+static void
+test_fbd_theme_expander_async (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GCancellable) cancel = g_cancellable_new ();
+  g_autoptr (GAsyncResult) res = NULL;
+  g_autofree char *tmp_dir = NULL;
+  g_autofree char *theme_file = NULL;
+  const char *compatibles[] = { "replace", NULL };
+  FbdFeedbackTheme *changed = NULL;
+  FbdFeedbackProfile *profile;
+  FbdThemeExpander *expander;
+  FbdFeedbackTheme *theme;
+  FbdFeedbackBase *fb;
+
+  tmp_dir = g_dir_make_tmp ("fbd-theme-async-XXXXXX", &err);
+  g_assert_no_error (err);
+  theme_file = g_build_filename (tmp_dir, "watch.json", NULL);
+  write_watch_theme (theme_file, 1);
+
+  expander = fbd_theme_expander_new (compatibles, NULL, theme_file);
+  fbd_theme_expander_set_watch (expander, TRUE);
+  g_signal_connect (expander, "theme-changed", G_CALLBACK (on_theme_changed), &changed);
+
+  /* A cancelled load drops the theme */
+  fbd_theme_expander_load_theme_files_async (expander, cancel, on_theme_loaded, &res);
+  g_cancellable_cancel (cancel);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  theme = fbd_theme_expander_load_theme_files_finish (expander, res, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (theme);
+  g_clear_error (&err);
+  g_clear_object (&res);
+
+  fbd_theme_expander_load_theme_files_async (expander, NULL, on_theme_loaded, &res);
+  while (res == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  theme = fbd_theme_expander_load_theme_files_finish (expander, res, &err);
+  g_assert_no_error (err);
+  g_assert_true (FBD_IS_FEEDBACK_THEME (theme));
+
+  profile = fbd_feedback_theme_get_profile (theme, "full");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 1);
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-2");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 0x20);
+
+  /* Monitors got set up once the load finished */
+  write_watch_theme (theme_file, 2);
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  profile = fbd_feedback_theme_get_profile (changed, "full");
+  fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+  g_assert_cmpint (fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb)), ==, 2);
+
+  g_assert_finalize_object (theme);
+  g_assert_finalize_object (changed);
+  g_clear_object (&res);
+  /* The worker might not have dropped its reference to the task yet */
+  g_object_unref (expander);
+
+  g_assert_cmpint (g_unlink (theme_file), ==, 0);
+  g_assert_cmpint (g_rmdir (tmp_dir), ==, 0);
+}
+
+
+#define DEVICE_THEME \
+  "{ \"name\": \"$device\", \"parent-name\": \"default\", \"profiles\": [ " \
+  "  { \"name\": \"full\", \"feedbacks\": [ " \
+  "    { \"event-name\": \"test-dummy-0\", \"type\": \"Dummy\", \"duration\": 3 } ] } ] }"
+
+/* Prepended to XDG_DATA_DIRS so tests can add system themes */
+static char *xdg_data_dir;
+
+static guint
+get_dummy_duration (FbdFeedbackTheme *theme)
+{
+  FbdFeedbackProfile *profile = fbd_feedback_theme_get_profile (theme, "full");
+  FbdFeedbackBase *fb = fbd_feedback_profile_get_feedback (profile, "test-dummy-0");
+
+  return fbd_feedback_dummy_get_duration (FBD_FEEDBACK_DUMMY (fb));
+}
+
+
+static void
+test_fbd_theme_expander_index (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *theme_file = NULL;
+  const char *compatibles[] = { "appears", NULL };
+  FbdFeedbackTheme *changed = NULL;
+  FbdThemeExpander *expander;
+  FbdFeedbackTheme *theme;
+
+  theme_file = g_build_filename (xdg_data_dir, "feedbackd", "themes", "appears.json", NULL);
+
+  expander = fbd_theme_expander_new (compatibles, NULL, NULL);
+  fbd_theme_expander_set_watch (expander, TRUE);
+  g_signal_connect (expander, "theme-changed", G_CALLBACK (on_theme_changed), &changed);
+  theme = fbd_theme_expander_load_theme_files (expander, &err);
+  g_assert_no_error (err);
+  /* No device theme yet */
+  g_assert_cmpuint (get_dummy_duration (theme), !=, 3);
+
+  /* A device theme showing up gets indexed and loaded */
+  g_file_set_contents (theme_file, DEVICE_THEME, -1, &err);
+  g_assert_no_error (err);
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (get_dummy_duration (changed), ==, 3);
+  g_clear_object (&changed);
+
+  /* and is dropped again once it's gone */
+  g_assert_cmpint (g_unlink (theme_file), ==, 0);
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (get_dummy_duration (changed), !=, 3);
+
+  g_assert_finalize_object (theme);
+  g_assert_finalize_object (changed);
+  g_assert_finalize_object (expander);
+}
+
 gint
 main (int argc, char *argv[])
 {
+  g_autoptr (GError) err = NULL;
+  g_autofree char *themes_dir = NULL;
+  g_autofree char *data_dirs = NULL;
+  int ret;
+
+  /* The system data dirs are looked up only once */
+  xdg_data_dir = g_dir_make_tmp ("fbd-theme-index-XXXXXX", &err);
+  g_assert_no_error (err);
+  themes_dir = g_build_filename (xdg_data_dir, "feedbackd", "themes", NULL);
+  g_assert_cmpint (g_mkdir_with_parents (themes_dir, 0700), ==, 0);
+  data_dirs = g_strjoin (":", xdg_data_dir, g_getenv ("XDG_DATA_DIRS"), NULL);
+  g_setenv ("XDG_DATA_DIRS", data_dirs, TRUE);
+
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func("/feedbackd/fbd/theme-expander/object", test_fbd_theme_expander_object);
   g_test_add_func("/feedbackd/fbd/theme-expander/device", test_fbd_theme_expander_device);
   g_test_add_func("/feedbackd/fbd/theme-expander/custom", test_fbd_theme_expander_custom);
+  g_test_add_func("/feedbackd/fbd/theme-expander/cache", test_fbd_theme_expander_cache);
+  g_test_add_func("/feedbackd/fbd/theme-expander/watch", test_fbd_theme_expander_watch);
+  g_test_add_func("/feedbackd/fbd/theme-expander/async", test_fbd_theme_expander_async);
+  g_test_add_func("/feedbackd/fbd/theme-expander/index", test_fbd_theme_expander_index);
+
+  ret = g_test_run();
+
+  g_rmdir (themes_dir);
+  g_clear_pointer (&themes_dir, g_free);
+  themes_dir = g_build_filename (xdg_data_dir, "feedbackd", NULL);
+  g_rmdir (themes_dir);
+  g_rmdir (xdg_data_dir);
+  g_clear_pointer (&xdg_data_dir, g_free);
 
-  return g_test_run();
+  return ret;
 }
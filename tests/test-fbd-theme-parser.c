@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-theme-parser.h"
+
+#define THEME_HEAD "{\n  \"name\" : \"test\",\n  \"profiles\" : [ {\n"
+
+
+static void
+test_fbd_theme_parser_valid (void)
+{
+  const char *files[] = { "test.json", "xdg-data/feedbackd/themes/default.json" };
+
+  for (int i = 0; i < G_N_ELEMENTS (files); i++) {
+    g_autoptr (GError) err = NULL;
+    g_autoptr (JsonNode) node = NULL;
+    g_autofree char *path = g_build_filename (TEST_DATA_DIR, files[i], NULL);
+
+    node = fbd_theme_parser_load_file (path, FBD_THEME_PARSER_FLAG_VALIDATE, &err);
+    g_assert_no_error (err);
+    g_assert_true (JSON_NODE_HOLDS_OBJECT (node));
+  }
+}
+
+
+static void
+test_fbd_theme_parser_invalid (void)
+{
+  struct {
+    const char *json;
+    const char *prefix;
+  } tests[] = {
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"Dummy\", \"event-name\" : \"e\", \"foo\" : 1 } ] } ] }",
+      "<data>:6:" },
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"Unknown\", \"event-name\" : \"e\" } ] } ] }",
+      "<data>:6:" },
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"Dummy\" } ] } ] }",
+      "<data>:6:" },
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"Dummy\", \"event-name\" : \"e\", \"duration\" : \"long\" } ] } ] }",
+      "<data>:6:" },
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"VibraRumble\", \"event-name\" : \"e\", \"magnitude\" : 2 } ] } ] }",
+      "<data>:6:" },
+    { THEME_HEAD "    \"name\" : \"full\",\n    \"feedbacks\" : [\n"
+      "      { \"type\" : \"Dummy\", \"event-name\" : \"e\" },\n"
+      "      { \"type\" : \"Dummy\", \"event-name\" : \"e\" } ] } ] }",
+      "<data>:7:" },
+    { THEME_HEAD "    \"name\" : \"loud\" } ] }",
+      "<data>:3:" },
+    { "{ \"profiles\" : [] }",
+      "<data>:1:" },
+  };
+
+  for (int i = 0; i < G_N_ELEMENTS (tests); i++) {
+    g_autoptr (GError) err = NULL;
+    g_autoptr (JsonNode) node = NULL;
+
+    node = fbd_theme_parser_load_data (tests[i].json, -1, FBD_THEME_PARSER_FLAG_VALIDATE, &err);
+    g_assert_error (err, fbd_error_quark (), FBD_ERROR_THEME_INVALID);
+    g_assert_null (node);
+    g_test_message ("%s", err->message);
+    g_assert_true (g_str_has_prefix (err->message, tests[i].prefix));
+  }
+
+  /* Only validation looks at the properties */
+  {
+    g_autoptr (GError) err = NULL;
+    g_autoptr (JsonNode) node = NULL;
+
+    node = fbd_theme_parser_load_data (tests[0].json, -1, FBD_THEME_PARSER_FLAG_NONE, &err);
+    g_assert_no_error (err);
+    g_assert_nonnull (node);
+  }
+}
+
+
+static void
+test_fbd_theme_parser_syntax (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (JsonNode) node = NULL;
+
+  node = fbd_theme_parser_load_data ("{ \"name\" : }", -1, FBD_THEME_PARSER_FLAG_VALIDATE, &err);
+  g_assert_nonnull (err);
+  g_assert_null (node);
+  g_clear_error (&err);
+
+  node = fbd_theme_parser_load_data ("", -1, FBD_THEME_PARSER_FLAG_NONE, &err);
+  g_assert_error (err, fbd_error_quark (), FBD_ERROR_THEME_INVALID);
+  g_assert_null (node);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/theme-parser/valid", test_fbd_theme_parser_valid);
+  g_test_add_func ("/feedbackd/fbd/theme-parser/invalid", test_fbd_theme_parser_invalid);
+  g_test_add_func ("/feedbackd/fbd/theme-parser/syntax", test_fbd_theme_parser_syntax);
+
+  return g_test_run ();
+}
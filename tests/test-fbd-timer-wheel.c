@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd-timer-wheel.h"
+
+typedef struct {
+  GMainLoop *loop;
+  GArray    *fired;
+  gint64     fired_at[2];
+  guint      count;
+  guint      id;
+} TestData;
+
+
+static void
+on_once (gpointer data)
+{
+  TestData *test = data;
+  guint n = test->fired->len;
+
+  g_array_append_val (test->fired, n);
+  test->fired_at[MIN (n, 1)] = g_get_monotonic_time ();
+  if (test->fired->len == 2)
+    g_main_loop_quit (test->loop);
+}
+
+
+static void
+test_fbd_timer_wheel_once (void)
+{
+  g_autoptr (FbdTimerWheel) wheel = g_object_new (FBD_TYPE_TIMER_WHEEL, NULL);
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr (GArray) fired = g_array_new (FALSE, FALSE, sizeof (guint));
+  TestData test = { .loop = loop, .fired = fired };
+  guint id;
+
+  fbd_timer_wheel_add_once (wheel, 20, 0, on_once, &test);
+  id = fbd_timer_wheel_add_once (wheel, 5, 0, on_once, &test);
+  fbd_timer_wheel_remove (wheel, id);
+  fbd_timer_wheel_add_once (wheel, 10, 0, on_once, &test);
+  g_assert_cmpuint (fbd_timer_wheel_get_n_timers (wheel), ==, 2);
+
+  g_main_loop_run (loop);
+  g_assert_cmpuint (fired->len, ==, 2);
+  g_assert_cmpuint (fbd_timer_wheel_get_n_timers (wheel), ==, 0);
+}
+
+
+static void
+test_fbd_timer_wheel_slack (void)
+{
+  g_autoptr (FbdTimerWheel) wheel = g_object_new (FBD_TYPE_TIMER_WHEEL, NULL);
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr (GArray) fired = g_array_new (FALSE, FALSE, sizeof (guint));
+  TestData test = { .loop = loop, .fired = fired };
+  gint64 start = g_get_monotonic_time ();
+
+  /* The first timer can wait for the second so both fire together */
+  fbd_timer_wheel_add_once (wheel, 10, 100, on_once, &test);
+  fbd_timer_wheel_add_once (wheel, 30, 0, on_once, &test);
+
+  g_main_loop_run (loop);
+  g_assert_cmpint (test.fired_at[0] - start, >=, 30 * 1000);
+  g_assert_cmpint (test.fired_at[1] - test.fired_at[0], <, 10 * 1000);
+}
+
+
+static gboolean
+on_repeat (gpointer data)
+{
+  TestData *test = data;
+
+  test->count++;
+  if (test->count == 3) {
+    /* Removing itself from the callback */
+    fbd_timer_wheel_remove (fbd_timer_wheel_get_default (), test->id);
+    g_main_loop_quit (test->loop);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+test_fbd_timer_wheel_repeat (void)
+{
+  FbdTimerWheel *wheel = fbd_timer_wheel_get_default ();
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  TestData test = { .loop = loop };
+
+  test.id = fbd_timeout_add (5, 0, on_repeat, &test);
+  g_assert_cmpuint (test.id, !=, 0);
+
+  g_main_loop_run (loop);
+  g_assert_cmpuint (test.count, ==, 3);
+  g_assert_cmpuint (fbd_timer_wheel_get_n_timers (wheel), ==, 0);
+}
+
+
+static gboolean
+on_frame (gpointer data)
+{
+  guint *count = data;
+
+  (*count)++;
+  return G_SOURCE_CONTINUE;
+}
+
+
+static guint
+count_frames (FbdTimerWheel *wheel, GMainLoop *loop)
+{
+  guint count = 0;
+  guint id;
+
+  /* Like a software LED animation */
+  id = fbd_timer_wheel_add (wheel, 20, FBD_TIMER_WHEEL_SLACK_DEFAULT, on_frame, &count);
+  fbd_timer_wheel_add_once (wheel, 1000, 0, (GSourceOnceFunc)g_main_loop_quit, loop);
+  g_main_loop_run (loop);
+  fbd_timer_wheel_remove (wheel, id);
+
+  return count;
+}
+
+
+static void
+test_fbd_timer_wheel_min_slack (void)
+{
+  g_autoptr (FbdTimerWheel) wheel = g_object_new (FBD_TYPE_TIMER_WHEEL, NULL);
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  guint normal, low_power;
+
+  normal = count_frames (wheel, loop);
+
+  fbd_timer_wheel_set_min_slack (wheel, 200);
+  low_power = count_frames (wheel, loop);
+
+  /* Frames are at least the minimum slack apart, exact timers are unaffected */
+  g_test_message ("Wakeups per second: %u, in low power mode: %u", normal, low_power);
+  g_assert_cmpuint (low_power, <=, 5);
+  g_assert_cmpuint (low_power, <, normal);
+  g_assert_cmpuint (fbd_timer_wheel_get_n_timers (wheel), ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/timer-wheel/once", test_fbd_timer_wheel_once);
+  g_test_add_func ("/feedbackd/fbd/timer-wheel/slack", test_fbd_timer_wheel_slack);
+  g_test_add_func ("/feedbackd/fbd/timer-wheel/repeat", test_fbd_timer_wheel_repeat);
+  g_test_add_func ("/feedbackd/fbd/timer-wheel/min-slack", test_fbd_timer_wheel_min_slack);
+
+  return g_test_run ();
+}
@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "fbd.h"
+#include "fbd-vibra-slots.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define TEST_N_SLOTS 4
+#define TEST_BUSY_NONE -1
+
+/* An emulated force feedback device, ids aren't reused to tell effects apart */
+typedef struct {
+  gboolean uploaded[64];
+  int      next_id;
+  guint    n_effects;
+  /* Effects the device can hold, less than that means another client holds some */
+  guint    max_effects;
+  guint    n_uploads;
+  guint    n_erases;
+  int      busy;
+} TestDevice;
+
+
+static int
+test_upload (struct ff_effect *effect, gpointer user_data)
+{
+  TestDevice *dev = user_data;
+
+  dev->n_uploads++;
+  if (dev->n_effects >= dev->max_effects) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  g_assert_cmpint (dev->next_id, <, G_N_ELEMENTS (dev->uploaded));
+  effect->id = dev->next_id++;
+  dev->uploaded[effect->id] = TRUE;
+  dev->n_effects++;
+
+  return 0;
+}
+
+
+static void
+test_erase (int id, gpointer user_data)
+{
+  TestDevice *dev = user_data;
+
+  g_assert_cmpint (id, >=, 0);
+  g_assert_true (dev->uploaded[id]);
+  dev->uploaded[id] = FALSE;
+  dev->n_effects--;
+  dev->n_erases++;
+}
+
+
+static gboolean
+test_is_busy (int id, gpointer user_data)
+{
+  TestDevice *dev = user_data;
+
+  return id == dev->busy;
+}
+
+
+static const FbdVibraSlotsOps test_ops = {
+  .upload = test_upload,
+  .erase = test_erase,
+  .is_busy = test_is_busy,
+};
+
+
+static void
+test_device_init (TestDevice *dev, guint max_effects)
+{
+  *dev = (TestDevice) { 0 };
+  dev->max_effects = max_effects;
+  dev->busy = TEST_BUSY_NONE;
+}
+
+
+static void
+build_rumble (struct ff_effect *effect, guint magnitude)
+{
+  memset (effect, 0, sizeof (*effect));
+  effect->type = FF_RUMBLE;
+  effect->id = -1;
+  effect->u.rumble.strong_magnitude = magnitude;
+  effect->replay.length = 100;
+}
+
+
+static void
+build_custom (struct ff_effect *effect, gint16 *samples, guint n_samples)
+{
+  memset (effect, 0, sizeof (*effect));
+  effect->type = FF_PERIODIC;
+  effect->id = -1;
+  effect->u.periodic.waveform = FF_CUSTOM;
+  effect->u.periodic.custom_data = samples;
+  effect->u.periodic.custom_len = n_samples;
+  effect->replay.length = 100;
+}
+
+
+static int
+upload_rumble (FbdVibraSlots *slots, guint magnitude, gint64 now)
+{
+  struct ff_effect effect;
+
+  build_rumble (&effect, magnitude);
+  g_assert_true (fbd_vibra_slots_upload (slots, &effect, now));
+  g_assert_cmpint (effect.id, >=, 0);
+
+  return effect.id;
+}
+
+
+static void
+test_fbd_vibra_slots_reuse (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  struct ff_effect effect;
+  int id;
+
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (TEST_N_SLOTS, &test_ops, &dev);
+  g_assert_cmpuint (fbd_vibra_slots_get_n_slots (slots), ==, TEST_N_SLOTS);
+
+  id = upload_rumble (slots, 0x1000, 1);
+  g_assert_cmpuint (dev.n_uploads, ==, 1);
+
+  /* The same effect is only uploaded once */
+  g_assert_cmpint (upload_rumble (slots, 0x1000, 2), ==, id);
+  g_assert_cmpuint (dev.n_uploads, ==, 1);
+  g_assert_nonnull (fbd_vibra_slots_find (slots, id));
+
+  /* A different one isn't shared */
+  g_assert_cmpint (upload_rumble (slots, 0x2000, 3), !=, id);
+  g_assert_cmpuint (dev.n_uploads, ==, 2);
+
+  /* Unless asked to not look at the cache */
+  build_rumble (&effect, 0x1000);
+  g_assert_true (fbd_vibra_slots_upload_new (slots, &effect, 4));
+  g_assert_cmpint (effect.id, !=, id);
+  g_assert_cmpuint (dev.n_uploads, ==, 3);
+}
+
+
+static void
+test_fbd_vibra_slots_lru (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  int ids[TEST_N_SLOTS];
+  gint64 now = 0;
+
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (TEST_N_SLOTS, &test_ops, &dev);
+
+  for (guint i = 0; i < TEST_N_SLOTS; i++)
+    ids[i] = upload_rumble (slots, 0x1000 * (i + 1), ++now);
+  g_assert_null (fbd_vibra_slots_find (slots, -1));
+
+  /* Reusing the oldest effect makes the second one the least recently used */
+  g_assert_cmpint (upload_rumble (slots, 0x1000, ++now), ==, ids[0]);
+  upload_rumble (slots, 0x8000, ++now);
+  g_assert_cmpuint (dev.n_erases, ==, 1);
+  g_assert_true (dev.uploaded[ids[0]]);
+  g_assert_null (fbd_vibra_slots_find (slots, ids[1]));
+  g_assert_nonnull (fbd_vibra_slots_find (slots, ids[0]));
+
+  /* Playing effects aren't evicted */
+  dev.busy = ids[2];
+  upload_rumble (slots, 0x9000, ++now);
+  g_assert_nonnull (fbd_vibra_slots_find (slots, ids[2]));
+  g_assert_null (fbd_vibra_slots_find (slots, ids[3]));
+  g_assert_cmpuint (dev.n_erases, ==, 2);
+  g_assert_cmpuint (dev.n_effects, ==, TEST_N_SLOTS);
+}
+
+
+static void
+test_fbd_vibra_slots_reserved (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  struct ff_effect effect;
+  int prepared;
+  gint64 now = 0;
+
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (2, &test_ops, &dev);
+
+  build_rumble (&effect, 0x1000);
+  g_assert_true (fbd_vibra_slots_prepare (slots, &effect, ++now, 100));
+  prepared = effect.id;
+  upload_rumble (slots, 0x2000, ++now);
+
+  /* The prepared effect is older but reserved */
+  upload_rumble (slots, 0x3000, ++now);
+  g_assert_nonnull (fbd_vibra_slots_find (slots, prepared));
+  g_assert_cmpuint (dev.n_erases, ==, 1);
+
+  /* Once the reservation expired it's evicted like any other */
+  now = 100;
+  upload_rumble (slots, 0x4000, ++now);
+  g_assert_null (fbd_vibra_slots_find (slots, prepared));
+  g_assert_cmpuint (dev.n_erases, ==, 2);
+
+  /* Reusing a prepared effect ends the reservation */
+  build_rumble (&effect, 0x5000);
+  g_assert_true (fbd_vibra_slots_prepare (slots, &effect, ++now, 1000));
+  prepared = effect.id;
+  g_assert_cmpint (upload_rumble (slots, 0x5000, ++now), ==, prepared);
+  upload_rumble (slots, 0x6000, ++now);
+  upload_rumble (slots, 0x7000, ++now);
+  g_assert_null (fbd_vibra_slots_find (slots, prepared));
+
+  /* With all slots reserved there's nowhere to keep it so it's not leaked */
+  build_rumble (&effect, 0x6000);
+  g_assert_true (fbd_vibra_slots_prepare (slots, &effect, ++now, 2000));
+  build_rumble (&effect, 0x7000);
+  g_assert_true (fbd_vibra_slots_prepare (slots, &effect, ++now, 2000));
+  build_rumble (&effect, 0x8000);
+  g_assert_false (fbd_vibra_slots_prepare (slots, &effect, ++now, 2000));
+  g_assert_cmpuint (dev.n_effects, ==, 2);
+}
+
+
+static void
+test_fbd_vibra_slots_resident (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  gint16 samples[] = { 0, 0x4000, 0x7FFF, 0x4000 };
+  struct ff_effect effect;
+  FbdVibraSlot *slot;
+  int custom[2];
+  gint64 now = 0;
+
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (2, &test_ops, &dev);
+
+  for (guint i = 0; i < G_N_ELEMENTS (custom); i++) {
+    samples[0] = i;
+    build_custom (&effect, samples, G_N_ELEMENTS (samples));
+    g_assert_true (fbd_vibra_slots_upload (slots, &effect, ++now));
+    custom[i] = effect.id;
+  }
+
+  /* The cache keeps its own copy of the samples */
+  slot = fbd_vibra_slots_find (slots, custom[0]);
+  g_assert_true (slot->resident);
+  g_assert_true (slot->effect.u.periodic.custom_data != samples);
+  g_assert_cmpint (slot->effect.u.periodic.custom_data[0], ==, 0);
+
+  /* One slot stays available for everything else */
+  slot = fbd_vibra_slots_find (slots, custom[1]);
+  g_assert_false (slot->resident);
+
+  /* Resident effects aren't evicted even when least recently used */
+  upload_rumble (slots, 0x1000, ++now);
+  upload_rumble (slots, 0x2000, ++now);
+  g_assert_nonnull (fbd_vibra_slots_find (slots, custom[0]));
+  g_assert_null (fbd_vibra_slots_find (slots, custom[1]));
+
+  /* Compared by their samples */
+  samples[0] = 0;
+  build_custom (&effect, samples, G_N_ELEMENTS (samples));
+  g_assert_true (fbd_vibra_slots_upload (slots, &effect, ++now));
+  g_assert_cmpint (effect.id, ==, custom[0]);
+  samples[1] = 0;
+  effect.id = -1;
+  g_assert_false (fbd_vibra_effect_equal (&fbd_vibra_slots_find (slots, custom[0])->effect,
+                                          &effect));
+}
+
+
+static void
+test_fbd_vibra_slots_tuned (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  struct ff_effect effect;
+  FbdVibraSlot *slot;
+  int tuned;
+
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (TEST_N_SLOTS, &test_ops, &dev);
+  g_assert_null (fbd_vibra_slots_find_tuned (slots));
+
+  build_rumble (&effect, 0x1000);
+  g_assert_true (fbd_vibra_slots_upload_new (slots, &effect, 1));
+  tuned = effect.id;
+  slot = fbd_vibra_slots_find (slots, tuned);
+  slot->tuned = TRUE;
+  g_assert_true (fbd_vibra_slots_find_tuned (slots) == slot);
+
+  /* Tuned effects change in place so an equal effect gets its own slot */
+  g_assert_cmpint (upload_rumble (slots, 0x1000, 2), !=, tuned);
+  g_assert_cmpuint (dev.n_uploads, ==, 2);
+
+  /* Evicting a tuned effect clears the flag */
+  for (guint i = 0; i < TEST_N_SLOTS; i++)
+    upload_rumble (slots, 0x2000 + i, 3 + i);
+  g_assert_null (fbd_vibra_slots_find (slots, tuned));
+  g_assert_null (fbd_vibra_slots_find_tuned (slots));
+}
+
+
+static void
+test_fbd_vibra_slots_enospc (void)
+{
+  TestDevice dev;
+  g_autoptr (FbdVibraSlots) slots = NULL;
+  int first, second, untracked;
+  struct ff_effect effect;
+
+  /* Another client holds all but two of the device's effects */
+  test_device_init (&dev, 2);
+  slots = fbd_vibra_slots_new (TEST_N_SLOTS, &test_ops, &dev);
+
+  first = upload_rumble (slots, 0x1000, 1);
+  second = upload_rumble (slots, 0x2000, 2);
+  g_assert_nonnull (fbd_vibra_slots_find (slots, -1));
+
+  /* There are free slots but the device is full, evict and retry */
+  upload_rumble (slots, 0x3000, 3);
+  g_assert_cmpuint (dev.n_uploads, ==, 4);
+  g_assert_cmpuint (dev.n_erases, ==, 1);
+  g_assert_null (fbd_vibra_slots_find (slots, first));
+  g_assert_nonnull (fbd_vibra_slots_find (slots, second));
+
+  /* Nothing evictable, the upload fails */
+  dev.busy = second;
+  build_rumble (&effect, 0x4000);
+  g_assert_true (fbd_vibra_slots_prepare (slots, &effect, 4, 100));
+  g_test_expect_message ("fbd-vibra-slots", G_LOG_LEVEL_WARNING, "*Failed to upload*");
+  build_rumble (&effect, 0x5000);
+  g_assert_false (fbd_vibra_slots_upload (slots, &effect, 5));
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (dev.n_effects, ==, 2);
+
+  /* Effects without a slot are uploaded but not tracked */
+  g_clear_pointer (&slots, fbd_vibra_slots_free);
+  test_device_init (&dev, 16);
+  slots = fbd_vibra_slots_new (1, &test_ops, &dev);
+  first = upload_rumble (slots, 0x1000, 1);
+  dev.busy = first;
+  untracked = upload_rumble (slots, 0x2000, 2);
+  g_assert_cmpint (untracked, !=, first);
+  g_assert_null (fbd_vibra_slots_find (slots, untracked));
+  g_assert_cmpuint (dev.n_effects, ==, 2);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/reuse", test_fbd_vibra_slots_reuse);
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/lru", test_fbd_vibra_slots_lru);
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/reserved", test_fbd_vibra_slots_reserved);
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/resident", test_fbd_vibra_slots_resident);
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/tuned", test_fbd_vibra_slots_tuned);
+  g_test_add_func ("/feedbackd/fbd/vibra-slots/enospc", test_fbd_vibra_slots_enospc);
+
+  return g_test_run ();
+}
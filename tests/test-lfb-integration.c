@@ -4,8 +4,18 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  */
 
+#define _GNU_SOURCE
+
 #include "libfeedback.h"
+#include "lfb-names.h"
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 typedef struct {
   GTestDBus *dbus;
@@ -15,11 +25,9 @@ typedef struct {
 GMainLoop *mainloop;
 
 static void
-fixture_setup (TestFixture *fixture, gconstpointer unused)
+fixture_setup_uninitted (TestFixture *fixture, gconstpointer unused)
 {
-  g_autoptr (GError) err = NULL;
   gchar *relative, *servicesdir;
-  gint success;
 
   fixture->dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
   relative = g_test_build_filename (G_TEST_BUILT, "services", NULL);
@@ -34,12 +42,30 @@ fixture_setup (TestFixture *fixture, gconstpointer unused)
 
   g_assert_null (mainloop);
   mainloop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+fixture_setup (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GError) err = NULL;
+  gint success;
+
+  fixture_setup_uninitted (fixture, unused);
 
   success = lfb_init (TEST_APP_ID, &err);
   g_assert_no_error (err);
   g_assert_true (success);
 }
 
+/* Provide the haptic interface without a motor */
+static void
+fixture_setup_haptic (TestFixture *fixture, gconstpointer unused)
+{
+  g_setenv ("FEEDBACKD_DEBUG", "force-haptic", TRUE);
+  fixture_setup (fixture, unused);
+  g_unsetenv ("FEEDBACKD_DEBUG");
+}
+
 static void
 fixture_teardown (TestFixture *fixture, gconstpointer unused)
 {
@@ -217,6 +243,44 @@ test_lfb_integration_event_not_found_async (void)
   g_assert_cmpint (lfb_event_get_end_reason (event0), ==, LFB_EVENT_END_REASON_NOT_FOUND);
 }
 
+
+static void
+on_raw_feedback_ended_not_found (LfbGdbusFeedback *proxy, guint id, guint reason, guint *ended_id)
+{
+  g_assert_cmpuint (reason, ==, LFB_EVENT_END_REASON_NOT_FOUND);
+  *ended_id = id;
+}
+
+
+static void
+test_lfb_integration_not_found_compat (void)
+{
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  guint id, ended_id = 0;
+  gboolean success;
+
+  g_signal_connect (proxy, "feedback-ended", (GCallback)on_raw_feedback_ended_not_found, &ended_id);
+
+  /* Clients using TriggerFeedback get a real id and the signal */
+  success = lfb_gdbus_feedback_call_trigger_feedback_sync (proxy, TEST_APP_ID, "test-does-not-exist",
+                                                           g_variant_new ("a{sv}", NULL), 0,
+                                                           &id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpuint (id, !=, FB_EVENT_ID_NO_FEEDBACK);
+  while (ended_id == 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (ended_id, ==, id);
+
+  /* Ending the reserved id is fine */
+  success = lfb_gdbus_feedback_call_end_feedback_sync (proxy, FB_EVENT_ID_NO_FEEDBACK, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  g_signal_handlers_disconnect_by_data (proxy, &ended_id);
+}
+
 static void
 test_lfb_integration_event_async (void)
 {
@@ -304,6 +368,449 @@ test_lfb_integration_event_async_error (void)
 }
 
 
+static void
+on_events_triggered (GObject      *source_object,
+                     GAsyncResult *res,
+                     gboolean     *triggered)
+{
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+
+  g_assert_null (source_object);
+
+  success = lfb_events_trigger_feedback_batch_finish (res, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  *triggered = TRUE;
+}
+
+
+static void
+on_batch_feedback_ended (LfbEvent *event, guint *n_ended)
+{
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_ENDED);
+
+  (*n_ended)++;
+  if (*n_ended == 2)
+    g_main_loop_quit (mainloop);
+}
+
+
+static void
+test_lfb_integration_event_batch (void)
+{
+  g_autoptr (LfbEvent) event0 = NULL;
+  g_autoptr (LfbEvent) event1 = NULL;
+  g_autoptr (GPtrArray) events = g_ptr_array_new ();
+  gboolean triggered = FALSE;
+  guint n_ended = 0;
+
+  event0 = lfb_event_new ("test-dummy-0");
+  g_signal_connect (event0, "feedback-ended", (GCallback)on_batch_feedback_ended, &n_ended);
+  g_ptr_array_add (events, event0);
+
+  event1 = lfb_event_new ("test-does-not-exist");
+  g_signal_connect (event1, "feedback-ended", (GCallback)on_batch_feedback_ended, &n_ended);
+  g_ptr_array_add (events, event1);
+
+  lfb_events_trigger_feedback_batch_async (events,
+                                           NULL,
+                                           (GAsyncReadyCallback)on_events_triggered,
+                                           &triggered);
+  g_main_loop_run (mainloop);
+
+  g_assert_true (triggered);
+  g_assert_cmpint (n_ended, ==, 2);
+  g_assert_cmpint (lfb_event_get_end_reason (event0), ==, LFB_EVENT_END_REASON_NATURAL);
+  g_assert_cmpint (lfb_event_get_end_reason (event1), ==, LFB_EVENT_END_REASON_NOT_FOUND);
+}
+
+
+static void
+test_lfb_integration_event_coalesce (void)
+{
+  g_autoptr (LfbEvent) event0 = NULL;
+  g_autoptr (LfbEvent) event1 = NULL;
+  g_autoptr (GError) err = NULL;
+  guint n_ended = 0;
+  gboolean success;
+
+  event0 = lfb_event_new ("test-dummy-coalesce");
+  g_signal_connect (event0, "feedback-ended", (GCallback)on_batch_feedback_ended, &n_ended);
+  success = lfb_event_trigger_feedback (event0, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  /* Merged into the running event */
+  event1 = lfb_event_new ("test-dummy-coalesce");
+  g_signal_connect (event1, "feedback-ended", (GCallback)on_batch_feedback_ended, &n_ended);
+  success = lfb_event_trigger_feedback (event1, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  /* Ending one ends both */
+  success = lfb_event_end_feedback (event0, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  g_main_loop_run (mainloop);
+
+  g_assert_cmpint (n_ended, ==, 2);
+  g_assert_cmpint (lfb_event_get_end_reason (event0), ==, LFB_EVENT_END_REASON_EXPLICIT);
+  g_assert_cmpint (lfb_event_get_end_reason (event1), ==, LFB_EVENT_END_REASON_EXPLICIT);
+}
+
+
+static void
+test_lfb_integration_event_fire_and_forget (void)
+{
+  g_autoptr (LfbEvent) event = NULL;
+  g_autoptr (GError) err = NULL;
+  LfbEvent *cmp = NULL;
+  gboolean success;
+
+  /* Marked in the theme so the event ends right away although the feedback runs on */
+  event = lfb_event_new ("test-dummy-fire-and-forget");
+  g_signal_connect (event, "feedback-ended", (GCallback)on_feedback_ended, &cmp);
+  g_signal_connect_swapped (event, "feedback-ended", (GCallback)g_main_loop_quit, mainloop);
+  success = lfb_event_trigger_feedback (event, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  g_main_loop_run (mainloop);
+
+  g_assert_true (event == cmp);
+  g_assert_cmpint (lfb_event_get_end_reason (event), ==, LFB_EVENT_END_REASON_NATURAL);
+}
+
+
+static void
+test_lfb_integration_haptic_session (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedbackHaptic) haptic = NULL;
+  gboolean success;
+  guint session = 42;
+
+  haptic = lfb_gdbus_feedback_haptic_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                             G_DBUS_PROXY_FLAGS_NONE,
+                                                             FB_DBUS_NAME,
+                                                             FB_DBUS_PATH,
+                                                             NULL,
+                                                             &err);
+  g_assert_no_error (err);
+
+  /* No motor to hand out */
+  success = lfb_gdbus_feedback_haptic_call_open_session_sync (haptic, TEST_APP_ID, &session,
+                                                              NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpuint (session, ==, 0);
+
+  /* Unknown sessions can't be used */
+  success = lfb_gdbus_feedback_haptic_call_update_magnitude_sync (haptic, 42, 0.5, NULL, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_false (success);
+  g_clear_error (&err);
+
+  success = lfb_gdbus_feedback_haptic_call_close_session_sync (haptic, 42, NULL, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_false (success);
+}
+
+/* Like FbdHapticStep in the daemon */
+typedef struct {
+  float   magnitude;
+  guint32 duration;
+} TestHapticStep;
+
+
+static gboolean
+vibrate_fd (LfbGdbusFeedbackHaptic *haptic,
+            gconstpointer           steps,
+            gsize                   size,
+            int                     seals,
+            GError                **error)
+{
+  g_autoptr (GUnixFDList) fd_list = g_unix_fd_list_new ();
+  gboolean success = FALSE;
+  int fd;
+
+  fd = memfd_create ("test-pattern", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  g_assert_cmpint (fd, >=, 0);
+  g_assert_cmpint (write (fd, steps, size), ==, size);
+  if (seals)
+    g_assert_cmpint (fcntl (fd, F_ADD_SEALS, seals), ==, 0);
+  g_assert_cmpint (g_unix_fd_list_append (fd_list, fd, NULL), ==, 0);
+  close (fd);
+
+  lfb_gdbus_feedback_haptic_call_vibrate_fd_sync (haptic, TEST_APP_ID, g_variant_new_handle (0),
+                                                  fd_list, &success, NULL, NULL, error);
+  return success;
+}
+
+
+static void
+test_lfb_integration_haptic_vibrate_fd (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (LfbGdbusFeedbackHaptic) haptic = NULL;
+  g_autofree TestHapticStep *long_steps = g_new0 (TestHapticStep, 1025);
+  TestHapticStep steps[] = { { 1.0, 10 }, { NAN, 10 }, { 2.0, G_MAXUINT32 }, { -1.0, 10 } };
+  int seals = F_SEAL_WRITE | F_SEAL_SHRINK;
+
+  haptic = lfb_gdbus_feedback_haptic_proxy_new_for_bus_sync (FB_DBUS_TYPE,
+                                                             G_DBUS_PROXY_FLAGS_NONE,
+                                                             FB_DBUS_NAME,
+                                                             FB_DBUS_PATH,
+                                                             NULL,
+                                                             &err);
+  g_assert_no_error (err);
+
+  /* The memfd must be sealed against writing and shrinking */
+  g_assert_false (vibrate_fd (haptic, steps, sizeof (steps), 0, &err));
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_clear_error (&err);
+
+  g_assert_false (vibrate_fd (haptic, steps, sizeof (steps), F_SEAL_WRITE, &err));
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_clear_error (&err);
+
+  /* Only complete steps and at most 1024 of them */
+  g_assert_false (vibrate_fd (haptic, steps, sizeof (steps) - 2, seals, &err));
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_clear_error (&err);
+
+  g_assert_false (vibrate_fd (haptic, long_steps, 1025 * sizeof (TestHapticStep), seals, &err));
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_clear_error (&err);
+
+  /* NaN and out of range values get clamped, without a motor nothing plays */
+  g_assert_false (vibrate_fd (haptic, steps, sizeof (steps), seals, &err));
+  g_assert_no_error (err);
+
+  /* Sent again it's served from the cache */
+  g_assert_false (vibrate_fd (haptic, steps, sizeof (steps), seals, &err));
+  g_assert_no_error (err);
+
+  g_assert_false (vibrate_fd (haptic, long_steps, 1024 * sizeof (TestHapticStep), seals, &err));
+  g_assert_no_error (err);
+}
+
+
+static void
+on_retrigger_feedback_ended (LfbEvent *event, guint *n_ended)
+{
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_ENDED);
+
+  (*n_ended)++;
+  if (*n_ended < 3)
+    lfb_event_retrigger_async (event, NULL);
+  else
+    g_main_loop_quit (mainloop);
+}
+
+
+static void
+test_lfb_integration_event_retrigger (void)
+{
+  g_autoptr (LfbEvent) event = NULL;
+  guint n_ended = 0;
+
+  event = lfb_event_new ("test-dummy-0");
+  lfb_event_set_important (event, TRUE);
+  g_signal_connect (event, "feedback-ended", (GCallback)on_retrigger_feedback_ended, &n_ended);
+
+  lfb_event_retrigger_async (event, NULL);
+  g_main_loop_run (mainloop);
+
+  g_assert_cmpint (n_ended, ==, 3);
+  g_assert_cmpint (lfb_event_get_end_reason (event), ==, LFB_EVENT_END_REASON_NATURAL);
+
+  /* Changed hints get picked up */
+  lfb_event_set_feedback_profile (event, "silent");
+  n_ended = 2;
+  lfb_event_retrigger_async (event, NULL);
+  g_main_loop_run (mainloop);
+  g_assert_cmpint (n_ended, ==, 3);
+  g_assert_cmpint (lfb_event_get_end_reason (event), ==, LFB_EVENT_END_REASON_NOT_FOUND);
+}
+
+
+static void
+test_lfb_integration_event_prepare (void)
+{
+  g_autoptr (LfbEvent) event = NULL;
+  g_autoptr (LfbEvent) missing = NULL;
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+
+  event = lfb_event_new ("test-dummy-0");
+  missing = lfb_event_new ("does-not-exist");
+
+  /* Preparing doesn't trigger anything and unknown events are fine */
+  lfb_event_prepare_feedback_async (event, NULL);
+  lfb_event_prepare_feedback_async (missing, NULL);
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_NONE);
+
+  success = lfb_event_trigger_feedback (event, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_RUNNING);
+
+  g_signal_connect_swapped (event, "feedback-ended", (GCallback)g_main_loop_quit, mainloop);
+  g_main_loop_run (mainloop);
+  g_assert_cmpint (lfb_event_get_end_reason (event), ==, LFB_EVENT_END_REASON_NATURAL);
+}
+
+
+static void
+test_lfb_integration_event_many (void)
+{
+  g_autoptr (GPtrArray) events = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (GError) err = NULL;
+  LfbEvent *cmp = NULL, *ended;
+  gboolean success;
+
+  /* Stay below the default rate limit */
+  for (guint i = 0; i < 24; i++) {
+    LfbEvent *event = lfb_event_new ("test-dummy-10");
+
+    success = lfb_event_trigger_feedback (event, &err);
+    g_assert_no_error (err);
+    g_assert_true (success);
+    g_ptr_array_add (events, event);
+  }
+
+  /* Dropping running events must not confuse the dispatch */
+  g_ptr_array_remove_index (events, 0);
+
+  ended = g_ptr_array_index (events, 12);
+  g_signal_connect (ended, "feedback-ended", (GCallback)on_feedback_ended, &cmp);
+  g_signal_connect_swapped (ended, "feedback-ended", (GCallback)g_main_loop_quit, mainloop);
+  success = lfb_event_end_feedback (ended, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  g_main_loop_run (mainloop);
+
+  /* Only the ended event saw the signal */
+  g_assert_true (ended == cmp);
+  for (guint i = 0; i < events->len; i++) {
+    LfbEvent *event = g_ptr_array_index (events, i);
+
+    if (event == ended)
+      continue;
+    g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_RUNNING);
+  }
+}
+
+
+static void
+on_raw_feedback_ended (LfbGdbusFeedback *proxy, guint id, guint reason, guint *ended_id)
+{
+  *ended_id = id;
+  g_main_loop_quit (mainloop);
+}
+
+
+static void
+test_lfb_integration_peer (void)
+{
+  g_autoptr (LfbGdbusFeedback) peer_proxy = NULL;
+  g_autoptr (GDBusConnection) conn = NULL;
+  g_autoptr (GSocketConnection) stream = NULL;
+  g_autoptr (GSocket) socket = NULL;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  g_autoptr (GVariant) handle = NULL;
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  guint id, ended_id = 0;
+  gboolean success;
+  int fd;
+
+  success = lfb_gdbus_feedback_call_open_peer_connection_sync (proxy, NULL, &handle, &fd_list,
+                                                               NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (handle), &err);
+  g_assert_no_error (err);
+  socket = g_socket_new_from_fd (fd, &err);
+  g_assert_no_error (err);
+  stream = g_socket_connection_factory_create_connection (socket);
+  conn = g_dbus_connection_new_sync (G_IO_STREAM (stream), NULL,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL, NULL, &err);
+  g_assert_no_error (err);
+  g_dbus_connection_set_exit_on_close (conn, FALSE);
+  peer_proxy = lfb_gdbus_feedback_proxy_new_sync (conn, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                  NULL, "/org/sigxcpu/Feedback", NULL, &err);
+  g_assert_no_error (err);
+
+  /* Feedback ends on the peer connection */
+  g_signal_connect (peer_proxy, "feedback-ended", (GCallback)on_raw_feedback_ended, &ended_id);
+  success = lfb_gdbus_feedback_call_trigger_feedback_sync (peer_proxy, TEST_APP_ID, "test-dummy-0",
+                                                           g_variant_new ("a{sv}", NULL), -1,
+                                                           &id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_main_loop_run (mainloop);
+  g_assert_cmpuint (ended_id, ==, id);
+
+  /* Peers can't open further peer connections */
+  g_clear_pointer (&handle, g_variant_unref);
+  g_clear_object (&fd_list);
+  success = lfb_gdbus_feedback_call_open_peer_connection_sync (peer_proxy, NULL, &handle,
+                                                               &fd_list, NULL, &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED);
+  g_assert_false (success);
+  g_clear_error (&err);
+
+  /* Closing the connection ends the peer's events, the bus still sees that */
+  success = lfb_gdbus_feedback_call_trigger_feedback_sync (peer_proxy, TEST_APP_ID, "test-dummy-10",
+                                                           g_variant_new ("a{sv}", NULL), 0,
+                                                           &id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_signal_connect (proxy, "feedback-ended", (GCallback)on_raw_feedback_ended, &ended_id);
+  g_clear_object (&peer_proxy);
+  success = g_dbus_connection_close_sync (conn, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_main_loop_run (mainloop);
+  g_assert_cmpuint (ended_id, ==, id);
+  g_signal_handlers_disconnect_by_data (proxy, &ended_id);
+}
+
+
+static void
+test_lfb_integration_peer_limit (void)
+{
+  g_autoptr (GPtrArray) fd_lists = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  gboolean success;
+
+  /* A client only gets a few peer connections, pending ones count too */
+  while (TRUE) {
+    g_autoptr (GUnixFDList) fd_list = NULL;
+    g_autoptr (GVariant) handle = NULL;
+
+    success = lfb_gdbus_feedback_call_open_peer_connection_sync (proxy, NULL, &handle, &fd_list,
+                                                                 NULL, &err);
+    if (!success)
+      break;
+
+    g_assert_no_error (err);
+    g_ptr_array_add (fd_lists, g_steal_pointer (&fd_list));
+    g_assert_cmpuint (fd_lists->len, <, 64);
+  }
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED);
+  g_assert_cmpuint (fd_lists->len, ==, 4);
+}
+
+
 static void
 on_profile_changed (LfbGdbusFeedback *proxy, GParamSpec *psepc, const gchar **profile)
 {
@@ -331,6 +838,412 @@ test_lfb_integration_profile (void)
   g_assert_cmpstr (cmp, ==, "quiet");
 }
 
+static void
+on_capabilities_changed (LfbGdbusFeedback *proxy, gboolean *changed)
+{
+  *changed = TRUE;
+  g_main_loop_quit (mainloop);
+}
+
+static void
+test_lfb_integration_capabilities (void)
+{
+  g_autoptr (GError) err = NULL;
+  const char *events[] = { "test-dummy-0", "does-not-exist", NULL };
+  LfbGdbusFeedback *proxy;
+  gboolean changed = FALSE;
+  gboolean success;
+
+  success = lfb_query_event_capabilities (events, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  /* Dummy feedbacks have no device */
+  g_assert_cmpint (lfb_get_event_capabilities ("test-dummy-0"), ==, LFB_EVENT_CAPABILITY_NONE);
+  g_assert_cmpint (lfb_get_event_capabilities ("does-not-exist"), ==,
+                   LFB_EVENT_CAPABILITY_NONE);
+  /* Not queried before */
+  g_assert_cmpint (lfb_get_event_capabilities ("test-dummy-10"), ==,
+                   LFB_EVENT_CAPABILITY_NONE);
+
+  proxy = lfb_get_proxy ();
+  g_signal_connect (proxy, "capabilities-changed", G_CALLBACK (on_capabilities_changed),
+                    &changed);
+  lfb_set_feedback_profile ("quiet");
+  g_main_loop_run (mainloop);
+  g_assert_true (changed);
+
+  g_assert_cmpint (lfb_get_event_capabilities ("test-dummy-0"), ==, LFB_EVENT_CAPABILITY_NONE);
+  g_signal_handlers_disconnect_by_func (proxy, on_capabilities_changed, &changed);
+}
+
+static void
+test_lfb_integration_trigger_ex (void)
+{
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  gboolean success;
+  guint id;
+
+  g_assert_cmpuint (lfb_gdbus_feedback_get_version (proxy), ==, FB_DBUS_VERSION);
+
+  success = lfb_gdbus_feedback_call_trigger_feedback_ex_sync (proxy,
+                                                              TEST_APP_ID,
+                                                              "test-dummy-0",
+                                                              g_variant_new ("(uuus)",
+                                                                             FB_TRIGGER_LEVEL_DEFAULT,
+                                                                             0, 0, ""),
+                                                              g_variant_new ("a{sv}", NULL),
+                                                              -1,
+                                                              &id,
+                                                              NULL,
+                                                              &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpuint (id, !=, FB_EVENT_ID_NO_FEEDBACK);
+
+  /* The silent profile has no feedbacks */
+  success = lfb_gdbus_feedback_call_trigger_feedback_ex_sync (proxy,
+                                                              TEST_APP_ID,
+                                                              "test-dummy-0",
+                                                              g_variant_new ("(uuus)",
+                                                                             FB_TRIGGER_LEVEL_SILENT,
+                                                                             0, 0, ""),
+                                                              g_variant_new ("a{sv}", NULL),
+                                                              -1,
+                                                              &id,
+                                                              NULL,
+                                                              &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpuint (id, ==, FB_EVENT_ID_NO_FEEDBACK);
+
+  success = lfb_gdbus_feedback_call_trigger_feedback_ex_sync (proxy,
+                                                              TEST_APP_ID,
+                                                              "test-dummy-0",
+                                                              g_variant_new ("(uuus)", 42,
+                                                                             0, 0, ""),
+                                                              g_variant_new ("a{sv}", NULL),
+                                                              -1,
+                                                              &id,
+                                                              NULL,
+                                                              &err);
+  g_assert_error (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS);
+  g_assert_false (success);
+}
+
+static void
+on_raw_feedback_ended_count (LfbGdbusFeedback *proxy, guint id, guint reason, guint *n_ended)
+{
+  g_assert_cmpuint (reason, ==, LFB_EVENT_END_REASON_EXPLICIT);
+
+  (*n_ended)++;
+  if (*n_ended == 2)
+    g_main_loop_quit (mainloop);
+}
+
+
+static guint
+trigger_raw (LfbGdbusFeedback *proxy, const char *event)
+{
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+  guint id;
+
+  success = lfb_gdbus_feedback_call_trigger_feedback_sync (proxy, TEST_APP_ID, event,
+                                                           g_variant_new ("a{sv}", NULL), 0,
+                                                           &id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpuint (id, !=, FB_EVENT_ID_NO_FEEDBACK);
+
+  return id;
+}
+
+
+static void
+test_lfb_integration_end_feedbacks (void)
+{
+  g_autoptr (GError) err = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  guint32 ids[3];
+  guint n_ended = 0;
+  gboolean success;
+
+  g_signal_connect (proxy, "feedback-ended", (GCallback)on_raw_feedback_ended_count, &n_ended);
+
+  ids[0] = trigger_raw (proxy, "test-dummy-10");
+  ids[1] = trigger_raw (proxy, "test-dummy-10");
+  /* Unknown ids are skipped */
+  ids[2] = ids[1] + 1000;
+  success = lfb_gdbus_feedback_call_end_feedbacks_sync (proxy,
+                                                        g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                                                   ids,
+                                                                                   G_N_ELEMENTS (ids),
+                                                                                   sizeof (guint32)),
+                                                        NULL,
+                                                        &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_main_loop_run (mainloop);
+  g_assert_cmpuint (n_ended, ==, 2);
+
+  /* Ends everything the caller started */
+  n_ended = 0;
+  trigger_raw (proxy, "test-dummy-10");
+  trigger_raw (proxy, "test-dummy-10");
+  success = lfb_gdbus_feedback_call_end_all_feedbacks_for_sender_sync (proxy, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_main_loop_run (mainloop);
+  g_assert_cmpuint (n_ended, ==, 2);
+
+  g_signal_handlers_disconnect_by_data (proxy, &n_ended);
+}
+
+
+static void
+on_raw_feedback_ended_id (LfbGdbusFeedback *proxy, guint id, guint reason, guint *ended_id)
+{
+  *ended_id = id;
+}
+
+
+static void
+test_lfb_integration_end_foreign (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GDBusConnection) other_conn = NULL;
+  g_autoptr (LfbGdbusFeedback) other = NULL;
+  g_autoptr (GVariant) reply = NULL;
+  LfbGdbusFeedback *proxy = lfb_get_proxy ();
+  guint32 id;
+  guint ended_id = 0;
+  gboolean success;
+
+  g_signal_connect (proxy, "feedback-ended", (GCallback)on_raw_feedback_ended_id, &ended_id);
+  id = trigger_raw (proxy, "test-dummy-10");
+
+  other_conn = g_dbus_connection_new_for_address_sync (g_getenv ("DBUS_SESSION_BUS_ADDRESS"),
+                                                       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                       G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                       NULL,
+                                                       NULL,
+                                                       &err);
+  g_assert_no_error (err);
+  other = lfb_gdbus_feedback_proxy_new_sync (other_conn, G_DBUS_PROXY_FLAGS_NONE,
+                                             FB_DBUS_NAME, FB_DBUS_PATH, NULL, &err);
+  g_assert_no_error (err);
+
+  /* Other clients can't end the event */
+  success = lfb_gdbus_feedback_call_end_feedback_sync (other, id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  success = lfb_gdbus_feedback_call_end_feedbacks_sync (other,
+                                                        g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                                                   &id, 1,
+                                                                                   sizeof (guint32)),
+                                                        NULL,
+                                                        &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  /* A FeedbackEnded would have been sent before the reply */
+  reply = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (G_DBUS_PROXY (proxy)),
+                                       FB_DBUS_NAME, FB_DBUS_PATH,
+                                       "org.freedesktop.DBus.Peer", "Ping",
+                                       NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &err);
+  g_assert_no_error (err);
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpuint (ended_id, ==, 0);
+
+  /* The owner can */
+  success = lfb_gdbus_feedback_call_end_feedback_sync (proxy, id, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  while (ended_id == 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (ended_id, ==, id);
+
+  g_signal_handlers_disconnect_by_data (proxy, &ended_id);
+}
+
+
+static void
+on_init_finished (GObject *source_object, GAsyncResult *res, gboolean *done)
+{
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+
+  success = lfb_init_finish (res, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+
+  *done = TRUE;
+}
+
+static void
+test_lfb_integration_init_async (void)
+{
+  g_autoptr (LfbEvent) event = NULL;
+  LfbEvent *cmp = NULL;
+  gboolean done = FALSE;
+
+  lfb_init_async (TEST_APP_ID, NULL, (GAsyncReadyCallback)on_init_finished, &done);
+  g_assert_true (lfb_is_initted ());
+  g_assert_cmpstr (lfb_get_app_id (), ==, TEST_APP_ID);
+
+  /* Queued until the proxy is there */
+  event = lfb_event_new ("test-dummy-10");
+  lfb_event_trigger_feedback_async (event, NULL,
+                                    (GAsyncReadyCallback)on_event_triggered_quit,
+                                    &cmp);
+  g_main_loop_run (mainloop);
+
+  g_assert_true (done);
+  g_assert_true (cmp == event);
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_RUNNING);
+  g_assert_cmpstr (lfb_get_feedback_profile (), ==, "full");
+}
+
+static void
+test_lfb_integration_init_lazy (void)
+{
+  g_autoptr (LfbEvent) event0 = NULL;
+  g_autoptr (LfbEvent) event10 = NULL;
+  g_autoptr (GError) err = NULL;
+  LfbEvent *cmp = NULL, *ended = NULL;
+  gboolean success;
+
+  lfb_init_lazy (TEST_APP_ID);
+  g_assert_true (lfb_is_initted ());
+
+  /* Both wait for the proxy and are sent in order */
+  event10 = lfb_event_new ("test-dummy-10");
+  lfb_event_trigger_feedback_async (event10, NULL, (GAsyncReadyCallback)on_event_triggered,
+                                    &cmp);
+  event0 = lfb_event_new ("test-dummy-0");
+  g_signal_connect (event0, "feedback-ended", (GCallback)on_feedback_ended, &ended);
+  g_signal_connect_swapped (event0, "feedback-ended", (GCallback)g_main_loop_quit, mainloop);
+  lfb_event_retrigger_async (event0, NULL);
+  g_main_loop_run (mainloop);
+
+  g_assert_true (cmp == event10);
+  g_assert_true (ended == event0);
+
+  /* Sync calls work once the proxy is there */
+  success = lfb_event_end_feedback (event10, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+}
+
+static void
+test_lfb_integration_init_lazy_sync (void)
+{
+  g_autoptr (LfbEvent) event = NULL;
+  g_autoptr (GError) err = NULL;
+  gboolean success;
+
+  lfb_init_lazy (TEST_APP_ID);
+
+  /* Sync calls don't wait for a main loop */
+  event = lfb_event_new ("test-dummy-10");
+  success = lfb_event_trigger_feedback (event, &err);
+  g_assert_no_error (err);
+  g_assert_true (success);
+  g_assert_cmpint (lfb_event_get_state (event), ==, LFB_EVENT_STATE_RUNNING);
+}
+
+typedef struct {
+  GMainContext *context;
+  GMainLoop    *loop;
+  gboolean      ended_in_thread;
+} ThreadData;
+
+static int n_threads_done;
+
+static void
+on_thread_feedback_ended (LfbEvent *event, ThreadData *data)
+{
+  data->ended_in_thread = g_main_context_is_owner (data->context);
+  g_main_loop_quit (data->loop);
+}
+
+static gpointer
+trigger_in_thread (gpointer user_data)
+{
+  ThreadData *data = user_data;
+  g_autoptr (LfbEvent) event = lfb_event_new ("test-dummy-0");
+
+  g_main_context_push_thread_default (data->context);
+  g_signal_connect (event, "feedback-ended", G_CALLBACK (on_thread_feedback_ended), data);
+  lfb_event_trigger_feedback_async (event, NULL, NULL, NULL);
+  g_main_loop_run (data->loop);
+  g_main_context_pop_thread_default (data->context);
+
+  g_atomic_int_inc (&n_threads_done);
+  g_main_context_wakeup (NULL);
+
+  return NULL;
+}
+
+#define N_THREADS 4
+
+static void
+test_lfb_integration_threads (void)
+{
+  ThreadData data[N_THREADS];
+  GThread *threads[N_THREADS];
+
+  n_threads_done = 0;
+  for (guint i = 0; i < N_THREADS; i++) {
+    data[i].context = g_main_context_new ();
+    data[i].loop = g_main_loop_new (data[i].context, FALSE);
+    data[i].ended_in_thread = FALSE;
+    threads[i] = g_thread_new ("trigger", trigger_in_thread, &data[i]);
+  }
+
+  /* The daemon's signals arrive in the main thread and get passed on */
+  while (g_atomic_int_get (&n_threads_done) < N_THREADS)
+    g_main_context_iteration (NULL, TRUE);
+
+  for (guint i = 0; i < N_THREADS; i++) {
+    g_thread_join (threads[i]);
+    /* The event ended in the thread that triggered it */
+    g_assert_true (data[i].ended_in_thread);
+    g_main_loop_unref (data[i].loop);
+    g_main_context_unref (data[i].context);
+  }
+}
+
+/* fbcli's load mode runs against the daemon and reports latencies */
+static void
+test_lfb_integration_fbcli_load (TestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GSubprocess) proc = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *out = NULL;
+
+  proc = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, &err,
+                           FBCLI_PATH,
+                           "--event", "test-dummy-0",
+                           "--load", "20",
+                           "--load-apps", "2",
+                           "--load-duration", "1",
+                           "--watch", "5",
+                           NULL);
+  g_assert_no_error (err);
+
+  g_subprocess_communicate_utf8 (proc, NULL, NULL, &out, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (g_subprocess_get_successful (proc));
+
+  g_assert_nonnull (strstr (out, ", failed: 0,"));
+  g_assert_nonnull (strstr (out, ", not ended: 0\n"));
+  g_assert_nonnull (strstr (out, "trigger-feedback"));
+  g_assert_nonnull (strstr (out, "feedback-ended"));
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -361,10 +1274,105 @@ main (gint argc, gchar *argv[])
              (gpointer)test_lfb_integration_event_not_found_async,
              (gpointer)fixture_teardown);
 
+  g_test_add("/feedbackd/lfb-integration/not_found_compat", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_not_found_compat,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_batch", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_batch,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_coalesce", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_coalesce,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_fire_and_forget", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_fire_and_forget,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/haptic_session", TestFixture, NULL,
+             (gpointer)fixture_setup_haptic,
+             (gpointer)test_lfb_integration_haptic_session,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/haptic_vibrate_fd", TestFixture, NULL,
+             (gpointer)fixture_setup_haptic,
+             (gpointer)test_lfb_integration_haptic_vibrate_fd,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_retrigger", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_retrigger,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_prepare", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_prepare,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/event_many", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_event_many,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/peer", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_peer,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/peer_limit", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_peer_limit,
+             (gpointer)fixture_teardown);
+
   g_test_add("/feedbackd/lfb-integration/profile", TestFixture, NULL,
              (gpointer)fixture_setup,
              (gpointer)test_lfb_integration_profile,
              (gpointer)fixture_teardown);
 
+  g_test_add("/feedbackd/lfb-integration/trigger_ex", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_trigger_ex,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/end_feedbacks", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_end_feedbacks,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/end_foreign", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_end_foreign,
+             (gpointer)fixture_teardown);
+
+  g_test_add("/feedbackd/lfb-integration/capabilities", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_capabilities,
+             (gpointer)fixture_teardown);
+  g_test_add("/feedbackd/lfb-integration/threads", TestFixture, NULL,
+             (gpointer)fixture_setup,
+             (gpointer)test_lfb_integration_threads,
+             (gpointer)fixture_teardown);
+  g_test_add("/feedbackd/lfb-integration/init_async", TestFixture, NULL,
+             (gpointer)fixture_setup_uninitted,
+             (gpointer)test_lfb_integration_init_async,
+             (gpointer)fixture_teardown);
+  g_test_add("/feedbackd/lfb-integration/init_lazy", TestFixture, NULL,
+             (gpointer)fixture_setup_uninitted,
+             (gpointer)test_lfb_integration_init_lazy,
+             (gpointer)fixture_teardown);
+  g_test_add("/feedbackd/lfb-integration/init_lazy_sync", TestFixture, NULL,
+             (gpointer)fixture_setup_uninitted,
+             (gpointer)test_lfb_integration_init_lazy_sync,
+             (gpointer)fixture_teardown);
+  g_test_add("/feedbackd/lfb-integration/fbcli_load", TestFixture, NULL,
+             (gpointer)fixture_setup_uninitted,
+             (gpointer)test_lfb_integration_fbcli_load,
+             (gpointer)fixture_teardown);
+
   return g_test_run();
 }
@@ -7,6 +7,8 @@
 
 #include "testlib.h"
 
+#include <sys/socket.h>
+
 void
 fbd_test_umockdev_setup (FbdUmockdevFixture *fixture, gconstpointer mockname)
 {
@@ -31,3 +33,47 @@ fbd_test_umockdev_teardown (FbdUmockdevFixture *fixture, gconstpointer unused)
   umockdev_testbed_clear (fixture->testbed);
   umockdev_testbed_disable (fixture->testbed);
 }
+
+
+static void
+on_connection_new (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GDBusConnection **conn = user_data;
+  g_autoptr (GError) err = NULL;
+
+  *conn = g_dbus_connection_new_finish (res, &err);
+  g_assert_no_error (err);
+}
+
+
+/* The server side only processes messages once started so objects can be exported first */
+void
+fbd_test_new_connection_pair (GDBusConnection **server, GDBusConnection **client)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *guid = g_dbus_generate_guid ();
+  int fds[2];
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), ==, 0);
+
+  for (int i = 0; i < 2; i++) {
+    g_autoptr (GSocket) socket = g_socket_new_from_fd (fds[i], &err);
+    g_autoptr (GSocketConnection) stream = NULL;
+
+    g_assert_no_error (err);
+    stream = g_socket_connection_factory_create_connection (socket);
+    g_dbus_connection_new (G_IO_STREAM (stream),
+                           i == 0 ? guid : NULL,
+                           i == 0 ?
+                           G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER |
+                           G_DBUS_CONNECTION_FLAGS_DELAY_MESSAGE_PROCESSING :
+                           G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                           NULL,
+                           NULL,
+                           on_connection_new,
+                           i == 0 ? server : client);
+  }
+
+  while (*server == NULL || *client == NULL)
+    g_main_context_iteration (NULL, TRUE);
+}
@@ -3,7 +3,7 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
-#include <glib.h>
+#include <gio/gio.h>
 #include <umockdev.h>
 
 #pragma once
@@ -17,6 +17,7 @@ typedef struct _FbdUdevMockFixture {
 
 void fbd_test_umockdev_setup (FbdUmockdevFixture *fixture, gconstpointer mockname);
 void fbd_test_umockdev_teardown (FbdUmockdevFixture *fixture, gconstpointer unused);
+void fbd_test_new_connection_pair (GDBusConnection **server, GDBusConnection **client);
 
 #define FBD_UMOCKDEV_TEST_ADD(name, func, f) g_test_add ((name), FbdUmockdevFixture, (f),  \
                                                          (gpointer)fbd_test_umockdev_setup, \
@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * An emulated force feedback device for umockdev test beds. umockdev
+ * only provides the device node so the ioctl() and write() calls on it
+ * are handled here. These replace the C library's functions in the
+ * test binary and pass everything else on.
+ */
+
+#define _GNU_SOURCE
+
+#include "vibralib.h"
+
+#include <glib/gstdio.h>
+#include <gudev/gudev.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#define TEST_WAIT_TIMEOUT (5 * G_USEC_PER_SEC)
+
+struct _FbdTestVibra {
+  UMockdevTestbed *testbed;
+  char            *sysfs_path;
+  GUdevClient     *client;
+  dev_t            dev;
+  ino_t            ino;
+
+  /* Protects everything below, the haptic thread talks to the device too */
+  GMutex           lock;
+  gboolean         uploaded[FBD_TEST_VIBRA_MAX_EFFECTS];
+  struct ff_effect effects[FBD_TEST_VIBRA_MAX_EFFECTS];
+  gboolean         playing[FBD_TEST_VIBRA_MAX_EFFECTS];
+  guint            max_effects;
+  guint            n_uploads;
+  guint            n_updates;
+  guint            n_erases;
+  guint            n_plays;
+  guint            n_gains;
+  int              gain;
+};
+
+/* Only one device at a time */
+static FbdTestVibra *test_vibra;
+
+
+static gboolean
+is_test_vibra_fd (int fd)
+{
+  FbdTestVibra *self = g_atomic_pointer_get (&test_vibra);
+  struct stat st;
+
+  if (self == NULL || fstat (fd, &st) == -1)
+    return FALSE;
+
+  return st.st_dev == self->dev && st.st_ino == self->ino;
+}
+
+
+static int
+handle_set_effect (FbdTestVibra *self, struct ff_effect *effect)
+{
+  if (effect->id == -1) {
+    for (guint i = 0; i < self->max_effects; i++) {
+      if (self->uploaded[i])
+        continue;
+
+      effect->id = i;
+      self->uploaded[i] = TRUE;
+      self->effects[i] = *effect;
+      self->n_uploads++;
+      return 0;
+    }
+    errno = ENOSPC;
+    return -1;
+  }
+
+  /* Updating an existing effect, this works while it plays */
+  if (effect->id < 0 || effect->id >= self->max_effects || !self->uploaded[effect->id]) {
+    errno = EINVAL;
+    return -1;
+  }
+  self->effects[effect->id] = *effect;
+  self->n_updates++;
+  return 0;
+}
+
+
+static int
+handle_ioctl_locked (FbdTestVibra *self, unsigned long request, void *arg)
+{
+  int id;
+
+  if (_IOC_DIR (request) == _IOC_READ && _IOC_NR (request) == _IOC_NR (EVIOCGBIT (EV_FF, 0))) {
+    unsigned long *features = arg;
+    const int bits[] = { FF_RUMBLE, FF_PERIODIC, FF_CONSTANT, FF_CUSTOM, FF_SINE, FF_GAIN };
+    guint size = _IOC_SIZE (request);
+
+    memset (features, 0, size);
+    for (guint i = 0; i < G_N_ELEMENTS (bits); i++) {
+      guint word = bits[i] / (8 * sizeof (unsigned long));
+
+      g_assert_cmpuint ((word + 1) * sizeof (unsigned long), <=, size);
+      features[word] |= 1UL << (bits[i] % (8 * sizeof (unsigned long)));
+    }
+    return size;
+  }
+
+  switch (request) {
+  case EVIOCGEFFECTS:
+    *(int *)arg = self->max_effects;
+    return 0;
+  case EVIOCSFF:
+    return handle_set_effect (self, arg);
+  case EVIOCRMFF:
+    id = (int)(intptr_t)arg;
+    if (id < 0 || id >= self->max_effects || !self->uploaded[id]) {
+      errno = EINVAL;
+      return -1;
+    }
+    self->uploaded[id] = FALSE;
+    self->playing[id] = FALSE;
+    self->n_erases++;
+    return 0;
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+
+static ssize_t
+handle_write_locked (FbdTestVibra *self, const void *buf, size_t count)
+{
+  const struct input_event *events = buf;
+
+  if (count % sizeof (struct input_event)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (guint i = 0; i < count / sizeof (struct input_event); i++) {
+    const struct input_event *event = &events[i];
+
+    if (event->type != EV_FF) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (event->code == FF_GAIN) {
+      self->gain = event->value;
+      self->n_gains++;
+      continue;
+    }
+
+    if (event->code >= self->max_effects || !self->uploaded[event->code]) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    self->playing[event->code] = !!event->value;
+    if (event->value)
+      self->n_plays++;
+  }
+
+  return count;
+}
+
+
+int
+ioctl (int fd, unsigned long request, ...)
+{
+  static gsize real_ioctl;
+  va_list ap;
+  void *arg;
+
+  va_start (ap, request);
+  arg = va_arg (ap, void *);
+  va_end (ap);
+
+  if (_IOC_TYPE (request) == 'E' && is_test_vibra_fd (fd)) {
+    int ret;
+
+    g_mutex_lock (&test_vibra->lock);
+    ret = handle_ioctl_locked (test_vibra, request, arg);
+    g_mutex_unlock (&test_vibra->lock);
+    return ret;
+  }
+
+  if (g_once_init_enter (&real_ioctl))
+    g_once_init_leave (&real_ioctl, (gsize) dlsym (RTLD_NEXT, "ioctl"));
+
+  return ((int (*) (int, unsigned long, ...)) real_ioctl) (fd, request, arg);
+}
+
+
+ssize_t
+write (int fd, const void *buf, size_t count)
+{
+  static gsize real_write;
+
+  if (is_test_vibra_fd (fd)) {
+    ssize_t ret;
+
+    g_mutex_lock (&test_vibra->lock);
+    ret = handle_write_locked (test_vibra, buf, count);
+    g_mutex_unlock (&test_vibra->lock);
+    return ret;
+  }
+
+  if (g_once_init_enter (&real_write))
+    g_once_init_leave (&real_write, (gsize) dlsym (RTLD_NEXT, "write"));
+
+  return ((ssize_t (*) (int, const void *, size_t)) real_write) (fd, buf, count);
+}
+
+/**
+ * fbd_test_vibra_new:
+ * @testbed: The umockdev test bed
+ * @name: The name of the device node, e.g. `event0`
+ * @n_effects: The number of effects the device can hold
+ *
+ * Adds a haptic motor to the test bed.
+ *
+ * Returns: The emulated device
+ */
+FbdTestVibra *
+fbd_test_vibra_new (UMockdevTestbed *testbed, const char *name, guint n_effects)
+{
+  g_autofree char *devname = g_strdup_printf ("/dev/input/%s", name);
+  g_autofree char *node = NULL;
+  FbdTestVibra *self;
+  struct stat st;
+
+  g_assert_null (test_vibra);
+  g_assert_cmpuint (n_effects, <=, FBD_TEST_VIBRA_MAX_EFFECTS);
+
+  self = g_new0 (FbdTestVibra, 1);
+  g_mutex_init (&self->lock);
+  self->testbed = g_object_ref (testbed);
+  self->max_effects = n_effects;
+  self->gain = -1;
+
+  self->sysfs_path = umockdev_testbed_add_device (testbed, "input", name, NULL,
+                                                  /* attributes */
+                                                  NULL,
+                                                  /* properties */
+                                                  "DEVNAME", devname,
+                                                  "FEEDBACKD_TYPE", "vibra",
+                                                  NULL);
+  g_assert_nonnull (self->sysfs_path);
+
+  /* The node is a plain file, ioctls and writes are told apart by it */
+  node = g_build_filename (umockdev_testbed_get_root_dir (testbed), devname, NULL);
+  if (!g_file_test (node, G_FILE_TEST_EXISTS)) {
+    g_autofree char *dir = g_path_get_dirname (node);
+
+    g_assert_cmpint (g_mkdir_with_parents (dir, 0755), ==, 0);
+    g_assert_true (g_file_set_contents (node, "", 0, NULL));
+  }
+  g_assert_cmpint (g_stat (node, &st), ==, 0);
+  self->dev = st.st_dev;
+  self->ino = st.st_ino;
+
+  self->client = g_udev_client_new (NULL);
+  g_atomic_pointer_set (&test_vibra, self);
+
+  return self;
+}
+
+
+void
+fbd_test_vibra_free (FbdTestVibra *self)
+{
+  g_assert_true (test_vibra == self);
+
+  g_atomic_pointer_set (&test_vibra, NULL);
+  g_clear_object (&self->client);
+  g_clear_object (&self->testbed);
+  g_free (self->sysfs_path);
+  g_mutex_clear (&self->lock);
+  g_free (self);
+}
+
+/**
+ * fbd_test_vibra_remove:
+ * @self: The emulated device
+ *
+ * Unplugs the device. Its effects are gone and it doesn't handle
+ * requests anymore, it can't be added back.
+ */
+void
+fbd_test_vibra_remove (FbdTestVibra *self)
+{
+  umockdev_testbed_uevent (self->testbed, self->sysfs_path, "remove");
+  umockdev_testbed_remove_device (self->testbed, self->sysfs_path);
+
+  g_mutex_lock (&self->lock);
+  self->ino = 0;
+  memset (self->uploaded, 0, sizeof (self->uploaded));
+  memset (self->playing, 0, sizeof (self->playing));
+  g_mutex_unlock (&self->lock);
+}
+
+
+const char *
+fbd_test_vibra_get_sysfs_path (FbdTestVibra *self)
+{
+  return self->sysfs_path;
+}
+
+/**
+ * fbd_test_vibra_get_udev_device:
+ * @self: The emulated device
+ *
+ * Returns:(transfer full): The device's udev device
+ */
+GUdevDevice *
+fbd_test_vibra_get_udev_device (FbdTestVibra *self)
+{
+  GUdevDevice *device;
+
+  device = g_udev_client_query_by_sysfs_path (self->client, self->sysfs_path);
+  g_assert_nonnull (device);
+
+  return device;
+}
+
+
+guint
+fbd_test_vibra_get_n_uploads (FbdTestVibra *self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->n_uploads;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+
+guint
+fbd_test_vibra_get_n_updates (FbdTestVibra *self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->n_updates;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+
+guint
+fbd_test_vibra_get_n_erases (FbdTestVibra *self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->n_erases;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+
+guint
+fbd_test_vibra_get_n_plays (FbdTestVibra *self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->n_plays;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+/**
+ * fbd_test_vibra_get_n_gains:
+ * @self: The emulated device
+ *
+ * Returns: How often the gain was written
+ */
+guint
+fbd_test_vibra_get_n_gains (FbdTestVibra *self)
+{
+  guint ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->n_gains;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+/**
+ * fbd_test_vibra_get_n_effects:
+ * @self: The emulated device
+ *
+ * Returns: The number of effects uploaded to the device
+ */
+guint
+fbd_test_vibra_get_n_effects (FbdTestVibra *self)
+{
+  guint n = 0;
+
+  g_mutex_lock (&self->lock);
+  for (guint i = 0; i < self->max_effects; i++)
+    n += !!self->uploaded[i];
+  g_mutex_unlock (&self->lock);
+
+  return n;
+}
+
+/**
+ * fbd_test_vibra_get_gain:
+ * @self: The emulated device
+ *
+ * Returns: The last gain written to the device or `-1`
+ */
+int
+fbd_test_vibra_get_gain (FbdTestVibra *self)
+{
+  int ret;
+
+  g_mutex_lock (&self->lock);
+  ret = self->gain;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+}
+
+/**
+ * fbd_test_vibra_get_playing:
+ * @self: The emulated device
+ *
+ * Returns: The id of the playing effect with the lowest id or `-1`
+ */
+int
+fbd_test_vibra_get_playing (FbdTestVibra *self)
+{
+  int id = -1;
+
+  g_mutex_lock (&self->lock);
+  for (guint i = 0; i < self->max_effects; i++) {
+    if (self->playing[i]) {
+      id = i;
+      break;
+    }
+  }
+  g_mutex_unlock (&self->lock);
+
+  return id;
+}
+
+/**
+ * fbd_test_vibra_get_magnitude:
+ * @self: The emulated device
+ * @id: The effect's id
+ *
+ * Returns: The strong magnitude of the uploaded rumble effect
+ */
+guint16
+fbd_test_vibra_get_magnitude (FbdTestVibra *self, int id)
+{
+  struct ff_effect effect;
+
+  g_assert_cmpint (id, >=, 0);
+  g_assert_cmpint (id, <, self->max_effects);
+
+  g_mutex_lock (&self->lock);
+  g_assert_true (self->uploaded[id]);
+  effect = self->effects[id];
+  g_mutex_unlock (&self->lock);
+
+  g_assert_cmpint (effect.type, ==, FF_RUMBLE);
+  return effect.u.rumble.strong_magnitude;
+}
+
+
+/* The haptic thread talks to the device asynchronously */
+static void
+wait_for (FbdTestVibra *self, gboolean (*done) (FbdTestVibra *self, guint n), guint n)
+{
+  gint64 end = g_get_monotonic_time () + TEST_WAIT_TIMEOUT;
+
+  while (!done (self, n)) {
+    g_assert_cmpint (g_get_monotonic_time (), <, end);
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+  }
+}
+
+
+static gboolean
+has_plays (FbdTestVibra *self, guint n_plays)
+{
+  return fbd_test_vibra_get_n_plays (self) >= n_plays;
+}
+
+
+static gboolean
+is_stopped (FbdTestVibra *self, guint unused)
+{
+  return fbd_test_vibra_get_playing (self) == -1;
+}
+
+
+void
+fbd_test_vibra_wait_for_plays (FbdTestVibra *self, guint n_plays)
+{
+  wait_for (self, has_plays, n_plays);
+}
+
+
+void
+fbd_test_vibra_wait_until_stopped (FbdTestVibra *self)
+{
+  wait_for (self, is_stopped, 0);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2025 Phosh.mobi e.V.
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include <gio/gio.h>
+#include <gudev/gudev.h>
+#include <umockdev.h>
+
+#include <linux/input.h>
+
+#pragma once
+
+G_BEGIN_DECLS
+
+#define FBD_TEST_VIBRA_MAX_EFFECTS 16
+
+typedef struct _FbdTestVibra FbdTestVibra;
+
+FbdTestVibra *fbd_test_vibra_new (UMockdevTestbed *testbed, const char *name, guint n_effects);
+void          fbd_test_vibra_free (FbdTestVibra *self);
+void          fbd_test_vibra_remove (FbdTestVibra *self);
+const char   *fbd_test_vibra_get_sysfs_path (FbdTestVibra *self);
+GUdevDevice  *fbd_test_vibra_get_udev_device (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_uploads (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_updates (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_erases (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_plays (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_gains (FbdTestVibra *self);
+guint         fbd_test_vibra_get_n_effects (FbdTestVibra *self);
+int           fbd_test_vibra_get_gain (FbdTestVibra *self);
+int           fbd_test_vibra_get_playing (FbdTestVibra *self);
+guint16       fbd_test_vibra_get_magnitude (FbdTestVibra *self, int id);
+void          fbd_test_vibra_wait_for_plays (FbdTestVibra *self, guint n_plays);
+void          fbd_test_vibra_wait_until_stopped (FbdTestVibra *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FbdTestVibra, fbd_test_vibra_free)
+
+G_END_DECLS